@@ -0,0 +1,122 @@
+// Compute bloom mip pyramid for King (D3D11), see PostProcessD3D11 (bloom passes).
+//
+// Downsample: level 0 is half the scene resolution, each further level half the previous.
+// Every destination texel takes the 13-tap filter from "Next Generation Post Processing in
+// Call of Duty: Advanced Warfare": five overlapping 2x2 boxes of bilinear taps, so one level
+// step is a wide, stable blur instead of a 2x2 box. The first step (gPrefilter) also applies
+// the bright-pass threshold and weights each box by 1 / (1 + luma) (Karis average) to keep
+// single very bright pixels from flickering.
+//
+// Upsample: walks the chain back up, each level = its downsample + a 3x3 tent of the level
+// below. Level 0 of the up chain is the bloom the composite reads; it holds the sum of all
+// levels, so PostProcessD3D11 divides bloomIntensity by the level count.
+//
+// Under dynamic resolution only the top-left gDstSize texels of each level are used.
+// Level textures are exact halves of each other, so a texel's UV in its own texture is also
+// where it sits in the level above; taps are clamped to the source's used region (gSrcUvMax).
+//
+// Binding contract:
+//   b0: BloomCB
+//   t0: source level (downsample: previous level or scene color; upsample: the level below)
+//   t1: upsample only, the downsample level of the destination's size
+//   u0: destination level
+//   s0: linear clamp
+//   Dispatch: (ceil(w / 8), ceil(h / 8), 1) of the destination
+
+cbuffer BloomCB : register(b0)
+{
+    uint2 gDstSize;        // used region of the destination
+    float2 gInvSrcSize;    // source texel size (of the whole texture)
+    float gThreshold;
+    uint gPrefilter;
+    float gUpsampleRadius; // tent radius in source texels
+    float _padBloom;
+
+    float2 gInvDstTexSize;
+    float2 gSrcUvMax;      // last usable source UV (half a texel inside its used region)
+};
+
+Texture2D<float4> gSrc : register(t0);
+Texture2D<float4> gLevel : register(t1);
+RWTexture2D<float4> gDst : register(u0);
+SamplerState gLinearClamp : register(s0);
+
+float3 Tap(float2 uv, float2 offset)
+{
+    return gSrc.SampleLevel(gLinearClamp, min(uv + offset * gInvSrcSize, gSrcUvMax), 0).rgb;
+}
+
+float KarisWeight(float3 c)
+{
+    return 1.0 / (1.0 + dot(c, float3(0.2126, 0.7152, 0.0722)));
+}
+
+float3 BrightPass(float3 c)
+{
+    return max(c - max(gThreshold, 0.0).xxx, 0.0);
+}
+
+[numthreads(8, 8, 1)]
+void CSBloomDownsampleMain(uint3 id : SV_DispatchThreadID)
+{
+    if (any(id.xy >= gDstSize))
+        return;
+
+    const float2 uv = (float2(id.xy) + 0.5) * gInvDstTexSize;
+
+    const float3 a = Tap(uv, float2(-2.0, -2.0));
+    const float3 b = Tap(uv, float2(0.0, -2.0));
+    const float3 c = Tap(uv, float2(2.0, -2.0));
+    const float3 d = Tap(uv, float2(-1.0, -1.0));
+    const float3 e = Tap(uv, float2(1.0, -1.0));
+    const float3 f = Tap(uv, float2(-2.0, 0.0));
+    const float3 g = Tap(uv, float2(0.0, 0.0));
+    const float3 h = Tap(uv, float2(2.0, 0.0));
+    const float3 i = Tap(uv, float2(-1.0, 1.0));
+    const float3 j = Tap(uv, float2(1.0, 1.0));
+    const float3 k = Tap(uv, float2(-2.0, 2.0));
+    const float3 l = Tap(uv, float2(0.0, 2.0));
+    const float3 m = Tap(uv, float2(2.0, 2.0));
+
+    // The inner box carries half the weight, the four corner boxes an eighth each.
+    float3 boxes[5] = {
+        (d + e + i + j) * 0.25,
+        (a + b + f + g) * 0.25,
+        (b + c + g + h) * 0.25,
+        (f + g + k + l) * 0.25,
+        (g + h + l + m) * 0.25,
+    };
+    const float weights[5] = { 0.5, 0.125, 0.125, 0.125, 0.125 };
+
+    float3 sum = 0.0;
+    float wsum = 0.0;
+    [unroll]
+    for (uint n = 0; n < 5; ++n)
+    {
+        float w = weights[n];
+        if (gPrefilter != 0u)
+        {
+            boxes[n] = BrightPass(boxes[n]);
+            w *= KarisWeight(boxes[n]);
+        }
+        sum += boxes[n] * w;
+        wsum += w;
+    }
+    gDst[id.xy] = float4(sum / max(wsum, 1e-6), 1.0);
+}
+
+[numthreads(8, 8, 1)]
+void CSBloomUpsampleMain(uint3 id : SV_DispatchThreadID)
+{
+    if (any(id.xy >= gDstSize))
+        return;
+
+    const float2 uv = (float2(id.xy) + 0.5) * gInvDstTexSize;
+    const float r = max(gUpsampleRadius, 0.0);
+
+    float3 tent = Tap(uv, float2(0.0, 0.0)) * 4.0;
+    tent += (Tap(uv, float2(-r, 0.0)) + Tap(uv, float2(r, 0.0)) + Tap(uv, float2(0.0, -r)) + Tap(uv, float2(0.0, r))) * 2.0;
+    tent += Tap(uv, float2(-r, -r)) + Tap(uv, float2(r, -r)) + Tap(uv, float2(-r, r)) + Tap(uv, float2(r, r));
+
+    gDst[id.xy] = float4(gLevel.Load(int3(id.xy, 0)).rgb + tent * (1.0 / 16.0), 1.0);
+}
@@ -0,0 +1,165 @@
+// GPU instance culling for King (D3D11), see GpuCullingD3D11.
+//
+// One thread per instance: frustum test of its bounding sphere, LOD pick from its projected
+// size (SelectMeshLod), then an atomic append to the args of its bucket's level and a copy of
+// the instance into that level's compacted range.
+// Optionally the sphere is also tested against a max-depth (Hi-Z) pyramid built from an earlier
+// frame's depth buffer (CSHiZDownsampleMain).
+//
+// Binding contract:
+//   b0: CullCB
+//   t0: CullInstance records, t1: source instances (raw), t2: Hi-Z pyramid (all mips)
+//   u0: compacted instances (raw, bound as the instance vertex buffer afterwards)
+//   u1: draw args, 5 uints per bucket and level; InstanceCount is the second uint in both the indexed
+//       and the non-indexed layout
+//   Hi-Z downsample: b1 HiZCB, t3 source level, u2 destination level
+
+cbuffer CullCB : register(b0)
+{
+    float4 gPlanes[6];   // left, right, bottom, top, near, far; inside: dot(n, p) + d >= 0
+    uint gInstanceCount;
+    uint gInstanceStride; // bytes, multiple of 8
+    uint gThreadsPerRow;
+    uint gOcclusion;
+    row_major float4x4 gHiZViewProj; // matrix the pyramid's depth was rendered with
+    float2 gHiZScreenSize;           // rendered size of that depth buffer in pixels
+    uint gHiZMipCount;
+    float gLodPxPerUnit;             // 0 = always level 0
+    float4 gLodWRow;                 // clip-space w column of the view-projection
+};
+
+struct CullInstance
+{
+    float4 sphere; // world center + radius; radius < 0 = never drawn
+    uint argsFirst;  // args record of level 0
+    uint dstFirst;   // compacted range of level 0; level l starts at dstFirst + l * lodStride
+    uint lodStride;
+    uint lodCount;
+    float4 lodMaxPixels; // levels 1..3
+};
+
+StructuredBuffer<CullInstance> gCullInstances : register(t0);
+ByteAddressBuffer gSrcInstances : register(t1);
+RWByteAddressBuffer gDstInstances : register(u0);
+RWByteAddressBuffer gDrawArgs : register(u1);
+Texture2D<float> gHiZ : register(t2);
+
+static const uint kArgsStride = 20;
+
+// True if the sphere is entirely behind the depth recorded in the pyramid. Conservative:
+// spheres crossing the near plane or leaving the recorded view are kept.
+bool OccludedByHiZ(float4 sphere)
+{
+    float3 ndcMin = float3(1e30f, 1e30f, 1e30f);
+    float3 ndcMax = float3(-1e30f, -1e30f, -1e30f);
+    [unroll]
+    for (uint c = 0; c < 8; ++c)
+    {
+        const float3 corner = sphere.xyz + sphere.w * float3((c & 1) ? 1.0f : -1.0f, (c & 2) ? 1.0f : -1.0f, (c & 4) ? 1.0f : -1.0f);
+        const float4 clip = mul(float4(corner, 1.0f), gHiZViewProj);
+        if (clip.w <= 1e-5f)
+            return false;
+        const float3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+    if (ndcMin.z <= 0.0f || any(ndcMin.xy < -1.0f) || any(ndcMax.xy > 1.0f))
+        return false;
+
+    // Pixel rect in the source depth buffer (y down).
+    const float2 uvMin = float2(ndcMin.x, -ndcMax.y) * 0.5f + 0.5f;
+    const float2 uvMax = float2(ndcMax.x, -ndcMin.y) * 0.5f + 0.5f;
+    const uint2 pxMin = (uint2)clamp(uvMin * gHiZScreenSize, 0.0f, gHiZScreenSize - 1.0f);
+    const uint2 pxMax = (uint2)clamp(uvMax * gHiZScreenSize, 0.0f, gHiZScreenSize - 1.0f);
+
+    // Finest level where the rect spans at most 2x2 texels (a level-m texel covers 2^(m+1) px).
+    uint mip = 0;
+    [loop]
+    while (mip + 1 < gHiZMipCount)
+    {
+        const uint2 span = (pxMax >> (mip + 1)) - (pxMin >> (mip + 1));
+        if (span.x <= 1 && span.y <= 1)
+            break;
+        ++mip;
+    }
+
+    uint mipW, mipH, mipLevels;
+    gHiZ.GetDimensions(mip, mipW, mipH, mipLevels);
+    const uint2 lo = min(pxMin >> (mip + 1), uint2(mipW - 1, mipH - 1));
+    const uint2 hi = min(pxMax >> (mip + 1), uint2(mipW - 1, mipH - 1));
+    const float maxDepth = max(max(gHiZ.Load(int3(lo.x, lo.y, mip)), gHiZ.Load(int3(hi.x, lo.y, mip))),
+                               max(gHiZ.Load(int3(lo.x, hi.y, mip)), gHiZ.Load(int3(hi.x, hi.y, mip))));
+    return ndcMin.z > maxDepth;
+}
+
+[numthreads(64, 1, 1)]
+void CSCullInstancesMain(uint3 id : SV_DispatchThreadID)
+{
+    const uint i = id.y * gThreadsPerRow + id.x;
+    if (i >= gInstanceCount)
+        return;
+
+    const CullInstance ci = gCullInstances[i];
+    if (ci.sphere.w < 0.0f)
+        return;
+
+    [unroll]
+    for (uint p = 0; p < 6; ++p)
+    {
+        if (dot(gPlanes[p].xyz, ci.sphere.xyz) + gPlanes[p].w < -ci.sphere.w)
+            return;
+    }
+
+    if (gOcclusion != 0 && OccludedByHiZ(ci.sphere))
+        return;
+
+    uint lod = 0;
+    if (ci.lodCount > 1 && gLodPxPerUnit > 0.0f)
+    {
+        const float w = dot(float4(ci.sphere.xyz, 1.0f), gLodWRow);
+        const float px = (w > 1e-4f) ? 2.0f * ci.sphere.w * gLodPxPerUnit / w : 3.4e38f;
+        [unroll]
+        for (uint l = 1; l < 4; ++l)
+        {
+            if (l < ci.lodCount && lod == l - 1 && px < ci.lodMaxPixels[l - 1])
+                lod = l;
+        }
+    }
+
+    uint slot;
+    gDrawArgs.InterlockedAdd((ci.argsFirst + lod) * kArgsStride + 4, 1, slot);
+
+    const uint src = i * gInstanceStride;
+    const uint dst = (ci.dstFirst + lod * ci.lodStride + slot) * gInstanceStride;
+    for (uint o = 0; o < gInstanceStride; o += 8)
+        gDstInstances.Store2(dst + o, gSrcInstances.Load2(src + o));
+}
+
+// --------------------------------------------------------------------------------------------
+// Hi-Z pyramid: each texel is the max of the 2x2 source texels it covers (sizes round up, so an
+// odd source's last row/column is read once, clamped).
+
+cbuffer HiZCB : register(b1)
+{
+    uint2 gSrcSize;
+    uint2 gDstSize;
+};
+
+// Separate registers from the cull pass so both entry points share one file cleanly.
+Texture2D<float> gHiZSrc : register(t3);
+RWTexture2D<float> gHiZDst : register(u2);
+
+[numthreads(8, 8, 1)]
+void CSHiZDownsampleMain(uint3 id : SV_DispatchThreadID)
+{
+    if (any(id.xy >= gDstSize))
+        return;
+
+    const uint2 base = id.xy * 2;
+    const uint2 last = gSrcSize - 1;
+    const float d0 = gHiZSrc.Load(int3(min(base, last), 0));
+    const float d1 = gHiZSrc.Load(int3(min(base + uint2(1, 0), last), 0));
+    const float d2 = gHiZSrc.Load(int3(min(base + uint2(0, 1), last), 0));
+    const float d3 = gHiZSrc.Load(int3(min(base + uint2(1, 1), last), 0));
+    gHiZDst[id.xy] = max(max(d0, d1), max(d2, d3));
+}
@@ -7,6 +7,21 @@
 #define KING_SHADING_MODEL 0
 #endif
 
+// Directional shadow filter of each cascade (0 hard .. 4 PCSS, see RenderSettings::
+// cascadeFilterQuality) and the adaptive early-out, fixed per permutation (ShadowsD3D11::FilterDefines).
+#ifndef KING_SHADOW_FILTER0
+#define KING_SHADOW_FILTER0 1
+#endif
+#ifndef KING_SHADOW_FILTER1
+#define KING_SHADOW_FILTER1 KING_SHADOW_FILTER0
+#endif
+#ifndef KING_SHADOW_FILTER2
+#define KING_SHADOW_FILTER2 KING_SHADOW_FILTER1
+#endif
+#ifndef KING_SHADOW_ADAPTIVE
+#define KING_SHADOW_ADAPTIVE 0
+#endif
+
 #define MAX_LIGHTS 16
 
 cbuffer CameraCB : register(b0)
@@ -19,24 +34,33 @@ cbuffer CameraCB : register(b0)
     float3 _padPost;
 };
 
-// Frozen material uniform layout (instances differ only by values).
-cbuffer MaterialCB : register(b4)
+// Frozen material parameter layout, one entry per material (instances differ only by values).
+// Indexed by the material id in the top 16 bits of the instance flags, so one draw can mix
+// materials that share program and textures.
+struct MaterialData
 {
-    float4 gMatBaseColor;
-    float3 gMatEmissive;
-    float gMatRoughness;
+    float4 baseColor;
+    float3 emissive;
+    float roughness;
 
-    float gMatMetallic;
-    uint gMatFlags;
-    float2 _padMat;
+    float metallic;
+    uint flags;
+    float2 _pad;
 };
 
+StructuredBuffer<MaterialData> gMaterials : register(t14);
+
+MaterialData LoadMaterial(uint instanceFlags)
+{
+    return gMaterials[instanceFlags >> 16];
+}
+
 struct LightData
 {
     uint type;
     uint groupMask;
-    uint _padU0;
-    uint _padU1;
+    uint flags; // bit0 = has ready shadow-atlas tiles, starting at shadowFace
+    uint shadowFace;
 
     float3 color;
     float intensity;
@@ -60,7 +84,7 @@ cbuffer LightCB : register(b1)
     row_major float4x4 gLightViewProj[3];
     float4 gCascadeSplitsNdc; // x=split1, y=split2, z=split3(typically 1), w=unused
     uint gCascadeCount;
-    float3 _padCsm;
+    float3 gCascadeUvScale; // used fraction of each slice (cascades may render below the map size)
 
     float2 gShadowTexelSize;
     float gShadowBias;
@@ -71,16 +95,47 @@ cbuffer LightCB : register(b1)
 
     // x=fadeStartNdc, y=fadeEndNdc, z=shadowSoftness, w=shadowFlags (packed as float)
     float4 gShadowExtras;
-    // Point shadow params:
+    // Point/spot shadow params:
     // x = enabled (0/1)
     // y = bias (world units)
-    // z = invFar (1/range)
+    // z = unused (range is per face)
     // w = strength (0..1)
     float4 gPointShadowParams;
-    float2 gPointShadowTexelSize;
+    float2 gPointShadowTexelSize; // 1 / atlas size
     float2 _padPointShadow;
+
+    // Camera the cascades were fitted to. Equals gViewProj except in secondary views, which
+    // reuse the main view's cascades.
+    row_major float4x4 gShadowCameraViewProj;
+};
+
+// Clustered point/spot lights (see LightClusters on the C++ side). Directional lights stay in
+// LightCB; everything else is looked up through the froxel containing the pixel.
+cbuffer ClusterCB : register(b5)
+{
+    float4 gClusterViewZ;     // view depth = dot(float4(wpos, 1), gClusterViewZ)
+    float2 gClusterTileScale; // SV_Position.xy * scale + bias -> tile
+    float gClusterSliceScale;
+    float gClusterSliceBias;
+    uint3 gClusterDims;
+    uint gLocalLightCount;
+    float2 gClusterTileBias;  // viewports that do not start at the target's origin
+    float2 _padClusterTile;
 };
 
+StructuredBuffer<LightData> gLocalLights : register(t10);
+StructuredBuffer<uint2> gClusterRanges : register(t11); // (offset, count) into gClusterLightIndices
+StructuredBuffer<uint> gClusterLightIndices : register(t12);
+
+uint ClusterIndex(float4 svPos, float3 wpos)
+{
+    uint3 c;
+    c.xy = min((uint2)max(svPos.xy * gClusterTileScale + gClusterTileBias, 0.0), gClusterDims.xy - 1u);
+    const float viewZ = max(dot(float4(wpos, 1.0), gClusterViewZ), 1e-4);
+    c.z = (uint)clamp(floor(log(viewZ) * gClusterSliceScale + gClusterSliceBias), 0.0, (float)(gClusterDims.z - 1u));
+    return (c.z * gClusterDims.y + c.y) * gClusterDims.x + c.x;
+}
+
 cbuffer ShadowCB : register(b2)
 {
     row_major float4x4 gShadowViewProj;
@@ -90,8 +145,17 @@ Texture2DArray<float> gShadowMap : register(t0);
 SamplerComparisonState gShadowSamplerPoint : register(s0);
 SamplerComparisonState gShadowSamplerLinear : register(s1);
 SamplerState gShadowSamplerNonCmp : register(s3);
-// Point-light shadow cubemap (stores linear depth normalized: dist / far)
-TextureCube<float> gPointShadowMap : register(t9);
+// Point/spot shadow atlas (stores linear distance normalized: dist / range). A point light owns
+// six consecutive faces (+X, -X, +Y, -Y, +Z, -Z), a spot light one.
+struct ShadowFaceData
+{
+    row_major float4x4 viewProj;
+    float4 rect;     // atlas uv: xy = tile origin, zw = tile size
+    float3 lightPos; // as rendered; cached faces may lag the light
+    float invRange;
+};
+Texture2D<float> gShadowAtlas : register(t9);
+StructuredBuffer<ShadowFaceData> gShadowFaces : register(t13);
 SamplerState gPointShadowSampler : register(s5);
 
 // SSAO resources (used by SSAO/blur/tonemap passes)
@@ -110,35 +174,60 @@ struct VSPointShadowOut
 };
 
 // Minimal input for point-shadow pass. Must match the engine input layout.
+// Instance world matrix (slot 1, TEXCOORD4..6): its first three COLUMNS, the fourth being
+// (0, 0, 0, 1). In the engine's row-vector convention each output component is a dot product
+// against one column.
+static float4 InstanceWorldPos(float3 pos, float4 c0, float4 c1, float4 c2)
+{
+    const float4 p = float4(pos, 1.0);
+    return float4(dot(p, c0), dot(p, c1), dot(p, c2), 1.0);
+}
+
+// Normal through the inverse-transpose of world, rebuilt from the cofactors of its 3x3 part
+// (correct under non-uniform scale; the caller normalizes). Mirrored instances flip it back.
+static float3 InstanceWorldNormal(float3 n, float4 c0, float4 c1, float4 c2)
+{
+    const float3 r0 = float3(c0.x, c1.x, c2.x);
+    const float3 r1 = float3(c0.y, c1.y, c2.y);
+    const float3 r2 = float3(c0.z, c1.z, c2.z);
+    const float3 k0 = cross(r1, r2);
+    const float3 wn = n.x * k0 + n.y * cross(r2, r0) + n.z * cross(r0, r1);
+    return dot(r0, k0) < 0.0 ? -wn : wn;
+}
+
+// Cooked meshes store normals octahedrally (SNORM16 x2). Not normalized: InstanceWorldNormal's
+// caller does that.
+static float3 DecodeOctNormal(float2 e)
+{
+    float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+    const float t = saturate(-n.z);
+    n.xy += (n.xy >= 0.0) ? -t : t;
+    return n;
+}
+
 struct VSInPointShadow
 {
     float3 pos : POSITION;
-    float3 nrm : NORMAL;
+    float2 nrm : NORMAL;
 
-    // Per-instance transform rows (slot 1)
-    float4 iRow0 : TEXCOORD4;
-    float4 iRow1 : TEXCOORD5;
-    float4 iRow2 : TEXCOORD6;
-    float4 iRow3 : TEXCOORD7;
+    // Per-instance world matrix columns (slot 1)
+    float4 iCol0 : TEXCOORD4;
+    float4 iCol1 : TEXCOORD5;
+    float4 iCol2 : TEXCOORD6;
+
+    // Shadow instances carry their face slot (single-pass mode) instead of the usual flags.
+    uint iFlags : TEXCOORD10;
 };
 
+static float4 PointShadowWorldPos(VSInPointShadow v)
+{
+    return InstanceWorldPos(v.pos, v.iCol0, v.iCol1, v.iCol2);
+}
+
 VSPointShadowOut VSPointShadowMain(VSInPointShadow v)
 {
     VSPointShadowOut o;
-
-    float4 localPos = float4(v.pos, 1.0);
-
-    float4 col0 = float4(v.iRow0.x, v.iRow1.x, v.iRow2.x, v.iRow3.x);
-    float4 col1 = float4(v.iRow0.y, v.iRow1.y, v.iRow2.y, v.iRow3.y);
-    float4 col2 = float4(v.iRow0.z, v.iRow1.z, v.iRow2.z, v.iRow3.z);
-    float4 col3 = float4(v.iRow0.w, v.iRow1.w, v.iRow2.w, v.iRow3.w);
-
-    float4 wpos;
-    wpos.x = dot(localPos, col0);
-    wpos.y = dot(localPos, col1);
-    wpos.z = dot(localPos, col2);
-    wpos.w = dot(localPos, col3);
-
+    float4 wpos = PointShadowWorldPos(v);
     o.pos = mul(wpos, gPointShadowViewProj);
     o.wpos = wpos.xyz;
     return o;
@@ -150,43 +239,140 @@ float PSPointShadowMain(VSPointShadowOut i) : SV_TARGET
     return saturate(dist * gPointShadowInvFar);
 }
 
+// Single-pass shadow faces: up to 16 atlas tiles per pass, one viewport each. Every instance is
+// emitted once per face that sees it and is routed to that face's viewport.
+#define MAX_SHADOW_SLOTS 16
+
+cbuffer PointShadowSlotsCB : register(b8)
+{
+    row_major float4x4 gShadowSlotViewProj[MAX_SHADOW_SLOTS];
+    float4 gShadowSlotLight[MAX_SHADOW_SLOTS]; // xyz = light position, w = 1 / range
+};
+
+struct PointShadowSlotVSOut
+{
+    float4 pos : SV_POSITION;
+    float3 wpos : TEXCOORD0;
+    nointerpolation uint slot : TEXCOORD1;
+};
+
+struct PointShadowSlotOut
+{
+    float4 pos : SV_POSITION;
+    float3 wpos : TEXCOORD0;
+    nointerpolation uint slot : TEXCOORD1;
+    uint viewport : SV_ViewportArrayIndex;
+};
+
+// Needs VPAndRTArrayIndexFromAnyShaderFeedingRasterizer (D3D11.3 hardware).
+PointShadowSlotOut VSPointShadowLayeredMain(VSInPointShadow v)
+{
+    const uint slot = min(v.iFlags, (uint)(MAX_SHADOW_SLOTS - 1));
+    const float4 wpos = PointShadowWorldPos(v);
+
+    PointShadowSlotOut o;
+    o.pos = mul(wpos, gShadowSlotViewProj[slot]);
+    o.wpos = wpos.xyz;
+    o.slot = slot;
+    o.viewport = slot;
+    return o;
+}
+
+// Fallback: the viewport index is set by GSPointShadowMain.
+PointShadowSlotVSOut VSPointShadowReplicateMain(VSInPointShadow v)
+{
+    const uint slot = min(v.iFlags, (uint)(MAX_SHADOW_SLOTS - 1));
+    const float4 wpos = PointShadowWorldPos(v);
+
+    PointShadowSlotVSOut o;
+    o.pos = mul(wpos, gShadowSlotViewProj[slot]);
+    o.wpos = wpos.xyz;
+    o.slot = slot;
+    return o;
+}
+
+[maxvertexcount(3)]
+void GSPointShadowMain(triangle PointShadowSlotVSOut tri[3], inout TriangleStream<PointShadowSlotOut> stream)
+{
+    [unroll]
+    for (uint k = 0; k < 3; ++k)
+    {
+        PointShadowSlotOut o;
+        o.pos = tri[k].pos;
+        o.wpos = tri[k].wpos;
+        o.slot = tri[k].slot;
+        o.viewport = tri[0].slot;
+        stream.Append(o);
+    }
+}
+
+float PSPointShadowLayeredMain(PointShadowSlotOut i) : SV_TARGET
+{
+    const float4 light = gShadowSlotLight[i.slot];
+    return saturate(length(i.wpos - light.xyz) * light.w);
+}
+
+// Resets one atlas tile (viewport) to "nothing in range" before its face is re-rendered.
+struct ShadowTileClearOut
+{
+    float dist : SV_TARGET;
+    float depth : SV_DEPTH;
+};
+
+ShadowTileClearOut PSShadowTileClearMain(float4 pos : SV_POSITION)
+{
+    ShadowTileClearOut o;
+    o.dist = 1.0;
+    o.depth = 1.0;
+    return o;
+}
+
 // SSAO pass inputs
 Texture2D<float> gDepth : register(t3);
 Texture2D<float4> gNormal : register(t4);
 SamplerState gPointClamp : register(s2);
 
+// SSAO at reduced resolution (RenderSettings::ssaoQuality): depth/normal at AO resolution,
+// and the full-res depth for the bilateral upsample. History for temporal accumulation.
+Texture2D<float> gSsaoLowDepth : register(t15);
+Texture2D<float> gSsaoHistory : register(t16);
+
+// Shared with ssao_cs.hlsl; keep the layouts identical.
 cbuffer SsaoCB : register(b3)
 {
     row_major float4x4 gSsaoProj;
     row_major float4x4 gSsaoInvProj;
     row_major float4x4 gSsaoView;
-    float2 gSsaoInvTargetSize;
+    float2 gSsaoInvTargetSize; // AO target
     float gSsaoRadius;
     float gSsaoBias;
+
+    row_major float4x4 gSsaoReproject; // this frame's clip space -> last frame's (temporal)
+    uint2 gSsaoTargetSize;
+    uint2 gSsaoSourceSize;             // full-res depth / normal
+    float2 gSsaoNoiseOffset;           // rotates the sample kernel per frame (temporal)
+    float gSsaoTemporalBlend;          // weight of this frame; 1 = no history
+    uint gSsaoDownsample;              // 1, 2 or 4
+
+    float2 gSsaoUvScale;               // used / allocated size of AO-resolution targets
+    float2 _padSsao;
 };
 
 struct VSIn
 {
+    // Cooked vertex: position in [0, 1] over the mesh's quantization box (the instance matrix
+    // includes the dequantization) and an octahedral normal.
     float3 pos : POSITION;
-    float3 nrm : NORMAL;
-
-    // Per-instance data (slot 1)
-    float4 iRow0 : TEXCOORD4;
-    float4 iRow1 : TEXCOORD5;
-    float4 iRow2 : TEXCOORD6;
-    float4 iRow3 : TEXCOORD7;
+    float2 nrm : NORMAL;
 
-    // Inverse-transpose of world (for correct normals under non-uniform scale)
-    float4 nRow0 : TEXCOORD11;
-    float4 nRow1 : TEXCOORD12;
-    float4 nRow2 : TEXCOORD13;
-    float4 nRow3 : TEXCOORD14;
+    // Per-instance data (slot 1): world matrix columns (see InstanceWorldPos)
+    float4 iCol0 : TEXCOORD4;
+    float4 iCol1 : TEXCOORD5;
+    float4 iCol2 : TEXCOORD6;
 
-    float4 albedo : COLOR0;
-
-    float2 rm : TEXCOORD8;     // x=roughness, y=metallic (not fully used yet)
+    // Material parameters are not per instance: LoadMaterial(flags) reads them from t14.
     uint lightMask : TEXCOORD9;
-    uint flags : TEXCOORD10;   // bit0 receivesShadows
+    uint flags : TEXCOORD10;   // bit0 receivesShadows, bit1 castsShadows, bits 16..31 material id
 };
 
 struct VSOut
@@ -194,8 +380,6 @@ struct VSOut
     float4 pos : SV_POSITION;
     float3 wpos : TEXCOORD0;
     float3 nrm : TEXCOORD1;
-    float4 albedo : COLOR0;
-    float2 rm : TEXCOORD2;
     uint lightMask : TEXCOORD3;
     uint flags : TEXCOORD4;
 };
@@ -204,34 +388,13 @@ VSOut VSMain(VSIn v)
 {
     VSOut o;
 
-    // Treat iRow* as ROWS of the world matrix (as provided by C++).
-    float4 localPos = float4(v.pos, 1.0);
-
-    // mul(localPos, world) uses row-vector convention, so each output component
-    // is a dot against a COLUMN of the matrix.
-    float4 col0 = float4(v.iRow0.x, v.iRow1.x, v.iRow2.x, v.iRow3.x);
-    float4 col1 = float4(v.iRow0.y, v.iRow1.y, v.iRow2.y, v.iRow3.y);
-    float4 col2 = float4(v.iRow0.z, v.iRow1.z, v.iRow2.z, v.iRow3.z);
-    float4 col3 = float4(v.iRow0.w, v.iRow1.w, v.iRow2.w, v.iRow3.w);
-
-    float4 wpos;
-    wpos.x = dot(localPos, col0);
-    wpos.y = dot(localPos, col1);
-    wpos.z = dot(localPos, col2);
-    wpos.w = dot(localPos, col3);
+    float4 wpos = InstanceWorldPos(v.pos, v.iCol0, v.iCol1, v.iCol2);
     o.pos = mul(wpos, gViewProj);
     o.wpos = wpos.xyz;
 
-    // Correct normal transform: inverse-transpose(world) applied to direction (w=0)
-    float4 ncol0 = float4(v.nRow0.x, v.nRow1.x, v.nRow2.x, v.nRow3.x);
-    float4 ncol1 = float4(v.nRow0.y, v.nRow1.y, v.nRow2.y, v.nRow3.y);
-    float4 ncol2 = float4(v.nRow0.z, v.nRow1.z, v.nRow2.z, v.nRow3.z);
-    float4 localNrm = float4(v.nrm, 0.0);
-    o.nrm.x = dot(localNrm, ncol0);
-    o.nrm.y = dot(localNrm, ncol1);
-    o.nrm.z = dot(localNrm, ncol2);
-    o.albedo = v.albedo;
-    o.rm = v.rm;
+    // Correct normal transform under non-uniform scale: inverse-transpose(world).
+    // Normalized here too: the decoded normals differ in length per vertex.
+    o.nrm = normalize(InstanceWorldNormal(DecodeOctNormal(v.nrm), v.iCol0, v.iCol1, v.iCol2));
     o.lightMask = v.lightMask;
     o.flags = v.flags;
     return o;
@@ -240,19 +403,7 @@ VSOut VSMain(VSIn v)
 // Depth-only vertex shader (prepass)
 float4 VSDepthMain(VSIn v) : SV_POSITION
 {
-    float4 localPos = float4(v.pos, 1.0);
-
-    float4 col0 = float4(v.iRow0.x, v.iRow1.x, v.iRow2.x, v.iRow3.x);
-    float4 col1 = float4(v.iRow0.y, v.iRow1.y, v.iRow2.y, v.iRow3.y);
-    float4 col2 = float4(v.iRow0.z, v.iRow1.z, v.iRow2.z, v.iRow3.z);
-    float4 col3 = float4(v.iRow0.w, v.iRow1.w, v.iRow2.w, v.iRow3.w);
-
-    float4 wpos;
-    wpos.x = dot(localPos, col0);
-    wpos.y = dot(localPos, col1);
-    wpos.z = dot(localPos, col2);
-    wpos.w = dot(localPos, col3);
-    return mul(wpos, gViewProj);
+    return mul(InstanceWorldPos(v.pos, v.iCol0, v.iCol1, v.iCol2), gViewProj);
 }
 
 static float Hash12Shadow(float2 p)
@@ -396,19 +547,10 @@ static float SampleShadowCascadePCSS(uint cascade, float2 uv, float receiverDept
 static float GetShadowSoftness(float4 albedo, float2 rm, uint flags)
 {
     // Global softness by default.
-    // Future: override per object/material by reading instance params (e.g. rm, flags, material id).
+    // Future: override per object/material from the material parameters or instance flags.
     return max(0.0, gShadowExtras.z);
 }
 
-static uint GetShadowFilterQuality(float4 albedo, float2 rm, uint flags)
-{
-    // Global quality by default, packed into shadow flags.
-    // Future: override per object/material.
-    uint shadowFlags = (uint)gShadowExtras.w;
-    uint q = (shadowFlags >> 8) & 0xFu;
-    return q;
-}
-
 static float SampleShadowCascadePcfGrid(uint cascade, float2 uv, float depth, float radiusTexels, uint gridRadius)
 {
     // Grid PCF using hardware 2x2 comparison filtering per tap (linear comparison sampler).
@@ -451,6 +593,80 @@ static float SampleShadowCascadeSoftCross(uint cascade, float2 uv, float depth,
     return sum * 0.2;
 }
 
+static float ShadowFootprintLitCount(uint cascade, float2 uv, float depth, float radiusTexels)
+{
+    // Five 2x2 compare gathers (center + the four corners of the footprint): 20 point compares
+    // for the price of five fetches, used to classify a pixel before the real filter runs.
+    const float2 o = radiusTexels * gShadowTexelSize;
+    float4 lit = gShadowMap.GatherCmp(gShadowSamplerPoint, float3(uv, (float)cascade), depth);
+    lit += gShadowMap.GatherCmp(gShadowSamplerPoint, float3(uv + float2(-o.x, -o.y), (float)cascade), depth);
+    lit += gShadowMap.GatherCmp(gShadowSamplerPoint, float3(uv + float2( o.x, -o.y), (float)cascade), depth);
+    lit += gShadowMap.GatherCmp(gShadowSamplerPoint, float3(uv + float2(-o.x,  o.y), (float)cascade), depth);
+    lit += gShadowMap.GatherCmp(gShadowSamplerPoint, float3(uv + float2( o.x,  o.y), (float)cascade), depth);
+    return dot(lit, 1.0.xxxx);
+}
+
+static float SampleShadowCascadeQuality(uint quality, uint cascade, float2 uv, float depth, float radiusTexels, float rot)
+{
+    // quality is a literal at every call site (KING_SHADOW_FILTERn), so this folds to one filter.
+#if KING_SHADOW_ADAPTIVE
+    if (quality > 0u)
+    {
+        // Early-out: if every compare over the filter's footprint (PCSS: its blocker search)
+        // agrees, the pixel is fully lit or fully shadowed and the filter cannot change that.
+        float footprint = max(radiusTexels, 1.0);
+        if (quality == 4u)
+            footprint = clamp(footprint * 2.0, 2.0, 8.0);
+        else if (quality == 2u)
+            footprint *= 2.0;
+        const float lit = ShadowFootprintLitCount(cascade, uv, depth, footprint);
+        if (lit >= 20.0)
+            return 1.0;
+        if (lit <= 0.0)
+            return 0.0;
+    }
+#endif
+
+    if (quality == 4u)
+    {
+        // PCSS (variable penumbra)
+        return SampleShadowCascadePCSS(cascade, uv, depth, max(radiusTexels, 1.0), rot);
+    }
+    if (quality == 3u)
+    {
+        // Poisson 9-tap (stable, softer)
+        return SampleShadowCascadeFiltered(cascade, uv, depth, max(radiusTexels, 0.0), rot);
+    }
+    if (quality == 2u)
+    {
+        // 5x5 grid PCF
+        return SampleShadowCascadePcfGrid(cascade, uv, depth, max(radiusTexels, 1.0), 2u);
+    }
+    if (quality == 1u)
+    {
+        // 3x3 grid PCF (good default)
+        return SampleShadowCascadePcfGrid(cascade, uv, depth, max(radiusTexels, 1.0), 1u);
+    }
+    // Hard (still linear compare to avoid texel-block harshness)
+    return gShadowMap.SampleCmpLevelZero(gShadowSamplerLinear, float3(uv, (float)cascade), depth);
+}
+
+static float SampleShadowCascade(uint cascade, float2 uv, float depth, float radiusTexels, float rot)
+{
+#if KING_SHADOW_FILTER0 == KING_SHADOW_FILTER1 && KING_SHADOW_FILTER1 == KING_SHADOW_FILTER2
+    return SampleShadowCascadeQuality(KING_SHADOW_FILTER0, cascade, uv, depth, radiusTexels, rot);
+#else
+    // Cascades cover contiguous screen regions, so this rarely diverges within a wave.
+    [branch]
+    if (cascade == 0u)
+        return SampleShadowCascadeQuality(KING_SHADOW_FILTER0, cascade, uv, depth, radiusTexels, rot);
+    [branch]
+    if (cascade == 1u)
+        return SampleShadowCascadeQuality(KING_SHADOW_FILTER1, cascade, uv, depth, radiusTexels, rot);
+    return SampleShadowCascadeQuality(KING_SHADOW_FILTER2, cascade, uv, depth, radiusTexels, rot);
+#endif
+}
+
 static float ReceiverPlaneDepthBias(float2 uv, float depth)
 {
     // Receiver-plane depth bias (RPDB).
@@ -474,40 +690,50 @@ static float ReceiverPlaneDepthBias(float2 uv, float depth)
     return rpdb;
 }
 
-static float SamplePointShadowFiltered(float3 wpos, float3 lightPos, float dist)
+static float SampleLocalShadowFiltered(LightData Ld, float3 wpos)
 {
     if (gPointShadowParams.x <= 0.5)
         return 1.0;
 
-    // Normalize depth to match cubemap storage.
-    float invFar = max(gPointShadowParams.z, 1e-6);
-    float distN = dist * invFar;
-    float biasN = gPointShadowParams.y * invFar;
-
-    float3 dir = wpos - lightPos;
-    float lenDir = max(length(dir), 1e-6);
-    float3 D = dir / lenDir;
+    uint faceIndex = Ld.shadowFace;
+    if (Ld.type == 1u)
+    {
+        // Cube face by major axis.
+        const float3 d = wpos - Ld.pos;
+        const float3 a = abs(d);
+        if (a.x >= a.y && a.x >= a.z)
+            faceIndex += (d.x >= 0.0) ? 0u : 1u;
+        else if (a.y >= a.z)
+            faceIndex += (d.y >= 0.0) ? 2u : 3u;
+        else
+            faceIndex += (d.z >= 0.0) ? 4u : 5u;
+    }
+    const ShadowFaceData f = gShadowFaces[faceIndex];
 
-    // 5-tap compare using small angular offsets.
-    float3 up = (abs(D.y) < 0.95) ? float3(0.0, 1.0, 0.0) : float3(1.0, 0.0, 0.0);
-    float3 U = normalize(cross(up, D));
-    float3 V = cross(D, U);
-    float eps = 1.75 * gPointShadowTexelSize.x;
+    const float4 clip = mul(float4(wpos, 1.0), f.viewProj);
+    if (clip.w <= 1e-5)
+        return 1.0;
+    const float2 uv = clip.xy / clip.w * float2(0.5, -0.5) + 0.5;
+    // Outside a spot cone (cube faces keep a border, so they stay inside).
+    if (any(uv < 0.0) || any(uv > 1.0))
+        return 1.0;
 
-    float ref = distN - biasN;
+    const float invRange = max(f.invRange, 1e-6);
+    const float ref = (length(wpos - f.lightPos) - gPointShadowParams.y) * invRange;
 
-    float s0 = gPointShadowMap.SampleLevel(gPointShadowSampler, D, 0).r;
-    float s1 = gPointShadowMap.SampleLevel(gPointShadowSampler, normalize(D + U * eps), 0).r;
-    float s2 = gPointShadowMap.SampleLevel(gPointShadowSampler, normalize(D - U * eps), 0).r;
-    float s3 = gPointShadowMap.SampleLevel(gPointShadowSampler, normalize(D + V * eps), 0).r;
-    float s4 = gPointShadowMap.SampleLevel(gPointShadowSampler, normalize(D - V * eps), 0).r;
+    // 5-tap compare, clamped to the tile so no tap reads a neighbouring light.
+    const float2 texel = gPointShadowTexelSize;
+    const float2 lo = f.rect.xy + texel * 0.5;
+    const float2 hi = f.rect.xy + f.rect.zw - texel * 0.5;
+    const float2 c = f.rect.xy + uv * f.rect.zw;
+    const float e = 1.25;
 
     float sum = 0.0;
-    sum += step(ref, s0);
-    sum += step(ref, s1);
-    sum += step(ref, s2);
-    sum += step(ref, s3);
-    sum += step(ref, s4);
+    sum += step(ref, gShadowAtlas.SampleLevel(gPointShadowSampler, clamp(c, lo, hi), 0).r);
+    sum += step(ref, gShadowAtlas.SampleLevel(gPointShadowSampler, clamp(c + float2(e, 0.0) * texel, lo, hi), 0).r);
+    sum += step(ref, gShadowAtlas.SampleLevel(gPointShadowSampler, clamp(c - float2(e, 0.0) * texel, lo, hi), 0).r);
+    sum += step(ref, gShadowAtlas.SampleLevel(gPointShadowSampler, clamp(c + float2(0.0, e) * texel, lo, hi), 0).r);
+    sum += step(ref, gShadowAtlas.SampleLevel(gPointShadowSampler, clamp(c - float2(0.0, e) * texel, lo, hi), 0).r);
     return sum / 5.0;
 }
 
@@ -518,18 +744,9 @@ static float SampleShadowFiltered(float3 wpos, float3 N, float4 albedo, float2 r
 
     uint shadowFlags = (uint)gShadowExtras.w;
     const bool enableFadeOut = (shadowFlags & (1u << 0)) != 0u;
-    const bool enablePoissonFlag = (shadowFlags & (1u << 1)) != 0u;
     const bool enableNormalOffset = (shadowFlags & (1u << 2)) != 0u;
     const bool enableRpdb = (shadowFlags & (1u << 3)) != 0u;
 
-    uint filterQ = GetShadowFilterQuality(albedo, rm, flags);
-    // Back-compat: if quality isn't set (0) but Poisson is enabled, treat as Poisson.
-    // Otherwise default to 3x3.
-    if (filterQ == 0u && enablePoissonFlag)
-        filterQ = 3u;
-    if (filterQ > 4u)
-        filterQ = 4u;
-
     // Find a directional light direction for slope bias.
     // (Shadows are for the primary sun; in this demo there is usually only one directional.)
     float3 Ldir = float3(0.0, -1.0, 0.0);
@@ -546,8 +763,8 @@ static float SampleShadowFiltered(float3 wpos, float3 N, float4 albedo, float2 r
     // Increase bias on grazing angles to reduce acne without blowing out contact shadows.
     float bias = gShadowBias * (1.0 + (1.0 - ndotl) * 2.5);
 
-    // Select cascade based on camera clip-space depth.
-    float4 clip = mul(float4(wpos, 1.0), gViewProj);
+    // Select cascade based on clip-space depth of the camera the cascades were fitted to.
+    float4 clip = mul(float4(wpos, 1.0), gShadowCameraViewProj);
     float ndcZ = clip.z / max(clip.w, 1e-6);
 
     // Optional fade out near far plane.
@@ -604,6 +821,7 @@ static float SampleShadowFiltered(float3 wpos, float3 N, float4 albedo, float2 r
             return 1.0;
         if (ndc.z < 0.0 || ndc.z > 1.0)
             return 1.0;
+        uv *= gCascadeUvScale[cascade];
 
         float depth = ndc.z;
         float rpdb = 0.0;
@@ -615,32 +833,7 @@ static float SampleShadowFiltered(float3 wpos, float3 N, float4 albedo, float2 r
         }
         float depthBiased = depth - bias - rpdb;
 
-        float s0 = 1.0;
-        if (filterQ == 4u)
-        {
-            // PCSS (variable penumbra)
-            s0 = SampleShadowCascadePCSS(cascade, uv, depthBiased, max(radiusTexels, 1.0), rot);
-        }
-        else if (filterQ == 3u)
-        {
-            // Poisson 9-tap (stable, softer)
-            s0 = SampleShadowCascadeFiltered(cascade, uv, depthBiased, max(radiusTexels, 0.0), rot);
-        }
-        else if (filterQ == 2u)
-        {
-            // 5x5 grid PCF
-            s0 = SampleShadowCascadePcfGrid(cascade, uv, depthBiased, max(radiusTexels, 1.0), 2u);
-        }
-        else if (filterQ == 1u)
-        {
-            // 3x3 grid PCF (good default)
-            s0 = SampleShadowCascadePcfGrid(cascade, uv, depthBiased, max(radiusTexels, 1.0), 1u);
-        }
-        else
-        {
-            // Hard (still linear compare to avoid texel-block harshness)
-            s0 = gShadowMap.SampleCmpLevelZero(gShadowSamplerLinear, float3(uv, (float)cascade), depthBiased);
-        }
+        float s0 = SampleShadowCascade(cascade, uv, depthBiased, radiusTexels, rot);
 
         if (blend <= 0.0 || cascade2 == cascade)
             return lerp(1.0, s0, fade);
@@ -651,6 +844,7 @@ static float SampleShadowFiltered(float3 wpos, float3 N, float4 albedo, float2 r
         float2 uv2 = ndc2.xy * float2(0.5, -0.5) + 0.5;
         if (uv2.x < 0.0 || uv2.x > 1.0 || uv2.y < 0.0 || uv2.y > 1.0 || ndc2.z < 0.0 || ndc2.z > 1.0)
             return s0;
+        uv2 *= gCascadeUvScale[cascade2];
 
         float depth2 = ndc2.z;
         float rpdb2 = 0.0;
@@ -661,27 +855,7 @@ static float SampleShadowFiltered(float3 wpos, float3 N, float4 albedo, float2 r
         }
         float depth2Biased = depth2 - bias - rpdb2;
 
-        float s1 = 1.0;
-        if (filterQ == 4u)
-        {
-            s1 = SampleShadowCascadePCSS(cascade2, uv2, depth2Biased, max(radiusTexels, 1.0), rot);
-        }
-        else if (filterQ == 3u)
-        {
-            s1 = SampleShadowCascadeFiltered(cascade2, uv2, depth2Biased, max(radiusTexels, 0.0), rot);
-        }
-        else if (filterQ == 2u)
-        {
-            s1 = SampleShadowCascadePcfGrid(cascade2, uv2, depth2Biased, max(radiusTexels, 1.0), 2u);
-        }
-        else if (filterQ == 1u)
-        {
-            s1 = SampleShadowCascadePcfGrid(cascade2, uv2, depth2Biased, max(radiusTexels, 1.0), 1u);
-        }
-        else
-        {
-            s1 = gShadowMap.SampleCmpLevelZero(gShadowSamplerLinear, float3(uv2, (float)cascade2), depth2Biased);
-        }
+        float s1 = SampleShadowCascade(cascade2, uv2, depth2Biased, radiusTexels, rot);
         float s = lerp(s0, s1, blend);
         return lerp(1.0, s, fade);
     }
@@ -698,27 +872,76 @@ static float3 ApplyTonemapACES(float3 x)
     return saturate((x * (a * x + b)) / (x * (c * x + d) + e));
 }
 
+// Direct lighting from one light (no shadowing).
+float3 ShadeLight(LightData Ld, float3 wpos, float3 N, float3 V, float3 diffColor, float3 F0, float roughness)
+{
+    float3 lightColor = Ld.color * Ld.intensity;
+    float3 L = 0.0;
+    float atten = 1.0;
+
+    if (Ld.type == 0u) // Directional
+    {
+        L = normalize(-Ld.dir);
+    }
+    else
+    {
+        float3 toLight = Ld.pos - wpos;
+        float dist = length(toLight);
+        if (dist > Ld.range)
+            return 0.0;
+        L = toLight / max(dist, 1e-6);
+
+        float a0 = saturate(1.0 - dist / max(Ld.range, 1e-3));
+        atten = a0 * a0;
+
+        if (Ld.type == 2u) // Spot
+        {
+            float3 spotDir = normalize(Ld.dir);
+            float cosTheta = dot(normalize(wpos - Ld.pos), spotDir);
+            float denom = max(Ld.innerConeCos - Ld.outerConeCos, 1e-5);
+            float spot = saturate((cosTheta - Ld.outerConeCos) / denom);
+            atten *= spot;
+        }
+    }
+
+    float ndotl = saturate(dot(N, L));
+    if (ndotl <= 1e-5)
+        return 0.0;
+
+    float3 H = normalize(L + V);
+    float ndoth = saturate(dot(N, H));
+
+    float a = 1.0 - roughness;
+    float specPower = lerp(8.0, 256.0, a * a);
+    float specTerm = pow(ndoth, specPower);
+
+    float3 diffuse = diffColor * ndotl;
+    float3 specular = F0 * (specTerm * ndotl);
+    return (diffuse + specular) * atten * lightColor;
+}
+
 float4 PSMain(VSOut i) : SV_TARGET
 {
     float3 N = normalize(i.nrm);
 
-    const float3 baseColor = i.albedo.rgb * gMatBaseColor.rgb;
+    const MaterialData mat = LoadMaterial(i.flags);
+    const float3 baseColor = mat.baseColor.rgb;
 
 #if KING_SHADING_MODEL == 1
     // Unlit: base + emissive (HDR)
-    float3 color = baseColor + gMatEmissive;
-    return float4(color, i.albedo.a * gMatBaseColor.a);
+    float3 color = baseColor + mat.emissive;
+    return float4(color, mat.baseColor.a);
 #elif KING_SHADING_MODEL == 2
     // Rim glow: stylized silhouette glow using emissive
     float3 V = normalize(gCameraPos - i.wpos);
     float ndv = saturate(dot(N, V));
     float rim = pow(saturate(1.0 - ndv), 3.0);
-    float3 color = baseColor + gMatEmissive * (rim * 2.5);
-    return float4(color, i.albedo.a * gMatBaseColor.a);
+    float3 color = baseColor + mat.emissive * (rim * 2.5);
+    return float4(color, mat.baseColor.a);
 #else
     // PBR-ish (current simple lit path)
-    float roughness = saturate(gMatRoughness);
-    float metallic = saturate(gMatMetallic);
+    float roughness = saturate(mat.roughness);
+    float metallic = saturate(mat.metallic);
 
     // Simple hemisphere ambient so the unlit side isn't crushed.
     float hemi = saturate(N.y * 0.5 + 0.5);
@@ -734,7 +957,7 @@ float4 PSMain(VSOut i) : SV_TARGET
     const bool receivesShadows = (i.flags & 1u) != 0;
     if (receivesShadows)
     {
-        rawShadow = SampleShadowFiltered(i.wpos, N, float4(baseColor, i.albedo.a * gMatBaseColor.a), float2(gMatRoughness, gMatMetallic), i.flags);
+        rawShadow = SampleShadowFiltered(i.wpos, N, mat.baseColor, float2(mat.roughness, mat.metallic), i.flags);
         float vis = lerp(saturate(gShadowMinVisibility), 1.0, saturate(rawShadow));
         shadow = lerp(1.0, vis, saturate(gShadowStrength));
     }
@@ -760,66 +983,33 @@ float4 PSMain(VSOut i) : SV_TARGET
     float3 F0 = lerp(0.04.xxx, baseColor, metallic);
     float3 diffColor = baseColor * (1.0 - metallic);
 
+    const float3 V = normalize(gCameraPos - i.wpos);
+
+    // Directional lights.
     [loop]
     for (uint li = 0; li < min(gLightCount, (uint)MAX_LIGHTS); ++li)
     {
         LightData Ld = gLights[li];
         if ((i.lightMask & Ld.groupMask) == 0u)
             continue;
+        color += ShadeLight(Ld, i.wpos, N, V, diffColor, F0, roughness) * shadow;
+    }
 
-        float3 lightColor = Ld.color * Ld.intensity;
-        float3 L = 0.0;
-        float atten = 1.0;
-
-        if (Ld.type == 0u) // Directional
-        {
-            L = normalize(-Ld.dir);
-        }
-        else
-        {
-            float3 toLight = Ld.pos - i.wpos;
-            float dist = length(toLight);
-            if (dist > Ld.range)
-                continue;
-            L = toLight / max(dist, 1e-6);
-
-            float a0 = saturate(1.0 - dist / max(Ld.range, 1e-3));
-            atten = a0 * a0;
-
-            if (Ld.type == 2u) // Spot
-            {
-                float3 spotDir = normalize(Ld.dir);
-                float cosTheta = dot(normalize(i.wpos - Ld.pos), spotDir);
-                float denom = max(Ld.innerConeCos - Ld.outerConeCos, 1e-5);
-                float spot = saturate((cosTheta - Ld.outerConeCos) / denom);
-                atten *= spot;
-            }
-        }
-
-        float ndotl = saturate(dot(N, L));
-        if (ndotl <= 1e-5)
+    // Point/spot lights of this pixel's cluster.
+    const uint2 range = gClusterRanges[ClusterIndex(i.pos, i.wpos)];
+    [loop]
+    for (uint ci = 0; ci < range.y; ++ci)
+    {
+        LightData Ld = gLocalLights[gClusterLightIndices[range.x + ci]];
+        if ((i.lightMask & Ld.groupMask) == 0u)
             continue;
 
-        float3 V = normalize(gCameraPos - i.wpos);
-        float3 H = normalize(L + V);
-        float ndoth = saturate(dot(N, H));
-
-        float a = 1.0 - roughness;
-        float specPower = lerp(8.0, 256.0, a * a);
-        float specTerm = pow(ndoth, specPower);
-
-        float3 diffuse = diffColor * ndotl;
-        float3 specular = F0 * (specTerm * ndotl);
-        float3 contrib = (diffuse + specular) * atten * lightColor;
-
-        // Apply directional shadow only to directional lights.
-        if (Ld.type == 0u)
-            contrib *= shadow;
+        float3 contrib = ShadeLight(Ld, i.wpos, N, V, diffColor, F0, roughness);
 
-        // Apply point-light shadow only to point lights.
-        if (Ld.type == 1u)
+        // Only lights with ready tiles in the shadow atlas sample it.
+        if ((Ld.flags & 1u) != 0u)
         {
-            float ps = SamplePointShadowFiltered(i.wpos, Ld.pos, length(i.wpos - Ld.pos));
+            float ps = SampleLocalShadowFiltered(Ld, i.wpos);
             contrib *= lerp(1.0, ps, saturate(gPointShadowParams.w));
         }
 
@@ -827,8 +1017,8 @@ float4 PSMain(VSOut i) : SV_TARGET
     }
 
     // Output is HDR (tone mapping is a separate pass).
-    color += gMatEmissive;
-    return float4(color, i.albedo.a * gMatBaseColor.a);
+    color += mat.emissive;
+    return float4(color, mat.baseColor.a);
 #endif
 }
 
@@ -852,19 +1042,7 @@ PSOut PSMainMRT(VSOut i)
 // Shadow-only vertex shader (depth-only pass)
 float4 VSShadowMain(VSIn v) : SV_POSITION
 {
-    float4 localPos = float4(v.pos, 1.0);
-
-    float4 col0 = float4(v.iRow0.x, v.iRow1.x, v.iRow2.x, v.iRow3.x);
-    float4 col1 = float4(v.iRow0.y, v.iRow1.y, v.iRow2.y, v.iRow3.y);
-    float4 col2 = float4(v.iRow0.z, v.iRow1.z, v.iRow2.z, v.iRow3.z);
-    float4 col3 = float4(v.iRow0.w, v.iRow1.w, v.iRow2.w, v.iRow3.w);
-
-    float4 wpos;
-    wpos.x = dot(localPos, col0);
-    wpos.y = dot(localPos, col1);
-    wpos.z = dot(localPos, col2);
-    wpos.w = dot(localPos, col3);
-    return mul(wpos, gShadowViewProj);
+    return mul(InstanceWorldPos(v.pos, v.iCol0, v.iCol1, v.iCol2), gShadowViewProj);
 }
 
 // Fullscreen post/tonemap
@@ -881,7 +1059,10 @@ cbuffer PostCB : register(b6)
 
     float2 gInvBloomSize;
     float2 gInvPostSize;
-    float2 _padPostParams;
+
+    float2 gRenderUvScale;   // used / allocated size of the scene targets (dynamic resolution)
+    float gUpscaleSharpness;
+    float _padPostParams;
 }
 
 struct FSOut
@@ -913,6 +1094,14 @@ FSOut VSTonemapMain(uint vid : SV_VertexID)
     return VSFullscreenMain(vid);
 }
 
+// Viewport UV [0, 1] -> UV of a scene-sized texture whose used region is gRenderUvScale of it
+// (dynamic resolution), kept half a texel inside that region so bilinear taps do not pick up
+// texels outside it.
+static float2 PostTexUv(float2 uv, float2 invTexSize)
+{
+    return min(uv * gRenderUvScale, gRenderUvScale - 0.5 * invTexSize);
+}
+
 static float3 LinearToSrgb(float3 x)
 {
     x = saturate(x);
@@ -922,12 +1111,10 @@ static float3 LinearToSrgb(float3 x)
     return lerp(lo, hi, m);
 }
 
-float4 PSVignetteMain(FSOut i) : SV_TARGET
+// Aspect-correct radial vignette factor (multiplies HDR color).
+static float VignetteFactor(float2 uvIn)
 {
-    float3 hdr = gPostIn.Sample(gLinearClamp, i.uv).rgb;
-
-    // Aspect-correct radial vignette.
-    float2 uv = saturate(i.uv);
+    float2 uv = saturate(uvIn);
     float2 p = uv - 0.5;
 
     // invPostSize = (1/W, 1/H) => aspect = W/H.
@@ -945,13 +1132,12 @@ float4 PSVignetteMain(FSOut i) : SV_TARGET
     float power = max(gVignettePower, 0.25);
     float v = pow(rn, power);
     float strength = saturate(gVignetteStrength);
-    float mul = 1.0 - strength * v;
-    return float4(hdr * mul, 1.0);
+    return 1.0 - strength * v;
 }
 
 float4 PSBloomExtractMain(FSOut i) : SV_TARGET
 {
-    float3 hdr = gPostIn.Sample(gLinearClamp, i.uv).rgb;
+    float3 hdr = gPostIn.Sample(gLinearClamp, PostTexUv(i.uv, gInvPostSize)).rgb;
     float thr = max(gBloomThreshold, 0.0);
 
     // Simple bright-pass (keep only components above threshold).
@@ -976,34 +1162,63 @@ static float3 BloomBlur(float2 uv, float2 dir)
 float4 PSBloomBlurHMain(FSOut i) : SV_TARGET
 {
     float2 dir = float2(max(gInvBloomSize.x, 0.0), 0.0);
-    return float4(BloomBlur(i.uv, dir), 1.0);
+    return float4(BloomBlur(PostTexUv(i.uv, gInvBloomSize), dir), 1.0);
 }
 
 float4 PSBloomBlurVMain(FSOut i) : SV_TARGET
 {
     float2 dir = float2(0.0, max(gInvBloomSize.y, 0.0));
-    return float4(BloomBlur(i.uv, dir), 1.0);
+    return float4(BloomBlur(PostTexUv(i.uv, gInvBloomSize), dir), 1.0);
 }
 
+// Fused post composite: bloom, AO, vignette, exposure and ACES in one full-screen pass, which
+// is also the upscale when the scene rendered at a reduced scale (bilinear, plus the optional
+// sharpen). PostProcessD3D11 compiles one permutation per set of enabled effects
+// (KING_POST_* = 0/1), so disabled effects cost neither a branch nor a texture fetch.
+#ifndef KING_POST_BLOOM
+#define KING_POST_BLOOM 0
+#endif
+#ifndef KING_POST_AO
+#define KING_POST_AO 0
+#endif
+#ifndef KING_POST_VIGNETTE
+#define KING_POST_VIGNETTE 0
+#endif
+#ifndef KING_POST_SHARPEN
+#define KING_POST_SHARPEN 0
+#endif
+
 float4 PSTonemapMain(FSOut i) : SV_TARGET
 {
-    float3 hdr = gPostIn.Sample(gLinearClamp, i.uv).rgb;
+    const float2 uv = PostTexUv(i.uv, gInvPostSize);
+    float3 hdr = gPostIn.Sample(gLinearClamp, uv).rgb;
+
+#if KING_POST_SHARPEN
+    // Unsharp mask against the 4 neighbours one scene texel away, clamped to their range so
+    // edges do not ring.
+    const float2 t = gInvPostSize;
+    const float3 n0 = gPostIn.Sample(gLinearClamp, uv + float2(-t.x, 0.0)).rgb;
+    const float3 n1 = gPostIn.Sample(gLinearClamp, uv + float2(t.x, 0.0)).rgb;
+    const float3 n2 = gPostIn.Sample(gLinearClamp, uv + float2(0.0, -t.y)).rgb;
+    const float3 n3 = gPostIn.Sample(gLinearClamp, uv + float2(0.0, t.y)).rgb;
+    const float3 lo = min(hdr, min(min(n0, n1), min(n2, n3)));
+    const float3 hi = max(hdr, max(max(n0, n1), max(n2, n3)));
+    hdr = clamp(hdr + (hdr - (n0 + n1 + n2 + n3) * 0.25) * max(gUpscaleSharpness, 0.0), lo, hi);
+#endif
 
-    // Optional bloom (already blurred). Add in HDR before tonemap.
-    float bloomIntensity = max(gBloomIntensity, 0.0);
-    if (bloomIntensity > 1e-4)
-    {
-        float3 b = gBloom.Sample(gLinearClamp, i.uv).rgb;
-        hdr += b * bloomIntensity;
-    }
+#if KING_POST_BLOOM
+    // Bloom (already blurred). Add in HDR before tonemap.
+    hdr += gBloom.Sample(gLinearClamp, PostTexUv(i.uv, gInvBloomSize)).rgb * max(gBloomIntensity, 0.0);
+#endif
 
-    // Optional AO integration.
-    float aoStrength = saturate(gAoStrength);
-    if (aoStrength > 1e-3)
-    {
-        float ao = gSsao.Sample(gLinearClamp, i.uv).r;
-        hdr *= lerp(1.0, ao, aoStrength);
-    }
+#if KING_POST_AO
+    float ao = gSsao.Sample(gLinearClamp, uv).r;
+    hdr *= lerp(1.0, ao, saturate(gAoStrength));
+#endif
+
+#if KING_POST_VIGNETTE
+    hdr *= VignetteFactor(i.uv);
+#endif
 
     hdr *= max(gExposure, 0.0);
     float3 ldr = ApplyTonemapACES(hdr);
@@ -1013,6 +1228,12 @@ float4 PSTonemapMain(FSOut i) : SV_TARGET
 }
 
 // SSAO pass
+// Viewport UV [0, 1] -> UV of an AO-resolution input whose used region is gSsaoUvScale of it.
+static float2 SsaoTexUv(float2 uv)
+{
+    return min(uv, 1.0 - 0.5 * gSsaoInvTargetSize) * gSsaoUvScale;
+}
+
 static float Hash12(float2 p)
 {
     float3 p3 = frac(float3(p.xyx) * 0.1031);
@@ -1022,7 +1243,7 @@ static float Hash12(float2 p)
 
 static float3 ReconstructSsaoPosition(float2 uv)
 {
-    float z = gDepth.Sample(gPointClamp, uv).r;
+    float z = gDepth.Sample(gPointClamp, SsaoTexUv(uv)).r;
 
     // Convert UV (top-left origin) to NDC (+Y up).
     float2 ndc;
@@ -1037,7 +1258,7 @@ static float3 ReconstructSsaoPosition(float2 uv)
 
 float4 PSSsaoMain(FSOut i) : SV_TARGET
 {
-    float3 nW = normalize(gNormal.Sample(gPointClamp, i.uv).xyz * 2.0 - 1.0);
+    float3 nW = normalize(gNormal.Sample(gPointClamp, SsaoTexUv(i.uv)).xyz * 2.0 - 1.0);
     float3 n = normalize(mul(float4(nW, 0.0), gSsaoView).xyz);
     float3 p = ReconstructSsaoPosition(i.uv);
 
@@ -1046,7 +1267,7 @@ float4 PSSsaoMain(FSOut i) : SV_TARGET
         return 1.0;
 
     // Build a basis around the normal.
-    float r = Hash12(i.uv / max(gSsaoInvTargetSize, 1e-6));
+    float r = Hash12(i.uv / max(gSsaoInvTargetSize, 1e-6) + gSsaoNoiseOffset);
     float3 randDir = normalize(float3(r * 2.0 - 1.0, frac(r * 13.37) * 2.0 - 1.0, frac(r * 7.77) * 2.0 - 1.0));
     float3 t = normalize(randDir - n * dot(randDir, n));
     float3 b = cross(n, t);
@@ -1075,7 +1296,7 @@ float4 PSSsaoMain(FSOut i) : SV_TARGET
         if (uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0)
             continue;
 
-        float sceneZ = gDepth.Sample(gPointClamp, uv).r;
+        float sceneZ = gDepth.Sample(gPointClamp, SsaoTexUv(uv)).r;
         float testZ = ndc.z - gSsaoBias;
         occ += (sceneZ < testZ) ? 1.0 : 0.0;
     }
@@ -1087,13 +1308,132 @@ float4 PSSsaoMain(FSOut i) : SV_TARGET
 
 float4 PSBlurMain(FSOut i) : SV_TARGET
 {
-    float2 o = gSsaoInvTargetSize;
+    float2 o = gSsaoInvTargetSize * gSsaoUvScale;
+    float2 uv = SsaoTexUv(i.uv);
     float sum = 0.0;
-    sum += gSsao.Sample(gLinearClamp, i.uv + float2(-o.x, 0)).r;
-    sum += gSsao.Sample(gLinearClamp, i.uv + float2( o.x, 0)).r;
-    sum += gSsao.Sample(gLinearClamp, i.uv + float2(0, -o.y)).r;
-    sum += gSsao.Sample(gLinearClamp, i.uv + float2(0,  o.y)).r;
-    sum += gSsao.Sample(gLinearClamp, i.uv).r;
+    sum += gSsao.Sample(gLinearClamp, uv + float2(-o.x, 0)).r;
+    sum += gSsao.Sample(gLinearClamp, uv + float2( o.x, 0)).r;
+    sum += gSsao.Sample(gLinearClamp, uv + float2(0, -o.y)).r;
+    sum += gSsao.Sample(gLinearClamp, uv + float2(0,  o.y)).r;
+    sum += gSsao.Sample(gLinearClamp, uv).r;
     float ao = sum / 5.0;
     return float4(ao, ao, ao, 1.0);
 }
+
+// View-space distance of a depth-buffer value (row-vector unprojection of (0, 0, z, 1)).
+static float LinearSsaoDepth(float z)
+{
+    const float vz = z * gSsaoInvProj._33 + gSsaoInvProj._43;
+    const float vw = z * gSsaoInvProj._34 + gSsaoInvProj._44;
+    return abs(vz / max(abs(vw), 1e-6));
+}
+
+// Depth and normal at AO resolution: of each gSsaoDownsample^2 footprint keep the nearest
+// texel, so thin foreground edges survive and the pair stays consistent.
+struct SsaoDownsampleOut
+{
+    float depth : SV_Target0;
+    float4 normal : SV_Target1;
+};
+
+SsaoDownsampleOut PSSsaoDownsampleMain(FSOut i)
+{
+    const int2 base = int2(i.pos.xy) * (int)gSsaoDownsample;
+    const int2 last = int2(gSsaoSourceSize) - 1;
+
+    int2 best = min(base, last);
+    float bestZ = gDepth.Load(int3(best, 0));
+    for (uint y = 0; y < gSsaoDownsample; ++y)
+    {
+        for (uint x = 0; x < gSsaoDownsample; ++x)
+        {
+            const int2 p = min(base + int2(x, y), last);
+            const float z = gDepth.Load(int3(p, 0));
+            if (z < bestZ)
+            {
+                bestZ = z;
+                best = p;
+            }
+        }
+    }
+
+    SsaoDownsampleOut o;
+    o.depth = bestZ;
+    o.normal = gNormal.Load(int3(best, 0));
+    return o;
+}
+
+// Temporal accumulation at AO resolution: reprojects last frame's result through this frame's
+// depth, clamps it to the current 3x3 neighbourhood and blends. gSsao = current (blurred),
+// gSsaoLowDepth = depth at AO resolution, gSsaoHistory = last frame's output.
+float4 PSSsaoTemporalMain(FSOut i) : SV_TARGET
+{
+    const int2 p = int2(i.pos.xy);
+    const int2 last = int2(gSsaoTargetSize) - 1;
+    const float cur = gSsao.Load(int3(p, 0));
+
+    float lo = cur;
+    float hi = cur;
+    [unroll]
+    for (int y = -1; y <= 1; ++y)
+    {
+        [unroll]
+        for (int x = -1; x <= 1; ++x)
+        {
+            const float n = gSsao.Load(int3(clamp(p + int2(x, y), int2(0, 0), last), 0));
+            lo = min(lo, n);
+            hi = max(hi, n);
+        }
+    }
+
+    const float z = gSsaoLowDepth.Load(int3(p, 0));
+    const float2 ndc = float2(i.uv.x * 2.0 - 1.0, (1.0 - i.uv.y) * 2.0 - 1.0);
+    const float4 prev = mul(float4(ndc, z, 1.0), gSsaoReproject);
+    if (z >= 1.0 || prev.w <= 1e-6 || gSsaoTemporalBlend >= 1.0)
+        return float4(cur, cur, cur, 1.0);
+
+    const float2 prevNdc = prev.xy / prev.w;
+    const float2 prevUv = float2(prevNdc.x * 0.5 + 0.5, 0.5 - prevNdc.y * 0.5);
+    if (any(prevUv < 0.0) || any(prevUv > 1.0))
+        return float4(cur, cur, cur, 1.0);
+
+    const float hist = clamp(gSsaoHistory.SampleLevel(gLinearClamp, SsaoTexUv(prevUv), 0), lo, hi);
+    const float ao = lerp(hist, cur, saturate(gSsaoTemporalBlend));
+    return float4(ao, ao, ao, 1.0);
+}
+
+// Depth-aware upsample of reduced-resolution AO to full resolution: the four low-res texels
+// around the pixel weighted bilinearly and by how close their depth is to the pixel's.
+float4 PSSsaoUpsampleMain(FSOut i) : SV_TARGET
+{
+    const float zFull = LinearSsaoDepth(gDepth.Load(int3(int2(i.pos.xy), 0)));
+    const float2 lowPos = i.uv * float2(gSsaoTargetSize) - 0.5;
+    const int2 p0 = int2(floor(lowPos));
+    const float2 f = lowPos - float2(p0);
+    const int2 last = int2(gSsaoTargetSize) - 1;
+
+    float sum = 0.0;
+    float wsum = 0.0;
+    float nearestAo = 1.0;
+    float nearestDz = 1e30;
+    [unroll]
+    for (int k = 0; k < 4; ++k)
+    {
+        const int2 o = int2(k & 1, k >> 1);
+        const int2 p = clamp(p0 + o, int2(0, 0), last);
+        const float ao = gSsao.Load(int3(p, 0));
+        const float dz = abs(LinearSsaoDepth(gSsaoLowDepth.Load(int3(p, 0))) - zFull) / max(zFull, 1e-3);
+        const float2 b = lerp(1.0 - f, f, float2(o));
+        const float w = b.x * b.y / (dz + 1e-3);
+        sum += ao * w;
+        wsum += w;
+        if (dz < nearestDz)
+        {
+            nearestDz = dz;
+            nearestAo = ao;
+        }
+    }
+
+    const float ao = (wsum > 1e-4) ? sum / wsum : nearestAo;
+    return float4(ao, ao, ao, 1.0);
+}
@@ -16,37 +16,35 @@ cbuffer CameraCB : register(b0)
     float3 _padPost;
 };
 
-cbuffer MaterialCB : register(b4)
+// Per-material constants: one entry per material, indexed by the top 16 bits of the instance
+// flags. Layout matches MaterialData in render_system_d3d11.h (48 bytes).
+struct MaterialData
 {
-    float4 gMatBaseColor;
-    float3 gMatEmissive;
-    float gMatRoughness;
+    float4 baseColor;
+    float3 emissive;
+    float roughness;
 
-    float gMatMetallic;
-    uint gMatFlags;
-    float2 _padMat;
+    float metallic;
+    uint flags;
+    float2 _pad;
 };
 
+StructuredBuffer<MaterialData> gMaterials : register(t14);
+
 struct VSIn
 {
+    // Cooked vertex: position in [0, 1] over the mesh's quantization box (the instance matrix
+    // includes the dequantization) and an octahedral normal.
     float3 pos : POSITION;
-    float3 nrm : NORMAL;
-
-    // Per-instance data (slot 1)
-    float4 iRow0 : TEXCOORD4;
-    float4 iRow1 : TEXCOORD5;
-    float4 iRow2 : TEXCOORD6;
-    float4 iRow3 : TEXCOORD7;
-
-    // Inverse-transpose of world
-    float4 nRow0 : TEXCOORD11;
-    float4 nRow1 : TEXCOORD12;
-    float4 nRow2 : TEXCOORD13;
-    float4 nRow3 : TEXCOORD14;
+    float2 nrm : NORMAL;
 
-    float4 albedo : COLOR0;
+    // Per-instance data (slot 1): the first three COLUMNS of the world matrix; the fourth is
+    // (0, 0, 0, 1). There is no normal matrix, it is rebuilt below.
+    float4 iCol0 : TEXCOORD4;
+    float4 iCol1 : TEXCOORD5;
+    float4 iCol2 : TEXCOORD6;
 
-    float2 rm : TEXCOORD8;
+    // No material parameters per instance: the material id in flags indexes t14.
     uint lightMask : TEXCOORD9;
     uint flags : TEXCOORD10;
 };
@@ -56,44 +54,36 @@ struct VSOut
     float4 pos : SV_POSITION;
     float3 wpos : TEXCOORD0;
     float3 nrm  : TEXCOORD1;
-    float4 col  : COLOR0;
+    nointerpolation uint flags : TEXCOORD2;
 };
 
 VSOut VSMain(VSIn input)
 {
     VSOut o;
 
-    // Engine provides world matrix as ROWS in iRow*. Build COLUMNS explicitly.
+    // Row-vector convention: each output component is a dot against one world column.
     float4 localPos = float4(input.pos, 1.0);
-    float4 col0 = float4(input.iRow0.x, input.iRow1.x, input.iRow2.x, input.iRow3.x);
-    float4 col1 = float4(input.iRow0.y, input.iRow1.y, input.iRow2.y, input.iRow3.y);
-    float4 col2 = float4(input.iRow0.z, input.iRow1.z, input.iRow2.z, input.iRow3.z);
-    float4 col3 = float4(input.iRow0.w, input.iRow1.w, input.iRow2.w, input.iRow3.w);
-
-    float4 wpos;
-    wpos.x = dot(localPos, col0);
-    wpos.y = dot(localPos, col1);
-    wpos.z = dot(localPos, col2);
-    wpos.w = dot(localPos, col3);
+    float4 wpos = float4(dot(localPos, input.iCol0), dot(localPos, input.iCol1), dot(localPos, input.iCol2), 1.0);
     o.pos = mul(wpos, gViewProj);
     o.wpos = wpos.xyz;
 
-    // Normal matrix is also provided as ROWS.
-    float4 localNrm = float4(input.nrm, 0.0);
-    float4 ncol0 = float4(input.nRow0.x, input.nRow1.x, input.nRow2.x, input.nRow3.x);
-    float4 ncol1 = float4(input.nRow0.y, input.nRow1.y, input.nRow2.y, input.nRow3.y);
-    float4 ncol2 = float4(input.nRow0.z, input.nRow1.z, input.nRow2.z, input.nRow3.z);
-    float3 wn;
-    wn.x = dot(localNrm, ncol0);
-    wn.y = dot(localNrm, ncol1);
-    wn.z = dot(localNrm, ncol2);
+    // Inverse-transpose of the 3x3 part from its cofactors (rows of world are (c0.i, c1.i, c2.i)).
+    float3 r0 = float3(input.iCol0.x, input.iCol1.x, input.iCol2.x);
+    float3 r1 = float3(input.iCol0.y, input.iCol1.y, input.iCol2.y);
+    float3 r2 = float3(input.iCol0.z, input.iCol1.z, input.iCol2.z);
+    // Octahedral decode (see DecodeOctNormal in pbr_test.hlsl).
+    float3 n = float3(input.nrm, 1.0 - abs(input.nrm.x) - abs(input.nrm.y));
+    n.xy += (n.xy >= 0.0) ? -saturate(-n.z) : saturate(-n.z);
+    float3 wn = n.x * cross(r1, r2) + n.y * cross(r2, r0) + n.z * cross(r0, r1);
+    if (dot(r0, cross(r1, r2)) < 0.0)
+        wn = -wn;
     o.nrm = normalize(wn);
 
-    o.col = input.albedo * gMatBaseColor;
+    o.flags = input.flags;
     return o;
 }
 
-static float3 ApplyRim(float3 baseRgb, float3 nrm, float3 wpos)
+static float3 ApplyRim(float3 baseRgb, float3 nrm, float3 wpos, float3 rimColor)
 {
     float3 V = normalize(gCameraPos - wpos);
     float ndv = saturate(dot(nrm, V));
@@ -101,8 +91,7 @@ static float3 ApplyRim(float3 baseRgb, float3 nrm, float3 wpos)
     // Rim factor: stronger near silhouettes.
     float rim = pow(saturate(1.0 - ndv), 3.0);
 
-    // Use emissive as the rim color; allow overbright HDR ("glow") by scaling.
-    float3 rimColor = gMatEmissive;
+    // rimColor is the material emissive; allow overbright HDR ("glow") by scaling.
     float rimStrength = 2.5;
 
     float3 outRgb = baseRgb + rimColor * (rim * rimStrength);
@@ -111,8 +100,10 @@ static float3 ApplyRim(float3 baseRgb, float3 nrm, float3 wpos)
 
 float4 PSMain(VSOut input) : SV_Target0
 {
-    float3 rgb = ApplyRim(input.col.rgb, input.nrm, input.wpos);
-    return float4(rgb, input.col.a);
+    const MaterialData mat = gMaterials[input.flags >> 16];
+    const float4 col = mat.baseColor;
+    float3 rgb = ApplyRim(col.rgb, input.nrm, input.wpos, mat.emissive);
+    return float4(rgb, col.a);
 }
 
 struct PSOutMRT
@@ -124,8 +115,10 @@ struct PSOutMRT
 PSOutMRT PSMainMRT(VSOut input)
 {
     PSOutMRT o;
-    float3 rgb = ApplyRim(input.col.rgb, input.nrm, input.wpos);
-    o.hdr = float4(rgb, input.col.a);
+    const MaterialData mat = gMaterials[input.flags >> 16];
+    const float4 col = mat.baseColor;
+    float3 rgb = ApplyRim(col.rgb, input.nrm, input.wpos, mat.emissive);
+    o.hdr = float4(rgb, col.a);
     o.normal = float4(input.nrm * 0.5f + 0.5f, 1.0f);
     return o;
 }
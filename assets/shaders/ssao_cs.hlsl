@@ -0,0 +1,107 @@
+// Separable depth-aware SSAO blur for King (D3D11), see RenderSystemD3D11 (SSAO passes).
+//
+// One thread group filters GROUP_SIZE pixels of a row (H) or column (V). The group first
+// loads its span plus BLUR_RADIUS texels on either side into groupshared memory (AO and
+// linear depth), so each texel is fetched once instead of 2 * BLUR_RADIUS + 1 times. Taps are
+// Gaussian-weighted and fall off with relative depth difference, so AO does not bleed across
+// silhouettes. Runs at AO resolution (RenderSettings::ssaoQuality).
+//
+// Binding contract:
+//   b3: SsaoCB (same layout as pbr_test.hlsl)
+//   t0: AO input, t1: depth at AO resolution
+//   u0: AO output
+//   Dispatch H: (ceil(w / GROUP_SIZE), h, 1); V: (ceil(h / GROUP_SIZE), w, 1)
+
+cbuffer SsaoCB : register(b3)
+{
+    row_major float4x4 gSsaoProj;
+    row_major float4x4 gSsaoInvProj;
+    row_major float4x4 gSsaoView;
+    float2 gSsaoInvTargetSize;
+    float gSsaoRadius;
+    float gSsaoBias;
+
+    row_major float4x4 gSsaoReproject;
+    uint2 gSsaoTargetSize;
+    uint2 gSsaoSourceSize;
+    float2 gSsaoNoiseOffset;
+    float gSsaoTemporalBlend;
+    uint gSsaoDownsample;
+
+    float2 gSsaoUvScale;
+    float2 _padSsao;
+};
+
+Texture2D<float> gAoIn : register(t0);
+Texture2D<float> gAoDepth : register(t1);
+RWTexture2D<float> gAoOut : register(u0);
+
+#define GROUP_SIZE 64
+#define BLUR_RADIUS 4
+
+// Relative depth difference at which a tap's weight has fallen to 1/e.
+static const float kDepthFalloff = 0.05;
+static const float kWeights[BLUR_RADIUS + 1] = { 0.2270, 0.1945, 0.1216, 0.0540, 0.0162 };
+
+groupshared float gsAo[GROUP_SIZE + 2 * BLUR_RADIUS];
+groupshared float gsDepth[GROUP_SIZE + 2 * BLUR_RADIUS];
+
+// View-space distance of a depth-buffer value (see LinearSsaoDepth in pbr_test.hlsl).
+float LinearDepth(float z)
+{
+    const float vz = z * gSsaoInvProj._33 + gSsaoInvProj._43;
+    const float vw = z * gSsaoInvProj._34 + gSsaoInvProj._44;
+    return abs(vz / max(abs(vw), 1e-6));
+}
+
+int2 LinePixel(uint line, int along, bool horizontal)
+{
+    return horizontal ? int2(along, (int)line) : int2((int)line, along);
+}
+
+void BlurLine(uint3 groupId, uint3 threadId, bool horizontal)
+{
+    const int2 size = int2(gSsaoTargetSize);
+    const int2 last = size - 1;
+    const int start = (int)(groupId.x * GROUP_SIZE) - BLUR_RADIUS;
+
+    for (uint i = threadId.x; i < GROUP_SIZE + 2 * BLUR_RADIUS; i += GROUP_SIZE)
+    {
+        const int2 p = clamp(LinePixel(groupId.y, start + (int)i, horizontal), int2(0, 0), last);
+        gsAo[i] = gAoIn.Load(int3(p, 0));
+        gsDepth[i] = LinearDepth(gAoDepth.Load(int3(p, 0)));
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    const int2 p = LinePixel(groupId.y, (int)(groupId.x * GROUP_SIZE + threadId.x), horizontal);
+    if (any(p >= size))
+        return;
+
+    const uint c = threadId.x + BLUR_RADIUS;
+    const float zc = gsDepth[c];
+    const float invFalloff = 1.0 / (kDepthFalloff * max(zc, 1e-3));
+
+    float sum = gsAo[c] * kWeights[0];
+    float wsum = kWeights[0];
+    [unroll]
+    for (int k = 1; k <= BLUR_RADIUS; ++k)
+    {
+        const float wl = kWeights[k] * exp(-abs(gsDepth[c - k] - zc) * invFalloff);
+        const float wr = kWeights[k] * exp(-abs(gsDepth[c + k] - zc) * invFalloff);
+        sum += gsAo[c - k] * wl + gsAo[c + k] * wr;
+        wsum += wl + wr;
+    }
+    gAoOut[p] = sum / wsum;
+}
+
+[numthreads(GROUP_SIZE, 1, 1)]
+void CSSsaoBlurHMain(uint3 groupId : SV_GroupID, uint3 threadId : SV_GroupThreadID)
+{
+    BlurLine(groupId, threadId, true);
+}
+
+[numthreads(GROUP_SIZE, 1, 1)]
+void CSSsaoBlurVMain(uint3 groupId : SV_GroupID, uint3 threadId : SV_GroupThreadID)
+{
+    BlurLine(groupId, threadId, false);
+}
@@ -0,0 +1,208 @@
+// Microbenchmark: paged SparseSet vs the previous unordered_map-indexed implementation,
+// plus a two-pool ComponentView join before/after AlignTo.
+// Usage: EcsBench [entityCount...]   (defaults to 10000 100000 1000000)
+
+#include "king/ecs/sparse_set.h"
+#include "king/ecs/view.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+// Reference: the pre-paging SparseSet (dense storage + std::unordered_map index).
+template <typename T>
+class LegacySparseSet
+{
+public:
+    bool Has(king::Entity e) const { return mIndex.find(e) != mIndex.end(); }
+
+    T* TryGet(king::Entity e)
+    {
+        auto it = mIndex.find(e);
+        if (it == mIndex.end()) return nullptr;
+        return &mData[it->second];
+    }
+
+    template <typename... Args>
+    T* Emplace(king::Entity e, Args&&... args)
+    {
+        Remove(e);
+        const size_t idx = mData.size();
+        mEntities.push_back(e);
+        mData.emplace_back(std::forward<Args>(args)...);
+        mIndex[e] = idx;
+        return &mData.back();
+    }
+
+    void Remove(king::Entity e)
+    {
+        auto it = mIndex.find(e);
+        if (it == mIndex.end()) return;
+
+        size_t idx = it->second;
+        size_t last = mData.size() - 1;
+        if (idx != last)
+        {
+            mData[idx] = std::move(mData[last]);
+            mEntities[idx] = mEntities[last];
+            mIndex[mEntities[idx]] = idx;
+        }
+        mData.pop_back();
+        mEntities.pop_back();
+        mIndex.erase(it);
+    }
+
+    size_t Size() const { return mData.size(); }
+
+private:
+    std::vector<king::Entity> mEntities;
+    std::vector<T> mData;
+    std::unordered_map<king::Entity, size_t> mIndex;
+};
+
+// Roughly Transform-sized payload.
+struct Payload
+{
+    float v[10] = {};
+};
+
+struct Timings
+{
+    double emplaceMs = 0.0;
+    double lookupSeqMs = 0.0;
+    double lookupRandMs = 0.0;
+    double removeMs = 0.0;
+    double checksum = 0.0;
+};
+
+double MsSince(std::chrono::steady_clock::time_point t0)
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now() - t0).count();
+}
+
+template <typename Set>
+Timings Run(const std::vector<king::Entity>& entities, const std::vector<king::Entity>& shuffled)
+{
+    Timings t{};
+    Set set;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (king::Entity e : entities)
+        set.Emplace(e)->v[0] = (float)(e & 0xFF);
+    t.emplaceMs = MsSince(t0);
+
+    double sum = 0.0;
+    t0 = std::chrono::steady_clock::now();
+    for (king::Entity e : entities)
+    {
+        if (auto* p = set.TryGet(e))
+            sum += p->v[0];
+    }
+    t.lookupSeqMs = MsSince(t0);
+
+    t0 = std::chrono::steady_clock::now();
+    for (king::Entity e : shuffled)
+    {
+        if (auto* p = set.TryGet(e))
+            sum += p->v[0];
+    }
+    t.lookupRandMs = MsSince(t0);
+
+    t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < shuffled.size(); i += 2)
+        set.Remove(shuffled[i]);
+    t.removeMs = MsSince(t0);
+
+    t.checksum = sum + (double)set.Size();
+    return t;
+}
+
+void PrintRow(const char* name, const Timings& t)
+{
+    std::printf("  %-8s emplace %9.3f ms | lookup seq %9.3f ms | lookup rand %9.3f ms | remove half %9.3f ms  (chk %.0f)\n",
+        name, t.emplaceMs, t.lookupSeqMs, t.lookupRandMs, t.removeMs, t.checksum);
+}
+
+// Join A x B where B was filled in shuffled order; then again after B.AlignTo(A).
+void RunJoin(const std::vector<king::Entity>& entities, const std::vector<king::Entity>& shuffled)
+{
+    king::SparseSet<Payload> a;
+    king::SparseSet<Payload> b;
+    for (king::Entity e : entities)
+        a.Emplace(e)->v[0] = 1.0f;
+    for (king::Entity e : shuffled)
+        b.Emplace(e)->v[0] = 2.0f;
+
+    auto join = [&]()
+    {
+        double sum = 0.0;
+        const auto t0 = std::chrono::steady_clock::now();
+        for (auto [e, pa, pb] : king::ComponentView<Payload, Payload>(a, b))
+        {
+            (void)e;
+            sum += pa.v[0] + pb.v[0];
+        }
+        const double ms = MsSince(t0);
+        return std::make_pair(ms, sum);
+    };
+
+    const auto unaligned = join();
+
+    auto t0 = std::chrono::steady_clock::now();
+    b.AlignTo(a);
+    const double alignMs = MsSince(t0);
+
+    const auto aligned = join();
+
+    std::printf("  view     join unaligned %9.3f ms | align %9.3f ms | join aligned %9.3f ms  (chk %.0f)\n",
+        unaligned.first, alignMs, aligned.first, unaligned.second + aligned.second);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::vector<uint32_t> counts;
+    for (int i = 1; i < argc; ++i)
+    {
+        const long v = std::strtol(argv[i], nullptr, 10);
+        if (v > 0)
+            counts.push_back((uint32_t)v);
+    }
+    if (counts.empty())
+        counts = { 10000u, 100000u, 1000000u };
+
+    std::mt19937 rng(1234u);
+
+    for (uint32_t n : counts)
+    {
+        if (n > king::kEntityIndexMask)
+            n = king::kEntityIndexMask;
+
+        // Entities as the Registry hands them out: slot 1..n, generation 0.
+        std::vector<king::Entity> entities;
+        entities.reserve(n);
+        for (uint32_t i = 1; i <= n; ++i)
+            entities.push_back(king::MakeEntity(i, 0));
+
+        std::vector<king::Entity> shuffled = entities;
+        std::shuffle(shuffled.begin(), shuffled.end(), rng);
+
+        std::printf("[EcsBench] entities=%u\n", n);
+        PrintRow("legacy", Run<LegacySparseSet<Payload>>(entities, shuffled));
+        PrintRow("paged", Run<king::SparseSet<Payload>>(entities, shuffled));
+        RunJoin(entities, shuffled);
+    }
+
+    return 0;
+}
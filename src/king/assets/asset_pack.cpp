@@ -0,0 +1,392 @@
+#include "asset_pack.h"
+
+#include "../ecs/components.h"
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace king
+{
+
+std::string NormalizeAssetPath(std::string_view path)
+{
+    std::string out;
+    out.reserve(path.size());
+    for (char c : path)
+    {
+        if (c == '\\')
+            c = '/';
+        else if (c >= 'A' && c <= 'Z')
+            c = (char)(c - 'A' + 'a');
+        out.push_back(c);
+    }
+    while (out.size() >= 2 && out[0] == '.' && out[1] == '/')
+        out.erase(0, 2);
+    return out;
+}
+
+uint64_t AssetPathHash(std::string_view path)
+{
+    const std::string n = NormalizeAssetPath(path);
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (char c : n)
+    {
+        h ^= (uint8_t)c;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+AssetPack::~AssetPack()
+{
+    Close();
+}
+
+bool AssetPack::Open(const std::wstring& path)
+{
+    Close();
+
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        std::printf("AssetPack: cannot open '%ls'\n", path.c_str());
+        return false;
+    }
+    mFile = file;
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(PackHeader))
+    {
+        std::printf("AssetPack: '%ls' is too small\n", path.c_str());
+        Close();
+        return false;
+    }
+    mSize = (uint64_t)size.QuadPart;
+
+    mMapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mMapping)
+    {
+        std::printf("AssetPack: CreateFileMapping failed for '%ls'\n", path.c_str());
+        Close();
+        return false;
+    }
+    mBase = (const uint8_t*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+    if (!mBase)
+    {
+        std::printf("AssetPack: MapViewOfFile failed for '%ls'\n", path.c_str());
+        Close();
+        return false;
+    }
+
+    const PackHeader* h = (const PackHeader*)mBase;
+    const uint64_t tableBytes = (uint64_t)h->entryCount * sizeof(PackEntry);
+    if (std::memcmp(h->magic, "KPAK", 4) != 0 || h->version != kAssetPackVersion
+        || h->tableOffset > mSize || tableBytes > mSize - h->tableOffset || (h->tableOffset % 8u) != 0
+        || h->namesOffset > mSize)
+    {
+        std::printf("AssetPack: '%ls' is not a version %u pack\n", path.c_str(), kAssetPackVersion);
+        Close();
+        return false;
+    }
+
+    mEntries = (const PackEntry*)(mBase + h->tableOffset);
+    mEntryCount = h->entryCount;
+    mNames = (const char*)(mBase + h->namesOffset);
+    mNamesSize = mSize - h->namesOffset;
+
+    for (uint32_t i = 0; i < mEntryCount; ++i)
+    {
+        const PackEntry& e = mEntries[i];
+        const bool sorted = (i == 0) || mEntries[i - 1].pathHash < e.pathHash;
+        if (!sorted || e.offset > mSize || e.size > mSize - e.offset || e.nameOffset >= mNamesSize)
+        {
+            std::printf("AssetPack: '%ls' has a broken entry table (entry %u)\n", path.c_str(), i);
+            Close();
+            return false;
+        }
+    }
+
+    mPath = path;
+    std::printf("AssetPack: mapped '%ls' (%u entries, %.1f MB)\n", path.c_str(), mEntryCount, (double)mSize / (1024.0 * 1024.0));
+    return true;
+}
+
+void AssetPack::Close()
+{
+    if (mBase)
+        UnmapViewOfFile(mBase);
+    if (mMapping)
+        CloseHandle((HANDLE)mMapping);
+    if (mFile)
+        CloseHandle((HANDLE)mFile);
+    mBase = nullptr;
+    mMapping = nullptr;
+    mFile = nullptr;
+    mSize = 0;
+    mEntries = nullptr;
+    mEntryCount = 0;
+    mNames = nullptr;
+    mNamesSize = 0;
+    mPath.clear();
+}
+
+const PackEntry* AssetPack::FindHash(uint64_t pathHash) const
+{
+    const PackEntry* end = mEntries + mEntryCount;
+    const PackEntry* it = std::lower_bound(mEntries, end, pathHash, [](const PackEntry& e, uint64_t h) { return e.pathHash < h; });
+    return (it != end && it->pathHash == pathHash) ? it : nullptr;
+}
+
+const PackEntry* AssetPack::Find(std::string_view path) const
+{
+    const PackEntry* e = FindHash(AssetPathHash(path));
+    if (!e)
+        return nullptr;
+    // Guard against hash collisions; names are stored normalized.
+    return (NormalizeAssetPath(path) == Name(*e)) ? e : nullptr;
+}
+
+const char* AssetPack::Name(const PackEntry& e) const
+{
+    if (!mNames || e.nameOffset >= mNamesSize)
+        return "";
+    // The writer NUL-terminates every name; a truncated file fails this check.
+    const char* s = mNames + e.nameOffset;
+    return std::memchr(s, 0, (size_t)(mNamesSize - e.nameOffset)) ? s : "";
+}
+
+bool ReadPackMesh(const AssetPack& pack, const PackEntry& e, PackMeshView& out)
+{
+    out = {};
+    if (e.type != PackAssetType::Mesh || e.size < sizeof(PackMeshHeader))
+        return false;
+
+    const uint8_t* blob = pack.Data(e);
+    const PackMeshHeader* h = (const PackMeshHeader*)blob;
+    const uint64_t vertexBytes = (uint64_t)h->vertexCount * sizeof(PackedVertex);
+    const uint64_t indicesAt = (sizeof(PackMeshHeader) + vertexBytes + 3u) & ~3ull;
+    const uint64_t indexBytes = (uint64_t)h->indexCount * (h->index32 ? 4u : 2u);
+    if (h->vertexCount == 0 || h->lodCount == 0 || h->lodCount > kMaxMeshLods || indicesAt + indexBytes > e.size)
+        return false;
+    for (uint32_t l = 0; l < h->lodCount; ++l)
+    {
+        if ((uint64_t)h->lods[l].firstIndex + h->lods[l].indexCount > h->indexCount)
+            return false;
+    }
+
+    out.header = h;
+    out.vertices = blob + sizeof(PackMeshHeader);
+    out.indices = (h->indexCount > 0) ? blob + indicesAt : nullptr;
+    out.vertexBytes = (uint32_t)vertexBytes;
+    out.indexBytes = (uint32_t)indexBytes;
+    return true;
+}
+
+bool ReadPackTexture(const AssetPack& pack, const PackEntry& e, PackTextureView& out)
+{
+    out = {};
+    if (e.type != PackAssetType::Texture || e.size < sizeof(PackTextureHeader))
+        return false;
+
+    const uint8_t* blob = pack.Data(e);
+    const PackTextureHeader* h = (const PackTextureHeader*)blob;
+    const uint64_t subresources = (uint64_t)h->mipLevels * h->arraySize;
+    if (h->width == 0 || h->height == 0 || h->mipLevels == 0 || h->mipLevels > 16 || h->arraySize == 0
+        || sizeof(PackTextureHeader) + subresources * sizeof(PackTextureMip) > e.size)
+        return false;
+
+    const PackTextureMip* mips = (const PackTextureMip*)(blob + sizeof(PackTextureHeader));
+    for (uint64_t i = 0; i < subresources; ++i)
+    {
+        if (mips[i].offset > e.size || mips[i].slicePitch > e.size - mips[i].offset)
+            return false;
+    }
+
+    out.header = h;
+    out.mips = mips;
+    out.blob = blob;
+    return true;
+}
+
+bool AssetPackWriter::Add(std::string_view path, PackAssetType type, std::vector<uint8_t>&& blob)
+{
+    std::string name = NormalizeAssetPath(path);
+    if (name.empty())
+        return false;
+    const uint64_t hash = AssetPathHash(name);
+    for (const Pending& p : mEntries)
+    {
+        if (AssetPathHash(p.name) == hash)
+        {
+            std::printf("AssetPackWriter: '%s' collides with '%s'\n", name.c_str(), p.name.c_str());
+            return false;
+        }
+    }
+
+    Pending p{};
+    p.name = std::move(name);
+    p.type = type;
+    p.blob = std::move(blob);
+    mEntries.push_back(std::move(p));
+    return true;
+}
+
+bool AssetPackWriter::AddMesh(std::string_view path, const Mesh& mesh)
+{
+    if (mesh.packedVertices.empty() || mesh.revision == 0)
+    {
+        std::printf("AssetPackWriter: mesh '%.*s' is not cooked\n", (int)path.size(), path.data());
+        return false;
+    }
+
+    PackMeshHeader h{};
+    h.vertexCount = (uint32_t)mesh.packedVertices.size();
+    h.indexCount = (uint32_t)mesh.packedIndices.size();
+    h.index32 = mesh.index32 ? 1u : 0u;
+    h.lodCount = std::max(mesh.lodCount, 1u);
+    for (uint32_t l = 0; l < h.lodCount && l < kMaxMeshLods; ++l)
+    {
+        h.lods[l].firstIndex = mesh.lods[l].firstIndex;
+        h.lods[l].indexCount = mesh.lods[l].indexCount;
+        h.lods[l].maxPixels = mesh.lods[l].maxPixels;
+    }
+    h.quantOffset[0] = mesh.quantOffset.x;
+    h.quantOffset[1] = mesh.quantOffset.y;
+    h.quantOffset[2] = mesh.quantOffset.z;
+    h.quantScale[0] = mesh.quantScale.x;
+    h.quantScale[1] = mesh.quantScale.y;
+    h.quantScale[2] = mesh.quantScale.z;
+    h.boundsCenter[0] = mesh.boundsCenter.x;
+    h.boundsCenter[1] = mesh.boundsCenter.y;
+    h.boundsCenter[2] = mesh.boundsCenter.z;
+    h.boundsRadius = mesh.boundsRadius;
+
+    const size_t vertexBytes = mesh.packedVertices.size() * sizeof(PackedVertex);
+    const size_t indicesAt = (sizeof(PackMeshHeader) + vertexBytes + 3u) & ~(size_t)3u;
+    const size_t indexSize = mesh.index32 ? 4u : 2u;
+
+    std::vector<uint8_t> blob(indicesAt + mesh.packedIndices.size() * indexSize, 0);
+    std::memcpy(blob.data(), &h, sizeof(h));
+    std::memcpy(blob.data() + sizeof(h), mesh.packedVertices.data(), vertexBytes);
+    uint8_t* dst = blob.data() + indicesAt;
+    for (uint32_t idx : mesh.packedIndices)
+    {
+        if (mesh.index32)
+        {
+            std::memcpy(dst, &idx, 4);
+        }
+        else
+        {
+            const uint16_t i16 = (uint16_t)idx;
+            std::memcpy(dst, &i16, 2);
+        }
+        dst += indexSize;
+    }
+    return Add(path, PackAssetType::Mesh, std::move(blob));
+}
+
+bool AssetPackWriter::AddTexture(std::string_view path, const PackTextureHeader& desc, const void* const* data,
+    const uint32_t* rowPitch, const uint32_t* slicePitch)
+{
+    const uint32_t subresources = desc.mipLevels * desc.arraySize;
+    if (!data || !rowPitch || !slicePitch || subresources == 0 || desc.mipLevels > 16)
+        return false;
+
+    size_t dataAt = sizeof(PackTextureHeader) + (size_t)subresources * sizeof(PackTextureMip);
+    dataAt = (dataAt + 15u) & ~(size_t)15u;
+    size_t total = dataAt;
+    for (uint32_t i = 0; i < subresources; ++i)
+        total += ((size_t)slicePitch[i] + 15u) & ~(size_t)15u;
+
+    std::vector<uint8_t> blob(total, 0);
+    std::memcpy(blob.data(), &desc, sizeof(desc));
+    PackTextureMip* mips = (PackTextureMip*)(blob.data() + sizeof(PackTextureHeader));
+    size_t at = dataAt;
+    for (uint32_t i = 0; i < subresources; ++i)
+    {
+        if (!data[i])
+            return false;
+        mips[i].offset = at;
+        mips[i].rowPitch = rowPitch[i];
+        mips[i].slicePitch = slicePitch[i];
+        std::memcpy(blob.data() + at, data[i], slicePitch[i]);
+        at += ((size_t)slicePitch[i] + 15u) & ~(size_t)15u;
+    }
+    return Add(path, PackAssetType::Texture, std::move(blob));
+}
+
+bool AssetPackWriter::AddMaterial(std::string_view path, std::string_view text)
+{
+    std::vector<uint8_t> blob(text.begin(), text.end());
+    return Add(path, PackAssetType::Material, std::move(blob));
+}
+
+bool AssetPackWriter::Save(const std::wstring& path, std::string* outError) const
+{
+    // Blobs in insertion order, then the table sorted by hash, then the names.
+    std::vector<uint32_t> order(mEntries.size());
+    for (uint32_t i = 0; i < (uint32_t)order.size(); ++i)
+        order[i] = i;
+    std::vector<uint64_t> hashes(mEntries.size());
+    for (size_t i = 0; i < mEntries.size(); ++i)
+        hashes[i] = AssetPathHash(mEntries[i].name);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return hashes[a] < hashes[b]; });
+
+    std::vector<PackEntry> table(mEntries.size());
+    std::string names;
+    uint64_t at = sizeof(PackHeader);
+    for (size_t k = 0; k < order.size(); ++k)
+    {
+        const Pending& p = mEntries[order[k]];
+        PackEntry& e = table[k];
+        at = (at + 15u) & ~15ull;
+        e.pathHash = hashes[order[k]];
+        e.offset = at;
+        e.size = p.blob.size();
+        e.type = p.type;
+        e.nameOffset = (uint32_t)names.size();
+        names.append(p.name);
+        names.push_back('\0');
+        at += p.blob.size();
+    }
+
+    PackHeader h{};
+    std::memcpy(h.magic, "KPAK", 4);
+    h.version = kAssetPackVersion;
+    h.entryCount = (uint32_t)table.size();
+    h.tableOffset = (at + 15u) & ~15ull;
+    h.namesOffset = h.tableOffset + table.size() * sizeof(PackEntry);
+
+    std::vector<uint8_t> file((size_t)(h.namesOffset + names.size()), 0);
+    std::memcpy(file.data(), &h, sizeof(h));
+    for (size_t k = 0; k < order.size(); ++k)
+    {
+        const Pending& p = mEntries[order[k]];
+        if (!p.blob.empty())
+            std::memcpy(file.data() + table[k].offset, p.blob.data(), p.blob.size());
+    }
+    if (!table.empty())
+        std::memcpy(file.data() + h.tableOffset, table.data(), table.size() * sizeof(PackEntry));
+    if (!names.empty())
+        std::memcpy(file.data() + h.namesOffset, names.data(), names.size());
+
+    FILE* f = nullptr;
+    _wfopen_s(&f, path.c_str(), L"wb");
+    if (!f)
+    {
+        if (outError)
+            *outError = "cannot create pack file";
+        return false;
+    }
+    const bool ok = std::fwrite(file.data(), 1, file.size(), f) == file.size();
+    std::fclose(f);
+    if (!ok && outError)
+        *outError = "short write";
+    return ok;
+}
+
+} // namespace king
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace king
+{
+
+struct Mesh;
+
+// Binary asset pack (.kpak), memory-mapped read-only. Blobs are stored the way they are
+// uploaded (cooked mesh buffers, texture mips in their final DXGI format, material text), so
+// loading is page-in + CreateBuffer/CreateTexture2D straight from the mapping.
+//
+//   PackHeader | blobs (16-byte aligned) | PackEntry[entryCount] (sorted by pathHash) | names
+//
+// Entries are found by the hash of the normalized asset path (AssetPathHash); names are kept
+// for collision checks and tooling. All integers are little-endian.
+
+enum class PackAssetType : uint32_t
+{
+    Mesh = 1,
+    Texture = 2,
+    Material = 3,
+};
+
+struct PackHeader
+{
+    char magic[4];            // "KPAK"
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t flags;
+    uint64_t tableOffset;     // PackEntry[entryCount]
+    uint64_t namesOffset;     // NUL-terminated names
+};
+static_assert(sizeof(PackHeader) == 32, "PackHeader layout");
+
+struct PackEntry
+{
+    uint64_t pathHash;
+    uint64_t offset;          // blob, from the start of the file
+    uint64_t size;
+    PackAssetType type;
+    uint32_t nameOffset;      // from namesOffset
+};
+static_assert(sizeof(PackEntry) == 32, "PackEntry layout");
+
+// Mesh blob: header, PackedVertex[vertexCount], then indexCount 16- or 32-bit indices
+// (4-byte aligned). Fields mirror the cooked Mesh (see CookMesh).
+struct PackMeshHeader
+{
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t index32;
+    uint32_t lodCount;
+    struct Lod
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        float maxPixels;
+    } lods[4];
+    float quantOffset[3];
+    float quantScale[3];
+    float boundsCenter[3];
+    float boundsRadius;
+    uint32_t reserved[2];
+};
+static_assert(sizeof(PackMeshHeader) == 112, "PackMeshHeader layout");
+
+// Texture blob: header, PackTextureMip[mipLevels * arraySize] (array slice major), data.
+// format is a DXGI_FORMAT (UNORM; the sRGB view is chosen at load time).
+struct PackTextureHeader
+{
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    uint32_t arraySize;
+    uint32_t flags;
+    uint32_t reserved[2];
+};
+static_assert(sizeof(PackTextureHeader) == 32, "PackTextureHeader layout");
+
+struct PackTextureMip
+{
+    uint64_t offset;          // from the start of the blob
+    uint32_t rowPitch;        // bytes per row (per row of blocks for BC formats)
+    uint32_t slicePitch;      // bytes of the whole level
+};
+static_assert(sizeof(PackTextureMip) == 16, "PackTextureMip layout");
+
+constexpr uint32_t kAssetPackVersion = 1;
+
+// FNV-1a of the path lower-cased, with '\\' -> '/' and leading "./" removed, so
+// "Textures\\Brick.png" and "textures/brick.png" name the same entry.
+uint64_t AssetPathHash(std::string_view path);
+std::string NormalizeAssetPath(std::string_view path);
+
+class AssetPack
+{
+public:
+    AssetPack() = default;
+    ~AssetPack();
+
+    AssetPack(const AssetPack&) = delete;
+    AssetPack& operator=(const AssetPack&) = delete;
+
+    // Maps the file and validates the header and entry table (blob contents are checked by the
+    // typed readers below). Returns false and stays closed on failure.
+    bool Open(const std::wstring& path);
+    void Close();
+
+    bool IsOpen() const { return mBase != nullptr; }
+    const std::wstring& Path() const { return mPath; }
+    uint64_t Size() const { return mSize; }
+
+    uint32_t EntryCount() const { return mEntryCount; }
+    const PackEntry* Entries() const { return mEntries; }
+
+    const PackEntry* Find(std::string_view path) const;
+    const PackEntry* FindHash(uint64_t pathHash) const;
+
+    const uint8_t* Data(const PackEntry& e) const { return mBase + e.offset; }
+    const char* Name(const PackEntry& e) const;
+
+private:
+    std::wstring mPath;
+    void* mFile = nullptr;    // HANDLE
+    void* mMapping = nullptr; // HANDLE
+    const uint8_t* mBase = nullptr;
+    uint64_t mSize = 0;
+    const PackEntry* mEntries = nullptr;
+    uint32_t mEntryCount = 0;
+    const char* mNames = nullptr;
+    uint64_t mNamesSize = 0;
+};
+
+// Typed views into a mapped blob; false if the entry has another type or is malformed.
+struct PackMeshView
+{
+    const PackMeshHeader* header = nullptr;
+    const void* vertices = nullptr;
+    const void* indices = nullptr;
+    uint32_t vertexBytes = 0;
+    uint32_t indexBytes = 0;
+};
+bool ReadPackMesh(const AssetPack& pack, const PackEntry& e, PackMeshView& out);
+
+struct PackTextureView
+{
+    const PackTextureHeader* header = nullptr;
+    const PackTextureMip* mips = nullptr; // mipLevels * arraySize
+    const uint8_t* blob = nullptr;
+};
+bool ReadPackTexture(const AssetPack& pack, const PackEntry& e, PackTextureView& out);
+
+// Builds a pack in memory and writes it in one go (tools and the demo's cook path).
+class AssetPackWriter
+{
+public:
+    // mesh must be cooked and not yet uploaded (packedVertices/packedIndices present).
+    bool AddMesh(std::string_view path, const Mesh& mesh);
+    // data[i] / rowPitch[i] / slicePitch[i] per subresource, array slice major.
+    bool AddTexture(std::string_view path, const PackTextureHeader& desc, const void* const* data,
+        const uint32_t* rowPitch, const uint32_t* slicePitch);
+    bool AddMaterial(std::string_view path, std::string_view text);
+
+    bool Save(const std::wstring& path, std::string* outError) const;
+
+    size_t EntryCount() const { return mEntries.size(); }
+
+private:
+    struct Pending
+    {
+        std::string name;
+        PackAssetType type = PackAssetType::Mesh;
+        std::vector<uint8_t> blob;
+    };
+
+    bool Add(std::string_view path, PackAssetType type, std::vector<uint8_t>&& blob);
+
+    std::vector<Pending> mEntries;
+};
+
+} // namespace king
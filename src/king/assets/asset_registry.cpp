@@ -0,0 +1,94 @@
+#include "asset_registry.h"
+
+#include "../ecs/components.h"
+#include "../render/material.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace king
+{
+
+bool AssetRegistry::Mount(const std::wstring& packPath)
+{
+    auto pack = std::make_unique<AssetPack>();
+    if (!pack->Open(packPath))
+        return false;
+    mPacks.push_back(std::move(pack));
+    return true;
+}
+
+void AssetRegistry::UnmountAll()
+{
+    mPacks.clear();
+}
+
+AssetRef AssetRegistry::Resolve(std::string_view path, PackAssetType type) const
+{
+    if (path.empty())
+        return {};
+    for (auto it = mPacks.rbegin(); it != mPacks.rend(); ++it)
+    {
+        const PackEntry* e = (*it)->Find(path);
+        if (e && e->type == type)
+            return { it->get(), e };
+    }
+    return {};
+}
+
+bool AssetRegistry::LoadMaterial(std::string_view path, PbrMaterial& outMaterial, std::string* outError) const
+{
+    const AssetRef ref = Resolve(path, PackAssetType::Material);
+    if (!ref)
+    {
+        if (outError)
+            *outError = "Material not found in mounted packs: " + std::string(path);
+        return false;
+    }
+    const char* text = (const char*)ref.pack->Data(*ref.entry);
+    return ParseMaterialText(std::string_view(text, (size_t)ref.entry->size), outMaterial, outError);
+}
+
+bool AssetRegistry::LoadMesh(std::string_view path, Mesh& outMesh) const
+{
+    const AssetRef ref = Resolve(path, PackAssetType::Mesh);
+    PackMeshView view{};
+    if (!ref || !ReadPackMesh(*ref.pack, *ref.entry, view))
+    {
+        std::printf("AssetRegistry: no valid mesh '%.*s' in mounted packs\n", (int)path.size(), path.data());
+        return false;
+    }
+
+    const PackMeshHeader& h = *view.header;
+    outMesh.vertices.clear();
+    outMesh.indices.clear();
+    outMesh.lodSources.clear();
+    outMesh.packedVertices.clear();
+    outMesh.packedIndices.clear();
+    outMesh.keepCpuData = false;
+    outMesh.pack = ref.pack;
+    outMesh.packEntry = ref.entry;
+
+    outMesh.vertexCount = h.vertexCount;
+    outMesh.indexCount = h.indexCount;
+    outMesh.index32 = h.index32 != 0;
+    outMesh.lodCount = std::max(h.lodCount, 1u);
+    for (uint32_t l = 0; l < kMaxMeshLods; ++l)
+    {
+        outMesh.lods[l] = {};
+        if (l < h.lodCount)
+        {
+            outMesh.lods[l].firstIndex = h.lods[l].firstIndex;
+            outMesh.lods[l].indexCount = h.lods[l].indexCount;
+            outMesh.lods[l].maxPixels = h.lods[l].maxPixels;
+        }
+    }
+    outMesh.quantOffset = { h.quantOffset[0], h.quantOffset[1], h.quantOffset[2] };
+    outMesh.quantScale = { h.quantScale[0], h.quantScale[1], h.quantScale[2] };
+    outMesh.boundsCenter = { h.boundsCenter[0], h.boundsCenter[1], h.boundsCenter[2] };
+    outMesh.boundsRadius = h.boundsRadius;
+    outMesh.revision = 0;
+    return true;
+}
+
+} // namespace king
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "asset_pack.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace king
+{
+
+struct Mesh;
+struct PbrMaterial;
+
+struct AssetRef
+{
+    const AssetPack* pack = nullptr;
+    const PackEntry* entry = nullptr;
+
+    explicit operator bool() const { return pack && entry; }
+};
+
+// Mounted packs, looked up by asset path (the strings in PbrMaterial::textures, mesh and
+// material names). Later mounts shadow earlier ones, so a patch pack can override a base pack.
+// Packs stay mapped until UnmountAll; meshes and textures loaded from them point into the
+// mapping, so unmount only after the scene and the renderer's textures are gone.
+class AssetRegistry
+{
+public:
+    AssetRegistry() = default;
+
+    AssetRegistry(const AssetRegistry&) = delete;
+    AssetRegistry& operator=(const AssetRegistry&) = delete;
+
+    bool Mount(const std::wstring& packPath);
+    void UnmountAll();
+
+    size_t PackCount() const { return mPacks.size(); }
+
+    AssetRef Resolve(std::string_view path, PackAssetType type) const;
+
+    // Parses a material entry (same text format as LoadMaterialFile).
+    bool LoadMaterial(std::string_view path, PbrMaterial& outMaterial, std::string* outError) const;
+
+    // Points the mesh at a mesh entry: the draw fields are filled now, the buffers are uploaded
+    // from the mapping by the renderer once the streamer has paged them in (revision stays 0
+    // until then, so the mesh is not drawn).
+    bool LoadMesh(std::string_view path, Mesh& outMesh) const;
+
+private:
+    std::vector<std::unique_ptr<AssetPack>> mPacks;
+};
+
+} // namespace king
@@ -0,0 +1,95 @@
+#include "asset_streamer.h"
+
+#include "../thread_config.h"
+
+namespace king
+{
+
+AssetStreamer::~AssetStreamer()
+{
+    Stop();
+}
+
+void AssetStreamer::Start()
+{
+    Stop();
+    mStop = false;
+    mRunning = true;
+    const ThreadPlacement placement = GetThreadConfig().streaming;
+    mThread = std::thread([this, placement]()
+    {
+        (void)ApplyThreadPlacement(placement);
+        ThreadMain();
+    });
+}
+
+void AssetStreamer::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mCv.notify_all();
+    if (mThread.joinable())
+        mThread.join();
+    mRunning = false;
+    mQueue.clear();
+}
+
+void AssetStreamer::Clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mQueue.clear();
+    mState.clear();
+}
+
+bool AssetStreamer::Prefetch(const AssetRef& ref)
+{
+    if (!ref)
+        return false;
+    if (!mRunning)
+        return true;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mState.find(ref.entry);
+    if (it != mState.end())
+        return it->second;
+
+    mState.emplace(ref.entry, false);
+    mQueue.push_back(ref);
+    mCv.notify_one();
+    return false;
+}
+
+void AssetStreamer::ThreadMain()
+{
+    for (;;)
+    {
+        AssetRef ref{};
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCv.wait(lock, [&]() { return mStop || !mQueue.empty(); });
+            if (mStop)
+                return;
+            ref = mQueue.front();
+            mQueue.pop_front();
+        }
+
+        // One read per page faults the whole blob in (the mapping is read-only, so the reads
+        // cannot be optimized into nothing through the volatile pointer).
+        const volatile uint8_t* p = ref.pack->Data(*ref.entry);
+        const uint64_t size = ref.entry->size;
+        uint32_t sink = 0;
+        for (uint64_t o = 0; o < size; o += 4096u)
+            sink += p[o];
+        if (size > 0)
+            sink += p[size - 1];
+        (void)sink;
+
+        mBytesPagedIn.fetch_add(size, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mMutex);
+        mState[ref.entry] = true;
+    }
+}
+
+} // namespace king
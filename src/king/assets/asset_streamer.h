@@ -0,0 +1,74 @@
+#pragma once
+
+#include "asset_registry.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace king
+{
+
+// Per-frame GPU upload allowance shared by everything that streams (meshes, textures). An
+// upload that does not fit waits for a later frame, except that the first upload of a frame
+// always goes through so an asset larger than the budget still arrives.
+struct StreamBudget
+{
+    uint64_t bytesLeft = 0;
+    uint32_t uploads = 0;
+
+    bool Take(uint64_t bytes)
+    {
+        if (bytes > bytesLeft && uploads > 0)
+            return false;
+        bytesLeft = (bytes > bytesLeft) ? 0 : bytesLeft - bytes;
+        uploads++;
+        return true;
+    }
+};
+
+// Background page-in for pack entries. Uploads read straight from the mapping, so the cost a
+// render-thread CreateBuffer/CreateTexture2D could hit is the disk read behind the page
+// faults; this thread touches an entry's pages first and marks it resident.
+//
+// Without Start() every entry reports resident immediately (the faults happen on upload).
+class AssetStreamer
+{
+public:
+    AssetStreamer() = default;
+    ~AssetStreamer();
+
+    AssetStreamer(const AssetStreamer&) = delete;
+    AssetStreamer& operator=(const AssetStreamer&) = delete;
+
+    void Start();
+    void Stop();
+
+    // True once the entry's bytes are resident; queues it otherwise (repeated calls are cheap).
+    bool Prefetch(const AssetRef& ref);
+
+    // Forgets residency state (call when packs are unmounted).
+    void Clear();
+
+    uint64_t BytesPagedIn() const { return mBytesPagedIn.load(std::memory_order_relaxed); }
+
+private:
+    void ThreadMain();
+
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    bool mRunning = false;
+    bool mStop = false;
+
+    std::deque<AssetRef> mQueue;
+    // false = queued, true = resident.
+    std::unordered_map<const PackEntry*, bool> mState;
+    std::atomic<uint64_t> mBytesPagedIn{ 0 };
+};
+
+} // namespace king
@@ -0,0 +1,172 @@
+#include "file_watcher.h"
+
+#include "../perf/trace_capture.h"
+
+#include <windows.h>
+
+#include <cstdio>
+#include <cwctype>
+
+namespace king
+{
+
+FileWatcher::~FileWatcher()
+{
+    Stop();
+}
+
+std::wstring FileWatcher::NormalizePath(const std::wstring& path)
+{
+    if (path.empty())
+        return {};
+
+    std::wstring full(MAX_PATH, L'\0');
+    DWORD n = GetFullPathNameW(path.c_str(), (DWORD)full.size(), full.data(), nullptr);
+    if (n >= full.size())
+    {
+        full.resize(n);
+        n = GetFullPathNameW(path.c_str(), (DWORD)full.size(), full.data(), nullptr);
+    }
+    if (n == 0 || n >= full.size())
+        full = path;
+    else
+        full.resize(n);
+
+    for (wchar_t& c : full)
+        c = (c == L'/') ? L'\\' : (wchar_t)std::towlower(c);
+    while (full.size() > 3 && full.back() == L'\\')
+        full.pop_back();
+    return full;
+}
+
+bool FileWatcher::Start(const std::wstring& directory, bool recursive)
+{
+    if (Running() || directory.empty())
+        return false;
+
+    mDirectory = NormalizePath(directory);
+    mRecursive = recursive;
+
+    HANDLE dir = CreateFileW(mDirectory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+    if (dir == INVALID_HANDLE_VALUE)
+        return false;
+
+    HANDLE stop = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (!stop)
+    {
+        CloseHandle(dir);
+        return false;
+    }
+
+    mDirHandle = dir;
+    mStopEvent = stop;
+    mThread = std::thread([this]() { ThreadMain(); });
+    return true;
+}
+
+void FileWatcher::Stop()
+{
+    if (mStopEvent)
+        SetEvent((HANDLE)mStopEvent);
+    if (mThread.joinable())
+        mThread.join();
+    if (mDirHandle)
+    {
+        CloseHandle((HANDLE)mDirHandle);
+        mDirHandle = nullptr;
+    }
+    if (mStopEvent)
+    {
+        CloseHandle((HANDLE)mStopEvent);
+        mStopEvent = nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPending.clear();
+}
+
+void FileWatcher::Poll(std::vector<std::wstring>& outPaths)
+{
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto it = mPending.begin(); it != mPending.end();)
+    {
+        if (now - it->second >= mDebounce)
+        {
+            outPaths.push_back(it->first);
+            it = mPending.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void FileWatcher::ThreadMain()
+{
+    king::perf::TraceCapture::SetThreadName("FileWatcher");
+
+    HANDLE dir = (HANDLE)mDirHandle;
+    HANDLE ioEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (!ioEvent)
+        return;
+
+    // FILE_NOTIFY_INFORMATION records are DWORD aligned.
+    std::vector<DWORD> buffer(16 * 1024);
+    const uint8_t* bytesBase = (const uint8_t*)buffer.data();
+    const DWORD filter = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE;
+
+    for (;;)
+    {
+        OVERLAPPED ov{};
+        ov.hEvent = ioEvent;
+        ResetEvent(ioEvent);
+        if (!ReadDirectoryChangesW(dir, buffer.data(), (DWORD)(buffer.size() * sizeof(DWORD)), mRecursive ? TRUE : FALSE, filter, nullptr, &ov, nullptr))
+        {
+            std::printf("FileWatcher: ReadDirectoryChangesW failed for '%ls' (%lu)\n", mDirectory.c_str(), GetLastError());
+            break;
+        }
+
+        HANDLE handles[2] = { (HANDLE)mStopEvent, ioEvent };
+        const DWORD wait = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+        if (wait != WAIT_OBJECT_0 + 1)
+        {
+            CancelIoEx(dir, &ov);
+            DWORD ignored = 0;
+            (void)GetOverlappedResult(dir, &ov, &ignored, TRUE);
+            break;
+        }
+
+        DWORD bytes = 0;
+        if (!GetOverlappedResult(dir, &ov, &bytes, FALSE))
+            continue;
+        // Zero bytes: more changes than the buffer held. They are lost; the next save reports.
+        if (bytes == 0)
+            continue;
+
+        const auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (size_t offset = 0;;)
+        {
+            const auto* info = (const FILE_NOTIFY_INFORMATION*)(bytesBase + offset);
+            if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+            {
+                std::wstring path = mDirectory;
+                path += L'\\';
+                path.append(info->FileName, info->FileNameLength / sizeof(wchar_t));
+                for (wchar_t& c : path)
+                    c = (c == L'/') ? L'\\' : (wchar_t)std::towlower(c);
+                mPending[path] = now;
+            }
+            if (info->NextEntryOffset == 0)
+                break;
+            offset += info->NextEntryOffset;
+        }
+    }
+
+    CloseHandle(ioEvent);
+}
+
+} // namespace king
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace king
+{
+
+// Watches one directory tree for written, created and renamed-to files on a background thread
+// (ReadDirectoryChangesW). Editors often save in several writes, so a path is reported by Poll
+// only once it has been quiet for the debounce time.
+class FileWatcher
+{
+public:
+    FileWatcher() = default;
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Returns false if the directory cannot be opened (or a watch is already running).
+    bool Start(const std::wstring& directory, bool recursive = true);
+    void Stop();
+    bool Running() const { return mThread.joinable(); }
+    // NormalizePath of the watched directory.
+    const std::wstring& Directory() const { return mDirectory; }
+
+    void SetDebounceMs(uint32_t ms) { mDebounce = std::chrono::milliseconds(ms); }
+
+    // Appends the paths (NormalizePath form) that changed and have settled since the last call.
+    void Poll(std::vector<std::wstring>& outPaths);
+
+    // Absolute, lower case, backslashes, no "." / ".." parts: the form paths are compared in.
+    static std::wstring NormalizePath(const std::wstring& path);
+
+private:
+    void ThreadMain();
+
+    std::thread mThread;
+    std::wstring mDirectory;
+    bool mRecursive = true;
+    // Directory handle and a manual-reset stop event (HANDLEs kept opaque here).
+    void* mDirHandle = nullptr;
+    void* mStopEvent = nullptr;
+    std::chrono::milliseconds mDebounce{ 150 };
+
+    std::mutex mMutex; // guards mPending
+    std::unordered_map<std::wstring, std::chrono::steady_clock::time_point> mPending;
+};
+
+} // namespace king
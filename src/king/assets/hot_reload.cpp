@@ -0,0 +1,122 @@
+#include "hot_reload.h"
+
+#include <windows.h>
+
+#include <cstdio>
+#include <cwchar>
+
+namespace king
+{
+
+static std::wstring ToWide(const std::string& s)
+{
+    if (s.empty())
+        return {};
+    const int wlen = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), nullptr, 0);
+    if (wlen <= 0)
+        return {};
+    std::wstring w;
+    w.resize((size_t)wlen);
+    MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), w.data(), wlen);
+    return w;
+}
+
+static bool EndsWith(const std::wstring& s, const wchar_t* suffix)
+{
+    const size_t m = std::wcslen(suffix);
+    return s.size() >= m && s.compare(s.size() - m, m, suffix) == 0;
+}
+
+bool HotReload::Watch(const std::wstring& directory)
+{
+    const std::wstring dir = FileWatcher::NormalizePath(directory);
+    if (dir.empty())
+        return false;
+
+    // Watchers are recursive: a directory at or below a watched one is covered.
+    for (const auto& w : mWatchers)
+    {
+        const std::wstring& root = w->Directory();
+        if (dir.compare(0, root.size(), root) == 0 && (dir.size() == root.size() || dir[root.size()] == L'\\'))
+            return true;
+    }
+
+    auto watcher = std::make_unique<FileWatcher>();
+    if (!watcher->Start(dir))
+    {
+        std::printf("HotReload: cannot watch '%ls'\n", dir.c_str());
+        return false;
+    }
+    std::printf("HotReload: watching '%ls'\n", dir.c_str());
+    mWatchers.push_back(std::move(watcher));
+    return true;
+}
+
+void HotReload::Stop()
+{
+    mWatchers.clear();
+}
+
+bool HotReload::LoadMaterial(MaterialRegistry& registry, const std::string& path, MaterialHandle& outHandle, std::string* outError)
+{
+    PbrMaterial mat{};
+    if (!LoadMaterialFile(path.c_str(), mat, outError))
+        return false;
+
+    // A handle of its own: reloads overwrite it, so it must not be shared with an identical
+    // interned material (or the default one).
+    outHandle = registry.Add(mat);
+
+    MaterialFile file{};
+    file.registry = &registry;
+    file.handle = outHandle;
+    file.path = path;
+    file.normalized = FileWatcher::NormalizePath(ToWide(path));
+    mMaterials.push_back(std::move(file));
+
+    if (Enabled())
+    {
+        const std::wstring& p = mMaterials.back().normalized;
+        const size_t slash = p.find_last_of(L'\\');
+        if (slash != std::wstring::npos)
+            (void)Watch(p.substr(0, slash));
+    }
+    return true;
+}
+
+void HotReload::Update(std::vector<std::wstring>& outChangedShaders)
+{
+    mChanged.clear();
+    for (auto& w : mWatchers)
+        w->Poll(mChanged);
+
+    for (const std::wstring& path : mChanged)
+    {
+        if (EndsWith(path, L".hlsl") || EndsWith(path, L".hlsli"))
+        {
+            outChangedShaders.push_back(path);
+            continue;
+        }
+        if (!EndsWith(path, L".mat"))
+            continue;
+
+        for (const MaterialFile& file : mMaterials)
+        {
+            if (file.normalized != path)
+                continue;
+
+            PbrMaterial mat{};
+            std::string err;
+            if (!LoadMaterialFile(file.path.c_str(), mat, &err))
+            {
+                std::printf("HotReload: %s (keeping the previous material)\n", err.c_str());
+                continue;
+            }
+            file.registry->Set(file.handle, mat);
+            ++mMaterialReloads;
+            std::printf("HotReload: reloaded material '%s'\n", file.path.c_str());
+        }
+    }
+}
+
+} // namespace king
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "file_watcher.h"
+#include "../render/material_registry.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace king
+{
+
+// Dev hot reload: watches directories (FileWatcher) and, once per frame, reloads the material
+// files it was given into their handles and hands back the shader sources that changed, for
+// RenderSystemD3D11::ReloadShaders. Nothing is re-created: a reloaded material only moves its
+// registry version, so the renderer re-resolves that one material.
+class HotReload
+{
+public:
+    HotReload() = default;
+    ~HotReload() { Stop(); }
+
+    HotReload(const HotReload&) = delete;
+    HotReload& operator=(const HotReload&) = delete;
+
+    // Starts watching `directory` (and below); true if it is already watched. Once anything is
+    // watched, the directories of material files loaded through LoadMaterial are added too.
+    bool Watch(const std::wstring& directory);
+    void Stop();
+    bool Enabled() const { return !mWatchers.empty(); }
+
+    // LoadMaterialFile into a handle of `registry` that Update reloads in place whenever the
+    // file changes. The handle is private to this file (MaterialRegistry::Add), so a reload
+    // only changes the renderers that use it.
+    bool LoadMaterial(MaterialRegistry& registry, const std::string& path, MaterialHandle& outHandle, std::string* outError);
+
+    // Main thread, between frames. A material file that fails to parse keeps its old contents.
+    void Update(std::vector<std::wstring>& outChangedShaders);
+
+    uint32_t MaterialReloads() const { return mMaterialReloads; }
+
+private:
+    struct MaterialFile
+    {
+        MaterialRegistry* registry = nullptr;
+        MaterialHandle handle = kDefaultMaterial;
+        std::string path;           // as given, for LoadMaterialFile
+        std::wstring normalized;    // FileWatcher::NormalizePath
+    };
+
+    std::vector<std::unique_ptr<FileWatcher>> mWatchers;
+    std::vector<MaterialFile> mMaterials;
+    std::vector<std::wstring> mChanged; // scratch
+    uint32_t mMaterialReloads = 0;
+};
+
+} // namespace king
@@ -0,0 +1,530 @@
+#include "scene_file.h"
+
+#include "asset_pack.h"
+#include "asset_registry.h"
+#include "../render/mesh_cook.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace king
+{
+
+namespace
+{
+
+constexpr uint32_t kSceneMagic = 0x4E43534Bu; // "KSCN"
+constexpr uint32_t kSceneVersion = 1;
+
+struct SceneFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entityCount;
+    uint32_t materialCount;
+    uint32_t poolCount;
+    uint32_t reserved[3];
+};
+static_assert(sizeof(SceneFileHeader) == 32, "SceneFileHeader layout");
+
+// Followed by Entity[count] (the writer's ids), then the pool's data.
+struct PoolHeader
+{
+    uint32_t pool;        // ComponentBit of the component type
+    uint32_t count;
+    uint32_t elementSize; // sizeof(T) for plain-data pools, 0 for meshes
+    uint32_t reserved;
+};
+static_assert(sizeof(PoolHeader) == 16, "PoolHeader layout");
+
+constexpr uint32_t kMeshFromAsset = 1u << 0;
+constexpr uint32_t kMeshKeepCpuData = 1u << 1;
+
+template <typename T>
+constexpr bool kRawPool = std::is_trivially_copyable_v<T>;
+static_assert(kRawPool<Transform> && kRawPool<MeshRenderer> && kRawPool<CameraComponent> && kRawPool<Light>,
+    "scene file pools are written as raw arrays");
+
+struct Writer
+{
+    std::vector<uint8_t> bytes;
+
+    void Raw(const void* p, size_t n)
+    {
+        if (n == 0)
+            return;
+        const size_t at = bytes.size();
+        bytes.resize(at + n);
+        std::memcpy(bytes.data() + at, p, n);
+    }
+    template <typename T>
+    void Pod(const T& v) { Raw(&v, sizeof(T)); }
+    template <typename T>
+    void Array(const std::vector<T>& v)
+    {
+        Pod((uint32_t)v.size());
+        Raw(v.data(), v.size() * sizeof(T));
+    }
+    void String(const std::string& s)
+    {
+        Pod((uint32_t)s.size());
+        Raw(s.data(), s.size());
+    }
+};
+
+// Fails (and stays failed) on the first read past the end.
+struct Reader
+{
+    const uint8_t* p = nullptr;
+    size_t size = 0;
+    size_t at = 0;
+    bool ok = true;
+
+    size_t Remaining() const { return ok ? size - at : 0; }
+
+    const uint8_t* Take(size_t n)
+    {
+        if (!ok || n > size - at)
+        {
+            ok = false;
+            return nullptr;
+        }
+        const uint8_t* r = p + at;
+        at += n;
+        return r;
+    }
+    template <typename T>
+    T Pod()
+    {
+        T v{};
+        if (const uint8_t* src = Take(sizeof(T)))
+            std::memcpy(&v, src, sizeof(T));
+        return v;
+    }
+    template <typename T>
+    void Array(std::vector<T>& out)
+    {
+        const uint32_t n = Pod<uint32_t>();
+        const size_t bytesNeeded = (size_t)n * sizeof(T);
+        if (!ok || bytesNeeded / sizeof(T) != n || bytesNeeded > size - at)
+        {
+            ok = false;
+            return;
+        }
+        out.resize(n);
+        if (const uint8_t* src = Take(bytesNeeded))
+            std::memcpy(out.data(), src, bytesNeeded);
+    }
+    void String(std::string& out)
+    {
+        const uint32_t n = Pod<uint32_t>();
+        if (const uint8_t* src = Take(n))
+            out.assign((const char*)src, n);
+    }
+};
+
+void WriteMaterial(Writer& w, const PbrMaterial& m)
+{
+    w.Pod(m.albedo);
+    w.Pod(m.roughness);
+    w.Pod(m.metallic);
+    w.Pod(m.emissive);
+    w.Pod((uint8_t)m.blendMode);
+    w.Pod((uint8_t)m.shadingModel);
+    w.String(m.shader);
+    w.String(m.textures.albedo);
+    w.String(m.textures.normal);
+    w.String(m.textures.metallicRoughness);
+    w.String(m.textures.emissive);
+
+    // Sorted, so equal materials write equal bytes.
+    std::vector<std::pair<std::string, float>> scalars(m.scalars.begin(), m.scalars.end());
+    std::sort(scalars.begin(), scalars.end());
+    w.Pod((uint32_t)scalars.size());
+    for (const auto& s : scalars)
+    {
+        w.String(s.first);
+        w.Pod(s.second);
+    }
+}
+
+// Smallest encoding WriteMaterial produces (empty strings, no scalars).
+constexpr size_t kMinMaterialBytes = sizeof(Float4) + 2 * sizeof(float) + sizeof(Float3) + 2 * sizeof(uint8_t)
+    + 5 * sizeof(uint32_t) + sizeof(uint32_t);
+
+void ReadMaterial(Reader& r, PbrMaterial& m)
+{
+    m.albedo = r.Pod<Float4>();
+    m.roughness = r.Pod<float>();
+    m.metallic = r.Pod<float>();
+    m.emissive = r.Pod<Float3>();
+    m.blendMode = (MaterialBlendMode)r.Pod<uint8_t>();
+    m.shadingModel = (MaterialShadingModel)r.Pod<uint8_t>();
+    r.String(m.shader);
+    r.String(m.textures.albedo);
+    r.String(m.textures.normal);
+    r.String(m.textures.metallicRoughness);
+    r.String(m.textures.emissive);
+
+    const uint32_t scalarCount = r.Pod<uint32_t>();
+    for (uint32_t i = 0; i < scalarCount && r.ok; ++i)
+    {
+        std::string name;
+        r.String(name);
+        m.scalars[name] = r.Pod<float>();
+    }
+}
+
+template <typename T>
+void WriteRawPool(Writer& w, const SparseSet<T>& pool)
+{
+    PoolHeader h{};
+    h.pool = ComponentBit<T>();
+    h.count = (uint32_t)pool.Size();
+    h.elementSize = (uint32_t)sizeof(T);
+    w.Pod(h);
+    w.Raw(pool.Entities().data(), pool.Size() * sizeof(Entity));
+    w.Raw(pool.Data().data(), pool.Size() * sizeof(T));
+}
+
+bool WriteMeshPool(Writer& w, const SparseSet<Mesh>& pool, std::string* outError)
+{
+    PoolHeader h{};
+    h.pool = ComponentBit<Mesh>();
+    h.count = (uint32_t)pool.Size();
+    w.Pod(h);
+    w.Raw(pool.Entities().data(), pool.Size() * sizeof(Entity));
+
+    for (const Mesh& m : pool.Data())
+    {
+        if (m.pack && m.packEntry)
+        {
+            w.Pod(kMeshFromAsset);
+            w.String(m.pack->Name(*m.packEntry));
+            continue;
+        }
+        if (m.vertices.empty())
+        {
+            if (outError)
+                *outError = "a mesh has neither an asset path nor CPU data (keepCpuData off after upload)";
+            return false;
+        }
+
+        w.Pod(m.keepCpuData ? kMeshKeepCpuData : 0u);
+        w.Array(m.vertices);
+        w.Array(m.indices);
+        w.Pod((uint32_t)m.lodSources.size());
+        for (const MeshLodSource& lod : m.lodSources)
+        {
+            w.Pod(lod.maxPixels);
+            w.Array(lod.indices);
+        }
+    }
+    return true;
+}
+
+// Maps a stored entity to the one created for it on load (kInvalidEntity if it was not alive).
+struct EntityRemap
+{
+    std::vector<uint32_t> slot; // stored entity index -> position in stored/created
+    const std::vector<Entity>* stored = nullptr;
+    const std::vector<Entity>* created = nullptr;
+
+    // Per stored entity: the last pool (stamp) that listed it, for Apply's duplicate check.
+    std::vector<uint32_t> seen;
+
+    Entity operator()(Entity e) const
+    {
+        const uint32_t i = EntityIndex(e);
+        if (i >= slot.size() || slot[i] == ~0u || (*stored)[slot[i]] != e)
+            return kInvalidEntity;
+        return (*created)[slot[i]];
+    }
+
+    // Remaps a pool's entity list in place. False if an entity was not stored alive, or is
+    // listed twice (Append would leave the sparse index pointing at only one copy). `stamp`
+    // must be unique per pool and non-zero.
+    bool Apply(std::vector<Entity>& list, uint32_t stamp)
+    {
+        for (Entity& e : list)
+        {
+            const Entity mapped = (*this)(e);
+            if (mapped == kInvalidEntity)
+                return false;
+            uint32_t& mark = seen[slot[EntityIndex(e)]];
+            if (mark == stamp)
+                return false;
+            mark = stamp;
+            e = mapped;
+        }
+        return true;
+    }
+};
+
+template <typename T>
+bool ReadRawPool(Reader& r, const PoolHeader& h, SparseSet<T>& pool, EntityRemap& remap, uint32_t stamp,
+    std::vector<Entity>& scratch, std::string* outError)
+{
+    if (h.elementSize != sizeof(T))
+    {
+        if (outError)
+            *outError = "component layout differs from the build that wrote the scene";
+        return false;
+    }
+
+    const uint8_t* entities = r.Take((size_t)h.count * sizeof(Entity));
+    const uint8_t* data = r.Take((size_t)h.count * sizeof(T));
+    if (!r.ok)
+        return false;
+
+    scratch.resize(h.count);
+    std::memcpy(scratch.data(), entities, scratch.size() * sizeof(Entity));
+    // A component of an entity that was not stored alive has nowhere to go.
+    if (!remap.Apply(scratch, stamp))
+    {
+        if (outError)
+            *outError = "a component belongs to an entity that is not in the scene, or is listed twice";
+        return false;
+    }
+
+    T* out = pool.Append(scratch.data(), scratch.size());
+    std::memcpy((void*)out, data, (size_t)h.count * sizeof(T));
+    return true;
+}
+
+bool ReadMeshPool(Reader& r, const PoolHeader& h, SparseSet<Mesh>& pool, EntityRemap& remap, uint32_t stamp,
+    const AssetRegistry* assets, std::vector<Entity>& scratch)
+{
+    const uint8_t* entities = r.Take((size_t)h.count * sizeof(Entity));
+    if (!r.ok)
+        return false;
+    scratch.resize(h.count);
+    std::memcpy(scratch.data(), entities, scratch.size() * sizeof(Entity));
+    if (!remap.Apply(scratch, stamp))
+        return false;
+
+    Mesh* out = pool.Append(scratch.data(), scratch.size());
+    for (uint32_t i = 0; i < h.count && r.ok; ++i)
+    {
+        Mesh& m = out[i];
+        const uint32_t flags = r.Pod<uint32_t>();
+        if (flags & kMeshFromAsset)
+        {
+            std::string id;
+            r.String(id);
+            if (!assets || !assets->LoadMesh(id, m))
+                std::printf("LoadScene: mesh '%s' is not in a mounted pack, left empty\n", id.c_str());
+            continue;
+        }
+
+        r.Array(m.vertices);
+        r.Array(m.indices);
+        const uint32_t lodCount = r.Pod<uint32_t>();
+        for (uint32_t l = 0; l < lodCount && r.ok; ++l)
+        {
+            MeshLodSource lod{};
+            lod.maxPixels = r.Pod<float>();
+            r.Array(lod.indices);
+            m.lodSources.push_back(std::move(lod));
+        }
+        m.keepCpuData = (flags & kMeshKeepCpuData) != 0;
+        if (r.ok)
+            (void)CookMesh(m);
+    }
+    return r.ok;
+}
+
+} // namespace
+
+bool SaveScene(const Scene& scene, const std::wstring& path, std::string* outError)
+{
+    const Registry& reg = scene.reg;
+
+    Writer w;
+    SceneFileHeader h{};
+    h.magic = kSceneMagic;
+    h.version = kSceneVersion;
+    h.entityCount = (uint32_t)reg.Alive().size();
+    h.materialCount = (uint32_t)scene.materials.Size();
+    h.poolCount = 5;
+    w.Pod(h);
+    w.Raw(reg.Alive().data(), reg.Alive().size() * sizeof(Entity));
+
+    for (MaterialHandle m = 0; m < (MaterialHandle)scene.materials.Size(); ++m)
+        WriteMaterial(w, scene.materials.Get(m));
+
+    WriteRawPool(w, reg.transforms);
+    if (!WriteMeshPool(w, reg.meshes, outError))
+        return false;
+    WriteRawPool(w, reg.renderers);
+    WriteRawPool(w, reg.cameras);
+    WriteRawPool(w, reg.lights);
+
+    FILE* f = nullptr;
+    _wfopen_s(&f, path.c_str(), L"wb");
+    if (!f)
+    {
+        if (outError)
+            *outError = "cannot create scene file";
+        return false;
+    }
+    const bool ok = std::fwrite(w.bytes.data(), 1, w.bytes.size(), f) == w.bytes.size();
+    std::fclose(f);
+    if (!ok && outError)
+        *outError = "short write";
+    return ok;
+}
+
+bool LoadScene(Scene& scene, const std::wstring& path, const AssetRegistry* assets, std::string* outError)
+{
+    auto fail = [&](const char* msg)
+    {
+        if (outError)
+            *outError = msg;
+        return false;
+    };
+
+    Registry& reg = scene.reg;
+    if (!reg.Alive().empty())
+        return fail("LoadScene needs an empty scene");
+
+    std::vector<uint8_t> file;
+    {
+        FILE* f = nullptr;
+        if (_wfopen_s(&f, path.c_str(), L"rb") != 0 || !f)
+            return fail("cannot open scene file");
+        std::fseek(f, 0, SEEK_END);
+        const long size = std::ftell(f);
+        std::fseek(f, 0, SEEK_SET);
+        bool ok = size >= 0;
+        if (ok && size > 0)
+        {
+            file.resize((size_t)size);
+            ok = std::fread(file.data(), 1, file.size(), f) == file.size();
+        }
+        std::fclose(f);
+        if (!ok)
+            return fail("cannot read scene file");
+    }
+
+    Reader r{ file.data(), file.size() };
+    const SceneFileHeader h = r.Pod<SceneFileHeader>();
+    if (!r.ok || h.magic != kSceneMagic)
+        return fail("not a scene file");
+    if (h.version != kSceneVersion)
+        return fail("unsupported scene file version");
+
+    // Entities: the same count, created in one batch; references are remapped below. Counts
+    // are checked against the bytes left before anything is sized from them.
+    if ((size_t)h.entityCount * sizeof(Entity) > r.Remaining())
+        return fail("truncated scene file");
+    std::vector<Entity> stored((size_t)h.entityCount);
+    if (const uint8_t* src = r.Take(stored.size() * sizeof(Entity)))
+        std::memcpy(stored.data(), src, stored.size() * sizeof(Entity));
+    if (!r.ok)
+        return fail("truncated scene file");
+
+    // The remap is validated before any entity exists: alive entities have distinct indices.
+    std::vector<Entity> created;
+    EntityRemap remap;
+    remap.stored = &stored;
+    remap.created = &created;
+    uint32_t maxIndex = 0;
+    for (Entity e : stored)
+        maxIndex = std::max(maxIndex, EntityIndex(e));
+    remap.slot.assign(stored.empty() ? 0 : (size_t)maxIndex + 1u, ~0u);
+    for (uint32_t i = 0; i < (uint32_t)stored.size(); ++i)
+    {
+        uint32_t& slot = remap.slot[EntityIndex(stored[i])];
+        if (slot != ~0u)
+            return fail("an entity is stored twice");
+        slot = i;
+    }
+    remap.seen.assign(stored.size(), 0u);
+
+    if ((size_t)h.materialCount > r.Remaining() / kMinMaterialBytes)
+        return fail("truncated scene file");
+
+    reg.CreateEntities(stored.size(), created);
+    // From here on a failure destroys what was created (and their components), so the scene
+    // is empty again and the caller may retry. Interned materials stay: they are shared.
+    auto rollback = [&](const char* msg)
+    {
+        reg.DestroyEntities(created);
+        if (msg && outError)
+            *outError = msg;
+        return false;
+    };
+    if (created.size() != stored.size())
+        return rollback("entity index space exhausted");
+
+    // Materials: interned in file order; handles in renderers go through this table.
+    std::vector<MaterialHandle> materials(h.materialCount, kDefaultMaterial);
+    for (uint32_t i = 0; i < h.materialCount && r.ok; ++i)
+    {
+        PbrMaterial m{};
+        ReadMaterial(r, m);
+        materials[i] = scene.materials.Intern(m);
+    }
+    if (!r.ok)
+        return rollback("truncated scene file");
+
+    std::vector<Entity> scratch;
+    ComponentMask poolsRead = 0;
+    for (uint32_t p = 0; p < h.poolCount; ++p)
+    {
+        const PoolHeader ph = r.Pod<PoolHeader>();
+        if (!r.ok)
+            return rollback("truncated scene file");
+        // A second copy of a pool would Append entities that are already in it.
+        if (poolsRead & ph.pool)
+            return rollback("a component pool appears twice in the scene file");
+        poolsRead |= ph.pool;
+
+        const uint32_t stamp = p + 1u;
+        bool ok = false;
+        if (ph.pool == ComponentBit<Transform>())
+        {
+            ok = ReadRawPool(r, ph, reg.transforms, remap, stamp, scratch, outError);
+        }
+        else if (ph.pool == ComponentBit<Mesh>())
+        {
+            ok = ReadMeshPool(r, ph, reg.meshes, remap, stamp, assets, scratch);
+            if (!ok)
+                return rollback("corrupt mesh pool");
+        }
+        else if (ph.pool == ComponentBit<MeshRenderer>())
+        {
+            ok = ReadRawPool(r, ph, reg.renderers, remap, stamp, scratch, outError);
+        }
+        else if (ph.pool == ComponentBit<CameraComponent>())
+        {
+            ok = ReadRawPool(r, ph, reg.cameras, remap, stamp, scratch, outError);
+        }
+        else if (ph.pool == ComponentBit<Light>())
+        {
+            ok = ReadRawPool(r, ph, reg.lights, remap, stamp, scratch, outError);
+        }
+        else
+        {
+            return rollback("unknown component pool in scene file");
+        }
+        if (!ok)
+            return rollback(r.ok ? nullptr : "truncated scene file");
+    }
+
+    for (Transform& t : reg.transforms.Data())
+        t.parent = remap(t.parent);
+    for (MeshRenderer& mr : reg.renderers.Data())
+    {
+        mr.mesh = remap(mr.mesh);
+        mr.material = (mr.material < materials.size()) ? materials[mr.material] : kDefaultMaterial;
+    }
+    return true;
+}
+
+} // namespace king
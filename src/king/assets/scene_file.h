@@ -0,0 +1,31 @@
+#pragma once
+
+#include "../ecs/scene.h"
+
+#include <string>
+
+namespace king
+{
+
+class AssetRegistry;
+
+// Binary scene snapshot (.kscene): the live entities, every material of Scene::materials and
+// the transforms, meshes, renderers, cameras and lights pools. WorldTransforms are not stored;
+// TransformSystem rebuilds them.
+//
+// Plain-data pools (everything but meshes) are their dense arrays as they are in memory, so
+// a file only loads into the build (layout) that wrote it; the header records each pool's
+// element size and a mismatch fails the load. Entity references (Transform::parent,
+// MeshRenderer::mesh) are remapped to the entities created on load, and material handles to
+// the handles the stored materials intern to.
+//
+// A mesh from a mounted asset pack is stored as its asset path and loaded again through the
+// AssetRegistry; any other mesh (procedural) stores its source vertices, indices and LODs and
+// is cooked on load. A mesh that has neither (CPU data released) cannot be saved.
+bool SaveScene(const Scene& scene, const std::wstring& path, std::string* outError);
+
+// The scene must be empty (no entities). Every pool is filled with one bulk append after a
+// single reserve. `assets` resolves pack meshes (nullptr: they load empty and aren't drawn).
+bool LoadScene(Scene& scene, const std::wstring& path, const AssetRegistry* assets, std::string* outError);
+
+} // namespace king
@@ -1,7 +1,7 @@
 #pragma once
 
 #include "../math/types.h"
-#include "../render/material.h"
+#include "../render/material_registry.h"
 #include "../scene/camera.h"
 #include "entity.h"
 
@@ -13,6 +13,9 @@
 namespace king
 {
 
+class AssetPack;
+struct PackEntry;
+
 struct Transform
 {
     Float3 position{ 0, 0, 0 };
@@ -22,21 +25,94 @@ struct Transform
     Entity parent = kInvalidEntity;
 };
 
-// For the sample, a mesh is just a list of vertices uploaded to D3D11.
+// World-space result of a Transform and its parent chain. Maintained by
+// systems::TransformSystem; treat as read-only elsewhere.
+struct WorldTransform
+{
+    // Normals are rebuilt from this in the vertex shader (cofactors of the instance matrix).
+    Mat4x4 world{};
+    // Largest axis scale of world, for bounding spheres.
+    float maxScale = 1.0f;
+
+    // Local transform the matrices were built from; a mismatch marks the entity dirty.
+    Transform local{};
+    // Bumped every time the matrices are recomputed (cheap change detection downstream).
+    uint32_t revision = 0;
+};
+
+// Source vertex of a mesh (what content code builds).
 struct VertexPN
 {
     float x, y, z;
     float nx, ny, nz;
 };
 
+// Cooked GPU vertex, 12 bytes (see render/mesh_cook.h): position as UNORM16 inside the mesh's
+// quantization box and an octahedral SNORM16 normal.
+struct PackedVertex
+{
+    uint16_t pos[4]; // x, y, z, unused
+    int16_t nrm[2];
+};
+
+static constexpr uint32_t kMaxMeshLods = 4;
+
+// A coarser level of detail as authored: triangles over Mesh::vertices (generators append the
+// vertices they need). Used while the bounding sphere projects to fewer than maxPixels pixels
+// (diameter, vertically).
+struct MeshLodSource
+{
+    std::vector<uint32_t> indices;
+    float maxPixels = 0.0f;
+};
+
+// Cooked level of detail: a range of the mesh's index buffer. Level 0 is the full mesh; each
+// further level has a smaller maxPixels than the one before.
+struct MeshLod
+{
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0; // 0 for non-indexed meshes
+    float maxPixels = 0.0f;  // unused for level 0
+};
+
 struct Mesh
 {
+    // Source data. Indices are 32-bit here; the GPU copy is 16-bit whenever they fit.
     std::vector<VertexPN> vertices;
-    std::vector<uint16_t> indices;
+    std::vector<uint32_t> indices;
+    // Levels 1.. (fine to coarse); at most kMaxMeshLods - 1 are used.
+    std::vector<MeshLodSource> lodSources;
     ID3D11Buffer* vb = nullptr; // owned by renderer; released when destroying scene/mesh
     ID3D11Buffer* ib = nullptr; // owned by renderer; released when destroying scene/mesh
 
-    // Simple bounds for culling (optional)
+    // Cooked form produced by CookMesh and consumed (then freed) by the upload.
+    std::vector<PackedVertex> packedVertices;
+    std::vector<uint32_t> packedIndices;
+    // Or: the cooked form lives in a mounted asset pack (AssetRegistry::LoadMesh) and is
+    // uploaded straight from the mapping.
+    const AssetPack* pack = nullptr;
+    const PackEntry* packEntry = nullptr;
+
+    // false: vertices/indices/lodSources are released once the GPU buffers exist. The mesh can then no
+    // longer be re-cooked or re-uploaded (e.g. after ReleaseSceneMeshBuffers).
+    bool keepCpuData = true;
+
+    // Set by CookMesh; draw code uses these rather than the (possibly released) arrays.
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0; // whole index buffer (every level)
+    bool index32 = false;
+    MeshLod lods[kMaxMeshLods]{};
+    uint32_t lodCount = 1;
+    // Bumped by every cook, set once a pack mesh is uploaded (cheap change detection for cached
+    // instance data; 0 = not drawable yet).
+    uint32_t revision = 0;
+
+    // Dequantization: meshPos = quantOffset + packedPos * quantScale. Folded into the instance
+    // world matrix, so shaders see the packed position directly.
+    Float3 quantOffset{ 0, 0, 0 };
+    Float3 quantScale{ 1, 1, 1 };
+
+    // Bounding sphere for culling; recomputed (tight) by CookMesh.
     Float3 boundsCenter{ 0, 0, 0 };
     float boundsRadius = 1.0f;
 };
@@ -44,7 +120,8 @@ struct Mesh
 struct MeshRenderer
 {
     Entity mesh = kInvalidEntity;
-    PbrMaterial material;
+    // Interned in Scene::materials; defaults to the built-in default material.
+    MaterialHandle material = kDefaultMaterial;
 
     // Light grouping: renderable receives only lights whose mask overlaps this.
     uint32_t lightMask = 0xFFFFFFFFu;
@@ -52,6 +129,11 @@ struct MeshRenderer
     // Shadow participation.
     bool castsShadows = true;
     bool receivesShadows = true;
+
+    // Rarely-changing geometry: kept in a persistent, pre-sorted GPU instance region that is
+    // only rebuilt when a static renderer is added, removed or changed (transform, mesh,
+    // material, flags); per frame it only costs a visibility test.
+    bool isStatic = false;
 };
 
 struct CameraComponent
@@ -5,7 +5,22 @@
 namespace king
 {
 
+// Entity = 24-bit slot index + 8-bit generation.
+// The generation is bumped each time a slot is recycled, so stale handles held after
+// DestroyEntity() fail Has()/TryGet() instead of aliasing the new occupant.
+// Slot index 0 is never allocated, so kInvalidEntity (0) never matches a live entity.
 using Entity = uint32_t;
 static constexpr Entity kInvalidEntity = 0;
 
+static constexpr uint32_t kEntityIndexBits = 24;
+static constexpr uint32_t kEntityIndexMask = (1u << kEntityIndexBits) - 1u;
+static constexpr uint32_t kEntityGenerationMask = 0xFFu;
+
+constexpr uint32_t EntityIndex(Entity e) { return e & kEntityIndexMask; }
+constexpr uint32_t EntityGeneration(Entity e) { return (e >> kEntityIndexBits) & kEntityGenerationMask; }
+constexpr Entity MakeEntity(uint32_t index, uint32_t generation)
+{
+    return (Entity)((index & kEntityIndexMask) | ((generation & kEntityGenerationMask) << kEntityIndexBits));
+}
+
 } // namespace king
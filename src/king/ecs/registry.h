@@ -2,49 +2,160 @@
 
 #include "components.h"
 #include "sparse_set.h"
+#include "view.h"
 
 #include "../thread_config.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <type_traits>
 #include <vector>
 
 namespace king
 {
 
+// One bit per Registry pool (used by SystemAccess to describe read/write sets).
+using ComponentMask = uint32_t;
+
+template <typename T>
+constexpr ComponentMask ComponentBit()
+{
+    using U = std::remove_const_t<T>;
+    if constexpr (std::is_same_v<U, Transform>) return 1u << 0;
+    else if constexpr (std::is_same_v<U, Mesh>) return 1u << 1;
+    else if constexpr (std::is_same_v<U, MeshRenderer>) return 1u << 2;
+    else if constexpr (std::is_same_v<U, CameraComponent>) return 1u << 3;
+    else if constexpr (std::is_same_v<U, WorldTransform>) return 1u << 5;
+    else
+    {
+        static_assert(std::is_same_v<U, Light>, "Registry has no pool for this component type");
+        return 1u << 4;
+    }
+}
+
+template <typename... Ts>
+constexpr ComponentMask ComponentMaskOf()
+{
+    return (ComponentMask)(0u | ... | ComponentBit<Ts>());
+}
+
 class Registry
 {
 public:
     Registry()
         : mWorkerThreadsCached(king::GetThreadConfig().ecsWorkerThreads)
     {
+        // Slot 0 is reserved so kInvalidEntity never names a live entity.
+        mGenerations.push_back(0);
+        mAlivePos.push_back(kNotAlive);
     }
 
     Entity CreateEntity()
     {
-        Entity e = ++mNext;
+        uint32_t index = 0;
+        if (!mFreeIndices.empty())
+        {
+            index = mFreeIndices.back();
+            mFreeIndices.pop_back();
+            mGenerations[index] &= ~kSlotFreeBit;
+        }
+        else
+        {
+            index = (uint32_t)mGenerations.size();
+            if (index > kEntityIndexMask)
+                return kInvalidEntity;
+            mGenerations.push_back(0);
+            mAlivePos.push_back(kNotAlive);
+        }
+
+        Entity e = MakeEntity(index, mGenerations[index]);
+        mAlivePos[index] = (uint32_t)mAlive.size();
         mAlive.push_back(e);
         return e;
     }
 
+    // Creates `count` entities and appends them to `out`. Bookkeeping and every component
+    // pool are reserved up front, so spawning a batch costs one allocation per container.
+    // Stops early (fewer than `count` appended) if the entity index space runs out.
+    void CreateEntities(size_t count, std::vector<Entity>& out)
+    {
+        const size_t recycled = std::min(count, mFreeIndices.size());
+        const size_t fresh = count - recycled;
+        mGenerations.reserve(mGenerations.size() + fresh);
+        mAlivePos.reserve(mAlivePos.size() + fresh);
+        mAlive.reserve(mAlive.size() + count);
+        out.reserve(out.size() + count);
+
+        const size_t maxIndex = std::min(mGenerations.size() + fresh, (size_t)kEntityIndexMask + 1u);
+        ReservePools(count, (uint32_t)(maxIndex - 1u));
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Entity e = CreateEntity();
+            if (e == kInvalidEntity)
+                break;
+            out.push_back(e);
+        }
+    }
+
+    // True if e was returned by CreateEntity and its slot hasn't been recycled since.
+    bool IsAlive(Entity e) const
+    {
+        const uint32_t index = EntityIndex(e);
+        // Free slots carry kSlotFreeBit, so they never compare equal to a generation.
+        return index != 0 && index < mGenerations.size() && mGenerations[index] == EntityGeneration(e);
+    }
+
     void DestroyEntity(Entity e)
     {
+        if (!IsAlive(e))
+            return;
+
         // Remove components
         transforms.Remove(e);
         meshes.Remove(e);
         renderers.Remove(e);
         cameras.Remove(e);
         lights.Remove(e);
+        worldTransforms.Remove(e);
 
-        // Remove from alive list (linear; fine for now)
-        for (size_t i = 0; i < mAlive.size(); ++i)
-        {
-            if (mAlive[i] == e)
-            {
-                mAlive[i] = mAlive.back();
-                mAlive.pop_back();
-                break;
-            }
-        }
+        // Swap-remove from the alive list.
+        const uint32_t index = EntityIndex(e);
+        const uint32_t pos = mAlivePos[index];
+        const Entity last = mAlive.back();
+        mAlive[pos] = last;
+        mAlivePos[EntityIndex(last)] = pos;
+        mAlive.pop_back();
+        mAlivePos[index] = kNotAlive;
+
+        // Bump the generation so outstanding copies of e go stale, then recycle the slot.
+        mGenerations[index] = ((mGenerations[index] + 1u) & kEntityGenerationMask) | kSlotFreeBit;
+        mFreeIndices.push_back(index);
+    }
+
+    // Dead/stale handles in the batch are ignored.
+    void DestroyEntities(const Entity* entities, size_t count)
+    {
+        mFreeIndices.reserve(mFreeIndices.size() + count);
+        for (size_t i = 0; i < count; ++i)
+            DestroyEntity(entities[i]);
+    }
+
+    void DestroyEntities(const std::vector<Entity>& entities)
+    {
+        DestroyEntities(entities.data(), entities.size());
+    }
+
+    // Reserves room for `additional` more components in every pool plus sparse pages
+    // covering entity slots up to `maxIndex`.
+    void ReservePools(size_t additional, uint32_t maxIndex)
+    {
+        transforms.Reserve(transforms.Size() + additional, maxIndex);
+        meshes.Reserve(meshes.Size() + additional, maxIndex);
+        renderers.Reserve(renderers.Size() + additional, maxIndex);
+        cameras.Reserve(cameras.Size() + additional, maxIndex);
+        lights.Reserve(lights.Size() + additional, maxIndex);
+        worldTransforms.Reserve(worldTransforms.Size() + additional, maxIndex);
     }
 
     const std::vector<Entity>& Alive() const { return mAlive; }
@@ -53,15 +164,65 @@ public:
 
     void SetWorkerThreads(uint32_t threads) { mWorkerThreadsCached = threads; }
 
+    template <typename T>
+    SparseSet<T>& Pool()
+    {
+        if constexpr (std::is_same_v<T, Transform>) return transforms;
+        else if constexpr (std::is_same_v<T, Mesh>) return meshes;
+        else if constexpr (std::is_same_v<T, MeshRenderer>) return renderers;
+        else if constexpr (std::is_same_v<T, CameraComponent>) return cameras;
+        else if constexpr (std::is_same_v<T, WorldTransform>) return worldTransforms;
+        else
+        {
+            static_assert(std::is_same_v<T, Light>, "Registry has no pool for this component type");
+            return lights;
+        }
+    }
+
+    template <typename T>
+    const SparseSet<T>& Pool() const
+    {
+        return const_cast<Registry*>(this)->Pool<T>();
+    }
+
+    // Entities that have every component in Ts (see ComponentView).
+    template <typename... Ts>
+    ComponentView<Ts...> View()
+    {
+        return ComponentView<Ts...>(Pool<Ts>()...);
+    }
+
+    template <typename... Ts>
+    ComponentView<const Ts...> View() const
+    {
+        return ComponentView<const Ts...>(Pool<Ts>()...);
+    }
+
+    // Packs the pools of Others into Lead's dense order so View<Lead, Others...> walks
+    // them linearly. Cheap when nothing was added/removed since the last call.
+    template <typename Lead, typename... Others>
+    void Group()
+    {
+        const SparseSet<Lead>& lead = Pool<Lead>();
+        (Pool<Others>().AlignTo(lead), ...);
+    }
+
     SparseSet<Transform> transforms;
     SparseSet<Mesh> meshes;
     SparseSet<MeshRenderer> renderers;
     SparseSet<CameraComponent> cameras;
     SparseSet<Light> lights;
+    SparseSet<WorldTransform> worldTransforms;
 
 private:
-    Entity mNext = 0;
+    static constexpr uint32_t kSlotFreeBit = 1u << 8;
+    static constexpr uint32_t kNotAlive = 0xFFFFFFFFu;
+
     std::vector<Entity> mAlive;
+    // Per entity slot: position in mAlive (kNotAlive when free).
+    std::vector<uint32_t> mAlivePos;
+    std::vector<uint32_t> mGenerations;
+    std::vector<uint32_t> mFreeIndices;
     uint32_t mWorkerThreadsCached = 0;
 };
 
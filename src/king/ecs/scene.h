@@ -1,6 +1,7 @@
 #pragma once
 
 #include "registry.h"
+#include "../render/material_registry.h"
 
 namespace king
 {
@@ -8,6 +9,7 @@ namespace king
 struct Scene
 {
     Registry reg;
+    MaterialRegistry materials;
 };
 
 } // namespace king
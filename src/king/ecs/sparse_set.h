@@ -2,85 +2,237 @@
 
 #include "entity.h"
 
-#include <unordered_map>
+#include <cstdint>
+#include <memory>
 #include <utility>
 #include <vector>
 
 namespace king
 {
 
-// Simple sparse-set style container: stable dense storage + entity->index map.
-// Not the fastest possible ECS, but a solid, clear foundation.
+// Sparse-set container: packed dense storage + paged entity-index -> dense-index table.
+// Lookups are two array reads (page, slot) plus a full-entity compare against the dense
+// entry, which doubles as the generation check for recycled entity slots.
+// Pages are allocated lazily, so sparse entity ranges don't cost memory up front.
 template <typename T>
 class SparseSet
 {
 public:
+    static constexpr uint32_t kPageBits = 12;
+    static constexpr uint32_t kPageSize = 1u << kPageBits;
+    static constexpr uint32_t kNoDense = 0xFFFFFFFFu;
+
     bool Has(Entity e) const
     {
-        return mIndex.find(e) != mIndex.end();
+        return FindDense(e) != kNoDense;
     }
 
     T* TryGet(Entity e)
     {
-        auto it = mIndex.find(e);
-        if (it == mIndex.end()) return nullptr;
-        return &mData[it->second];
+        const uint32_t d = FindDense(e);
+        return (d == kNoDense) ? nullptr : &mData[d];
     }
 
     const T* TryGet(Entity e) const
     {
-        auto it = mIndex.find(e);
-        if (it == mIndex.end()) return nullptr;
-        return &mData[it->second];
+        const uint32_t d = FindDense(e);
+        return (d == kNoDense) ? nullptr : &mData[d];
+    }
+
+    // Lookups with a dense-slot hint: if dense slot `hint` already holds `e` (pools aligned
+    // via AlignTo) this is a single compare, otherwise it falls back to the paged lookup.
+    bool HasAt(size_t hint, Entity e) const
+    {
+        return (hint < mEntities.size() && mEntities[hint] == e) || FindDense(e) != kNoDense;
+    }
+
+    T* TryGetAt(size_t hint, Entity e)
+    {
+        if (hint < mEntities.size() && mEntities[hint] == e)
+            return &mData[hint];
+        return TryGet(e);
     }
 
+    const T* TryGetAt(size_t hint, Entity e) const
+    {
+        if (hint < mEntities.size() && mEntities[hint] == e)
+            return &mData[hint];
+        return TryGet(e);
+    }
+
+    // Adds e's component, replacing the one e already has. Returns nullptr and leaves the set
+    // as is when e's slot holds another generation: one of the two handles is stale and the
+    // set can't tell which. Registry::DestroyEntity strips components before recycling, so in
+    // its pools that is e; a dead e whose slot is empty is the caller's to catch (IsAlive).
     template <typename... Args>
-    T& Emplace(Entity e, Args&&... args)
+    T* Emplace(Entity e, Args&&... args)
     {
-        Remove(e);
-        const size_t idx = mData.size();
+        const uint32_t index = EntityIndex(e);
+        const uint32_t d = SparseAt(index);
+        if (d != kNoDense && d < mEntities.size() && EntityIndex(mEntities[d]) == index)
+        {
+            if (mEntities[d] != e)
+                return nullptr;
+            RemoveSlot(index);
+        }
+
+        const uint32_t idx = (uint32_t)mData.size();
         mEntities.push_back(e);
         mData.emplace_back(std::forward<Args>(args)...);
-        mIndex[e] = idx;
-        return mData.back();
+        SparseRef(index) = idx;
+        ++mVersion;
+        return &mData.back();
+    }
+
+    // Bulk insert for entities that aren't in the set yet (e.g. a scene being loaded): the
+    // dense arrays grow once and the returned pointer is the `count` new default-constructed
+    // components, in `entities` order, for the caller to fill. Not checked: every entity must
+    // be absent from the set and listed once (LoadScene validates file lists before this).
+    T* Append(const Entity* entities, size_t count)
+    {
+        const size_t first = mData.size();
+        mEntities.insert(mEntities.end(), entities, entities + count);
+        mData.resize(first + count);
+        for (size_t i = 0; i < count; ++i)
+            SparseRef(EntityIndex(entities[i])) = (uint32_t)(first + i);
+        ++mVersion;
+        return mData.data() + first;
     }
 
     void Remove(Entity e)
     {
-        auto it = mIndex.find(e);
-        if (it == mIndex.end()) return;
+        if (FindDense(e) == kNoDense)
+            return;
+        RemoveSlot(EntityIndex(e));
+    }
+
+    void Clear()
+    {
+        mData.clear();
+        mEntities.clear();
+        mPages.clear();
+        ++mVersion;
+    }
 
-        size_t idx = it->second;
-        size_t last = mData.size() - 1;
+    // Reorders this set so every entity that is also in `lead` sits at the same dense index
+    // as in `lead` (those come first, in lead order; the rest follow). Joins led by `lead`
+    // then hit the same-slot fast path in TryGetAt. Skipped when neither set changed
+    // structurally since the last call against the same lead.
+    template <typename U>
+    void AlignTo(const SparseSet<U>& lead)
+    {
+        if (mAlignLead == &lead && mAlignLeadVersion == lead.Version() && mAlignVersion == mVersion)
+            return;
 
-        if (idx != last)
+        const std::vector<Entity>& order = lead.Entities();
+        uint32_t next = 0;
+        for (Entity e : order)
         {
-            mData[idx] = std::move(mData[last]);
-            mEntities[idx] = mEntities[last];
-            mIndex[mEntities[idx]] = idx;
+            const uint32_t d = FindDense(e);
+            if (d == kNoDense)
+                continue;
+            if (d != next)
+                SwapDense(d, next);
+            ++next;
         }
 
-        mData.pop_back();
-        mEntities.pop_back();
-        mIndex.erase(it);
+        ++mVersion;
+        mAlignLead = &lead;
+        mAlignLeadVersion = lead.Version();
+        mAlignVersion = mVersion;
     }
 
-    void Clear()
+    // Reserves dense storage for `capacity` components and allocates the sparse pages
+    // covering entity slots [0, maxIndex], so a following batch of Emplace calls doesn't
+    // reallocate.
+    void Reserve(size_t capacity, uint32_t maxIndex)
     {
-        mData.clear();
-        mEntities.clear();
-        mIndex.clear();
+        mEntities.reserve(capacity);
+        mData.reserve(capacity);
+        const uint32_t lastPage = (maxIndex & kEntityIndexMask) >> kPageBits;
+        if (mPages.size() <= lastPage)
+            mPages.resize((size_t)lastPage + 1);
+        for (uint32_t page = 0; page <= lastPage; ++page)
+            (void)SparseRef(page << kPageBits);
     }
 
+    // Bumped on every structural change (insert/remove/reorder), not on component writes.
+    uint64_t Version() const { return mVersion; }
+
     size_t Size() const { return mData.size(); }
     const std::vector<Entity>& Entities() const { return mEntities; }
     std::vector<T>& Data() { return mData; }
     const std::vector<T>& Data() const { return mData; }
 
+private:
+    uint32_t SparseAt(uint32_t index) const
+    {
+        const uint32_t page = index >> kPageBits;
+        if (page >= mPages.size() || !mPages[page])
+            return kNoDense;
+        return mPages[page][index & (kPageSize - 1u)];
+    }
+
+    uint32_t& SparseRef(uint32_t index)
+    {
+        const uint32_t page = index >> kPageBits;
+        if (page >= mPages.size())
+            mPages.resize((size_t)page + 1);
+        if (!mPages[page])
+        {
+            mPages[page].reset(new uint32_t[kPageSize]);
+            for (uint32_t i = 0; i < kPageSize; ++i)
+                mPages[page][i] = kNoDense;
+        }
+        return mPages[page][index & (kPageSize - 1u)];
+    }
+
+    uint32_t FindDense(Entity e) const
+    {
+        const uint32_t d = SparseAt(EntityIndex(e));
+        if (d == kNoDense || d >= mEntities.size() || mEntities[d] != e)
+            return kNoDense;
+        return d;
+    }
+
+    void RemoveSlot(uint32_t index)
+    {
+        const uint32_t d = SparseAt(index);
+        if (d == kNoDense || d >= mEntities.size() || EntityIndex(mEntities[d]) != index)
+            return;
+
+        const uint32_t last = (uint32_t)mData.size() - 1u;
+        if (d != last)
+        {
+            mData[d] = std::move(mData[last]);
+            mEntities[d] = mEntities[last];
+            SparseRef(EntityIndex(mEntities[d])) = d;
+        }
+
+        mData.pop_back();
+        mEntities.pop_back();
+        SparseRef(index) = kNoDense;
+        ++mVersion;
+    }
+
+    void SwapDense(uint32_t a, uint32_t b)
+    {
+        using std::swap;
+        swap(mData[a], mData[b]);
+        swap(mEntities[a], mEntities[b]);
+        SparseRef(EntityIndex(mEntities[a])) = a;
+        SparseRef(EntityIndex(mEntities[b])) = b;
+    }
+
 private:
     std::vector<Entity> mEntities;
     std::vector<T> mData;
-    std::unordered_map<Entity, size_t> mIndex;
+    std::vector<std::unique_ptr<uint32_t[]>> mPages;
+
+    uint64_t mVersion = 0;
+    const void* mAlignLead = nullptr;
+    uint64_t mAlignLeadVersion = 0;
+    uint64_t mAlignVersion = 0;
 };
 
 } // namespace king
@@ -0,0 +1,84 @@
+#include "system_scheduler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+
+namespace king
+{
+
+SystemScheduler::SystemScheduler(uint32_t workerThreads)
+    : mJobs(GetJobSystem())
+    , mWorkerThreads(workerThreads)
+{
+}
+
+void SystemScheduler::Add(const char* name, const SystemAccess& access, SystemFn fn)
+{
+    System s;
+    s.name = name ? name : "";
+    s.access = access;
+    s.fn = std::move(fn);
+    mSystems.push_back(std::move(s));
+    mWavesDirty = true;
+}
+
+size_t SystemScheduler::WaveCount()
+{
+    if (mWavesDirty)
+        BuildWaves();
+    return mWaves.size();
+}
+
+void SystemScheduler::BuildWaves()
+{
+    mWaves.clear();
+
+    std::vector<uint32_t> waveOf(mSystems.size(), 0);
+    for (uint32_t i = 0; i < (uint32_t)mSystems.size(); ++i)
+    {
+        uint32_t wave = 0;
+        for (uint32_t j = 0; j < i; ++j)
+        {
+            if (mSystems[i].access.ConflictsWith(mSystems[j].access) && waveOf[j] + 1u > wave)
+                wave = waveOf[j] + 1u;
+        }
+
+        waveOf[i] = wave;
+        if (mWaves.size() <= wave)
+            mWaves.resize((size_t)wave + 1);
+        mWaves[wave].push_back(i);
+    }
+
+    mWavesDirty = false;
+
+    std::printf("[ECS] Scheduler: %zu systems in %zu waves, %u worker threads\n",
+        mSystems.size(), mWaves.size(), std::min(mWorkerThreads, mJobs.WorkerCount()));
+}
+
+void SystemScheduler::Run(Scene& scene)
+{
+    if (mWavesDirty)
+        BuildWaves();
+
+    for (const auto& wave : mWaves)
+    {
+        if (wave.size() == 1 || mWorkerThreads == 0 || mJobs.WorkerCount() == 0)
+        {
+            for (uint32_t idx : wave)
+                mSystems[idx].fn(scene);
+            continue;
+        }
+
+        JobCounter counter;
+        for (size_t k = 1; k < wave.size(); ++k)
+        {
+            System* s = &mSystems[wave[k]];
+            mJobs.Submit(counter, [s, &scene]() { s->fn(scene); });
+        }
+        mSystems[wave[0]].fn(scene);
+        mJobs.Wait(counter);
+    }
+}
+
+} // namespace king
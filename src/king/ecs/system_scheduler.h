@@ -0,0 +1,110 @@
+#pragma once
+
+#include "scene.h"
+#include "../jobs/job_system.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace king
+{
+
+// Component read/write sets used to decide which systems may run concurrently.
+struct SystemAccess
+{
+    ComponentMask reads = 0;
+    ComponentMask writes = 0;
+
+    // Structural changes (create/destroy entities, add/remove components) or anything
+    // else that can't be described by component sets: runs alone.
+    bool exclusive = false;
+
+    template <typename... Ts>
+    SystemAccess& Read()
+    {
+        reads |= ComponentMaskOf<Ts...>();
+        return *this;
+    }
+
+    template <typename... Ts>
+    SystemAccess& Write()
+    {
+        writes |= ComponentMaskOf<Ts...>();
+        return *this;
+    }
+
+    SystemAccess& Exclusive()
+    {
+        exclusive = true;
+        return *this;
+    }
+
+    bool ConflictsWith(const SystemAccess& o) const
+    {
+        if (exclusive || o.exclusive)
+            return true;
+        return (writes & (o.reads | o.writes)) != 0 || (o.writes & reads) != 0;
+    }
+};
+
+// Runs registered systems once per Run() call.
+// Systems are grouped into waves: a system goes into the first wave after every earlier
+// (registration order) system it conflicts with, so results match sequential execution
+// in registration order. Systems within a wave run concurrently on the engine JobSystem;
+// systems can also use ParallelFor over dense component arrays.
+class SystemScheduler
+{
+public:
+    using SystemFn = std::function<void(Scene&)>;
+
+    // workerThreads = ThreadConfig::ecsWorkerThreads: how many job workers ECS work may
+    // occupy (0 = run everything inline, in order).
+    explicit SystemScheduler(uint32_t workerThreads = 0);
+
+    void Add(const char* name, const SystemAccess& access, SystemFn fn);
+
+    void Run(Scene& scene);
+
+    // JobSystem::ParallelFor capped to the ECS thread budget.
+    template <typename Fn>
+    void ParallelFor(size_t count, size_t minChunk, Fn&& fn)
+    {
+        if (mWorkerThreads == 0)
+        {
+            if (count > 0)
+                fn((size_t)0, count);
+            return;
+        }
+        mJobs.ParallelFor(count, minChunk, fn, mWorkerThreads + 1u);
+    }
+
+    // Budget passed to the constructor (callers forward it to engine code that takes a
+    // parallelism cap, e.g. RenderSystemD3D11::PrepareSnapshot).
+    uint32_t WorkerThreads() const { return mWorkerThreads; }
+    // Live ThreadConfig changes (between Run calls).
+    void SetWorkerThreads(uint32_t workerThreads) { mWorkerThreads = workerThreads; }
+
+    // Number of waves in the current schedule (1 = all systems independent).
+    size_t WaveCount();
+
+private:
+    struct System
+    {
+        std::string name;
+        SystemAccess access;
+        SystemFn fn;
+    };
+
+    void BuildWaves();
+
+    JobSystem& mJobs;
+    uint32_t mWorkerThreads = 0;
+    std::vector<System> mSystems;
+    std::vector<std::vector<uint32_t>> mWaves;
+    bool mWavesDirty = true;
+};
+
+} // namespace king
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "sparse_set.h"
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace king
+{
+
+template <typename T>
+using PoolFor = std::conditional_t<std::is_const_v<T>, const SparseSet<std::remove_const_t<T>>, SparseSet<T>>;
+
+// Join over several component pools: yields every entity that has all of Ts.
+// Walks the smallest pool and probes the rest. Probes first try the same dense slot
+// (hit when the pools were aligned with SparseSet::AlignTo), then fall back to the
+// paged lookup, so aligned joins are linear scans.
+//
+//   for (auto [e, t, r] : reg.View<Transform, MeshRenderer>()) { ... }
+//   reg.View<Transform, MeshRenderer>().Each([](Entity e, Transform& t, MeshRenderer& r) { ... });
+//
+// Adding/removing components of the viewed types while iterating is not supported.
+template <typename... Ts>
+class ComponentView
+{
+    static_assert(sizeof...(Ts) > 0, "ComponentView needs at least one component type");
+
+public:
+    using Item = std::tuple<Entity, Ts&...>;
+
+    explicit ComponentView(PoolFor<Ts>&... pools)
+        : mPools(&pools...)
+    {
+        size_t best = (size_t)-1;
+        std::apply([&](auto*... p)
+        {
+            ((p->Size() < best ? (best = p->Size(), mLead = &p->Entities(), 0) : 0), ...);
+        }, mPools);
+    }
+
+    class Iterator
+    {
+    public:
+        Iterator(const ComponentView* view, size_t i)
+            : mView(view), mIndex(i)
+        {
+            SkipMissing();
+        }
+
+        Item operator*() const { return mView->Fetch(mIndex); }
+
+        Iterator& operator++()
+        {
+            ++mIndex;
+            SkipMissing();
+            return *this;
+        }
+
+        bool operator==(const Iterator& o) const { return mIndex == o.mIndex; }
+        bool operator!=(const Iterator& o) const { return mIndex != o.mIndex; }
+
+    private:
+        void SkipMissing()
+        {
+            const size_t n = mView->mLead->size();
+            while (mIndex < n && !mView->Contains(mIndex))
+                ++mIndex;
+        }
+
+        const ComponentView* mView = nullptr;
+        size_t mIndex = 0;
+    };
+
+    Iterator begin() const { return Iterator(this, 0); }
+    Iterator end() const { return Iterator(this, mLead->size()); }
+
+    // fn(Entity, Ts&...)
+    template <typename Fn>
+    void Each(Fn&& fn) const
+    {
+        const size_t n = mLead->size();
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (!Contains(i))
+                continue;
+            std::apply(fn, Fetch(i));
+        }
+    }
+
+    // Like Each, restricted to lead dense slots [begin, end) and passing the slot:
+    // fn(size_t slot, Entity, Ts&...). Disjoint ranges can run on different threads.
+    template <typename Fn>
+    void EachInRange(size_t begin, size_t end, Fn&& fn) const
+    {
+        if (end > mLead->size())
+            end = mLead->size();
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (!Contains(i))
+                continue;
+            std::apply([&](auto&&... args) { fn(i, args...); }, Fetch(i));
+        }
+    }
+
+    // Upper bound on the number of matches (size of the lead pool).
+    size_t SizeHint() const { return mLead->size(); }
+
+private:
+    bool Contains(size_t i) const
+    {
+        const Entity e = (*mLead)[i];
+        return std::apply([&](auto*... p) { return (p->HasAt(i, e) && ...); }, mPools);
+    }
+
+    Item Fetch(size_t i) const
+    {
+        const Entity e = (*mLead)[i];
+        return std::apply([&](auto*... p) { return Item(e, *p->TryGetAt(i, e)...); }, mPools);
+    }
+
+    std::tuple<PoolFor<Ts>*...> mPools;
+    const std::vector<Entity>* mLead = nullptr;
+};
+
+} // namespace king
@@ -0,0 +1,277 @@
+#include "job_system.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+
+namespace king
+{
+namespace
+{
+thread_local const JobSystem* tOwner = nullptr;
+thread_local uint32_t tWorkerIndex = kAnyWorker;
+} // namespace
+
+JobSystem::~JobSystem()
+{
+    Stop();
+}
+
+void JobSystem::Start(uint32_t workers, const ThreadPlacement& placement, const ThreadPlacement& lastWorkerPlacement)
+{
+    Stop();
+
+    mStopping = false;
+    mPlacement = placement;
+    mLastPlacement = lastWorkerPlacement;
+    mWorkers.clear();
+    mWorkers.reserve(workers);
+    for (uint32_t i = 0; i < workers; ++i)
+        mWorkers.push_back(std::make_unique<Worker>());
+
+    for (uint32_t i = 0; i < workers; ++i)
+        mWorkers[i]->thread = std::thread([this, i]() { WorkerMain(i); });
+
+    std::printf("[Jobs] Started %u worker threads\n", workers);
+    if (workers > 0 && (!placement.IsDefault() || !lastWorkerPlacement.IsDefault()))
+    {
+        std::printf("[Jobs] Placement: workers mask 0x%llx prio %d, last worker mask 0x%llx prio %d\n",
+            (unsigned long long)placement.affinityMask, placement.priority,
+            (unsigned long long)lastWorkerPlacement.affinityMask, lastWorkerPlacement.priority);
+    }
+}
+
+void JobSystem::Stop()
+{
+    if (mWorkers.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mStopping = true;
+    }
+    mSleepCv.notify_all();
+
+    for (auto& w : mWorkers)
+    {
+        if (w->thread.joinable())
+            w->thread.join();
+    }
+
+    // Workers drain their queues before exiting; anything left was submitted concurrently
+    // with Stop(). Run it here so no counter is left pending.
+    for (uint32_t i = 0; i < (uint32_t)mWorkers.size(); ++i)
+    {
+        Job job;
+        while (PopPinned(i, job) || PopLocal(i, job))
+            Execute(job);
+    }
+
+    mWorkers.clear();
+}
+
+uint32_t JobSystem::CurrentWorker()
+{
+    return tWorkerIndex;
+}
+
+void JobSystem::Submit(JobCounter& counter, std::function<void()> fn, uint32_t affinity)
+{
+    counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+    if (mWorkers.empty())
+    {
+        fn();
+        counter.pending.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+
+    const uint32_t count = (uint32_t)mWorkers.size();
+    Job job{ std::move(fn), &counter };
+
+    if (affinity != kAnyWorker)
+    {
+        Worker& w = *mWorkers[affinity % count];
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+            w.pinned.push_back(std::move(job));
+        }
+        w.pinnedCount.fetch_add(1, std::memory_order_release);
+        // Only the target can run it, so make sure it's the one that wakes up.
+        Wake(true);
+        return;
+    }
+
+    uint32_t target = (tOwner == this) ? tWorkerIndex : kAnyWorker;
+    if (target == kAnyWorker)
+        target = mNextWorker.fetch_add(1, std::memory_order_relaxed) % count;
+
+    Worker& w = *mWorkers[target];
+    {
+        std::lock_guard<std::mutex> lock(w.mutex);
+        w.deque.push_back(std::move(job));
+    }
+    mStealable.fetch_add(1, std::memory_order_release);
+    Wake(false);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    const uint32_t self = (tOwner == this) ? tWorkerIndex : kAnyWorker;
+
+    while (!counter.Done())
+    {
+        Job job;
+        const bool got = (self != kAnyWorker && PopLocal(self, job)) || Steal(self, job);
+        if (got)
+            Execute(job);
+        else
+            std::this_thread::yield();
+    }
+}
+
+bool JobSystem::PopLocal(uint32_t index, Job& out)
+{
+    Worker& w = *mWorkers[index];
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (w.deque.empty())
+        return false;
+    out = std::move(w.deque.back());
+    w.deque.pop_back();
+    mStealable.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool JobSystem::PopPinned(uint32_t index, Job& out)
+{
+    Worker& w = *mWorkers[index];
+    if (w.pinnedCount.load(std::memory_order_acquire) == 0)
+        return false;
+
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (w.pinned.empty())
+        return false;
+    out = std::move(w.pinned.front());
+    w.pinned.pop_front();
+    w.pinnedCount.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool JobSystem::Steal(uint32_t thief, Job& out)
+{
+    if (mStealable.load(std::memory_order_acquire) == 0)
+        return false;
+
+    const uint32_t count = (uint32_t)mWorkers.size();
+    const uint32_t start = (thief != kAnyWorker) ? (thief + 1u) : mNextWorker.load(std::memory_order_relaxed);
+    for (uint32_t k = 0; k < count; ++k)
+    {
+        const uint32_t victim = (start + k) % count;
+        if (victim == thief)
+            continue;
+
+        Worker& w = *mWorkers[victim];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if (w.deque.empty())
+            continue;
+        out = std::move(w.deque.front());
+        w.deque.pop_front();
+        mStealable.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::Execute(Job& job)
+{
+    job.fn();
+    job.counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::Wake(bool all)
+{
+    // Taking the lock orders this against a worker that just checked for work and is about
+    // to sleep, so the notification can't be lost.
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+    }
+    if (all)
+        mSleepCv.notify_all();
+    else
+        mSleepCv.notify_one();
+}
+
+void JobSystem::WorkerMain(uint32_t index)
+{
+    tOwner = this;
+    tWorkerIndex = index;
+
+    const bool last = (index + 1u == (uint32_t)mWorkers.size());
+    if (!ApplyThreadPlacement(last ? mLastPlacement : mPlacement))
+        std::printf("[Jobs] Worker %u: thread placement rejected\n", index);
+
+    Worker& self = *mWorkers[index];
+
+    for (;;)
+    {
+        Job job;
+        if (PopPinned(index, job) || PopLocal(index, job) || Steal(index, job))
+        {
+            Execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mSleepCv.wait(lock, [&]()
+        {
+            return mStopping
+                || mStealable.load(std::memory_order_acquire) != 0
+                || self.pinnedCount.load(std::memory_order_acquire) != 0;
+        });
+
+        if (mStopping
+            && mStealable.load(std::memory_order_acquire) == 0
+            && self.pinnedCount.load(std::memory_order_acquire) == 0)
+        {
+            return;
+        }
+    }
+}
+
+uint32_t JobWorkerCountFromConfig(const ThreadConfig& cfg)
+{
+    uint32_t n = std::max({ cfg.ecsWorkerThreads, cfg.renderShadowRecordThreads, cfg.renderDeferredContexts, cfg.renderPrepareWorkerThreads });
+
+    const unsigned hc = std::thread::hardware_concurrency();
+    if (hc > 1 && n > hc - 1)
+        n = hc - 1;
+    if (cfg.maxThreads > 0 && n > cfg.maxThreads)
+        n = cfg.maxThreads;
+    return n;
+}
+
+JobSystem& GetJobSystem()
+{
+    static JobSystem sJobs;
+    static std::once_flag sOnce;
+    std::call_once(sOnce, []()
+    {
+        const ThreadConfig& cfg = GetThreadConfig();
+        sJobs.Start(JobWorkerCountFromConfig(cfg), cfg.jobWorkers, cfg.renderPrepare);
+    });
+    return sJobs;
+}
+
+bool RebalanceJobSystem()
+{
+    JobSystem& jobs = GetJobSystem();
+    const ThreadConfig& cfg = GetThreadConfig();
+    const uint32_t workers = JobWorkerCountFromConfig(cfg);
+    if (workers == jobs.WorkerCount() && cfg.jobWorkers == jobs.Placement() && cfg.renderPrepare == jobs.LastWorkerPlacement())
+        return false;
+
+    jobs.Start(workers, cfg.jobWorkers, cfg.renderPrepare);
+    return true;
+}
+
+} // namespace king
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "../thread_config.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace king
+{
+
+// Fence for a group of jobs: Submit increments, job completion decrements.
+struct JobCounter
+{
+    std::atomic<uint32_t> pending{ 0 };
+
+    bool Done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Affinity hint for Submit: run on any worker (stealable), or only on one worker.
+constexpr uint32_t kAnyWorker = 0xFFFFFFFFu;
+
+// Engine-wide persistent worker pool with per-worker work-stealing deques.
+//
+// - A worker pushes/pops its own deque at the back (LIFO, cache-warm); idle workers and
+//   waiting threads steal from the front of other deques.
+// - Jobs submitted from non-worker threads are spread round-robin across the deques.
+// - Pinned jobs (affinity = worker index) go to a separate per-worker queue that is never
+//   stolen and never run by Wait(); use it for long-running jobs (e.g. frame prep) so they
+//   don't stall a thread that is only helping out while it waits.
+// - Wait() executes other stealable jobs until the counter drains, so jobs may submit and
+//   wait on nested work without deadlocking.
+// With 0 workers, Submit runs the job inline.
+class JobSystem
+{
+public:
+    JobSystem() = default;
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // (Re)starts with `workers` threads: running workers finish the queued jobs first. Each
+    // worker applies `placement` when it starts, the last one `lastWorkerPlacement` (it hosts
+    // long-running pinned jobs). Not while another thread may Submit or Wait.
+    void Start(uint32_t workers, const ThreadPlacement& placement = {}, const ThreadPlacement& lastWorkerPlacement = {});
+    void Stop();
+
+    uint32_t WorkerCount() const { return (uint32_t)mWorkers.size(); }
+    const ThreadPlacement& Placement() const { return mPlacement; }
+    const ThreadPlacement& LastWorkerPlacement() const { return mLastPlacement; }
+
+    // Index of the calling worker thread, or kAnyWorker when called from a non-worker thread.
+    static uint32_t CurrentWorker();
+
+    void Submit(JobCounter& counter, std::function<void()> fn, uint32_t affinity = kAnyWorker);
+
+    void Wait(JobCounter& counter);
+
+    // Splits [0, count) into chunks of at least minChunk and calls fn(begin, end) for each.
+    // maxParallelism caps how many threads work on it (0 = all workers + caller;
+    // 1 = run inline). Blocks until all chunks are done.
+    template <typename Fn>
+    void ParallelFor(size_t count, size_t minChunk, Fn&& fn, uint32_t maxParallelism = 0)
+    {
+        if (count == 0)
+            return;
+        if (minChunk == 0)
+            minChunk = 1;
+
+        uint32_t threads = WorkerCount() + 1u;
+        if (maxParallelism > 0 && maxParallelism < threads)
+            threads = maxParallelism;
+
+        // A few chunks per thread so stealing can even out uneven ranges.
+        const size_t maxChunks = (threads > 1) ? (size_t)threads * 4u : 1u;
+        size_t chunks = count / minChunk;
+        if (chunks > maxChunks)
+            chunks = maxChunks;
+        if (chunks <= 1)
+        {
+            fn((size_t)0, count);
+            return;
+        }
+
+        const size_t chunkSize = (count + chunks - 1) / chunks;
+        JobCounter counter;
+        for (size_t begin = chunkSize; begin < count; begin += chunkSize)
+        {
+            const size_t end = (begin + chunkSize < count) ? (begin + chunkSize) : count;
+            Submit(counter, [&fn, begin, end]() { fn(begin, end); });
+        }
+        fn((size_t)0, chunkSize);
+        Wait(counter);
+    }
+
+private:
+    struct Job
+    {
+        std::function<void()> fn;
+        JobCounter* counter = nullptr;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Job> deque;
+        std::deque<Job> pinned;
+        std::atomic<uint32_t> pinnedCount{ 0 };
+        std::thread thread;
+    };
+
+    void WorkerMain(uint32_t index);
+
+    bool PopLocal(uint32_t index, Job& out);
+    bool PopPinned(uint32_t index, Job& out);
+    bool Steal(uint32_t thief, Job& out);
+    void Execute(Job& job);
+    void Wake(bool all);
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::atomic<uint32_t> mStealable{ 0 };
+    std::atomic<uint32_t> mNextWorker{ 0 };
+
+    std::mutex mSleepMutex;
+    std::condition_variable mSleepCv;
+    bool mStopping = false;
+
+    ThreadPlacement mPlacement{};
+    ThreadPlacement mLastPlacement{};
+};
+
+// Worker count derived from the thread config: the largest per-subsystem budget
+// (ECS, shadow recording, deferred contexts, prepare), clamped by maxThreads and the
+// hardware thread count minus the main thread.
+uint32_t JobWorkerCountFromConfig(const ThreadConfig& cfg);
+
+// Engine-wide instance, started on first use with JobWorkerCountFromConfig(GetThreadConfig())
+// and the config's placements.
+JobSystem& GetJobSystem();
+
+// Restarts the engine JobSystem if the live config asks for a different worker count or
+// placement; true if it did. Main thread, between frames, with no jobs in flight (a
+// frame-prep job still running is finished by the restart).
+bool RebalanceJobSystem();
+
+} // namespace king
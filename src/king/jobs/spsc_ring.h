@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace king
+{
+
+// Bounded single-producer / single-consumer lock-free FIFO.
+// Exactly one thread may call TryPush and exactly one (possibly different) thread may call
+// TryPop. Holds up to Capacity elements; storage is inline, so pushing never allocates.
+template <typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity > 0, "SpscRing needs a non-zero capacity");
+
+public:
+    bool TryPush(T value)
+    {
+        const size_t tail = mTail.load(std::memory_order_relaxed);
+        const size_t head = mHead.load(std::memory_order_acquire);
+        if (tail - head >= Capacity)
+            return false;
+
+        mSlots[tail % Capacity] = std::move(value);
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& out)
+    {
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        const size_t tail = mTail.load(std::memory_order_acquire);
+        if (head == tail)
+            return false;
+
+        out = std::move(mSlots[head % Capacity]);
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called concurrently with the other side.
+    bool Empty() const
+    {
+        return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+    }
+
+    // Not thread-safe: only while neither side is active.
+    void Reset()
+    {
+        mHead.store(0, std::memory_order_relaxed);
+        mTail.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    T mSlots[Capacity]{};
+
+    // Producer and consumer indices on separate cache lines to avoid false sharing.
+    alignas(64) std::atomic<size_t> mHead{ 0 };
+    alignas(64) std::atomic<size_t> mTail{ 0 };
+};
+
+} // namespace king
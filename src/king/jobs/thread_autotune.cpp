@@ -0,0 +1,95 @@
+#include "thread_autotune.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+namespace king
+{
+
+ThreadConfig ThreadAutoTuner::Candidate(uint32_t workers) const
+{
+    ThreadConfig c = mBase;
+    c.autoTune = false;
+    c.ecsWorkerThreads = workers;
+    c.renderShadowRecordThreads = workers;
+    c.renderPrepareWorkerThreads = (workers > 0 && mBase.renderPrepareWorkerThreads > 0) ? 1u : 0u;
+    return c;
+}
+
+bool ThreadAutoTuner::Begin(const ThreadConfig& base, uint32_t warmupFrames, uint32_t sampleFrames)
+{
+    mBase = base;
+    mBest = base;
+    mBest.autoTune = false;
+    mCandidates.clear();
+    mResults.clear();
+    mSamples.clear();
+    mRunning = false;
+
+    // Same ceiling as JobWorkerCountFromConfig: hardware threads minus the main thread.
+    const unsigned hc = std::thread::hardware_concurrency();
+    uint32_t maxWorkers = (hc > 1) ? (uint32_t)(hc - 1) : 0u;
+    if (base.maxThreads > 0 && maxWorkers > base.maxThreads)
+        maxWorkers = base.maxThreads;
+
+    const uint32_t counts[] = { 0u, 1u, 2u, 4u, maxWorkers / 2u, maxWorkers };
+    for (uint32_t n : counts)
+    {
+        if (n <= maxWorkers)
+            mCandidates.push_back(n);
+    }
+    std::sort(mCandidates.begin(), mCandidates.end());
+    mCandidates.erase(std::unique(mCandidates.begin(), mCandidates.end()), mCandidates.end());
+    if (mCandidates.size() < 2)
+        return false;
+
+    mWarmupFrames = warmupFrames;
+    mSampleFrames = (sampleFrames > 0) ? sampleFrames : 1u;
+    mSamples.reserve(mSampleFrames);
+    mCurrent = 0;
+    mFrame = 0;
+    mRunning = true;
+    std::printf("[ThreadTune] Timing %zu worker counts, %u frames each\n", mCandidates.size(), mWarmupFrames + mSampleFrames);
+    SetThreadConfig(Candidate(mCandidates[0]));
+    return true;
+}
+
+bool ThreadAutoTuner::Tick(double frameMs)
+{
+    if (!mRunning)
+        return false;
+
+    if (mFrame++ >= mWarmupFrames)
+        mSamples.push_back(frameMs);
+    if (mSamples.size() < mSampleFrames)
+        return false;
+
+    const size_t mid = mSamples.size() / 2;
+    std::nth_element(mSamples.begin(), mSamples.begin() + (std::ptrdiff_t)mid, mSamples.end());
+    mResults.push_back({ mCandidates[mCurrent], mSamples[mid] });
+    std::printf("[ThreadTune] %u workers: %.3f ms median\n", mCandidates[mCurrent], mSamples[mid]);
+    mSamples.clear();
+    mFrame = 0;
+
+    if (++mCurrent < (uint32_t)mCandidates.size())
+    {
+        SetThreadConfig(Candidate(mCandidates[mCurrent]));
+        return true;
+    }
+
+    // Candidates are ascending, so a strict compare keeps the smaller count on a tie.
+    size_t best = 0;
+    for (size_t i = 1; i < mResults.size(); ++i)
+    {
+        if (mResults[i].medianMs < mResults[best].medianMs)
+            best = i;
+    }
+    mBest = Candidate(mResults[best].workers);
+    mRunning = false;
+    std::printf("[ThreadTune] Picked %u workers (%.3f ms)\n", mResults[best].workers, mResults[best].medianMs);
+    SetThreadConfig(mBest);
+    return true;
+}
+
+} // namespace king
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "../thread_config.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace king
+{
+
+// Startup auto-tune (ThreadConfig::autoTune): times real frames under a few job worker counts
+// and keeps the fastest. Each candidate is applied with SetThreadConfig (the caller rebalances,
+// as for any live change), runs `warmupFrames` to settle, then `sampleFrames` whose median
+// CPU frame time is its score. Ties go to fewer workers. Frames should be paced by the CPU
+// (no v-sync) for the scores to mean anything.
+//
+// Candidates scale every budget together from base (ECS, shadow recording, prepare on/off);
+// maxThreads, deferred contexts and placements stay as configured.
+class ThreadAutoTuner
+{
+public:
+    struct Result
+    {
+        uint32_t workers = 0;
+        double medianMs = 0.0;
+    };
+
+    // Applies the first candidate. False (and nothing applied) if there is only one.
+    bool Begin(const ThreadConfig& base, uint32_t warmupFrames = 30, uint32_t sampleFrames = 120);
+
+    // Once per frame, between frames, with that frame's CPU time. True when it applied another
+    // config: the next candidate, or the winner once the last one is scored.
+    bool Tick(double frameMs);
+
+    bool Running() const { return mRunning; }
+    const std::vector<Result>& Results() const { return mResults; }
+    // The winner; valid once Begin returned true and Running() went false.
+    const ThreadConfig& Best() const { return mBest; }
+
+private:
+    ThreadConfig Candidate(uint32_t workers) const;
+
+    ThreadConfig mBase{};
+    ThreadConfig mBest{};
+    std::vector<uint32_t> mCandidates;
+    std::vector<Result> mResults;
+    std::vector<double> mSamples;
+    uint32_t mCurrent = 0;
+    uint32_t mFrame = 0;
+    uint32_t mWarmupFrames = 0;
+    uint32_t mSampleFrames = 0;
+    bool mRunning = false;
+};
+
+} // namespace king
@@ -0,0 +1,98 @@
+#include "frame_arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+namespace king
+{
+
+// Every block starts aligned to this; larger alignments are bumped to inside the block.
+static constexpr size_t kBlockAlignment = 64;
+
+FrameArena::FrameArena(size_t blockSize)
+    : mBlockSize(std::max<size_t>(blockSize, 4096))
+{
+}
+
+FrameArena::~FrameArena()
+{
+    for (Block& b : mBlocks)
+        _aligned_free(b.data);
+}
+
+size_t FrameArena::Capacity() const
+{
+    size_t total = 0;
+    for (const Block& b : mBlocks)
+        total += b.size;
+    return total;
+}
+
+bool FrameArena::AddBlock(size_t minSize)
+{
+    const size_t size = std::max(mBlockSize, minSize);
+    void* p = _aligned_malloc(size, kBlockAlignment);
+    if (!p)
+        return false;
+    mBlocks.push_back({ (std::byte*)p, size });
+    return true;
+}
+
+void* FrameArena::do_allocate(size_t bytes, size_t alignment)
+{
+    bytes = std::max<size_t>(bytes, 1);
+    alignment = std::max<size_t>(alignment, alignof(std::max_align_t));
+
+    // Try the current block, then any later ones (kept from before a Reset merged them).
+    for (; mCurrent < mBlocks.size(); ++mCurrent, mOffset = 0)
+    {
+        const Block& b = mBlocks[mCurrent];
+        const uintptr_t base = (uintptr_t)b.data;
+        const uintptr_t aligned = (base + mOffset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        const size_t end = (size_t)(aligned - base) + bytes;
+        if (end <= b.size)
+        {
+            mUsed += end - mOffset;
+            mOffset = end;
+            return (void*)aligned;
+        }
+    }
+
+    if (!mBlocks.empty())
+        ++mOverflows;
+    if (!AddBlock(bytes + alignment))
+        throw std::bad_alloc();
+    mCurrent = mBlocks.size() - 1;
+    mOffset = 0;
+    return do_allocate(bytes, alignment);
+}
+
+void FrameArena::Reset()
+{
+    mPeak = std::max(mPeak, mUsed);
+
+    // Outgrew one block: replace them all with a single one that holds the whole frame.
+    if (mBlocks.size() > 1)
+    {
+        const size_t total = Capacity();
+        for (Block& b : mBlocks)
+            _aligned_free(b.data);
+        mBlocks.clear();
+        (void)AddBlock(total);
+    }
+
+    mCurrent = 0;
+    mOffset = 0;
+    mUsed = 0;
+    mOverflows = 0;
+}
+
+FrameArena& ThreadFrameArena()
+{
+    thread_local FrameArena arena;
+    return arena;
+}
+
+} // namespace king
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace king
+{
+
+// Bump allocator for data that lives at most until its owner's next Reset (one frame):
+// allocation is a pointer bump, deallocation is a no-op, Reset frees everything at once.
+// Usable with any std::pmr container (FrameVector below).
+//
+// Memory comes in blocks. A frame that outgrows the current blocks takes another one from
+// the heap; the next Reset replaces them with one block of the combined size, so from then
+// on a frame of that size is a single block and allocates nothing.
+//
+// Not thread-safe: each thread uses its own (ThreadFrameArena).
+class FrameArena final : public std::pmr::memory_resource
+{
+public:
+    static constexpr size_t kDefaultBlockSize = 256u * 1024u;
+
+    explicit FrameArena(size_t blockSize = kDefaultBlockSize);
+    ~FrameArena() override;
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // Everything allocated since the last Reset becomes invalid. Containers on the arena must
+    // be destroyed (or never touched again) first.
+    void Reset();
+
+    size_t BytesUsed() const { return mUsed; }
+    size_t Capacity() const;
+    // Heap blocks taken since the last Reset (0 in steady state).
+    uint32_t Overflows() const { return mOverflows; }
+    // Most bytes any frame used.
+    size_t PeakBytes() const { return mPeak; }
+
+private:
+    struct Block
+    {
+        std::byte* data = nullptr;
+        size_t size = 0;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    bool AddBlock(size_t minSize);
+
+private:
+    std::vector<Block> mBlocks;
+    size_t mBlockSize = kDefaultBlockSize;
+    size_t mCurrent = 0; // block being bumped
+    size_t mOffset = 0;  // into mBlocks[mCurrent]
+    size_t mUsed = 0;
+    size_t mPeak = 0;
+    uint32_t mOverflows = 0;
+};
+
+// The calling thread's arena, created on first use. Reset by that thread at its own frame
+// boundary (the render thread: end of RenderSystemD3D11::RenderGeometryPass), so memory from
+// it must not be handed to another thread that keeps it past that point.
+FrameArena& ThreadFrameArena();
+
+template <typename T>
+using FrameVector = std::pmr::vector<T>;
+
+} // namespace king
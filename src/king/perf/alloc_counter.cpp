@@ -0,0 +1,65 @@
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+namespace king::perf
+{
+
+static std::atomic<uint64_t> sAllocations{ 0 };
+// Trivial type, so no thread_local initialization runs inside operator new.
+static thread_local uint64_t tAllocations = 0;
+
+uint64_t AllocationCount()
+{
+    return sAllocations.load(std::memory_order_relaxed);
+}
+
+uint64_t ThreadAllocationCount()
+{
+    return tAllocations;
+}
+
+} // namespace king::perf
+
+// The array and nothrow forms of the C++ runtime forward to these.
+
+void* operator new(std::size_t size)
+{
+    king::perf::sAllocations.fetch_add(1, std::memory_order_relaxed);
+    ++king::perf::tAllocations;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    king::perf::sAllocations.fetch_add(1, std::memory_order_relaxed);
+    ++king::perf::tAllocations;
+    if (void* p = _aligned_malloc(size ? size : 1, (size_t)align))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    _aligned_free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    _aligned_free(p);
+}
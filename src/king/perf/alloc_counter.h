@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+namespace king::perf
+{
+
+// Number of global operator new calls (scalar/array, aligned, nothrow; every thread) since
+// start-up. alloc_counter.cpp replaces the global operators with malloc-backed ones that bump
+// a relaxed atomic; the difference between two frames is that frame's allocation count.
+// Direct malloc calls (the D3D runtime, C libraries) are not seen.
+uint64_t AllocationCount();
+
+// The same, counting only the calling thread's calls.
+uint64_t ThreadAllocationCount();
+
+} // namespace king::perf
@@ -1,5 +1,6 @@
 #include "gpu_profiler_d3d11.h"
 
+#include <chrono>
 #include <cstdio>
 #include <cstring>
 
@@ -61,8 +62,15 @@ void GpuProfilerD3D11::Shutdown()
             IUnknown* p = (IUnknown*)q;
             SafeRelease(p);
         }
+        for (auto* q : s.stats)
+        {
+            IUnknown* p = (IUnknown*)q;
+            SafeRelease(p);
+        }
         s.begin.clear();
         s.end.clear();
+        s.stats.clear();
+        s.statsFrame.clear();
     }
     mScopes.clear();
 
@@ -71,6 +79,7 @@ void GpuProfilerD3D11::Shutdown()
     mDevice = nullptr;
 
     mFrameIndex = 0;
+    mCalibFrequency = 0;
 }
 
 ID3D11Query* GpuProfilerD3D11::CreateTimestampQuery()
@@ -99,6 +108,19 @@ ID3D11Query* GpuProfilerD3D11::CreateDisjointQuery()
     return q;
 }
 
+ID3D11Query* GpuProfilerD3D11::CreatePipelineStatsQuery()
+{
+    if (!mDevice)
+        return nullptr;
+
+    D3D11_QUERY_DESC qd{};
+    qd.Query = D3D11_QUERY_PIPELINE_STATISTICS;
+    ID3D11Query* q = nullptr;
+    if (FAILED(mDevice->CreateQuery(&qd, &q)))
+        return nullptr;
+    return q;
+}
+
 GpuProfilerD3D11::Scope* GpuProfilerD3D11::FindOrCreateScope(const char* name)
 {
     for (auto& s : mScopes)
@@ -162,6 +184,22 @@ void GpuProfilerD3D11::BeginScope(ID3D11DeviceContext* ctx, const char* name)
 
     if (s && s->begin[fi])
         ctx->End(s->begin[fi]);
+
+    if (s && mPipelineStats)
+    {
+        if (s->stats.empty())
+        {
+            s->stats.resize(bf, nullptr);
+            s->statsFrame.resize(bf, 0);
+            for (uint32_t i = 0; i < bf; ++i)
+                s->stats[i] = CreatePipelineStatsQuery();
+        }
+        if (s->stats[fi])
+        {
+            ctx->Begin(s->stats[fi]);
+            s->statsFrame[fi] = mFrameIndex + 1u;
+        }
+    }
 }
 
 void GpuProfilerD3D11::EndScope(ID3D11DeviceContext* ctx, const char* name)
@@ -175,11 +213,64 @@ void GpuProfilerD3D11::EndScope(ID3D11DeviceContext* ctx, const char* name)
 
     if (s && s->end[fi])
         ctx->End(s->end[fi]);
+
+    // Ended even if stats were switched off inside the scope, so no query is left open.
+    if (s && !s->stats.empty() && s->stats[fi] && s->statsFrame[fi] == mFrameIndex + 1u)
+        ctx->End(s->stats[fi]);
 }
 
-bool GpuProfilerD3D11::TryGetResults(ID3D11DeviceContext* ctx, uint32_t& outFrameIndex, std::vector<std::pair<const char*, double>>& outGpuMs)
+bool GpuProfilerD3D11::Calibrate(ID3D11DeviceContext* ctx)
+{
+    if (!mSettings.enabled || !ctx || !mDevice)
+        return false;
+
+    ID3D11Query* disjoint = CreateDisjointQuery();
+    ID3D11Query* stamp = CreateTimestampQuery();
+    bool ok = false;
+    if (disjoint && stamp)
+    {
+        ctx->Begin(disjoint);
+        ctx->End(stamp);
+        ctx->End(disjoint);
+
+        // Spin (flushing) until the GPU has written the timestamp; the CPU time read right
+        // after is late by the readback latency only.
+        UINT64 ticks = 0;
+        HRESULT hr = S_FALSE;
+        while ((hr = ctx->GetData(stamp, &ticks, sizeof(ticks), 0)) == S_FALSE)
+        {
+        }
+        const int64_t cpuNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+
+        D3D11_QUERY_DATA_TIMESTAMP_DISJOINT dis{};
+        HRESULT hrDis = S_FALSE;
+        while (hr == S_OK && (hrDis = ctx->GetData(disjoint, &dis, sizeof(dis), 0)) == S_FALSE)
+        {
+        }
+
+        if (hr == S_OK && hrDis == S_OK && !dis.Disjoint && dis.Frequency != 0)
+        {
+            mCalibTicks = ticks;
+            mCalibFrequency = dis.Frequency;
+            mCalibNs = cpuNs;
+            ok = true;
+        }
+    }
+
+    IUnknown* p = (IUnknown*)disjoint;
+    SafeRelease(p);
+    p = (IUnknown*)stamp;
+    SafeRelease(p);
+    return ok;
+}
+
+bool GpuProfilerD3D11::TryGetResults(ID3D11DeviceContext* ctx, uint32_t& outFrameIndex, std::vector<std::pair<const char*, double>>& outGpuMs,
+    std::vector<Span>* outSpans)
 {
     outGpuMs.clear();
+    if (outSpans)
+        outSpans->clear();
 
     if (!mSettings.enabled || !ctx || mDisjoint.empty())
         return false;
@@ -226,9 +317,49 @@ bool GpuProfilerD3D11::TryGetResults(ID3D11DeviceContext* ctx, uint32_t& outFram
 
         const double ms = ((double)(t1 - t0) * 1000.0) / freq;
         outGpuMs.push_back({ s.name, ms });
+
+        if (outSpans && mCalibFrequency != 0)
+        {
+            // Signed: scopes of frames submitted before the calibration precede it.
+            const double nsPerTick = 1e9 / freq;
+            Span span{};
+            span.name = s.name;
+            span.beginNs = mCalibNs + (int64_t)((double)(int64_t)(t0 - mCalibTicks) * nsPerTick);
+            span.endNs = mCalibNs + (int64_t)((double)(int64_t)(t1 - mCalibTicks) * nsPerTick);
+            outSpans->push_back(span);
+        }
     }
 
     return true;
 }
 
+bool GpuProfilerD3D11::TryGetPipelineStats(ID3D11DeviceContext* ctx, uint32_t& outFrameIndex,
+    std::vector<std::pair<const char*, D3D11_QUERY_DATA_PIPELINE_STATISTICS>>& outStats)
+{
+    outStats.clear();
+    if (!mSettings.enabled || !ctx || mDisjoint.empty())
+        return false;
+
+    const uint32_t bf = (uint32_t)mDisjoint.size();
+    if (mFrameIndex < bf)
+        return false;
+
+    const uint32_t readFrame = mFrameIndex - bf;
+    const uint32_t fi = (readFrame % bf);
+    outFrameIndex = readFrame;
+
+    for (auto& s : mScopes)
+    {
+        if (s.stats.empty() || !s.stats[fi] || s.statsFrame[fi] != readFrame + 1u)
+            continue;
+
+        D3D11_QUERY_DATA_PIPELINE_STATISTICS ps{};
+        if (ctx->GetData(s.stats[fi], &ps, sizeof(ps), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+            continue;
+        outStats.push_back({ s.name, ps });
+    }
+
+    return !outStats.empty();
+}
+
 } // namespace king::perf
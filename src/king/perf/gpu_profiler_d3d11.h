@@ -19,11 +19,23 @@ public:
         uint32_t bufferedFrames = 3;
     };
 
+    // A scope's GPU interval on the CPU's steady_clock (ns since its epoch), see Calibrate().
+    struct Span
+    {
+        const char* name = nullptr;
+        int64_t beginNs = 0;
+        int64_t endNs = 0;
+    };
+
     struct Scope
     {
         const char* name = nullptr;
         std::vector<ID3D11Query*> begin;
         std::vector<ID3D11Query*> end;
+        // Pipeline statistics, created on first use while enabled; statsFrame[i] is the frame
+        // index + 1 the query in slot i was last issued for (0 = never).
+        std::vector<ID3D11Query*> stats;
+        std::vector<uint32_t> statsFrame;
     };
 
     explicit GpuProfilerD3D11(Settings s = {}) : mSettings(s) {}
@@ -35,7 +47,13 @@ public:
     void SetEnabled(bool enabled) { mSettings.enabled = enabled; }
     bool Enabled() const { return mSettings.enabled; }
 
+    // Also wraps every scope in a D3D11_QUERY_PIPELINE_STATISTICS query (off by default: the
+    // counters are not free on every driver).
+    void SetPipelineStatsEnabled(bool enabled) { mPipelineStats = enabled; }
+    bool PipelineStatsEnabled() const { return mPipelineStats; }
+
     void Initialize(ID3D11Device* device);
+    bool Initialized() const { return mDevice != nullptr; }
     void Shutdown();
 
     void BeginFrame(ID3D11DeviceContext* ctx);
@@ -44,14 +62,28 @@ public:
     void BeginScope(ID3D11DeviceContext* ctx, const char* name);
     void EndScope(ID3D11DeviceContext* ctx, const char* name);
 
+    // Pairs a GPU timestamp with the CPU clock so TryGetResults can place scopes on the CPU
+    // timeline. Blocks until the GPU has caught up; call between frames (outside BeginFrame /
+    // EndFrame), e.g. once when a trace capture starts. Drift since the last call is not tracked.
+    bool Calibrate(ID3D11DeviceContext* ctx);
+    bool Calibrated() const { return mCalibFrequency != 0; }
+
     // Tries to fetch results for the most recently completed frame.
-    // Returns true if disjoint/timestamps were ready.
-    bool TryGetResults(ID3D11DeviceContext* ctx, uint32_t& outFrameIndex, std::vector<std::pair<const char*, double>>& outGpuMs);
+    // Returns true if disjoint/timestamps were ready. outSpans (optional) receives the same
+    // scopes as CPU-clock intervals once calibrated.
+    bool TryGetResults(ID3D11DeviceContext* ctx, uint32_t& outFrameIndex, std::vector<std::pair<const char*, double>>& outGpuMs,
+        std::vector<Span>* outSpans = nullptr);
+
+    // Pipeline statistics of the scopes of the same frame TryGetResults reads (call it in the
+    // same frame). Scopes whose query was not issued that frame, or is not ready, are left out.
+    bool TryGetPipelineStats(ID3D11DeviceContext* ctx, uint32_t& outFrameIndex,
+        std::vector<std::pair<const char*, D3D11_QUERY_DATA_PIPELINE_STATISTICS>>& outStats);
 
 private:
     Scope* FindOrCreateScope(const char* name);
     ID3D11Query* CreateTimestampQuery();
     ID3D11Query* CreateDisjointQuery();
+    ID3D11Query* CreatePipelineStatsQuery();
 
 private:
     Settings mSettings{};
@@ -61,6 +93,12 @@ private:
 
     std::vector<ID3D11Query*> mDisjoint;
     uint32_t mFrameIndex = 0;
+    bool mPipelineStats = false;
+
+    // Calibrate(): a GPU timestamp and the steady_clock time it was read back at.
+    uint64_t mCalibTicks = 0;
+    uint64_t mCalibFrequency = 0;
+    int64_t mCalibNs = 0;
 };
 
 } // namespace king::perf
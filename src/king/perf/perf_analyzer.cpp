@@ -1,4 +1,5 @@
 #include "perf_analyzer.h"
+#include "trace_capture.h"
 
 #include <cstdio>
 #include <cstring>
@@ -140,9 +141,9 @@ static double MsSince(const std::chrono::steady_clock::time_point& start,
     return duration<double, std::milli>(end - start).count();
 }
 
-PerfAnalyzer::Sample* PerfAnalyzer::FindOrAdd(std::vector<Sample>& samples, const char* name)
+PerfAnalyzer::Sample* PerfAnalyzer::FindOrAdd(const char* name)
 {
-    for (auto& s : samples)
+    for (auto& s : mSamples)
     {
         if (s.name == name)
             return &s;
@@ -152,8 +153,127 @@ PerfAnalyzer::Sample* PerfAnalyzer::FindOrAdd(std::vector<Sample>& samples, cons
 
     Sample ns{};
     ns.name = name;
-    samples.push_back(ns);
-    return &samples.back();
+    mSamples.push_back(ns);
+    Timers& t = mTimers.emplace_back();
+    t.cpu.Reset(mSettings.histogramWindowFrames);
+    t.gpu.Reset(mSettings.histogramWindowFrames);
+    return &mSamples.back();
+}
+
+static PerfAnalyzer::Percentiles ReadPercentiles(const TimingHistogram& h)
+{
+    PerfAnalyzer::Percentiles p;
+    p.p50 = h.PercentileMs(0.50);
+    p.p95 = h.PercentileMs(0.95);
+    p.p99 = h.PercentileMs(0.99);
+    p.max = h.MaxMs();
+    p.frames = h.Count();
+    return p;
+}
+
+void PerfAnalyzer::SetHistogramWindow(uint32_t frames)
+{
+    mSettings.histogramWindowFrames = frames;
+    ResetHistograms();
+}
+
+void PerfAnalyzer::SetHitchThreshold(double minMs, double factor)
+{
+    mSettings.hitchMinMs = minMs;
+    mSettings.hitchFactor = factor;
+}
+
+void PerfAnalyzer::ResetHistograms()
+{
+    for (auto& t : mTimers)
+    {
+        t.cpu.Reset(mSettings.histogramWindowFrames);
+        t.gpu.Reset(mSettings.histogramWindowFrames);
+    }
+    for (auto& s : mSamples)
+    {
+        s.cpu = {};
+        s.gpu = {};
+        s.hitches = 0;
+    }
+    mHitchLog.clear();
+    mHitchCount = 0;
+}
+
+void PerfAnalyzer::RecordHitch(const Sample& s, bool gpu, double ms, double p50Ms)
+{
+    Hitch h;
+    h.frame = mFrameIndex;
+    h.name = s.name;
+    h.gpu = gpu;
+    h.ms = ms;
+    h.p50Ms = p50Ms;
+    if (mHitchLog.size() < kHitchLogCapacity)
+        mHitchLog.push_back(h);
+    else
+        mHitchLog[mHitchCount % kHitchLogCapacity] = h;
+    ++mHitchCount;
+}
+
+void PerfAnalyzer::UpdateHistograms()
+{
+    // Judged against the history before this frame, then added to it.
+    auto observe = [&](Sample& s, TimingHistogram& h, bool gpu, double ms)
+    {
+        if (h.Count() > 0)
+        {
+            const double p50 = h.PercentileMs(0.50);
+            if (ms > mSettings.hitchMinMs && ms > p50 * mSettings.hitchFactor)
+            {
+                RecordHitch(s, gpu, ms, p50);
+                ++s.hitches;
+            }
+        }
+        h.Add(ms);
+    };
+
+    for (size_t i = 0; i < mSamples.size(); ++i)
+    {
+        Sample& s = mSamples[i];
+        Timers& t = mTimers[i];
+        if (!s.name)
+            continue;
+        if (t.cpuThisFrame)
+        {
+            observe(s, t.cpu, false, s.cpuMs);
+            s.cpu = ReadPercentiles(t.cpu);
+            t.cpuThisFrame = false;
+        }
+        if (s.gpuMs >= 0.0)
+        {
+            observe(s, t.gpu, true, s.gpuMs);
+            s.gpu = ReadPercentiles(t.gpu);
+        }
+    }
+}
+
+std::vector<PerfAnalyzer::Hitch> PerfAnalyzer::Hitches() const
+{
+    std::vector<Hitch> out;
+    out.reserve(mHitchLog.size());
+    const size_t start = (mHitchLog.size() < kHitchLogCapacity) ? 0 : (size_t)(mHitchCount % kHitchLogCapacity);
+    for (size_t i = 0; i < mHitchLog.size(); ++i)
+        out.push_back(mHitchLog[(start + i) % mHitchLog.size()]);
+    return out;
+}
+
+bool PerfAnalyzer::WriteHitchCsv(const std::wstring& path) const
+{
+    std::FILE* f = nullptr;
+    if (_wfopen_s(&f, path.c_str(), L"wb") != 0 || !f)
+        return false;
+
+    std::fprintf(f, "frame,scope,timer,ms,p50_ms\n");
+    for (const Hitch& h : Hitches())
+        std::fprintf(f, "%llu,%s,%s,%.4f,%.4f\n", (unsigned long long)h.frame, h.name ? h.name : "?", h.gpu ? "gpu" : "cpu", h.ms, h.p50Ms);
+    const bool ok = std::ferror(f) == 0;
+    std::fclose(f);
+    return ok;
 }
 
 void PerfAnalyzer::BeginFrame()
@@ -167,6 +287,8 @@ void PerfAnalyzer::BeginFrame()
         s.cpuMs = 0.0;
         s.gpuMs = -1.0;
     }
+    for (auto& c : mCounters)
+        c.value = 0;
 }
 
 void PerfAnalyzer::SetFps(double fps)
@@ -183,6 +305,7 @@ void PerfAnalyzer::EndFrame()
     if (!mSettings.enabled)
         return;
 
+    UpdateHistograms();
     mFrameIndex++;
 
     if (!mSettings.printToStdout)
@@ -231,9 +354,11 @@ void PerfAnalyzer::EndFrame()
                 return;
             }
             if (s->gpuMs >= 0.0)
-                std::printf("  %-16s CPU %7.3f ms | GPU %7.3f ms\n", s->name, s->cpuMs, s->gpuMs);
+                std::printf("  %-16s CPU %7.3f ms | GPU %7.3f ms | p99 CPU %7.3f GPU %7.3f | hitches %llu\n", s->name, s->cpuMs,
+                    s->gpuMs, s->cpu.p99, s->gpu.p99, (unsigned long long)s->hitches);
             else
-                std::printf("  %-16s CPU %7.3f ms | GPU   (n/a)\n", s->name, s->cpuMs);
+                std::printf("  %-16s CPU %7.3f ms | GPU   (n/a)    | p99 CPU %7.3f             | hitches %llu\n", s->name, s->cpuMs,
+                    s->cpu.p99, (unsigned long long)s->hitches);
         };
 
         if (mHaveFps)
@@ -245,7 +370,17 @@ void PerfAnalyzer::EndFrame()
         printOne("SSAOPass");
         printOne("TonemapPass");
 
-        mLastPrintedLines = mHaveFps ? 7u : 6u;
+        char cmpBuf[256];
+        for (const auto& c : mComparisons)
+        {
+            FormatComparison(c, cmpBuf, sizeof(cmpBuf));
+            std::printf("  %s\n", cmpBuf);
+        }
+
+        for (const auto& c : mCounters)
+            std::printf("  %-16s %llu\n", c.name, (unsigned long long)c.value);
+
+        mLastPrintedLines = (mHaveFps ? 7u : 6u) + (uint32_t)mComparisons.size() + (uint32_t)mCounters.size();
         std::fflush(stdout);
         return;
     }
@@ -291,6 +426,26 @@ void PerfAnalyzer::EndFrame()
         }
     }
 
+    char cmpBuf[256];
+    for (const auto& c : mComparisons)
+    {
+        FormatComparison(c, cmpBuf, sizeof(cmpBuf));
+#if defined(_WIN32)
+        ConsoleOverlayPrintfLine(mSettings.printToStdout, "  %s", cmpBuf);
+#else
+        PrintfLine(mSettings.printToStdout, "  %s\n", cmpBuf);
+#endif
+    }
+
+    for (const auto& c : mCounters)
+    {
+#if defined(_WIN32)
+        ConsoleOverlayPrintfLine(mSettings.printToStdout, "  %-16s %llu", c.name, (unsigned long long)c.value);
+#else
+        PrintfLine(mSettings.printToStdout, "  %-16s %llu\n", c.name, (unsigned long long)c.value);
+#endif
+    }
+
 #if defined(_WIN32)
     // Clear the remainder of the screen below our overlay.
     if (mSettings.printToStdout && EnsureVtConsole())
@@ -305,19 +460,85 @@ void PerfAnalyzer::AddCpuMs(const char* name, double ms)
 {
     if (!mSettings.enabled)
         return;
-    auto* s = FindOrAdd(mSamples, name);
+    auto* s = FindOrAdd(name);
     s->cpuMs += ms;
+    mTimers[(size_t)(s - mSamples.data())].cpuThisFrame = true;
 }
 
 void PerfAnalyzer::AddGpuMs(const char* name, double ms)
 {
     if (!mSettings.enabled)
         return;
-    auto* s = FindOrAdd(mSamples, name);
+    auto* s = FindOrAdd(name);
     // Keep the latest reading for the frame.
     s->gpuMs = ms;
 }
 
+void PerfAnalyzer::AddCount(const char* name, uint64_t value)
+{
+    if (!mSettings.enabled || !name)
+        return;
+    for (auto& c : mCounters)
+    {
+        if (c.name == name || (c.name && std::strcmp(c.name, name) == 0))
+        {
+            c.value += value;
+            return;
+        }
+    }
+    Counter nc{};
+    nc.name = name;
+    nc.value = value;
+    mCounters.push_back(nc);
+}
+
+void PerfAnalyzer::AddComparisonMs(const char* name, const char* labelA, const char* labelB, bool usedB, double ms)
+{
+    if (!mSettings.enabled || !name)
+        return;
+
+    Comparison* c = nullptr;
+    for (auto& it : mComparisons)
+    {
+        if (it.name == name || (it.name && std::strcmp(it.name, name) == 0))
+        {
+            c = &it;
+            break;
+        }
+    }
+    if (!c)
+    {
+        Comparison nc{};
+        nc.name = name;
+        nc.labelA = labelA;
+        nc.labelB = labelB;
+        mComparisons.push_back(nc);
+        c = &mComparisons.back();
+    }
+
+    // Plain mean for the first samples, then an exponential moving average so the verdict
+    // follows scene changes.
+    constexpr uint32_t kWarmSamples = 16;
+    constexpr double kAlpha = 1.0 / (double)kWarmSamples;
+    double& avg = usedB ? c->avgMsB : c->avgMsA;
+    uint32_t& n = usedB ? c->samplesB : c->samplesA;
+    if (n < kWarmSamples)
+        avg += (ms - avg) / (double)(n + 1u);
+    else
+        avg += (ms - avg) * kAlpha;
+    ++n;
+}
+
+void PerfAnalyzer::FormatComparison(const Comparison& c, char* buf, size_t bufSize)
+{
+    const char* verdict = (c.samplesA == 0 || c.samplesB == 0) ? "(collecting)" : (c.AWins() ? "WON" : "LOST");
+    (void)std::snprintf(buf, bufSize, "%-16s %s %7.3f ms vs %s %7.3f ms -> %s",
+        c.name ? c.name : "?",
+        c.labelA ? c.labelA : "A", c.avgMsA,
+        c.labelB ? c.labelB : "B", c.avgMsB,
+        verdict);
+}
+
 CpuScope::CpuScope(PerfAnalyzer& perf, const char* name)
     : mPerf(&perf), mName(name), mStart(std::chrono::steady_clock::now())
 {
@@ -325,10 +546,17 @@ CpuScope::CpuScope(PerfAnalyzer& perf, const char* name)
 
 CpuScope::~CpuScope()
 {
-    if (!mPerf || !mPerf->Enabled() || !mName)
+    if (!mName)
         return;
 
     const auto end = std::chrono::steady_clock::now();
+    TraceCapture& trace = GetTraceCapture();
+    if (trace.Recording())
+        trace.AddCpuEvent(mName, TraceCapture::ToNs(mStart), TraceCapture::ToNs(end));
+
+    if (!mPerf || !mPerf->Enabled())
+        return;
+
     const double ms = MsSince(mStart, end);
     mPerf->AddCpuMs(mName, ms);
 }
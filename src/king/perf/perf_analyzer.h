@@ -1,7 +1,10 @@
 #pragma once
 
+#include "timing_histogram.h"
+
 #include <cstdint>
 #include <chrono>
+#include <string>
 #include <vector>
 
 namespace king::perf
@@ -22,6 +25,25 @@ public:
 
         // Print once per N frames (fallback if no stable wall clock is desired).
         uint32_t printEveryNFrames = 60;
+
+        // Per-scope percentiles (Sample::cpu / Sample::gpu) cover this many of the latest
+        // frames the scope ran in. 0 keeps every frame since the last reset.
+        uint32_t histogramWindowFrames = 600;
+
+        // A scope hitches on a frame when its time is above hitchMinMs and above hitchFactor
+        // times its rolling p50. Hitches go to a fixed-size log (Hitches(), WriteHitchCsv).
+        double hitchMinMs = 1.0;
+        double hitchFactor = 3.0;
+    };
+
+    // Rolling distribution of one timer (see Settings::histogramWindowFrames).
+    struct Percentiles
+    {
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+        uint32_t frames = 0; // samples in the window
     };
 
     struct Sample
@@ -29,6 +51,45 @@ public:
         const char* name = nullptr;
         double cpuMs = 0.0;
         double gpuMs = -1.0; // <0 means unavailable
+
+        // Updated by EndFrame().
+        Percentiles cpu;
+        Percentiles gpu;
+        uint64_t hitches = 0; // frames this scope hitched on since the last reset
+    };
+
+    struct Hitch
+    {
+        uint64_t frame = 0;
+        const char* name = nullptr;
+        bool gpu = false;
+        double ms = 0.0;
+        double p50Ms = 0.0; // the scope's rolling p50 before this frame
+    };
+
+    static constexpr uint32_t kHitchLogCapacity = 256;
+
+    // Per-frame event count (e.g. state binds issued/skipped); reset by BeginFrame().
+    struct Counter
+    {
+        const char* name = nullptr;
+        uint64_t value = 0;
+    };
+
+    // A/B timing of two interchangeable code paths doing the same work
+    // (e.g. deferred-context vs immediate submission). Averages persist across frames.
+    struct Comparison
+    {
+        const char* name = nullptr;
+        const char* labelA = nullptr;
+        const char* labelB = nullptr;
+        double avgMsA = 0.0;
+        double avgMsB = 0.0;
+        uint32_t samplesA = 0;
+        uint32_t samplesB = 0;
+
+        // True once both paths have samples and A is cheaper than B.
+        bool AWins() const { return samplesA > 0 && samplesB > 0 && avgMsA < avgMsB; }
     };
 
     explicit PerfAnalyzer(Settings s = {}) : mSettings(s) {}
@@ -41,6 +102,11 @@ public:
     void SetPrintEveryNFrames(uint32_t n) { mSettings.printEveryNFrames = n; }
     void SetOverwriteConsole(bool enabled) { mSettings.overwriteConsole = enabled; }
 
+    // Clears histograms and the hitch log.
+    void SetHistogramWindow(uint32_t frames);
+    void SetHitchThreshold(double minMs, double factor);
+    void ResetHistograms();
+
     void BeginFrame();
     void EndFrame();
 
@@ -52,12 +118,45 @@ public:
 
     const std::vector<Sample>& Samples() const { return mSamples; }
 
+    // Latest hitches, oldest first (at most kHitchLogCapacity).
+    std::vector<Hitch> Hitches() const;
+    // CSV: frame,scope,timer,ms,p50_ms. Returns false if the file cannot be written.
+    bool WriteHitchCsv(const std::wstring& path) const;
+
+    void AddCount(const char* name, uint64_t value);
+
+    const std::vector<Counter>& Counters() const { return mCounters; }
+
+    // Records one timing of path A (usedB=false) or path B (usedB=true) for comparison
+    // `name`. Printed in the overlay as "A won/lost vs B".
+    void AddComparisonMs(const char* name, const char* labelA, const char* labelB, bool usedB, double ms);
+
+    const std::vector<Comparison>& Comparisons() const { return mComparisons; }
+
 private:
-    static Sample* FindOrAdd(std::vector<Sample>& samples, const char* name);
+    // Parallel to mSamples.
+    struct Timers
+    {
+        TimingHistogram cpu;
+        TimingHistogram gpu;
+        bool cpuThisFrame = false;
+    };
+
+    Sample* FindOrAdd(const char* name);
+    void UpdateHistograms();
+    void RecordHitch(const Sample& s, bool gpu, double ms, double p50Ms);
+
+    // Formats e.g. "GeomSubmit deferred 0.412 ms vs immediate 0.655 ms -> WON".
+    static void FormatComparison(const Comparison& c, char* buf, size_t bufSize);
 
 private:
     Settings mSettings{};
     std::vector<Sample> mSamples;
+    std::vector<Timers> mTimers;
+    std::vector<Hitch> mHitchLog; // ring of kHitchLogCapacity
+    uint64_t mHitchCount = 0;
+    std::vector<Comparison> mComparisons;
+    std::vector<Counter> mCounters;
     uint64_t mFrameIndex = 0;
 
     // Console presentation state (best-effort; only used when stdout is a console).
@@ -69,6 +168,7 @@ private:
     double mLastMsPerFrame = 0.0;
 };
 
+// Times the enclosing block into PerfAnalyzer (and, while one records, a TraceCapture).
 class CpuScope
 {
 public:
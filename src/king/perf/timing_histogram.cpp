@@ -0,0 +1,106 @@
+#include "timing_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace king::perf
+{
+
+static uint32_t HighestBit(uint64_t v)
+{
+    uint32_t msb = 0;
+    while (v >>= 1)
+        ++msb;
+    return msb;
+}
+
+uint32_t TimingHistogram::BucketOf(uint64_t us)
+{
+    us = std::min<uint64_t>(us, 0xFFFFFFFFull);
+    if (us < kSubBuckets)
+        return (uint32_t)us;
+
+    // Octave [2^msb, 2^(msb+1)) split into 16; [16, 32) lands on buckets 16..31 unchanged.
+    const uint32_t msb = HighestBit(us);
+    const uint32_t shift = msb - 4u;
+    const uint32_t sub = (uint32_t)(us >> shift) - kSubBuckets;
+    return kSubBuckets + shift * kSubBuckets + sub;
+}
+
+double TimingHistogram::BucketUpperMs(uint32_t bucket)
+{
+    if (bucket < kSubBuckets)
+        return (double)bucket * 1e-3;
+
+    const uint32_t shift = (bucket - kSubBuckets) / kSubBuckets;
+    const uint32_t sub = (bucket - kSubBuckets) % kSubBuckets;
+    const uint64_t lower = (uint64_t)(kSubBuckets + sub) << shift;
+    return (double)(lower + (1ull << shift) - 1ull) * 1e-3;
+}
+
+void TimingHistogram::Reset(uint32_t window)
+{
+    std::memset(mCounts, 0, sizeof(mCounts));
+    mCount = 0;
+    mMaxBucket = 0;
+    mRing.assign(window, 0);
+    mRingHead = 0;
+}
+
+void TimingHistogram::Add(double ms)
+{
+    if (!(ms >= 0.0))
+        return;
+
+    const uint32_t bucket = BucketOf((uint64_t)std::llround(ms * 1e3));
+    if (!mRing.empty())
+    {
+        const uint32_t slot = mRingHead % (uint32_t)mRing.size();
+        if (mCount == mRing.size())
+        {
+            --mCounts[mRing[slot]];
+            --mCount;
+        }
+        mRing[slot] = (uint16_t)bucket;
+        mRingHead = slot + 1u;
+    }
+
+    ++mCounts[bucket];
+    ++mCount;
+
+    if (bucket >= mMaxBucket)
+    {
+        mMaxBucket = bucket;
+    }
+    else if (mCounts[mMaxBucket] == 0)
+    {
+        // The previous maximum left the window.
+        while (mMaxBucket > 0 && mCounts[mMaxBucket] == 0)
+            --mMaxBucket;
+    }
+}
+
+double TimingHistogram::PercentileMs(double fraction) const
+{
+    if (mCount == 0)
+        return 0.0;
+
+    const double f = std::clamp(fraction, 0.0, 1.0);
+    const uint32_t target = std::max(1u, (uint32_t)std::ceil(f * (double)mCount));
+    uint32_t seen = 0;
+    for (uint32_t b = 0; b <= mMaxBucket; ++b)
+    {
+        seen += mCounts[b];
+        if (seen >= target)
+            return BucketUpperMs(b);
+    }
+    return BucketUpperMs(mMaxBucket);
+}
+
+double TimingHistogram::MaxMs() const
+{
+    return (mCount > 0) ? BucketUpperMs(mMaxBucket) : 0.0;
+}
+
+} // namespace king::perf
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace king::perf
+{
+
+// Fixed-size histogram of durations, laid out like an HDR histogram: microsecond values,
+// linear below 16 us and 16 sub-buckets per power of two above, so a bucket is never wider
+// than 1/16 (~6%) of the values in it. Covers 0 us .. 2^32 us in kBucketCount counters.
+//
+// With a window, only the last `window` samples count: each sample's bucket index is kept in
+// a ring and taken back out when the ring wraps (fixed memory, exact rolling counts).
+class TimingHistogram
+{
+public:
+    static constexpr uint32_t kSubBuckets = 16;
+    static constexpr uint32_t kBucketCount = kSubBuckets + 28u * kSubBuckets;
+
+    // Drops all samples. window = 0 keeps every sample.
+    void Reset(uint32_t window);
+
+    void Add(double ms);
+
+    uint32_t Count() const { return mCount; }
+    uint32_t Window() const { return (uint32_t)mRing.size(); }
+
+    // Smallest value that at least `fraction` (0..1) of the samples are at or below, as the
+    // upper edge of its bucket (HDR "highest equivalent value"). 0 when empty.
+    double PercentileMs(double fraction) const;
+    double MaxMs() const;
+
+private:
+    static uint32_t BucketOf(uint64_t us);
+    static double BucketUpperMs(uint32_t bucket);
+
+private:
+    uint32_t mCounts[kBucketCount]{};
+    uint32_t mCount = 0;
+    uint32_t mMaxBucket = 0;
+
+    std::vector<uint16_t> mRing;
+    uint32_t mRingHead = 0;
+};
+
+} // namespace king::perf
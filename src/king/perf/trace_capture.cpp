@@ -0,0 +1,248 @@
+#include "trace_capture.h"
+
+#include "../jobs/job_system.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace king::perf
+{
+
+// Events a ring may take while being read (in-flight scopes of a capture that just stopped);
+// the dump skips that many of the oldest.
+static constexpr uint32_t kRingReadMargin = 1024;
+
+static thread_local const char* tThreadName = nullptr;
+static thread_local void* tRingOwner = nullptr;
+static thread_local void* tRing = nullptr;
+
+TraceCapture& GetTraceCapture()
+{
+    static TraceCapture sCapture;
+    return sCapture;
+}
+
+void TraceCapture::SetThreadName(const char* name)
+{
+    tThreadName = name;
+}
+
+bool TraceCapture::Request(uint32_t frameCount, const std::wstring& path)
+{
+    if (frameCount == 0 || path.empty() || mState != State::Idle || mRequestedFrames != 0)
+        return false;
+    mRequestedFrames = frameCount;
+    mRequestedPath = path;
+    return true;
+}
+
+TraceCapture::Ring* TraceCapture::ThreadRing()
+{
+    if (tRingOwner == this)
+        return (Ring*)tRing;
+
+    auto ring = std::make_unique<Ring>();
+    ring->events.reset(new Event[kRingEvents]);
+    Ring* out = ring.get();
+    {
+        std::lock_guard<std::mutex> lock(mRingsMutex);
+        out->tid = (uint32_t)mRings.size() + 1u;
+        if (tThreadName)
+        {
+            out->name = tThreadName;
+        }
+        else
+        {
+            const uint32_t worker = JobSystem::CurrentWorker();
+            char buf[32];
+            (void)std::snprintf(buf, sizeof(buf), (worker != kAnyWorker) ? "Worker %u" : "Thread %u",
+                (worker != kAnyWorker) ? worker : out->tid);
+            out->name = buf;
+        }
+        mRings.push_back(std::move(ring));
+    }
+    tRingOwner = this;
+    tRing = out;
+    return out;
+}
+
+void TraceCapture::Push(Ring& ring, const char* name, int64_t beginNs, int64_t endNs)
+{
+    const uint32_t h = ring.head.load(std::memory_order_relaxed);
+    Event& e = ring.events[h & (kRingEvents - 1u)];
+    e.name = name;
+    e.beginNs = beginNs;
+    e.endNs = endNs;
+    ring.head.store(h + 1u, std::memory_order_release);
+}
+
+void TraceCapture::AddCpuEvent(const char* name, int64_t beginNs, int64_t endNs)
+{
+    if (!Recording() || !name)
+        return;
+    Push(*ThreadRing(), name, beginNs, endNs);
+}
+
+void TraceCapture::AddGpuEvent(const char* name, int64_t beginNs, int64_t endNs)
+{
+    if (mState == State::Idle || !name || endNs < mStartNs)
+        return;
+    if (!mGpuRing.events)
+        mGpuRing.events.reset(new Event[kRingEvents]);
+    Push(mGpuRing, name, beginNs, endNs);
+}
+
+void TraceCapture::BeginFrame()
+{
+    const int64_t now = NowNs();
+    switch (mState)
+    {
+    case State::Idle:
+        if (mRequestedFrames == 0)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mRingsMutex);
+            for (auto& r : mRings)
+                r->captureStart = r->head.load(std::memory_order_acquire);
+        }
+        mGpuRing.captureStart = mGpuRing.head.load(std::memory_order_relaxed);
+        mFramesLeft = mRequestedFrames;
+        mPath = mRequestedPath;
+        mRequestedFrames = 0;
+        mFrameStartNs.clear();
+        mStartNs = now;
+        mEndNs = now;
+        ++mCaptureId;
+        mState = State::Recording;
+        mRecording.store(true, std::memory_order_relaxed);
+        mFrameStartNs.push_back(now);
+        return;
+
+    case State::Recording:
+        if (--mFramesLeft > 0)
+        {
+            mFrameStartNs.push_back(now);
+            return;
+        }
+        mRecording.store(false, std::memory_order_relaxed);
+        mEndNs = now;
+        mFramesLeft = kGpuDrainFrames;
+        mState = State::Draining;
+        return;
+
+    case State::Draining:
+        if (--mFramesLeft > 0)
+            return;
+        if (Write())
+            std::printf("TraceCapture: wrote %zu frames to '%ls'\n", mFrameStartNs.size(), mPath.c_str());
+        else
+            std::printf("TraceCapture: cannot write '%ls'\n", mPath.c_str());
+        mState = State::Idle;
+        return;
+    }
+}
+
+static void WriteJsonString(std::FILE* f, const char* s)
+{
+    std::fputc('"', f);
+    for (; s && *s; ++s)
+    {
+        const char c = *s;
+        if (c == '"' || c == '\\')
+        {
+            std::fputc('\\', f);
+            std::fputc(c, f);
+        }
+        else if ((unsigned char)c >= 0x20)
+        {
+            std::fputc(c, f);
+        }
+    }
+    std::fputc('"', f);
+}
+
+bool TraceCapture::Write() const
+{
+    std::FILE* f = nullptr;
+    if (_wfopen_s(&f, mPath.c_str(), L"wb") != 0 || !f)
+        return false;
+
+    // Microseconds from the capture start, as the format expects.
+    auto us = [&](int64_t ns) { return (double)(ns - mStartNs) * 1e-3; };
+
+    bool first = true;
+    auto separator = [&]()
+    {
+        std::fputs(first ? "\n" : ",\n", f);
+        first = false;
+    };
+
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+    separator();
+    std::fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}}", f);
+    separator();
+    std::fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"GPU\"}}", f);
+    separator();
+    std::fputs("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":1,\"args\":{\"name\":\"D3D11 timestamps\"}}", f);
+
+    for (size_t i = 0; i < mFrameStartNs.size(); ++i)
+    {
+        separator();
+        std::fprintf(f, "{\"name\":\"Frame %zu\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f}", i, us(mFrameStartNs[i]));
+    }
+
+    std::vector<Event> events;
+    auto writeRing = [&](const Ring& r, uint32_t pid, uint32_t tid, int64_t endNs)
+    {
+        if (!r.events)
+            return;
+        const uint32_t head = r.head.load(std::memory_order_acquire);
+        uint32_t count = head - r.captureStart;
+        count = std::min(count, kRingEvents - kRingReadMargin);
+
+        events.clear();
+        for (uint32_t i = head - count; i != head; ++i)
+        {
+            const Event& e = r.events[i & (kRingEvents - 1u)];
+            if (e.name && e.beginNs >= mStartNs && e.beginNs <= endNs && e.endNs >= e.beginNs)
+                events.push_back(e);
+        }
+        // Parents first: earlier begin, then the longer of two scopes starting together.
+        std::sort(events.begin(), events.end(), [](const Event& a, const Event& b)
+        {
+            if (a.beginNs != b.beginNs)
+                return a.beginNs < b.beginNs;
+            return a.endNs > b.endNs;
+        });
+
+        for (const Event& e : events)
+        {
+            separator();
+            std::fputs("{\"name\":", f);
+            WriteJsonString(f, e.name);
+            std::fprintf(f, ",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", pid, tid, us(e.beginNs),
+                (double)(e.endNs - e.beginNs) * 1e-3);
+        }
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(mRingsMutex);
+        for (const auto& r : mRings)
+        {
+            separator();
+            std::fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", r->tid);
+            WriteJsonString(f, r->name.c_str());
+            std::fputs("}}", f);
+            writeRing(*r, 1, r->tid, mEndNs);
+        }
+    }
+    // GPU work of the last recorded frames may end after the CPU stopped; keep what began before.
+    writeRing(mGpuRing, 2, 1, mEndNs);
+
+    std::fputs("\n]}\n", f);
+    const bool ok = std::ferror(f) == 0;
+    std::fclose(f);
+    return ok;
+}
+
+} // namespace king::perf
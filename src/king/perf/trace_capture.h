@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace king::perf
+{
+
+// Timeline capture: nested CPU scopes from every thread plus GPU scopes (GpuProfilerD3D11,
+// moved onto the CPU clock) over a number of frames, written as Chrome trace event JSON
+// (chrome://tracing, Perfetto, Speedscope).
+//
+// Off until Request(). While recording, CpuScope and TraceScope append to a ring owned by the
+// calling thread: one writer per ring, no locks (a mutex is taken once per thread, to register
+// its ring). Rings keep the newest kRingEvents events. Nesting is implied by time containment
+// per thread, as the format expects. Scope names must outlive the capture (string literals).
+class TraceCapture
+{
+public:
+    static constexpr uint32_t kRingEvents = 1u << 16;
+    // GPU results arrive a few frames late (GpuProfilerD3D11::Settings::bufferedFrames), so
+    // the capture keeps taking them for this many frames after CPU recording stops.
+    static constexpr uint32_t kGpuDrainFrames = 4;
+
+    TraceCapture() = default;
+
+    TraceCapture(const TraceCapture&) = delete;
+    TraceCapture& operator=(const TraceCapture&) = delete;
+
+    // Main thread. Records frameCount frames from the next BeginFrame() and writes them to path.
+    // Returns false while a capture is in progress.
+    bool Request(uint32_t frameCount, const std::wstring& path);
+
+    // Main thread, once per frame: starts and stops captures and writes the file.
+    void BeginFrame();
+
+    // Any thread: true while CPU scopes are recorded.
+    bool Recording() const { return mRecording.load(std::memory_order_relaxed); }
+    // Main thread: true while GPU scopes are taken (recording plus the drain frames).
+    bool AcceptingGpu() const { return mState != State::Idle; }
+    // Changes with every capture (recalibrate GPU clocks once per capture).
+    uint32_t CaptureId() const { return mCaptureId; }
+
+    // Times are steady_clock nanoseconds since its epoch (see ToNs).
+    void AddCpuEvent(const char* name, int64_t beginNs, int64_t endNs);
+    // Main thread only.
+    void AddGpuEvent(const char* name, int64_t beginNs, int64_t endNs);
+
+    // Track name of the calling thread; takes effect if called before its first event.
+    static void SetThreadName(const char* name);
+
+    static int64_t ToNs(std::chrono::steady_clock::time_point t)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    }
+    static int64_t NowNs() { return ToNs(std::chrono::steady_clock::now()); }
+
+private:
+    enum class State
+    {
+        Idle,
+        Recording,
+        Draining,
+    };
+
+    struct Event
+    {
+        const char* name = nullptr;
+        int64_t beginNs = 0;
+        int64_t endNs = 0;
+    };
+
+    struct Ring
+    {
+        std::atomic<uint32_t> head{ 0 };
+        uint32_t captureStart = 0; // head when the current capture began
+        uint32_t tid = 0;
+        std::string name;
+        std::unique_ptr<Event[]> events;
+    };
+
+    Ring* ThreadRing();
+    static void Push(Ring& ring, const char* name, int64_t beginNs, int64_t endNs);
+    bool Write() const;
+
+private:
+    mutable std::mutex mRingsMutex;
+    std::vector<std::unique_ptr<Ring>> mRings;
+    Ring mGpuRing;
+
+    std::atomic<bool> mRecording{ false };
+    State mState = State::Idle;
+    uint32_t mCaptureId = 0;
+    uint32_t mRequestedFrames = 0;
+    uint32_t mFramesLeft = 0;
+    std::wstring mRequestedPath;
+    std::wstring mPath;
+    int64_t mStartNs = 0;
+    int64_t mEndNs = 0;
+    std::vector<int64_t> mFrameStartNs;
+};
+
+TraceCapture& GetTraceCapture();
+
+// Records the enclosing block on the calling thread's track while a capture is recording.
+// For threads without a PerfAnalyzer (CpuScope covers the main thread).
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name)
+        : mName(name), mBeginNs(GetTraceCapture().Recording() ? TraceCapture::NowNs() : 0)
+    {
+    }
+    ~TraceScope()
+    {
+        if (mBeginNs != 0 && mName)
+            GetTraceCapture().AddCpuEvent(mName, mBeginNs, TraceCapture::NowNs());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* mName = nullptr;
+    int64_t mBeginNs = 0;
+};
+
+} // namespace king::perf
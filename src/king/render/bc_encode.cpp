@@ -0,0 +1,404 @@
+#include "bc_encode.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace king
+{
+
+// Endpoints of the segment through the block's texels along their principal axis (first
+// `channels` components; power iteration on the covariance). mask skips texels (BC1 alpha).
+static void FitEndpoints(const uint8_t rgba[64], int channels, uint16_t mask, float e0[4], float e1[4])
+{
+    float mean[4] = {};
+    int n = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        if (!(mask & (1u << i)))
+            continue;
+        for (int c = 0; c < channels; ++c)
+            mean[c] += rgba[i * 4 + c];
+        ++n;
+    }
+    if (n == 0)
+    {
+        for (int c = 0; c < 4; ++c)
+            e0[c] = e1[c] = 0.0f;
+        return;
+    }
+    for (int c = 0; c < channels; ++c)
+        mean[c] /= (float)n;
+
+    float cov[4][4] = {};
+    float lo[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+    float hi[4] = {};
+    for (int i = 0; i < 16; ++i)
+    {
+        if (!(mask & (1u << i)))
+            continue;
+        float d[4] = {};
+        for (int c = 0; c < channels; ++c)
+        {
+            const float v = rgba[i * 4 + c];
+            d[c] = v - mean[c];
+            lo[c] = std::min(lo[c], v);
+            hi[c] = std::max(hi[c], v);
+        }
+        for (int a = 0; a < channels; ++a)
+            for (int b = 0; b < channels; ++b)
+                cov[a][b] += d[a] * d[b];
+    }
+
+    // Start from the bounding box diagonal; a few iterations settle on the dominant axis.
+    float axis[4] = {};
+    for (int c = 0; c < channels; ++c)
+        axis[c] = hi[c] - lo[c];
+    for (int it = 0; it < 8; ++it)
+    {
+        float next[4] = {};
+        for (int a = 0; a < channels; ++a)
+            for (int b = 0; b < channels; ++b)
+                next[a] += cov[a][b] * axis[b];
+        float len = 0.0f;
+        for (int c = 0; c < channels; ++c)
+            len += next[c] * next[c];
+        if (len <= 1e-12f)
+            break;
+        len = 1.0f / std::sqrt(len);
+        for (int c = 0; c < channels; ++c)
+            axis[c] = next[c] * len;
+    }
+
+    float len = 0.0f;
+    for (int c = 0; c < channels; ++c)
+        len += axis[c] * axis[c];
+    if (len <= 1e-12f)
+    {
+        // Flat block.
+        for (int c = 0; c < 4; ++c)
+            e0[c] = e1[c] = (c < channels) ? mean[c] : 0.0f;
+        return;
+    }
+    len = 1.0f / std::sqrt(len);
+    for (int c = 0; c < channels; ++c)
+        axis[c] *= len;
+
+    float tMin = 1e30f, tMax = -1e30f;
+    for (int i = 0; i < 16; ++i)
+    {
+        if (!(mask & (1u << i)))
+            continue;
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c)
+            t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    for (int c = 0; c < 4; ++c)
+    {
+        e0[c] = (c < channels) ? std::clamp(mean[c] + axis[c] * tMin, 0.0f, 255.0f) : 0.0f;
+        e1[c] = (c < channels) ? std::clamp(mean[c] + axis[c] * tMax, 0.0f, 255.0f) : 0.0f;
+    }
+}
+
+static uint16_t To565(const float c[3])
+{
+    const int r = (int)(c[0] * (31.0f / 255.0f) + 0.5f);
+    const int g = (int)(c[1] * (63.0f / 255.0f) + 0.5f);
+    const int b = (int)(c[2] * (31.0f / 255.0f) + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void From565(uint16_t v, int out[3])
+{
+    const int r = (v >> 11) & 31;
+    const int g = (v >> 5) & 63;
+    const int b = v & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+void EncodeBc1Block(const uint8_t rgba[64], uint8_t out[8], bool allowPunchThrough)
+{
+    uint16_t opaque = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        if (!allowPunchThrough || rgba[i * 4 + 3] >= 128)
+            opaque |= (uint16_t)(1u << i);
+    }
+    const bool punchThrough = opaque != 0xFFFFu;
+
+    float e0[4], e1[4];
+    FitEndpoints(rgba, 3, opaque, e0, e1);
+    uint16_t c0 = To565(e0);
+    uint16_t c1 = To565(e1);
+
+    // 4-colour blocks need c0 > c1, 3-colour (+ transparent) blocks c0 <= c1.
+    if (punchThrough ? (c0 > c1) : (c0 < c1))
+        std::swap(c0, c1);
+
+    int p[4][3];
+    From565(c0, p[0]);
+    From565(c1, p[1]);
+    for (int c = 0; c < 3; ++c)
+    {
+        if (punchThrough)
+        {
+            p[2][c] = (p[0][c] + p[1][c]) / 2;
+            p[3][c] = 0;
+        }
+        else
+        {
+            p[2][c] = (2 * p[0][c] + p[1][c]) / 3;
+            p[3][c] = (p[0][c] + 2 * p[1][c]) / 3;
+        }
+    }
+    // c0 == c1 decodes as 3-colour in BC1 (4-colour in BC3): only index 0 means the same in both.
+    const int paletteSize = (c0 == c1) ? 1 : (punchThrough ? 3 : 4);
+
+    uint32_t indices = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        uint32_t best = 3;
+        if (opaque & (1u << i))
+        {
+            int bestErr = 0x7fffffff;
+            for (int k = 0; k < paletteSize; ++k)
+            {
+                int err = 0;
+                for (int c = 0; c < 3; ++c)
+                {
+                    const int d = (int)rgba[i * 4 + c] - p[k][c];
+                    err += d * d;
+                }
+                if (err < bestErr)
+                {
+                    bestErr = err;
+                    best = (uint32_t)k;
+                }
+            }
+        }
+        indices |= best << (i * 2);
+    }
+
+    std::memcpy(out + 0, &c0, 2);
+    std::memcpy(out + 2, &c1, 2);
+    std::memcpy(out + 4, &indices, 4);
+}
+
+void EncodeBc4Block(const uint8_t rgba[64], int channel, uint8_t out[8])
+{
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        lo = std::min(lo, (int)rgba[i * 4 + channel]);
+        hi = std::max(hi, (int)rgba[i * 4 + channel]);
+    }
+
+    // a0 > a1 selects the 8-value ramp.
+    int p[8];
+    p[0] = hi;
+    p[1] = lo;
+    for (int k = 2; k < 8; ++k)
+        p[k] = ((8 - k) * hi + (k - 1) * lo) / 7;
+
+    uint64_t bits = 0;
+    if (hi != lo)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            const int v = rgba[i * 4 + channel];
+            uint64_t best = 0;
+            int bestErr = 0x7fffffff;
+            for (int k = 0; k < 8; ++k)
+            {
+                const int err = std::abs(v - p[k]);
+                if (err < bestErr)
+                {
+                    bestErr = err;
+                    best = (uint64_t)k;
+                }
+            }
+            bits |= best << (i * 3);
+        }
+    }
+
+    out[0] = (uint8_t)hi;
+    out[1] = (uint8_t)lo;
+    for (int b = 0; b < 6; ++b)
+        out[2 + b] = (uint8_t)(bits >> (b * 8));
+}
+
+void EncodeBc3Block(const uint8_t rgba[64], uint8_t out[16])
+{
+    EncodeBc4Block(rgba, 3, out);
+    // BC2/BC3 colour blocks always decode in 4-colour mode.
+    EncodeBc1Block(rgba, out + 8, false);
+}
+
+void EncodeBc5Block(const uint8_t rgba[64], uint8_t out[16])
+{
+    EncodeBc4Block(rgba, 0, out);
+    EncodeBc4Block(rgba, 1, out + 8);
+}
+
+// Mode 6: 7-bit RGBA endpoints with one p-bit each, 16-level indices, texel 0 is the anchor.
+void EncodeBc7Block(const uint8_t rgba[64], uint8_t out[16])
+{
+    static const int kWeights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    float e[2][4];
+    FitEndpoints(rgba, 4, 0xFFFFu, e[0], e[1]);
+
+    // Per endpoint, the p-bit that quantizes its four channels best.
+    int q[2][4];
+    int pbit[2];
+    int ep[2][4];
+    for (int s = 0; s < 2; ++s)
+    {
+        float bestErr = 1e30f;
+        for (int p = 0; p < 2; ++p)
+        {
+            int qq[4];
+            float err = 0.0f;
+            for (int c = 0; c < 4; ++c)
+            {
+                qq[c] = std::clamp((int)std::lround((e[s][c] - (float)p) * 0.5f), 0, 127);
+                const float d = (float)((qq[c] << 1) | p) - e[s][c];
+                err += d * d;
+            }
+            if (err < bestErr)
+            {
+                bestErr = err;
+                pbit[s] = p;
+                std::memcpy(q[s], qq, sizeof(qq));
+            }
+        }
+        for (int c = 0; c < 4; ++c)
+            ep[s][c] = (q[s][c] << 1) | pbit[s];
+    }
+
+    int palette[16][4];
+    for (int k = 0; k < 16; ++k)
+        for (int c = 0; c < 4; ++c)
+            palette[k][c] = ((64 - kWeights[k]) * ep[0][c] + kWeights[k] * ep[1][c] + 32) >> 6;
+
+    int idx[16];
+    for (int i = 0; i < 16; ++i)
+    {
+        int bestErr = 0x7fffffff;
+        idx[i] = 0;
+        for (int k = 0; k < 16; ++k)
+        {
+            int err = 0;
+            for (int c = 0; c < 4; ++c)
+            {
+                const int d = (int)rgba[i * 4 + c] - palette[k][c];
+                err += d * d;
+            }
+            if (err < bestErr)
+            {
+                bestErr = err;
+                idx[i] = k;
+            }
+        }
+    }
+
+    // The anchor index drops its top bit, so it must be < 8: flip the segment if not.
+    if (idx[0] & 8)
+    {
+        std::swap(q[0], q[1]);
+        std::swap(pbit[0], pbit[1]);
+        for (int i = 0; i < 16; ++i)
+            idx[i] = 15 - idx[i];
+    }
+
+    std::memset(out, 0, 16);
+    uint32_t at = 0;
+    auto put = [&](uint32_t value, uint32_t bits)
+    {
+        for (uint32_t b = 0; b < bits; ++b, ++at)
+        {
+            if (value & (1u << b))
+                out[at >> 3] |= (uint8_t)(1u << (at & 7u));
+        }
+    };
+
+    put(1u << 6, 7);
+    for (int c = 0; c < 4; ++c)
+    {
+        put((uint32_t)q[0][c], 7);
+        put((uint32_t)q[1][c], 7);
+    }
+    put((uint32_t)pbit[0], 1);
+    put((uint32_t)pbit[1], 1);
+    put((uint32_t)idx[0], 3);
+    for (int i = 1; i < 16; ++i)
+        put((uint32_t)idx[i], 4);
+}
+
+bool CompressRgba8(const uint8_t* rgba, uint32_t width, uint32_t height, DXGI_FORMAT format, std::vector<uint8_t>& out)
+{
+    uint32_t blockBytes = 0;
+    switch (format)
+    {
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC1_UNORM_SRGB:
+    case DXGI_FORMAT_BC4_UNORM:
+        blockBytes = 8;
+        break;
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC3_UNORM_SRGB:
+    case DXGI_FORMAT_BC5_UNORM:
+    case DXGI_FORMAT_BC7_UNORM:
+    case DXGI_FORMAT_BC7_UNORM_SRGB:
+        blockBytes = 16;
+        break;
+    default:
+        out.clear();
+        return false;
+    }
+    if (!rgba || width == 0 || height == 0)
+    {
+        out.clear();
+        return false;
+    }
+
+    const uint32_t bw = (width + 3u) / 4u;
+    const uint32_t bh = (height + 3u) / 4u;
+    out.resize((size_t)bw * bh * blockBytes);
+
+    uint8_t block[64];
+    for (uint32_t by = 0; by < bh; ++by)
+    {
+        for (uint32_t bx = 0; bx < bw; ++bx)
+        {
+            for (uint32_t y = 0; y < 4; ++y)
+            {
+                const uint32_t sy = std::min(by * 4u + y, height - 1u);
+                for (uint32_t x = 0; x < 4; ++x)
+                {
+                    const uint32_t sx = std::min(bx * 4u + x, width - 1u);
+                    std::memcpy(block + (y * 4u + x) * 4u, rgba + ((size_t)sy * width + sx) * 4u, 4);
+                }
+            }
+
+            uint8_t* dst = out.data() + ((size_t)by * bw + bx) * blockBytes;
+            switch (format)
+            {
+            case DXGI_FORMAT_BC1_UNORM:
+            case DXGI_FORMAT_BC1_UNORM_SRGB: EncodeBc1Block(block, dst); break;
+            case DXGI_FORMAT_BC3_UNORM:
+            case DXGI_FORMAT_BC3_UNORM_SRGB: EncodeBc3Block(block, dst); break;
+            case DXGI_FORMAT_BC4_UNORM: EncodeBc4Block(block, 0, dst); break;
+            case DXGI_FORMAT_BC5_UNORM: EncodeBc5Block(block, dst); break;
+            default: EncodeBc7Block(block, dst); break;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace king
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <dxgiformat.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace king
+{
+
+// Offline block compressors for the texture cooker. Each takes a 4x4 block of RGBA8 texels
+// (row major, 64 bytes) and fits endpoints along the block's principal axis, then picks the
+// nearest palette entry per texel: quick, and close enough to a full search for cooked assets.
+// sRGB data is encoded as stored (the hardware decodes the endpoints before converting).
+void EncodeBc1Block(const uint8_t rgba[64], uint8_t out[8], bool allowPunchThrough = true);
+void EncodeBc3Block(const uint8_t rgba[64], uint8_t out[16]);
+void EncodeBc4Block(const uint8_t rgba[64], int channel, uint8_t out[8]);
+void EncodeBc5Block(const uint8_t rgba[64], uint8_t out[16]); // R and G
+void EncodeBc7Block(const uint8_t rgba[64], uint8_t out[16]); // mode 6 (one RGBA subset)
+
+// Compresses one RGBA8 level into format (BC1/BC3/BC4/BC5/BC7, UNORM or _SRGB); edge blocks
+// repeat the last row/column. Returns false for other formats.
+bool CompressRgba8(const uint8_t* rgba, uint32_t width, uint32_t height, DXGI_FORMAT format, std::vector<uint8_t>& out);
+
+} // namespace king
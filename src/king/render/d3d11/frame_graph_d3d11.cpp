@@ -0,0 +1,343 @@
+#include "frame_graph_d3d11.h"
+
+#include "state_cache_d3d11.h"
+
+#include <cstdio>
+
+namespace king::render::d3d11
+{
+
+static uint32_t BytesPerPixel(DXGI_FORMAT format)
+{
+    switch (format)
+    {
+    case DXGI_FORMAT_R8_UNORM:
+        return 1;
+    case DXGI_FORMAT_R16_FLOAT:
+    case DXGI_FORMAT_R8G8_UNORM:
+        return 2;
+    case DXGI_FORMAT_R16G16B16A16_FLOAT:
+    case DXGI_FORMAT_R32G32_FLOAT:
+        return 8;
+    case DXGI_FORMAT_R32G32B32A32_FLOAT:
+        return 16;
+    default:
+        return 4;
+    }
+}
+
+static uint64_t TextureBytes(const FrameGraphTextureDesc& desc)
+{
+    return (uint64_t)desc.width * desc.height * BytesPerPixel(desc.format);
+}
+
+FrameGraphD3D11::~FrameGraphD3D11()
+{
+    Shutdown();
+}
+
+void FrameGraphD3D11::Shutdown()
+{
+    for (PooledTexture& p : mPool)
+        ReleasePooled(p);
+    mPool.clear();
+    Reset();
+}
+
+void FrameGraphD3D11::ReleasePooled(PooledTexture& p)
+{
+    if (p.uav)
+        p.uav->Release();
+    if (p.srv)
+        p.srv->Release();
+    if (p.rtv)
+        p.rtv->Release();
+    if (p.tex)
+        p.tex->Release();
+    p.uav = nullptr;
+    p.srv = nullptr;
+    p.rtv = nullptr;
+    p.tex = nullptr;
+}
+
+void FrameGraphD3D11::Reset()
+{
+    mResources.clear();
+    for (Pass& p : mPasses)
+    {
+        if (p.destroy)
+            p.destroy(p.closure);
+    }
+    mPasses.clear();
+    mArena.Reset();
+    mCompiled = false;
+    mStats = {};
+}
+
+FrameGraphTexture FrameGraphD3D11::Import(const char* name, ID3D11RenderTargetView* rtv, ID3D11ShaderResourceView* srv)
+{
+    Resource r{};
+    r.name = name;
+    r.imported = true;
+    r.rtv = rtv;
+    r.srv = srv;
+    mResources.push_back(r);
+    return (FrameGraphTexture)(mResources.size() - 1);
+}
+
+FrameGraphTexture FrameGraphD3D11::Builder::Create(const char* name, const FrameGraphTextureDesc& desc)
+{
+    if (desc.width == 0 || desc.height == 0)
+        return kInvalidFrameGraphTexture;
+
+    Resource r{};
+    r.name = name;
+    r.desc = desc;
+    mGraph.mResources.push_back(r);
+    const FrameGraphTexture t = (FrameGraphTexture)(mGraph.mResources.size() - 1);
+    Write(t);
+    return t;
+}
+
+static void AddUnique(FrameVector<FrameGraphTexture>& list, FrameGraphTexture t)
+{
+    for (FrameGraphTexture x : list)
+    {
+        if (x == t)
+            return;
+    }
+    list.push_back(t);
+}
+
+void FrameGraphD3D11::Builder::Read(FrameGraphTexture t)
+{
+    if (t < mGraph.mResources.size())
+        AddUnique(mGraph.mPasses[mPass].reads, t);
+}
+
+void FrameGraphD3D11::Builder::Write(FrameGraphTexture t)
+{
+    if (t < mGraph.mResources.size())
+        AddUnique(mGraph.mPasses[mPass].writes, t);
+}
+
+void FrameGraphD3D11::CullPasses()
+{
+    // Reference counts: a texture by the passes that read it, a pass by its writes. Textures
+    // nobody reads release their writers; a writer left with no live write is culled and in
+    // turn releases what it read. Passes writing imported textures are the graph's outputs.
+    for (Pass& p : mPasses)
+    {
+        p.refCount = (uint32_t)p.writes.size();
+        for (FrameGraphTexture t : p.reads)
+            mResources[t].refCount++;
+        for (FrameGraphTexture t : p.writes)
+            p.sideEffect |= mResources[t].imported;
+    }
+
+    std::vector<FrameGraphTexture> unread;
+    for (FrameGraphTexture t = 0; t < (FrameGraphTexture)mResources.size(); ++t)
+    {
+        if (!mResources[t].imported && mResources[t].refCount == 0)
+            unread.push_back(t);
+    }
+
+    while (!unread.empty())
+    {
+        const FrameGraphTexture t = unread.back();
+        unread.pop_back();
+
+        for (Pass& p : mPasses)
+        {
+            if (p.culled || p.sideEffect)
+                continue;
+            bool writes = false;
+            for (FrameGraphTexture w : p.writes)
+                writes |= (w == t);
+            if (!writes || --p.refCount > 0)
+                continue;
+
+            p.culled = true;
+            mStats.culled++;
+            for (FrameGraphTexture r : p.reads)
+            {
+                Resource& res = mResources[r];
+                if (res.refCount > 0 && --res.refCount == 0 && !res.imported)
+                    unread.push_back(r);
+            }
+        }
+    }
+}
+
+bool FrameGraphD3D11::AllocateTransients(ID3D11Device* device)
+{
+    constexpr uint32_t kUnused = 0xFFFFFFFFu;
+    for (Resource& r : mResources)
+        r.firstPass = kUnused;
+
+    for (uint32_t i = 0; i < (uint32_t)mPasses.size(); ++i)
+    {
+        const Pass& p = mPasses[i];
+        if (p.culled)
+            continue;
+        auto touch = [&](FrameGraphTexture t)
+        {
+            Resource& r = mResources[t];
+            if (r.firstPass == kUnused)
+                r.firstPass = i;
+            r.lastPass = i;
+        };
+        for (FrameGraphTexture t : p.reads)
+            touch(t);
+        for (FrameGraphTexture t : p.writes)
+            touch(t);
+    }
+
+    // Walk passes in order and hand each transient, at its first use, a pooled texture of the
+    // same desc whose previous holder this frame is done with (or that is unused this frame).
+    for (uint32_t i = 0; i < (uint32_t)mPasses.size(); ++i)
+    {
+        for (Resource& r : mResources)
+        {
+            if (r.imported || r.firstPass != i)
+                continue;
+
+            PooledTexture* slot = nullptr;
+            for (PooledTexture& p : mPool)
+            {
+                if (p.desc == r.desc && (p.lastFrame != mFrame || p.busyUntil < i))
+                {
+                    slot = &p;
+                    break;
+                }
+            }
+
+            if (!slot)
+            {
+                PooledTexture p{};
+                p.desc = r.desc;
+
+                D3D11_TEXTURE2D_DESC td{};
+                td.Width = r.desc.width;
+                td.Height = r.desc.height;
+                td.MipLevels = 1;
+                td.ArraySize = 1;
+                td.SampleDesc.Count = 1;
+                td.Usage = D3D11_USAGE_DEFAULT;
+                td.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+                if (r.desc.unorderedAccess)
+                    td.BindFlags |= D3D11_BIND_UNORDERED_ACCESS;
+                td.Format = r.desc.format;
+
+                if (FAILED(device->CreateTexture2D(&td, nullptr, &p.tex)) ||
+                    FAILED(device->CreateRenderTargetView(p.tex, nullptr, &p.rtv)) ||
+                    FAILED(device->CreateShaderResourceView(p.tex, nullptr, &p.srv)) ||
+                    (r.desc.unorderedAccess && FAILED(device->CreateUnorderedAccessView(p.tex, nullptr, &p.uav))))
+                {
+                    std::printf("FrameGraphD3D11: cannot create '%s' (%ux%u, format %u)\n", r.name ? r.name : "?",
+                        r.desc.width, r.desc.height, (unsigned)r.desc.format);
+                    ReleasePooled(p);
+                    return false;
+                }
+                mPool.push_back(p);
+                slot = &mPool.back();
+            }
+
+            if (slot->lastFrame != mFrame)
+            {
+                mStats.textures++;
+                mStats.textureBytes += TextureBytes(slot->desc);
+            }
+            slot->lastFrame = mFrame;
+            slot->busyUntil = r.lastPass;
+            r.rtv = slot->rtv;
+            r.srv = slot->srv;
+            r.uav = slot->uav;
+
+            mStats.transients++;
+            mStats.transientBytes += TextureBytes(r.desc);
+        }
+    }
+
+    for (size_t i = 0; i < mPool.size();)
+    {
+        if (mFrame - mPool[i].lastFrame > kPoolRetainFrames)
+        {
+            ReleasePooled(mPool[i]);
+            mPool[i] = mPool.back();
+            mPool.pop_back();
+            continue;
+        }
+        ++i;
+    }
+    return true;
+}
+
+bool FrameGraphD3D11::Compile(ID3D11Device* device)
+{
+    mCompiled = false;
+    if (!device)
+        return false;
+
+    ++mFrame;
+    mStats.passes = (uint32_t)mPasses.size();
+    CullPasses();
+    if (!AllocateTransients(device))
+        return false;
+
+    mCompiled = true;
+    return true;
+}
+
+void FrameGraphD3D11::Execute(StateCacheD3D11& sc, const ScopeFn& scope)
+{
+    if (!mCompiled)
+        return;
+
+    ID3D11DeviceContext* ctx = sc.Context();
+    const char* openScope = nullptr;
+    for (Pass& p : mPasses)
+    {
+        if (p.culled)
+            continue;
+
+        if (scope && p.scope != openScope)
+        {
+            if (openScope)
+                scope(openScope, false);
+            openScope = p.scope;
+            if (openScope)
+                scope(openScope, true);
+        }
+
+        sc.Begin(ctx);
+        p.execute(p.closure, *this, sc);
+    }
+    if (scope && openScope)
+        scope(openScope, false);
+}
+
+ID3D11RenderTargetView* FrameGraphD3D11::RTV(FrameGraphTexture t) const
+{
+    return (t < mResources.size()) ? mResources[t].rtv : nullptr;
+}
+
+ID3D11ShaderResourceView* FrameGraphD3D11::SRV(FrameGraphTexture t) const
+{
+    return (t < mResources.size()) ? mResources[t].srv : nullptr;
+}
+
+ID3D11UnorderedAccessView* FrameGraphD3D11::UAV(FrameGraphTexture t) const
+{
+    return (t < mResources.size()) ? mResources[t].uav : nullptr;
+}
+
+GpuMemoryD3D11 FrameGraphD3D11::PoolMemory() const
+{
+    GpuMemoryD3D11 m{};
+    for (const PooledTexture& p : mPool)
+        m.Add(p.tex);
+    return m;
+}
+
+} // namespace king::render::d3d11
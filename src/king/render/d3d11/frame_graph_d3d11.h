@@ -0,0 +1,199 @@
+#pragma once
+
+#include "gpu_memory_d3d11.h"
+#include "../../memory/frame_arena.h"
+
+#include <d3d11.h>
+
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace king::render::d3d11
+{
+
+class StateCacheD3D11;
+
+// Handle to a texture of the current frame's graph; only valid until the next Reset().
+using FrameGraphTexture = uint32_t;
+constexpr FrameGraphTexture kInvalidFrameGraphTexture = 0xFFFFFFFFu;
+
+// A transient 2D target: one mip, no MSAA, always bindable as RTV and SRV; also as UAV when
+// unorderedAccess is set (compute passes).
+struct FrameGraphTextureDesc
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    DXGI_FORMAT format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    bool unorderedAccess = false;
+
+    bool operator==(const FrameGraphTextureDesc& o) const
+    {
+        return width == o.width && height == o.height && format == o.format && unorderedAccess == o.unorderedAccess;
+    }
+};
+
+// Declarative list of the frame's passes. Every frame: Reset(), Import() the persistent
+// targets the passes touch (scene color, depth, back buffer), AddPass() each pass with a setup
+// callback that declares what it reads and writes (creating its transient targets there), then
+// Compile() and Execute().
+//
+// Compile() culls passes whose output nothing consumes (a write to an imported texture always
+// counts), then gives every transient a physical texture for the span of passes between its
+// first and last use. Transients whose spans do not overlap and whose descs match share one
+// texture; D3D11 has no placed resources, so sharing memory means sharing the ID3D11Texture2D.
+// The pool survives across frames and drops textures not used for kPoolRetainFrames frames
+// (resizes, toggled passes). Transient contents are undefined on entry: clear before reading.
+//
+// Pass data, execute callbacks and read/write lists live in a FrameArena the graph resets
+// with itself, so a steady-state frame declares its passes without touching the heap.
+class FrameGraphD3D11
+{
+public:
+    class Builder
+    {
+    public:
+        FrameGraphTexture Create(const char* name, const FrameGraphTextureDesc& desc);
+        void Read(FrameGraphTexture t);
+        void Write(FrameGraphTexture t);
+
+    private:
+        friend class FrameGraphD3D11;
+        Builder(FrameGraphD3D11& graph, uint32_t pass) : mGraph(graph), mPass(pass) {}
+
+        FrameGraphD3D11& mGraph;
+        uint32_t mPass;
+    };
+
+    struct Stats
+    {
+        uint32_t passes = 0;         // declared
+        uint32_t culled = 0;
+        uint32_t transients = 0;     // live transient textures
+        uint32_t textures = 0;       // physical textures backing them
+        uint64_t transientBytes = 0; // what the transients would take unaliased
+        uint64_t textureBytes = 0;   // what they actually take
+    };
+
+    // Called around runs of passes sharing a scope name (profiler scopes, GPU events).
+    using ScopeFn = std::function<void(const char* scope, bool begin)>;
+
+    static constexpr uint32_t kPoolRetainFrames = 3;
+
+    FrameGraphD3D11() = default;
+    ~FrameGraphD3D11();
+
+    FrameGraphD3D11(const FrameGraphD3D11&) = delete;
+    FrameGraphD3D11& operator=(const FrameGraphD3D11&) = delete;
+
+    // Releases the pooled textures.
+    void Shutdown();
+
+    void Reset();
+
+    FrameGraphTexture Import(const char* name, ID3D11RenderTargetView* rtv, ID3D11ShaderResourceView* srv);
+
+    // setup(Builder&, Data&) runs immediately; execute(const FrameGraphD3D11&, StateCacheD3D11&,
+    // const Data&) runs from Execute() unless the pass was culled, and looks its textures up
+    // through the graph. name and scope must outlive the graph (string literals).
+    template <typename Data, typename Setup, typename Exec>
+    void AddPass(const char* name, const char* scope, Setup&& setup, Exec&& execute)
+    {
+        struct Closure
+        {
+            std::decay_t<Exec> exec;
+            Data data;
+        };
+        void* mem = mArena.allocate(sizeof(Closure), alignof(Closure));
+        Closure* closure = new (mem) Closure{ std::forward<Exec>(execute), Data{} };
+
+        const uint32_t index = (uint32_t)mPasses.size();
+        mPasses.emplace_back(&mArena);
+        Pass& pass = mPasses.back();
+        pass.name = name;
+        pass.scope = scope;
+        pass.closure = closure;
+        pass.execute = [](void* c, const FrameGraphD3D11& g, StateCacheD3D11& sc)
+        {
+            Closure* cl = static_cast<Closure*>(c);
+            cl->exec(g, sc, cl->data);
+        };
+        pass.destroy = [](void* c) { static_cast<Closure*>(c)->~Closure(); };
+
+        Builder builder(*this, index);
+        setup(builder, closure->data);
+    }
+
+    // Returns false (and leaves nothing to execute) when a transient could not be created.
+    bool Compile(ID3D11Device* device);
+    // Begins sc on its context before each pass, so passes may also bind directly.
+    void Execute(StateCacheD3D11& sc, const ScopeFn& scope = {});
+
+    ID3D11RenderTargetView* RTV(FrameGraphTexture t) const;
+    ID3D11ShaderResourceView* SRV(FrameGraphTexture t) const;
+    ID3D11UnorderedAccessView* UAV(FrameGraphTexture t) const;
+
+    const Stats& GetStats() const { return mStats; }
+    // Every pooled texture, including ones kept from recent frames for reuse.
+    GpuMemoryD3D11 PoolMemory() const;
+
+private:
+    struct Resource
+    {
+        const char* name = nullptr;
+        FrameGraphTextureDesc desc{};
+        bool imported = false;
+        ID3D11RenderTargetView* rtv = nullptr; // imported, or the pooled texture's after Compile
+        ID3D11ShaderResourceView* srv = nullptr;
+        ID3D11UnorderedAccessView* uav = nullptr;
+
+        uint32_t refCount = 0; // passes reading it (culling)
+        uint32_t firstPass = 0;
+        uint32_t lastPass = 0;
+    };
+
+    struct Pass
+    {
+        explicit Pass(std::pmr::memory_resource* arena) : reads(arena), writes(arena) {}
+
+        const char* name = nullptr;
+        const char* scope = nullptr;
+        FrameVector<FrameGraphTexture> reads;
+        FrameVector<FrameGraphTexture> writes;
+        // Execute callback + pass data, placed in mArena by AddPass.
+        void* closure = nullptr;
+        void (*execute)(void* closure, const FrameGraphD3D11& graph, StateCacheD3D11& sc) = nullptr;
+        void (*destroy)(void* closure) = nullptr;
+
+        uint32_t refCount = 0; // writes someone still reads (culling)
+        bool sideEffect = false;
+        bool culled = false;
+    };
+
+    struct PooledTexture
+    {
+        FrameGraphTextureDesc desc{};
+        ID3D11Texture2D* tex = nullptr;
+        ID3D11RenderTargetView* rtv = nullptr;
+        ID3D11ShaderResourceView* srv = nullptr;
+        ID3D11UnorderedAccessView* uav = nullptr;
+        uint64_t lastFrame = 0;
+        uint32_t busyUntil = 0; // last pass of this frame holding it
+    };
+
+    void CullPasses();
+    bool AllocateTransients(ID3D11Device* device);
+    static void ReleasePooled(PooledTexture& p);
+
+    std::vector<Resource> mResources;
+    std::vector<Pass> mPasses;
+    FrameArena mArena{ 16u * 1024u };
+    std::vector<PooledTexture> mPool;
+    uint64_t mFrame = 0;
+    bool mCompiled = false;
+    Stats mStats{};
+};
+
+} // namespace king::render::d3d11
@@ -141,33 +141,33 @@ ID3D11PixelShader* FullscreenPassCacheD3D11::GetOrCreatePS(
     return shader;
 }
 
-void FullscreenPassCacheD3D11::Begin(ID3D11DeviceContext* ctx, ID3D11RenderTargetView* rtv, const D3D11_VIEWPORT& vp)
+void FullscreenPassCacheD3D11::Begin(StateCacheD3D11& sc, ID3D11RenderTargetView* rtv, const D3D11_VIEWPORT& vp, ID3D11PixelShader* ps)
 {
+    ID3D11DeviceContext* ctx = sc.Context();
     if (!ctx)
         return;
 
-    const float blendFactor[4] = { 0, 0, 0, 0 };
-
+    // An RTV binding unbinds any SRV of the same texture (previous pass output).
     ctx->OMSetRenderTargets(1, &rtv, nullptr);
-    if (mDSSNoDepth)
-        ctx->OMSetDepthStencilState(mDSSNoDepth, 0);
-    ctx->OMSetBlendState(mBlendOpaque, blendFactor, 0xFFFFFFFFu);
-
-    if (mRS)
-        ctx->RSSetState(mRS);
+    sc.InvalidateShaderResources();
     ctx->RSSetViewports(1, &vp);
 
-    ctx->IASetInputLayout(nullptr);
-    ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-    ctx->VSSetShader(mVS, nullptr, 0);
+    PipelineStateD3D11 p{};
+    p.layout = nullptr;
+    p.vs = mVS;
+    p.ps = ps;
+    p.blend = mBlendOpaque;
+    p.dss = mDSSNoDepth;
+    p.rs = mRS;
+    p.topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    sc.SetPipeline(p);
 }
 
-void FullscreenPassCacheD3D11::Draw(ID3D11DeviceContext* ctx)
+void FullscreenPassCacheD3D11::Draw(StateCacheD3D11& sc)
 {
-    if (!ctx)
+    if (!sc.Context())
         return;
-    ctx->Draw(3, 0);
+    sc.Draw(3, 0);
 }
 
 } // namespace king::render::d3d11
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "render_device_d3d11.h"
+#include "state_cache_d3d11.h"
 #include "../../render/shader.h"
 
 #include <d3d11.h>
@@ -37,9 +38,10 @@ public:
         const std::vector<king::ShaderDefine>& defines,
         std::string* outError);
 
-    // Convenience: set up common full-screen state (RTV, viewport, no depth).
-    void Begin(ID3D11DeviceContext* ctx, ID3D11RenderTargetView* rtv, const D3D11_VIEWPORT& vp);
-    void Draw(ID3D11DeviceContext* ctx);
+    // Convenience: set up common full-screen state (RTV, viewport, no depth) and ps on the
+    // cache's context. Consecutive passes only rebind the pixel shader.
+    void Begin(StateCacheD3D11& sc, ID3D11RenderTargetView* rtv, const D3D11_VIEWPORT& vp, ID3D11PixelShader* ps);
+    void Draw(StateCacheD3D11& sc);
 
 private:
     struct PsKey
@@ -0,0 +1,484 @@
+#include "gpu_culling_d3d11.h"
+
+#include "../../render/shader.h"
+#include "../../scene/frustum.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace king::render::d3d11
+{
+
+static void SafeRelease(IUnknown*& p)
+{
+    if (p)
+    {
+        p->Release();
+        p = nullptr;
+    }
+}
+
+// Matches CullInstance in gpu_cull.hlsl.
+struct CullInstanceGpu
+{
+    float sphere[4];
+    uint32_t argsFirst;  // args record of level 0; level l is argsFirst + l
+    uint32_t dstFirst;   // compacted range of level 0; level l starts at dstFirst + l * lodStride
+    uint32_t lodStride;
+    uint32_t lodCount;
+    float lodMaxPixels[4]; // maxPixels of levels 1..3
+};
+static_assert(sizeof(CullInstanceGpu) == 48, "CullInstanceGpu must match the HLSL struct");
+static_assert(kMaxMeshLods <= 4, "CullInstanceGpu holds thresholds for 4 levels");
+
+static constexpr uint32_t kCullGroupSize = 64;
+static constexpr uint32_t kMaxGroupsPerRow = 65535; // D3D11 dispatch limit per dimension
+static constexpr uint32_t kHiZGroupSize = 8;
+
+GpuCullingD3D11::~GpuCullingD3D11()
+{
+    Shutdown();
+}
+
+bool GpuCullingD3D11::Initialize(RenderDeviceD3D11& device, ShaderCache& shaderCache, const std::wstring& shaderPath)
+{
+    Shutdown();
+
+    ID3D11Device* d = device.Device();
+    if (!d)
+        return false;
+
+    king::CompiledShader cs;
+    std::string shaderErr;
+    if (!shaderCache.CompileCSFromFile(shaderPath.c_str(), "CSCullInstancesMain", {}, cs, &shaderErr))
+    {
+        std::printf("GpuCullingD3D11: CSCullInstancesMain compile error:\n%s\n", shaderErr.c_str());
+        return false;
+    }
+    HRESULT hr = d->CreateComputeShader(cs.bytecode->GetBufferPointer(), cs.bytecode->GetBufferSize(), nullptr, &mCS);
+    if (FAILED(hr))
+    {
+        std::printf("GpuCullingD3D11: CreateComputeShader failed hr=0x%08X\n", (unsigned)hr);
+        mCS = nullptr;
+        return false;
+    }
+
+    D3D11_BUFFER_DESC cbd{};
+    cbd.Usage = D3D11_USAGE_DYNAMIC;
+    cbd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    cbd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    cbd.ByteWidth = (UINT)sizeof(CullCBData);
+    hr = d->CreateBuffer(&cbd, nullptr, &mCullCB);
+    if (FAILED(hr))
+    {
+        std::printf("GpuCullingD3D11: CreateBuffer(CullCB) failed hr=0x%08X\n", (unsigned)hr);
+        Shutdown();
+        return false;
+    }
+
+    // Hi-Z downsample (optional: without it Cull() stays frustum-only).
+    king::CompiledShader hizCs;
+    if (shaderCache.CompileCSFromFile(shaderPath.c_str(), "CSHiZDownsampleMain", {}, hizCs, &shaderErr))
+    {
+        if (FAILED(d->CreateComputeShader(hizCs.bytecode->GetBufferPointer(), hizCs.bytecode->GetBufferSize(), nullptr, &mHiZCS)))
+            mHiZCS = nullptr;
+        cbd.ByteWidth = (UINT)sizeof(HiZCBData);
+        if (mHiZCS && FAILED(d->CreateBuffer(&cbd, nullptr, &mHiZCB)))
+            SafeRelease((IUnknown*&)mHiZCS);
+    }
+    else
+    {
+        std::printf("GpuCullingD3D11: CSHiZDownsampleMain compile error (occlusion culling disabled):\n%s\n", shaderErr.c_str());
+    }
+
+    return true;
+}
+
+void GpuCullingD3D11::Shutdown()
+{
+    ReleaseBuffers();
+    ReleaseHiZ();
+    SafeRelease((IUnknown*&)mHiZCB);
+    SafeRelease((IUnknown*&)mHiZCS);
+    SafeRelease((IUnknown*&)mCullCB);
+    SafeRelease((IUnknown*&)mCS);
+}
+
+void GpuCullingD3D11::ReleaseHiZ()
+{
+    for (uint32_t m = 0; m < kMaxHiZMips; ++m)
+    {
+        SafeRelease((IUnknown*&)mHiZMipUAV[m]);
+        SafeRelease((IUnknown*&)mHiZMipSRV[m]);
+    }
+    SafeRelease((IUnknown*&)mHiZSRV);
+    SafeRelease((IUnknown*&)mHiZTex);
+    mHiZMipCount = 0;
+    mHiZWidth = 0;
+    mHiZHeight = 0;
+    mHiZValid = false;
+}
+
+bool GpuCullingD3D11::EnsureHiZ(ID3D11Device* d, uint32_t width, uint32_t height)
+{
+    if (mHiZTex && mHiZWidth == width && mHiZHeight == height)
+        return true;
+    ReleaseHiZ();
+
+    const uint32_t w0 = std::max(1u, (width + 1u) / 2u);
+    const uint32_t h0 = std::max(1u, (height + 1u) / 2u);
+    uint32_t mips = 1;
+    for (uint32_t s = std::max(w0, h0); s > 1u && mips < kMaxHiZMips; s = (s + 1u) / 2u)
+        ++mips;
+
+    D3D11_TEXTURE2D_DESC td{};
+    td.Width = w0;
+    td.Height = h0;
+    td.MipLevels = mips;
+    td.ArraySize = 1;
+    td.Format = DXGI_FORMAT_R32_FLOAT;
+    td.SampleDesc.Count = 1;
+    td.Usage = D3D11_USAGE_DEFAULT;
+    td.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+    if (FAILED(d->CreateTexture2D(&td, nullptr, &mHiZTex)) || FAILED(d->CreateShaderResourceView(mHiZTex, nullptr, &mHiZSRV)))
+    {
+        ReleaseHiZ();
+        return false;
+    }
+
+    for (uint32_t m = 0; m < mips; ++m)
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvd{};
+        srvd.Format = DXGI_FORMAT_R32_FLOAT;
+        srvd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvd.Texture2D.MostDetailedMip = m;
+        srvd.Texture2D.MipLevels = 1;
+
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavd{};
+        uavd.Format = DXGI_FORMAT_R32_FLOAT;
+        uavd.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+        uavd.Texture2D.MipSlice = m;
+
+        if (FAILED(d->CreateShaderResourceView(mHiZTex, &srvd, &mHiZMipSRV[m])) || FAILED(d->CreateUnorderedAccessView(mHiZTex, &uavd, &mHiZMipUAV[m])))
+        {
+            ReleaseHiZ();
+            return false;
+        }
+    }
+
+    mHiZMipCount = mips;
+    mHiZWidth = width;
+    mHiZHeight = height;
+    return true;
+}
+
+bool GpuCullingD3D11::BuildHiZ(ID3D11Device* d, ID3D11DeviceContext* ctx, ID3D11ShaderResourceView* depthSRV,
+    uint32_t width, uint32_t height, uint32_t usedWidth, uint32_t usedHeight, const Mat4x4& viewProj)
+{
+    mHiZValid = false;
+    if (!d || !ctx || !depthSRV || !mHiZCS || !mHiZCB || width == 0 || height == 0)
+        return false;
+    if (!EnsureHiZ(d, width, height))
+        return false;
+    usedWidth = std::clamp(usedWidth, 1u, width);
+    usedHeight = std::clamp(usedHeight, 1u, height);
+
+    ctx->CSSetShader(mHiZCS, nullptr, 0);
+    ctx->CSSetConstantBuffers(1, 1, &mHiZCB);
+
+    // Each level is the max of the 2x2 texels above it; sizes round up so that a texel at
+    // level m always covers exactly 2^(m+1) depth pixels per axis.
+    uint32_t srcW = usedWidth;
+    uint32_t srcH = usedHeight;
+    ID3D11ShaderResourceView* nullSrv = nullptr;
+    ID3D11UnorderedAccessView* nullUav = nullptr;
+    for (uint32_t m = 0; m < mHiZMipCount; ++m)
+    {
+        const uint32_t dstW = std::max(1u, (srcW + 1u) / 2u);
+        const uint32_t dstH = std::max(1u, (srcH + 1u) / 2u);
+
+        HiZCBData cb{};
+        cb.srcSize[0] = srcW;
+        cb.srcSize[1] = srcH;
+        cb.dstSize[0] = dstW;
+        cb.dstSize[1] = dstH;
+        D3D11_MAPPED_SUBRESOURCE mapped{};
+        if (FAILED(ctx->Map(mHiZCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+            break;
+        std::memcpy(mapped.pData, &cb, sizeof(cb));
+        ctx->Unmap(mHiZCB, 0);
+        mMapBytes += sizeof(cb);
+
+        ID3D11ShaderResourceView* src = (m == 0) ? depthSRV : mHiZMipSRV[m - 1u];
+        ctx->CSSetUnorderedAccessViews(2, 1, &nullUav, nullptr);
+        ctx->CSSetShaderResources(3, 1, &src);
+        ctx->CSSetUnorderedAccessViews(2, 1, &mHiZMipUAV[m], nullptr);
+        ctx->Dispatch((dstW + kHiZGroupSize - 1u) / kHiZGroupSize, (dstH + kHiZGroupSize - 1u) / kHiZGroupSize, 1);
+        ctx->CSSetShaderResources(3, 1, &nullSrv);
+
+        srcW = dstW;
+        srcH = dstH;
+        if (m + 1u == mHiZMipCount)
+            mHiZValid = true;
+    }
+
+    ID3D11Buffer* nullCb = nullptr;
+    ctx->CSSetUnorderedAccessViews(2, 1, &nullUav, nullptr);
+    ctx->CSSetConstantBuffers(1, 1, &nullCb);
+    ctx->CSSetShader(nullptr, nullptr, 0);
+
+    mHiZViewProj = viewProj;
+    mHiZUsedWidth = usedWidth;
+    mHiZUsedHeight = usedHeight;
+    return mHiZValid;
+}
+
+void GpuCullingD3D11::ReleaseBuffers()
+{
+    SafeRelease((IUnknown*&)mCullInstancesSRV);
+    SafeRelease((IUnknown*&)mCullInstances);
+    SafeRelease((IUnknown*&)mSrcInstancesSRV);
+    SafeRelease((IUnknown*&)mSrcInstances);
+    SafeRelease((IUnknown*&)mDstInstancesUAV);
+    SafeRelease((IUnknown*&)mDstInstances);
+    SafeRelease((IUnknown*&)mArgsUAV);
+    SafeRelease((IUnknown*&)mArgs);
+    SafeRelease((IUnknown*&)mArgsReset);
+    mInstanceCount = 0;
+    mInstanceStride = 0;
+    mBucketCount = 0;
+}
+
+GpuMemoryD3D11 GpuCullingD3D11::BufferMemory() const
+{
+    GpuMemoryD3D11 m{};
+    m.Add(mCullInstances);
+    m.Add(mSrcInstances);
+    m.Add(mDstInstances);
+    m.Add(mArgs);
+    m.Add(mArgsReset);
+    return m;
+}
+
+GpuMemoryD3D11 GpuCullingD3D11::HiZMemory() const
+{
+    GpuMemoryD3D11 m{};
+    m.Add(mHiZTex);
+    return m;
+}
+
+void GpuCullingD3D11::Clear()
+{
+    ReleaseBuffers();
+}
+
+bool GpuCullingD3D11::Upload(ID3D11Device* d, ID3D11DeviceContext* ctx, const void* instances, uint32_t instanceStride,
+    const Float4* spheres, uint32_t instanceCount, const Bucket* buckets, uint32_t bucketCount)
+{
+    ReleaseBuffers();
+    if (!d || !ctx || !mCS || instanceCount == 0 || bucketCount == 0 || instanceStride == 0 || (instanceStride % 8u) != 0)
+        return false;
+
+    std::vector<CullInstanceGpu> cull(instanceCount);
+    for (uint32_t i = 0; i < instanceCount; ++i)
+    {
+        cull[i].sphere[0] = spheres[i].x;
+        cull[i].sphere[1] = spheres[i].y;
+        cull[i].sphere[2] = spheres[i].z;
+        cull[i].sphere[3] = -1.0f; // not in any bucket
+    }
+
+    // Args as drawn with nothing visible; copied over the live args before every cull. Each
+    // bucket owns kMaxMeshLods records (unused levels stay empty) and lodCount compacted ranges.
+    std::vector<uint32_t> args((size_t)bucketCount * kMaxMeshLods * (kArgsStride / 4u), 0u);
+    uint32_t dstCount = 0;
+    for (uint32_t b = 0; b < bucketCount; ++b)
+    {
+        const Bucket& bk = buckets[b];
+        const uint32_t lodCount = std::clamp(bk.lodCount, 1u, kMaxMeshLods);
+        for (uint32_t l = 0; l < lodCount; ++l)
+        {
+            uint32_t* a = args.data() + ArgsOffset(b, l) / 4u;
+            const uint32_t first = dstCount + l * bk.instanceCount;
+            if (bk.lods[0].indexCount > 0)
+            {
+                a[0] = bk.lods[l].indexCount; // IndexCountPerInstance
+                a[2] = bk.lods[l].firstIndex; // StartIndexLocation
+                a[4] = first; // StartInstanceLocation
+            }
+            else
+            {
+                a[0] = bk.vertexCount; // VertexCountPerInstance
+                a[3] = first; // StartInstanceLocation
+            }
+        }
+
+        const uint32_t end = std::min(bk.firstInstance + bk.instanceCount, instanceCount);
+        for (uint32_t i = bk.firstInstance; i < end; ++i)
+        {
+            CullInstanceGpu& ci = cull[i];
+            ci.sphere[3] = spheres[i].w;
+            ci.argsFirst = ArgsOffset(b, 0) / kArgsStride;
+            ci.dstFirst = dstCount;
+            ci.lodStride = bk.instanceCount;
+            ci.lodCount = (bk.lods[0].indexCount > 0) ? lodCount : 1u;
+            for (uint32_t l = 1; l < kMaxMeshLods; ++l)
+                ci.lodMaxPixels[l - 1u] = (l < lodCount) ? bk.lods[l].maxPixels : 0.0f;
+        }
+        dstCount += lodCount * bk.instanceCount;
+    }
+    if (dstCount == 0)
+        return false;
+
+    D3D11_SUBRESOURCE_DATA init{};
+    D3D11_BUFFER_DESC bd{};
+
+    // t0: per-instance cull records.
+    bd.Usage = D3D11_USAGE_IMMUTABLE;
+    bd.ByteWidth = (UINT)(sizeof(CullInstanceGpu) * instanceCount);
+    bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    bd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    bd.StructureByteStride = (UINT)sizeof(CullInstanceGpu);
+    init.pSysMem = cull.data();
+    if (FAILED(d->CreateBuffer(&bd, &init, &mCullInstances)) || FAILED(d->CreateShaderResourceView(mCullInstances, nullptr, &mCullInstancesSRV)))
+    {
+        ReleaseBuffers();
+        return false;
+    }
+
+    // t1: source instances (raw).
+    D3D11_SHADER_RESOURCE_VIEW_DESC rawSrv{};
+    rawSrv.Format = DXGI_FORMAT_R32_TYPELESS;
+    rawSrv.ViewDimension = D3D11_SRV_DIMENSION_BUFFEREX;
+    rawSrv.BufferEx.FirstElement = 0;
+    rawSrv.BufferEx.NumElements = (UINT)((size_t)instanceStride * instanceCount / 4u);
+    rawSrv.BufferEx.Flags = D3D11_BUFFEREX_SRV_FLAG_RAW;
+
+    bd = {};
+    bd.Usage = D3D11_USAGE_IMMUTABLE;
+    bd.ByteWidth = (UINT)((size_t)instanceStride * instanceCount);
+    bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    bd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+    init.pSysMem = instances;
+    if (FAILED(d->CreateBuffer(&bd, &init, &mSrcInstances)) || FAILED(d->CreateShaderResourceView(mSrcInstances, &rawSrv, &mSrcInstancesSRV)))
+    {
+        ReleaseBuffers();
+        return false;
+    }
+
+    // u0: compacted instances, also the instance vertex buffer.
+    D3D11_UNORDERED_ACCESS_VIEW_DESC rawUav{};
+    rawUav.Format = DXGI_FORMAT_R32_TYPELESS;
+    rawUav.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+    rawUav.Buffer.FirstElement = 0;
+    rawUav.Buffer.NumElements = (UINT)((size_t)instanceStride * dstCount / 4u);
+    rawUav.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+
+    bd = {};
+    bd.Usage = D3D11_USAGE_DEFAULT;
+    bd.ByteWidth = (UINT)((size_t)instanceStride * dstCount);
+    bd.BindFlags = D3D11_BIND_VERTEX_BUFFER | D3D11_BIND_UNORDERED_ACCESS;
+    bd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+    if (FAILED(d->CreateBuffer(&bd, nullptr, &mDstInstances)) || FAILED(d->CreateUnorderedAccessView(mDstInstances, &rawUav, &mDstInstancesUAV)))
+    {
+        ReleaseBuffers();
+        return false;
+    }
+
+    // u1: indirect args (raw) + reset image.
+    bd = {};
+    bd.Usage = D3D11_USAGE_DEFAULT;
+    bd.ByteWidth = (UINT)(args.size() * sizeof(uint32_t));
+    bd.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+    bd.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS | D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+    init.pSysMem = args.data();
+    rawUav.Buffer.NumElements = (UINT)args.size();
+    if (FAILED(d->CreateBuffer(&bd, &init, &mArgs)) || FAILED(d->CreateUnorderedAccessView(mArgs, &rawUav, &mArgsUAV)))
+    {
+        ReleaseBuffers();
+        return false;
+    }
+
+    bd = {};
+    bd.Usage = D3D11_USAGE_IMMUTABLE;
+    bd.ByteWidth = (UINT)(args.size() * sizeof(uint32_t));
+    bd.BindFlags = D3D11_BIND_SHADER_RESOURCE; // CopyResource source only
+    if (FAILED(d->CreateBuffer(&bd, &init, &mArgsReset)))
+    {
+        ReleaseBuffers();
+        return false;
+    }
+
+    mInstanceCount = instanceCount;
+    mInstanceStride = instanceStride;
+    mBucketCount = bucketCount;
+    return true;
+}
+
+void GpuCullingD3D11::Cull(ID3D11DeviceContext* ctx, const Frustum& frustum, const MeshLodView& lodView, bool occlusion)
+{
+    if (!ctx || !Ready())
+        return;
+
+    ctx->CopyResource(mArgs, mArgsReset);
+
+    const uint32_t groups = (mInstanceCount + kCullGroupSize - 1u) / kCullGroupSize;
+    const uint32_t groupsX = std::min(groups, kMaxGroupsPerRow);
+    const uint32_t groupsY = (groups + groupsX - 1u) / groupsX;
+
+    CullCBData cb{};
+    for (int p = 0; p < 6; ++p)
+    {
+        cb.planes[p][0] = frustum.planes[p].n.x;
+        cb.planes[p][1] = frustum.planes[p].n.y;
+        cb.planes[p][2] = frustum.planes[p].n.z;
+        cb.planes[p][3] = frustum.planes[p].d;
+    }
+    cb.instanceCount = mInstanceCount;
+    cb.instanceStride = mInstanceStride;
+    cb.threadsPerRow = groupsX * kCullGroupSize;
+    cb.lodPxPerUnit = lodView.pxPerUnit;
+    for (int k = 0; k < 4; ++k)
+        cb.lodWRow[k] = lodView.wRow[k];
+    occlusion = occlusion && mHiZValid && mHiZSRV;
+    if (occlusion)
+    {
+        cb.occlusion = 1u;
+        cb.hizViewProj = mHiZViewProj;
+        cb.hizScreenSize[0] = (float)mHiZUsedWidth;
+        cb.hizScreenSize[1] = (float)mHiZUsedHeight;
+        cb.hizMipCount = mHiZMipCount;
+    }
+
+    D3D11_MAPPED_SUBRESOURCE mapped{};
+    if (FAILED(ctx->Map(mCullCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+        return;
+    std::memcpy(mapped.pData, &cb, sizeof(cb));
+    ctx->Unmap(mCullCB, 0);
+    mMapBytes += sizeof(cb);
+
+    // The instance buffer may still be bound from the previous frame's draws.
+    ID3D11Buffer* nullVbs[2] = { nullptr, nullptr };
+    UINT zeros[2] = { 0u, 0u };
+    ctx->IASetVertexBuffers(0, 2, nullVbs, zeros, zeros);
+
+    ID3D11ShaderResourceView* srvs[3] = { mCullInstancesSRV, mSrcInstancesSRV, occlusion ? mHiZSRV : nullptr };
+    ID3D11UnorderedAccessView* uavs[2] = { mDstInstancesUAV, mArgsUAV };
+    ctx->CSSetShader(mCS, nullptr, 0);
+    ctx->CSSetConstantBuffers(0, 1, &mCullCB);
+    ctx->CSSetShaderResources(0, 3, srvs);
+    ctx->CSSetUnorderedAccessViews(0, 2, uavs, nullptr);
+    ctx->Dispatch(groupsX, groupsY, 1);
+
+    ID3D11ShaderResourceView* nullSrvs[3] = {};
+    ID3D11UnorderedAccessView* nullUavs[2] = {};
+    ID3D11Buffer* nullCb = nullptr;
+    ctx->CSSetUnorderedAccessViews(0, 2, nullUavs, nullptr);
+    ctx->CSSetShaderResources(0, 3, nullSrvs);
+    ctx->CSSetConstantBuffers(0, 1, &nullCb);
+    ctx->CSSetShader(nullptr, nullptr, 0);
+}
+
+} // namespace king::render::d3d11
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "gpu_memory_d3d11.h"
+#include "render_device_d3d11.h"
+
+#include "../../math/types.h"
+#include "../../render/mesh_lod.h"
+
+#include <d3d11.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace king
+{
+class ShaderCache;
+class Frustum;
+}
+
+namespace king::render::d3d11
+{
+
+// GPU-driven culling for a persistent instance set (the renderer's static region).
+// Instances, their bounding spheres and the draw buckets (contiguous instance ranges sharing
+// mesh + material) are uploaded once. Each frame Cull() resets one indirect-args record per
+// bucket and a compute pass tests every sphere against the frustum, appending the survivors
+// of bucket b to its own range [firstInstance, firstInstance + instanceCount) of InstanceVB().
+// The CPU then issues one DrawIndexedInstancedIndirect (or DrawInstancedIndirect) per bucket,
+// so its cost depends on the bucket count, not the instance count.
+//
+// Instance order within a bucket is not preserved (atomic append), so buckets are meant for
+// opaque draws.
+//
+// LOD: a bucket has one args record and one compacted range per mesh level. The pass picks
+// each survivor's level from its projected size (MeshLodView, same rule as SelectMeshLod) and
+// appends it to that level's range, so the CPU issues one indirect draw per bucket and level.
+//
+// Occlusion: BuildHiZ() reduces a depth buffer to a max-depth pyramid and remembers the
+// view-projection it was rendered with. Cull(occlusion = true) additionally projects each
+// sphere with that matrix and drops it if it lies behind the pyramid. Culling this frame
+// against last frame's depth is exact for static instances up to disocclusion, where an
+// object may show up one frame late.
+class GpuCullingD3D11
+{
+public:
+    struct Bucket
+    {
+        uint32_t firstInstance = 0;
+        uint32_t instanceCount = 0;
+        uint32_t vertexCount = 0;
+        // Index ranges per level; lods[0].indexCount == 0 = non-indexed, draws vertexCount.
+        uint32_t lodCount = 1;
+        MeshLod lods[kMaxMeshLods]{};
+    };
+
+    // One args record per bucket and level: DrawIndexedInstancedIndirect layout (5 uints), or
+    // the DrawInstancedIndirect one (4 uints + padding) for non-indexed buckets.
+    static constexpr uint32_t kArgsStride = 20;
+    static uint32_t ArgsOffset(uint32_t bucket, uint32_t lod)
+    {
+        return (bucket * kMaxMeshLods + std::min(lod, kMaxMeshLods - 1u)) * kArgsStride;
+    }
+
+    GpuCullingD3D11() = default;
+    ~GpuCullingD3D11();
+
+    GpuCullingD3D11(const GpuCullingD3D11&) = delete;
+    GpuCullingD3D11& operator=(const GpuCullingD3D11&) = delete;
+
+    bool Initialize(RenderDeviceD3D11& device, ShaderCache& shaderCache, const std::wstring& shaderPath);
+    void Shutdown();
+
+    // Replaces the instance set. instanceStride must be a multiple of 8 bytes; spheres are
+    // world-space (center, radius), radius < 0 = never visible. Buckets must not overlap.
+    bool Upload(ID3D11Device* d, ID3D11DeviceContext* ctx, const void* instances, uint32_t instanceStride,
+        const Float4* spheres, uint32_t instanceCount, const Bucket* buckets, uint32_t bucketCount);
+    void Clear();
+
+    // Resets the args and runs the culling pass (leaves no compute bindings behind). The
+    // occlusion test only runs once a pyramid has been built.
+    void Cull(ID3D11DeviceContext* ctx, const Frustum& frustum, const MeshLodView& lodView, bool occlusion = false);
+
+    // depthSRV: R32_FLOAT view of a width x height depth buffer (not bound for output), of
+    // which the top-left usedWidth x usedHeight were rendered this frame (dynamic resolution).
+    // The pyramid is allocated for the full size, so a changing used size never reallocates.
+    bool BuildHiZ(ID3D11Device* d, ID3D11DeviceContext* ctx, ID3D11ShaderResourceView* depthSRV,
+        uint32_t width, uint32_t height, uint32_t usedWidth, uint32_t usedHeight, const Mat4x4& viewProj);
+    void InvalidateHiZ() { mHiZValid = false; }
+    bool HiZValid() const { return mHiZValid; }
+
+    bool Ready() const { return mCS && mInstanceCount > 0 && mBucketCount > 0; }
+    uint32_t BucketCount() const { return mBucketCount; }
+
+    ID3D11Buffer* InstanceVB() const { return mDstInstances; }
+    ID3D11Buffer* ArgsBuffer() const { return mArgs; }
+
+    // Running total of bytes written through Map (cull and Hi-Z constants).
+    uint64_t MapBytes() const { return mMapBytes; }
+    // Instance, compacted instance and args buffers; the Hi-Z pyramid.
+    GpuMemoryD3D11 BufferMemory() const;
+    GpuMemoryD3D11 HiZMemory() const;
+
+private:
+    struct CullCBData
+    {
+        float planes[6][4];
+        uint32_t instanceCount;
+        uint32_t instanceStride; // bytes
+        uint32_t threadsPerRow;  // dispatch width in threads (2D dispatch for large sets)
+        uint32_t occlusion;      // 1 = test against the Hi-Z pyramid (t2)
+        Mat4x4 hizViewProj;
+        float hizScreenSize[2];  // depth-buffer region the pyramid was built from
+        uint32_t hizMipCount;
+        float lodPxPerUnit;      // MeshLodView; 0 = always level 0
+        float lodWRow[4];
+    };
+    static_assert(sizeof(CullCBData) % 16 == 0, "CullCBData must be 16-byte aligned");
+
+    struct HiZCBData
+    {
+        uint32_t srcSize[2];
+        uint32_t dstSize[2];
+    };
+    static_assert(sizeof(HiZCBData) % 16 == 0, "HiZCBData must be 16-byte aligned");
+
+    static constexpr uint32_t kMaxHiZMips = 16;
+
+    void ReleaseBuffers();
+    void ReleaseHiZ();
+    bool EnsureHiZ(ID3D11Device* d, uint32_t width, uint32_t height);
+
+    ID3D11ComputeShader* mCS = nullptr;
+    ID3D11Buffer* mCullCB = nullptr;
+
+    // Per instance: sphere + args/compacted ranges + LOD thresholds (t0), source instances (t1, raw).
+    ID3D11Buffer* mCullInstances = nullptr;
+    ID3D11ShaderResourceView* mCullInstancesSRV = nullptr;
+    ID3D11Buffer* mSrcInstances = nullptr;
+    ID3D11ShaderResourceView* mSrcInstancesSRV = nullptr;
+
+    // Compacted instances (u0, raw; bound as the instance vertex buffer when drawing), one
+    // range per bucket and level.
+    ID3D11Buffer* mDstInstances = nullptr;
+    ID3D11UnorderedAccessView* mDstInstancesUAV = nullptr;
+
+    // Indirect args (u1, raw) and the per-frame reset image (instance counts 0).
+    ID3D11Buffer* mArgs = nullptr;
+    ID3D11UnorderedAccessView* mArgsUAV = nullptr;
+    ID3D11Buffer* mArgsReset = nullptr;
+
+    uint32_t mInstanceCount = 0;
+    uint32_t mInstanceStride = 0;
+    uint32_t mBucketCount = 0;
+
+    // Max-depth pyramid; mip 0 is half the depth buffer (rounded up), one SRV/UAV per mip for
+    // the downsample and a full-chain SRV for the cull (t2).
+    ID3D11ComputeShader* mHiZCS = nullptr;
+    ID3D11Buffer* mHiZCB = nullptr;
+    ID3D11Texture2D* mHiZTex = nullptr;
+    ID3D11ShaderResourceView* mHiZSRV = nullptr;
+    ID3D11ShaderResourceView* mHiZMipSRV[kMaxHiZMips] = {};
+    ID3D11UnorderedAccessView* mHiZMipUAV[kMaxHiZMips] = {};
+    uint32_t mHiZMipCount = 0;
+    uint32_t mHiZWidth = 0;  // source depth size
+    uint32_t mHiZHeight = 0;
+    uint32_t mHiZUsedWidth = 0;  // part of it the pyramid was built from
+    uint32_t mHiZUsedHeight = 0;
+    Mat4x4 mHiZViewProj{};
+    bool mHiZValid = false;
+
+    uint64_t mMapBytes = 0;
+};
+
+} // namespace king::render::d3d11
@@ -0,0 +1,75 @@
+#include "gpu_memory_d3d11.h"
+
+#include "../../render/dds.h"
+
+namespace king::render::d3d11
+{
+
+// Render target and depth formats, on top of what ComputeSurfacePitch knows.
+static uint32_t TargetTexelBytes(DXGI_FORMAT format)
+{
+    switch (format)
+    {
+    case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+    case DXGI_FORMAT_R32G32B32A32_FLOAT:
+        return 16;
+    case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+    case DXGI_FORMAT_R16G16B16A16_FLOAT:
+    case DXGI_FORMAT_R16G16B16A16_UNORM:
+    case DXGI_FORMAT_R32G32_TYPELESS:
+    case DXGI_FORMAT_R32G32_FLOAT:
+        return 8;
+    case DXGI_FORMAT_R16_TYPELESS:
+    case DXGI_FORMAT_R16_FLOAT:
+    case DXGI_FORMAT_R16_UNORM:
+    case DXGI_FORMAT_D16_UNORM:
+        return 2;
+    default:
+        return 4; // R32_*, D32, D24S8, R11G11B10, R10G10B10A2, 8-bit RGBA
+    }
+}
+
+uint64_t EstimateResourceBytes(ID3D11Resource* resource)
+{
+    if (!resource)
+        return 0;
+
+    D3D11_RESOURCE_DIMENSION dim = D3D11_RESOURCE_DIMENSION_UNKNOWN;
+    resource->GetType(&dim);
+    if (dim == D3D11_RESOURCE_DIMENSION_BUFFER)
+    {
+        D3D11_BUFFER_DESC bd{};
+        static_cast<ID3D11Buffer*>(resource)->GetDesc(&bd);
+        return bd.ByteWidth;
+    }
+    if (dim != D3D11_RESOURCE_DIMENSION_TEXTURE2D)
+        return 0;
+
+    D3D11_TEXTURE2D_DESC td{};
+    static_cast<ID3D11Texture2D*>(resource)->GetDesc(&td);
+
+    uint64_t bytes = 0;
+    uint32_t w = td.Width;
+    uint32_t h = td.Height;
+    for (uint32_t mip = 0; mip < td.MipLevels; ++mip)
+    {
+        uint32_t rowPitch = 0;
+        uint32_t slicePitch = 0;
+        if (!ComputeSurfacePitch(td.Format, w, h, rowPitch, slicePitch))
+            slicePitch = w * h * TargetTexelBytes(td.Format);
+        bytes += slicePitch;
+        w = (w > 1) ? w / 2 : 1;
+        h = (h > 1) ? h / 2 : 1;
+    }
+    return bytes * td.ArraySize * (td.SampleDesc.Count > 0 ? td.SampleDesc.Count : 1u);
+}
+
+void GpuMemoryD3D11::Add(ID3D11Resource* resource)
+{
+    if (!resource)
+        return;
+    resources++;
+    bytes += EstimateResourceBytes(resource);
+}
+
+} // namespace king::render::d3d11
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <cstdint>
+
+namespace king::render::d3d11
+{
+
+// Live GPU resources of one kind and the bytes they take, estimated from their descs (every
+// mip, array slice and sample; no driver padding or alignment).
+struct GpuMemoryD3D11
+{
+    uint32_t resources = 0;
+    uint64_t bytes = 0;
+
+    // Null resources are ignored.
+    void Add(ID3D11Resource* resource);
+
+    GpuMemoryD3D11& operator+=(const GpuMemoryD3D11& o)
+    {
+        resources += o.resources;
+        bytes += o.bytes;
+        return *this;
+    }
+};
+
+// Size of a buffer or 2D texture (other dimensions: 0).
+uint64_t EstimateResourceBytes(ID3D11Resource* resource);
+
+} // namespace king::render::d3d11
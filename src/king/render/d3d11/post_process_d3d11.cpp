@@ -2,6 +2,7 @@
 
 #include "render_device_d3d11.h"
 
+#include <algorithm>
 #include <cstring>
 #include <cstdio>
 
@@ -54,195 +55,242 @@ bool PostProcessD3D11::Initialize(RenderDeviceD3D11& device, king::ShaderCache&
         return false;
     }
 
+    // Compute bloom pyramid. Optional: without it bloom falls back to the pixel-shader chain.
+    {
+        const size_t slash = shaderPath.find_last_of(L"/\\");
+        const std::wstring bloomPath =
+            (slash == std::wstring::npos) ? std::wstring(L"bloom_cs.hlsl") : shaderPath.substr(0, slash) + L"\\bloom_cs.hlsl";
+        std::string csErr;
+        king::CompiledShader down;
+        king::CompiledShader up;
+        cbd.ByteWidth = (UINT)sizeof(BloomCBData);
+        if (cache.CompileCSFromFile(bloomPath.c_str(), "CSBloomDownsampleMain", {}, down, &csErr) &&
+            cache.CompileCSFromFile(bloomPath.c_str(), "CSBloomUpsampleMain", {}, up, &csErr))
+        {
+            if (FAILED(d->CreateComputeShader(down.bytecode->GetBufferPointer(), down.bytecode->GetBufferSize(), nullptr, &mBloomDownCS)) ||
+                FAILED(d->CreateComputeShader(up.bytecode->GetBufferPointer(), up.bytecode->GetBufferSize(), nullptr, &mBloomUpCS)) ||
+                FAILED(d->CreateBuffer(&cbd, nullptr, &mBloomCB)))
+            {
+                SafeRelease((IUnknown*&)mBloomDownCS);
+                SafeRelease((IUnknown*&)mBloomUpCS);
+                SafeRelease((IUnknown*&)mBloomCB);
+            }
+        }
+        if (!mBloomDownCS)
+            std::printf("PostProcessD3D11: compute bloom unavailable (%s), using the pixel-shader bloom.\n", csErr.c_str());
+    }
+
     return true;
 }
 
-void PostProcessD3D11::Shutdown()
+std::vector<king::ShaderDefine> PostProcessD3D11::CompositeDefines(bool bloom, bool ambientOcclusion, bool vignette, bool sharpen)
 {
-    IUnknown* tmp = nullptr;
-
-    tmp = (IUnknown*)mPingSRV;
-    SafeRelease(tmp);
-    mPingSRV = nullptr;
-
-    tmp = (IUnknown*)mPingRTV;
-    SafeRelease(tmp);
-    mPingRTV = nullptr;
-
-    tmp = (IUnknown*)mPingTex;
-    SafeRelease(tmp);
-    mPingTex = nullptr;
-
-    tmp = (IUnknown*)mBloomASRV;
-    SafeRelease(tmp);
-    mBloomASRV = nullptr;
-
-    tmp = (IUnknown*)mBloomARTV;
-    SafeRelease(tmp);
-    mBloomARTV = nullptr;
-
-    tmp = (IUnknown*)mBloomATex;
-    SafeRelease(tmp);
-    mBloomATex = nullptr;
-
-    tmp = (IUnknown*)mBloomBSRV;
-    SafeRelease(tmp);
-    mBloomBSRV = nullptr;
-
-    tmp = (IUnknown*)mBloomBRTV;
-    SafeRelease(tmp);
-    mBloomBRTV = nullptr;
-
-    tmp = (IUnknown*)mBloomBTex;
-    SafeRelease(tmp);
-    mBloomBTex = nullptr;
-
-    mW = 0;
-    mH = 0;
-    mBloomW = 0;
-    mBloomH = 0;
+    return {
+        { "KING_POST_BLOOM", bloom ? "1" : "0" },
+        { "KING_POST_AO", ambientOcclusion ? "1" : "0" },
+        { "KING_POST_VIGNETTE", vignette ? "1" : "0" },
+        { "KING_POST_SHARPEN", sharpen ? "1" : "0" },
+    };
+}
 
-    tmp = (IUnknown*)mPostCB;
+void PostProcessD3D11::Shutdown()
+{
+    IUnknown* tmp = (IUnknown*)mPostCB;
     SafeRelease(tmp);
     mPostCB = nullptr;
 
+    SafeRelease((IUnknown*&)mBloomDownCS);
+    SafeRelease((IUnknown*&)mBloomUpCS);
+    SafeRelease((IUnknown*&)mBloomCB);
+
     mFullscreen.Shutdown();
 
     mShaderPath.clear();
 }
 
-void PostProcessD3D11::EnsureIntermediate(RenderDeviceD3D11& device)
-{
-    ID3D11Device* d = device.Device();
-    if (!d)
-        return;
-
-    const uint32_t w = device.BackBufferWidth();
-    const uint32_t h = device.BackBufferHeight();
-    if (w == 0 || h == 0)
-        return;
-
-    if (mPingTex && mPingRTV && mPingSRV && mW == w && mH == h)
-        return;
-
-    IUnknown* tmp = nullptr;
-
-    tmp = (IUnknown*)mPingSRV;
-    SafeRelease(tmp);
-    mPingSRV = nullptr;
-
-    tmp = (IUnknown*)mPingRTV;
-    SafeRelease(tmp);
-    mPingRTV = nullptr;
-
-    tmp = (IUnknown*)mPingTex;
-    SafeRelease(tmp);
-    mPingTex = nullptr;
-
-    D3D11_TEXTURE2D_DESC td{};
-    td.Width = w;
-    td.Height = h;
-    td.MipLevels = 1;
-    td.ArraySize = 1;
-    td.SampleDesc.Count = 1;
-    td.Usage = D3D11_USAGE_DEFAULT;
-    td.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-    td.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
-
-    if (FAILED(d->CreateTexture2D(&td, nullptr, &mPingTex)) || !mPingTex)
-        return;
-
-    if (FAILED(d->CreateRenderTargetView(mPingTex, nullptr, &mPingRTV)) || !mPingRTV)
-        return;
+// Profiler / GPU event scope of every post pass (the whole chain reads as one entry).
+static constexpr const char* kPostScope = "TonemapPass";
 
-    if (FAILED(d->CreateShaderResourceView(mPingTex, nullptr, &mPingSRV)) || !mPingSRV)
-        return;
-
-    mW = w;
-    mH = h;
+void PostProcessD3D11::AddFullscreenPass(FrameGraphD3D11& graph, const char* name, const char* dstName,
+    const FrameGraphTextureDesc& dstDesc, uint32_t vpWidth, uint32_t vpHeight, FrameGraphTexture src, ID3D11PixelShader* ps,
+    ID3D11SamplerState* linearClamp, FrameGraphTexture& outDst)
+{
+    outDst = kInvalidFrameGraphTexture;
+    graph.AddPass<FullscreenPassData>(name, kPostScope,
+        [&](FrameGraphD3D11::Builder& b, FullscreenPassData& data)
+        {
+            b.Read(src);
+            data.src = src;
+            data.dst = b.Create(dstName, dstDesc);
+            data.ps = ps;
+            data.vp.Width = (float)vpWidth;
+            data.vp.Height = (float)vpHeight;
+            data.vp.MaxDepth = 1.0f;
+            outDst = data.dst;
+        },
+        [this, linearClamp](const FrameGraphD3D11& g, StateCacheD3D11& sc, const FullscreenPassData& data)
+        {
+            ID3D11RenderTargetView* rtv = g.RTV(data.dst);
+            ID3D11ShaderResourceView* srv = g.SRV(data.src);
+            if (!rtv || !srv)
+                return;
+
+            const float clear[4] = { 0, 0, 0, 0 };
+            sc.Context()->ClearRenderTargetView(rtv, clear);
+            mFullscreen.Begin(sc, rtv, data.vp, data.ps);
+            sc.SetPSConstantBuffer(6, mPostCB);
+            sc.SetPSShaderResources(1, 1, &srv);
+            if (linearClamp)
+                sc.SetPSSampler(1, linearClamp);
+            mFullscreen.Draw(sc);
+
+            ID3D11ShaderResourceView* nullSrv[1] = { nullptr };
+            sc.SetPSShaderResources(1, 1, nullSrv);
+        });
 }
 
-void PostProcessD3D11::EnsureBloomTargets(RenderDeviceD3D11& device)
+void PostProcessD3D11::AddBloomPass(FrameGraphD3D11& graph, const char* name, const FrameGraphTextureDesc& dstDesc,
+    FrameGraphTexture src, FrameGraphTexture level, ID3D11ComputeShader* cs, const BloomCBData& cb,
+    ID3D11SamplerState* linearClamp, FrameGraphTexture& outDst)
 {
-    ID3D11Device* d = device.Device();
-    if (!d)
-        return;
-
-    const uint32_t w = device.BackBufferWidth();
-    const uint32_t h = device.BackBufferHeight();
-    if (w == 0 || h == 0)
-        return;
-
-    const uint32_t bw = (w > 1) ? (w / 2) : 1;
-    const uint32_t bh = (h > 1) ? (h / 2) : 1;
-    if (mBloomATex && mBloomARTV && mBloomASRV && mBloomBTex && mBloomBRTV && mBloomBSRV && mBloomW == bw && mBloomH == bh)
-        return;
-
-    IUnknown* tmp = nullptr;
-
-    tmp = (IUnknown*)mBloomASRV;
-    SafeRelease(tmp);
-    mBloomASRV = nullptr;
-
-    tmp = (IUnknown*)mBloomARTV;
-    SafeRelease(tmp);
-    mBloomARTV = nullptr;
-
-    tmp = (IUnknown*)mBloomATex;
-    SafeRelease(tmp);
-    mBloomATex = nullptr;
-
-    tmp = (IUnknown*)mBloomBSRV;
-    SafeRelease(tmp);
-    mBloomBSRV = nullptr;
-
-    tmp = (IUnknown*)mBloomBRTV;
-    SafeRelease(tmp);
-    mBloomBRTV = nullptr;
+    outDst = kInvalidFrameGraphTexture;
+    graph.AddPass<BloomPassData>(name, kPostScope,
+        [&](FrameGraphD3D11::Builder& b, BloomPassData& data)
+        {
+            b.Read(src);
+            b.Read(level);
+            data.src = src;
+            data.level = level;
+            data.dst = b.Create(name, dstDesc);
+            data.cs = cs;
+            data.cb = cb;
+            outDst = data.dst;
+        },
+        [this, linearClamp](const FrameGraphD3D11& g, StateCacheD3D11& sc, const BloomPassData& data)
+        {
+            ID3D11DeviceContext* c = sc.Context();
+            ID3D11UnorderedAccessView* uav = g.UAV(data.dst);
+            ID3D11ShaderResourceView* srvs[2] = { g.SRV(data.src), g.SRV(data.level) };
+            if (!uav || !srvs[0])
+                return;
+
+            D3D11_MAPPED_SUBRESOURCE mapped{};
+            if (FAILED(c->Map(mBloomCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+                return;
+            std::memcpy(mapped.pData, &data.cb, sizeof(data.cb));
+            c->Unmap(mBloomCB, 0);
+            mMapBytes += sizeof(data.cb);
+
+            // The previous pass may still hold src as a render target.
+            c->OMSetRenderTargets(0, nullptr, nullptr);
+            c->CSSetShader(data.cs, nullptr, 0);
+            c->CSSetConstantBuffers(0, 1, &mBloomCB);
+            c->CSSetShaderResources(0, 2, srvs);
+            c->CSSetUnorderedAccessViews(0, 1, &uav, nullptr);
+            if (linearClamp)
+                c->CSSetSamplers(0, 1, &linearClamp);
+            sc.Dispatch((data.cb.dstSize[0] + 7u) / 8u, (data.cb.dstSize[1] + 7u) / 8u, 1);
+
+            ID3D11ShaderResourceView* nullSrvs[2] = { nullptr, nullptr };
+            ID3D11UnorderedAccessView* nullUav = nullptr;
+            c->CSSetShaderResources(0, 2, nullSrvs);
+            c->CSSetUnorderedAccessViews(0, 1, &nullUav, nullptr);
+            c->CSSetShader(nullptr, nullptr, 0);
+        });
+}
 
-    tmp = (IUnknown*)mBloomBTex;
-    SafeRelease(tmp);
-    mBloomBTex = nullptr;
-
-    D3D11_TEXTURE2D_DESC td{};
-    td.Width = bw;
-    td.Height = bh;
-    td.MipLevels = 1;
-    td.ArraySize = 1;
-    td.SampleDesc.Count = 1;
-    td.Usage = D3D11_USAGE_DEFAULT;
-    td.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-    td.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
-
-    if (FAILED(d->CreateTexture2D(&td, nullptr, &mBloomATex)) || !mBloomATex)
-        return;
-    if (FAILED(d->CreateRenderTargetView(mBloomATex, nullptr, &mBloomARTV)) || !mBloomARTV)
-        return;
-    if (FAILED(d->CreateShaderResourceView(mBloomATex, nullptr, &mBloomASRV)) || !mBloomASRV)
-        return;
+FrameGraphTexture PostProcessD3D11::AddComputeBloom(FrameGraphD3D11& graph, FrameGraphTexture hdr, uint32_t width,
+    uint32_t height, uint32_t usedWidth, uint32_t usedHeight, float threshold, ID3D11SamplerState* linearClamp,
+    uint32_t& outLevels)
+{
+    static const char* const kDownNames[kBloomMaxLevels] = {
+        "BloomDown0", "BloomDown1", "BloomDown2", "BloomDown3", "BloomDown4", "BloomDown5",
+    };
+    static const char* const kUpNames[kBloomMaxLevels] = {
+        "BloomUp0", "BloomUp1", "BloomUp2", "BloomUp3", "BloomUp4", "BloomUp5",
+    };
+
+    // Level sizes follow the full-size source so the pooled textures never change with the
+    // render scale; used[] is the part of each level the scene covers.
+    FrameGraphTextureDesc descs[kBloomMaxLevels]{};
+    uint32_t used[kBloomMaxLevels][2]{};
+    FrameGraphTexture down[kBloomMaxLevels];
+    uint32_t levels = 0;
+    uint32_t srcW = width;
+    uint32_t srcH = height;
+    uint32_t srcUsedW = usedWidth;
+    uint32_t srcUsedH = usedHeight;
+    FrameGraphTexture src = hdr;
+    auto fillSource = [](BloomCBData& cb, uint32_t w, uint32_t h, uint32_t usedW, uint32_t usedH)
+    {
+        cb.invSrcSize[0] = 1.0f / (float)w;
+        cb.invSrcSize[1] = 1.0f / (float)h;
+        cb.srcUvMax[0] = ((float)usedW - 0.5f) / (float)w;
+        cb.srcUvMax[1] = ((float)usedH - 0.5f) / (float)h;
+    };
+    while (levels < kBloomMaxLevels)
+    {
+        const uint32_t lw = (srcW > 1) ? (srcW / 2) : 1;
+        const uint32_t lh = (srcH > 1) ? (srcH / 2) : 1;
+        if (levels > 0 && (lw < kBloomMinSize || lh < kBloomMinSize))
+            break;
+
+        descs[levels] = { lw, lh, DXGI_FORMAT_R16G16B16A16_FLOAT, true };
+        used[levels][0] = std::max(1u, srcUsedW / 2);
+        used[levels][1] = std::max(1u, srcUsedH / 2);
+        BloomCBData cb{};
+        cb.dstSize[0] = used[levels][0];
+        cb.dstSize[1] = used[levels][1];
+        cb.invDstTexSize[0] = 1.0f / (float)lw;
+        cb.invDstTexSize[1] = 1.0f / (float)lh;
+        fillSource(cb, srcW, srcH, srcUsedW, srcUsedH);
+        cb.threshold = threshold;
+        cb.prefilter = (levels == 0) ? 1u : 0u;
+        AddBloomPass(graph, kDownNames[levels], descs[levels], src, kInvalidFrameGraphTexture, mBloomDownCS, cb, linearClamp,
+            down[levels]);
+
+        src = down[levels];
+        srcW = lw;
+        srcH = lh;
+        srcUsedW = used[levels][0];
+        srcUsedH = used[levels][1];
+        ++levels;
+    }
 
-    if (FAILED(d->CreateTexture2D(&td, nullptr, &mBloomBTex)) || !mBloomBTex)
-        return;
-    if (FAILED(d->CreateRenderTargetView(mBloomBTex, nullptr, &mBloomBRTV)) || !mBloomBRTV)
-        return;
-    if (FAILED(d->CreateShaderResourceView(mBloomBTex, nullptr, &mBloomBSRV)) || !mBloomBSRV)
-        return;
+    // Each up level reads the one below and its own downsample; the smallest level is its own
+    // up level.
+    FrameGraphTexture up = down[levels - 1];
+    for (uint32_t i = levels - 1; i-- > 0;)
+    {
+        BloomCBData cb{};
+        cb.dstSize[0] = used[i][0];
+        cb.dstSize[1] = used[i][1];
+        cb.invDstTexSize[0] = 1.0f / (float)descs[i].width;
+        cb.invDstTexSize[1] = 1.0f / (float)descs[i].height;
+        fillSource(cb, descs[i + 1].width, descs[i + 1].height, used[i + 1][0], used[i + 1][1]);
+        cb.upsampleRadius = 1.0f;
+        FrameGraphTexture next = kInvalidFrameGraphTexture;
+        AddBloomPass(graph, kUpNames[i], descs[i], up, down[i], mBloomUpCS, cb, linearClamp, next);
+        up = next;
+    }
 
-    mBloomW = bw;
-    mBloomH = bh;
+    outLevels = levels;
+    return up;
 }
 
-void PostProcessD3D11::Execute(
-    ID3D11DeviceContext* ctx,
+void PostProcessD3D11::AddPasses(
+    FrameGraphD3D11& graph,
     RenderDeviceD3D11& device,
     king::ShaderCache& cache,
-    ID3D11ShaderResourceView* hdrSrv,
-    ID3D11ShaderResourceView* aoSrv,
+    ID3D11DeviceContext* ctx,
+    FrameGraphTexture hdr,
+    FrameGraphTexture ao,
+    FrameGraphTexture output,
     ID3D11Buffer* cameraCB,
     ID3D11SamplerState* linearClamp,
     const Settings& settings)
 {
-    if (!ctx || !hdrSrv)
+    if (!ctx || hdr == kInvalidFrameGraphTexture || output == kInvalidFrameGraphTexture || !mPostCB)
         return;
 
     std::string err;
@@ -251,173 +299,120 @@ void PostProcessD3D11::Execute(
     // This also prevents stale bloom intensity from sampling a null bloom SRV.
     const uint32_t w = device.BackBufferWidth();
     const uint32_t h = device.BackBufferHeight();
+    if (w == 0 || h == 0)
+        return;
     const uint32_t bw = (w > 1) ? (w / 2) : 1;
     const uint32_t bh = (h > 1) ? (h / 2) : 1;
-    if (mPostCB)
+    const bool bloom = settings.enableBloom && settings.bloomIntensity > 1e-4f;
+
+    // Used region of the scene targets (dynamic resolution); the composite upscales it.
+    const uint32_t rw = (settings.renderWidth > 0) ? std::min(settings.renderWidth, w) : w;
+    const uint32_t rh = (settings.renderHeight > 0) ? std::min(settings.renderHeight, h) : h;
+    const bool sharpen = (rw < w || rh < h) && settings.upscaleSharpness > 1e-3f;
+
+    // The pyramid sums its levels into level 0; normalize so both paths look alike.
+    const bool computeBloom = bloom && mBloomDownCS && mBloomUpCS && mBloomCB;
+    uint32_t bloomLevels = 1;
+    FrameGraphTexture bloomTex = kInvalidFrameGraphTexture;
+    if (computeBloom)
+        bloomTex = AddComputeBloom(graph, hdr, w, h, rw, rh, settings.bloomThreshold, linearClamp, bloomLevels);
+
+    D3D11_MAPPED_SUBRESOURCE mapped{};
+    if (SUCCEEDED(ctx->Map(mPostCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
     {
-        D3D11_MAPPED_SUBRESOURCE mapped{};
-        if (SUCCEEDED(ctx->Map(mPostCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
-        {
-            PostCBData cb{};
-            cb.vignetteStrength = settings.vignetteStrength;
-            cb.vignettePower = settings.vignettePower;
-            cb.bloomIntensity = (settings.enableBloom ? settings.bloomIntensity : 0.0f);
-            cb.bloomThreshold = settings.bloomThreshold;
-            cb.invBloomSize[0] = (bw > 0) ? (1.0f / (float)bw) : 0.0f;
-            cb.invBloomSize[1] = (bh > 0) ? (1.0f / (float)bh) : 0.0f;
-            cb.invPostSize[0] = (w > 0) ? (1.0f / (float)w) : 0.0f;
-            cb.invPostSize[1] = (h > 0) ? (1.0f / (float)h) : 0.0f;
-            std::memcpy(mapped.pData, &cb, sizeof(cb));
-            ctx->Unmap(mPostCB, 0);
-        }
+        PostCBData cb{};
+        cb.vignetteStrength = settings.vignetteStrength;
+        cb.vignettePower = settings.vignettePower;
+        cb.bloomIntensity = (settings.enableBloom ? settings.bloomIntensity / (float)bloomLevels : 0.0f);
+        cb.bloomThreshold = settings.bloomThreshold;
+        cb.invBloomSize[0] = 1.0f / (float)bw;
+        cb.invBloomSize[1] = 1.0f / (float)bh;
+        cb.invPostSize[0] = 1.0f / (float)w;
+        cb.invPostSize[1] = 1.0f / (float)h;
+        cb.renderUvScale[0] = (float)rw / (float)w;
+        cb.renderUvScale[1] = (float)rh / (float)h;
+        cb.upscaleSharpness = sharpen ? settings.upscaleSharpness : 0.0f;
+        std::memcpy(mapped.pData, &cb, sizeof(cb));
+        ctx->Unmap(mPostCB, 0);
+        mMapBytes += sizeof(cb);
     }
 
-    ID3D11ShaderResourceView* currentSrv = hdrSrv;
-
-    ID3D11ShaderResourceView* bloomSrv = nullptr;
-
-    // Bloom: extract + separable blur at half res.
-    if (settings.enableBloom && settings.bloomIntensity > 1e-4f)
+    // Fallback bloom: extract + separable blur at half res. The vertical blur's target has the
+    // extract's desc and starts after the extract's last read, so the graph gives it the same
+    // texture: three logical targets, two textures.
+    if (bloom && !computeBloom)
     {
-        EnsureBloomTargets(device);
-        if (mBloomARTV && mBloomASRV && mBloomBRTV && mBloomBSRV)
-        {
-            ID3D11PixelShader* psExtract = mFullscreen.GetOrCreatePS(device, cache, mShaderPath, "PSBloomExtractMain", {}, &err);
-            ID3D11PixelShader* psBlurH = mFullscreen.GetOrCreatePS(device, cache, mShaderPath, "PSBloomBlurHMain", {}, &err);
-            ID3D11PixelShader* psBlurV = mFullscreen.GetOrCreatePS(device, cache, mShaderPath, "PSBloomBlurVMain", {}, &err);
-
-            if (psExtract && psBlurH && psBlurV && mPostCB)
-            {
-                D3D11_VIEWPORT vp{};
-                vp.TopLeftX = 0;
-                vp.TopLeftY = 0;
-                vp.Width = (float)mBloomW;
-                vp.Height = (float)mBloomH;
-                vp.MinDepth = 0.0f;
-                vp.MaxDepth = 1.0f;
-
-                const float clear[4] = { 0, 0, 0, 0 };
-
-                // Extract (HDR -> bloomA)
-                ctx->ClearRenderTargetView(mBloomARTV, clear);
-                mFullscreen.Begin(ctx, mBloomARTV, vp);
-                ctx->PSSetShader(psExtract, nullptr, 0);
-                ctx->PSSetConstantBuffers(6, 1, &mPostCB);
-                ctx->PSSetShaderResources(1, 1, &currentSrv);
-                if (linearClamp)
-                    ctx->PSSetSamplers(1, 1, &linearClamp);
-                mFullscreen.Draw(ctx);
-                {
-                    ID3D11ShaderResourceView* nullSrv[1] = { nullptr };
-                    ctx->PSSetShaderResources(1, 1, nullSrv);
-                }
-
-                // Blur H (A -> B)
-                ctx->ClearRenderTargetView(mBloomBRTV, clear);
-                mFullscreen.Begin(ctx, mBloomBRTV, vp);
-                ctx->PSSetShader(psBlurH, nullptr, 0);
-                ctx->PSSetConstantBuffers(6, 1, &mPostCB);
-                ctx->PSSetShaderResources(1, 1, &mBloomASRV);
-                if (linearClamp)
-                    ctx->PSSetSamplers(1, 1, &linearClamp);
-                mFullscreen.Draw(ctx);
-                {
-                    ID3D11ShaderResourceView* nullSrv[1] = { nullptr };
-                    ctx->PSSetShaderResources(1, 1, nullSrv);
-                }
-
-                // Blur V (B -> A)
-                ctx->ClearRenderTargetView(mBloomARTV, clear);
-                mFullscreen.Begin(ctx, mBloomARTV, vp);
-                ctx->PSSetShader(psBlurV, nullptr, 0);
-                ctx->PSSetConstantBuffers(6, 1, &mPostCB);
-                ctx->PSSetShaderResources(1, 1, &mBloomBSRV);
-                if (linearClamp)
-                    ctx->PSSetSamplers(1, 1, &linearClamp);
-                mFullscreen.Draw(ctx);
-                {
-                    ID3D11ShaderResourceView* nullSrv[1] = { nullptr };
-                    ctx->PSSetShaderResources(1, 1, nullSrv);
-                }
-
-                bloomSrv = mBloomASRV;
-            }
-        }
-    }
+        ID3D11PixelShader* psExtract = mFullscreen.GetOrCreatePS(device, cache, mShaderPath, "PSBloomExtractMain", {}, &err);
+        ID3D11PixelShader* psBlurH = mFullscreen.GetOrCreatePS(device, cache, mShaderPath, "PSBloomBlurHMain", {}, &err);
+        ID3D11PixelShader* psBlurV = mFullscreen.GetOrCreatePS(device, cache, mShaderPath, "PSBloomBlurVMain", {}, &err);
 
-    // Optional vignette in HDR space (writes into an intermediate HDR RT).
-    if (settings.enableVignette)
-    {
-        EnsureIntermediate(device);
-        if (mPingRTV && mPingSRV && mPostCB)
+        if (psExtract && psBlurH && psBlurV)
         {
-            ID3D11PixelShader* ps = mFullscreen.GetOrCreatePS(device, cache, mShaderPath, "PSVignetteMain", {}, &err);
-            if (ps)
-            {
-                const float clear[4] = { 0, 0, 0, 0 };
-                ctx->ClearRenderTargetView(mPingRTV, clear);
-
-                const D3D11_VIEWPORT vp = device.Viewport();
-                mFullscreen.Begin(ctx, mPingRTV, vp);
-                ctx->PSSetShader(ps, nullptr, 0);
-
-                ctx->PSSetConstantBuffers(6, 1, &mPostCB);
-                ctx->PSSetShaderResources(1, 1, &currentSrv);
-                if (linearClamp)
-                    ctx->PSSetSamplers(1, 1, &linearClamp);
-
-                mFullscreen.Draw(ctx);
-
-                ID3D11ShaderResourceView* nullSrv[1] = { nullptr };
-                ctx->PSSetShaderResources(1, 1, nullSrv);
-
-                currentSrv = mPingSRV;
-            }
+            const FrameGraphTextureDesc half{ bw, bh, DXGI_FORMAT_R16G16B16A16_FLOAT };
+            const uint32_t vw = std::max(1u, rw / 2);
+            const uint32_t vh = std::max(1u, rh / 2);
+            FrameGraphTexture extracted = kInvalidFrameGraphTexture;
+            FrameGraphTexture blurredH = kInvalidFrameGraphTexture;
+            AddFullscreenPass(graph, "BloomExtract", "BloomExtracted", half, vw, vh, hdr, psExtract, linearClamp, extracted);
+            AddFullscreenPass(graph, "BloomBlurH", "BloomBlurH", half, vw, vh, extracted, psBlurH, linearClamp, blurredH);
+            AddFullscreenPass(graph, "BloomBlurV", "Bloom", half, vw, vh, blurredH, psBlurV, linearClamp, bloomTex);
         }
     }
 
-    // Final: tonemap to backbuffer.
-    ID3D11RenderTargetView* outRtv = device.RTV();
-    if (!outRtv)
-        return;
-
-    ID3D11PixelShader* psTonemap = mFullscreen.GetOrCreatePS(device, cache, mShaderPath, "PSTonemapMain", {}, &err);
+    // Final: one composite pass to the output (back buffer), specialized on what is enabled.
+    const bool useBloom = bloomTex != kInvalidFrameGraphTexture;
+    const std::vector<king::ShaderDefine> defines =
+        CompositeDefines(useBloom, settings.ambientOcclusion, settings.enableVignette, sharpen);
+    ID3D11PixelShader* psTonemap = mFullscreen.GetOrCreatePS(device, cache, mShaderPath, "PSTonemapMain", defines, &err);
     if (!psTonemap)
         return;
 
-    const D3D11_VIEWPORT vp = device.Viewport();
-    mFullscreen.Begin(ctx, outRtv, vp);
-
-    ctx->PSSetShader(psTonemap, nullptr, 0);
+    struct TonemapData
+    {
+        FrameGraphTexture color = kInvalidFrameGraphTexture;
+        FrameGraphTexture ao = kInvalidFrameGraphTexture;
+        FrameGraphTexture bloom = kInvalidFrameGraphTexture;
+        FrameGraphTexture output = kInvalidFrameGraphTexture;
+    };
 
-    if (cameraCB)
-        ctx->PSSetConstantBuffers(0, 1, &cameraCB);
+    const D3D11_VIEWPORT vp = device.Viewport();
+    graph.AddPass<TonemapData>("Tonemap", kPostScope,
+        [&](FrameGraphD3D11::Builder& b, TonemapData& data)
+        {
+            data.color = hdr;
+            data.ao = settings.ambientOcclusion ? ao : kInvalidFrameGraphTexture;
+            data.bloom = bloomTex;
+            data.output = output;
+            b.Read(hdr);
+            b.Read(data.ao);
+            b.Read(bloomTex);
+            b.Write(output);
+        },
+        [this, vp, psTonemap, cameraCB, linearClamp](const FrameGraphD3D11& g, StateCacheD3D11& sc, const TonemapData& data)
+        {
+            ID3D11RenderTargetView* outRtv = g.RTV(data.output);
+            ID3D11ShaderResourceView* colorSrv = g.SRV(data.color);
+            if (!outRtv || !colorSrv)
+                return;
 
-    ctx->PSSetShaderResources(1, 1, &currentSrv);
-    if (aoSrv)
-        ctx->PSSetShaderResources(2, 1, &aoSrv);
+            mFullscreen.Begin(sc, outRtv, vp, psTonemap);
 
-    if (bloomSrv)
-        ctx->PSSetShaderResources(3, 1, &bloomSrv);
-    else
-    {
-        ID3D11ShaderResourceView* nullSrv[1] = { nullptr };
-        ctx->PSSetShaderResources(3, 1, nullSrv);
-    }
+            if (cameraCB)
+                sc.SetPSConstantBuffer(0, cameraCB);
 
-    if (mPostCB)
-        ctx->PSSetConstantBuffers(6, 1, &mPostCB);
+            ID3D11ShaderResourceView* srvs[3] = { colorSrv, g.SRV(data.ao), g.SRV(data.bloom) };
+            sc.SetPSShaderResources(1, 3, srvs);
+            sc.SetPSConstantBuffer(6, mPostCB);
 
-    if (linearClamp)
-        ctx->PSSetSamplers(1, 1, &linearClamp);
+            if (linearClamp)
+                sc.SetPSSampler(1, linearClamp);
 
-    mFullscreen.Draw(ctx);
+            mFullscreen.Draw(sc);
 
-    // Unbind SRVs so HDR targets can be rebound as RTVs next frame.
-    ID3D11ShaderResourceView* nullSrv[1] = { nullptr };
-    ctx->PSSetShaderResources(1, 1, nullSrv);
-    ctx->PSSetShaderResources(2, 1, nullSrv);
-    ctx->PSSetShaderResources(3, 1, nullSrv);
+            // Unbind SRVs so HDR targets can be rebound as RTVs next frame.
+            ID3D11ShaderResourceView* nullSrvs[3] = { nullptr, nullptr, nullptr };
+            sc.SetPSShaderResources(1, 3, nullSrvs);
+        });
 }
 
 } // namespace king::render::d3d11
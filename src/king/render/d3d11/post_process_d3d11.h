@@ -1,11 +1,13 @@
 #pragma once
 
+#include "frame_graph_d3d11.h"
 #include "fullscreen_pass_d3d11.h"
 
 #include <d3d11.h>
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace king
 {
@@ -27,8 +29,26 @@ public:
         bool enableBloom = false;
         float bloomIntensity = 0.65f;
         float bloomThreshold = 1.10f;
+
+        // ao is real SSAO output (not the white fallback): the composite multiplies it in.
+        bool ambientOcclusion = false;
+
+        // Dynamic resolution: the scene covers the top-left renderWidth x renderHeight of the
+        // back-buffer-sized hdr/ao (0 = all of it). The composite upscales it to the output and
+        // sharpens by upscaleSharpness (0 = off) while it is smaller.
+        uint32_t renderWidth = 0;
+        uint32_t renderHeight = 0;
+        float upscaleSharpness = 0.0f;
     };
 
+    // Bloom pyramid depth: level 0 is half resolution, levels stop early at kBloomMinSize.
+    static constexpr uint32_t kBloomMaxLevels = 6;
+    static constexpr uint32_t kBloomMinSize = 8;
+
+    // Defines of the PSTonemapMain permutation for a set of enabled effects (shader prewarm
+    // builds all of them).
+    static std::vector<king::ShaderDefine> CompositeDefines(bool bloom, bool ambientOcclusion, bool vignette, bool sharpen);
+
     PostProcessD3D11() = default;
     ~PostProcessD3D11();
 
@@ -38,21 +58,29 @@ public:
     bool Initialize(RenderDeviceD3D11& device, king::ShaderCache& cache, const std::wstring& shaderPath);
     void Shutdown();
 
-    // Runs post chain (currently optional vignette in HDR) and then tonemaps to the backbuffer.
-    // - hdrSrv must be bound to t1 for the fullscreen shaders.
-    // - aoSrv must be bound to t2 for tonemap (can be a 1x1 white fallback).
-    void Execute(
-        ID3D11DeviceContext* ctx,
+    // Adds the post chain to `output` as passes of `graph`: the optional bloom pyramid, then
+    // one composite pass (bloom, AO, vignette and tonemap fused, see PSTonemapMain). hdr is
+    // read at t1, ao at t2 (a 1x1 white fallback when SSAO is off); the bloom levels are graph
+    // transients. Bloom runs in compute (bloom_cs.hlsl) and falls back to the pixel-shader
+    // extract + blur when the compute shaders are unavailable. ctx receives the PostCB update
+    // now; the passes record when the graph executes.
+    void AddPasses(
+        FrameGraphD3D11& graph,
         RenderDeviceD3D11& device,
         king::ShaderCache& cache,
-        ID3D11ShaderResourceView* hdrSrv,
-        ID3D11ShaderResourceView* aoSrv,
+        ID3D11DeviceContext* ctx,
+        FrameGraphTexture hdr,
+        FrameGraphTexture ao,
+        FrameGraphTexture output,
         ID3D11Buffer* cameraCB,
         ID3D11SamplerState* linearClamp,
         const Settings& settings);
 
     FullscreenPassCacheD3D11& Fullscreen() { return mFullscreen; }
 
+    // Running total of bytes written through Map (post and bloom constants).
+    uint64_t MapBytes() const { return mMapBytes; }
+
 private:
     struct PostCBData
     {
@@ -63,13 +91,62 @@ private:
 
         float invBloomSize[2];
         float invPostSize[2];
-        float _pad[4];
+
+        float renderUvScale[2];
+        float upscaleSharpness;
+        float _pad;
     };
 
     static_assert(sizeof(PostCBData) % 16 == 0, "PostCBData must be 16-byte aligned");
 
-    void EnsureIntermediate(RenderDeviceD3D11& device);
-    void EnsureBloomTargets(RenderDeviceD3D11& device);
+    // One full-screen draw from src (t1) into dst.
+    struct FullscreenPassData
+    {
+        FrameGraphTexture src = kInvalidFrameGraphTexture;
+        FrameGraphTexture dst = kInvalidFrameGraphTexture;
+        ID3D11PixelShader* ps = nullptr;
+        D3D11_VIEWPORT vp{};
+    };
+
+    // vpWidth x vpHeight: the used region of dst (dynamic resolution).
+    void AddFullscreenPass(FrameGraphD3D11& graph, const char* name, const char* dstName, const FrameGraphTextureDesc& dstDesc,
+        uint32_t vpWidth, uint32_t vpHeight, FrameGraphTexture src, ID3D11PixelShader* ps, ID3D11SamplerState* linearClamp,
+        FrameGraphTexture& outDst);
+
+    // Layout of BloomCB in bloom_cs.hlsl; one upload per dispatch.
+    struct BloomCBData
+    {
+        uint32_t dstSize[2];
+        float invSrcSize[2];
+        float threshold;
+        uint32_t prefilter;
+        float upsampleRadius;
+        float _pad;
+
+        float invDstTexSize[2];
+        float srcUvMax[2];
+    };
+
+    static_assert(sizeof(BloomCBData) % 16 == 0, "BloomCBData must be 16-byte aligned");
+
+    // One bloom dispatch: src (t0) [+ level (t1)] into dst (u0).
+    struct BloomPassData
+    {
+        FrameGraphTexture src = kInvalidFrameGraphTexture;
+        FrameGraphTexture level = kInvalidFrameGraphTexture;
+        FrameGraphTexture dst = kInvalidFrameGraphTexture;
+        ID3D11ComputeShader* cs = nullptr;
+        BloomCBData cb{};
+    };
+
+    // Downsample chain from hdr (width x height, of which usedWidth x usedHeight hold the
+    // scene), then upsample back to level 0; returns level 0 of the up chain and the number of
+    // levels summed into it.
+    FrameGraphTexture AddComputeBloom(FrameGraphD3D11& graph, FrameGraphTexture hdr, uint32_t width, uint32_t height,
+        uint32_t usedWidth, uint32_t usedHeight, float threshold, ID3D11SamplerState* linearClamp, uint32_t& outLevels);
+    void AddBloomPass(FrameGraphD3D11& graph, const char* name, const FrameGraphTextureDesc& dstDesc, FrameGraphTexture src,
+        FrameGraphTexture level, ID3D11ComputeShader* cs, const BloomCBData& cb, ID3D11SamplerState* linearClamp,
+        FrameGraphTexture& outDst);
 
 private:
     std::wstring mShaderPath;
@@ -78,23 +155,11 @@ private:
 
     ID3D11Buffer* mPostCB = nullptr;
 
-    ID3D11Texture2D* mPingTex = nullptr;
-    ID3D11RenderTargetView* mPingRTV = nullptr;
-    ID3D11ShaderResourceView* mPingSRV = nullptr;
-
-    ID3D11Texture2D* mBloomATex = nullptr;
-    ID3D11RenderTargetView* mBloomARTV = nullptr;
-    ID3D11ShaderResourceView* mBloomASRV = nullptr;
-
-    ID3D11Texture2D* mBloomBTex = nullptr;
-    ID3D11RenderTargetView* mBloomBRTV = nullptr;
-    ID3D11ShaderResourceView* mBloomBSRV = nullptr;
-
-    uint32_t mBloomW = 0;
-    uint32_t mBloomH = 0;
+    ID3D11ComputeShader* mBloomDownCS = nullptr;
+    ID3D11ComputeShader* mBloomUpCS = nullptr;
+    ID3D11Buffer* mBloomCB = nullptr;
 
-    uint32_t mW = 0;
-    uint32_t mH = 0;
+    uint64_t mMapBytes = 0;
 };
 
 } // namespace king::render::d3d11
@@ -1,8 +1,13 @@
 #include "render_device_d3d11.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <cwchar>
 #include <d3d11_1.h>
+#include <dxgi1_5.h>
+#include <iterator>
 #include <string>
+#include <thread>
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -25,30 +30,13 @@ static bool EnvFlagW(const wchar_t* name)
 #endif
 }
 
-static HRESULT TryCreateDeviceAndSwapChain(
-    HWND hwnd,
-    uint32_t width,
-    uint32_t height,
+static HRESULT TryCreateDevice(
     D3D_DRIVER_TYPE driverType,
     UINT createFlags,
-    IDXGISwapChain** outSwapChain,
     ID3D11Device** outDevice,
     ID3D11DeviceContext** outContext,
     D3D_FEATURE_LEVEL* outFeatureLevel)
 {
-    DXGI_SWAP_CHAIN_DESC scd{};
-    scd.BufferCount = 2;
-    scd.BufferDesc.Width = width;
-    scd.BufferDesc.Height = height;
-    scd.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-    scd.BufferDesc.RefreshRate.Numerator = 60;
-    scd.BufferDesc.RefreshRate.Denominator = 1;
-    scd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-    scd.OutputWindow = hwnd;
-    scd.SampleDesc.Count = 1;
-    scd.Windowed = TRUE;
-    scd.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
-
     D3D_FEATURE_LEVEL featureLevels[] = {
         D3D_FEATURE_LEVEL_11_1,
         D3D_FEATURE_LEVEL_11_0,
@@ -56,7 +44,7 @@ static HRESULT TryCreateDeviceAndSwapChain(
         D3D_FEATURE_LEVEL_10_0,
     };
 
-    return D3D11CreateDeviceAndSwapChain(
+    return D3D11CreateDevice(
         nullptr,
         driverType,
         nullptr,
@@ -64,13 +52,65 @@ static HRESULT TryCreateDeviceAndSwapChain(
         featureLevels,
         (UINT)(sizeof(featureLevels) / sizeof(featureLevels[0])),
         D3D11_SDK_VERSION,
-        &scd,
-        outSwapChain,
         outDevice,
         outFeatureLevel,
         outContext);
 }
 
+// Creates the device, retrying without the debug layer (Debug builds) and then on WARP.
+static HRESULT CreateDeviceWithFallbacks(
+    UINT createFlags,
+    ID3D11Device** outDevice,
+    ID3D11DeviceContext** outContext,
+    D3D_FEATURE_LEVEL* outFeatureLevel)
+{
+    HRESULT hr = TryCreateDevice(D3D_DRIVER_TYPE_HARDWARE, createFlags, outDevice, outContext, outFeatureLevel);
+
+    if (FAILED(hr) && (createFlags & D3D11_CREATE_DEVICE_DEBUG))
+    {
+        std::printf("Retrying without D3D11 debug layer...\n");
+        hr = TryCreateDevice(D3D_DRIVER_TYPE_HARDWARE, createFlags & ~D3D11_CREATE_DEVICE_DEBUG, outDevice, outContext, outFeatureLevel);
+    }
+
+    if (FAILED(hr))
+    {
+        std::printf("Retrying with WARP software device...\n");
+        hr = TryCreateDevice(D3D_DRIVER_TYPE_WARP, 0, outDevice, outContext, outFeatureLevel);
+    }
+
+    return hr;
+}
+
+// The factory that created the device's adapter (swapchains must come from it).
+static IDXGIFactory2* GetDeviceFactory(ID3D11Device* device)
+{
+    IDXGIDevice* dxgiDevice = nullptr;
+    IDXGIAdapter* adapter = nullptr;
+    IDXGIFactory2* factory = nullptr;
+    if (SUCCEEDED(device->QueryInterface(__uuidof(IDXGIDevice), (void**)&dxgiDevice)) && dxgiDevice)
+    {
+        if (SUCCEEDED(dxgiDevice->GetAdapter(&adapter)) && adapter)
+        {
+            (void)adapter->GetParent(__uuidof(IDXGIFactory2), (void**)&factory);
+            adapter->Release();
+        }
+        dxgiDevice->Release();
+    }
+    return factory;
+}
+
+static bool QueryTearingSupport(IDXGIFactory2* factory)
+{
+    IDXGIFactory5* factory5 = nullptr;
+    if (FAILED(factory->QueryInterface(__uuidof(IDXGIFactory5), (void**)&factory5)) || !factory5)
+        return false;
+
+    BOOL allow = FALSE;
+    const bool ok = SUCCEEDED(factory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allow, sizeof(allow)));
+    factory5->Release();
+    return ok && allow;
+}
+
 RenderDeviceD3D11::~RenderDeviceD3D11()
 {
     Shutdown();
@@ -109,10 +149,29 @@ void RenderDeviceD3D11::Shutdown()
     SafeRelease(tmp);
     mRS = nullptr;
 
+    if (mFrameLatencyWaitable)
+    {
+        CloseHandle(mFrameLatencyWaitable);
+        mFrameLatencyWaitable = nullptr;
+    }
+    mFrameWaited = false;
+    mFlipModel = false;
+    mTearingSupported = false;
+    mSwapChainFlags = 0;
+
     tmp = (IUnknown*)mSwapChain;
     SafeRelease(tmp);
     mSwapChain = nullptr;
 
+    for (ID3D11Query*& q : mOffscreenFences)
+    {
+        tmp = (IUnknown*)q;
+        SafeRelease(tmp);
+        q = nullptr;
+    }
+    mOffscreen = false;
+    mOffscreenFrame = 0;
+
     if (mContext)
     {
         mContext->ClearState();
@@ -141,7 +200,25 @@ HRESULT RenderDeviceD3D11::CreateRenderTarget()
     mRTV = nullptr;
 
     ID3D11Texture2D* backBuffer = nullptr;
-    HRESULT hr = mSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (void**)&backBuffer);
+    HRESULT hr = S_OK;
+    if (mSwapChain)
+    {
+        hr = mSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (void**)&backBuffer);
+    }
+    else
+    {
+        // Offscreen: same format and usage as the swapchain buffer would have.
+        D3D11_TEXTURE2D_DESC td{};
+        td.Width = mBackBufferW;
+        td.Height = mBackBufferH;
+        td.MipLevels = 1;
+        td.ArraySize = 1;
+        td.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        td.SampleDesc.Count = 1;
+        td.Usage = D3D11_USAGE_DEFAULT;
+        td.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+        hr = mDevice->CreateTexture2D(&td, nullptr, &backBuffer);
+    }
     if (FAILED(hr))
         return hr;
 
@@ -191,7 +268,7 @@ HRESULT RenderDeviceD3D11::CreateDepthTarget(uint32_t width, uint32_t height)
 
 HRESULT RenderDeviceD3D11::ResizeInternal(uint32_t width, uint32_t height)
 {
-    if (!mSwapChain)
+    if (!mSwapChain && !mOffscreen)
         return S_OK;
 
     mBackBufferW = width;
@@ -209,7 +286,8 @@ HRESULT RenderDeviceD3D11::ResizeInternal(uint32_t width, uint32_t height)
     SafeRelease(tmp);
     mDSV = nullptr;
 
-    HRESULT hr = mSwapChain->ResizeBuffers(0, width, height, DXGI_FORMAT_UNKNOWN, 0);
+    // The flags must match creation (the waitable and tearing cannot be toggled by a resize).
+    HRESULT hr = mSwapChain ? mSwapChain->ResizeBuffers(0, width, height, DXGI_FORMAT_UNKNOWN, mSwapChainFlags) : S_OK;
     if (FAILED(hr))
         return hr;
 
@@ -280,52 +358,134 @@ HRESULT RenderDeviceD3D11::Initialize(HWND hwnd, uint32_t width, uint32_t height
     std::printf("InitD3D: debug layer %s\n", (createFlags & D3D11_CREATE_DEVICE_DEBUG) ? "ON" : "OFF");
 
     D3D_FEATURE_LEVEL fl{};
-    HRESULT hr = TryCreateDeviceAndSwapChain(
-        hwnd,
-        width,
-        height,
-        D3D_DRIVER_TYPE_HARDWARE,
-        createFlags,
-        &mSwapChain,
-        &mDevice,
-        &mContext,
-        &fl);
+    HRESULT hr = CreateDeviceWithFallbacks(createFlags, &mDevice, &mContext, &fl);
+    if (FAILED(hr))
+        return hr;
 
-#if defined(_DEBUG)
-    if (FAILED(hr) && (createFlags & D3D11_CREATE_DEVICE_DEBUG))
+    hr = CreateSwapChain(hwnd, width, height);
+    if (FAILED(hr))
+        return hr;
+
+    return FinishInitialize(width, height, fl);
+}
+
+HRESULT RenderDeviceD3D11::CreateSwapChain(HWND hwnd, uint32_t width, uint32_t height)
+{
+    IDXGIFactory2* factory = GetDeviceFactory(mDevice);
+    if (!factory)
+        return E_NOINTERFACE;
+
+    HRESULT hr = E_FAIL;
+    if (!EnvFlagW(L"KING_LEGACY_SWAPCHAIN"))
     {
-        std::printf("Retrying without D3D11 debug layer...\n");
-        hr = TryCreateDeviceAndSwapChain(
-            hwnd,
-            width,
-            height,
-            D3D_DRIVER_TYPE_HARDWARE,
-            createFlags & ~D3D11_CREATE_DEVICE_DEBUG,
-            &mSwapChain,
-            &mDevice,
-            &mContext,
-            &fl);
+        // Flip model: the compositor takes the buffer without a copy, Present never blocks on
+        // a full queue (WaitForNextFrame paces the loop instead) and vsync off can tear.
+        mTearingSupported = QueryTearingSupport(factory);
+        mSwapChainFlags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+        if (mTearingSupported)
+            mSwapChainFlags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+
+        // Flip buffers cannot be sRGB; the _SRGB view on the UNORM buffer still is.
+        DXGI_SWAP_CHAIN_DESC1 scd{};
+        scd.Width = width;
+        scd.Height = height;
+        scd.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        scd.SampleDesc.Count = 1;
+        scd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+        scd.BufferCount = kFlipBufferCount;
+        scd.Scaling = DXGI_SCALING_STRETCH;
+        scd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+        scd.AlphaMode = DXGI_ALPHA_MODE_IGNORE;
+        scd.Flags = mSwapChainFlags;
+
+        IDXGISwapChain1* swapChain1 = nullptr;
+        hr = factory->CreateSwapChainForHwnd(mDevice, hwnd, &scd, nullptr, nullptr, &swapChain1);
+        if (SUCCEEDED(hr) && swapChain1)
+        {
+            mSwapChain = swapChain1;
+            mFlipModel = true;
+
+            IDXGISwapChain2* swapChain2 = nullptr;
+            if (SUCCEEDED(swapChain1->QueryInterface(__uuidof(IDXGISwapChain2), (void**)&swapChain2)) && swapChain2)
+            {
+                (void)swapChain2->SetMaximumFrameLatency(mMaxFrameLatency);
+                mFrameLatencyWaitable = swapChain2->GetFrameLatencyWaitableObject();
+                swapChain2->Release();
+            }
+        }
+        else
+        {
+            std::printf("InitD3D: flip-model swapchain failed (0x%08X), using the legacy one\n", (unsigned)hr);
+            mTearingSupported = false;
+            mSwapChainFlags = 0;
+        }
     }
-#endif
 
-    if (FAILED(hr))
+    if (!mSwapChain)
     {
-        std::printf("Retrying with WARP software device...\n");
-        hr = TryCreateDeviceAndSwapChain(
-            hwnd,
-            width,
-            height,
-            D3D_DRIVER_TYPE_WARP,
-            0,
-            &mSwapChain,
-            &mDevice,
-            &mContext,
-            &fl);
+        DXGI_SWAP_CHAIN_DESC scd{};
+        scd.BufferCount = 2;
+        scd.BufferDesc.Width = width;
+        scd.BufferDesc.Height = height;
+        scd.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        scd.BufferDesc.RefreshRate.Numerator = 60;
+        scd.BufferDesc.RefreshRate.Denominator = 1;
+        scd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+        scd.OutputWindow = hwnd;
+        scd.SampleDesc.Count = 1;
+        scd.Windowed = TRUE;
+        scd.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
+
+        hr = factory->CreateSwapChain(mDevice, &scd, &mSwapChain);
     }
 
+    if (SUCCEEDED(hr))
+    {
+        // Borderless/windowed only: exclusive fullscreen would disable tearing and the waitable.
+        (void)factory->MakeWindowAssociation(hwnd, DXGI_MWA_NO_ALT_ENTER);
+        std::printf("InitD3D: swapchain %s, %u buffers, tearing %s, max frame latency %u%s\n",
+            mFlipModel ? "FLIP_DISCARD" : "DISCARD",
+            mFlipModel ? kFlipBufferCount : 2u,
+            mTearingSupported ? "ON" : "OFF",
+            mMaxFrameLatency,
+            mFrameLatencyWaitable ? " (waitable)" : "");
+    }
+
+    factory->Release();
+    return hr;
+}
+
+HRESULT RenderDeviceD3D11::InitializeOffscreen(uint32_t width, uint32_t height)
+{
+    Shutdown();
+
+    UINT createFlags = 0;
+    if (EnvFlagW(L"KING_D3D11_DEBUG_LAYER"))
+        createFlags |= D3D11_CREATE_DEVICE_DEBUG;
+
+    std::printf("InitD3D: creating offscreen device (%ux%u)\n", width, height);
+    std::printf("InitD3D: debug layer %s\n", (createFlags & D3D11_CREATE_DEVICE_DEBUG) ? "ON" : "OFF");
+
+    D3D_FEATURE_LEVEL fl{};
+    HRESULT hr = CreateDeviceWithFallbacks(createFlags, &mDevice, &mContext, &fl);
     if (FAILED(hr))
         return hr;
 
+    mOffscreen = true;
+    for (ID3D11Query*& q : mOffscreenFences)
+    {
+        D3D11_QUERY_DESC qd{};
+        qd.Query = D3D11_QUERY_EVENT;
+        hr = mDevice->CreateQuery(&qd, &q);
+        if (FAILED(hr))
+            return hr;
+    }
+
+    return FinishInitialize(width, height, fl);
+}
+
+HRESULT RenderDeviceD3D11::FinishInitialize(uint32_t width, uint32_t height, D3D_FEATURE_LEVEL fl)
+{
     std::printf("D3D device created. Feature level: 0x%X\n", (unsigned)fl);
 
     // Try to acquire annotation interface for GPU markers.
@@ -338,7 +498,7 @@ HRESULT RenderDeviceD3D11::Initialize(HWND hwnd, uint32_t width, uint32_t height
         }
     }
 
-    hr = ResizeInternal(width, height);
+    HRESULT hr = ResizeInternal(width, height);
     if (FAILED(hr))
         return hr;
 
@@ -357,7 +517,13 @@ void RenderDeviceD3D11::BeginGpuEvent(std::wstring_view name)
     if (!mAnnotation)
         return;
     auto* ann = (ID3DUserDefinedAnnotation*)mAnnotation;
-    ann->BeginEvent(std::wstring(name).c_str());
+    // BeginEvent wants a terminated string; copy into a stack buffer (truncating long names)
+    // instead of allocating a wstring per event.
+    wchar_t buf[128];
+    const size_t n = std::min(name.size(), std::size(buf) - 1);
+    std::wmemcpy(buf, name.data(), n);
+    buf[n] = L'\0';
+    ann->BeginEvent(buf);
 }
 
 void RenderDeviceD3D11::EndGpuEvent()
@@ -417,10 +583,68 @@ void RenderDeviceD3D11::BeginFrame(const float clearColor[4])
 
 HRESULT RenderDeviceD3D11::Present(uint32_t syncInterval)
 {
+    if (mOffscreen)
+    {
+        // Wait for the frame kOffscreenLatency back, then fence this one.
+        ID3D11Query* fence = mOffscreenFences[mOffscreenFrame % kOffscreenLatency];
+        if (mOffscreenFrame >= kOffscreenLatency)
+        {
+            BOOL done = FALSE;
+            while (mContext->GetData(fence, &done, sizeof(done), 0) == S_FALSE)
+                std::this_thread::yield();
+        }
+        mContext->End(fence);
+        mContext->Flush();
+        ++mOffscreenFrame;
+        return mDevice->GetDeviceRemovedReason();
+    }
+
     if (!mSwapChain)
         return E_FAIL;
 
-    return mSwapChain->Present(syncInterval, 0);
+    // Tearing needs the flag at creation and is only valid with sync interval 0.
+    const UINT presentFlags = (syncInterval == 0 && mTearingSupported) ? DXGI_PRESENT_ALLOW_TEARING : 0;
+    mFrameWaited = false;
+    return mSwapChain->Present(syncInterval, presentFlags);
+}
+
+bool RenderDeviceD3D11::WaitForNextFrame(uint32_t timeoutMs)
+{
+    if (!mFrameLatencyWaitable || mFrameWaited)
+        return true;
+
+    // Once per present even on timeout, so a stalled compositor costs one timeout, not one per loop.
+    mFrameWaited = true;
+    return WaitForSingleObjectEx(mFrameLatencyWaitable, timeoutMs, TRUE) == WAIT_OBJECT_0;
+}
+
+void RenderDeviceD3D11::SetMaxFrameLatency(uint32_t frames)
+{
+    mMaxFrameLatency = (frames < 1u) ? 1u : (frames > 16u) ? 16u : frames;
+}
+
+uint32_t RenderDeviceD3D11::LastPresentCount() const
+{
+    UINT count = 0;
+    if (!mSwapChain || FAILED(mSwapChain->GetLastPresentCount(&count)))
+        return 0;
+    return count;
+}
+
+bool RenderDeviceD3D11::TryGetDisplayedPresent(uint32_t* outPresentCount, int64_t* outSyncQpc) const
+{
+    if (!mSwapChain)
+        return false;
+
+    DXGI_FRAME_STATISTICS fs{};
+    if (FAILED(mSwapChain->GetFrameStatistics(&fs)) || fs.PresentCount == 0)
+        return false;
+
+    if (outPresentCount)
+        *outPresentCount = fs.PresentCount;
+    if (outSyncQpc)
+        *outSyncQpc = (int64_t)fs.SyncQPCTime.QuadPart;
+    return true;
 }
 
 bool RenderDeviceD3D11::IsDeviceLost(HRESULT hr) const
@@ -438,6 +662,9 @@ bool RenderDeviceD3D11::RecoverFromDeviceLost(HWND hwnd)
     uint32_t w = mBackBufferW;
     uint32_t h = mBackBufferH;
 
+    if (mOffscreen)
+        return SUCCEEDED(InitializeOffscreen(w, h));
+
     if (w == 0 || h == 0)
     {
         RECT r{};
@@ -18,11 +18,16 @@ public:
     RenderDeviceD3D11& operator=(const RenderDeviceD3D11&) = delete;
 
     HRESULT Initialize(HWND hwnd, uint32_t width, uint32_t height);
+    // No window or swapchain: the back buffer is an offscreen texture and Present() only
+    // submits, holding the CPU at most kOffscreenLatency frames ahead (as a swapchain would).
+    // For headless runs (KingBench).
+    HRESULT InitializeOffscreen(uint32_t width, uint32_t height);
     void Shutdown();
 
     ID3D11Device* Device() const { return mDevice; }
     ID3D11DeviceContext* Context() const { return mContext; }
     IDXGISwapChain* SwapChain() const { return mSwapChain; }
+    bool Offscreen() const { return mOffscreen; }
 
     ID3D11RenderTargetView* RTV() const { return mRTV; }
     ID3D11DepthStencilView* DSV() const { return mDSV; }
@@ -43,31 +48,65 @@ public:
     void BeginGpuEvent(std::wstring_view name);
     void EndGpuEvent();
 
-    // Presents. Returns the HRESULT from Present.
+    // Blocks until the swapchain can take another frame (flip model with a frame latency
+    // waitable; no-op otherwise). Call at the top of the frame, before input is sampled, so
+    // the CPU starts as late as possible instead of stalling inside Present. Waits at most
+    // once per presented frame. Returns false on timeout.
+    bool WaitForNextFrame(uint32_t timeoutMs = 1000);
+
+    // Presents. Returns the HRESULT from Present. syncInterval 0 tears when supported.
     HRESULT Present(uint32_t syncInterval = 1);
 
+    // Frames the CPU may queue ahead of the display (1..16). Takes effect on the next
+    // Initialize (the swapchain is configured at creation).
+    void SetMaxFrameLatency(uint32_t frames);
+    uint32_t MaxFrameLatency() const { return mMaxFrameLatency; }
+    bool FlipModel() const { return mFlipModel; }
+    bool TearingSupported() const { return mTearingSupported; }
+
+    // Present count of the last Present call, and of the last present that reached the
+    // screen with its vblank time in QueryPerformanceCounter ticks. False when the swapchain
+    // has no statistics yet (or offscreen).
+    uint32_t LastPresentCount() const;
+    bool TryGetDisplayedPresent(uint32_t* outPresentCount, int64_t* outSyncQpc) const;
+
     bool IsDeviceLost(HRESULT hr) const;
     HRESULT GetDeviceRemovedReason() const;
 
-    // Attempts to recover from device lost by recreating the device/swapchain.
+    // Attempts to recover from device lost by recreating the device/swapchain (or the
+    // offscreen target; hwnd is unused then).
     bool RecoverFromDeviceLost(HWND hwnd);
 
     uint32_t BackBufferWidth() const { return mBackBufferW; }
     uint32_t BackBufferHeight() const { return mBackBufferH; }
 
+    static constexpr uint32_t kOffscreenLatency = 2;
+
 private:
     static void SafeRelease(IUnknown*& p);
 
+    HRESULT CreateSwapChain(HWND hwnd, uint32_t width, uint32_t height);
     HRESULT CreateRenderTarget();
     HRESULT CreateDepthTarget(uint32_t width, uint32_t height);
     HRESULT ResizeInternal(uint32_t width, uint32_t height);
     HRESULT CreateStates();
+    HRESULT FinishInitialize(uint32_t width, uint32_t height, D3D_FEATURE_LEVEL fl);
 
 private:
     ID3D11Device* mDevice = nullptr;
     ID3D11DeviceContext* mContext = nullptr;
     IDXGISwapChain* mSwapChain = nullptr;
 
+    // Flip model: FLIP_DISCARD, kFlipBufferCount buffers, presents paced by the waitable.
+    // Legacy blt model (DISCARD, 2 buffers) when flip creation fails or KING_LEGACY_SWAPCHAIN=1.
+    static constexpr uint32_t kFlipBufferCount = 3;
+    bool mFlipModel = false;
+    bool mTearingSupported = false;
+    UINT mSwapChainFlags = 0;
+    HANDLE mFrameLatencyWaitable = nullptr;
+    uint32_t mMaxFrameLatency = 2;
+    bool mFrameWaited = false;
+
     ID3D11RenderTargetView* mRTV = nullptr;
     ID3D11DepthStencilView* mDSV = nullptr;
 
@@ -80,6 +119,10 @@ private:
 
     D3D11_VIEWPORT mViewport{};
 
+    bool mOffscreen = false;
+    ID3D11Query* mOffscreenFences[kOffscreenLatency]{};
+    uint32_t mOffscreenFrame = 0;
+
     uint32_t mBackBufferW = 0;
     uint32_t mBackBufferH = 0;
 
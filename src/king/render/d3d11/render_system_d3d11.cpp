@@ -2,11 +2,16 @@
 
 #include "shadows.h"
 #include "shader_program_d3d11.h"
+#include "shader_variants_d3d11.h"
 #include "texture_manager_d3d11.h"
 
 #include "../../thread_config.h"
+#include "../../scene/frustum_cull.h"
+#include "../../systems/transform_system.h"
 
 #include "../../math/dxmath.h"
+#include "../../perf/alloc_counter.h"
+#include "../mesh_cook.h"
 #include "../shader.h"
 
 #include <cstdint>
@@ -17,7 +22,11 @@
 #include <cstdlib>
 #include <vector>
 #include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <optional>
 #include <unordered_map>
+#include <d3d11_1.h>
 
 namespace
 {
@@ -66,6 +75,31 @@ static bool EnvFlagA(const char* name)
 #endif
 }
 
+static uint32_t EnvUIntA(const char* name, uint32_t defaultValue)
+{
+    if (!name || !*name)
+        return defaultValue;
+
+#if defined(_WIN32)
+    char* buf = nullptr;
+    size_t len = 0;
+    if (_dupenv_s(&buf, &len, name) != 0 || !buf)
+        return defaultValue;
+    char* end = nullptr;
+    const unsigned long v = std::strtoul(buf, &end, 10);
+    const bool ok = (end != buf);
+    free(buf);
+    return ok ? (uint32_t)v : defaultValue;
+#else
+    const char* v = std::getenv(name);
+    if (!v || !*v)
+        return defaultValue;
+    char* end = nullptr;
+    const unsigned long u = std::strtoul(v, &end, 10);
+    return (end != v) ? (uint32_t)u : defaultValue;
+#endif
+}
+
 static bool EndsWithI(const std::string& s, const char* suffix)
 {
     if (!suffix)
@@ -86,83 +120,61 @@ static bool EndsWithI(const std::string& s, const char* suffix)
     return true;
 }
 
-static uint64_t Fnv1a64(const void* data, size_t len, uint64_t seed = 1469598103934665603ull)
+static king::MaterialShadingModel ResolveShadingModel(const king::PbrMaterial& mat)
 {
-    const uint8_t* p = (const uint8_t*)data;
-    uint64_t h = seed;
-    for (size_t i = 0; i < len; ++i)
+    // Prefer explicit intent.
+    king::MaterialShadingModel sm = mat.shadingModel;
+
+    // Convenience: derive from common symbolic names when intent isn't set.
+    if (sm == king::MaterialShadingModel::Pbr)
     {
-        h ^= (uint64_t)p[i];
-        h *= 1099511628211ull;
+        if (mat.shader == "unlit" || mat.shader == "unlit_color")
+            return king::MaterialShadingModel::Unlit;
+        if (mat.shader == "rim" || mat.shader == "rim_glow" || mat.shader == "rim_outline_glow")
+            return king::MaterialShadingModel::RimGlow;
     }
-    return h;
+    return sm;
 }
 
-static uint64_t HashU32(uint64_t h, uint32_t v)
+// Shadow filter permutation of the lit geometry programs: per-cascade quality with the global
+// setting (and the old Poisson switch) as fallback. Cascades past cascadeCount repeat the last
+// one, so they add no permutations. Returns the permutation packed in an integer (3 bits per
+// cascade, then the adaptive bit) for comparing frames without building its defines.
+static uint32_t ShadowFilterKey(const king::render::d3d11::RenderSystemD3D11::RenderSettings& settings,
+    uint32_t outQuality[king::render::d3d11::ShadowsD3D11::kMaxCascades])
 {
-    return Fnv1a64(&v, sizeof(v), h);
-}
+    using RenderSettings = king::render::d3d11::RenderSystemD3D11::RenderSettings;
+    constexpr uint32_t kCascades = king::render::d3d11::ShadowsD3D11::kMaxCascades;
 
-static uint64_t HashF32(uint64_t h, float v)
-{
-    uint32_t bits = 0;
-    static_assert(sizeof(bits) == sizeof(v), "float must be 32-bit");
-    std::memcpy(&bits, &v, sizeof(bits));
-    return HashU32(h, bits);
-}
+    uint32_t global = settings.shadowFilterQuality;
+    if (global == 0 && settings.enableShadowPoissonPcf)
+        global = 3;
 
-static uint64_t HashString(uint64_t h, const std::string& s)
-{
-    // Prefix with length to avoid boundary ambiguity.
-    h = HashU32(h, (uint32_t)s.size());
-    if (!s.empty())
-        h = Fnv1a64(s.data(), s.size(), h);
-    return h;
+    const uint32_t used = std::clamp(settings.cascadeCount, 1u, kCascades);
+    uint32_t key = 0;
+    for (uint32_t c = 0; c < kCascades; ++c)
+    {
+        const uint32_t q = settings.cascadeFilterQuality[std::min(c, used - 1)];
+        outQuality[c] = std::min((q == RenderSettings::kShadowFilterDefault) ? global : q, 4u);
+        key |= outQuality[c] << (3u * c);
+    }
+    if (settings.enableShadowAdaptiveFilter)
+        key |= 1u << (3u * kCascades);
+    return key;
 }
 
-static uint64_t MakeMaterialKeyHash(const king::PbrMaterial& m)
+// 7-bit program id for draw keys: the engine variant (shading model), or a hash bucket of the
+// path for dev-only custom shaders. Only groups draws; equal ids don't imply equal programs.
+static uint8_t ProgramSortId(const king::PbrMaterial& mat)
 {
-    // Fast, stable key for caching/material batching (avoid per-frame string building).
-    uint64_t h = 1469598103934665603ull;
-
-    // Only include explicit shader path when it's a dev override.
-    if (EndsWithI(m.shader, ".hlsl") || EndsWithI(m.shader, ".hlsli"))
-        h = HashString(h, m.shader);
-
-    h = HashU32(h, (uint32_t)m.blendMode);
-    h = HashU32(h, (uint32_t)m.shadingModel);
-
-    h = HashF32(h, m.albedo.x);
-    h = HashF32(h, m.albedo.y);
-    h = HashF32(h, m.albedo.z);
-    h = HashF32(h, m.albedo.w);
-    h = HashF32(h, m.roughness);
-    h = HashF32(h, m.metallic);
-    h = HashF32(h, m.emissive.x);
-    h = HashF32(h, m.emissive.y);
-    h = HashF32(h, m.emissive.z);
-
-    h = HashString(h, m.textures.albedo);
-    h = HashString(h, m.textures.normal);
-    h = HashString(h, m.textures.metallicRoughness);
-    h = HashString(h, m.textures.emissive);
-
-    if (!m.scalars.empty())
+    if (EndsWithI(mat.shader, ".hlsl") || EndsWithI(mat.shader, ".hlsli"))
     {
-        std::vector<std::pair<std::string, float>> scalars;
-        scalars.reserve(m.scalars.size());
-        for (const auto& kv : m.scalars)
-            scalars.push_back(kv);
-        std::sort(scalars.begin(), scalars.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
-
-        for (const auto& kv : scalars)
-        {
-            h = HashString(h, kv.first);
-            h = HashF32(h, kv.second);
-        }
+        uint32_t h = 2166136261u;
+        for (char c : mat.shader)
+            h = (h ^ (uint8_t)c) * 16777619u;
+        return (uint8_t)(0x40u | (h & 0x3Fu));
     }
-
-    return h;
+    return (uint8_t)((uint32_t)ResolveShadingModel(mat) & 0x3Fu);
 }
 
 static std::string MakeDefinesKey(std::vector<king::ShaderDefine> defines)
@@ -200,31 +212,6 @@ static void SafeRelease(IUnknown*& p)
     }
 }
 
-static Mat4x4 TransformToWorld(const Transform& t)
-{
-    using namespace DirectX;
-    const XMVECTOR q = XMVectorSet(t.rotation.x, t.rotation.y, t.rotation.z, t.rotation.w);
-    XMMATRIX S = XMMatrixScaling(t.scale.x, t.scale.y, t.scale.z);
-    XMMATRIX R = XMMatrixRotationQuaternion(q);
-    XMMATRIX T = XMMatrixTranslation(t.position.x, t.position.y, t.position.z);
-    XMMATRIX W = S * R * T;
-    return dx::StoreMat4x4(W);
-}
-
-static Mat4x4 WorldToNormalMatrix(const Mat4x4& world)
-{
-    using namespace DirectX;
-    const XMMATRIX W = dx::LoadMat4x4(world);
-    XMVECTOR det{};
-    const XMMATRIX invW = XMMatrixInverse(&det, W);
-    // If determinant is near-zero (singular), fall back to identity.
-    const float detLen = std::fabs(XMVectorGetX(det));
-    if (detLen < 1e-8f)
-        return dx::StoreMat4x4(XMMatrixIdentity());
-    const XMMATRIX N = XMMatrixTranspose(invW);
-    return dx::StoreMat4x4(N);
-}
-
 static Float3 TransformPoint(const Mat4x4& m, const Float3& p)
 {
     using namespace DirectX;
@@ -238,7 +225,9 @@ static Float3 TransformPoint(const Mat4x4& m, const Float3& p)
     return out;
 }
 
-static Mat4x4 MakePointShadowViewProj(const Float3& lightPos, int face, float nearZ, float farZ)
+// fovY slightly above 90 degrees leaves a border around the cube face inside its atlas tile,
+// so filter taps near the face edge still read this face.
+static Mat4x4 MakePointShadowViewProj(const Float3& lightPos, int face, float nearZ, float farZ, float fovY = DirectX::XM_PIDIV2)
 {
     using namespace DirectX;
     const XMVECTOR eye = XMVectorSet(lightPos.x, lightPos.y, lightPos.z, 1.0f);
@@ -274,99 +263,91 @@ static Mat4x4 MakePointShadowViewProj(const Float3& lightPos, int face, float ne
     }
 
     const XMMATRIX V = XMMatrixLookAtLH(eye, at, up);
-    const XMMATRIX P = XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, nearZ, farZ);
+    const XMMATRIX P = XMMatrixPerspectiveFovLH(fovY, 1.0f, nearZ, farZ);
+    return dx::StoreMat4x4(V * P);
+}
+
+static Mat4x4 MakeSpotShadowViewProj(const Float3& lightPos, const Float3& dir, float outerConeCos, float nearZ, float farZ)
+{
+    using namespace DirectX;
+    const XMVECTOR eye = XMVectorSet(lightPos.x, lightPos.y, lightPos.z, 1.0f);
+    const XMVECTOR d = XMVectorSet(dir.x, dir.y, dir.z, 0.0f);
+    const XMVECTOR up = (std::fabs(dir.y) < 0.99f) ? XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f) : XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+
+    // Square frustum around the outer cone, with a little margin for the filter taps.
+    const float halfAngle = std::acos(std::clamp(outerConeCos, 0.087f, 1.0f));
+    const float fovY = std::clamp(halfAngle * 2.0f * 1.05f, 0.05f, 2.9670597f); // <= 170 degrees
+
+    const XMMATRIX V = XMMatrixLookToLH(eye, d, up);
+    const XMMATRIX P = XMMatrixPerspectiveFovLH(fovY, 1.0f, nearZ, farZ);
     return dx::StoreMat4x4(V * P);
 }
 
-static bool EnsurePointShadowResources(
+static bool EnsureShadowAtlasResources(
     RenderDeviceD3D11& device,
     uint32_t size,
     ID3D11Texture2D*& tex,
     ID3D11ShaderResourceView*& srv,
-    ID3D11RenderTargetView* rtv[6],
+    ID3D11RenderTargetView*& rtv,
     ID3D11Texture2D*& depthTex,
-    ID3D11DepthStencilView* dsv[6])
+    ID3D11DepthStencilView*& dsv)
 {
     ID3D11Device* d = device.Device();
     if (!d)
         return false;
 
-    if (tex && srv && depthTex && rtv[0] && dsv[0])
+    if (tex && srv && rtv && depthTex && dsv)
         return true;
 
-    // Color cubemap: R32_FLOAT
+    // Color atlas: R32_FLOAT (distance / range)
     if (!tex)
     {
         D3D11_TEXTURE2D_DESC td{};
         td.Width = size;
         td.Height = size;
         td.MipLevels = 1;
-        td.ArraySize = 6;
+        td.ArraySize = 1;
         td.Format = DXGI_FORMAT_R32_FLOAT;
         td.SampleDesc.Count = 1;
         td.Usage = D3D11_USAGE_DEFAULT;
         td.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-        td.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
 
         HRESULT hr = d->CreateTexture2D(&td, nullptr, &tex);
         if (FAILED(hr))
             return false;
 
-        D3D11_SHADER_RESOURCE_VIEW_DESC sd{};
-        sd.Format = td.Format;
-        sd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
-        sd.TextureCube.MipLevels = 1;
-        hr = d->CreateShaderResourceView(tex, &sd, &srv);
+        hr = d->CreateShaderResourceView(tex, nullptr, &srv);
         if (FAILED(hr))
             return false;
 
-        for (int face = 0; face < 6; ++face)
-        {
-            D3D11_RENDER_TARGET_VIEW_DESC rd{};
-            rd.Format = td.Format;
-            rd.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
-            rd.Texture2DArray.MipSlice = 0;
-            rd.Texture2DArray.FirstArraySlice = (UINT)face;
-            rd.Texture2DArray.ArraySize = 1;
-            hr = d->CreateRenderTargetView(tex, &rd, &rtv[face]);
-            if (FAILED(hr))
-                return false;
-        }
+        hr = d->CreateRenderTargetView(tex, nullptr, &rtv);
+        if (FAILED(hr))
+            return false;
     }
 
-    // Depth cubemap: D32
+    // Depth atlas: D32
     if (!depthTex)
     {
         D3D11_TEXTURE2D_DESC td{};
         td.Width = size;
         td.Height = size;
         td.MipLevels = 1;
-        td.ArraySize = 6;
+        td.ArraySize = 1;
         td.Format = DXGI_FORMAT_D32_FLOAT;
         td.SampleDesc.Count = 1;
         td.Usage = D3D11_USAGE_DEFAULT;
         td.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-        td.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
 
         HRESULT hr = d->CreateTexture2D(&td, nullptr, &depthTex);
         if (FAILED(hr))
             return false;
 
-        for (int face = 0; face < 6; ++face)
-        {
-            D3D11_DEPTH_STENCIL_VIEW_DESC dd{};
-            dd.Format = td.Format;
-            dd.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
-            dd.Texture2DArray.MipSlice = 0;
-            dd.Texture2DArray.FirstArraySlice = (UINT)face;
-            dd.Texture2DArray.ArraySize = 1;
-            hr = d->CreateDepthStencilView(depthTex, &dd, &dsv[face]);
-            if (FAILED(hr))
-                return false;
-        }
+        hr = d->CreateDepthStencilView(depthTex, nullptr, &dsv);
+        if (FAILED(hr))
+            return false;
     }
 
-    return (tex && srv && depthTex && rtv[0] && dsv[0]);
+    return (tex && srv && rtv && depthTex && dsv);
 }
 
 RenderSystemD3D11::RenderSystemD3D11()
@@ -398,6 +379,7 @@ void RenderSystemD3D11::EnsureDeferredContexts(RenderDeviceD3D11& device)
     unsigned desired = 0;
     {
         const king::ThreadConfig& tc = king::GetThreadConfig();
+        mDeferredContextsConfigured = tc.renderDeferredContexts;
         if (tc.renderDeferredContexts > 0)
             desired = (unsigned)tc.renderDeferredContexts;
     }
@@ -416,6 +398,7 @@ void RenderSystemD3D11::EnsureDeferredContexts(RenderDeviceD3D11& device)
         if (SUCCEEDED(d->CreateDeferredContext(0, &dc)) && dc)
             mDeferredContexts.push_back(dc);
     }
+    mDeferredStateCaches.resize(mDeferredContexts.size());
 
     if (mDeferredContexts.empty())
     {
@@ -433,59 +416,89 @@ void RenderSystemD3D11::ReleaseDeferredContexts()
             dc->Release();
     }
     mDeferredContexts.clear();
+    mDeferredStateCaches.clear();
 }
 
-void RenderSystemD3D11::StartWorker()
+void RenderSystemD3D11::ApplyThreadConfig(RenderDeviceD3D11& device)
 {
-    StopWorker();
+    mThreadConfigGeneration = king::ThreadConfigGeneration();
+    const king::ThreadConfig& tc = king::GetThreadConfig();
 
-    mWorkerExit = false;
-    mPendingValid = false;
-    mReadyValid = false;
+    // Waits for the prep job and recycles every slot, so nothing prepared with the old worker
+    // layout is left in flight; the next frame is prepared inline.
+    StartWorker();
+    mUsePrepareWorker = (tc.renderPrepareWorkerThreads > 0) && king::GetJobSystem().WorkerCount() > 0;
+    mPrepareParallelism = tc.ecsWorkerThreads + 1u;
 
-    mWorker = std::thread([this]()
+    if (mShadows)
+        mShadows->ApplyThreadConfig(device);
+
+    if (mAllowDeferredContexts && tc.renderDeferredContexts != mDeferredContextsConfigured)
     {
-        // Reuse storage across frames to avoid allocation churn.
-        std::vector<SnapshotItem> items;
-        Frustum fr{};
+        ReleaseDeferredContexts();
+        EnsureDeferredContexts(device);
+    }
 
-        for (;;)
-        {
-            {
-                std::unique_lock<std::mutex> lock(mWorkMutex);
-                mWorkCv.wait(lock, [this]() { return mWorkerExit || mPendingValid; });
-                if (mWorkerExit)
-                    return;
-
-                // Swap so the main thread retains a buffer with capacity.
-                items.swap(mPendingItems);
-                fr = mPendingFrustum;
-                mPendingValid = false;
-            }
+    std::printf("[Render] Thread config applied: prepare worker %s, shadow recorders %u, deferred contexts %u\n",
+        mUsePrepareWorker ? "on" : "off", tc.renderShadowRecordThreads, (uint32_t)mDeferredContexts.size());
+}
 
-            PreparedFrame frame;
-            BuildPreparedFrame(items, fr, frame);
+void RenderSystemD3D11::StartWorker()
+{
+    StopWorker();
 
-            {
-                std::lock_guard<std::mutex> lock(mWorkMutex);
-                mReadyFrame = std::move(frame);
-                mReadyValid = true;
-            }
-        }
-    });
+    mPrepareToWorker.Reset();
+    mPrepareToMain.Reset();
+    mPrepareFreeCount = 0;
+    for (uint32_t i = 0; i < kPrepareSlots; ++i)
+        mPrepareFree[mPrepareFreeCount++] = i;
+    mPrepareInFlight = 0;
+    mRenderSlot = kNoPrepareSlot;
 }
 
 void RenderSystemD3D11::StopWorker()
 {
+    // The prep job only drains what was already queued; wait so it doesn't outlive `this`.
+    king::GetJobSystem().Wait(mPrepareJob);
+}
+
+void RenderSystemD3D11::PrepareJobMain()
+{
+    for (;;)
     {
-        std::lock_guard<std::mutex> lock(mWorkMutex);
-        mWorkerExit = true;
-        mPendingValid = false;
+        uint32_t slot = kNoPrepareSlot;
+        while (mPrepareToWorker.TryPop(slot))
+        {
+            king::perf::TraceScope trace("PrepareFrame");
+            PrepareSlot& ps = mPrepareSlots[slot];
+            // Clears and refills ps.frame, so its vectors keep their capacity.
+            mPrepareArena.Reset();
+            BuildPreparedFrame(ps.items, ps.frustum, ps.lodView, mPrepareParallelism, mPrepareArena, ps.frame);
+            // Can't fail: the ring holds every slot.
+            (void)mPrepareToMain.TryPush(slot);
+        }
+
+        // Go idle, then re-check for a snapshot pushed in between (the main thread only
+        // submits a new job when it sees the flag clear). Pairs with the fence in EnqueueBuild.
+        mPrepareJobActive.store(false, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mPrepareToWorker.Empty() || mPrepareJobActive.exchange(true))
+            return;
     }
-    mWorkCv.notify_all();
+}
+
+void RenderSystemD3D11::SetPrepareLatencyFrames(uint32_t frames)
+{
+    mPrepareLatency = std::min<uint32_t>(frames, kPrepareSlots - 1u);
+}
 
-    if (mWorker.joinable())
-        mWorker.join();
+void RenderSystemD3D11::SetAssetRegistry(const AssetRegistry* assets)
+{
+    mStreamer.Stop();
+    mStreamer.Clear();
+    mAssets = assets;
+    if (mAssets && mAssets->PackCount() > 0)
+        mStreamer.Start();
 }
 
 bool RenderSystemD3D11::Initialize(RenderDeviceD3D11& device, const std::wstring& shaderPath)
@@ -500,8 +513,18 @@ bool RenderSystemD3D11::Initialize(RenderDeviceD3D11& device, const std::wstring
         return false;
 
     mShaderCache = std::make_unique<king::ShaderCache>(d);
+    mShaderCache->SetDiskCacheDir(mShaderCacheDir);
+
+    // Everything below (and each material variant's first use) then hits the cache.
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        const uint32_t failed = mShaderCache->Precompile(EngineShaderVariants(shaderPath), GetJobSystem());
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::printf("Shaders: %.1f ms (%u from disk cache, %u compiled, %u failed)\n", ms, mShaderCache->DiskHits(),
+            mShaderCache->Compiles(), failed);
+    }
 
-    // Basic texture manager (WIC) so materials can bind textures for custom shaders.
+    // Texture manager (async WIC loads + pack streaming) so materials can bind textures.
     if (!mTextures.Initialize(d))
         return false;
 
@@ -511,6 +534,7 @@ bool RenderSystemD3D11::Initialize(RenderDeviceD3D11& device, const std::wstring
     king::CompiledShader ps;
     king::CompiledShader psMrt;
     king::CompiledShader psPointShadow;
+    king::CompiledShader psShadowTileClear;
     std::string shaderErr;
 
     if (!mShaderCache->CompileVSFromFile(shaderPath.c_str(), "VSMain", {}, vs, &shaderErr))
@@ -549,6 +573,12 @@ bool RenderSystemD3D11::Initialize(RenderDeviceD3D11& device, const std::wstring
         return false;
     }
 
+    if (!mShaderCache->CompilePSFromFile(shaderPath.c_str(), "PSShadowTileClearMain", {}, psShadowTileClear, &shaderErr))
+    {
+        std::printf("Shader PSShadowTileClearMain compile error:\n%s\n", shaderErr.c_str());
+        return false;
+    }
+
     // Print reflection once to keep debugging approachable.
     std::printf("VS reflection: %zu resources, %zu cbuffers\n", vs.reflection.resources.size(), vs.reflection.cbuffers.size());
     for (const auto& r : vs.reflection.resources)
@@ -604,6 +634,62 @@ bool RenderSystemD3D11::Initialize(RenderDeviceD3D11& device, const std::wstring
         return false;
     }
 
+    hr = d->CreatePixelShader(psShadowTileClear.bytecode->GetBufferPointer(), psShadowTileClear.bytecode->GetBufferSize(), nullptr, &mPSShadowTileClear);
+    if (FAILED(hr))
+    {
+        std::printf("CreatePixelShader(PSShadowTileClearMain) failed hr=0x%08X\n", (unsigned)hr);
+        return false;
+    }
+
+    // Single-pass shadow faces. Optional: without them every face gets its own pass.
+    {
+        D3D11_FEATURE_DATA_D3D11_OPTIONS3 opts3{};
+        const bool vsViewportIndex = SUCCEEDED(d->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS3, &opts3, sizeof(opts3)))
+            && opts3.VPAndRTArrayIndexFromAnyShaderFeedingRasterizer;
+
+        king::CompiledShader vsLayered;
+        if (vsViewportIndex && mShaderCache->CompileVSFromFile(shaderPath.c_str(), "VSPointShadowLayeredMain", {}, vsLayered, &shaderErr))
+        {
+            if (FAILED(d->CreateVertexShader(vsLayered.bytecode->GetBufferPointer(), vsLayered.bytecode->GetBufferSize(), nullptr, &mVSPointShadowLayered)))
+                mVSPointShadowLayered = nullptr;
+        }
+
+        king::CompiledShader vsReplicate;
+        king::CompiledShader gsPointShadow;
+        king::CompiledShader psLayered;
+        if (!mShaderCache->CompilePSFromFile(shaderPath.c_str(), "PSPointShadowLayeredMain", {}, psLayered, &shaderErr)
+            || FAILED(d->CreatePixelShader(psLayered.bytecode->GetBufferPointer(), psLayered.bytecode->GetBufferSize(), nullptr, &mPSPointShadowLayered)))
+        {
+            std::printf("RenderSystemD3D11: PSPointShadowLayeredMain unavailable, point shadows render one face per pass\n%s\n", shaderErr.c_str());
+            mPSPointShadowLayered = nullptr;
+        }
+        else if (!mVSPointShadowLayered)
+        {
+            if (!mShaderCache->CompileVSFromFile(shaderPath.c_str(), "VSPointShadowReplicateMain", {}, vsReplicate, &shaderErr)
+                || !mShaderCache->CompileGSFromFile(shaderPath.c_str(), "GSPointShadowMain", {}, gsPointShadow, &shaderErr)
+                || FAILED(d->CreateVertexShader(vsReplicate.bytecode->GetBufferPointer(), vsReplicate.bytecode->GetBufferSize(), nullptr, &mVSPointShadowReplicate))
+                || FAILED(d->CreateGeometryShader(gsPointShadow.bytecode->GetBufferPointer(), gsPointShadow.bytecode->GetBufferSize(), nullptr, &mGSPointShadow)))
+            {
+                std::printf("RenderSystemD3D11: GSPointShadowMain unavailable, point shadows render one face per pass\n%s\n", shaderErr.c_str());
+                SafeRelease((IUnknown*&)mVSPointShadowReplicate);
+                SafeRelease((IUnknown*&)mGSPointShadow);
+            }
+        }
+
+        D3D11_BUFFER_DESC bd{};
+        bd.ByteWidth = (UINT)((sizeof(Mat4x4) + 16u) * kMaxShadowSlots); // viewProj[16] + light[16]
+        bd.Usage = D3D11_USAGE_DYNAMIC;
+        bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        if (FAILED(d->CreateBuffer(&bd, nullptr, &mPointShadowSlotsCB)))
+            mPointShadowSlotsCB = nullptr;
+
+        std::printf("RenderSystemD3D11: single-pass point shadows: %s\n",
+            !mPSPointShadowLayered || !mPointShadowSlotsCB ? "off"
+            : mVSPointShadowLayered ? "VS viewport index"
+            : mGSPointShadow ? "GS viewport index" : "off");
+    }
+
     // Post-processing system (full-screen shaders + post chain)
     if (!mPost.Initialize(device, *mShaderCache, shaderPath))
     {
@@ -619,7 +705,39 @@ bool RenderSystemD3D11::Initialize(RenderDeviceD3D11& device, const std::wstring
         return false;
     }
 
-    // Point shadow constant buffer (updated per cubemap face).
+    // GPU-driven culling of the static region (RenderSettings::enableGpuCulling). Optional.
+    {
+        const std::wstring cullPath = mShaderDir.empty() ? std::wstring(L"gpu_cull.hlsl") : mShaderDir + L"\\gpu_cull.hlsl";
+        mGpuCulling = std::make_unique<GpuCullingD3D11>();
+        if (!mGpuCulling->Initialize(device, *mShaderCache, cullPath))
+        {
+            std::printf("RenderSystemD3D11: GPU culling unavailable, static instances are culled on the CPU.\n");
+            mGpuCulling.reset();
+        }
+        mGpuCullDirty = true;
+    }
+
+    // SSAO compute blur. Optional: without it SSAO falls back to the pixel-shader blur.
+    {
+        const std::wstring ssaoPath = mShaderDir.empty() ? std::wstring(L"ssao_cs.hlsl") : mShaderDir + L"\\ssao_cs.hlsl";
+        std::string csErr;
+        king::CompiledShader blurH;
+        king::CompiledShader blurV;
+        if (mShaderCache->CompileCSFromFile(ssaoPath.c_str(), "CSSsaoBlurHMain", {}, blurH, &csErr) &&
+            mShaderCache->CompileCSFromFile(ssaoPath.c_str(), "CSSsaoBlurVMain", {}, blurV, &csErr))
+        {
+            if (FAILED(d->CreateComputeShader(blurH.bytecode->GetBufferPointer(), blurH.bytecode->GetBufferSize(), nullptr, &mSsaoBlurHCS)) ||
+                FAILED(d->CreateComputeShader(blurV.bytecode->GetBufferPointer(), blurV.bytecode->GetBufferSize(), nullptr, &mSsaoBlurVCS)))
+            {
+                SafeRelease((IUnknown*&)mSsaoBlurHCS);
+                SafeRelease((IUnknown*&)mSsaoBlurVCS);
+            }
+        }
+        if (!mSsaoBlurHCS)
+            std::printf("RenderSystemD3D11: SSAO compute blur unavailable (%s), using the pixel-shader blur.\n", csErr.c_str());
+    }
+
+    // Point/spot shadow constant buffer (updated per atlas face).
     {
         D3D11_BUFFER_DESC bd{};
         bd.ByteWidth = (UINT)sizeof(Mat4x4) + 16u; // viewProj + (float3 + float)
@@ -635,24 +753,17 @@ bool RenderSystemD3D11::Initialize(RenderDeviceD3D11& device, const std::wstring
     }
 
     D3D11_INPUT_ELEMENT_DESC layout[] = {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        // Cooked vertex (PackedVertex): quantized position, octahedral normal
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "NORMAL",   0, DXGI_FORMAT_R16G16_SNORM,       0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 
-        // Per-instance data (slot 1)
+        // Per-instance data (slot 1): world matrix columns 0..2 (the fourth is 0,0,0,1)
         { "TEXCOORD",  4, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
         { "TEXCOORD",  5, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
         { "TEXCOORD",  6, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD",  7, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        // Normal matrix rows (inverse-transpose of world)
-        { "TEXCOORD", 11, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 64,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD", 12, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 80,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD", 13, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 96,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD", 14, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 112, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-
-        { "COLOR",     0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 128, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD",  8, DXGI_FORMAT_R32G32_FLOAT,       1, 144, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD",  9, DXGI_FORMAT_R32_UINT,           1, 152, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD", 10, DXGI_FORMAT_R32_UINT,           1, 156, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+
+        { "TEXCOORD",  9, DXGI_FORMAT_R32_UINT,           1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "TEXCOORD", 10, DXGI_FORMAT_R32_UINT,           1, 52, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
     };
 
     hr = d->CreateInputLayout(
@@ -688,6 +799,12 @@ bool RenderSystemD3D11::Initialize(RenderDeviceD3D11& device, const std::wstring
     if (FAILED(hr))
         return false;
 
+    static_assert(sizeof(ClusterCBData) % 16 == 0, "ClusterCBData must be 16-byte aligned");
+    cbd.ByteWidth = (UINT)sizeof(ClusterCBData);
+    hr = d->CreateBuffer(&cbd, nullptr, &mClusterCB);
+    if (FAILED(hr))
+        return false;
+
     // Samplers
     {
         D3D11_SAMPLER_DESC sd{};
@@ -745,10 +862,16 @@ bool RenderSystemD3D11::Initialize(RenderDeviceD3D11& device, const std::wstring
         dsd.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
         dsd.StencilEnable = FALSE;
         (void)d->CreateDepthStencilState(&dsd, &mDepthReadOnly);
+
+        // Depth always passes and writes: clears one shadow atlas tile (PSShadowTileClearMain).
+        dsd.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+        dsd.DepthFunc = D3D11_COMPARISON_ALWAYS;
+        (void)d->CreateDepthStencilState(&dsd, &mDepthAlwaysWrite);
     }
 
-    // Instance buffer: created lazily (capacity grows with scene).
-    mInstanceCapacity = 0;
+    // Per-frame instance ring shared by the shadow passes and the main view (grows with the scene).
+    if (!mInstanceRing.Initialize(d, D3D11_BIND_VERTEX_BUFFER, (uint32_t)sizeof(InstanceData), kInstanceRingInitialCapacity))
+        return false;
 
     // 1x1 white AO texture (used when SSAO is disabled so the tonemap shader
     // can always sample gSsao safely).
@@ -775,7 +898,11 @@ bool RenderSystemD3D11::Initialize(RenderDeviceD3D11& device, const std::wstring
 
     {
         const king::ThreadConfig& tc = king::GetThreadConfig();
-        mUsePrepareWorker = (tc.renderPrepareWorkerThreads > 0);
+        mThreadConfigGeneration = king::ThreadConfigGeneration();
+        // Without job workers the "worker" would just run inline on this thread.
+        mUsePrepareWorker = (tc.renderPrepareWorkerThreads > 0) && king::GetJobSystem().WorkerCount() > 0;
+        mPrepareParallelism = tc.ecsWorkerThreads + 1u;
+        SetPrepareLatencyFrames(EnvUIntA("KING_PREPARE_LATENCY", 1u));
     }
 
     // Cache init-time feature switches to avoid per-frame env checks.
@@ -798,6 +925,8 @@ bool RenderSystemD3D11::Initialize(RenderDeviceD3D11& device, const std::wstring
 void RenderSystemD3D11::Shutdown()
 {
     StopWorker();
+    WaitShaderReload();
+    mStreamer.Stop();
 
     if (mGpuPerf.Enabled())
         mGpuPerf.Shutdown();
@@ -818,6 +947,16 @@ void RenderSystemD3D11::Shutdown()
     SafeRelease(tmp);
     mLightCB = nullptr;
 
+    tmp = (IUnknown*)mClusterCB;
+    SafeRelease(tmp);
+    mClusterCB = nullptr;
+    ReleaseStructured(mClusterLights);
+    ReleaseStructured(mClusterRanges);
+    ReleaseStructured(mClusterIndices);
+    ReleaseStructured(mShadowFacesBuffer);
+    mLocalLights.clear();
+    mLocalLightSpheres.clear();
+
     tmp = (IUnknown*)mSsaoCB;
     SafeRelease(tmp);
     mSsaoCB = nullptr;
@@ -848,25 +987,33 @@ void RenderSystemD3D11::Shutdown()
         mShadows.reset();
     }
 
-    // Point shadow resources
+    if (mGpuCulling)
+    {
+        mGpuCulling->Shutdown();
+        mGpuCulling.reset();
+    }
+
+    // Point/spot shadow resources
     SafeRelease((IUnknown*&)mVSPointShadow);
     SafeRelease((IUnknown*&)mPSPointShadow);
+    SafeRelease((IUnknown*&)mPSShadowTileClear);
+    SafeRelease((IUnknown*&)mVSPointShadowLayered);
+    SafeRelease((IUnknown*&)mVSPointShadowReplicate);
+    SafeRelease((IUnknown*&)mGSPointShadow);
+    SafeRelease((IUnknown*&)mPSPointShadowLayered);
+    SafeRelease((IUnknown*&)mPointShadowSlotsCB);
+    SafeRelease((IUnknown*&)mDepthAlwaysWrite);
     SafeRelease((IUnknown*&)mPointShadowCB);
-    SafeRelease((IUnknown*&)mPointShadowSRV);
-    SafeRelease((IUnknown*&)mPointShadowTex);
-    for (int i = 0; i < 6; ++i)
-    {
-        SafeRelease((IUnknown*&)mPointShadowRTV[i]);
-        SafeRelease((IUnknown*&)mPointShadowDSV[i]);
-    }
-    SafeRelease((IUnknown*&)mPointShadowDepthTex);
-    mPointShadowSize = 0;
+    SafeRelease((IUnknown*&)mShadowAtlasSRV);
+    SafeRelease((IUnknown*&)mShadowAtlasRTV);
+    SafeRelease((IUnknown*&)mShadowAtlasTex);
+    SafeRelease((IUnknown*&)mShadowAtlasDSV);
+    SafeRelease((IUnknown*&)mShadowAtlasDepthTex);
+    mShadowAtlasTexSize = 0;
+    mShadowAtlas.Reset();
 
     for (auto& kv : mMaterialCache)
     {
-        IUnknown* tmp2 = (IUnknown*)kv.second.materialCB;
-        SafeRelease(tmp2);
-        kv.second.materialCB = nullptr;
         kv.second.program = nullptr;
         kv.second.albedoSRV = nullptr;
         kv.second.normalSRV = nullptr;
@@ -874,7 +1021,20 @@ void RenderSystemD3D11::Shutdown()
         kv.second.emissiveSRV = nullptr;
     }
     mMaterialCache.clear();
-    mProgramCache.clear();
+    mMaterialSlots.clear();
+    mMaterialSlotsOwner = nullptr;
+    mMaterialShadowFilterKey = kNoShadowFilterKey;
+    SafeRelease((IUnknown*&)mMaterialSRV);
+    SafeRelease((IUnknown*&)mMaterialBuffer);
+    mMaterialBufferCapacity = 0;
+    mMaterialData.clear();
+    mMaterialDataVersion.clear();
+    mMaterialDataOwner = nullptr;
+    mPrograms.clear();
+    mProgramDescs.clear();
+    mProgramIds.clear();
+    mShaderReloadQueue.clear();
+    std::fill(std::begin(mEngineProgramIds), std::end(mEngineProgramIds), kNoProgram);
     mTextures.Shutdown();
     mShaderCache.reset();
 
@@ -915,10 +1075,8 @@ void RenderSystemD3D11::Shutdown()
     tmp = (IUnknown*)mDepthTex;
     SafeRelease(tmp);
     mDepthTex = nullptr;
-
-    tmp = (IUnknown*)mSsaoBlurSRV;
-    SafeRelease(tmp);
-    mSsaoBlurSRV = nullptr;
+    mDepthW = 0;
+    mDepthH = 0;
 
     tmp = (IUnknown*)mAoWhiteSRV;
     SafeRelease(tmp);
@@ -928,30 +1086,26 @@ void RenderSystemD3D11::Shutdown()
     SafeRelease(tmp);
     mAoWhiteTex = nullptr;
 
-    tmp = (IUnknown*)mSsaoBlurRTV;
-    SafeRelease(tmp);
-    mSsaoBlurRTV = nullptr;
-
-    tmp = (IUnknown*)mSsaoBlurTex;
-    SafeRelease(tmp);
-    mSsaoBlurTex = nullptr;
-
-    tmp = (IUnknown*)mSsaoSRV;
-    SafeRelease(tmp);
-    mSsaoSRV = nullptr;
-
-    tmp = (IUnknown*)mSsaoRTV;
-    SafeRelease(tmp);
-    mSsaoRTV = nullptr;
+    mFrameGraph.Shutdown();
+    ReleaseSsaoHistory();
+    SafeRelease((IUnknown*&)mSsaoBlurHCS);
+    SafeRelease((IUnknown*&)mSsaoBlurVCS);
 
-    tmp = (IUnknown*)mSsaoTex;
-    SafeRelease(tmp);
-    mSsaoTex = nullptr;
+    mInstanceRing.Shutdown();
+    mMainInstanceFirst = 0;
 
-    tmp = (IUnknown*)mInstanceVB;
+    tmp = (IUnknown*)mStaticInstanceVB;
     SafeRelease(tmp);
-    mInstanceVB = nullptr;
-    mInstanceCapacity = 0;
+    mStaticInstanceVB = nullptr;
+    mStaticInstanceCapacity = 0;
+    mStaticItems.clear();
+    mStaticInstances.clear();
+    mStaticSpheres.Resize(0);
+    mStaticBvh.Clear();
+    mStaticSignature = 0;
+    mStaticCount = 0;
+    mStaticGpuDirty = false;
+    mGpuCullDirty = true;
 
     tmp = (IUnknown*)mInputLayout;
     SafeRelease(tmp);
@@ -972,18 +1126,18 @@ void RenderSystemD3D11::Shutdown()
     mPSMrt = nullptr;
 
     {
-        std::lock_guard<std::mutex> lock(mWorkMutex);
-        mPendingItems.clear();
-        mReadyFrame.instances.clear();
-        mReadyFrame.batches.clear();
-        mReadyFrame.materials.clear();
-        mReadyFrame.materialKeys.clear();
-        mRenderFrame.instances.clear();
-        mRenderFrame.batches.clear();
-        mRenderFrame.materials.clear();
-        mRenderFrame.materialKeys.clear();
-        mPendingValid = false;
-        mReadyValid = false;
+        for (auto& ps : mPrepareSlots)
+        {
+            ps.items.clear();
+            ps.frame.instances.clear();
+            ps.frame.batches.clear();
+            ps.frame.materials.clear();
+            ps.frame.opaqueBatchCount = 0;
+        }
+        mInlineFrame.instances.clear();
+        mInlineFrame.batches.clear();
+        mInlineFrame.materials.clear();
+        mInlineFrame.opaqueBatchCount = 0;
     }
 }
 
@@ -994,566 +1148,2518 @@ bool RenderSystemD3D11::OnDeviceReset(RenderDeviceD3D11& device)
     return Initialize(device, mShaderPath);
 }
 
-void RenderSystemD3D11::BuildSnapshot(Scene& scene, std::vector<SnapshotItem>& outItems)
-{
-    outItems.clear();
-    outItems.reserve(scene.reg.renderers.Entities().size());
-
-    constexpr uint32_t kInstFlag_ReceivesShadows = 1u << 0;
-    constexpr uint32_t kInstFlag_CastsShadows = 1u << 1;
-
-    for (auto e : scene.reg.renderers.Entities())
-    {
-        auto* r = scene.reg.renderers.TryGet(e);
-        auto* t = scene.reg.transforms.TryGet(e);
-        if (!r || !t)
-            continue;
-
-        auto* m = scene.reg.meshes.TryGet(r->mesh);
-        if (!m)
-            continue;
-
-        SnapshotItem it{};
-        it.mesh = m;
-        it.transform = *t;
-        it.albedo = r->material.albedo;
-        it.roughness = r->material.roughness;
-        it.metallic = r->material.metallic;
-        it.material = r->material;
-        it.lightMask = r->lightMask;
-        it.flags = 0;
-        if (r->receivesShadows)
-            it.flags |= kInstFlag_ReceivesShadows;
-        // Transparency policy: by default, transparent objects don't cast shadows
-        // (avoids incorrect shadowing without a dedicated masked shadow pass).
-        const bool isTransparent = (r->material.blendMode == king::MaterialBlendMode::AlphaBlend);
-        if (r->castsShadows && !isTransparent)
-            it.flags |= kInstFlag_CastsShadows;
-        it.boundsCenter = m->boundsCenter;
-        it.boundsRadius = m->boundsRadius;
-        outItems.push_back(it);
-    }
-}
-
-void RenderSystemD3D11::EnqueueBuild(std::vector<SnapshotItem>& items, const Frustum& frustum)
+void RenderSystemD3D11::ReloadShaders(const std::vector<std::wstring>& changedPaths)
 {
-    if (!mUsePrepareWorker)
-        return;
+    for (const std::wstring& p : changedPaths)
     {
-        std::lock_guard<std::mutex> lock(mWorkMutex);
-        // Swap so caller keeps a vector with capacity for the next frame.
-        mPendingItems.swap(items);
-        mPendingFrustum = frustum;
-        mPendingValid = true;
+        if (std::find(mShaderReloadQueue.begin(), mShaderReloadQueue.end(), p) == mShaderReloadQueue.end())
+            mShaderReloadQueue.push_back(p);
     }
-    mWorkCv.notify_one();
 }
 
-bool RenderSystemD3D11::ConsumeReadyFrame(PreparedFrame& outFrame)
+void RenderSystemD3D11::WaitShaderReload()
 {
-    std::lock_guard<std::mutex> lock(mWorkMutex);
-    if (!mReadyValid)
-        return false;
-
-    outFrame = std::move(mReadyFrame);
-    mReadyValid = false;
-    return true;
+    if (mShaderReload.thread.joinable())
+        mShaderReload.thread.join();
+    mShaderReload.ids.clear();
+    mShaderReload.programs.clear();
 }
 
-void RenderSystemD3D11::BuildPreparedFrame(const std::vector<SnapshotItem>& items, const Frustum& frustum, PreparedFrame& outFrame)
+void RenderSystemD3D11::UpdateShaderReload(RenderDeviceD3D11& device)
 {
-    outFrame.instances.clear();
-    outFrame.batches.clear();
-    outFrame.materials.clear();
-    outFrame.materialKeys.clear();
-
-    struct Item
-    {
-        Mesh* mesh = nullptr;
-        InstanceData inst{};
-        uint32_t materialIndex = 0;
-    };
-
-    thread_local std::vector<Item> visible;
-    visible.clear();
-    visible.reserve(items.size());
-
-    thread_local std::unordered_map<uint64_t, uint32_t> materialKeyToIndex;
-    materialKeyToIndex.clear();
-    materialKeyToIndex.reserve(items.size());
-
-    for (const SnapshotItem& s : items)
+    if (mShaderReload.thread.joinable())
     {
-        if (!s.mesh)
-            continue;
-
-        // Frustum culling (sphere)
-        Sphere sp{};
-        sp.center = {
-            s.transform.position.x + s.boundsCenter.x,
-            s.transform.position.y + s.boundsCenter.y,
-            s.transform.position.z + s.boundsCenter.z
-        };
-        const float sx = s.transform.scale.x;
-        const float sy = s.transform.scale.y;
-        const float sz = s.transform.scale.z;
-        const float maxScale = (sx > sy) ? ((sx > sz) ? sx : sz) : ((sy > sz) ? sy : sz);
-        sp.radius = s.boundsRadius * maxScale;
-        if (!frustum.Intersects(sp))
-            continue;
+        if (!mShaderReload.done.load(std::memory_order_acquire))
+            return;
+        mShaderReload.thread.join();
 
-        Item it{};
-        it.mesh = s.mesh;
+        uint32_t swapped = 0;
+        for (size_t i = 0; i < mShaderReload.ids.size(); ++i)
         {
-            const uint64_t k = MakeMaterialKeyHash(s.material);
-            auto mk = materialKeyToIndex.find(k);
-            if (mk == materialKeyToIndex.end())
-            {
-                const uint32_t newIndex = (uint32_t)outFrame.materials.size();
-                outFrame.materials.push_back(s.material);
-                outFrame.materialKeys.push_back(k);
-                materialKeyToIndex.emplace(k, newIndex);
-                it.materialIndex = newIndex;
-            }
-            else
-            {
-                it.materialIndex = mk->second;
-            }
+            if (!mShaderReload.programs[i])
+                continue;
+            // The old program is released here; the context only holds references of its own.
+            mPrograms[mShaderReload.ids[i]] = std::move(mShaderReload.programs[i]);
+            ++swapped;
         }
-        it.inst.world = TransformToWorld(s.transform);
-        it.inst.normal = WorldToNormalMatrix(it.inst.world);
-        it.inst.albedo[0] = s.albedo.x;
-        it.inst.albedo[1] = s.albedo.y;
-        it.inst.albedo[2] = s.albedo.z;
-        it.inst.albedo[3] = s.albedo.w;
-        it.inst.roughnessMetallic[0] = s.roughness;
-        it.inst.roughnessMetallic[1] = s.metallic;
-        it.inst.lightMask = s.lightMask;
-        it.inst.flags = s.flags;
-        visible.push_back(it);
+        if (swapped > 0)
+        {
+            // Pipelines point at the old shaders: rebuild every material's on first use, and
+            // forget what the state cache thinks is bound (a new shader may reuse an address).
+            mMaterialCache.clear();
+            mMaterialSlots.clear();
+            mImmediateState.Invalidate();
+        }
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mShaderReload.start).count();
+        std::printf("ShaderReload: %u of %zu programs swapped in (%.0f ms)\n", swapped, mShaderReload.ids.size(), ms);
+        mShaderReload.ids.clear();
+        mShaderReload.programs.clear();
     }
 
-    if (visible.empty())
+    if (mShaderReloadQueue.empty() || !mShaderCache)
         return;
 
-    // Batch/sort by pipeline-ish state (right now: mesh binds).
-    std::sort(visible.begin(), visible.end(), [](const Item& a, const Item& b)
-    {
-        if ((uintptr_t)a.mesh != (uintptr_t)b.mesh)
-            return (uintptr_t)a.mesh < (uintptr_t)b.mesh;
-        return a.materialIndex < b.materialIndex;
-    });
-
-    outFrame.instances.reserve(visible.size());
-    outFrame.batches.reserve(64);
-
-    Mesh* currentMesh = nullptr;
-    uint32_t currentMat = 0;
-    Batch currentBatch{};
+    bool all = false;
+    for (const std::wstring& p : mShaderReloadQueue)
+        all |= (p.size() >= 6 && p.compare(p.size() - 6, 6, L".hlsli") == 0);
 
-    for (const Item& v : visible)
+    std::vector<GeometryProgramDesc> descs;
+    for (uint32_t id = 0; id < (uint32_t)mProgramDescs.size(); ++id)
     {
-        if (v.mesh != currentMesh || v.materialIndex != currentMat)
+        const std::wstring path = FileWatcher::NormalizePath(mProgramDescs[id].hlslPath);
+        if (all || std::find(mShaderReloadQueue.begin(), mShaderReloadQueue.end(), path) != mShaderReloadQueue.end())
         {
-            if (currentBatch.mesh)
-                outFrame.batches.push_back(currentBatch);
-
-            currentMesh = v.mesh;
-            currentMat = v.materialIndex;
-            currentBatch = {};
-            currentBatch.mesh = v.mesh;
-            currentBatch.materialIndex = v.materialIndex;
-            currentBatch.startInstance = (uint32_t)outFrame.instances.size();
-            currentBatch.instanceCount = 0;
+            mShaderReload.ids.push_back(id);
+            descs.push_back(mProgramDescs[id]);
         }
-
-        outFrame.instances.push_back(v.inst);
-        currentBatch.instanceCount++;
     }
 
-    if (currentBatch.mesh)
-        outFrame.batches.push_back(currentBatch);
-}
-
-void RenderSystemD3D11::UpdateCameraCB(ID3D11DeviceContext* ctx, const Mat4x4& viewProj, const Float3& cameraPos, float exposure, float aoStrength)
-{
-    CameraCBData data{};
-    data.viewProj = viewProj;
-    data.cameraPos[0] = cameraPos.x;
-    data.cameraPos[1] = cameraPos.y;
-    data.cameraPos[2] = cameraPos.z;
-    data.exposure = exposure;
-    data.aoStrength = std::clamp(aoStrength, 0.0f, 1.0f);
-
-    D3D11_MAPPED_SUBRESOURCE mapped{};
-    if (SUCCEEDED(ctx->Map(mCameraCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+    if (all)
     {
-        std::memcpy(mapped.pData, &data, sizeof(data));
-        ctx->Unmap(mCameraCB, 0);
+        (void)mShaderCache->Invalidate(std::wstring());
     }
-}
-
-void RenderSystemD3D11::UpdateLightCB(ID3D11DeviceContext* ctx, const LightCBData& data)
-{
-    D3D11_MAPPED_SUBRESOURCE mapped{};
-    if (SUCCEEDED(ctx->Map(mLightCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+    else
     {
-        std::memcpy(mapped.pData, &data, sizeof(data));
-        ctx->Unmap(mLightCB, 0);
+        for (const std::wstring& p : mShaderReloadQueue)
+            (void)mShaderCache->Invalidate(p);
     }
-}
 
-void RenderSystemD3D11::EnsureMeshBuffers(RenderDeviceD3D11& device, Mesh& mesh)
+    if (descs.empty())
+    {
+        for (const std::wstring& p : mShaderReloadQueue)
+            std::printf("ShaderReload: no geometry program uses '%ls' (engine pass shaders reload on restart)\n", p.c_str());
+        mShaderReloadQueue.clear();
+        return;
+    }
+    mShaderReloadQueue.clear();
+
+    mShaderReload.programs.clear();
+    mShaderReload.programs.resize(descs.size());
+    mShaderReload.done.store(false, std::memory_order_relaxed);
+    mShaderReload.start = std::chrono::steady_clock::now();
+
+    // ID3D11Device is free-threaded and ShaderCache takes concurrent compiles; Shutdown joins
+    // before either goes away.
+    ID3D11Device* d3d = device.Device();
+    king::ShaderCache* cache = mShaderCache.get();
+    mShaderReload.thread = std::thread([this, d3d, cache, descs = std::move(descs)]()
+    {
+        king::perf::TraceCapture::SetThreadName("ShaderReload");
+        for (size_t i = 0; i < descs.size(); ++i)
+        {
+            auto prog = std::make_unique<ShaderProgramD3D11>();
+            std::string err;
+            if (prog->Create(d3d, *cache, descs[i], &err))
+                mShaderReload.programs[i] = std::move(prog);
+            else
+                std::printf("ShaderReload: '%ls' failed, keeping the old program: %s\n", descs[i].hlslPath.c_str(), err.c_str());
+        }
+        mShaderReload.done.store(true, std::memory_order_release);
+    });
+}
+
+// splitmix64 finalizer.
+static uint64_t MixHash(uint64_t h)
+{
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBull;
+    h ^= h >> 31;
+    return h;
+}
+
+static uint64_t HashBytes(const void* data, size_t len)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+void RenderSystemD3D11::BuildSnapshot(Scene& scene, std::vector<SnapshotItem>& outItems, uint32_t workerThreads)
+{
+    constexpr uint32_t kInstFlag_ReceivesShadows = 1u << 0;
+    constexpr uint32_t kInstFlag_CastsShadows = 1u << 1;
+
+    // Keep transforms packed in renderer order so the join below is a linear walk.
+    scene.reg.Group<MeshRenderer, Transform, WorldTransform>();
+    const auto& worlds = scene.reg.worldTransforms;
+
+    const auto view = scene.reg.View<MeshRenderer, Transform>();
+
+    // Draw key state per material, so the parallel fill below is a table lookup.
+    mMaterialDrawState.resize(scene.materials.Size());
+    for (MaterialHandle h = 0; h < (MaterialHandle)mMaterialDrawState.size(); ++h)
+    {
+        MaterialDrawState& ds = mMaterialDrawState[h];
+        const uint32_t version = scene.materials.Version(h);
+        if (ds.version == version)
+            continue;
+        const PbrMaterial& mat = scene.materials.Get(h);
+        ds.version = version;
+        ds.program = ProgramSortId(mat);
+        ds.alphaBlend = (mat.blendMode == king::MaterialBlendMode::AlphaBlend);
+        ds.bindGroup = mBindGroupIds.emplace(HashMaterialBindings(mat), (uint32_t)mBindGroupIds.size()).first->second;
+    }
+
+    auto fillItem = [&](size_t slot, Entity e, const MeshRenderer& r, const Transform& t, Mesh* m, SnapshotItem& it)
+    {
+        const PbrMaterial& mat = scene.materials.Get(r.material);
+
+        it.mesh = m;
+        if (const WorldTransform* w = worlds.TryGetAt(slot, e))
+        {
+            it.world = w->world;
+            it.maxScale = w->maxScale;
+        }
+        else
+        {
+            WorldTransform local{};
+            systems::TransformSystem::ComputeWorld(t, nullptr, local);
+            it.world = local.world;
+            it.maxScale = local.maxScale;
+        }
+        it.material = scene.materials.Valid(r.material) ? r.material : kDefaultMaterial;
+        it.lightMask = r.lightMask;
+        it.flags = 0;
+        if (r.receivesShadows)
+            it.flags |= kInstFlag_ReceivesShadows;
+        // Transparency policy: by default, transparent objects don't cast shadows
+        // (avoids incorrect shadowing without a dedicated masked shadow pass).
+        const bool isTransparent = (mat.blendMode == king::MaterialBlendMode::AlphaBlend);
+        if (r.castsShadows && !isTransparent)
+            it.flags |= kInstFlag_CastsShadows;
+        it.meshId = EntityIndex(r.mesh);
+        it.program = mMaterialDrawState[it.material].program;
+        it.alphaBlend = mMaterialDrawState[it.material].alphaBlend;
+        it.bindGroup = mMaterialDrawState[it.material].bindGroup;
+        it.boundsCenter = m->boundsCenter;
+        it.boundsRadius = m->boundsRadius;
+    };
+
+    // Order-independent signature of everything the static region is built from. Entities
+    // with a WorldTransform contribute its revision, so an unchanged static costs a hash, not
+    // a copy.
+    auto staticHash = [&](size_t slot, Entity e, const MeshRenderer& r, const Transform& t, const Mesh* m) -> uint64_t
+    {
+        uint64_t h = 0;
+        if (const WorldTransform* w = worlds.TryGetAt(slot, e))
+            h = ((uint64_t)e << 32) | w->revision;
+        else
+            h = ((uint64_t)e << 32) ^ HashBytes(&t, sizeof(Transform));
+        h = MixHash(h);
+        h = MixHash(h ^ (uint64_t)(uintptr_t)m ^ ((uint64_t)m->revision << 48));
+        h = MixHash(h ^ (((uint64_t)r.material << 32) | scene.materials.Version(r.material)));
+        h = MixHash(h ^ (((uint64_t)r.lightMask << 2) | ((uint64_t)r.castsShadows << 1) | (uint64_t)r.receivesShadows));
+        return h;
+    };
+
+    // One slot per lead (renderer) entry; slots that don't produce an item keep mesh == nullptr
+    // and are compacted out afterwards. Lets chunks write without coordination.
+    outItems.clear();
+    outItems.resize(view.SizeHint());
+
+    std::atomic<uint64_t> staticSignature{ 0 };
+    std::atomic<size_t> staticCount{ 0 };
+
+    auto buildRange = [&](size_t begin, size_t end)
+    {
+        uint64_t sig = 0;
+        size_t statics = 0;
+        view.EachInRange(begin, end, [&](size_t slot, Entity e, MeshRenderer& r, Transform& t)
+        {
+            // Meshes are cooked before their first upload; until then there is nothing to draw.
+            auto* m = scene.reg.meshes.TryGet(r.mesh);
+            if (!m || m->revision == 0)
+                return;
+
+            if (r.isStatic)
+            {
+                sig += staticHash(slot, e, r, t, m);
+                ++statics;
+                return;
+            }
+
+            fillItem(slot, e, r, t, m, outItems[slot]);
+        });
+        staticSignature.fetch_add(sig, std::memory_order_relaxed);
+        staticCount.fetch_add(statics, std::memory_order_relaxed);
+    };
+
+    constexpr size_t kSnapshotChunk = 2048;
+    if (workerThreads > 0)
+        king::GetJobSystem().ParallelFor(outItems.size(), kSnapshotChunk, buildRange, workerThreads + 1u);
+    else
+        buildRange(0, outItems.size());
+
+    outItems.erase(std::remove_if(outItems.begin(), outItems.end(), [](const SnapshotItem& it) { return it.mesh == nullptr; }), outItems.end());
+
+    const uint64_t sig = staticSignature.load(std::memory_order_relaxed);
+    const size_t count = staticCount.load(std::memory_order_relaxed);
+    if (sig == mStaticSignature && count == mStaticCount)
+        return;
+
+    mStaticItems.clear();
+    mStaticItems.reserve(count);
+    view.EachInRange(0, view.SizeHint(), [&](size_t slot, Entity e, MeshRenderer& r, Transform& t)
+    {
+        if (!r.isStatic)
+            return;
+        auto* m = scene.reg.meshes.TryGet(r.mesh);
+        if (!m || m->revision == 0)
+            return;
+        SnapshotItem it{};
+        fillItem(slot, e, r, t, m, it);
+        mStaticItems.push_back(it);
+    });
+
+    mStaticSignature = sig;
+    mStaticCount = count;
+    RebuildStaticRegion();
+}
+
+static uint32_t MortonSpread10(uint32_t v)
+{
+    v &= 0x3FFu;
+    v = (v | (v << 16)) & 0x030000FFu;
+    v = (v | (v << 8)) & 0x0300F00Fu;
+    v = (v | (v << 4)) & 0x030C30C3u;
+    v = (v | (v << 2)) & 0x09249249u;
+    return v;
+}
+
+void RenderSystemD3D11::RebuildStaticRegion()
+{
+    const size_t count = mStaticItems.size();
+
+    // Sort key: opaque before blended, mesh, bind group, then a 30-bit Morton code of the position inside the static
+    // bounds, so spatial neighbours (which tend to be visible together) are adjacent.
+    Float3 lo{ FLT_MAX, FLT_MAX, FLT_MAX };
+    Float3 hi{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (const SnapshotItem& it : mStaticItems)
+    {
+        const float* w = it.world.m;
+        lo = { std::min(lo.x, w[12]), std::min(lo.y, w[13]), std::min(lo.z, w[14]) };
+        hi = { std::max(hi.x, w[12]), std::max(hi.y, w[13]), std::max(hi.z, w[14]) };
+    }
+    const float sx = (hi.x > lo.x) ? 1023.0f / (hi.x - lo.x) : 0.0f;
+    const float sy = (hi.y > lo.y) ? 1023.0f / (hi.y - lo.y) : 0.0f;
+    const float sz = (hi.z > lo.z) ? 1023.0f / (hi.z - lo.z) : 0.0f;
+
+    struct Key
+    {
+        bool alphaBlend;
+        uintptr_t mesh;
+        uint32_t bindGroup;
+        uint32_t morton;
+        uint32_t index;
+    };
+    std::vector<Key> keys(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const SnapshotItem& it = mStaticItems[i];
+        const float* w = it.world.m;
+        const uint32_t qx = (uint32_t)((w[12] - lo.x) * sx);
+        const uint32_t qy = (uint32_t)((w[13] - lo.y) * sy);
+        const uint32_t qz = (uint32_t)((w[14] - lo.z) * sz);
+        keys[i] = { it.alphaBlend, (uintptr_t)it.mesh, it.bindGroup, MortonSpread10(qx) | (MortonSpread10(qy) << 1) | (MortonSpread10(qz) << 2), (uint32_t)i };
+    }
+    std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b)
+    {
+        if (a.alphaBlend != b.alphaBlend)
+            return b.alphaBlend;
+        if (a.mesh != b.mesh)
+            return a.mesh < b.mesh;
+        if (a.bindGroup != b.bindGroup)
+            return a.bindGroup < b.bindGroup;
+        return a.morton < b.morton;
+    });
+
+    std::vector<SnapshotItem> sorted;
+    sorted.reserve(count);
+    for (const Key& k : keys)
+        sorted.push_back(mStaticItems[k.index]);
+    mStaticItems.swap(sorted);
+
+    mStaticInstances.resize(count);
+    mStaticSpheres.Resize(count);
+    mStaticBatches.clear();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const SnapshotItem& it = mStaticItems[i];
+        mStaticInstances[i] = MakeInstanceData(it);
+        mStaticSpheres.Set(i, WorldBoundingSphere(it));
+
+        if (mStaticBatches.empty() || mStaticBatches.back().mesh != it.mesh || mStaticItems[mStaticBatches.back().startInstance].bindGroup != it.bindGroup)
+        {
+            StaticBatch b{};
+            b.mesh = it.mesh;
+            b.material = it.material;
+            b.startInstance = (uint32_t)i;
+            b.alphaBlend = it.alphaBlend;
+            mStaticBatches.push_back(b);
+        }
+        mStaticBatches.back().instanceCount++;
+    }
+
+    std::vector<AABB> boxes(count);
+    for (size_t i = 0; i < count; ++i)
+        boxes[i] = SphereBounds({ { mStaticSpheres.x[i], mStaticSpheres.y[i], mStaticSpheres.z[i] }, mStaticSpheres.r[i] });
+    mStaticBvh.Build(boxes.data(), nullptr, count);
+
+    mStaticGpuDirty = true;
+    mGpuCullDirty = true;
+    std::printf("[Render] Static region rebuilt: %zu instances in %zu batches, BVH height %u\n", count, mStaticBatches.size(), mStaticBvh.Height());
+}
+
+void RenderSystemD3D11::CullStaticRegion(const Frustum& frustum, size_t begin, size_t end, std::vector<uint32_t>& out) const
+{
+    out.clear();
+    end = std::min(end, mStaticSpheres.Size());
+    if (begin >= end)
+        return;
+
+    const SphereSoA& s = mStaticSpheres;
+    mStaticBvh.QueryFrustum(frustum, [&](uint32_t i)
+    {
+        if (i < begin || i >= end)
+            return;
+        Sphere sp{};
+        sp.center = { s.x[i], s.y[i], s.z[i] };
+        sp.radius = s.r[i];
+        if (frustum.Intersects(sp))
+            out.push_back(i);
+    });
+    std::sort(out.begin(), out.end());
+}
+
+void RenderSystemD3D11::UploadStaticInstances(RenderDeviceD3D11& device, ID3D11DeviceContext* ctx)
+{
+    if (!mStaticGpuDirty)
+        return;
+    if (mStaticInstances.empty())
+    {
+        mStaticGpuDirty = false;
+        return;
+    }
+
+    ID3D11Device* d = device.Device();
+    if (!d || !ctx)
+        return;
+
+    if (!mStaticInstanceVB || mStaticInstanceCapacity < mStaticInstances.size())
+    {
+        IUnknown* tmp = (IUnknown*)mStaticInstanceVB;
+        SafeRelease(tmp);
+        mStaticInstanceVB = nullptr;
+        mStaticInstanceCapacity = 0;
+
+        // Some headroom so adding a few statics doesn't recreate the buffer.
+        const size_t capacity = mStaticInstances.size() + mStaticInstances.size() / 4 + 64;
+
+        D3D11_BUFFER_DESC bd{};
+        bd.Usage = D3D11_USAGE_DEFAULT;
+        bd.ByteWidth = (UINT)(capacity * sizeof(InstanceData));
+        bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        if (FAILED(d->CreateBuffer(&bd, nullptr, &mStaticInstanceVB)))
+        {
+            mStaticInstanceVB = nullptr;
+            return;
+        }
+        mStaticInstanceCapacity = capacity;
+    }
+
+    D3D11_BOX box{};
+    box.left = 0;
+    box.right = (UINT)(mStaticInstances.size() * sizeof(InstanceData));
+    box.top = 0;
+    box.bottom = 1;
+    box.front = 0;
+    box.back = 1;
+    ctx->UpdateSubresource(mStaticInstanceVB, 0, &box, mStaticInstances.data(), 0, 0);
+    mStaticGpuDirty = false;
+}
+
+void RenderSystemD3D11::UploadGpuCullInstances(RenderDeviceD3D11& device, ID3D11DeviceContext* ctx)
+{
+    if (!mGpuCulling || !mGpuCullDirty)
+        return;
+    mGpuCullDirty = false;
+
+    // Opaque static batches come first; each becomes a bucket over its own instance range.
+    king::FrameArena& frameArena = king::ThreadFrameArena();
+    king::FrameVector<GpuCullingD3D11::Bucket> buckets(&frameArena);
+    king::FrameVector<Float4> spheres(&frameArena);
+    uint32_t opaqueEnd = 0;
+    for (const StaticBatch& sb : mStaticBatches)
+    {
+        if (sb.alphaBlend)
+            break;
+        GpuCullingD3D11::Bucket bk{};
+        bk.firstInstance = sb.startInstance;
+        bk.instanceCount = sb.instanceCount;
+        bk.vertexCount = sb.mesh ? sb.mesh->vertexCount : 0u;
+        if (sb.mesh && sb.mesh->ib)
+        {
+            bk.lodCount = sb.mesh->lodCount;
+            for (uint32_t l = 0; l < bk.lodCount; ++l)
+                bk.lods[l] = sb.mesh->lods[l];
+        }
+        buckets.push_back(bk);
+        opaqueEnd = sb.startInstance + sb.instanceCount;
+    }
+    if (buckets.empty())
+    {
+        mGpuCulling->Clear();
+        return;
+    }
+
+    spheres.resize(opaqueEnd);
+    for (uint32_t i = 0; i < opaqueEnd; ++i)
+        spheres[i] = { mStaticSpheres.x[i], mStaticSpheres.y[i], mStaticSpheres.z[i], mStaticSpheres.r[i] };
+
+    if (!mGpuCulling->Upload(device.Device(), ctx, mStaticInstances.data(), (uint32_t)sizeof(InstanceData),
+            spheres.data(), opaqueEnd, buckets.data(), (uint32_t)buckets.size()))
+    {
+        std::printf("[Render] GPU culling upload failed (%u instances), using CPU culling\n", opaqueEnd);
+    }
+}
+
+void RenderSystemD3D11::BuildDrawBatches(const PreparedFrame& frame, const Frustum& frustum, const MeshLodView& lodView, bool gpuStatic,
+    const std::vector<uint32_t>* staticVisible)
+{
+    mDrawBatches.clear();
+    mDrawMaterials.assign(frame.materials.begin(), frame.materials.end());
+
+    const size_t opaqueDynamic = std::min(frame.opaqueBatchCount, frame.batches.size());
+    const bool haveStatic = !mStaticBatches.empty() && mStaticInstanceVB;
+    gpuStatic = gpuStatic && !staticVisible && haveStatic && mGpuCulling && mGpuCulling->Ready();
+
+    // GPU buckets cover the opaque prefix; only blended statics are culled here.
+    size_t gpuBuckets = 0;
+    if (gpuStatic)
+    {
+        gpuBuckets = std::min<size_t>(mGpuCulling->BucketCount(), mStaticBatches.size());
+        const size_t blendBegin = (gpuBuckets > 0)
+            ? (size_t)mStaticBatches[gpuBuckets - 1].startInstance + mStaticBatches[gpuBuckets - 1].instanceCount
+            : 0;
+        const size_t count = mStaticSpheres.Size();
+        if (mStaticBvhCulling)
+        {
+            CullStaticRegion(frustum, blendBegin, count, mStaticVisible);
+        }
+        else
+        {
+            mStaticVisible.resize(count > blendBegin ? count - blendBegin : 0);
+            mStaticVisible.resize(CullSpheres(frustum, mStaticSpheres, std::min(blendBegin, count), count, mStaticVisible.data()));
+        }
+    }
+    else if (haveStatic && !staticVisible)
+    {
+        if (mStaticBvhCulling)
+            CullStaticRegion(frustum, 0, mStaticSpheres.Size(), mStaticVisible);
+        else
+            CullSpheresParallel(GetJobSystem(), frustum, mStaticSpheres, mStaticVisible, mPrepareParallelism);
+    }
+    const std::vector<uint32_t>& vis = staticVisible ? *staticVisible : mStaticVisible;
+    if (!haveStatic || (vis.empty() && gpuBuckets == 0))
+    {
+        mDrawBatches.assign(frame.batches.begin(), frame.batches.end());
+        mDrawOpaqueCount = opaqueDynamic;
+        return;
+    }
+
+    constexpr uint32_t kNoIndex = 0xFFFFFFFFu;
+    for (size_t i = 0; i < mDrawMaterials.size(); ++i)
+    {
+        const MaterialHandle h = mDrawMaterials[i];
+        if (h >= mDrawMaterialIndex.size())
+            mDrawMaterialIndex.resize((size_t)h + 1, kNoIndex);
+        mDrawMaterialIndex[h] = (uint32_t)i;
+    }
+    auto materialIndexOf = [&](MaterialHandle h)
+    {
+        if (h >= mDrawMaterialIndex.size())
+            mDrawMaterialIndex.resize((size_t)h + 1, kNoIndex);
+        uint32_t& mi = mDrawMaterialIndex[h];
+        if (mi == kNoIndex)
+        {
+            mi = (uint32_t)mDrawMaterials.size();
+            mDrawMaterials.push_back(h);
+        }
+        return mi;
+    };
+
+    // Visible indices are ascending, like the batches (opaque ones first). Each batch emits one
+    // draw per run of visible instances; runs separated by a few culled instances are merged,
+    // since drawing those (they get clipped) is cheaper than another draw call.
+    constexpr uint32_t kRunMergeGap = 8;
+    size_t v = 0;
+    size_t sbi = 0;
+    auto emitStatic = [&](bool alphaBlend)
+    {
+        for (; sbi < mStaticBatches.size() && mStaticBatches[sbi].alphaBlend == alphaBlend; ++sbi)
+        {
+            const StaticBatch& sb = mStaticBatches[sbi];
+            if (sbi < gpuBuckets)
+            {
+                // Drawn whether or not anything survives; the GPU decides the count (and the
+                // LOD, so every level gets its draw).
+                const uint32_t lodCount = sb.mesh ? sb.mesh->lodCount : 1u;
+                for (uint32_t lod = 0; lod < lodCount; ++lod)
+                {
+                    Batch b{};
+                    b.mesh = sb.mesh;
+                    b.lod = lod;
+                    b.materialIndex = materialIndexOf(sb.material);
+                    b.startInstance = sb.startInstance;
+                    b.instanceCount = sb.instanceCount;
+                    b.staticInstances = true;
+                    b.gpuBucket = (uint32_t)sbi;
+                    mDrawBatches.push_back(b);
+                }
+                continue;
+            }
+
+            const uint32_t batchEnd = sb.startInstance + sb.instanceCount;
+            if (v >= vis.size() || vis[v] >= batchEnd)
+                continue;
+
+            const uint32_t mi = materialIndexOf(sb.material);
+            auto lodOf = [&](uint32_t i)
+            {
+                return SelectMeshLod(*sb.mesh, lodView, mStaticSpheres.x[i], mStaticSpheres.y[i], mStaticSpheres.z[i], mStaticSpheres.r[i]);
+            };
+            while (v < vis.size() && vis[v] < batchEnd)
+            {
+                const uint32_t runStart = vis[v];
+                const uint32_t runLod = lodOf(runStart);
+                uint32_t runEnd = runStart + 1;
+                ++v;
+                while (v < vis.size() && vis[v] < batchEnd && vis[v] - runEnd <= kRunMergeGap && lodOf(vis[v]) == runLod)
+                {
+                    runEnd = vis[v] + 1;
+                    ++v;
+                }
+
+                Batch b{};
+                b.mesh = sb.mesh;
+                b.lod = runLod;
+                b.materialIndex = mi;
+                b.startInstance = runStart;
+                b.instanceCount = runEnd - runStart;
+                b.staticInstances = true;
+                mDrawBatches.push_back(b);
+            }
+        }
+    };
+
+    // Opaque (dynamic, static), then blended. Static blended draws follow the depth-sorted
+    // dynamic ones rather than interleaving with them.
+    mDrawBatches.insert(mDrawBatches.end(), frame.batches.begin(), frame.batches.begin() + opaqueDynamic);
+    emitStatic(false);
+    mDrawOpaqueCount = mDrawBatches.size();
+    mDrawBatches.insert(mDrawBatches.end(), frame.batches.begin() + opaqueDynamic, frame.batches.end());
+    emitStatic(true);
+
+    for (MaterialHandle h : mDrawMaterials)
+        mDrawMaterialIndex[h] = kNoIndex;
+}
+
+void RenderSystemD3D11::DrawBatchInstances(StateCacheD3D11& sc, const Batch& b) const
+{
+    const bool indirect = b.gpuBucket != kNoGpuBucket && mGpuCulling;
+    const bool dynamic = !indirect && !b.staticInstances;
+    ID3D11Buffer* instances = indirect ? mGpuCulling->InstanceVB() : (b.staticInstances ? mStaticInstanceVB : mInstanceRing.Buffer());
+    ID3D11Buffer* vbs[2] = { b.mesh->vb, instances };
+    UINT strides[2] = { (UINT)sizeof(PackedVertex), (UINT)sizeof(InstanceData) };
+    UINT offsets[2] = { 0u, dynamic ? mMainInstanceFirst * (UINT)sizeof(InstanceData) : 0u };
+    sc.SetVertexBuffers(0, 2, vbs, strides, offsets);
+
+    const MeshLod& lod = b.mesh->lods[std::min(b.lod, b.mesh->lodCount - 1u)];
+    const bool indexed = b.mesh->ib && lod.indexCount > 0;
+    if (indexed)
+        sc.SetIndexBuffer(b.mesh->ib, b.mesh->index32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT, 0);
+
+    if (indirect)
+    {
+        const UINT argsOffset = mGpuCulling->ArgsOffset(b.gpuBucket, b.lod);
+        if (indexed)
+            sc.DrawIndexedInstancedIndirect(mGpuCulling->ArgsBuffer(), argsOffset);
+        else
+            sc.DrawInstancedIndirect(mGpuCulling->ArgsBuffer(), argsOffset);
+    }
+    else if (indexed)
+    {
+        sc.DrawIndexedInstanced(lod.indexCount, b.instanceCount, lod.firstIndex, 0, b.startInstance);
+    }
+    else
+    {
+        sc.DrawInstanced(b.mesh->vertexCount, b.instanceCount, 0, b.startInstance);
+    }
+}
+
+PipelineStateD3D11 RenderSystemD3D11::GeometryPipeline(RenderDeviceD3D11& device, const ShaderProgramD3D11* program,
+    bool alphaBlend, bool mrt) const
+{
+    PipelineStateD3D11 p{};
+    if (program && (!mrt || program->HasMrtVariant()))
+    {
+        p.layout = program->InputLayout();
+        p.vs = program->VS();
+        p.ps = mrt ? program->PSMrt() : program->PS();
+    }
+    else
+    {
+        // Can't render into the normal MRT without PSMainMRT: engine default.
+        p.layout = mInputLayout;
+        p.vs = mVS;
+        p.ps = mrt ? mPSMrt : mPS;
+    }
+    p.blend = alphaBlend ? mBlendAlpha : mBlendOpaque;
+    p.dss = (alphaBlend && mDepthReadOnly) ? mDepthReadOnly : device.DSS();
+    p.rs = device.RS();
+    p.topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    return p;
+}
+
+void RenderSystemD3D11::DrawGeometryBatches(StateCacheD3D11& sc, size_t begin, size_t end,
+    const king::FrameVector<const MaterialGpu*>& frameMaterials, const PipelineStateD3D11& fallback, bool mrt) const
+{
+    for (size_t bi = begin; bi < end; ++bi)
+    {
+        const Batch& b = mDrawBatches[bi];
+        if (!b.mesh || !b.mesh->vb)
+            continue;
+
+        const uint32_t mi = b.materialIndex;
+        const MaterialGpu* mg = (mi < frameMaterials.size()) ? frameMaterials[mi] : nullptr;
+        sc.SetPipeline(mg ? mg->pipelines[mrt ? 1 : 0] : fallback);
+
+        if (mg)
+        {
+            // Parameters come from the material buffer (t14) through the instance material id.
+            ID3D11ShaderResourceView* srvs[4] = {
+                mg->albedoSRV ? mg->albedoSRV : mTextures.White(),
+                mg->normalSRV ? mg->normalSRV : mTextures.White(),
+                mg->mrSRV ? mg->mrSRV : mTextures.White(),
+                mg->emissiveSRV ? mg->emissiveSRV : mTextures.Black()
+            };
+            sc.SetPSShaderResources(5, 4, srvs);
+        }
+
+        DrawBatchInstances(sc, b);
+    }
+}
+
+void RenderSystemD3D11::ReportStateCacheStats()
+{
+    StateCacheD3D11::Stats total = mImmediateState.GetStats();
+    mImmediateState.ResetStats();
+    for (StateCacheD3D11& sc : mDeferredStateCaches)
+    {
+        total += sc.GetStats();
+        sc.ResetStats();
+    }
+    if (mShadows)
+    {
+        total += mShadows->StateStats();
+        mShadows->ResetStateStats();
+    }
+    mPerf.AddCount("StateBinds", total.issued);
+    mPerf.AddCount("StateBindsSkipped", total.skipped);
+}
+
+RenderSystemD3D11::PassCounters RenderSystemD3D11::CurrentPassCounters() const
+{
+    PassCounters c{};
+    c.binds = mImmediateState.GetStats();
+    for (const StateCacheD3D11& sc : mDeferredStateCaches)
+        c.binds += sc.GetStats();
+    if (mShadows)
+    {
+        c.binds += mShadows->StateStats();
+        c.mapBytes += mShadows->MapBytes();
+    }
+    if (mGpuCulling)
+        c.mapBytes += mGpuCulling->MapBytes();
+    c.mapBytes += mMapBytes + mInstanceRing.MapBytes() + mPost.MapBytes();
+    return c;
+}
+
+void RenderSystemD3D11::MarkFramePass(const char* name)
+{
+    const PassCounters now = CurrentPassCounters();
+    const char* running = mPassName ? mPassName : "Other";
+
+    FrameStats::Pass* pass = nullptr;
+    for (uint32_t i = 0; i < mFrameStats.passCount && !pass; ++i)
+    {
+        if (std::strcmp(mFrameStats.passes[i].name, running) == 0)
+            pass = &mFrameStats.passes[i];
+    }
+    if (!pass && mFrameStats.passCount < FrameStats::kMaxPasses)
+    {
+        pass = &mFrameStats.passes[mFrameStats.passCount++];
+        pass->name = running;
+    }
+
+    if (pass)
+    {
+        const StateCacheD3D11::Stats& a = mPassMark.binds;
+        const StateCacheD3D11::Stats& b = now.binds;
+        pass->draws += b.draws - a.draws;
+        pass->indirectDraws += b.indirectDraws - a.indirectDraws;
+        pass->instances += b.instances - a.instances;
+        pass->dispatches += b.dispatches - a.dispatches;
+        pass->stateChanges += b.issued - a.issued;
+        pass->stateChangesSkipped += b.skipped - a.skipped;
+        pass->mapBytes += now.mapBytes - mPassMark.mapBytes;
+    }
+
+    mPassMark = now;
+    mPassName = name;
+}
+
+void RenderSystemD3D11::BeginFrameStats()
+{
+    mFrameStats = FrameStats{};
+    mPassMark = CurrentPassCounters();
+    mPassName = nullptr;
+    mFrameAllocStart = king::perf::AllocationCount();
+    mFrameThreadAllocStart = king::perf::ThreadAllocationCount();
+}
+
+void RenderSystemD3D11::EndFrameStats(ID3D11DeviceContext* ctx)
+{
+    MarkFramePass(nullptr);
+
+    FrameStats& fs = mFrameStats;
+    fs.total = FrameStats::Pass{};
+    fs.total.name = "Frame";
+    for (uint32_t i = 0; i < fs.passCount; ++i)
+    {
+        const FrameStats::Pass& p = fs.passes[i];
+        fs.total.draws += p.draws;
+        fs.total.indirectDraws += p.indirectDraws;
+        fs.total.instances += p.instances;
+        fs.total.dispatches += p.dispatches;
+        fs.total.stateChanges += p.stateChanges;
+        fs.total.stateChangesSkipped += p.stateChangesSkipped;
+        fs.total.mapBytes += p.mapBytes;
+    }
+
+    if (mGpuPerf.PipelineStatsEnabled() && mGpuPerf.TryGetPipelineStats(ctx, fs.pipelineFrame, mPipelineStatsScratch))
+    {
+        for (const auto& s : mPipelineStatsScratch)
+        {
+            if (fs.pipelineCount == FrameStats::kMaxPasses)
+                break;
+            fs.pipeline[fs.pipelineCount++] = { s.first, s.second };
+            if (s.first && std::strcmp(s.first, "Frame") == 0)
+                mPerf.AddCount("GpuPrimitives", s.second.IAPrimitives);
+        }
+    }
+
+    if (mShadows)
+        fs.shadowMaps = mShadows->GpuMemory();
+    fs.shadowMaps.Add(mShadowAtlasTex);
+    fs.shadowMaps.Add(mShadowAtlasDepthTex);
+
+    fs.renderTargets.Add(mHdrTex);
+    fs.renderTargets.Add(mNormalTex);
+    fs.renderTargets.Add(mDepthTex);
+    for (ID3D11Texture2D* tex : mSsaoHistoryTex)
+        fs.renderTargets.Add(tex);
+    fs.renderTargets += mFrameGraph.PoolMemory();
+
+    fs.instanceBuffers = mInstanceRing.GpuMemory();
+    fs.instanceBuffers.Add(mStaticInstanceVB);
+    if (mGpuCulling)
+    {
+        fs.instanceBuffers += mGpuCulling->BufferMemory();
+        fs.renderTargets += mGpuCulling->HiZMemory();
+    }
+
+    fs.textures = mTextures.GpuMemory();
+
+    fs.allocations = king::perf::AllocationCount() - mFrameAllocStart;
+    fs.renderThreadAllocations = king::perf::ThreadAllocationCount() - mFrameThreadAllocStart;
+    const king::FrameArena& arena = king::ThreadFrameArena();
+    fs.frameArenaBytes = arena.BytesUsed();
+    fs.frameArenaOverflows = arena.Overflows();
+
+    if (mAllocCheckWarmup > 0)
+    {
+        if (mAllocCheckFrames < mAllocCheckWarmup)
+        {
+            ++mAllocCheckFrames;
+        }
+        else if (fs.renderThreadAllocations > 0)
+        {
+            // Log the first few, then every 256th, so a steady leak doesn't flood stdout.
+            if (mAllocCheckFailures < 8 || (mAllocCheckFailures & 255u) == 0)
+            {
+                std::printf("AllocCheck: render thread made %llu heap allocations this frame (arena %llu bytes, %u overflow blocks)\n",
+                    (unsigned long long)fs.renderThreadAllocations, (unsigned long long)fs.frameArenaBytes, fs.frameArenaOverflows);
+            }
+            ++mAllocCheckFailures;
+        }
+    }
+
+    mPerf.AddCount("Draws", fs.total.draws);
+    mPerf.AddCount("Instances", fs.total.instances);
+    mPerf.AddCount("Dispatches", fs.total.dispatches);
+    mPerf.AddCount("MapKB", fs.total.mapBytes / 1024u);
+    mPerf.AddCount("Allocations", fs.allocations);
+    mPerf.AddCount("RenderThreadAllocs", fs.renderThreadAllocations);
+    mPerf.AddCount("FrameArenaKB", fs.frameArenaBytes / 1024u);
+    mPerf.AddCount("GpuMemoryMB", (fs.shadowMaps.bytes + fs.renderTargets.bytes + fs.instanceBuffers.bytes + fs.textures.bytes) >> 20);
+}
+
+void RenderSystemD3D11::PrepareSnapshot(Scene& scene, uint32_t workerThreads)
+{
+    BuildSnapshot(scene, mSnapshotScratch, workerThreads);
+    mSnapshotPrepared = true;
+}
+
+void RenderSystemD3D11::EnqueueBuild(std::vector<SnapshotItem>& items, const Frustum& frustum, const MeshLodView& lodView)
+{
+    if (!mUsePrepareWorker || mPrepareLatency == 0 || mPrepareFreeCount == 0)
+        return;
+
+    const uint32_t slot = mPrepareFree[--mPrepareFreeCount];
+    PrepareSlot& ps = mPrepareSlots[slot];
+    // Swap so caller keeps a vector with capacity for the next frame.
+    ps.items.swap(items);
+    ps.frustum = frustum;
+    ps.lodView = lodView;
+
+    (void)mPrepareToWorker.TryPush(slot);
+    ++mPrepareInFlight;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!mPrepareJobActive.exchange(true))
+    {
+        // Pinned to the last worker: frame prep is long-running, so keep it away from
+        // threads that only help out while waiting on short jobs.
+        king::JobSystem& jobs = king::GetJobSystem();
+        jobs.Submit(mPrepareJob, [this]() { PrepareJobMain(); }, jobs.WorkerCount() - 1u);
+    }
+}
+
+const RenderSystemD3D11::PreparedFrame& RenderSystemD3D11::AcquireFrameToRender(const Frustum& frustum, const MeshLodView& lodView)
+{
+    // Last frame's slot has been submitted; recycle it.
+    if (mRenderSlot != kNoPrepareSlot)
+    {
+        mPrepareFree[mPrepareFreeCount++] = mRenderSlot;
+        mRenderSlot = kNoPrepareSlot;
+    }
+
+    // Keep only the newest finished frame; older ones are stale.
+    uint32_t newest = kNoPrepareSlot;
+    auto takeResult = [&](uint32_t slot)
+    {
+        if (newest != kNoPrepareSlot)
+            mPrepareFree[mPrepareFreeCount++] = newest;
+        newest = slot;
+        --mPrepareInFlight;
+    };
+
+    uint32_t slot = kNoPrepareSlot;
+    while (mPrepareToMain.TryPop(slot))
+        takeResult(slot);
+
+    // Bound the latency: the snapshot from `mPrepareLatency` frames ago must be done, so at
+    // most latency-1 newer ones may still be in flight. At latency 0 nothing stays in flight.
+    const uint32_t maxInFlight = (mPrepareLatency > 0) ? (mPrepareLatency - 1u) : 0u;
+    while (mPrepareInFlight > maxInFlight)
+    {
+        if (mPrepareToMain.TryPop(slot))
+            takeResult(slot);
+        else
+            std::this_thread::yield();
+    }
+
+    if (newest != kNoPrepareSlot && mPrepareLatency > 0)
+    {
+        mRenderSlot = newest;
+        return mPrepareSlots[newest].frame;
+    }
+    if (newest != kNoPrepareSlot)
+        mPrepareFree[mPrepareFreeCount++] = newest;
+
+    // Pipeline warm-up, latency 0 or no worker: prepare this frame's snapshot inline.
+    BuildPreparedFrame(mSnapshotScratch, frustum, lodView, mPrepareParallelism, king::ThreadFrameArena(), mInlineFrame);
+    return mInlineFrame;
+}
+
+Sphere RenderSystemD3D11::WorldBoundingSphere(const SnapshotItem& s)
+{
+    // Row-vector convention: center * world.
+    const float* w = s.world.m;
+    const Float3& c = s.boundsCenter;
+    Sphere sp{};
+    sp.center = {
+        c.x * w[0] + c.y * w[4] + c.z * w[8] + w[12],
+        c.x * w[1] + c.y * w[5] + c.z * w[9] + w[13],
+        c.x * w[2] + c.y * w[6] + c.z * w[10] + w[14]
+    };
+    sp.radius = s.mesh ? (s.boundsRadius * s.maxScale) : -FLT_MAX;
+    return sp;
+}
+
+RenderSystemD3D11::InstanceData RenderSystemD3D11::MakeInstanceData(const SnapshotItem& s)
+{
+    // Packed positions are in [0, 1] over the mesh's quantization box:
+    // world' = [diag(scale), 0; offset, 1] * world.
+    const Float3 qs = s.mesh ? s.mesh->quantScale : Float3{ 1, 1, 1 };
+    const Float3 qo = s.mesh ? s.mesh->quantOffset : Float3{ 0, 0, 0 };
+    const float* w = s.world.m;
+    float rows[4][4];
+    for (int c = 0; c < 4; ++c)
+    {
+        rows[0][c] = qs.x * w[c];
+        rows[1][c] = qs.y * w[4 + c];
+        rows[2][c] = qs.z * w[8 + c];
+        rows[3][c] = qo.x * w[c] + qo.y * w[4 + c] + qo.z * w[8 + c] + w[12 + c];
+    }
+
+    InstanceData inst{};
+    for (int c = 0; c < 3; ++c)
+    {
+        for (int r = 0; r < 4; ++r)
+            inst.worldCols[c][r] = rows[r][c];
+    }
+    inst.lightMask = s.lightMask;
+    const uint32_t materialId = (s.material < kMaxMaterialIds) ? s.material : kDefaultMaterial;
+    inst.flags = (s.flags & ((1u << kInstMaterialShift) - 1u)) | (materialId << kInstMaterialShift);
+    return inst;
+}
+
+void RenderSystemD3D11::BuildPreparedFrame(const std::vector<SnapshotItem>& items, const Frustum& frustum, const MeshLodView& lodView,
+    uint32_t maxParallelism, king::FrameArena& arena, PreparedFrame& outFrame)
+{
+    // Frustum culling: world spheres into SoA arrays, then the batched kernel, both split
+    // across job workers. This runs on the prep job (or inline on the render thread).
+    SphereSoA spheres(&arena); // filled by other worker threads below
+    spheres.Resize(items.size());
+
+    JobSystem& jobs = GetJobSystem();
+    constexpr size_t kBoundsChunk = 4096;
+    jobs.ParallelFor(items.size(), kBoundsChunk, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            spheres.Set(i, WorldBoundingSphere(items[i]));
+    }, maxParallelism);
+
+    king::FrameVector<uint32_t> visible(items.size(), &arena);
+    const size_t visibleCount = CullSpheresParallel(jobs, frustum, spheres, visible.data(), maxParallelism);
+    BuildPreparedBatches(items, spheres, visible.data(), visibleCount, frustum, lodView, maxParallelism, arena, outFrame);
+}
+
+void RenderSystemD3D11::BuildPreparedBatches(const std::vector<SnapshotItem>& items, const SphereSoA& spheres,
+    const uint32_t* visibleIndices, size_t visibleCount, const Frustum& frustum, const MeshLodView& lodView,
+    uint32_t maxParallelism, king::FrameArena& arena, PreparedFrame& outFrame)
+{
+    outFrame.instances.clear();
+    outFrame.batches.clear();
+    outFrame.materials.clear();
+    outFrame.opaqueBatchCount = 0;
+    if (visibleCount == 0)
+        return;
+
+    // Handle -> frame-local material index, grown as handles appear.
+    constexpr uint32_t kNoIndex = 0xFFFFFFFFu;
+    king::FrameVector<uint32_t> handleToIndex(&arena);
+    JobSystem& jobs = GetJobSystem();
+    constexpr size_t kBoundsChunk = 4096;
+
+    // Draw keys for the visible items (see draw_key.h). Depth is the distance of the bounds
+    // center from the near plane, which orders along the view direction. The LOD goes into
+    // the mesh field, so each (mesh, LOD) pair sorts into its own batch.
+    king::FrameVector<DrawSortPair> pairs(visibleCount, &arena);
+    king::FrameVector<DrawSortPair> pairScratch(&arena);
+    king::FrameVector<uint8_t> lods(items.size(), &arena);
+    const Plane nearPlane = frustum.planes[4];
+    jobs.ParallelFor(pairs.size(), kBoundsChunk, [&](size_t begin, size_t end)
+    {
+        for (size_t k = begin; k < end; ++k)
+        {
+            const uint32_t i = visibleIndices[k];
+            const SnapshotItem& s = items[i];
+            const float depth = nearPlane.n.x * spheres.x[i] + nearPlane.n.y * spheres.y[i] + nearPlane.n.z * spheres.z[i] + nearPlane.d;
+            const uint32_t lod = SelectMeshLod(*s.mesh, lodView, spheres.x[i], spheres.y[i], spheres.z[i], spheres.r[i]);
+            lods[i] = (uint8_t)lod;
+            const uint32_t meshKey = (s.meshId << 2) | lod;
+            static_assert(kMaxMeshLods <= 4, "mesh draw key field holds 2 LOD bits");
+            pairs[k].key = s.alphaBlend
+                ? MakeBlendedDrawKey(s.program, s.bindGroup, meshKey, depth)
+                : MakeOpaqueDrawKey(s.program, s.bindGroup, meshKey, depth);
+            pairs[k].index = i;
+        }
+    }, maxParallelism);
+
+    RadixSortDrawPairs(jobs, pairs, pairScratch, maxParallelism);
+
+    outFrame.instances.reserve(pairs.size());
+    outFrame.batches.reserve(64);
+
+    Batch currentBatch{};
+    bool currentBlended = false;
+    uint32_t currentBindGroup = 0;
+
+    for (const DrawSortPair& p : pairs)
+    {
+        const SnapshotItem& s = items[p.index];
+
+        if (s.material >= handleToIndex.size())
+            handleToIndex.resize((size_t)s.material + 1, kNoIndex);
+        uint32_t& slot = handleToIndex[s.material];
+        if (slot == kNoIndex)
+        {
+            slot = (uint32_t)outFrame.materials.size();
+            outFrame.materials.push_back(s.material);
+        }
+
+        const bool blended = IsBlendedDrawKey(p.key);
+        const uint32_t lod = lods[p.index];
+        // Materials of one bind group differ only in material buffer values, so they share a batch.
+        if (s.mesh != currentBatch.mesh || lod != currentBatch.lod || s.bindGroup != currentBindGroup || blended != currentBlended)
+        {
+            if (currentBatch.mesh)
+                outFrame.batches.push_back(currentBatch);
+            if (blended && !currentBlended)
+                outFrame.opaqueBatchCount = outFrame.batches.size();
+
+            currentBlended = blended;
+            currentBindGroup = s.bindGroup;
+            currentBatch = {};
+            currentBatch.mesh = s.mesh;
+            currentBatch.lod = lod;
+            currentBatch.materialIndex = slot;
+            currentBatch.startInstance = (uint32_t)outFrame.instances.size();
+            currentBatch.instanceCount = 0;
+        }
+
+        outFrame.instances.push_back(MakeInstanceData(s));
+        currentBatch.instanceCount++;
+    }
+
+    if (currentBatch.mesh)
+        outFrame.batches.push_back(currentBatch);
+    if (!currentBlended)
+        outFrame.opaqueBatchCount = outFrame.batches.size();
+}
+
+// A view's viewport; width 0 covers its whole target (the back buffer's: outputViewport).
+static D3D11_VIEWPORT ResolveViewViewport(const RenderSystemD3D11::RenderView& v, const D3D11_VIEWPORT& outputViewport)
+{
+    if (v.viewport.Width > 0.0f && v.viewport.Height > 0.0f)
+        return v.viewport;
+    if (!v.target)
+        return outputViewport;
+    D3D11_VIEWPORT vp{};
+    vp.Width = (float)v.target->width;
+    vp.Height = (float)v.target->height;
+    vp.MaxDepth = 1.0f;
+    return vp;
+}
+
+// ClearRenderTargetView clears the whole target; a view in part of the back buffer clears
+// just its rectangle (ID3D11DeviceContext1, D3D 11.1 runtime; left as is without it).
+static void ClearViewportRect(ID3D11DeviceContext* ctx, ID3D11RenderTargetView* rtv, const float color[4], const D3D11_VIEWPORT& vp)
+{
+    ID3D11DeviceContext1* ctx1 = nullptr;
+    if (FAILED(ctx->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&ctx1)) || !ctx1)
+        return;
+    const D3D11_RECT rect{ (LONG)vp.TopLeftX, (LONG)vp.TopLeftY, (LONG)(vp.TopLeftX + vp.Width), (LONG)(vp.TopLeftY + vp.Height) };
+    ctx1->ClearView(rtv, color, &rect, 1);
+    ctx1->Release();
+}
+
+void RenderSystemD3D11::PrepareSecondaryViews(RenderDeviceD3D11& device, const RenderSettings& settings)
+{
+    static_assert(kMaxRenderViews <= kMaxCullViews, "one cull mask bit per view");
+    const uint32_t count = mExtraViewCount;
+    mViewFrames.resize(count);
+    mViewLods.resize(count);
+    mViewVisible.resize(count);
+    mViewStaticVisible.resize(count);
+
+    Frustum frustums[kMaxRenderViews];
+    for (uint32_t v = 0; v < count; ++v)
+    {
+        const RenderView& rv = mExtraViews[v];
+        frustums[v] = rv.frustum;
+        mViewLods[v] = settings.enableMeshLod
+            ? MakeMeshLodView(rv.viewProj, ResolveViewViewport(rv, device.Viewport()).Height, settings.meshLodBias)
+            : MeshLodView{};
+    }
+
+    // This frame's snapshot (the main view may render an older prepared one) and the static
+    // region, each tested against every view's frustum in a single pass.
+    const std::vector<SnapshotItem>& items = mSnapshotScratch;
+    JobSystem& jobs = GetJobSystem();
+    constexpr size_t kBoundsChunk = 4096;
+    mViewSpheres.Resize(items.size());
+    jobs.ParallelFor(items.size(), kBoundsChunk, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            mViewSpheres.Set(i, WorldBoundingSphere(items[i]));
+    }, mPrepareParallelism);
+    CullSpheresMultiParallel(jobs, frustums, count, mViewSpheres, mViewMasks, mPrepareParallelism);
+    if (!mStaticBvhCulling)
+        CullSpheresMultiParallel(jobs, frustums, count, mStaticSpheres, mViewStaticMasks, mPrepareParallelism);
+
+    for (uint32_t v = 0; v < count; ++v)
+    {
+        const uint32_t bit = 1u << v;
+        std::vector<uint32_t>& visible = mViewVisible[v];
+        visible.clear();
+        for (size_t i = 0; i < mViewMasks.size(); ++i)
+        {
+            if (mViewMasks[i] & bit)
+                visible.push_back((uint32_t)i);
+        }
+        std::vector<uint32_t>& staticVisible = mViewStaticVisible[v];
+        if (mStaticBvhCulling)
+        {
+            CullStaticRegion(frustums[v], 0, mStaticSpheres.Size(), staticVisible);
+        }
+        else
+        {
+            staticVisible.clear();
+            for (size_t i = 0; i < mViewStaticMasks.size(); ++i)
+            {
+                if (mViewStaticMasks[i] & bit)
+                    staticVisible.push_back((uint32_t)i);
+            }
+        }
+
+        BuildPreparedBatches(items, mViewSpheres, visible.data(), visible.size(), frustums[v], mViewLods[v], mPrepareParallelism,
+            king::ThreadFrameArena(), mViewFrames[v]);
+    }
+}
+
+void RenderSystemD3D11::UpdateCameraCB(ID3D11DeviceContext* ctx, const Mat4x4& viewProj, const Float3& cameraPos, float exposure, float aoStrength)
+{
+    CameraCBData data{};
+    data.viewProj = viewProj;
+    data.cameraPos[0] = cameraPos.x;
+    data.cameraPos[1] = cameraPos.y;
+    data.cameraPos[2] = cameraPos.z;
+    data.exposure = exposure;
+    data.aoStrength = std::clamp(aoStrength, 0.0f, 1.0f);
+
+    D3D11_MAPPED_SUBRESOURCE mapped{};
+    if (SUCCEEDED(ctx->Map(mCameraCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+    {
+        std::memcpy(mapped.pData, &data, sizeof(data));
+        ctx->Unmap(mCameraCB, 0);
+        mMapBytes += sizeof(data);
+    }
+}
+
+void RenderSystemD3D11::UpdateLightCB(ID3D11DeviceContext* ctx, const LightCBData& data)
+{
+    D3D11_MAPPED_SUBRESOURCE mapped{};
+    if (SUCCEEDED(ctx->Map(mLightCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+    {
+        std::memcpy(mapped.pData, &data, sizeof(data));
+        ctx->Unmap(mLightCB, 0);
+        mMapBytes += sizeof(data);
+    }
+}
+
+void RenderSystemD3D11::EnsureMeshBuffers(RenderDeviceD3D11& device, Mesh& mesh, StreamBudget& budget)
+{
+    ID3D11Device* d = device.Device();
+    if (!d || mesh.vb)
+        return;
+
+    // Pack meshes upload straight from the mapping once paged in, within the frame's budget.
+    if (mesh.pack && mesh.packEntry)
+    {
+        const AssetRef ref{ mesh.pack, mesh.packEntry };
+        PackMeshView view{};
+        if (!ReadPackMesh(*mesh.pack, *mesh.packEntry, view))
+        {
+            mesh.pack = nullptr;
+            mesh.packEntry = nullptr;
+            return;
+        }
+        if (!mStreamer.Prefetch(ref) || !budget.Take(mesh.packEntry->size))
+            return;
+
+        D3D11_BUFFER_DESC bd{};
+        bd.Usage = D3D11_USAGE_IMMUTABLE;
+        bd.ByteWidth = view.vertexBytes;
+        bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        D3D11_SUBRESOURCE_DATA init{};
+        init.pSysMem = view.vertices;
+        (void)d->CreateBuffer(&bd, &init, &mesh.vb);
+
+        if (view.indices && !mesh.ib)
+        {
+            bd.ByteWidth = view.indexBytes;
+            bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+            init.pSysMem = view.indices;
+            (void)d->CreateBuffer(&bd, &init, &mesh.ib);
+        }
+        if (mesh.vb && (mesh.ib || !view.indices) && mesh.revision == 0)
+            mesh.revision = 1;
+        return;
+    }
+
+    // Meshes that were not cooked up front (or were released and need a re-upload) are cooked
+    // here with the default options.
+    if (mesh.packedVertices.empty() && !CookMesh(mesh))
+        return;
+
+    {
+        D3D11_BUFFER_DESC bd{};
+        bd.Usage = D3D11_USAGE_IMMUTABLE;
+        bd.ByteWidth = (UINT)(mesh.packedVertices.size() * sizeof(PackedVertex));
+        bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+        D3D11_SUBRESOURCE_DATA init{};
+        init.pSysMem = mesh.packedVertices.data();
+
+        (void)d->CreateBuffer(&bd, &init, &mesh.vb);
+    }
+
+    if (!mesh.ib && !mesh.packedIndices.empty())
+    {
+        thread_local std::vector<uint16_t> tIndices16;
+        const void* data = mesh.packedIndices.data();
+        size_t indexSize = sizeof(uint32_t);
+        if (!mesh.index32)
+        {
+            tIndices16.assign(mesh.packedIndices.begin(), mesh.packedIndices.end());
+            data = tIndices16.data();
+            indexSize = sizeof(uint16_t);
+        }
+
+        D3D11_BUFFER_DESC bd{};
+        bd.Usage = D3D11_USAGE_IMMUTABLE;
+        bd.ByteWidth = (UINT)(mesh.packedIndices.size() * indexSize);
+        bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+
+        D3D11_SUBRESOURCE_DATA init{};
+        init.pSysMem = data;
+
+        (void)d->CreateBuffer(&bd, &init, &mesh.ib);
+    }
+
+    if (!mesh.vb)
+        return;
+
+    // The cooked copy only exists for the upload.
+    std::vector<PackedVertex>().swap(mesh.packedVertices);
+    std::vector<uint32_t>().swap(mesh.packedIndices);
+    if (!mesh.keepCpuData)
+    {
+        std::vector<VertexPN>().swap(mesh.vertices);
+        std::vector<uint32_t>().swap(mesh.indices);
+        std::vector<MeshLodSource>().swap(mesh.lodSources);
+    }
+}
+
+void RenderSystemD3D11::EnsureHdrTargets(RenderDeviceD3D11& device, bool needSsao)
+{
+    ID3D11Device* d = device.Device();
+    if (!d)
+        return;
+
+    const uint32_t w = device.BackBufferWidth();
+    const uint32_t h = device.BackBufferHeight();
+    if (w == 0 || h == 0)
+        return;
+
+    if (mHdrTex && mHdrRTV && mHdrSRV && mHdrW == w && mHdrH == h)
+    {
+        if (!needSsao || (mNormalTex && mNormalRTV && mNormalSRV))
+            return;
+    }
+
+    IUnknown* tmp = nullptr;
+
+    tmp = (IUnknown*)mHdrSRV;
+    SafeRelease(tmp);
+    mHdrSRV = nullptr;
+
+    tmp = (IUnknown*)mHdrRTV;
+    SafeRelease(tmp);
+    mHdrRTV = nullptr;
+
+    tmp = (IUnknown*)mHdrTex;
+    SafeRelease(tmp);
+    mHdrTex = nullptr;
+
+    tmp = (IUnknown*)mNormalSRV;
+    SafeRelease(tmp);
+    mNormalSRV = nullptr;
+
+    tmp = (IUnknown*)mNormalRTV;
+    SafeRelease(tmp);
+    mNormalRTV = nullptr;
+
+    tmp = (IUnknown*)mNormalTex;
+    SafeRelease(tmp);
+    mNormalTex = nullptr;
+
+    D3D11_TEXTURE2D_DESC td{};
+    td.Width = w;
+    td.Height = h;
+    td.MipLevels = 1;
+    td.ArraySize = 1;
+    td.SampleDesc.Count = 1;
+    td.Usage = D3D11_USAGE_DEFAULT;
+
+    // HDR target
+    td.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    td.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+    if (FAILED(d->CreateTexture2D(&td, nullptr, &mHdrTex)) || !mHdrTex)
+        return;
+
+    if (FAILED(d->CreateRenderTargetView(mHdrTex, nullptr, &mHdrRTV)) || !mHdrRTV)
+        return;
+
+    if (FAILED(d->CreateShaderResourceView(mHdrTex, nullptr, &mHdrSRV)) || !mHdrSRV)
+        return;
+
+    // Normal target (world-space normal encoded to [0,1])
+    if (needSsao)
+    {
+        td.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+        td.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+        if (FAILED(d->CreateTexture2D(&td, nullptr, &mNormalTex)) || !mNormalTex)
+            return;
+        if (FAILED(d->CreateRenderTargetView(mNormalTex, nullptr, &mNormalRTV)) || !mNormalRTV)
+            return;
+        if (FAILED(d->CreateShaderResourceView(mNormalTex, nullptr, &mNormalSRV)) || !mNormalSRV)
+            return;
+    }
+
+    mHdrW = w;
+    mHdrH = h;
+}
+
+void RenderSystemD3D11::EnsureSceneDepth(RenderDeviceD3D11& device)
 {
+    // Backbuffer-sized depth that can also be read (SSAO, Hi-Z); the device depth has no SRV.
     ID3D11Device* d = device.Device();
     if (!d)
         return;
 
-    if (!mesh.vb && !mesh.vertices.empty())
+    const uint32_t w = device.BackBufferWidth();
+    const uint32_t h = device.BackBufferHeight();
+    if (w == 0 || h == 0)
+        return;
+
+    if (mDepthTex && mDepthDSV && mDepthSRV && mDepthW == w && mDepthH == h)
+        return;
+
+    IUnknown* tmp = (IUnknown*)mDepthSRV;
+    SafeRelease(tmp);
+    mDepthSRV = nullptr;
+
+    tmp = (IUnknown*)mDepthDSV;
+    SafeRelease(tmp);
+    mDepthDSV = nullptr;
+
+    tmp = (IUnknown*)mDepthTex;
+    SafeRelease(tmp);
+    mDepthTex = nullptr;
+    mDepthW = 0;
+    mDepthH = 0;
+
+    D3D11_TEXTURE2D_DESC dtd{};
+    dtd.Width = w;
+    dtd.Height = h;
+    dtd.MipLevels = 1;
+    dtd.ArraySize = 1;
+    dtd.Format = DXGI_FORMAT_R32_TYPELESS;
+    dtd.SampleDesc.Count = 1;
+    dtd.Usage = D3D11_USAGE_DEFAULT;
+    dtd.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+
+    if (FAILED(d->CreateTexture2D(&dtd, nullptr, &mDepthTex)) || !mDepthTex)
+        return;
+
+    D3D11_DEPTH_STENCIL_VIEW_DESC dsvd{};
+    dsvd.Format = DXGI_FORMAT_D32_FLOAT;
+    dsvd.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+    dsvd.Texture2D.MipSlice = 0;
+    if (FAILED(d->CreateDepthStencilView(mDepthTex, &dsvd, &mDepthDSV)) || !mDepthDSV)
+        return;
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvd{};
+    srvd.Format = DXGI_FORMAT_R32_FLOAT;
+    srvd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+    srvd.Texture2D.MostDetailedMip = 0;
+    srvd.Texture2D.MipLevels = 1;
+    if (FAILED(d->CreateShaderResourceView(mDepthTex, &srvd, &mDepthSRV)) || !mDepthSRV)
+        return;
+
+    mDepthW = w;
+    mDepthH = h;
+}
+
+bool RenderSystemD3D11::EnsureSsaoHistory(RenderDeviceD3D11& device, uint32_t w, uint32_t h)
+{
+    ID3D11Device* d = device.Device();
+    if (!d || w == 0 || h == 0)
+        return false;
+
+    if (mSsaoHistorySRV[0] && mSsaoHistorySRV[1] && mSsaoHistoryW == w && mSsaoHistoryH == h)
+        return true;
+
+    ReleaseSsaoHistory();
+
+    D3D11_TEXTURE2D_DESC td{};
+    td.Width = w;
+    td.Height = h;
+    td.MipLevels = 1;
+    td.ArraySize = 1;
+    td.SampleDesc.Count = 1;
+    td.Usage = D3D11_USAGE_DEFAULT;
+    td.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+    // 8 bits band visibly under a small blend weight.
+    td.Format = DXGI_FORMAT_R16_FLOAT;
+
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        if (FAILED(d->CreateTexture2D(&td, nullptr, &mSsaoHistoryTex[i])) ||
+            FAILED(d->CreateRenderTargetView(mSsaoHistoryTex[i], nullptr, &mSsaoHistoryRTV[i])) ||
+            FAILED(d->CreateShaderResourceView(mSsaoHistoryTex[i], nullptr, &mSsaoHistorySRV[i])))
+        {
+            ReleaseSsaoHistory();
+            return false;
+        }
+    }
+
+    mSsaoHistoryW = w;
+    mSsaoHistoryH = h;
+    return true;
+}
+
+void RenderSystemD3D11::ReleaseSsaoHistory()
+{
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        SafeRelease((IUnknown*&)mSsaoHistorySRV[i]);
+        SafeRelease((IUnknown*&)mSsaoHistoryRTV[i]);
+        SafeRelease((IUnknown*&)mSsaoHistoryTex[i]);
+    }
+    mSsaoHistoryW = 0;
+    mSsaoHistoryH = 0;
+    mSsaoHistoryValid = false;
+}
+
+bool RenderSystemD3D11::GetPrimaryDirectionalLightWithTransform(const Scene& scene, Light& outLight, Transform& outXform)
+{
+    for (auto e : scene.reg.lights.Entities())
+    {
+        auto* l = scene.reg.lights.TryGet(e);
+        if (!l || l->type != LightType::Directional)
+            continue;
+
+        outLight = *l;
+        if (auto* t = scene.reg.transforms.TryGet(e))
+            outXform = *t;
+        else
+            outXform = {};
+        return true;
+    }
+
+    outLight = {};
+    outXform = {};
+    return false;
+}
+
+static Float3 NormalizeOrDefault(const Float3& v, const Float3& def)
+{
+    const float len2 = v.x * v.x + v.y * v.y + v.z * v.z;
+    if (len2 <= 1e-8f)
+        return def;
+    const float invLen = 1.0f / std::sqrt(len2);
+    return { v.x * invLen, v.y * invLen, v.z * invLen };
+}
+
+void RenderSystemD3D11::GatherLights(const Scene& scene, king::FrameVector<GpuLight>& outDirectional, std::vector<GpuLight>& outLocal,
+    std::vector<LocalLightSource>& outLocalSources)
+{
+    outDirectional.clear();
+    outLocal.clear();
+    outLocal.reserve(scene.reg.lights.Entities().size());
+    outLocalSources.clear();
+    outLocalSources.reserve(scene.reg.lights.Entities().size());
+
+    for (auto e : scene.reg.lights.Entities())
+    {
+        auto* l = scene.reg.lights.TryGet(e);
+        if (!l)
+            continue;
+
+        const bool directional = (l->type == LightType::Directional);
+        if (directional && outDirectional.size() >= RenderSystemD3D11::kMaxLights)
+            continue;
+
+        GpuLight gl{};
+        gl.type = (uint32_t)l->type;
+        gl.groupMask = l->groupMask;
+        gl.color[0] = l->color.x;
+        gl.color[1] = l->color.y;
+        gl.color[2] = l->color.z;
+        gl.intensity = l->intensity;
+
+        const Float3 dir = NormalizeOrDefault(l->direction, { 0, -1, 0 });
+        gl.dir[0] = dir.x;
+        gl.dir[1] = dir.y;
+        gl.dir[2] = dir.z;
+        gl.range = l->range;
+
+        Float3 pos{ 0, 0, 0 };
+        if (auto* t = scene.reg.transforms.TryGet(e))
+            pos = t->position;
+        gl.pos[0] = pos.x;
+        gl.pos[1] = pos.y;
+        gl.pos[2] = pos.z;
+
+        gl.innerConeCos = l->innerConeCos;
+        gl.outerConeCos = l->outerConeCos;
+
+        if (directional)
+        {
+            outDirectional.push_back(gl);
+        }
+        else
+        {
+            outLocal.push_back(gl);
+            outLocalSources.push_back({ e, l->castsShadows });
+        }
+    }
+}
+
+void RenderSystemD3D11::ReleaseStructured(DynamicStructuredBuffer& sb)
+{
+    SafeRelease((IUnknown*&)sb.srv);
+    SafeRelease((IUnknown*&)sb.buffer);
+    sb.srv = nullptr;
+    sb.buffer = nullptr;
+    sb.capacity = 0;
+}
+
+bool RenderSystemD3D11::UploadStructured(ID3D11Device* d, ID3D11DeviceContext* ctx, DynamicStructuredBuffer& sb, const void* data, uint32_t count, uint32_t stride)
+{
+    // Never zero-sized: shaders may still index the (empty) buffer behind a zero count.
+    const uint32_t required = std::max(count, 1u);
+    if (!sb.buffer || sb.capacity < required)
+    {
+        ReleaseStructured(sb);
+
+        uint32_t capacity = 64;
+        while (capacity < required)
+            capacity *= 2;
+
+        D3D11_BUFFER_DESC bd{};
+        bd.Usage = D3D11_USAGE_DYNAMIC;
+        bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        bd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        bd.ByteWidth = capacity * stride;
+        bd.StructureByteStride = stride;
+        if (FAILED(d->CreateBuffer(&bd, nullptr, &sb.buffer)))
+        {
+            sb.buffer = nullptr;
+            return false;
+        }
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC sd{};
+        sd.Format = DXGI_FORMAT_UNKNOWN;
+        sd.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+        sd.Buffer.FirstElement = 0;
+        sd.Buffer.NumElements = capacity;
+        if (FAILED(d->CreateShaderResourceView(sb.buffer, &sd, &sb.srv)))
+        {
+            ReleaseStructured(sb);
+            return false;
+        }
+        sb.capacity = capacity;
+    }
+
+    if (count == 0)
+        return true;
+
+    D3D11_MAPPED_SUBRESOURCE mapped{};
+    if (FAILED(ctx->Map(sb.buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+        return false;
+    std::memcpy(mapped.pData, data, (size_t)count * stride);
+    ctx->Unmap(sb.buffer, 0);
+    mMapBytes += (uint64_t)count * stride;
+    return true;
+}
+
+void RenderSystemD3D11::UploadMaterialData(RenderDeviceD3D11& device, ID3D11DeviceContext* ctx, const MaterialRegistry& materials)
+{
+    ID3D11Device* d = device.Device();
+    if (!d || !ctx)
+        return;
+
+    if (mMaterialDataOwner != &materials)
+    {
+        mMaterialDataVersion.clear();
+        mMaterialDataOwner = &materials;
+    }
+    const uint32_t count = (uint32_t)std::min<size_t>(materials.Size(), kMaxMaterialIds);
+    mMaterialData.resize(count);
+    mMaterialDataVersion.resize(count, 0);
+
+    constexpr UINT kStride = (UINT)sizeof(MaterialData);
+    bool full = false;
+    if (!mMaterialBuffer || mMaterialBufferCapacity < count)
+    {
+        SafeRelease((IUnknown*&)mMaterialSRV);
+        SafeRelease((IUnknown*&)mMaterialBuffer);
+        mMaterialBufferCapacity = 0;
+
+        uint32_t capacity = 256;
+        while (capacity < count)
+            capacity *= 2;
+
+        D3D11_BUFFER_DESC bd{};
+        bd.Usage = D3D11_USAGE_DEFAULT;
+        bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        bd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        bd.ByteWidth = capacity * kStride;
+        bd.StructureByteStride = kStride;
+        if (FAILED(d->CreateBuffer(&bd, nullptr, &mMaterialBuffer)))
+        {
+            mMaterialBuffer = nullptr;
+            return;
+        }
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC sd{};
+        sd.Format = DXGI_FORMAT_UNKNOWN;
+        sd.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+        sd.Buffer.FirstElement = 0;
+        sd.Buffer.NumElements = capacity;
+        if (FAILED(d->CreateShaderResourceView(mMaterialBuffer, &sd, &mMaterialSRV)))
+        {
+            SafeRelease((IUnknown*&)mMaterialBuffer);
+            return;
+        }
+        mMaterialBufferCapacity = capacity;
+        full = true;
+    }
+
+    // Refresh the entries whose registry version moved, then upload each run of them with
+    // one UpdateSubresource (everything after the buffer was recreated).
+    constexpr uint32_t kNoMaterialRun = 0xFFFFFFFFu;
+    uint32_t runStart = kNoMaterialRun;
+    uint32_t runs = 0;
+    auto flush = [&](uint32_t end)
+    {
+        D3D11_BOX box{};
+        box.left = runStart * kStride;
+        box.right = end * kStride;
+        box.bottom = 1;
+        box.back = 1;
+        ctx->UpdateSubresource(mMaterialBuffer, 0, &box, &mMaterialData[runStart], 0, 0);
+        runStart = kNoMaterialRun;
+        ++runs;
+    };
+
+    for (uint32_t h = 0; h < count; ++h)
+    {
+        const uint32_t version = materials.Version(h);
+        const bool dirty = mMaterialDataVersion[h] != version;
+        if (dirty)
+        {
+            const PbrMaterial& mat = materials.Get(h);
+            MaterialData& md = mMaterialData[h];
+            md = {};
+            md.baseColor[0] = mat.albedo.x;
+            md.baseColor[1] = mat.albedo.y;
+            md.baseColor[2] = mat.albedo.z;
+            md.baseColor[3] = mat.albedo.w;
+            md.emissive[0] = mat.emissive.x;
+            md.emissive[1] = mat.emissive.y;
+            md.emissive[2] = mat.emissive.z;
+            md.roughness = mat.roughness;
+            md.metallic = mat.metallic;
+            md.flags = 0;
+            mMaterialDataVersion[h] = version;
+        }
+
+        if (dirty || full)
+        {
+            if (runStart == kNoMaterialRun)
+                runStart = h;
+        }
+        else if (runStart != kNoMaterialRun)
+        {
+            flush(h);
+        }
+    }
+    if (runStart != kNoMaterialRun)
+        flush(count);
+
+    mPerf.AddCount("MaterialUploads", runs);
+}
+
+void RenderSystemD3D11::UploadLightClusters(RenderDeviceD3D11& device, ID3D11DeviceContext* ctx, const Mat4x4& view, const Mat4x4& proj,
+    bool haveViewProj, float nearZ, float farZ, const D3D11_VIEWPORT& viewport)
+{
+    ID3D11Device* d = device.Device();
+    if (!d || !ctx || !mClusterCB)
+        return;
+
+    mLocalLightSpheres.resize(mLocalLights.size());
+    for (size_t i = 0; i < mLocalLights.size(); ++i)
     {
-        D3D11_BUFFER_DESC bd{};
-        bd.Usage = D3D11_USAGE_IMMUTABLE;
-        bd.ByteWidth = (UINT)(mesh.vertices.size() * sizeof(VertexPN));
-        bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-
-        D3D11_SUBRESOURCE_DATA init{};
-        init.pSysMem = mesh.vertices.data();
+        const GpuLight& l = mLocalLights[i];
+        mLocalLightSpheres[i] = { l.pos[0], l.pos[1], l.pos[2], l.range };
+    }
 
-        (void)d->CreateBuffer(&bd, &init, &mesh.vb);
+    // Without a real view/projection (legacy overloads) the grid degenerates to one cluster.
+    if (haveViewProj)
+    {
+        LightClusters::Desc desc{};
+        desc.tilesX = kClusterTilesX;
+        desc.tilesY = kClusterTilesY;
+        desc.slices = kClusterSlices;
+        mLightClusters.Build(GetJobSystem(), desc, view, proj, nearZ, farZ, mLocalLightSpheres.data(), mLocalLightSpheres.size());
+    }
+    else
+    {
+        mLightClusters.BuildUnclustered(mLocalLights.size());
     }
 
-    if (!mesh.ib && !mesh.indices.empty())
+    static bool sPrintedDropped = false;
+    if (mLightClusters.DroppedCount() > 0 && !sPrintedDropped)
     {
-        D3D11_BUFFER_DESC bd{};
-        bd.Usage = D3D11_USAGE_IMMUTABLE;
-        bd.ByteWidth = (UINT)(mesh.indices.size() * sizeof(uint16_t));
-        bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+        sPrintedDropped = true;
+        std::printf("LightClusters: %zu light references dropped (per-cluster cap)\n", mLightClusters.DroppedCount());
+    }
 
-        D3D11_SUBRESOURCE_DATA init{};
-        init.pSysMem = mesh.indices.data();
+    const std::vector<uint32_t>& ranges = mLightClusters.Ranges();
+    const std::vector<uint32_t>& indices = mLightClusters.Indices();
+    UploadStructured(d, ctx, mClusterLights, mLocalLights.data(), (uint32_t)mLocalLights.size(), (uint32_t)sizeof(GpuLight));
+    UploadStructured(d, ctx, mClusterRanges, ranges.data(), (uint32_t)(ranges.size() / 2), (uint32_t)(sizeof(uint32_t) * 2));
+    UploadStructured(d, ctx, mClusterIndices, indices.data(), (uint32_t)indices.size(), (uint32_t)sizeof(uint32_t));
+
+    ClusterCBData cb{};
+    // Third column of the row-vector view matrix.
+    cb.viewZ[0] = haveViewProj ? view.m[2] : 0.0f;
+    cb.viewZ[1] = haveViewProj ? view.m[6] : 0.0f;
+    cb.viewZ[2] = haveViewProj ? view.m[10] : 0.0f;
+    cb.viewZ[3] = haveViewProj ? view.m[14] : 1.0f;
+    // Tiles cover the viewport (the scene viewport under dynamic resolution); SV_Position is
+    // relative to the target, so an offset viewport shifts them back.
+    const D3D11_VIEWPORT& vp = viewport;
+    cb.tileScale[0] = (vp.Width > 0.0f) ? (float)mLightClusters.TilesX() / vp.Width : 0.0f;
+    cb.tileScale[1] = (vp.Height > 0.0f) ? (float)mLightClusters.TilesY() / vp.Height : 0.0f;
+    cb.tileBias[0] = -vp.TopLeftX * cb.tileScale[0];
+    cb.tileBias[1] = -vp.TopLeftY * cb.tileScale[1];
+    cb.sliceScale = mLightClusters.SliceScale();
+    cb.sliceBias = mLightClusters.SliceBias();
+    cb.dims[0] = mLightClusters.TilesX();
+    cb.dims[1] = mLightClusters.TilesY();
+    cb.dims[2] = mLightClusters.Slices();
+    cb.localLightCount = (uint32_t)mLocalLights.size();
 
-        (void)d->CreateBuffer(&bd, &init, &mesh.ib);
+    D3D11_MAPPED_SUBRESOURCE mapped{};
+    if (SUCCEEDED(ctx->Map(mClusterCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+    {
+        std::memcpy(mapped.pData, &cb, sizeof(cb));
+        ctx->Unmap(mClusterCB, 0);
+        mMapBytes += sizeof(cb);
     }
 }
 
-void RenderSystemD3D11::EnsureInstanceBuffer(RenderDeviceD3D11& device, size_t requiredInstanceCount)
+void RenderSystemD3D11::BindLightClusters(ID3D11DeviceContext* ctx) const
 {
-    ID3D11Device* d = device.Device();
-    if (!d)
-        return;
+    ctx->PSSetConstantBuffers(5, 1, &mClusterCB);
+    ID3D11ShaderResourceView* srvs[3] = { mClusterLights.srv, mClusterRanges.srv, mClusterIndices.srv };
+    ctx->PSSetShaderResources(10, 3, srvs);
+}
 
-    if (requiredInstanceCount <= mInstanceCapacity && mInstanceVB)
-        return;
+void RenderSystemD3D11::BuildShadowCasterBounds()
+{
+    constexpr uint32_t kInstFlag_CastsShadows = 1u << 1;
 
-    // Grow with headroom to avoid frequent realloc.
-    size_t newCapacity = (mInstanceCapacity == 0) ? 1024 : mInstanceCapacity;
-    while (newCapacity < requiredInstanceCount)
-        newCapacity *= 2;
+    const size_t count = mSnapshotScratch.size();
+    mShadowCasterSpheres.Resize(count);
+    mShadowCasterHashes.resize(count);
+    GetJobSystem().ParallelFor(count, 1024, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const SnapshotItem& s = mSnapshotScratch[i];
+            Sphere sp = WorldBoundingSphere(s);
+            if ((s.flags & kInstFlag_CastsShadows) == 0 || !s.mesh)
+                sp.radius = -FLT_MAX;
+            mShadowCasterSpheres.Set(i, sp);
+            mShadowCasterHashes[i] = MixHash(HashBytes(&s.world, sizeof(s.world)) ^ (uint64_t)(uintptr_t)s.mesh);
+        }
+    }, mPrepareParallelism);
+}
 
-    IUnknown* tmp = (IUnknown*)mInstanceVB;
-    SafeRelease(tmp);
-    mInstanceVB = nullptr;
+// Cascade frustum without its near plane: everything between the sun and the slice can cast
+// into it (ShadowsD3D11 clamps those casters onto the near plane).
+static Frustum ExtrudedCascadeFrustum(const Mat4x4& cascadeViewProj)
+{
+    Frustum f = Frustum::FromViewProjection(cascadeViewProj);
+    f.planes[4].n = { 0.0f, 0.0f, 0.0f };
+    f.planes[4].d = 1e30f;
+    return f;
+}
+
+uint32_t RenderSystemD3D11::PlanCascadeShadows(Mat4x4 cascadeViewProj[ShadowsD3D11::kMaxCascades], uint32_t cascadeCount,
+    const float splitsNdc[4], const Mat4x4& viewProj, const Mat4x4& proj, const Float3& sunDir,
+    float viewportHeight, const RenderSettings& settings)
+{
+    constexpr uint32_t kInstFlag_CastsShadows = 1u << 1;
+
+    const uint32_t cascades = std::min(cascadeCount, ShadowsD3D11::kMaxCascades);
+    for (uint32_t c = 0; c < ShadowsD3D11::kMaxCascades; ++c)
+        mShadowCasterPtrs[c].clear();
+    ++mCascadeFrame;
+
+    JobSystem& jobs = GetJobSystem();
+    const uint32_t generation = mShadows ? mShadows->ResourceGeneration() : 0u;
+    const uint64_t interval = std::max(1u, settings.shadowCacheUpdateInterval);
+    const float sliceNdc[4] = { 0.0f, splitsNdc[0], splitsNdc[1], 1.0f };
+
+    // What a cascade's depths depend on: the sun, the static set and the dynamic casters in it
+    // (summed, so the order they were culled in does not matter).
+    const uint64_t baseHash = MixHash(HashBytes(&sunDir, sizeof(sunDir)) ^ MixHash(mStaticSignature));
+    auto contentHash = [&](const std::vector<uint32_t>& visible)
+    {
+        uint64_t h = baseHash;
+        for (uint32_t i : visible)
+            h += mShadowCasterHashes[i];
+        return h;
+    };
+
+    // Optional size filter, one projection per surviving caster: radius in pixels is about
+    // r * proj[1][1] / w * half the viewport height (perspective and ortho alike).
+    const float minCasterPx = std::max(0.0f, settings.shadowMinCasterPixels);
+    const float pxPerUnit = std::max(1.0f, viewportHeight * 0.5f) * ((proj.m[5] > 0.0f) ? proj.m[5] : 1.0f);
+    const float* vp = viewProj.m;
+    auto largeEnough = [&](const SphereSoA& s, uint32_t i)
+    {
+        if (minCasterPx <= 0.0f)
+            return true;
+        const float w = s.x[i] * vp[3] + s.y[i] * vp[7] + s.z[i] * vp[11] + vp[15];
+        return w <= s.r[i] || s.r[i] * pxPerUnit >= minCasterPx * w; // at or behind the camera: keep
+    };
+
+    uint32_t renderMask = 0;
+    for (uint32_t c = 0; c < cascades; ++c)
+    {
+        CascadeCache& cache = mCascadeCache[c];
+
+        // A cached cascade stays while it still covers its slice and either nothing in it
+        // changed or it was redrawn too recently; the shader then samples it with its old matrix.
+        if (c >= settings.shadowCacheFirstCascade && cache.valid && cache.resourceGeneration == generation
+            && ShadowsD3D11::CascadeCoversSlice(cache.viewProj, viewProj, sliceNdc[c], sliceNdc[c + 1]))
+        {
+            bool keep = mCascadeFrame - cache.renderedFrame < interval;
+            if (!keep)
+            {
+                CullSpheresParallel(jobs, ExtrudedCascadeFrustum(cache.viewProj), mShadowCasterSpheres, mShadowCascadeVisible,
+                    mPrepareParallelism);
+                keep = contentHash(mShadowCascadeVisible) == cache.contentHash;
+            }
+            if (keep)
+            {
+                cascadeViewProj[c] = cache.viewProj;
+                continue;
+            }
+        }
+
+        renderMask |= 1u << c;
+        const Frustum extruded = ExtrudedCascadeFrustum(cascadeViewProj[c]);
+        std::vector<const SnapshotItem*>& ptrs = mShadowCasterPtrs[c];
 
-    D3D11_BUFFER_DESC bd{};
-    bd.Usage = D3D11_USAGE_DYNAMIC;
-    bd.ByteWidth = (UINT)(newCapacity * sizeof(InstanceData));
-    bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-    bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        CullSpheresParallel(jobs, extruded, mShadowCasterSpheres, mShadowCascadeVisible, mPrepareParallelism);
+        cache.contentHash = contentHash(mShadowCascadeVisible);
+        for (uint32_t i : mShadowCascadeVisible)
+        {
+            if (largeEnough(mShadowCasterSpheres, i))
+                ptrs.push_back(&mSnapshotScratch[i]);
+        }
+
+        if (mStaticBvhCulling)
+            CullStaticRegion(extruded, 0, mStaticSpheres.Size(), mShadowCascadeVisible);
+        else
+            CullSpheresParallel(jobs, extruded, mStaticSpheres, mShadowCascadeVisible, mPrepareParallelism);
+        for (uint32_t i : mShadowCascadeVisible)
+        {
+            const SnapshotItem& s = mStaticItems[i];
+            if ((s.flags & kInstFlag_CastsShadows) != 0 && s.mesh && largeEnough(mStaticSpheres, i))
+                ptrs.push_back(&s);
+        }
+
+        cache.valid = true;
+        cache.viewProj = cascadeViewProj[c];
+        cache.renderedFrame = mCascadeFrame;
+        cache.resourceGeneration = generation;
+    }
+    for (uint32_t c = cascades; c < ShadowsD3D11::kMaxCascades; ++c)
+        mCascadeCache[c].valid = false;
 
-    (void)d->CreateBuffer(&bd, nullptr, &mInstanceVB);
-    if (mInstanceVB)
-        mInstanceCapacity = newCapacity;
+    return renderMask;
 }
 
-void RenderSystemD3D11::EnsureHdrTargets(RenderDeviceD3D11& device, bool needSsao)
+void RenderSystemD3D11::PlanLocalShadows(const Frustum& frustum, const Float3& cameraPos, const Mat4x4& proj, float viewportHeight,
+    const RenderSettings& settings)
 {
-    ID3D11Device* d = device.Device();
-    if (!d)
-        return;
+    // Border kept around each cube face inside its tile, in texels of the smallest tile.
+    constexpr float kFaceBorderTexels = 2.0f;
 
-    const uint32_t w = device.BackBufferWidth();
-    const uint32_t h = device.BackBufferHeight();
-    if (w == 0 || h == 0)
+    mShadowAtlasRequests.clear();
+    mShadowAtlasLights.clear();
+    mShadowFaces.clear();
+    if (!settings.enablePointShadows || settings.pointShadowStrength <= 0.0f || settings.pointShadowMaxLights == 0)
+        return;
+    if (!mVSPointShadow || !mPSPointShadow || !mPSShadowTileClear || !mDepthAlwaysWrite || !mPointShadowCB)
         return;
 
-    if (mHdrTex && mHdrRTV && mHdrSRV && mHdrW == w && mHdrH == h)
+    // Candidates: shadow-casting point/spot lights whose range is on screen, ranked by the
+    // projected radius of that range (in half screen heights).
+    struct Candidate
     {
-        if (!needSsao)
-            return;
+        uint32_t light;
+        float ndcRadius;
+    };
+    king::FrameArena& frameArena = king::ThreadFrameArena();
+    king::FrameVector<Candidate> candidates(&frameArena);
 
-        if (mNormalTex && mNormalRTV && mNormalSRV && mDepthTex && mDepthDSV && mDepthSRV &&
-            mSsaoTex && mSsaoRTV && mSsaoSRV && mSsaoBlurTex && mSsaoBlurRTV && mSsaoBlurSRV)
-            return;
-    }
+    const float yScale = (proj.m[5] > 0.0f) ? proj.m[5] : 1.0f;
+    for (uint32_t i = 0; i < (uint32_t)mLocalLights.size(); ++i)
+    {
+        const GpuLight& L = mLocalLights[i];
+        if (!mLocalLightSources[i].castsShadows)
+            continue;
+        if ((L.type != (uint32_t)LightType::Point && L.type != (uint32_t)LightType::Spot) || L.range <= 0.01f || L.intensity <= 0.0f)
+            continue;
 
-    IUnknown* tmp = nullptr;
+        Sphere bounds{};
+        bounds.center = { L.pos[0], L.pos[1], L.pos[2] };
+        bounds.radius = L.range;
+        if (!frustum.Intersects(bounds))
+            continue;
 
-    tmp = (IUnknown*)mHdrSRV;
-    SafeRelease(tmp);
-    mHdrSRV = nullptr;
+        const float dx = L.pos[0] - cameraPos.x;
+        const float dy = L.pos[1] - cameraPos.y;
+        const float dz = L.pos[2] - cameraPos.z;
+        const float d2 = dx * dx + dy * dy + dz * dz;
+        const float r2 = L.range * L.range;
+        const float ndcRadius = (d2 > r2) ? yScale * L.range / std::sqrt(d2 - r2) : 64.0f; // camera inside the range
+        candidates.push_back({ i, std::min(ndcRadius, 64.0f) });
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b)
+    {
+        return a.ndcRadius > b.ndcRadius;
+    });
+    if (candidates.size() > settings.pointShadowMaxLights)
+        candidates.resize(settings.pointShadowMaxLights);
 
-    tmp = (IUnknown*)mHdrRTV;
-    SafeRelease(tmp);
-    mHdrRTV = nullptr;
+    const size_t dynamicCount = mShadowCasterSpheres.Size();
+    const float minTile = (float)std::max(16u, settings.pointShadowMinTileSize);
+    const float faceFovY = 2.0f * std::atan(minTile / std::max(1.0f, minTile - 2.0f * kFaceBorderTexels));
+    const float halfHeightPx = std::max(1.0f, viewportHeight * 0.5f);
 
-    tmp = (IUnknown*)mHdrTex;
-    SafeRelease(tmp);
-    mHdrTex = nullptr;
+    king::FrameVector<uint32_t> nearCasters(&frameArena);
 
-    tmp = (IUnknown*)mNormalSRV;
-    SafeRelease(tmp);
-    mNormalSRV = nullptr;
+    mShadowAtlasRequests.resize(candidates.size());
+    mShadowAtlasLights.resize(candidates.size());
+    for (size_t c = 0; c < candidates.size(); ++c)
+    {
+        const GpuLight& L = mLocalLights[candidates[c].light];
+        const bool spot = L.type == (uint32_t)LightType::Spot;
+        const Float3 pos{ L.pos[0], L.pos[1], L.pos[2] };
+        const float farZ = L.range;
+        const float nearZ = std::max(0.01f, std::min(0.1f, farZ * 0.25f));
+
+        ShadowAtlas::Request& req = mShadowAtlasRequests[c];
+        req = {};
+        req.key = (uint64_t)mLocalLightSources[candidates[c].light].entity;
+        req.faceCount = spot ? 1u : 6u;
+        // About one shadow texel per covered pixel across the light's radius.
+        req.desiredSize = candidates[c].ndcRadius * halfHeightPx;
+        req.priority = candidates[c].ndcRadius * candidates[c].ndcRadius;
+        mShadowAtlasLights[c] = candidates[c].light;
+
+        struct
+        {
+            float pos[3];
+            float dir[3];
+            float range;
+            float outerConeCos;
+            float fovY;
+            uint32_t type;
+        } key{};
+        std::memcpy(key.pos, L.pos, sizeof(key.pos));
+        std::memcpy(key.dir, L.dir, sizeof(key.dir));
+        key.range = L.range;
+        key.outerConeCos = spot ? L.outerConeCos : 0.0f;
+        key.fovY = spot ? 0.0f : faceFovY;
+        key.type = L.type;
+        const uint64_t lightHash = HashBytes(&key, sizeof(key));
+
+        // Dynamic casters within the range, then per face those inside its frustum.
+        nearCasters.clear();
+        const SphereSoA& cs = mShadowCasterSpheres;
+        for (uint32_t i = 0; i < (uint32_t)dynamicCount; ++i)
+        {
+            const float ex = cs.x[i] - pos.x;
+            const float ey = cs.y[i] - pos.y;
+            const float ez = cs.z[i] - pos.z;
+            const float reach = cs.r[i] + L.range;
+            if (cs.r[i] >= 0.0f && ex * ex + ey * ey + ez * ez <= reach * reach)
+                nearCasters.push_back(i);
+        }
 
-    tmp = (IUnknown*)mNormalRTV;
-    SafeRelease(tmp);
-    mNormalRTV = nullptr;
+        for (uint32_t f = 0; f < req.faceCount; ++f)
+        {
+            ShadowAtlas::FaceView& v = req.views[f];
+            v.viewProj = spot
+                ? MakeSpotShadowViewProj(pos, { L.dir[0], L.dir[1], L.dir[2] }, L.outerConeCos, nearZ, farZ)
+                : MakePointShadowViewProj(pos, (int)f, nearZ, farZ, faceFovY);
+            v.lightPos = pos;
+            v.invRange = 1.0f / std::max(0.01f, farZ);
+
+            const Frustum faceFrustum = Frustum::FromViewProjection(v.viewProj);
+            uint64_t h = MixHash(lightHash ^ MixHash(mStaticSignature + f));
+            for (uint32_t i : nearCasters)
+            {
+                Sphere sp{};
+                sp.center = { cs.x[i], cs.y[i], cs.z[i] };
+                sp.radius = cs.r[i];
+                if (faceFrustum.Intersects(sp))
+                    h += mShadowCasterHashes[i]; // order-independent
+            }
+            req.faceHash[f] = h;
+        }
+    }
 
-    tmp = (IUnknown*)mNormalTex;
-    SafeRelease(tmp);
-    mNormalTex = nullptr;
+    ShadowAtlas::Desc desc{};
+    desc.atlasSize = settings.pointShadowAtlasSize;
+    desc.minTileSize = settings.pointShadowMinTileSize;
+    desc.maxTileSize = settings.pointShadowMapSize;
+    desc.maxFaceUpdates = settings.pointShadowMaxFaceUpdates;
+    desc.updateBudgetMs = settings.pointShadowUpdateBudgetMs;
+    mShadowAtlas.Update(desc, mShadowAtlasRequests);
+
+    // Ready lights sample their tiles; the others stay unshadowed until all faces are in.
+    const float invAtlas = 1.0f / (float)mShadowAtlas.AtlasSize();
+    const std::vector<ShadowAtlas::Assignment>& assignments = mShadowAtlas.Assignments();
+    for (size_t r = 0; r < assignments.size(); ++r)
+    {
+        const ShadowAtlas::Assignment& a = assignments[r];
+        if (!a.ready)
+            continue;
 
-    tmp = (IUnknown*)mDepthSRV;
-    SafeRelease(tmp);
-    mDepthSRV = nullptr;
+        GpuLight& L = mLocalLights[mShadowAtlasLights[r]];
+        L.flags |= kLightFlag_Shadowed;
+        L.shadowFace = (uint32_t)mShadowFaces.size();
+        for (uint32_t f = 0; f < a.faceCount; ++f)
+        {
+            ShadowFaceGpu g{};
+            g.viewProj = a.views[f].viewProj;
+            g.rect[0] = (float)a.tiles[f].x * invAtlas;
+            g.rect[1] = (float)a.tiles[f].y * invAtlas;
+            g.rect[2] = (float)a.tiles[f].size * invAtlas;
+            g.rect[3] = (float)a.tiles[f].size * invAtlas;
+            g.lightPos[0] = a.views[f].lightPos.x;
+            g.lightPos[1] = a.views[f].lightPos.y;
+            g.lightPos[2] = a.views[f].lightPos.z;
+            g.invRange = a.views[f].invRange;
+            mShadowFaces.push_back(g);
+        }
+    }
+}
 
-    tmp = (IUnknown*)mDepthDSV;
-    SafeRelease(tmp);
-    mDepthDSV = nullptr;
+bool RenderSystemD3D11::RenderLocalShadows(RenderDeviceD3D11& device, ID3D11DeviceContext* ctx, const RenderSettings& settings)
+{
+    constexpr uint32_t kInstFlag_CastsShadows = 1u << 1;
 
-    tmp = (IUnknown*)mDepthTex;
-    SafeRelease(tmp);
-    mDepthTex = nullptr;
+    const uint32_t atlasSize = mShadowAtlas.AtlasSize();
+    if (mShadowAtlasTexSize != atlasSize)
+    {
+        SafeRelease((IUnknown*&)mShadowAtlasSRV);
+        SafeRelease((IUnknown*&)mShadowAtlasRTV);
+        SafeRelease((IUnknown*&)mShadowAtlasTex);
+        SafeRelease((IUnknown*&)mShadowAtlasDSV);
+        SafeRelease((IUnknown*&)mShadowAtlasDepthTex);
+        mShadowAtlasTexSize = 0;
+    }
+    if (mShadowAtlasTexSize == 0)
+    {
+        if (!EnsureShadowAtlasResources(device, atlasSize, mShadowAtlasTex, mShadowAtlasSRV, mShadowAtlasRTV, mShadowAtlasDepthTex, mShadowAtlasDSV))
+        {
+            std::printf("RenderSystemD3D11: shadow atlas (%u x %u) creation failed\n", atlasSize, atlasSize);
+            mShadowAtlas.Reset();
+            return false;
+        }
+        mShadowAtlasTexSize = atlasSize;
+    }
 
-    tmp = (IUnknown*)mSsaoBlurSRV;
-    SafeRelease(tmp);
-    mSsaoBlurSRV = nullptr;
+    const std::vector<ShadowAtlas::FaceUpdate>& updates = mShadowAtlas.Updates();
+    if (!updates.empty())
+    {
+        const auto t0 = std::chrono::steady_clock::now();
 
-    tmp = (IUnknown*)mSsaoBlurRTV;
-    SafeRelease(tmp);
-    mSsaoBlurRTV = nullptr;
+        // Ensure the atlas SRV isn't still bound from last frame.
+        {
+            ID3D11ShaderResourceView* nullSrv = nullptr;
+            ctx->PSSetShaderResources(9, 1, &nullSrv);
+        }
 
-    tmp = (IUnknown*)mSsaoBlurTex;
-    SafeRelease(tmp);
-    mSsaoBlurTex = nullptr;
+        const bool singlePass = settings.pointShadowSinglePass && mPSPointShadowLayered && mPointShadowSlotsCB
+            && (mVSPointShadowLayered || (mVSPointShadowReplicate && mGSPointShadow));
+        const uint32_t groupSize = singlePass ? kMaxShadowSlots : 1u;
+        const uint32_t groupCount = ((uint32_t)updates.size() + groupSize - 1u) / groupSize;
 
-    tmp = (IUnknown*)mSsaoSRV;
-    SafeRelease(tmp);
-    mSsaoSRV = nullptr;
+        // Casters per face, culled against the face frustum. Within a group they are sorted by
+        // mesh, so a single-pass group draws each mesh once for all of its faces.
+        mPointShadowDrawBatches.clear();
+        mPointShadowInstancesScratch.clear();
+        mPointShadowGroupBatchStart.clear();
+        mPointShadowVisible.resize(std::max(mShadowCasterSpheres.Size(), mStaticSpheres.Size()));
+        for (uint32_t g = 0; g < groupCount; ++g)
+        {
+            mPointShadowGroupBatchStart.push_back((uint32_t)mPointShadowDrawBatches.size());
+            mPointShadowCasters.clear();
 
-    tmp = (IUnknown*)mSsaoRTV;
-    SafeRelease(tmp);
-    mSsaoRTV = nullptr;
+            const uint32_t first = g * groupSize;
+            const uint32_t last = std::min(first + groupSize, (uint32_t)updates.size());
+            for (uint32_t ui = first; ui < last; ++ui)
+            {
+                const ShadowAtlas::FaceUpdate& u = updates[ui];
+                const uint32_t slot = ui - first;
+                const Mat4x4& faceViewProj = mShadowAtlasRequests[u.request].views[u.face].viewProj;
+                const Frustum faceFrustum = Frustum::FromViewProjection(faceViewProj);
+                const MeshLodView faceLodView = settings.enableMeshLod
+                    ? MakeMeshLodView(faceViewProj, (float)u.tile.size, settings.shadowMeshLodBias)
+                    : MeshLodView{};
+                auto lodOf = [&](const SnapshotItem& s, const SphereSoA& spheres, uint32_t i)
+                {
+                    return SelectMeshLod(*s.mesh, faceLodView, spheres.x[i], spheres.y[i], spheres.z[i], spheres.r[i]);
+                };
 
-    tmp = (IUnknown*)mSsaoTex;
-    SafeRelease(tmp);
-    mSsaoTex = nullptr;
+                size_t n = CullSpheres(faceFrustum, mShadowCasterSpheres, 0, mShadowCasterSpheres.Size(), mPointShadowVisible.data());
+                for (size_t k = 0; k < n; ++k)
+                {
+                    const SnapshotItem& s = mSnapshotScratch[mPointShadowVisible[k]];
+                    mPointShadowCasters.push_back({ &s, slot, lodOf(s, mShadowCasterSpheres, mPointShadowVisible[k]) });
+                }
+                const uint32_t* staticVisible = mPointShadowVisible.data();
+                if (mStaticBvhCulling)
+                {
+                    CullStaticRegion(faceFrustum, 0, mStaticSpheres.Size(), mPointShadowStaticVisible);
+                    staticVisible = mPointShadowStaticVisible.data();
+                    n = mPointShadowStaticVisible.size();
+                }
+                else
+                {
+                    n = CullSpheres(faceFrustum, mStaticSpheres, 0, mStaticSpheres.Size(), mPointShadowVisible.data());
+                }
+                for (size_t k = 0; k < n; ++k)
+                {
+                    const SnapshotItem& s = mStaticItems[staticVisible[k]];
+                    if ((s.flags & kInstFlag_CastsShadows) != 0 && s.mesh)
+                        mPointShadowCasters.push_back({ &s, slot, lodOf(s, mStaticSpheres, staticVisible[k]) });
+                }
+            }
 
-    D3D11_TEXTURE2D_DESC td{};
-    td.Width = w;
-    td.Height = h;
-    td.MipLevels = 1;
-    td.ArraySize = 1;
-    td.SampleDesc.Count = 1;
-    td.Usage = D3D11_USAGE_DEFAULT;
+            std::stable_sort(mPointShadowCasters.begin(), mPointShadowCasters.end(), [](const PointShadowCaster& a, const PointShadowCaster& b)
+            {
+                if (a.item->mesh != b.item->mesh)
+                    return (uintptr_t)a.item->mesh < (uintptr_t)b.item->mesh;
+                return a.lod < b.lod;
+            });
 
-    // HDR target
-    td.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
-    td.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+            Mesh* currentMesh = nullptr;
+            uint32_t currentLod = 0;
+            PointShadowDrawBatch current{};
+            for (const PointShadowCaster& c : mPointShadowCasters)
+            {
+                Mesh* mesh = c.item->mesh;
+                if (mesh != currentMesh || c.lod != currentLod)
+                {
+                    if (currentMesh && current.instanceCount > 0)
+                        mPointShadowDrawBatches.push_back(current);
 
-    if (FAILED(d->CreateTexture2D(&td, nullptr, &mHdrTex)) || !mHdrTex)
-        return;
+                    currentMesh = mesh;
+                    currentLod = c.lod;
+                    const MeshLod& lod = mesh->lods[std::min(c.lod, mesh->lodCount - 1u)];
+                    current = {};
+                    current.vb = mesh->vb;
+                    current.ib = mesh->ib;
+                    current.indexCount = lod.indexCount;
+                    current.startIndex = lod.firstIndex;
+                    current.vertexCount = mesh->vertexCount;
+                    current.index32 = mesh->index32;
+                    current.startInstance = (uint32_t)mPointShadowInstancesScratch.size();
+                    current.instanceCount = 0;
+                    current.mesh = mesh;
+                }
 
-    if (FAILED(d->CreateRenderTargetView(mHdrTex, nullptr, &mHdrRTV)) || !mHdrRTV)
-        return;
+                // Shadow copies only need the transform; flags carry the face slot instead.
+                InstanceData inst = MakeInstanceData(*c.item);
+                inst.flags = c.slot;
+                mPointShadowInstancesScratch.push_back(inst);
+                current.instanceCount++;
+            }
+            if (currentMesh && current.instanceCount > 0)
+                mPointShadowDrawBatches.push_back(current);
+        }
+        mPointShadowGroupBatchStart.push_back((uint32_t)mPointShadowDrawBatches.size());
 
-    if (FAILED(d->CreateShaderResourceView(mHdrTex, nullptr, &mHdrSRV)) || !mHdrSRV)
-        return;
+        uint32_t instanceFirst = 0;
+        const bool haveInstances = !mPointShadowInstancesScratch.empty()
+            && mInstanceRing.Append(ctx, mPointShadowInstancesScratch.data(), (uint32_t)mPointShadowInstancesScratch.size(), instanceFirst);
+        ID3D11Buffer* instanceVB = mInstanceRing.Buffer();
 
-    // Normal target (world-space normal encoded to [0,1])
-    if (needSsao)
-    {
-        td.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
-        td.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-        if (FAILED(d->CreateTexture2D(&td, nullptr, &mNormalTex)) || !mNormalTex)
-            return;
-        if (FAILED(d->CreateRenderTargetView(mNormalTex, nullptr, &mNormalRTV)) || !mNormalRTV)
-            return;
-        if (FAILED(d->CreateShaderResourceView(mNormalTex, nullptr, &mNormalSRV)) || !mNormalSRV)
-            return;
+        ctx->OMSetRenderTargets(1, &mShadowAtlasRTV, mShadowAtlasDSV);
+        StateCacheD3D11& sc = mImmediateState;
+        sc.Begin(ctx);
 
-        // Depth target with SRV
+        auto tileViewport = [](const ShadowAtlas::Tile& t)
         {
-            D3D11_TEXTURE2D_DESC dtd{};
-            dtd.Width = w;
-            dtd.Height = h;
-            dtd.MipLevels = 1;
-            dtd.ArraySize = 1;
-            dtd.Format = DXGI_FORMAT_R32_TYPELESS;
-            dtd.SampleDesc.Count = 1;
-            dtd.Usage = D3D11_USAGE_DEFAULT;
-            dtd.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
-
-            if (FAILED(d->CreateTexture2D(&dtd, nullptr, &mDepthTex)) || !mDepthTex)
-                return;
+            D3D11_VIEWPORT vp{};
+            vp.TopLeftX = (float)t.x;
+            vp.TopLeftY = (float)t.y;
+            vp.Width = (float)t.size;
+            vp.Height = (float)t.size;
+            vp.MinDepth = 0.0f;
+            vp.MaxDepth = 1.0f;
+            return vp;
+        };
 
-            D3D11_DEPTH_STENCIL_VIEW_DESC dsvd{};
-            dsvd.Format = DXGI_FORMAT_D32_FLOAT;
-            dsvd.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-            dsvd.Texture2D.MipSlice = 0;
-            if (FAILED(d->CreateDepthStencilView(mDepthTex, &dsvd, &mDepthDSV)) || !mDepthDSV)
-                return;
+        // Clear the tiles being re-rendered to "far": a full-viewport triangle writing distance
+        // and depth 1, since Clear*View would wipe the whole atlas.
+        PipelineStateD3D11 clearPipeline{};
+        clearPipeline.vs = mPost.Fullscreen().VS();
+        clearPipeline.ps = mPSShadowTileClear;
+        clearPipeline.blend = mBlendOpaque;
+        clearPipeline.dss = mDepthAlwaysWrite;
+        clearPipeline.rs = device.RS();
+        sc.SetPipeline(clearPipeline);
+        for (const ShadowAtlas::FaceUpdate& u : updates)
+        {
+            const D3D11_VIEWPORT vp = tileViewport(u.tile);
+            ctx->RSSetViewports(1, &vp);
+            sc.Draw(3, 0);
+        }
 
-            D3D11_SHADER_RESOURCE_VIEW_DESC srvd{};
-            srvd.Format = DXGI_FORMAT_R32_FLOAT;
-            srvd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-            srvd.Texture2D.MostDetailedMip = 0;
-            srvd.Texture2D.MipLevels = 1;
-            if (FAILED(d->CreateShaderResourceView(mDepthTex, &srvd, &mDepthSRV)) || !mDepthSRV)
-                return;
+        PipelineStateD3D11 drawPipeline = clearPipeline;
+        drawPipeline.layout = mInputLayout;
+        drawPipeline.dss = device.DSS();
+        if (singlePass)
+        {
+            drawPipeline.vs = mVSPointShadowLayered ? mVSPointShadowLayered : mVSPointShadowReplicate;
+            drawPipeline.gs = mVSPointShadowLayered ? nullptr : mGSPointShadow;
+            drawPipeline.ps = mPSPointShadowLayered;
+            sc.SetPipeline(drawPipeline);
+            sc.SetVSConstantBuffer(8, mPointShadowSlotsCB);
+            sc.SetPSConstantBuffer(8, mPointShadowSlotsCB);
+        }
+        else
+        {
+            drawPipeline.vs = mVSPointShadow;
+            drawPipeline.ps = mPSPointShadow;
+            sc.SetPipeline(drawPipeline);
+            sc.SetVSConstantBuffer(7, mPointShadowCB);
+            sc.SetPSConstantBuffer(7, mPointShadowCB);
         }
-    }
 
-    mHdrW = w;
-    mHdrH = h;
+        struct PointShadowCBData
+        {
+            Mat4x4 viewProj;
+            float lightPos[3];
+            float invFar;
+        };
+        static_assert(sizeof(PointShadowCBData) % 16 == 0, "PointShadowCBData must be 16-byte aligned");
 
-    if (needSsao)
-        EnsureSsaoTargets(device);
-}
+        struct PointShadowSlotsCBData
+        {
+            Mat4x4 viewProj[kMaxShadowSlots];
+            float light[kMaxShadowSlots][4]; // xyz = position, w = 1 / range
+        };
+        static_assert(sizeof(PointShadowSlotsCBData) % 16 == 0, "PointShadowSlotsCBData must be 16-byte aligned");
 
-void RenderSystemD3D11::EnsureSsaoTargets(RenderDeviceD3D11& device)
-{
-    ID3D11Device* d = device.Device();
-    if (!d)
-        return;
+        for (uint32_t g = 0; g < groupCount && haveInstances; ++g)
+        {
+            const uint32_t firstBatch = mPointShadowGroupBatchStart[g];
+            const uint32_t lastBatch = mPointShadowGroupBatchStart[g + 1];
+            if (firstBatch == lastBatch)
+                continue;
 
-    const uint32_t w = device.BackBufferWidth();
-    const uint32_t h = device.BackBufferHeight();
-    if (w == 0 || h == 0)
-        return;
+            const uint32_t first = g * groupSize;
+            const uint32_t last = std::min(first + groupSize, (uint32_t)updates.size());
 
-    if (mSsaoTex && mSsaoRTV && mSsaoSRV && mSsaoBlurTex && mSsaoBlurRTV && mSsaoBlurSRV && mHdrW == w && mHdrH == h)
-        return;
+            D3D11_VIEWPORT vps[kMaxShadowSlots];
+            for (uint32_t ui = first; ui < last; ++ui)
+                vps[ui - first] = tileViewport(updates[ui].tile);
+            ctx->RSSetViewports(last - first, vps);
 
-    IUnknown* tmp = nullptr;
+            D3D11_MAPPED_SUBRESOURCE mm{};
+            if (singlePass)
+            {
+                if (SUCCEEDED(ctx->Map(mPointShadowSlotsCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mm)))
+                {
+                    PointShadowSlotsCBData* cb = (PointShadowSlotsCBData*)mm.pData;
+                    for (uint32_t ui = first; ui < last; ++ui)
+                    {
+                        const ShadowAtlas::FaceView& view = mShadowAtlasRequests[updates[ui].request].views[updates[ui].face];
+                        cb->viewProj[ui - first] = view.viewProj;
+                        cb->light[ui - first][0] = view.lightPos.x;
+                        cb->light[ui - first][1] = view.lightPos.y;
+                        cb->light[ui - first][2] = view.lightPos.z;
+                        cb->light[ui - first][3] = view.invRange;
+                    }
+                    ctx->Unmap(mPointShadowSlotsCB, 0);
+                    mMapBytes += (uint64_t)(last - first) * (sizeof(cb->viewProj[0]) + sizeof(cb->light[0]));
+                }
+            }
+            else
+            {
+                const ShadowAtlas::FaceView& view = mShadowAtlasRequests[updates[first].request].views[updates[first].face];
+                PointShadowCBData cb{};
+                cb.viewProj = view.viewProj;
+                cb.lightPos[0] = view.lightPos.x;
+                cb.lightPos[1] = view.lightPos.y;
+                cb.lightPos[2] = view.lightPos.z;
+                cb.invFar = view.invRange;
+
+                if (SUCCEEDED(ctx->Map(mPointShadowCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mm)))
+                {
+                    std::memcpy(mm.pData, &cb, sizeof(cb));
+                    ctx->Unmap(mPointShadowCB, 0);
+                    mMapBytes += sizeof(cb);
+                }
+            }
 
-    tmp = (IUnknown*)mSsaoBlurSRV;
-    SafeRelease(tmp);
-    mSsaoBlurSRV = nullptr;
+            for (uint32_t bi = firstBatch; bi < lastBatch; ++bi)
+            {
+                const PointShadowDrawBatch& b = mPointShadowDrawBatches[bi];
+                if (!b.vb)
+                    continue;
 
-    tmp = (IUnknown*)mSsaoBlurRTV;
-    SafeRelease(tmp);
-    mSsaoBlurRTV = nullptr;
+                ID3D11Buffer* vbs[2] = { b.vb, instanceVB };
+                UINT strides[2] = { (UINT)sizeof(PackedVertex), (UINT)sizeof(InstanceData) };
+                UINT offsets[2] = { 0u, instanceFirst * (UINT)sizeof(InstanceData) };
+                sc.SetVertexBuffers(0, 2, vbs, strides, offsets);
+
+                if (b.ib && b.indexCount > 0)
+                {
+                    sc.SetIndexBuffer(b.ib, b.index32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT, 0);
+                    sc.DrawIndexedInstanced(b.indexCount, b.instanceCount, b.startIndex, 0, b.startInstance);
+                }
+                else
+                {
+                    sc.DrawInstanced(b.vertexCount, b.instanceCount, 0, b.startInstance);
+                }
+            }
+        }
 
-    tmp = (IUnknown*)mSsaoBlurTex;
-    SafeRelease(tmp);
-    mSsaoBlurTex = nullptr;
+        sc.SetGS(nullptr);
 
-    tmp = (IUnknown*)mSsaoSRV;
-    SafeRelease(tmp);
-    mSsaoSRV = nullptr;
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        mShadowAtlas.ReportUpdateCost(ms, (uint32_t)updates.size());
+    }
 
-    tmp = (IUnknown*)mSsaoRTV;
-    SafeRelease(tmp);
-    mSsaoRTV = nullptr;
+    if (mShadowFaces.empty())
+        return false;
+    if (!UploadStructured(device.Device(), ctx, mShadowFacesBuffer, mShadowFaces.data(), (uint32_t)mShadowFaces.size(), (uint32_t)sizeof(ShadowFaceGpu)))
+        return false;
+    return mShadowAtlasSRV != nullptr && mShadowFacesBuffer.srv != nullptr;
+}
 
-    tmp = (IUnknown*)mSsaoTex;
-    SafeRelease(tmp);
-    mSsaoTex = nullptr;
+bool RenderSystemD3D11::CreateViewTarget(RenderDeviceD3D11& device, uint32_t width, uint32_t height, ViewTarget& target)
+{
+    ReleaseViewTarget(target);
+    ID3D11Device* d = device.Device();
+    if (!d || width == 0 || height == 0)
+        return false;
 
     D3D11_TEXTURE2D_DESC td{};
-    td.Width = w;
-    td.Height = h;
+    td.Width = width;
+    td.Height = height;
     td.MipLevels = 1;
     td.ArraySize = 1;
+    td.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
     td.SampleDesc.Count = 1;
     td.Usage = D3D11_USAGE_DEFAULT;
     td.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-    td.Format = DXGI_FORMAT_R8_UNORM;
-
-    if (FAILED(d->CreateTexture2D(&td, nullptr, &mSsaoTex)) || !mSsaoTex)
-        return;
-    if (FAILED(d->CreateRenderTargetView(mSsaoTex, nullptr, &mSsaoRTV)) || !mSsaoRTV)
-        return;
-    if (FAILED(d->CreateShaderResourceView(mSsaoTex, nullptr, &mSsaoSRV)) || !mSsaoSRV)
-        return;
 
-    if (FAILED(d->CreateTexture2D(&td, nullptr, &mSsaoBlurTex)) || !mSsaoBlurTex)
-        return;
-    if (FAILED(d->CreateRenderTargetView(mSsaoBlurTex, nullptr, &mSsaoBlurRTV)) || !mSsaoBlurRTV)
-        return;
-    if (FAILED(d->CreateShaderResourceView(mSsaoBlurTex, nullptr, &mSsaoBlurSRV)) || !mSsaoBlurSRV)
-        return;
-}
+    bool ok = SUCCEEDED(d->CreateTexture2D(&td, nullptr, &target.colorTex)) && target.colorTex &&
+        SUCCEEDED(d->CreateRenderTargetView(target.colorTex, nullptr, &target.rtv)) && target.rtv &&
+        SUCCEEDED(d->CreateShaderResourceView(target.colorTex, nullptr, &target.srv)) && target.srv;
 
-bool RenderSystemD3D11::GetPrimaryDirectionalLightWithTransform(const Scene& scene, Light& outLight, Transform& outXform)
-{
-    for (auto e : scene.reg.lights.Entities())
+    if (ok)
     {
-        auto* l = scene.reg.lights.TryGet(e);
-        if (!l || l->type != LightType::Directional)
-            continue;
-
-        outLight = *l;
-        if (auto* t = scene.reg.transforms.TryGet(e))
-            outXform = *t;
-        else
-            outXform = {};
-        return true;
+        td.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+        td.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+        ok = SUCCEEDED(d->CreateTexture2D(&td, nullptr, &target.depthTex)) && target.depthTex &&
+            SUCCEEDED(d->CreateDepthStencilView(target.depthTex, nullptr, &target.dsv)) && target.dsv;
     }
 
-    outLight = {};
-    outXform = {};
-    return false;
+    if (!ok)
+    {
+        std::printf("CreateViewTarget: %ux%u target creation failed\n", width, height);
+        ReleaseViewTarget(target);
+        return false;
+    }
+    target.width = width;
+    target.height = height;
+    return true;
 }
 
-static Float3 NormalizeOrDefault(const Float3& v, const Float3& def)
+void RenderSystemD3D11::ReleaseViewTarget(ViewTarget& target)
 {
-    const float len2 = v.x * v.x + v.y * v.y + v.z * v.z;
-    if (len2 <= 1e-8f)
-        return def;
-    const float invLen = 1.0f / std::sqrt(len2);
-    return { v.x * invLen, v.y * invLen, v.z * invLen };
+    SafeRelease((IUnknown*&)target.dsv);
+    SafeRelease((IUnknown*&)target.depthTex);
+    SafeRelease((IUnknown*&)target.srv);
+    SafeRelease((IUnknown*&)target.rtv);
+    SafeRelease((IUnknown*&)target.colorTex);
+    target.width = 0;
+    target.height = 0;
 }
 
-void RenderSystemD3D11::GatherLights(const Scene& scene, std::vector<GpuLight>& outLights)
+void RenderSystemD3D11::RenderViews(
+    RenderDeviceD3D11& device,
+    Scene& scene,
+    const RenderView* views,
+    uint32_t viewCount,
+    const RenderSettings& settings,
+    float exposureOverride)
 {
-    outLights.clear();
-    outLights.reserve(scene.reg.lights.Entities().size());
-
-    for (auto e : scene.reg.lights.Entities())
-    {
-        auto* l = scene.reg.lights.TryGet(e);
-        if (!l)
-            continue;
-
-        GpuLight gl{};
-        gl.type = (uint32_t)l->type;
-        gl.groupMask = l->groupMask;
-        gl.color[0] = l->color.x;
-        gl.color[1] = l->color.y;
-        gl.color[2] = l->color.z;
-        gl.intensity = l->intensity;
-
-        const Float3 dir = NormalizeOrDefault(l->direction, { 0, -1, 0 });
-        gl.dir[0] = dir.x;
-        gl.dir[1] = dir.y;
-        gl.dir[2] = dir.z;
-        gl.range = l->range;
-
-        Float3 pos{ 0, 0, 0 };
-        if (auto* t = scene.reg.transforms.TryGet(e))
-            pos = t->position;
-        gl.pos[0] = pos.x;
-        gl.pos[1] = pos.y;
-        gl.pos[2] = pos.z;
-
-        gl.innerConeCos = l->innerConeCos;
-        gl.outerConeCos = l->outerConeCos;
+    if (!views || viewCount == 0)
+        return;
 
-        outLights.push_back(gl);
-        if (outLights.size() >= RenderSystemD3D11::kMaxLights)
-            break;
-    }
+    const RenderView& mainView = views[0];
+    mExtraViews = views + 1;
+    mExtraViewCount = std::min(viewCount, kMaxRenderViews) - 1u;
+    RenderGeometryPass(device, scene, mainView.frustum, mainView.viewProj, mainView.view, mainView.proj, mainView.cameraPos,
+        mainView.nearZ, mainView.farZ, settings, exposureOverride);
+    mExtraViews = nullptr;
+    mExtraViewCount = 0;
 }
 
 void RenderSystemD3D11::RenderGeometryPass(
@@ -1619,6 +3725,10 @@ void RenderSystemD3D11::RenderGeometryPass(
     if (!ctx)
         return;
 
+    // SetThreadConfig since the last frame: re-split the render work before anything is queued.
+    if (king::ThreadConfigGeneration() != mThreadConfigGeneration)
+        ApplyThreadConfig(device);
+
     struct GpuScopeGuard
     {
         king::perf::GpuProfilerD3D11* gpu = nullptr;
@@ -1639,19 +3749,54 @@ void RenderSystemD3D11::RenderGeometryPass(
         }
     };
 
+    // Charges what is recorded while it lives to the FrameStats pass `name`.
+    struct PassStatsGuard
+    {
+        RenderSystemD3D11* rs = nullptr;
+
+        PassStatsGuard(RenderSystemD3D11* r, const char* name)
+            : rs(r)
+        {
+            rs->MarkFramePass(name);
+        }
+
+        ~PassStatsGuard()
+        {
+            rs->MarkFramePass(nullptr);
+        }
+    };
+
     struct FrameProfilerGuard
     {
         RenderSystemD3D11* rs = nullptr;
         ID3D11DeviceContext* ctx = nullptr;
-        std::vector<std::pair<const char*, double>> gpuMs;
 
         FrameProfilerGuard(RenderSystemD3D11* r, ID3D11DeviceContext* c)
             : rs(r), ctx(c)
         {
             if (!rs)
                 return;
+            // GPU timing switched on after Initialize (stress test, trace hotkey) allocates its queries here.
+            if (rs->mGpuPerf.Enabled() && !rs->mGpuPerf.Initialized() && ctx)
+            {
+                ID3D11Device* device = nullptr;
+                ctx->GetDevice(&device);
+                rs->mGpuPerf.Initialize(device);
+                if (device)
+                    device->Release();
+            }
+            // A new trace capture lines the GPU clock up with the CPU one first (one stall).
+            king::perf::TraceCapture& trace = king::perf::GetTraceCapture();
+            trace.BeginFrame();
+            if (trace.Recording() && rs->mTraceCaptureId != trace.CaptureId() && rs->mGpuPerf.Enabled())
+            {
+                rs->mTraceCaptureId = trace.CaptureId();
+                if (!rs->mGpuPerf.Calibrate(ctx))
+                    std::printf("TraceCapture: GPU clock calibration failed, GPU scopes are left out\n");
+            }
             rs->mPerf.BeginFrame();
             rs->mGpuPerf.BeginFrame(ctx);
+            rs->BeginFrameStats();
         }
 
         ~FrameProfilerGuard()
@@ -1661,20 +3806,46 @@ void RenderSystemD3D11::RenderGeometryPass(
 
             rs->mGpuPerf.EndFrame(ctx);
 
+            king::perf::TraceCapture& trace = king::perf::GetTraceCapture();
+            const bool traceGpu = trace.AcceptingGpu() && rs->mGpuPerf.Calibrated();
             uint32_t gpuFrameIndex = 0;
-            if (rs->mGpuPerf.TryGetResults(ctx, gpuFrameIndex, gpuMs))
+            if (rs->mGpuPerf.TryGetResults(ctx, gpuFrameIndex, rs->mGpuMsScratch, traceGpu ? &rs->mGpuSpansScratch : nullptr))
             {
-                for (const auto& p : gpuMs)
+                for (const auto& p : rs->mGpuMsScratch)
+                {
                     rs->mPerf.AddGpuMs(p.first, p.second);
+                    if (p.first && std::strcmp(p.first, "Frame") == 0)
+                        rs->mLastGpuFrameMs = (float)p.second;
+                }
+                if (traceGpu)
+                {
+                    for (const auto& s : rs->mGpuSpansScratch)
+                        trace.AddGpuEvent(s.name, s.beginNs, s.endNs);
+                }
             }
 
+            if (rs->mInputToPresentMs >= 0.0)
+                rs->mPerf.AddCpuMs("InputToPresent", rs->mInputToPresentMs);
+            if (rs->mInputToDisplayMs >= 0.0)
+                rs->mPerf.AddCpuMs("InputToDisplay", rs->mInputToDisplayMs);
+            rs->mInputToPresentMs = -1.0;
+            rs->mInputToDisplayMs = -1.0;
+
+            rs->EndFrameStats(ctx);
+            rs->ReportStateCacheStats();
             rs->mPerf.EndFrame();
+
+            // Everything on the frame arena was declared after this guard and is gone by now.
+            king::ThreadFrameArena().Reset();
         }
     };
 
     FrameProfilerGuard frameGuard(this, ctx);
+    // Frame boundary: hot-reloaded programs that finished compiling replace the old ones.
+    UpdateShaderReload(device);
     // Top-level GPU scope so we can see total GPU frame time.
     GpuScopeGuard gpuFrame(mGpuPerf, ctx, "Frame");
+    mInstanceRing.NextFrame(ctx);
 
     auto IsIdentityMat = [](const Mat4x4& m) -> bool
     {
@@ -1704,6 +3875,43 @@ void RenderSystemD3D11::RenderGeometryPass(
 
     if (doHdrTarget)
         EnsureHdrTargets(device, doSsao);
+
+    // Dynamic resolution: the scene viewport shrinks inside the full-size targets and the
+    // tonemap upscales, so only the offscreen path can scale. Each GPU timing feeds the
+    // controller once; without the GPU profiler the scale stays where it is.
+    const D3D11_VIEWPORT outputViewport = device.Viewport();
+    float renderScale = 1.0f;
+    if (settings.enableDynamicResolution && doHdrTarget && doTonemap)
+    {
+        king::DynamicResolution::Desc dr{};
+        dr.targetMs = settings.dynamicResolutionTargetMs;
+        dr.minScale = settings.dynamicResolutionMinScale;
+        dr.maxScale = settings.dynamicResolutionMaxScale;
+        renderScale = mDynamicResolution.Update(dr, mLastGpuFrameMs);
+        mLastGpuFrameMs = 0.0f;
+    }
+    else
+    {
+        mDynamicResolution.Reset();
+    }
+    mRenderScale = renderScale;
+    mSceneViewport = outputViewport;
+    mSceneViewport.Width = std::max(1.0f, std::floor(outputViewport.Width * renderScale));
+    mSceneViewport.Height = std::max(1.0f, std::floor(outputViewport.Height * renderScale));
+    const uint32_t sceneW = (uint32_t)mSceneViewport.Width;
+    const uint32_t sceneH = (uint32_t)mSceneViewport.Height;
+    mPerf.AddCount("RenderScalePct", (uint64_t)(renderScale * 100.0f + 0.5f));
+
+    // Hi-Z occlusion reads the scene depth, so it renders into the SRV-capable depth target.
+    bool doOcclusion = settings.enableOcclusionCulling && settings.enableGpuCulling && mGpuCulling;
+    if (doSsao || doOcclusion)
+        EnsureSceneDepth(device);
+    if (doOcclusion && (!mDepthDSV || !mDepthSRV))
+        doOcclusion = false;
+    if (!doOcclusion && mGpuCulling)
+        mGpuCulling->InvalidateHiZ();
+    const bool useSceneDepth = doSsao || doOcclusion;
+    ID3D11DepthStencilView* sceneDsv = useSceneDepth ? mDepthDSV : device.DSV();
     if (doShadowsFeature && mShadows)
         mShadows->EnsureResources(device, settings.cascadeCount, settings.shadowMapSize);
 
@@ -1722,36 +3930,63 @@ void RenderSystemD3D11::RenderGeometryPass(
 
     device.BeginGpuEvent(L"GeometryPass");
 
-    // Ensure mesh buffers exist (GPU-side immutable buffers).
+    // Ensure mesh buffers exist (GPU-side immutable buffers). Pack meshes and textures share
+    // one streaming budget per frame.
+    StreamBudget streamBudget{};
+    streamBudget.bytesLeft = (uint64_t)settings.streamingBudgetKB * 1024u;
     for (auto me : scene.reg.meshes.Entities())
     {
         auto* m = scene.reg.meshes.TryGet(me);
         if (m)
-            EnsureMeshBuffers(device, *m);
+            EnsureMeshBuffers(device, *m, streamBudget);
     }
 
     // Build/consume prepared frame(s)
-    PreparedFrame frame;
-    BuildSnapshot(scene, mSnapshotScratch);
+    if (!mSnapshotPrepared)
+        BuildSnapshot(scene, mSnapshotScratch, 0);
+    mSnapshotPrepared = false;
+
+    const MeshLodView lodView = settings.enableMeshLod
+        ? MakeMeshLodView(viewProj, device.Viewport().Height, settings.meshLodBias)
+        : MeshLodView{};
+    const PreparedFrame& frame = AcquireFrameToRender(frustum, lodView);
+    mStaticBvhCulling = settings.enableStaticBvh;
+    if (mExtraViewCount > 0)
+    {
+        king::perf::CpuScope cpuViewCull(mPerf, "ViewCull");
+        PrepareSecondaryViews(device, settings);
+    }
 
-    if (!ConsumeReadyFrame(frame))
-        BuildPreparedFrame(mSnapshotScratch, frustum, frame);
+    // Dynamic batches from the prepared frame plus the visible runs of the static region
+    // (or, GPU-driven, one bucket per opaque static batch, culled right here).
+    UploadStaticInstances(device, ctx);
+    const bool gpuCulling = settings.enableGpuCulling && mGpuCulling;
+    if (gpuCulling)
+        UploadGpuCullInstances(device, ctx);
+    BuildDrawBatches(frame, frustum, lodView, gpuCulling);
+    if (gpuCulling && mGpuCulling->Ready())
+    {
+        GpuScopeGuard gpuCull(mGpuPerf, ctx, "GpuCull");
+        PassStatsGuard statsCull(this, "GpuCull");
+        mGpuCulling->Cull(ctx, frustum, lodView, doOcclusion);
+    }
 
-    if (frame.instances.empty() || frame.batches.empty())
+    if (mDrawBatches.empty())
     {
         static bool once = false;
         if (!once)
         {
             once = true;
-            std::printf("RenderGeometryPass: no visible instances (instances=%zu batches=%zu)\n", frame.instances.size(), frame.batches.size());
+            std::printf("RenderGeometryPass: no visible instances (instances=%zu static=%zu)\n", frame.instances.size(), mStaticInstances.size());
         }
         device.EndGpuEvent();
         return;
     }
 
-    // Gather lights
-    std::vector<GpuLight> lights;
-    GatherLights(scene, lights);
+    // Gather lights: directional ones go into LightCB, point/spot ones into the clusters.
+    king::FrameArena& frameArena = king::ThreadFrameArena();
+    king::FrameVector<GpuLight> lights(&frameArena);
+    GatherLights(scene, lights, mLocalLights, mLocalLightSources);
 
     LightCBData lightCB{};
     lightCB.lightCount = (uint32_t)lights.size();
@@ -1772,31 +4007,41 @@ void RenderSystemD3D11::RenderGeometryPass(
     if (settings.enableShadowPoissonPcf) shadowFlags |= 1u << 1;
     if (settings.enableShadowNormalOffsetBias) shadowFlags |= 1u << 2;
     if (settings.enableShadowReceiverPlaneBias) shadowFlags |= 1u << 3;
-    // Bits 8..11: filter quality (0..15)
-    shadowFlags |= (std::min(settings.shadowFilterQuality, 15u) & 0xFu) << 8;
+    // Filter quality is a shader permutation (ShadowFilterKey), not a flag.
     lightCB.shadowExtras[3] = (float)shadowFlags;
     for (uint32_t i = 0; i < kMaxCascades; ++i)
+    {
         lightCB.lightViewProj[i] = {};
+        lightCB.cascadeUvScale[i] = 1.0f;
+    }
     lightCB.cascadeSplitsNdc[0] = 1.0f;
     lightCB.cascadeSplitsNdc[1] = 1.0f;
     lightCB.cascadeSplitsNdc[2] = 1.0f;
     // w is unused by normal shading; repurpose for debug view.
     lightCB.cascadeSplitsNdc[3] = (float)settings.shadowDebugView;
     lightCB.cascadeCount = 1;
+    lightCB.shadowCameraViewProj = viewProj;
 
-    // Point shadow setup (single point light cubemap)
+    // Point/spot shadow setup (enabled once the atlas pass has run)
     lightCB.pointShadowParams[0] = 0.0f; // enabled
     lightCB.pointShadowParams[1] = settings.pointShadowBias;
-    lightCB.pointShadowParams[2] = 0.0f; // invFar
+    lightCB.pointShadowParams[2] = 0.0f;
     lightCB.pointShadowParams[3] = std::clamp(settings.pointShadowStrength, 0.0f, 1.0f);
     lightCB.pointShadowTexelSize[0] = 0.0f;
     lightCB.pointShadowTexelSize[1] = 0.0f;
 
+    if (doShadowsFeature || settings.enablePointShadows)
+    {
+        king::perf::CpuScope cpuCasterBounds(mPerf, "ShadowCasterBounds");
+        BuildShadowCasterBounds();
+    }
+
     Light sun{};
     Transform sunXform{};
     const bool haveSun = GetPrimaryDirectionalLightWithTransform(scene, sun, sunXform);
 
     Mat4x4 cascadeViewProj[kMaxCascades] = {};
+    uint32_t cascadeRenderMask = 0;
     bool doShadows = false;
     ID3D11ShaderResourceView* shadowSrv = nullptr;
     ID3D11SamplerState* shadowSamplerPoint = nullptr;
@@ -1813,7 +4058,11 @@ void RenderSystemD3D11::RenderGeometryPass(
         shadowSettings.strength = std::clamp(settings.shadowStrength, 0.0f, 1.0f);
         shadowSettings.mapSize = settings.shadowMapSize;
         shadowSettings.cascadeCount = settings.cascadeCount;
+        for (uint32_t i = 0; i < kMaxCascades; ++i)
+            shadowSettings.cascadeMapSize[i] = settings.cascadeMapSize[i];
         shadowSettings.cascadeLambda = settings.cascadeLambda;
+        shadowSettings.firstCachedCascade = settings.shadowCacheFirstCascade;
+        shadowSettings.cachedCascadePadding = settings.shadowCachePadding;
         shadowSettings.debugView = settings.shadowDebugView;
         shadowSettings.debugReadbackOnce = settings.debugShadowReadbackOnce;
 
@@ -1846,10 +4095,6 @@ void RenderSystemD3D11::RenderGeometryPass(
             lightCB.cascadeSplitsNdc[1] = splitsNdc[1];
             lightCB.cascadeSplitsNdc[2] = splitsNdc[2];
             lightCB.cascadeSplitsNdc[3] = splitsNdc[3];
-            for (uint32_t i = 0; i < cascadeCount && i < kMaxCascades; ++i)
-            {
-                lightCB.lightViewProj[i] = cascadeViewProj[i];
-            }
             lightCB.shadowTexelSize[0] = texelSize[0];
             lightCB.shadowTexelSize[1] = texelSize[1];
             lightCB.shadowBias = outBias;
@@ -1861,27 +4106,34 @@ void RenderSystemD3D11::RenderGeometryPass(
             shadowSamplerLinear = mShadows->ShadowSamplerLinear();
             shadowSamplerNonCmp = mShadows->ShadowSamplerNonCmp();
             doShadows = (shadowSrv != nullptr && shadowSamplerPoint != nullptr && shadowSamplerLinear != nullptr && shadowSamplerNonCmp != nullptr);
+
+            // Per-cascade casters, and cached cascades swap their stored matrix back in so
+            // shading matches the depths they hold.
+            if (doShadows && lightCB.shadowStrength > 0.0f)
+            {
+                king::perf::CpuScope cpuCascadePlan(mPerf, "CascadePlan");
+                cascadeRenderMask = PlanCascadeShadows(cascadeViewProj, cascadeCount, splitsNdc, viewProj, proj,
+                    sun.direction, device.Viewport().Height, settings);
+            }
+            for (uint32_t i = 0; i < cascadeCount && i < kMaxCascades; ++i)
+            {
+                lightCB.lightViewProj[i] = cascadeViewProj[i];
+                lightCB.cascadeUvScale[i] = mShadows->CascadeUvScale(i);
+            }
         }
     }
 
-    // Determine point light for point shadows (first visible point light).
+    // Point/spot shadows: pick the lights, assign atlas tiles and schedule face re-renders.
+    // Runs before the light upload, which carries each light's shadow flag and first face.
     bool doPointShadows = false;
-    ID3D11ShaderResourceView* pointShadowSrv = nullptr;
-    ID3D11SamplerState* pointShadowSampler = nullptr;
-    Float3 pointShadowLightPos{ 0, 0, 0 };
-    float pointShadowFarZ = 0.0f;
-    if (settings.enablePointShadows && lightCB.pointShadowParams[3] > 0.0f)
     {
-        for (uint32_t i = 0; i < lightCB.lightCount && i < kMaxLights; ++i)
-        {
-            const GpuLight& L = lightCB.lights[i];
-            if (L.type == 1u /* Point */ && L.range > 0.01f && L.intensity > 0.0f)
-            {
-                pointShadowLightPos = { L.pos[0], L.pos[1], L.pos[2] };
-                pointShadowFarZ = L.range;
-                break;
-            }
-        }
+        king::perf::CpuScope cpuShadowPlan(mPerf, "PointShadowPlan");
+        PlanLocalShadows(frustum, cameraPos, proj, device.Viewport().Height, settings);
+    }
+
+    {
+        king::perf::CpuScope cpuClusters(mPerf, "LightClusters");
+        UploadLightClusters(device, ctx, view, proj, !IsIdentityMat(proj), cameraNearZ, cameraFarZ, mSceneViewport);
     }
 
     static bool once = false;
@@ -1889,10 +4141,12 @@ void RenderSystemD3D11::RenderGeometryPass(
     {
         once = true;
         std::printf(
-            "RenderGeometryPass: instances=%zu batches=%zu lights=%zu hdr=%s shadows=%s deferredContexts=%zu tonemap=%s\n",
+            "RenderGeometryPass: instances=%zu batches=%zu lights=%zu+%zu clusters=%u hdr=%s shadows=%s deferredContexts=%zu tonemap=%s\n",
             frame.instances.size(),
-            frame.batches.size(),
+            mDrawBatches.size(),
             lights.size(),
+            mLocalLights.size(),
+            mLightClusters.ClusterCount(),
             (mHdrRTV && mHdrSRV) ? "yes" : "no",
             doShadows ? "yes" : "no",
             mDeferredContexts.size(),
@@ -1908,199 +4162,72 @@ void RenderSystemD3D11::RenderGeometryPass(
     {
         king::perf::CpuScope cpuShadow(mPerf, "ShadowPass");
         GpuScopeGuard gpuShadow(mGpuPerf, ctx, "ShadowPass");
+        PassStatsGuard statsShadow(this, "ShadowPass");
         device.BeginGpuEvent(L"ShadowPass");
 
-        // Build per-cascade caster lists from the existing snapshot.
-        // This avoids rebuilding the snapshot and enables cascade-aware caster culling.
-        constexpr uint32_t kInstFlag_CastsShadows = 1u << 1;
-
-        const D3D11_VIEWPORT mainVp = device.Viewport();
-        const float vpW = std::max(1.0f, mainVp.Width);
-        const float vpH = std::max(1.0f, mainVp.Height);
-        const float minCasterPx = std::max(0.0f, settings.shadowMinCasterPixels);
-
-        using namespace DirectX;
-        const XMMATRIX VP = dx::LoadMat4x4(viewProj);
-        auto estimateScreenRadiusPx = [&](const SnapshotItem& s) -> float
-        {
-            if (s.boundsRadius <= 0.0f)
-                return 0.0f;
-
-            // Approximate world-space radius using max scale axis.
-            const float sx = std::fabs(s.transform.scale.x);
-            const float sy = std::fabs(s.transform.scale.y);
-            const float sz = std::fabs(s.transform.scale.z);
-            const float scaleMax = std::max(sx, std::max(sy, sz));
-            const float rWorld = s.boundsRadius * scaleMax;
-            if (rWorld <= 1e-5f)
-                return 0.0f;
-
-            const Mat4x4 Wm = TransformToWorld(s.transform);
-            const Float3 cws = TransformPoint(Wm, s.boundsCenter);
-
-            const XMVECTOR c0 = XMVectorSet(cws.x, cws.y, cws.z, 1.0f);
-            const XMVECTOR c1x = XMVectorSet(cws.x + rWorld, cws.y, cws.z, 1.0f);
-            const XMVECTOR c1y = XMVectorSet(cws.x, cws.y + rWorld, cws.z, 1.0f);
-            const XMVECTOR c1z = XMVectorSet(cws.x, cws.y, cws.z + rWorld, 1.0f);
-
-            const XMVECTOR p0 = XMVector4Transform(c0, VP);
-            const XMVECTOR px = XMVector4Transform(c1x, VP);
-            const XMVECTOR py = XMVector4Transform(c1y, VP);
-            const XMVECTOR pz = XMVector4Transform(c1z, VP);
-
-            const float w0 = std::max(1e-6f, XMVectorGetW(p0));
-            const float wx = std::max(1e-6f, XMVectorGetW(px));
-            const float wy = std::max(1e-6f, XMVectorGetW(py));
-            const float wz = std::max(1e-6f, XMVectorGetW(pz));
-
-            const float x0 = XMVectorGetX(p0) / w0;
-            const float y0 = XMVectorGetY(p0) / w0;
-
-            auto ndcDistPx = [&](const XMVECTOR& p, float w) -> float
-            {
-                const float xn = XMVectorGetX(p) / w;
-                const float yn = XMVectorGetY(p) / w;
-                const float dx = (xn - x0) * 0.5f * vpW;
-                const float dy = (yn - y0) * 0.5f * vpH;
-                return std::sqrt(dx * dx + dy * dy);
-            };
-
-            float rx = ndcDistPx(px, wx);
-            float ry = ndcDistPx(py, wy);
-            float rz = ndcDistPx(pz, wz);
-            return std::max(rx, std::max(ry, rz));
-        };
-
-        auto intersectsCascade = [&](const SnapshotItem& s, const Mat4x4& cascadeVP) -> bool
-        {
-            if (s.boundsRadius <= 0.0f)
-                return false;
-
-            const float sx = std::fabs(s.transform.scale.x);
-            const float sy = std::fabs(s.transform.scale.y);
-            const float sz = std::fabs(s.transform.scale.z);
-            const float scaleMax = std::max(sx, std::max(sy, sz));
-            const float rWorld = s.boundsRadius * scaleMax;
-            if (rWorld <= 1e-5f)
-                return false;
-
-            const Mat4x4 Wm = TransformToWorld(s.transform);
-            const Float3 cws = TransformPoint(Wm, s.boundsCenter);
-
-            const XMMATRIX CVP = dx::LoadMat4x4(cascadeVP);
-            const XMVECTOR c0 = XMVectorSet(cws.x, cws.y, cws.z, 1.0f);
-            const XMVECTOR c1x = XMVectorSet(cws.x + rWorld, cws.y, cws.z, 1.0f);
-            const XMVECTOR c1y = XMVectorSet(cws.x, cws.y + rWorld, cws.z, 1.0f);
-            const XMVECTOR c1z = XMVectorSet(cws.x, cws.y, cws.z + rWorld, 1.0f);
-
-            const XMVECTOR p0 = XMVector4Transform(c0, CVP);
-            const XMVECTOR px = XMVector4Transform(c1x, CVP);
-            const XMVECTOR py = XMVector4Transform(c1y, CVP);
-            const XMVECTOR pz = XMVector4Transform(c1z, CVP);
-
-            const float w0 = std::max(1e-6f, XMVectorGetW(p0));
-            const float wx = std::max(1e-6f, XMVectorGetW(px));
-            const float wy = std::max(1e-6f, XMVectorGetW(py));
-            const float wz = std::max(1e-6f, XMVectorGetW(pz));
-
-            const float x0 = XMVectorGetX(p0) / w0;
-            const float y0 = XMVectorGetY(p0) / w0;
-            const float z0 = XMVectorGetZ(p0) / w0;
-
-            auto ndcDist = [&](const XMVECTOR& p, float w) -> float
-            {
-                const float xn = XMVectorGetX(p) / w;
-                const float yn = XMVectorGetY(p) / w;
-                const float dx = xn - x0;
-                const float dy = yn - y0;
-                return std::sqrt(dx * dx + dy * dy);
-            };
-
-            const float rNdcXY = std::max(ndcDist(px, wx), std::max(ndcDist(py, wy), ndcDist(pz, wz)));
-            // Conservative z radius: reuse XY radius.
-            const float rNdcZ = rNdcXY;
-
-            if (x0 < -1.0f - rNdcXY || x0 > 1.0f + rNdcXY) return false;
-            if (y0 < -1.0f - rNdcXY || y0 > 1.0f + rNdcXY) return false;
-            // D3D clip z for ortho is [0,1]
-            if (z0 < 0.0f - rNdcZ || z0 > 1.0f + rNdcZ) return false;
-            return true;
-        };
-
+        // Batch the casters PlanCascadeShadows picked for the cascades being redrawn.
         const uint32_t cascades = std::min(lightCB.cascadeCount, (uint32_t)ShadowsD3D11::kMaxCascades);
         for (uint32_t c = 0; c < cascades; ++c)
-        {
-            mShadowCasterPtrs[c].clear();
-            mShadowCasterPtrs[c].reserve(mSnapshotScratch.size() / 2);
             mShadowDrawBatchesPerCascade[c].clear();
-        }
         mShadowInstancesScratch.clear();
-        mShadowInstancesScratch.reserve(mSnapshotScratch.size());
 
-        for (const auto& s : mSnapshotScratch)
+        for (uint32_t c = 0; c < cascades; ++c)
         {
-            if ((s.flags & kInstFlag_CastsShadows) == 0)
-                continue;
-
-            if (minCasterPx > 0.0f)
+            // LODs follow the cascade's own texel density, so a cached slice does not depend on
+            // where the camera is.
+            const MeshLodView cascadeLodView = settings.enableMeshLod
+                ? MakeMeshLodView(cascadeViewProj[c], (float)mShadows->CascadeSize(c), settings.shadowMeshLodBias)
+                : MeshLodView{};
+            mShadowLodCasters.clear();
+            for (const SnapshotItem* sp : mShadowCasterPtrs[c])
             {
-                const float rpx = estimateScreenRadiusPx(s);
-                if (rpx < minCasterPx)
+                if (!sp || !sp->mesh)
                     continue;
+                uint32_t lod = 0;
+                if (sp->mesh->lodCount > 1)
+                {
+                    const Sphere ws = WorldBoundingSphere(*sp);
+                    lod = SelectMeshLod(*sp->mesh, cascadeLodView, ws.center.x, ws.center.y, ws.center.z, ws.radius);
+                }
+                mShadowLodCasters.push_back({ sp, lod });
             }
-
-            for (uint32_t c = 0; c < cascades; ++c)
-            {
-                if (intersectsCascade(s, cascadeViewProj[c]))
-                    mShadowCasterPtrs[c].push_back(&s);
-            }
-        }
-
-        for (uint32_t c = 0; c < cascades; ++c)
-        {
-            auto& ptrs = mShadowCasterPtrs[c];
-            std::sort(ptrs.begin(), ptrs.end(), [](const SnapshotItem* a, const SnapshotItem* b)
+            std::sort(mShadowLodCasters.begin(), mShadowLodCasters.end(), [](const ShadowLodCaster& a, const ShadowLodCaster& b)
             {
-                return (uintptr_t)a->mesh < (uintptr_t)b->mesh;
+                if (a.item->mesh != b.item->mesh)
+                    return (uintptr_t)a.item->mesh < (uintptr_t)b.item->mesh;
+                return a.lod < b.lod;
             });
 
             const uint32_t baseInstance = (uint32_t)mShadowInstancesScratch.size();
             Mesh* currentMesh = nullptr;
+            uint32_t currentLod = 0;
             ShadowsD3D11::DrawBatch current{};
             current.startInstance = baseInstance;
             current.instanceCount = 0;
 
-            for (const SnapshotItem* sp : ptrs)
+            for (const ShadowLodCaster& caster : mShadowLodCasters)
             {
-                if (!sp || !sp->mesh)
-                    continue;
-
-                if (sp->mesh != currentMesh)
+                const SnapshotItem* sp = caster.item;
+                if (sp->mesh != currentMesh || caster.lod != currentLod)
                 {
                     if (currentMesh && current.instanceCount > 0)
                         mShadowDrawBatchesPerCascade[c].push_back(current);
 
                     currentMesh = sp->mesh;
+                    currentLod = caster.lod;
+                    const MeshLod& lod = sp->mesh->lods[std::min(caster.lod, sp->mesh->lodCount - 1u)];
                     current = {};
                     current.vb = sp->mesh->vb;
                     current.ib = sp->mesh->ib;
-                    current.indexCount = (uint32_t)sp->mesh->indices.size();
-                    current.vertexCount = (uint32_t)sp->mesh->vertices.size();
+                    current.indexCount = lod.indexCount;
+                    current.startIndex = lod.firstIndex;
+                    current.vertexCount = sp->mesh->vertexCount;
+                    current.index32 = sp->mesh->index32;
                     current.startInstance = (uint32_t)mShadowInstancesScratch.size();
                     current.instanceCount = 0;
                 }
 
-                InstanceData inst{};
-                inst.world = TransformToWorld(sp->transform);
-                inst.normal = WorldToNormalMatrix(inst.world);
-                inst.albedo[0] = sp->albedo.x;
-                inst.albedo[1] = sp->albedo.y;
-                inst.albedo[2] = sp->albedo.z;
-                inst.albedo[3] = sp->albedo.w;
-                inst.roughnessMetallic[0] = sp->roughness;
-                inst.roughnessMetallic[1] = sp->metallic;
-                inst.lightMask = sp->lightMask;
-                inst.flags = sp->flags;
+                const InstanceData inst = MakeInstanceData(*sp);
 
                 mShadowInstancesScratch.push_back(inst);
                 current.instanceCount++;
@@ -2115,334 +4242,156 @@ void RenderSystemD3D11::RenderGeometryPass(
         {
             sPrintedShadowCasterStats = true;
             std::printf(
-                "ShadowPass: snapshot=%zu instances=%zu cascades=%u map=%ux%u\n",
+                "ShadowPass: snapshot=%zu instances=%zu cascades=%u redrawMask=0x%x map=%u (cascades %u/%u/%u)\n",
                 mSnapshotScratch.size(),
                 mShadowInstancesScratch.size(),
                 (unsigned)lightCB.cascadeCount,
+                (unsigned)cascadeRenderMask,
                 (unsigned)settings.shadowMapSize,
-                (unsigned)settings.shadowMapSize);
+                (unsigned)mShadows->CascadeSize(0),
+                (unsigned)mShadows->CascadeSize(1),
+                (unsigned)mShadows->CascadeSize(2));
         }
 
-        bool anyBatches = false;
-        for (uint32_t c = 0; c < cascades; ++c)
-            anyBatches = anyBatches || !mShadowDrawBatchesPerCascade[c].empty();
-
-        if (!mShadowInstancesScratch.empty() && anyBatches)
+        // Redrawn cascades are cleared even when nothing casts into them any more.
+        bool rendered = cascadeRenderMask == 0;
+        if (cascadeRenderMask != 0)
         {
-            EnsureInstanceBuffer(device, mShadowInstancesScratch.size());
-            if (mInstanceVB)
+            ID3D11Buffer* instanceVB = nullptr;
+            uint32_t instanceFirst = 0;
+            if (!mShadowInstancesScratch.empty())
+            {
+                if (mInstanceRing.Append(ctx, mShadowInstancesScratch.data(), (uint32_t)mShadowInstancesScratch.size(), instanceFirst))
+                {
+                    instanceVB = mInstanceRing.Buffer();
+                    // ShadowsD3D11 binds the buffer at offset 0.
+                    for (uint32_t c = 0; c < cascades; ++c)
+                    {
+                        for (ShadowsD3D11::DrawBatch& b : mShadowDrawBatchesPerCascade[c])
+                            b.startInstance += instanceFirst;
+                    }
+                }
+            }
+            else
             {
-                D3D11_MAPPED_SUBRESOURCE mapped{};
-                if (SUCCEEDED(ctx->Map(mInstanceVB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+                static bool sPrintedShadowEmpty = false;
+                if (!sPrintedShadowEmpty)
                 {
-                    std::memcpy(mapped.pData, mShadowInstancesScratch.data(), mShadowInstancesScratch.size() * sizeof(InstanceData));
-                    ctx->Unmap(mInstanceVB, 0);
-                    mShadows->Render(
-                        device,
-                        mShadowDrawBatchesPerCascade,
-                        mInputLayout,
-                        mInstanceVB,
-                        (uint32_t)sizeof(InstanceData),
-                        cascadeViewProj,
-                        lightCB.cascadeCount,
-                        settings.debugShadowReadbackOnce);
+                    sPrintedShadowEmpty = true;
+                    std::printf("ShadowPass: nothing to draw (check castsShadows flags / culling).\n");
                 }
             }
+
+            if (instanceVB || mShadowInstancesScratch.empty())
+            {
+                mShadows->Render(
+                    device,
+                    mShadowDrawBatchesPerCascade,
+                    mInputLayout,
+                    instanceVB,
+                    (uint32_t)sizeof(InstanceData),
+                    cascadeViewProj,
+                    lightCB.cascadeCount,
+                    settings.debugShadowReadbackOnce,
+                    cascadeRenderMask);
+                rendered = true;
+            }
         }
-        else
+        if (!rendered)
         {
-            static bool sPrintedShadowEmpty = false;
-            if (!sPrintedShadowEmpty)
+            for (uint32_t c = 0; c < cascades; ++c)
             {
-                sPrintedShadowEmpty = true;
-                std::printf("ShadowPass: nothing to draw (check castsShadows flags / culling).\n");
+                if (cascadeRenderMask & (1u << c))
+                    mCascadeCache[c].valid = false;
             }
         }
 
         // Restore main viewport/state.
-        D3D11_VIEWPORT vp = device.Viewport();
-        ctx->RSSetViewports(1, &vp);
+        ctx->RSSetViewports(1, &mSceneViewport);
         ctx->RSSetState(device.RS());
 
         device.EndGpuEvent();
     }
 
-    // Pass: Point shadow cubemap (single shadow-casting point light)
-    if (pointShadowFarZ > 0.01f && settings.enablePointShadows && lightCB.pointShadowParams[3] > 0.0f && mVSPointShadow && mPSPointShadow && mPointShadowCB)
+    // Pass: Point/spot shadow atlas (faces scheduled by PlanLocalShadows)
+    if (!mShadowAtlasRequests.empty())
     {
         king::perf::CpuScope cpuPointShadow(mPerf, "PointShadowPass");
         GpuScopeGuard gpuPointShadow(mGpuPerf, ctx, "PointShadowPass");
+        PassStatsGuard statsPointShadow(this, "PointShadowPass");
         device.BeginGpuEvent(L"PointShadowPass");
 
-        constexpr uint32_t kInstFlag_CastsShadows = 1u << 1;
-
-        uint32_t desiredSize = std::max(64u, settings.pointShadowMapSize);
-        if (mPointShadowSize != desiredSize)
-        {
-            SafeRelease((IUnknown*&)mPointShadowSRV);
-            SafeRelease((IUnknown*&)mPointShadowTex);
-            for (int i = 0; i < 6; ++i)
-                SafeRelease((IUnknown*&)mPointShadowRTV[i]);
-            SafeRelease((IUnknown*&)mPointShadowDepthTex);
-            for (int i = 0; i < 6; ++i)
-                SafeRelease((IUnknown*&)mPointShadowDSV[i]);
-            mPointShadowSize = 0;
-        }
-
-        if (mPointShadowSize == 0)
-        {
-            if (!EnsurePointShadowResources(device, desiredSize, mPointShadowTex, mPointShadowSRV, mPointShadowRTV, mPointShadowDepthTex, mPointShadowDSV))
-            {
-                device.EndGpuEvent();
-                goto PointShadowPassDone;
-            }
-            mPointShadowSize = desiredSize;
-        }
-
-        // Ensure the shadow SRV isn't still bound from last frame.
+        doPointShadows = RenderLocalShadows(device, ctx, settings);
+        if (doPointShadows)
         {
-            ID3D11ShaderResourceView* nullSrv = nullptr;
-            ctx->PSSetShaderResources(9, 1, &nullSrv);
+            lightCB.pointShadowParams[0] = 1.0f;
+            lightCB.pointShadowParams[1] = settings.pointShadowBias;
+            lightCB.pointShadowParams[2] = 0.0f;
+            lightCB.pointShadowParams[3] = std::clamp(settings.pointShadowStrength, 0.0f, 1.0f);
+            lightCB.pointShadowTexelSize[0] = 1.0f / (float)mShadowAtlasTexSize;
+            lightCB.pointShadowTexelSize[1] = 1.0f / (float)mShadowAtlasTexSize;
+            UpdateLightCB(ctx, lightCB);
         }
 
-        // Build caster batches from snapshot.
-        mPointShadowCasterPtrs.clear();
-        mPointShadowCasterPtrs.reserve(mSnapshotScratch.size() / 2);
-        mPointShadowDrawBatches.clear();
-        mPointShadowInstancesScratch.clear();
-        mPointShadowInstancesScratch.reserve(mSnapshotScratch.size());
-
-        for (const auto& s : mSnapshotScratch)
+        // Restore main viewport/state.
         {
-            if ((s.flags & kInstFlag_CastsShadows) == 0)
-                continue;
-            if (!s.mesh)
-                continue;
-            mPointShadowCasterPtrs.push_back(&s);
+            ctx->RSSetViewports(1, &mSceneViewport);
+            ctx->RSSetState(device.RS());
         }
 
-        std::sort(mPointShadowCasterPtrs.begin(), mPointShadowCasterPtrs.end(), [](const SnapshotItem* a, const SnapshotItem* b)
-        {
-            return (uintptr_t)a->mesh < (uintptr_t)b->mesh;
-        });
-
-        Mesh* currentMesh = nullptr;
-        PointShadowDrawBatch current{};
-        current.startInstance = 0;
-        current.instanceCount = 0;
-
-        for (const SnapshotItem* sp : mPointShadowCasterPtrs)
-        {
-            if (!sp || !sp->mesh)
-                continue;
-
-            if (sp->mesh != currentMesh)
-            {
-                if (currentMesh && current.instanceCount > 0)
-                    mPointShadowDrawBatches.push_back(current);
-
-                currentMesh = sp->mesh;
-                current = {};
-                current.vb = sp->mesh->vb;
-                current.ib = sp->mesh->ib;
-                current.indexCount = (uint32_t)sp->mesh->indices.size();
-                current.vertexCount = (uint32_t)sp->mesh->vertices.size();
-                current.startInstance = (uint32_t)mPointShadowInstancesScratch.size();
-                current.instanceCount = 0;
-                current.mesh = sp->mesh;
-            }
-
-            InstanceData inst{};
-            inst.world = TransformToWorld(sp->transform);
-            inst.normal = WorldToNormalMatrix(inst.world);
-            inst.albedo[0] = sp->albedo.x;
-            inst.albedo[1] = sp->albedo.y;
-            inst.albedo[2] = sp->albedo.z;
-            inst.albedo[3] = sp->albedo.w;
-            inst.roughnessMetallic[0] = sp->roughness;
-            inst.roughnessMetallic[1] = sp->metallic;
-            inst.lightMask = sp->lightMask;
-            inst.flags = sp->flags;
-            mPointShadowInstancesScratch.push_back(inst);
-            current.instanceCount++;
-        }
-        if (currentMesh && current.instanceCount > 0)
-            mPointShadowDrawBatches.push_back(current);
-
-        if (!mPointShadowInstancesScratch.empty() && !mPointShadowDrawBatches.empty())
-        {
-            EnsureInstanceBuffer(device, mPointShadowInstancesScratch.size());
-            if (mInstanceVB)
-            {
-                D3D11_MAPPED_SUBRESOURCE mapped{};
-                if (SUCCEEDED(ctx->Map(mInstanceVB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
-                {
-                    std::memcpy(mapped.pData, mPointShadowInstancesScratch.data(), mPointShadowInstancesScratch.size() * sizeof(InstanceData));
-                    ctx->Unmap(mInstanceVB, 0);
-
-                    // Configure pipeline.
-                    ctx->IASetInputLayout(mInputLayout);
-                    ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-                    ctx->VSSetShader(mVSPointShadow, nullptr, 0);
-                    ctx->PSSetShader(mPSPointShadow, nullptr, 0);
-                    ctx->RSSetState(device.RS());
-                    ctx->OMSetDepthStencilState(device.DSS(), 0);
-                    {
-                        const float blendFactor[4] = { 0, 0, 0, 0 };
-                        ctx->OMSetBlendState(mBlendOpaque, blendFactor, 0xFFFFFFFFu);
-                    }
-
-                    D3D11_VIEWPORT shadowVp{};
-                    shadowVp.TopLeftX = 0;
-                    shadowVp.TopLeftY = 0;
-                    shadowVp.Width = (float)mPointShadowSize;
-                    shadowVp.Height = (float)mPointShadowSize;
-                    shadowVp.MinDepth = 0.0f;
-                    shadowVp.MaxDepth = 1.0f;
-                    ctx->RSSetViewports(1, &shadowVp);
-
-                    struct PointShadowCBData
-                    {
-                        Mat4x4 viewProj;
-                        float lightPos[3];
-                        float invFar;
-                    };
-                    static_assert(sizeof(PointShadowCBData) % 16 == 0, "PointShadowCBData must be 16-byte aligned");
-
-                    const float nearZ = std::min(0.1f, pointShadowFarZ * 0.25f);
-                    const float invFar = 1.0f / std::max(0.01f, pointShadowFarZ);
-
-                    for (int face = 0; face < 6; ++face)
-                    {
-                        ID3D11RenderTargetView* rtv = mPointShadowRTV[face];
-                        ID3D11DepthStencilView* dsv = mPointShadowDSV[face];
-                        if (!rtv || !dsv)
-                            continue;
-
-                        const float clearDepth[4] = { 1, 1, 1, 1 };
-                        ctx->ClearRenderTargetView(rtv, clearDepth);
-                        ctx->ClearDepthStencilView(dsv, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
-                        ctx->OMSetRenderTargets(1, &rtv, dsv);
-
-                        PointShadowCBData cb{};
-                        cb.viewProj = MakePointShadowViewProj(pointShadowLightPos, face, std::max(0.01f, nearZ), pointShadowFarZ);
-                        cb.lightPos[0] = pointShadowLightPos.x;
-                        cb.lightPos[1] = pointShadowLightPos.y;
-                        cb.lightPos[2] = pointShadowLightPos.z;
-                        cb.invFar = invFar;
-
-                        D3D11_MAPPED_SUBRESOURCE mm{};
-                        if (SUCCEEDED(ctx->Map(mPointShadowCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mm)))
-                        {
-                            std::memcpy(mm.pData, &cb, sizeof(cb));
-                            ctx->Unmap(mPointShadowCB, 0);
-                        }
-
-                        ctx->VSSetConstantBuffers(7, 1, &mPointShadowCB);
-                        ctx->PSSetConstantBuffers(7, 1, &mPointShadowCB);
-
-                        for (const auto& b : mPointShadowDrawBatches)
-                        {
-                            if (!b.vb)
-                                continue;
-
-                            ID3D11Buffer* vbs[2] = { b.vb, mInstanceVB };
-                            UINT strides[2] = { (UINT)sizeof(VertexPN), (UINT)sizeof(InstanceData) };
-                            UINT offsets[2] = { 0u, 0u };
-                            ctx->IASetVertexBuffers(0, 2, vbs, strides, offsets);
-
-                            if (b.ib && b.indexCount > 0)
-                            {
-                                ctx->IASetIndexBuffer(b.ib, DXGI_FORMAT_R16_UINT, 0);
-                                ctx->DrawIndexedInstanced(b.indexCount, b.instanceCount, 0, 0, b.startInstance);
-                            }
-                            else
-                            {
-                                ctx->DrawInstanced(b.vertexCount, b.instanceCount, 0, b.startInstance);
-                            }
-                        }
-                    }
+        device.EndGpuEvent();
+    }
 
-                    doPointShadows = true;
-                    pointShadowSrv = mPointShadowSRV;
-                    pointShadowSampler = mLinearClamp;
-                    lightCB.pointShadowParams[0] = 1.0f;
-                    lightCB.pointShadowParams[1] = settings.pointShadowBias;
-                    lightCB.pointShadowParams[2] = invFar;
-                    lightCB.pointShadowParams[3] = std::clamp(settings.pointShadowStrength, 0.0f, 1.0f);
-                    lightCB.pointShadowTexelSize[0] = 1.0f / (float)mPointShadowSize;
-                    lightCB.pointShadowTexelSize[1] = 1.0f / (float)mPointShadowSize;
-                    UpdateLightCB(ctx, lightCB);
-                }
-            }
-        }
+    // Kick prep for the NEXT frame using the same snapshot we already built.
+    EnqueueBuild(mSnapshotScratch, frustum, lodView);
 
-        // Restore main viewport/state.
+    // Main-view instances, appended to the ring after the shadow passes' ranges.
+    mMainInstanceFirst = 0;
+    if (!frame.instances.empty())
+    {
+        if (!mInstanceRing.Append(ctx, frame.instances.data(), (uint32_t)frame.instances.size(), mMainInstanceFirst))
         {
-            D3D11_VIEWPORT vp = device.Viewport();
-            ctx->RSSetViewports(1, &vp);
-            ctx->RSSetState(device.RS());
+            device.EndGpuEvent();
+            return;
         }
-
-        device.EndGpuEvent();
     }
 
-PointShadowPassDone:
-
-    // Kick prep for the NEXT frame using the same snapshot we already built.
-    EnqueueBuild(mSnapshotScratch, frustum);
-
     // Optional: Depth prepass (depth-only). This is an engine-owned pass and does not vary per material.
+    bool depthPrimed = false;
     if (settings.enableDepthPrepass)
     {
         king::perf::CpuScope cpuDepth(mPerf, "DepthPrepass");
         GpuScopeGuard gpuDepth(mGpuPerf, ctx, "DepthPrepass");
+        PassStatsGuard statsDepth(this, "DepthPrepass");
 
-        ID3D11DepthStencilView* dsv = doSsao ? mDepthDSV : device.DSV();
+        ID3D11DepthStencilView* dsv = sceneDsv;
         if (dsv)
         {
-            // If SSAO uses its own depth, it is already cleared above; otherwise clear now.
-            if (!doSsao)
-                ctx->ClearDepthStencilView(dsv, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+            // The geometry pass keeps this depth (LESS_EQUAL), so it is only cleared here.
+            ctx->ClearDepthStencilView(dsv, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+            depthPrimed = true;
 
             ctx->OMSetRenderTargets(0, nullptr, dsv);
-            ctx->OMSetDepthStencilState(device.DSS(), 0);
-            ctx->RSSetState(device.RS());
-            {
-                const float blendFactor[4] = { 0, 0, 0, 0 };
-                ctx->OMSetBlendState(mBlendOpaque, blendFactor, 0xFFFFFFFFu);
-            }
-            {
-                D3D11_VIEWPORT vp = device.Viewport();
-                ctx->RSSetViewports(1, &vp);
-            }
+            ctx->RSSetViewports(1, &mSceneViewport);
+
+            PipelineStateD3D11 depthPipeline = GeometryPipeline(device, nullptr, false, false);
+            depthPipeline.vs = mVSDepth ? mVSDepth : mVS;
+            depthPipeline.ps = nullptr;
 
-            ctx->IASetInputLayout(mInputLayout);
-            ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-            ctx->VSSetShader(mVSDepth ? mVSDepth : mVS, nullptr, 0);
-            ctx->PSSetShader(nullptr, nullptr, 0);
-            ctx->VSSetConstantBuffers(0, 1, &mCameraCB);
+            StateCacheD3D11& sc = mImmediateState;
+            sc.Begin(ctx);
+            sc.SetPipeline(depthPipeline);
+            sc.SetVSConstantBuffer(0, mCameraCB);
 
             // Depth-only draws (single-threaded; cheap and avoids extra deferred contexts churn).
-            for (const Batch& b : frame.batches)
+            // Opaque batches only: blended ones do not write depth in the geometry pass either.
+            for (size_t bi = 0; bi < mDrawOpaqueCount; ++bi)
             {
+                const Batch& b = mDrawBatches[bi];
                 if (!b.mesh || !b.mesh->vb)
                     continue;
 
-                ID3D11Buffer* vbs[2] = { b.mesh->vb, mInstanceVB };
-                UINT strides[2] = { (UINT)sizeof(VertexPN), (UINT)sizeof(InstanceData) };
-                UINT offsets[2] = { 0u, 0u };
-                ctx->IASetVertexBuffers(0, 2, vbs, strides, offsets);
-
-                if (b.mesh->ib && !b.mesh->indices.empty())
-                {
-                    ctx->IASetIndexBuffer(b.mesh->ib, DXGI_FORMAT_R16_UINT, 0);
-                    ctx->DrawIndexedInstanced((UINT)b.mesh->indices.size(), b.instanceCount, 0, 0, b.startInstance);
-                }
-                else
-                {
-                    ctx->DrawInstanced((UINT)b.mesh->vertices.size(), b.instanceCount, 0, b.startInstance);
-                }
+                DrawBatchInstances(sc, b);
             }
 
             // Restore main viewport/state will be re-bound by the geometry pass below.
@@ -2452,6 +4401,7 @@ PointShadowPassDone:
     // Pass: Geometry
     king::perf::CpuScope cpuGeom(mPerf, "GeometryPass");
     GpuScopeGuard gpuGeom(mGpuPerf, ctx, "GeometryPass");
+    PassStatsGuard statsGeom(this, "GeometryPass");
     const float hdrClear[4] = { 0.06f, 0.06f, 0.08f, 1.0f };
     ctx->ClearRenderTargetView(mainRtv, hdrClear);
 
@@ -2459,15 +4409,16 @@ PointShadowPassDone:
     {
         const float normalClear[4] = { 0.5f, 0.5f, 1.0f, 1.0f };
         ctx->ClearRenderTargetView(mNormalRTV, normalClear);
-        ctx->ClearDepthStencilView(mDepthDSV, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+        if (!depthPrimed)
+            ctx->ClearDepthStencilView(mDepthDSV, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
         ID3D11RenderTargetView* rtvs[2] = { mainRtv, mNormalRTV };
         ctx->OMSetRenderTargets(2, rtvs, mDepthDSV);
     }
     else
     {
-        ID3D11DepthStencilView* dsv = device.DSV();
-        if (dsv)
+        ID3D11DepthStencilView* dsv = sceneDsv;
+        if (dsv && !depthPrimed)
             ctx->ClearDepthStencilView(dsv, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
         ctx->OMSetRenderTargets(1, &mainRtv, dsv);
     }
@@ -2477,28 +4428,13 @@ PointShadowPassDone:
         const float blendFactor[4] = { 0, 0, 0, 0 };
         ctx->OMSetBlendState(mBlendOpaque, blendFactor, 0xFFFFFFFFu);
     }
-    {
-        D3D11_VIEWPORT vp = device.Viewport();
-        ctx->RSSetViewports(1, &vp);
-    }
+    ctx->RSSetViewports(1, &mSceneViewport);
 
     ctx->IASetInputLayout(mInputLayout);
     ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
     // Resolve / create GPU-side material bindings for this frame.
     // These are updated on the immediate context before any deferred command recording begins.
-    struct MaterialCBData
-    {
-        float baseColor[4];
-        float emissive[3];
-        float roughness;
-        float metallic;
-        uint32_t flags;
-        float _pad0;
-        float _pad1;
-    };
-    static_assert(sizeof(MaterialCBData) % 16 == 0, "MaterialCBData must be 16-byte aligned");
-
     auto ResolveShaderPath = [&](const king::PbrMaterial& mat) -> std::wstring
     {
         if (mat.shader.empty() || mat.shader == "pbr" || mat.shader == "pbr_forward" || mat.shader == "pbr_test")
@@ -2520,36 +4456,29 @@ PointShadowPassDone:
         return mShaderPath;
     };
 
-    auto ResolveShadingModel = [&](const king::PbrMaterial& mat) -> king::MaterialShadingModel
+    // Only the lit model samples shadows; the others keep one program per shading model.
+    uint32_t shadowQuality[ShadowsD3D11::kMaxCascades] = {};
+    const uint32_t shadowFilterKey = ShadowFilterKey(settings, shadowQuality);
+    auto GetEngineDefines = [&](king::MaterialShadingModel sm) -> std::vector<king::ShaderDefine>
     {
-        // Prefer explicit intent.
-        king::MaterialShadingModel sm = mat.shadingModel;
-
-        // Convenience: derive from common symbolic names when intent isn't set.
+        std::vector<king::ShaderDefine> defs;
+        defs.push_back({ "KING_SHADING_MODEL", std::to_string((int)sm) });
         if (sm == king::MaterialShadingModel::Pbr)
         {
-            if (mat.shader == "unlit" || mat.shader == "unlit_color")
-                return king::MaterialShadingModel::Unlit;
-            if (mat.shader == "rim" || mat.shader == "rim_glow" || mat.shader == "rim_outline_glow")
-                return king::MaterialShadingModel::RimGlow;
+            const std::vector<king::ShaderDefine> shadowDefines = ShadowsD3D11::FilterDefines(shadowQuality, settings.enableShadowAdaptiveFilter);
+            defs.insert(defs.end(), shadowDefines.begin(), shadowDefines.end());
         }
-        return sm;
-    };
-
-    auto GetEngineDefinesForMaterial = [&](const king::PbrMaterial& mat) -> std::vector<king::ShaderDefine>
-    {
-        std::vector<king::ShaderDefine> defs;
-        const king::MaterialShadingModel sm = ResolveShadingModel(mat);
-        defs.push_back({ "KING_SHADING_MODEL", std::to_string((int)sm) });
         return defs;
     };
 
-    auto GetOrCreateProgram = [&](const std::wstring& hlslPath, const std::vector<king::ShaderDefine>& defines) -> ShaderProgramD3D11*
+    // Index into mPrograms, kNoProgram if it failed to compile. The string key is only built
+    // here, when a material is created.
+    auto GetOrCreateProgram = [&](const std::wstring& hlslPath, const std::vector<king::ShaderDefine>& defines) -> uint32_t
     {
         const std::wstring cacheKey = hlslPath + L"|" + ToWide(MakeDefinesKey(defines));
-        auto it = mProgramCache.find(cacheKey);
-        if (it != mProgramCache.end())
-            return it->second.get();
+        auto it = mProgramIds.find(cacheKey);
+        if (it != mProgramIds.end())
+            return it->second;
 
         auto prog = std::make_unique<ShaderProgramD3D11>();
         GeometryProgramDesc desc{};
@@ -2559,19 +4488,76 @@ PointShadowPassDone:
         if (!mShaderCache || !prog->Create(device.Device(), *mShaderCache, desc, &err))
         {
             std::printf("ShaderProgram create failed for '%ls': %s\n", hlslPath.c_str(), err.c_str());
-            return nullptr;
+            return kNoProgram;
+        }
+
+        const uint32_t id = (uint32_t)mPrograms.size();
+        mPrograms.push_back(std::move(prog));
+        mProgramDescs.push_back(std::move(desc));
+        mProgramIds.emplace(cacheKey, id);
+        return id;
+    };
+
+    // Engine variants are looked up by shading model alone (for the current shadow filter).
+    auto GetEngineProgram = [&](king::MaterialShadingModel sm) -> ShaderProgramD3D11*
+    {
+        uint32_t id = kNoProgram;
+        if ((size_t)sm < std::size(mEngineProgramIds))
+        {
+            uint32_t& cached = mEngineProgramIds[(size_t)sm];
+            if (cached == kNoProgram)
+                cached = GetOrCreateProgram(mShaderPath, GetEngineDefines(sm));
+            id = cached;
+        }
+        else
+        {
+            id = GetOrCreateProgram(mShaderPath, GetEngineDefines(sm));
+        }
+        return (id != kNoProgram) ? mPrograms[id].get() : nullptr;
+    };
+
+    // Textures (t5..t8): mounted packs first, else WIC files; both load in the background and
+    // bind the fallback until then. File paths are interpreted relative to the shader directory.
+    auto ResolveTexPath = [&](const std::string& p) -> std::wstring
+    {
+        if (p.empty())
+            return {};
+        const bool isAbs = (p.size() >= 2 && p[1] == ':') || (p.size() >= 2 && p[0] == '\\' && p[1] == '\\');
+        if (isAbs)
+            return ToWide(p);
+        if (!mShaderDir.empty())
+            return mShaderDir + L"\\" + ToWide(p);
+        return ToWide(p);
+    };
+
+    auto LoadTexture = [&](const std::string& p, bool srgb, ID3D11ShaderResourceView* fallback) -> ID3D11ShaderResourceView*
+    {
+        if (mAssets)
+        {
+            if (ID3D11ShaderResourceView* srv = mTextures.GetOrStream2D(*mAssets, p, srgb, fallback))
+                return srv;
         }
+        return mTextures.GetOrLoad2D(ResolveTexPath(p), srgb, fallback);
+    };
 
-        ShaderProgramD3D11* out = prog.get();
-        mProgramCache.emplace(cacheKey, std::move(prog));
-        return out;
+    auto ResolveMaterialTextures = [&](MaterialGpu& mg, const king::PbrMaterial& mat)
+    {
+        mg.albedoSRV = LoadTexture(mat.textures.albedo, true, mTextures.White());
+        mg.normalSRV = LoadTexture(mat.textures.normal, false, mTextures.White());
+        mg.mrSRV = LoadTexture(mat.textures.metallicRoughness, false, mTextures.White());
+        mg.emissiveSRV = LoadTexture(mat.textures.emissive, true, mTextures.Black());
+        mg.textureGeneration = mTextures.Generation();
     };
 
     auto GetOrCreateMaterialGpu = [&](uint64_t key, const king::PbrMaterial& mat) -> const MaterialGpu*
     {
         auto it = mMaterialCache.find(key);
         if (it != mMaterialCache.end())
+        {
+            if (it->second.textureGeneration != mTextures.Generation())
+                ResolveMaterialTextures(it->second, mat);
             return &it->second;
+        }
 
         MaterialGpu mg{};
 
@@ -2584,87 +4570,79 @@ PointShadowPassDone:
             return EnvFlagA("KING_ALLOW_CUSTOM_SHADERS");
         };
 
-        const std::wstring shaderW = ResolveShaderPath(mat);
         if ((EndsWithI(mat.shader, ".hlsl") || EndsWithI(mat.shader, ".hlsli")) && AllowCustomShaders())
         {
-            mg.program = GetOrCreateProgram(shaderW, {});
+            const uint32_t id = GetOrCreateProgram(ResolveShaderPath(mat), {});
+            mg.program = (id != kNoProgram) ? mPrograms[id].get() : nullptr;
         }
         else
         {
-            mg.program = GetOrCreateProgram(mShaderPath, GetEngineDefinesForMaterial(mat));
+            mg.program = GetEngineProgram(ResolveShadingModel(mat));
         }
 
-        // Material constant buffer (b4) for custom shaders.
-        D3D11_BUFFER_DESC bd{};
-        bd.Usage = D3D11_USAGE_DYNAMIC;
-        bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-        bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-        bd.ByteWidth = (UINT)sizeof(MaterialCBData);
-        (void)device.Device()->CreateBuffer(&bd, nullptr, &mg.materialCB);
-
-        // Textures (t5..t8), loaded via WIC. Paths are interpreted relative to the shader directory.
-        auto ResolveTexPath = [&](const std::string& p) -> std::wstring
-        {
-            if (p.empty())
-                return {};
-            const bool isAbs = (p.size() >= 2 && p[1] == ':') || (p.size() >= 2 && p[0] == '\\' && p[1] == '\\');
-            if (isAbs)
-                return ToWide(p);
-            if (!mShaderDir.empty())
-                return mShaderDir + L"\\" + ToWide(p);
-            return ToWide(p);
-        };
+        ResolveMaterialTextures(mg, mat);
 
-        mg.albedoSRV = mTextures.GetOrLoad2D(ResolveTexPath(mat.textures.albedo), true);
-        mg.normalSRV = mTextures.GetOrLoad2D(ResolveTexPath(mat.textures.normal), false);
-        mg.mrSRV = mTextures.GetOrLoad2D(ResolveTexPath(mat.textures.metallicRoughness), false);
-        mg.emissiveSRV = mTextures.GetOrLoad2D(ResolveTexPath(mat.textures.emissive), true);
+        mg.pipelines[0] = GeometryPipeline(device, mg.program, mg.alphaBlend, false);
+        mg.pipelines[1] = GeometryPipeline(device, mg.program, mg.alphaBlend, true);
 
         auto inserted = mMaterialCache.emplace(key, mg);
         return &inserted.first->second;
     };
 
-    std::vector<const MaterialGpu*> frameMaterials;
-    frameMaterials.resize(frame.materials.size(), nullptr);
-    for (size_t i = 0; i < frame.materials.size(); ++i)
-        frameMaterials[i] = GetOrCreateMaterialGpu(frame.materialKeys[i], frame.materials[i]);
-
-    // Update per-material constant buffers ONCE on the immediate context.
-    // This keeps deferred command recording safe (no Map() needed on deferred contexts).
-    for (size_t i = 0; i < frame.materials.size(); ++i)
+    // Resolve per-handle bindings. Hashing + GPU setup only happens when a material is new
+    // or its registry version changed; steady-state frames are a version compare per material.
+    if (mMaterialSlotsOwner != &scene.materials)
     {
-        const MaterialGpu* mg = frameMaterials[i];
-        if (!mg || !mg->materialCB)
-            continue;
+        mMaterialSlots.clear();
+        mMaterialSlotsOwner = &scene.materials;
+    }
+    // Another shadow filter permutation means other programs for every lit material. Programs
+    // stay in mPrograms, so switching back recompiles nothing.
+    if (shadowFilterKey != mMaterialShadowFilterKey)
+    {
+        mMaterialCache.clear();
+        mMaterialSlots.clear();
+        std::fill(std::begin(mEngineProgramIds), std::end(mEngineProgramIds), kNoProgram);
+        mMaterialShadowFilterKey = shadowFilterKey;
+    }
+    if (mMaterialSlots.size() < scene.materials.Size())
+        mMaterialSlots.resize(scene.materials.Size());
 
-        const king::PbrMaterial& mat = frame.materials[i];
-        MaterialCBData cbd{};
-        cbd.baseColor[0] = mat.albedo.x;
-        cbd.baseColor[1] = mat.albedo.y;
-        cbd.baseColor[2] = mat.albedo.z;
-        cbd.baseColor[3] = mat.albedo.w;
-        cbd.emissive[0] = mat.emissive.x;
-        cbd.emissive[1] = mat.emissive.y;
-        cbd.emissive[2] = mat.emissive.z;
-        cbd.roughness = mat.roughness;
-        cbd.metallic = mat.metallic;
-        cbd.flags = 0;
+    // Textures that landed this frame (file loads, pack streams) bump the generation, which
+    // re-resolves the materials holding their fallbacks.
+    mTextures.Update(mAssets ? &mStreamer : nullptr, streamBudget);
 
-        D3D11_MAPPED_SUBRESOURCE mm{};
-        if (SUCCEEDED(ctx->Map(mg->materialCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mm)))
+    // mDrawMaterials -> bindings; secondary views resolve their own batches the same way.
+    auto ResolveFrameMaterials = [&](king::FrameVector<const MaterialGpu*>& out)
+    {
+        out.assign(mDrawMaterials.size(), nullptr);
+        for (size_t i = 0; i < mDrawMaterials.size(); ++i)
         {
-            std::memcpy(mm.pData, &cbd, sizeof(cbd));
-            ctx->Unmap(mg->materialCB, 0);
+            const MaterialHandle h = scene.materials.Valid(mDrawMaterials[i]) ? mDrawMaterials[i] : kDefaultMaterial;
+            MaterialSlot& slot = mMaterialSlots[h];
+            const uint32_t version = scene.materials.Version(h);
+            if (slot.version != version || !slot.gpu || slot.gpu->textureGeneration != mTextures.Generation())
+            {
+                // Keyed by bindings only: parameter values live in the material buffer.
+                slot.gpu = GetOrCreateMaterialGpu(HashMaterialBindings(scene.materials.Get(h)), scene.materials.Get(h));
+                slot.version = version;
+            }
+            out[i] = slot.gpu;
         }
-    }
+    };
+
+    king::FrameVector<const MaterialGpu*> frameMaterials(&frameArena);
+    ResolveFrameMaterials(frameMaterials);
+    UploadMaterialData(device, ctx, scene.materials);
 
-    // Default shaders (for old materials or compile failures).
-    ctx->VSSetShader(mVS, nullptr, 0);
-    ctx->PSSetShader(doSsao ? mPSMrt : mPS, nullptr, 0);
+    // Default pipeline (for old materials or compile failures).
+    const PipelineStateD3D11 fallbackPipeline = GeometryPipeline(device, nullptr, false, doSsao);
 
     ctx->VSSetConstantBuffers(0, 1, &mCameraCB);
     ctx->PSSetConstantBuffers(0, 1, &mCameraCB);
     ctx->PSSetConstantBuffers(1, 1, &mLightCB);
+    BindLightClusters(ctx);
+    ctx->PSSetShaderResources(14, 1, &mMaterialSRV);
 
     if (doShadows && shadowSrv && shadowSamplerPoint && shadowSamplerLinear && shadowSamplerNonCmp)
     {
@@ -2674,63 +4652,87 @@ PointShadowPassDone:
         ctx->PSSetSamplers(3, 1, &shadowSamplerNonCmp);
     }
 
-    if (doPointShadows && pointShadowSrv && pointShadowSampler)
+    if (doPointShadows)
     {
-        ctx->PSSetShaderResources(9, 1, &pointShadowSrv);
-        ctx->PSSetSamplers(5, 1, &pointShadowSampler);
-    }
-
-    EnsureInstanceBuffer(device, frame.instances.size());
-    if (!mInstanceVB)
-    {
-        device.EndGpuEvent();
-        return;
+        ctx->PSSetShaderResources(9, 1, &mShadowAtlasSRV);
+        ctx->PSSetShaderResources(13, 1, &mShadowFacesBuffer.srv);
+        ctx->PSSetSamplers(5, 1, &mLinearClamp);
     }
 
-    D3D11_MAPPED_SUBRESOURCE mapped{};
-    if (FAILED(ctx->Map(mInstanceVB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
-    {
-        device.EndGpuEvent();
-        return;
-    }
-    std::memcpy(mapped.pData, frame.instances.data(), frame.instances.size() * sizeof(InstanceData));
-    ctx->Unmap(mInstanceVB, 0);
+    // Deferred-context submission (optional, KING_USE_DEFERRED_CONTEXTS=1).
+    // Batches are split into contiguous ranges of roughly equal estimated cost, one per
+    // deferred context. Context 0 records on this thread, the others concurrently on the engine
+    // job system; command lists are executed in range order, so draw order is unchanged.
+    // Every kDeferredProbeInterval-th frame takes the immediate path instead, so PerfAnalyzer
+    // can report whether deferred recording actually wins.
+    constexpr uint32_t kDeferredProbeInterval = 16;
+    const bool deferredAvailable = mAllowDeferredContexts && !mDeferredContexts.empty();
+    const bool probeImmediate = deferredAvailable && (++mDeferredProbeFrame % kDeferredProbeInterval) == 0;
+    const auto submitStart = std::chrono::steady_clock::now();
 
-    // Deferred-context submission (optional).
-    // Note: Spawning threads per frame is extremely expensive; we only record on deferred contexts
-    // when explicitly enabled, and we record sequentially to avoid thread creation overhead.
     bool usedDeferred = false;
-    if (mAllowDeferredContexts && !mDeferredContexts.empty())
+    if (deferredAvailable && !probeImmediate)
     {
-        const size_t totalBatches = frame.batches.size();
-        const size_t numWorkers = mDeferredContexts.size();
-        const size_t chunk = (totalBatches + numWorkers - 1) / numWorkers;
+        const size_t totalBatches = mDrawBatches.size();
+        king::JobSystem& jobs = king::GetJobSystem();
+        // More ranges than threads would just record back to back.
+        const size_t numWorkers = std::min(mDeferredContexts.size(), (size_t)jobs.WorkerCount() + 1u);
+
+        // Cost-balanced split: per batch, a fixed per-draw overhead (state + API call) plus
+        // indices x instances. bounds[i]..bounds[i+1] is range i.
+        std::vector<size_t>& bounds = mDeferredChunkBounds;
+        bounds.assign(numWorkers + 1, totalBatches);
+        bounds[0] = 0;
+        {
+            constexpr uint64_t kPerDrawCost = 4096;
+            auto batchCost = [](const Batch& b) -> uint64_t
+            {
+                if (!b.mesh)
+                    return 0;
+                const uint32_t lodIndices = b.mesh->lods[std::min(b.lod, b.mesh->lodCount - 1u)].indexCount;
+                const uint64_t elems = lodIndices > 0 ? (uint64_t)lodIndices : (uint64_t)b.mesh->vertexCount;
+                return kPerDrawCost + elems * (uint64_t)b.instanceCount;
+            };
+
+            uint64_t totalCost = 0;
+            for (const Batch& b : mDrawBatches)
+                totalCost += batchCost(b);
+
+            uint64_t acc = 0;
+            size_t range = 1;
+            for (size_t bi = 0; bi < totalBatches && range < numWorkers; ++bi)
+            {
+                acc += batchCost(mDrawBatches[bi]);
+                // Close range `range-1` once it reaches its share of the total.
+                if (acc * (uint64_t)numWorkers >= totalCost * (uint64_t)range)
+                    bounds[range++] = bi + 1;
+            }
+        }
 
         struct Recorded
         {
             ID3D11CommandList* list = nullptr;
         };
-        std::vector<Recorded> recorded(numWorkers);
+        king::FrameVector<Recorded> recorded(numWorkers, &frameArena);
 
-        for (size_t i = 0; i < numWorkers; ++i)
+        auto recordChunk = [&](size_t i)
         {
-            const size_t begin = i * chunk;
-            const size_t end = (begin + chunk < totalBatches) ? (begin + chunk) : totalBatches;
+            const size_t begin = bounds[i];
+            const size_t end = bounds[i + 1];
             if (begin >= end)
-                continue;
+                return;
 
             ID3D11DeviceContext* dc = mDeferredContexts[i];
             if (!dc)
-                continue;
+                return;
             {
 
                 dc->ClearState();
                 // IMPORTANT: deferred contexts don't inherit the immediate context's
-                // render target binding/state. Bind outputs + raster/depth state before draws.
-                ID3D11DepthStencilView* dsv = doSsao ? mDepthDSV : device.DSV();
-                ID3D11DepthStencilState* dss = device.DSS();
-                ID3D11RasterizerState* rs = device.RS();
-                D3D11_VIEWPORT vp = device.Viewport();
+                // render target binding/state. Bind outputs and the viewport here; the
+                // pipelines carry raster/depth/blend state.
+                ID3D11DepthStencilView* dsv = sceneDsv;
+                D3D11_VIEWPORT vp = mSceneViewport;
 
                 if (doSsao)
                 {
@@ -2743,143 +4745,48 @@ PointShadowPassDone:
                     if (rtv)
                         dc->OMSetRenderTargets(1, &rtv, dsv);
                 }
-                if (dss)
-                    dc->OMSetDepthStencilState(dss, 0);
-                if (rs)
-                    dc->RSSetState(rs);
                 dc->RSSetViewports(1, &vp);
 
-                dc->IASetInputLayout(mInputLayout);
-                dc->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-                // Track current bindings to avoid redundant state changes.
-                const ShaderProgramD3D11* curProg = nullptr;
-                uint32_t curMat = 0xFFFFFFFFu;
-                bool curAlphaBlend = false;
-
-                dc->VSSetShader(mVS, nullptr, 0);
-                dc->PSSetShader(doSsao ? mPSMrt : mPS, nullptr, 0);
-
-                dc->VSSetConstantBuffers(0, 1, &mCameraCB);
-                dc->PSSetConstantBuffers(0, 1, &mCameraCB);
-                dc->PSSetConstantBuffers(1, 1, &mLightCB);
-
-                // Default (opaque) output-merger state.
-                {
-                    const float blendFactor[4] = { 0, 0, 0, 0 };
-                    dc->OMSetBlendState(mBlendOpaque, blendFactor, 0xFFFFFFFFu);
-                    if (dss)
-                        dc->OMSetDepthStencilState(dss, 0);
-                    curAlphaBlend = false;
-                }
+                StateCacheD3D11& sc = mDeferredStateCaches[i];
+                sc.Begin(dc);
+                sc.SetVSConstantBuffer(0, mCameraCB);
+                sc.SetPSConstantBuffer(0, mCameraCB);
+                sc.SetPSConstantBuffer(1, mLightCB);
+                BindLightClusters(dc);
+                sc.SetPSShaderResources(14, 1, &mMaterialSRV);
 
                 if (doShadows && shadowSrv && shadowSamplerPoint && shadowSamplerLinear && shadowSamplerNonCmp)
                 {
-                    dc->PSSetShaderResources(0, 1, &shadowSrv);
-                    ID3D11SamplerState* samplers[2] = { shadowSamplerPoint, shadowSamplerLinear };
-                    dc->PSSetSamplers(0, 2, samplers);
-                    dc->PSSetSamplers(3, 1, &shadowSamplerNonCmp);
+                    sc.SetPSShaderResources(0, 1, &shadowSrv);
+                    sc.SetPSSampler(0, shadowSamplerPoint);
+                    sc.SetPSSampler(1, shadowSamplerLinear);
+                    sc.SetPSSampler(3, shadowSamplerNonCmp);
                 }
 
-                if (doPointShadows && pointShadowSrv && pointShadowSampler)
+                if (doPointShadows)
                 {
-                    dc->PSSetShaderResources(9, 1, &pointShadowSrv);
-                    dc->PSSetSamplers(5, 1, &pointShadowSampler);
+                    sc.SetPSShaderResources(9, 1, &mShadowAtlasSRV);
+                    sc.SetPSShaderResources(13, 1, &mShadowFacesBuffer.srv);
+                    sc.SetPSSampler(5, mLinearClamp);
                 }
 
-                // Material bindings: b4, t5..t8, s4
-                ID3D11SamplerState* matSampler = mLinearClamp;
-                if (matSampler)
-                    dc->PSSetSamplers(4, 1, &matSampler);
-
-                for (size_t bi = begin; bi < end; ++bi)
-                {
-                    const Batch& b = frame.batches[bi];
-                    if (!b.mesh || !b.mesh->vb)
-                        continue;
-
-                    const uint32_t mi = b.materialIndex;
-                    const MaterialGpu* mg = (mi < frameMaterials.size()) ? frameMaterials[mi] : nullptr;
-
-                    // Shader program selection (custom materials can override).
-                    const ShaderProgramD3D11* desiredProg = mg ? mg->program : nullptr;
-                    if (doSsao && desiredProg && !desiredProg->HasMrtVariant())
-                        desiredProg = nullptr; // can't render into normal MRT without PSMainMRT
-
-                    if (desiredProg != curProg)
-                    {
-                        if (desiredProg)
-                        {
-                            dc->IASetInputLayout(desiredProg->InputLayout());
-                            dc->VSSetShader(desiredProg->VS(), nullptr, 0);
-                            dc->PSSetShader(doSsao && desiredProg->PSMrt() ? desiredProg->PSMrt() : desiredProg->PS(), nullptr, 0);
-                        }
-                        else
-                        {
-                            dc->IASetInputLayout(mInputLayout);
-                            dc->VSSetShader(mVS, nullptr, 0);
-                            dc->PSSetShader(doSsao ? mPSMrt : mPS, nullptr, 0);
-                        }
-                        curProg = desiredProg;
-                        curMat = 0xFFFFFFFFu;
-                    }
-
-                    if (mg && mi != curMat)
-                    {
-                        // Render state derived from material intent.
-                        if (mg->alphaBlend != curAlphaBlend)
-                        {
-                            const float blendFactor[4] = { 0, 0, 0, 0 };
-                            dc->OMSetBlendState(mg->alphaBlend ? mBlendAlpha : mBlendOpaque, blendFactor, 0xFFFFFFFFu);
-                            if (mg->alphaBlend)
-                            {
-                                if (mDepthReadOnly)
-                                    dc->OMSetDepthStencilState(mDepthReadOnly, 0);
-                            }
-                            else
-                            {
-                                if (dss)
-                                    dc->OMSetDepthStencilState(dss, 0);
-                            }
-                            curAlphaBlend = mg->alphaBlend;
-                        }
-
-                        // Update per-material constant buffer once per frame on the immediate context.
-                        // Here we only bind (safe for deferred).
-                        if (mg->materialCB)
-                            dc->PSSetConstantBuffers(4, 1, &mg->materialCB);
-
-                        ID3D11ShaderResourceView* srvs[4] = {
-                            mg->albedoSRV ? mg->albedoSRV : mTextures.White(),
-                            mg->normalSRV ? mg->normalSRV : mTextures.White(),
-                            mg->mrSRV ? mg->mrSRV : mTextures.White(),
-                            mg->emissiveSRV ? mg->emissiveSRV : mTextures.Black()
-                        };
-                        dc->PSSetShaderResources(5, 4, srvs);
-                        curMat = mi;
-                    }
-
-                    ID3D11Buffer* vbs[2] = { b.mesh->vb, mInstanceVB };
-                    UINT strides[2] = { (UINT)sizeof(VertexPN), (UINT)sizeof(InstanceData) };
-                    UINT offsets[2] = { 0u, 0u };
-                    dc->IASetVertexBuffers(0, 2, vbs, strides, offsets);
+                // Material sampler (s4); t5..t8 are bound per batch.
+                if (mLinearClamp)
+                    sc.SetPSSampler(4, mLinearClamp);
 
-                    if (b.mesh->ib && !b.mesh->indices.empty())
-                    {
-                        dc->IASetIndexBuffer(b.mesh->ib, DXGI_FORMAT_R16_UINT, 0);
-                        dc->DrawIndexedInstanced((UINT)b.mesh->indices.size(), b.instanceCount, 0, 0, b.startInstance);
-                    }
-                    else
-                    {
-                        dc->DrawInstanced((UINT)b.mesh->vertices.size(), b.instanceCount, 0, b.startInstance);
-                    }
-                }
+                DrawGeometryBatches(sc, begin, end, frameMaterials, fallbackPipeline, doSsao);
 
                 ID3D11CommandList* cl = nullptr;
                 if (SUCCEEDED(dc->FinishCommandList(FALSE, &cl)))
                     recorded[i].list = cl;
             }
-        }
+        };
+
+        king::JobCounter recordDone;
+        for (size_t i = 1; i < numWorkers; ++i)
+            jobs.Submit(recordDone, [&recordChunk, i]() { recordChunk(i); });
+        recordChunk(0);
+        jobs.Wait(recordDone);
 
         for (auto& r : recorded)
         {
@@ -2897,189 +4804,369 @@ PointShadowPassDone:
     // Fallback: immediate submission (single-threaded draw calls).
     if (!usedDeferred)
     {
-        const ShaderProgramD3D11* curProg = nullptr;
-        uint32_t curMat = 0xFFFFFFFFu;
-        bool curAlphaBlend = false;
-        ID3D11SamplerState* matSampler = mLinearClamp;
-        if (matSampler)
-            ctx->PSSetSamplers(4, 1, &matSampler);
+        StateCacheD3D11& sc = mImmediateState;
+        sc.Begin(ctx);
+        if (mLinearClamp)
+            sc.SetPSSampler(4, mLinearClamp);
+        DrawGeometryBatches(sc, 0, mDrawBatches.size(), frameMaterials, fallbackPipeline, doSsao);
+    }
+
+    if (deferredAvailable)
+    {
+        const double submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count();
+        mPerf.AddComparisonMs("GeomSubmit", "deferred", "immediate", !usedDeferred, submitMs);
+    }
+
+    device.EndGpuEvent();
 
+    // Hi-Z pyramid from this frame's opaque depth, consumed by next frame's GPU cull.
+    if (doOcclusion)
+    {
+        GpuScopeGuard gpuHiZ(mGpuPerf, ctx, "HiZBuild");
+        PassStatsGuard statsHiZ(this, "HiZBuild");
+        ctx->OMSetRenderTargets(0, nullptr, nullptr);
+        mGpuCulling->BuildHiZ(device.Device(), ctx, mDepthSRV, mDepthW, mDepthH, sceneW, sceneH, viewProj);
+        if (doSsao)
         {
-            const float blendFactor[4] = { 0, 0, 0, 0 };
-            ctx->OMSetBlendState(mBlendOpaque, blendFactor, 0xFFFFFFFFu);
-            ctx->OMSetDepthStencilState(device.DSS(), 0);
-            curAlphaBlend = false;
+            ID3D11RenderTargetView* rtvs[2] = { mainRtv, mNormalRTV };
+            ctx->OMSetRenderTargets(2, rtvs, mDepthDSV);
         }
-
-        for (const Batch& b : frame.batches)
+        else
         {
-            if (!b.mesh || !b.mesh->vb)
-                continue;
-
-            const uint32_t mi = b.materialIndex;
-            const MaterialGpu* mg = (mi < frameMaterials.size()) ? frameMaterials[mi] : nullptr;
+            ctx->OMSetRenderTargets(1, &mainRtv, sceneDsv);
+        }
+    }
 
-            const ShaderProgramD3D11* desiredProg = mg ? mg->program : nullptr;
-            if (doSsao && desiredProg && !desiredProg->HasMrtVariant())
-                desiredProg = nullptr;
+    // Post-geometry passes (SSAO + blur, bloom, vignette, tonemap) run as a frame graph: the
+    // scene targets written above are imported, the intermediates are transients, and passes
+    // whose output nothing reads (SSAO without tonemap) are culled.
+    FrameGraphD3D11& graph = mFrameGraph;
+    graph.Reset();
+
+    // SSAO ladder (RenderSettings::ssaoQuality): optional downsample of depth + normal to AO
+    // resolution, AO, separable blur (compute when available), optional temporal
+    // accumulation, and a depth-aware upsample back to full resolution.
+    FrameGraphTexture aoTex = kInvalidFrameGraphTexture;
+    if (doSsao && mSsaoCB && mNormalSRV && mDepthSRV && mPost.Fullscreen().VS())
+    {
+        const uint32_t quality = std::min(settings.ssaoQuality, 2u);
+        const uint32_t downsample = (quality == 0) ? 4u : (quality == 1) ? 2u : 1u;
+        // AO targets are sized from the full back buffer; aoW x aoH of them hold this frame's
+        // scene viewport (dynamic resolution).
+        const uint32_t fullW = device.BackBufferWidth();
+        const uint32_t fullH = device.BackBufferHeight();
+        const uint32_t aoTexW = std::max(1u, (fullW + downsample - 1u) / downsample);
+        const uint32_t aoTexH = std::max(1u, (fullH + downsample - 1u) / downsample);
+        const uint32_t aoW = std::max(1u, (sceneW + downsample - 1u) / downsample);
+        const uint32_t aoH = std::max(1u, (sceneH + downsample - 1u) / downsample);
+        const bool computeBlur = mSsaoBlurHCS && mSsaoBlurVCS;
+        const bool temporal = settings.enableSsaoTemporal && EnsureSsaoHistory(device, aoTexW, aoTexH);
+        // History accumulated at another scale covers a different region: start over.
+        if (!temporal || mSsaoHistoryScale != renderScale)
+            mSsaoHistoryValid = false;
+        mSsaoHistoryScale = renderScale;
 
-            if (desiredProg != curProg)
+        std::string ppErr;
+        auto ps = [&](const char* entry) { return mPost.Fullscreen().GetOrCreatePS(device, *mShaderCache, mShaderPath, entry, {}, &ppErr); };
+        ID3D11PixelShader* psSsao = ps("PSSsaoMain");
+        ID3D11PixelShader* psBlur = computeBlur ? nullptr : ps("PSBlurMain");
+        ID3D11PixelShader* psDownsample = (downsample > 1) ? ps("PSSsaoDownsampleMain") : nullptr;
+        ID3D11PixelShader* psUpsample = (downsample > 1) ? ps("PSSsaoUpsampleMain") : nullptr;
+        ID3D11PixelShader* psTemporal = temporal ? ps("PSSsaoTemporalMain") : nullptr;
+        const bool haveShaders = psSsao && (computeBlur || psBlur) && (downsample == 1 || (psDownsample && psUpsample)) &&
+            (!temporal || psTemporal);
+
+        if (haveShaders)
+        {
+            using namespace DirectX;
+            const bool haveRealProj = !IsIdentityMat(proj);
+
+            // Preferred path: do SSAO in view-space using the actual projection matrix.
+            // Fallback path: preserve the old behavior by treating SSAO space as world-space and using viewProj.
+            const XMMATRIX projM = haveRealProj ? dx::LoadMat4x4(proj) : dx::LoadMat4x4(viewProj);
+            const XMMATRIX invProjM = XMMatrixInverse(nullptr, projM);
+
+            SsaoCBData cb{};
+            cb.proj = haveRealProj ? proj : viewProj;
+            cb.invProj = dx::StoreMat4x4(invProjM);
+            cb.view = haveRealProj ? view : Mat4x4{};
+            cb.invTargetSize[0] = 1.0f / (float)aoW;
+            cb.invTargetSize[1] = 1.0f / (float)aoH;
+            cb.radius = settings.ssaoRadius;
+            cb.bias = settings.ssaoBias;
+            cb.targetSize[0] = aoW;
+            cb.targetSize[1] = aoH;
+            cb.sourceSize[0] = sceneW;
+            cb.sourceSize[1] = sceneH;
+            cb.downsample = downsample;
+            cb.uvScale[0] = (float)aoW / (float)aoTexW;
+            cb.uvScale[1] = (float)aoH / (float)aoTexH;
+            cb.temporalBlend = 1.0f;
+            if (temporal)
             {
-                if (desiredProg)
-                {
-                    ctx->IASetInputLayout(desiredProg->InputLayout());
-                    ctx->VSSetShader(desiredProg->VS(), nullptr, 0);
-                    ctx->PSSetShader(doSsao && desiredProg->PSMrt() ? desiredProg->PSMrt() : desiredProg->PS(), nullptr, 0);
-                }
-                else
-                {
-                    ctx->IASetInputLayout(mInputLayout);
-                    ctx->VSSetShader(mVS, nullptr, 0);
-                    ctx->PSSetShader(doSsao ? mPSMrt : mPS, nullptr, 0);
-                }
-                curProg = desiredProg;
-                curMat = 0xFFFFFFFFu;
+                // Current clip -> world -> last frame's clip. Without valid history the blend
+                // weight is 1 and the pass just seeds it.
+                const XMMATRIX vp = dx::LoadMat4x4(viewProj);
+                cb.reproject = dx::StoreMat4x4(XMMatrixMultiply(XMMatrixInverse(nullptr, vp), dx::LoadMat4x4(mSsaoPrevViewProj)));
+                cb.temporalBlend = mSsaoHistoryValid ? std::clamp(settings.ssaoTemporalBlend, 0.01f, 1.0f) : 1.0f;
+                // R2 sequence: well spread offsets from frame to frame.
+                mSsaoFrame++;
+                cb.noiseOffset[0] = std::fmod((float)mSsaoFrame * 0.7548777f, 1.0f) * 64.0f;
+                cb.noiseOffset[1] = std::fmod((float)mSsaoFrame * 0.5698403f, 1.0f) * 64.0f;
+                mSsaoPrevViewProj = viewProj;
+                mSsaoHistoryIndex ^= 1u;
             }
 
-            if (mg && mi != curMat)
+            // One set of constants for every SSAO pass, uploaded before the graph executes.
+            D3D11_MAPPED_SUBRESOURCE mappedSsao{};
+            if (SUCCEEDED(ctx->Map(mSsaoCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedSsao)))
             {
-                if (mg->alphaBlend != curAlphaBlend)
-                {
-                    const float blendFactor[4] = { 0, 0, 0, 0 };
-                    ctx->OMSetBlendState(mg->alphaBlend ? mBlendAlpha : mBlendOpaque, blendFactor, 0xFFFFFFFFu);
-                    if (mg->alphaBlend)
-                    {
-                        if (mDepthReadOnly)
-                            ctx->OMSetDepthStencilState(mDepthReadOnly, 0);
-                    }
-                    else
-                    {
-                        ctx->OMSetDepthStencilState(device.DSS(), 0);
-                    }
-                    curAlphaBlend = mg->alphaBlend;
-                }
-
-                if (mg->materialCB)
-                    ctx->PSSetConstantBuffers(4, 1, &mg->materialCB);
-                ID3D11ShaderResourceView* srvs[4] = {
-                    mg->albedoSRV ? mg->albedoSRV : mTextures.White(),
-                    mg->normalSRV ? mg->normalSRV : mTextures.White(),
-                    mg->mrSRV ? mg->mrSRV : mTextures.White(),
-                    mg->emissiveSRV ? mg->emissiveSRV : mTextures.Black()
-                };
-                ctx->PSSetShaderResources(5, 4, srvs);
-                curMat = mi;
+                std::memcpy(mappedSsao.pData, &cb, sizeof(cb));
+                ctx->Unmap(mSsaoCB, 0);
+                mMapBytes += sizeof(cb);
             }
 
-            ID3D11Buffer* vbs[2] = { b.mesh->vb, mInstanceVB };
-            UINT strides[2] = { (UINT)sizeof(VertexPN), (UINT)sizeof(InstanceData) };
-            UINT offsets[2] = { 0u, 0u };
-            ctx->IASetVertexBuffers(0, 2, vbs, strides, offsets);
-
-            if (b.mesh->ib && !b.mesh->indices.empty())
+            // AO targets are UAV-capable so the raw AO and the blur output share one desc
+            // (and one texture: the raw AO is dead before the second blur starts).
+            const FrameGraphTextureDesc aoDesc{ aoTexW, aoTexH, DXGI_FORMAT_R8_UNORM, computeBlur };
+            D3D11_VIEWPORT aoVp{};
+            aoVp.Width = (float)aoW;
+            aoVp.Height = (float)aoH;
+            aoVp.MaxDepth = 1.0f;
+            const D3D11_VIEWPORT fullVp = mSceneViewport;
+
+            const FrameGraphTexture depthTex = graph.Import("SceneDepth", nullptr, mDepthSRV);
+            const FrameGraphTexture normalTex = graph.Import("SceneNormal", mNormalRTV, mNormalSRV);
+            FrameGraphTexture aoDepth = depthTex;
+            FrameGraphTexture aoNormal = normalTex;
+
+            struct SsaoPassData
             {
-                ctx->IASetIndexBuffer(b.mesh->ib, DXGI_FORMAT_R16_UINT, 0);
-                ctx->DrawIndexedInstanced((UINT)b.mesh->indices.size(), b.instanceCount, 0, 0, b.startInstance);
-            }
-            else
+                FrameGraphTexture in[3] = { kInvalidFrameGraphTexture, kInvalidFrameGraphTexture, kInvalidFrameGraphTexture };
+                FrameGraphTexture out[2] = { kInvalidFrameGraphTexture, kInvalidFrameGraphTexture };
+            };
+
+            if (downsample > 1)
             {
-                ctx->DrawInstanced((UINT)b.mesh->vertices.size(), b.instanceCount, 0, b.startInstance);
+                graph.AddPass<SsaoPassData>("SSAODownsample", "SSAOPass",
+                    [&](FrameGraphD3D11::Builder& b, SsaoPassData& data)
+                    {
+                        data.in[0] = depthTex;
+                        data.in[1] = normalTex;
+                        b.Read(depthTex);
+                        b.Read(normalTex);
+                        data.out[0] = b.Create("SSAODepth", { aoTexW, aoTexH, DXGI_FORMAT_R32_FLOAT });
+                        data.out[1] = b.Create("SSAONormal", { aoTexW, aoTexH, DXGI_FORMAT_R8G8B8A8_UNORM });
+                        aoDepth = data.out[0];
+                        aoNormal = data.out[1];
+                    },
+                    [this, aoVp, psDownsample](const FrameGraphD3D11& g, StateCacheD3D11& sc, const SsaoPassData& data)
+                    {
+                        mPost.Fullscreen().Begin(sc, g.RTV(data.out[0]), aoVp, psDownsample);
+                        ID3D11RenderTargetView* rtvs[2] = { g.RTV(data.out[0]), g.RTV(data.out[1]) };
+                        sc.Context()->OMSetRenderTargets(2, rtvs, nullptr);
+
+                        sc.SetPSConstantBuffer(3, mSsaoCB);
+                        ID3D11ShaderResourceView* srvs[2] = { g.SRV(data.in[0]), g.SRV(data.in[1]) };
+                        sc.SetPSShaderResources(3, 2, srvs);
+                        mPost.Fullscreen().Draw(sc);
+
+                        ID3D11ShaderResourceView* nullSrvs[2] = { nullptr, nullptr };
+                        sc.SetPSShaderResources(3, 2, nullSrvs);
+                    });
             }
-        }
-    }
-
-    device.EndGpuEvent();
-
-    // Pass: SSAO + blur
-    if (doSsao && mSsaoCB && mSsaoRTV && mSsaoBlurRTV)
-    {
-        king::perf::CpuScope cpuSsao(mPerf, "SSAOPass");
-        GpuScopeGuard gpuSsao(mGpuPerf, ctx, "SSAOPass");
-        device.BeginGpuEvent(L"SSAOPass");
-
-        std::string ppErr;
-        ID3D11PixelShader* psSsao = mPost.Fullscreen().GetOrCreatePS(device, *mShaderCache, mShaderPath, "PSSsaoMain", {}, &ppErr);
-        ID3D11PixelShader* psBlur = mPost.Fullscreen().GetOrCreatePS(device, *mShaderCache, mShaderPath, "PSBlurMain", {}, &ppErr);
-        if (!psSsao || !psBlur || !mPost.Fullscreen().VS())
-        {
-            device.EndGpuEvent();
-            return;
-        }
-
-        using namespace DirectX;
-        const bool haveRealProj = !IsIdentityMat(proj);
-
-        // Preferred path: do SSAO in view-space using the actual projection matrix.
-        // Fallback path: preserve the old behavior by treating SSAO space as world-space and using viewProj.
-        const XMMATRIX projM = haveRealProj ? dx::LoadMat4x4(proj) : dx::LoadMat4x4(viewProj);
-        const XMMATRIX invProjM = XMMatrixInverse(nullptr, projM);
-
-        SsaoCBData scb{};
-        scb.proj = haveRealProj ? proj : viewProj;
-        scb.invProj = dx::StoreMat4x4(invProjM);
-        scb.view = haveRealProj ? view : Mat4x4{};
-        scb.invTargetSize[0] = 1.0f / (float)device.BackBufferWidth();
-        scb.invTargetSize[1] = 1.0f / (float)device.BackBufferHeight();
-        scb.radius = settings.ssaoRadius;
-        scb.bias = settings.ssaoBias;
 
-        D3D11_MAPPED_SUBRESOURCE mappedSsao{};
-        if (SUCCEEDED(ctx->Map(mSsaoCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedSsao)))
-        {
-            std::memcpy(mappedSsao.pData, &scb, sizeof(scb));
-            ctx->Unmap(mSsaoCB, 0);
-        }
-
-        // SSAO target
-        const float aoClear[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
-        ctx->ClearRenderTargetView(mSsaoRTV, aoClear);
+            FrameGraphTexture rawAo = kInvalidFrameGraphTexture;
+            graph.AddPass<SsaoPassData>("SSAO", "SSAOPass",
+                [&](FrameGraphD3D11::Builder& b, SsaoPassData& data)
+                {
+                    data.in[0] = aoDepth;
+                    data.in[1] = aoNormal;
+                    b.Read(aoDepth);
+                    b.Read(aoNormal);
+                    data.out[0] = b.Create("SSAO", aoDesc);
+                    rawAo = data.out[0];
+                },
+                [this, aoVp, psSsao](const FrameGraphD3D11& g, StateCacheD3D11& sc, const SsaoPassData& data)
+                {
+                    const float aoClear[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+                    sc.Context()->ClearRenderTargetView(g.RTV(data.out[0]), aoClear);
+                    mPost.Fullscreen().Begin(sc, g.RTV(data.out[0]), aoVp, psSsao);
 
-        D3D11_VIEWPORT vp0 = device.Viewport();
-        mPost.Fullscreen().Begin(ctx, mSsaoRTV, vp0);
-        ctx->PSSetShader(psSsao, nullptr, 0);
+                    sc.SetPSConstantBuffer(3, mSsaoCB);
+                    ID3D11ShaderResourceView* ssaoSrvs[2] = { g.SRV(data.in[0]), g.SRV(data.in[1]) };
+                    sc.SetPSShaderResources(3, 2, ssaoSrvs);
+                    if (mPointClamp)
+                        sc.SetPSSampler(2, mPointClamp);
 
-        ctx->PSSetConstantBuffers(3, 1, &mSsaoCB);
+                    mPost.Fullscreen().Draw(sc);
 
-        ID3D11ShaderResourceView* ssaoSrvs[2] = { mDepthSRV, mNormalSRV };
-        ctx->PSSetShaderResources(3, 2, ssaoSrvs);
+                    ID3D11ShaderResourceView* nullSrvs[2] = { nullptr, nullptr };
+                    sc.SetPSShaderResources(3, 2, nullSrvs);
+                });
 
-        if (mPointClamp)
-            ctx->PSSetSamplers(2, 1, &mPointClamp);
+            FrameGraphTexture blurred = kInvalidFrameGraphTexture;
+            if (computeBlur)
+            {
+                struct CsBlurData
+                {
+                    FrameGraphTexture src = kInvalidFrameGraphTexture;
+                    FrameGraphTexture depth = kInvalidFrameGraphTexture;
+                    FrameGraphTexture dst = kInvalidFrameGraphTexture;
+                };
+                auto addBlur = [&](const char* name, const char* dstName, FrameGraphTexture src, ID3D11ComputeShader* cs, bool horizontal)
+                {
+                    FrameGraphTexture dst = kInvalidFrameGraphTexture;
+                    graph.AddPass<CsBlurData>(name, "SSAOPass",
+                        [&](FrameGraphD3D11::Builder& b, CsBlurData& data)
+                        {
+                            data.src = src;
+                            data.depth = aoDepth;
+                            b.Read(src);
+                            b.Read(aoDepth);
+                            data.dst = b.Create(dstName, aoDesc);
+                            dst = data.dst;
+                        },
+                        [this, cs, horizontal, aoW, aoH](const FrameGraphD3D11& g, StateCacheD3D11& sc, const CsBlurData& data)
+                        {
+                            // Group = 64 pixels of one row (H) or column (V); see ssao_cs.hlsl.
+                            ID3D11DeviceContext* c = sc.Context();
+                            c->OMSetRenderTargets(0, nullptr, nullptr);
+                            ID3D11ShaderResourceView* srvs[2] = { g.SRV(data.src), g.SRV(data.depth) };
+                            ID3D11UnorderedAccessView* uav = g.UAV(data.dst);
+                            c->CSSetShader(cs, nullptr, 0);
+                            c->CSSetConstantBuffers(3, 1, &mSsaoCB);
+                            c->CSSetShaderResources(0, 2, srvs);
+                            c->CSSetUnorderedAccessViews(0, 1, &uav, nullptr);
+                            if (horizontal)
+                                sc.Dispatch((aoW + 63u) / 64u, aoH, 1);
+                            else
+                                sc.Dispatch((aoH + 63u) / 64u, aoW, 1);
+
+                            ID3D11ShaderResourceView* nullSrvs[2] = { nullptr, nullptr };
+                            ID3D11UnorderedAccessView* nullUav = nullptr;
+                            c->CSSetShaderResources(0, 2, nullSrvs);
+                            c->CSSetUnorderedAccessViews(0, 1, &nullUav, nullptr);
+                            c->CSSetShader(nullptr, nullptr, 0);
+                        });
+                    return dst;
+                };
+                const FrameGraphTexture blurredH = addBlur("SSAOBlurH", "SSAOBlurH", rawAo, mSsaoBlurHCS, true);
+                blurred = addBlur("SSAOBlurV", "SSAOBlurred", blurredH, mSsaoBlurVCS, false);
+            }
+            else
+            {
+                graph.AddPass<SsaoPassData>("SSAOBlur", "SSAOPass",
+                    [&](FrameGraphD3D11::Builder& b, SsaoPassData& data)
+                    {
+                        data.in[0] = rawAo;
+                        b.Read(rawAo);
+                        data.out[0] = b.Create("SSAOBlurred", aoDesc);
+                        blurred = data.out[0];
+                    },
+                    [this, aoVp, psBlur](const FrameGraphD3D11& g, StateCacheD3D11& sc, const SsaoPassData& data)
+                    {
+                        const float aoClear[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+                        sc.Context()->ClearRenderTargetView(g.RTV(data.out[0]), aoClear);
+                        mPost.Fullscreen().Begin(sc, g.RTV(data.out[0]), aoVp, psBlur);
 
-        mPost.Fullscreen().Draw(ctx);
+                        sc.SetPSConstantBuffer(3, mSsaoCB);
+                        ID3D11ShaderResourceView* src = g.SRV(data.in[0]);
+                        sc.SetPSShaderResources(2, 1, &src);
+                        if (mLinearClamp)
+                            sc.SetPSSampler(1, mLinearClamp);
 
-        // Unbind SSAO inputs
-        {
-            ID3D11ShaderResourceView* nullSrvs[2] = { nullptr, nullptr };
-            ctx->PSSetShaderResources(3, 2, nullSrvs);
-        }
+                        mPost.Fullscreen().Draw(sc);
 
-        // Blur target
-        ctx->ClearRenderTargetView(mSsaoBlurRTV, aoClear);
-        mPost.Fullscreen().Begin(ctx, mSsaoBlurRTV, vp0);
-        ctx->PSSetShader(psBlur, nullptr, 0);
-        ctx->PSSetShaderResources(2, 1, &mSsaoSRV);
-        if (mLinearClamp)
-            ctx->PSSetSamplers(1, 1, &mLinearClamp);
+                        ID3D11ShaderResourceView* nullSrv[1] = { nullptr };
+                        sc.SetPSShaderResources(2, 1, nullSrv);
+                    });
+            }
+            aoTex = blurred;
 
-        mPost.Fullscreen().Draw(ctx);
+            if (temporal)
+            {
+                const uint32_t cur = mSsaoHistoryIndex;
+                const FrameGraphTexture history = graph.Import("SSAOHistory", nullptr, mSsaoHistorySRV[cur ^ 1u]);
+                const FrameGraphTexture accumulated = graph.Import("SSAOAccumulated", mSsaoHistoryRTV[cur], mSsaoHistorySRV[cur]);
+                graph.AddPass<SsaoPassData>("SSAOTemporal", "SSAOPass",
+                    [&](FrameGraphD3D11::Builder& b, SsaoPassData& data)
+                    {
+                        data.in[0] = blurred;
+                        data.in[1] = aoDepth;
+                        data.in[2] = history;
+                        b.Read(blurred);
+                        b.Read(aoDepth);
+                        b.Read(history);
+                        b.Write(accumulated);
+                        data.out[0] = accumulated;
+                    },
+                    [this, aoVp, psTemporal](const FrameGraphD3D11& g, StateCacheD3D11& sc, const SsaoPassData& data)
+                    {
+                        mPost.Fullscreen().Begin(sc, g.RTV(data.out[0]), aoVp, psTemporal);
+
+                        sc.SetPSConstantBuffer(3, mSsaoCB);
+                        ID3D11ShaderResourceView* ao = g.SRV(data.in[0]);
+                        ID3D11ShaderResourceView* depth = g.SRV(data.in[1]);
+                        ID3D11ShaderResourceView* hist = g.SRV(data.in[2]);
+                        sc.SetPSShaderResources(2, 1, &ao);
+                        sc.SetPSShaderResources(15, 1, &depth);
+                        sc.SetPSShaderResources(16, 1, &hist);
+                        if (mLinearClamp)
+                            sc.SetPSSampler(1, mLinearClamp);
+
+                        mPost.Fullscreen().Draw(sc);
+
+                        ID3D11ShaderResourceView* nullSrv[1] = { nullptr };
+                        sc.SetPSShaderResources(2, 1, nullSrv);
+                        sc.SetPSShaderResources(15, 1, nullSrv);
+                        sc.SetPSShaderResources(16, 1, nullSrv);
+                    });
+                mSsaoHistoryValid = true;
+                aoTex = accumulated;
+            }
 
-        // Unbind blur input
-        {
-            ID3D11ShaderResourceView* nullSrv[1] = { nullptr };
-            ctx->PSSetShaderResources(2, 1, nullSrv);
+            if (downsample > 1)
+            {
+                const FrameGraphTexture lowAo = aoTex;
+                graph.AddPass<SsaoPassData>("SSAOUpsample", "SSAOPass",
+                    [&](FrameGraphD3D11::Builder& b, SsaoPassData& data)
+                    {
+                        data.in[0] = lowAo;
+                        data.in[1] = aoDepth;
+                        data.in[2] = depthTex;
+                        b.Read(lowAo);
+                        b.Read(aoDepth);
+                        b.Read(depthTex);
+                        data.out[0] = b.Create("SSAOFull", { fullW, fullH, DXGI_FORMAT_R8_UNORM });
+                        aoTex = data.out[0];
+                    },
+                    [this, fullVp, psUpsample](const FrameGraphD3D11& g, StateCacheD3D11& sc, const SsaoPassData& data)
+                    {
+                        mPost.Fullscreen().Begin(sc, g.RTV(data.out[0]), fullVp, psUpsample);
+
+                        sc.SetPSConstantBuffer(3, mSsaoCB);
+                        ID3D11ShaderResourceView* ao = g.SRV(data.in[0]);
+                        ID3D11ShaderResourceView* lowDepth = g.SRV(data.in[1]);
+                        ID3D11ShaderResourceView* fullDepth = g.SRV(data.in[2]);
+                        sc.SetPSShaderResources(2, 1, &ao);
+                        sc.SetPSShaderResources(3, 1, &fullDepth);
+                        sc.SetPSShaderResources(15, 1, &lowDepth);
+
+                        mPost.Fullscreen().Draw(sc);
+
+                        ID3D11ShaderResourceView* nullSrv[1] = { nullptr };
+                        sc.SetPSShaderResources(2, 1, nullSrv);
+                        sc.SetPSShaderResources(3, 1, nullSrv);
+                        sc.SetPSShaderResources(15, 1, nullSrv);
+                    });
+            }
         }
-
-        device.EndGpuEvent();
     }
 
-    // Pass: Tonemap HDR -> backbuffer
+    // Tonemap HDR -> backbuffer
     if (doTonemap && doHdrTarget && mHdrSRV && device.RTV() && mPost.Fullscreen().VS())
     {
-        king::perf::CpuScope cpuTonemap(mPerf, "TonemapPass");
-        GpuScopeGuard gpuTonemap(mGpuPerf, ctx, "TonemapPass");
-        device.BeginGpuEvent(L"TonemapPass");
-
         static bool onceTonemap = false;
         if (!onceTonemap)
         {
@@ -3087,20 +5174,141 @@ PointShadowPassDone:
             std::printf("TonemapPass: executing\n");
         }
 
-        // Bind AO (blurred SSAO) if available, otherwise bind a 1x1 white texture.
-        ID3D11ShaderResourceView* aoSrv = (doSsao && mSsaoBlurSRV) ? mSsaoBlurSRV : mAoWhiteSRV;
-
+        // AO is the blurred SSAO if it ran, otherwise a 1x1 white texture.
         PostProcessD3D11::Settings pp{};
+        pp.ambientOcclusion = (aoTex != kInvalidFrameGraphTexture);
+        if (aoTex == kInvalidFrameGraphTexture)
+            aoTex = graph.Import("AOFallback", nullptr, mAoWhiteSRV);
+
         pp.enableVignette = settings.enableVignette && mAllowPostProcessing;
         pp.vignetteStrength = settings.vignetteStrength;
         pp.vignettePower = settings.vignettePower;
         pp.enableBloom = settings.enableBloom && mAllowPostProcessing;
         pp.bloomIntensity = settings.bloomIntensity;
         pp.bloomThreshold = settings.bloomThreshold;
+        pp.renderWidth = sceneW;
+        pp.renderHeight = sceneH;
+        pp.upscaleSharpness = settings.upscaleSharpness;
 
-        mPost.Execute(ctx, device, *mShaderCache, mHdrSRV, aoSrv, mCameraCB, mLinearClamp, pp);
+        const FrameGraphTexture hdrTex = graph.Import("SceneColor", mHdrRTV, mHdrSRV);
+        const FrameGraphTexture backBuffer = graph.Import("BackBuffer", device.RTV(), nullptr);
+        mPost.AddPasses(graph, device, *mShaderCache, ctx, hdrTex, aoTex, backBuffer, mCameraCB, mLinearClamp, pp);
+    }
 
-        device.EndGpuEvent();
+    if (graph.Compile(device.Device()))
+    {
+        // Passes sharing a scope (SSAO + blur, the post chain) report as one profiler entry.
+        std::optional<king::perf::CpuScope> cpuScope;
+        std::optional<GpuScopeGuard> gpuScope;
+        std::optional<PassStatsGuard> statsScope;
+        auto scope = [&](const char* name, bool begin)
+        {
+            if (begin)
+            {
+                cpuScope.emplace(mPerf, name);
+                gpuScope.emplace(mGpuPerf, ctx, name);
+                statsScope.emplace(this, name);
+                // Scope names are ASCII; widened on the stack rather than through a wstring.
+                wchar_t wname[64];
+                size_t n = 0;
+                for (; name[n] && n + 1 < std::size(wname); ++n)
+                    wname[n] = (wchar_t)name[n];
+                device.BeginGpuEvent(std::wstring_view(wname, n));
+            }
+            else
+            {
+                device.EndGpuEvent();
+                statsScope.reset();
+                gpuScope.reset();
+                cpuScope.reset();
+            }
+        };
+
+        mImmediateState.Begin(ctx);
+        graph.Execute(mImmediateState, scope);
+
+        const FrameGraphD3D11::Stats& gs = graph.GetStats();
+        mPerf.AddCount("GraphPasses", gs.passes - gs.culled);
+        mPerf.AddCount("GraphPassesCulled", gs.culled);
+        mPerf.AddCount("GraphTransientKB", gs.transientBytes / 1024u);
+        mPerf.AddCount("GraphTargetKB", gs.textureBytes / 1024u);
+    }
+
+    // Secondary views (RenderViews), forward into their own targets with this frame's
+    // lights, cascades and shadow atlas. After the main view's post chain, so a view in
+    // part of the back buffer draws over the tonemapped image.
+    if (mExtraViewCount > 0)
+    {
+        const PipelineStateD3D11 viewFallbackPipeline = GeometryPipeline(device, nullptr, false, false);
+        for (uint32_t vi = 0; vi < mExtraViewCount && vi < mViewFrames.size(); ++vi)
+        {
+            const RenderView& rv = mExtraViews[vi];
+            ID3D11RenderTargetView* rtv = rv.target ? rv.target->rtv : device.RTV();
+            ID3D11DepthStencilView* dsv = rv.target ? rv.target->dsv : device.DSV();
+            if (!rtv)
+                continue;
+            const D3D11_VIEWPORT vp = ResolveViewViewport(rv, outputViewport);
+
+            king::perf::CpuScope cpuView(mPerf, "ViewPass");
+            GpuScopeGuard gpuView(mGpuPerf, ctx, "ViewPass");
+            PassStatsGuard statsView(this, "ViewPass");
+            device.BeginGpuEvent(L"ViewPass");
+
+            // The view's depth is its own (or the main view is done with the device's).
+            if (rv.clear)
+            {
+                if (rv.target)
+                    ctx->ClearRenderTargetView(rtv, rv.clearColor);
+                else
+                    ClearViewportRect(ctx, rtv, rv.clearColor, vp);
+            }
+            if (dsv)
+                ctx->ClearDepthStencilView(dsv, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+
+            BuildDrawBatches(mViewFrames[vi], rv.frustum, mViewLods[vi], false, &mViewStaticVisible[vi]);
+            const PreparedFrame& viewFrame = mViewFrames[vi];
+            mMainInstanceFirst = 0;
+            const bool haveInstances = viewFrame.instances.empty() ||
+                mInstanceRing.Append(ctx, viewFrame.instances.data(), (uint32_t)viewFrame.instances.size(), mMainInstanceFirst);
+            if (!mDrawBatches.empty() && haveInstances)
+            {
+                king::FrameVector<const MaterialGpu*> viewMaterials(&frameArena);
+                ResolveFrameMaterials(viewMaterials);
+
+                UpdateCameraCB(ctx, rv.viewProj, rv.cameraPos, exposure, settings.aoStrength);
+                UploadLightClusters(device, ctx, rv.view, rv.proj, !IsIdentityMat(rv.proj), rv.nearZ, rv.farZ, vp);
+
+                ctx->OMSetRenderTargets(1, &rtv, dsv);
+                ctx->RSSetViewports(1, &vp);
+                ctx->VSSetConstantBuffers(0, 1, &mCameraCB);
+                ctx->PSSetConstantBuffers(0, 1, &mCameraCB);
+                ctx->PSSetConstantBuffers(1, 1, &mLightCB);
+                BindLightClusters(ctx);
+                ctx->PSSetShaderResources(14, 1, &mMaterialSRV);
+                if (doShadows && shadowSrv && shadowSamplerPoint && shadowSamplerLinear && shadowSamplerNonCmp)
+                {
+                    ctx->PSSetShaderResources(0, 1, &shadowSrv);
+                    ID3D11SamplerState* samplers[2] = { shadowSamplerPoint, shadowSamplerLinear };
+                    ctx->PSSetSamplers(0, 2, samplers);
+                    ctx->PSSetSamplers(3, 1, &shadowSamplerNonCmp);
+                }
+                if (doPointShadows)
+                {
+                    ctx->PSSetShaderResources(9, 1, &mShadowAtlasSRV);
+                    ctx->PSSetShaderResources(13, 1, &mShadowFacesBuffer.srv);
+                    ctx->PSSetSamplers(5, 1, &mLinearClamp);
+                }
+
+                StateCacheD3D11& sc = mImmediateState;
+                sc.Begin(ctx);
+                if (mLinearClamp)
+                    sc.SetPSSampler(4, mLinearClamp);
+                DrawGeometryBatches(sc, 0, mDrawBatches.size(), viewMaterials, viewFallbackPipeline, false);
+            }
+
+            device.EndGpuEvent();
+        }
+        mPerf.AddCount("Views", 1u + mExtraViewCount);
     }
 }
 
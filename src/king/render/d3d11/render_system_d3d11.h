@@ -1,23 +1,44 @@
 #pragma once
 
+#include "../../assets/asset_streamer.h"
+#include "../../assets/file_watcher.h"
 #include "../../ecs/scene.h"
+#include "../../jobs/job_system.h"
+#include "../../jobs/spsc_ring.h"
+#include "../../memory/frame_arena.h"
+#include "../../scene/bvh.h"
 #include "../../scene/frustum.h"
-#include "../../render/material.h"
+#include "../../scene/frustum_cull.h"
+#include "../../render/draw_key.h"
+#include "../../render/dynamic_resolution.h"
+#include "../../render/light_clusters.h"
+#include "../../render/material_registry.h"
+#include "../../render/mesh_lod.h"
+#include "../../render/shadow_atlas.h"
+#include "frame_graph_d3d11.h"
+#include "gpu_culling_d3d11.h"
+#include "gpu_memory_d3d11.h"
+#include "ring_buffer_d3d11.h"
 #include "render_device_d3d11.h"
 #include "shadows.h"
 #include "shader_program_d3d11.h"
+#include "state_cache_d3d11.h"
 #include "texture_manager_d3d11.h"
 #include "post_process_d3d11.h"
 
 #include "../../perf/perf_analyzer.h"
 #include "../../perf/gpu_profiler_d3d11.h"
+#include "../../perf/trace_capture.h"
 
 #include <d3d11.h>
+#include <cstddef>
 #include <string>
 #include <vector>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <unordered_map>
 
@@ -40,6 +61,35 @@ public:
         // This can improve overdraw and is a prerequisite for certain effects.
         bool enableDepthPrepass = false;
 
+        // GPU-driven static region: opaque static instances are frustum-culled by a compute
+        // pass (GpuCullingD3D11) and drawn with one indirect draw per mesh/material bucket, so
+        // CPU cost no longer grows with their count. Blended statics and dynamic renderers
+        // keep the CPU path. Needs assets/shaders/gpu_cull.hlsl next to the main shader.
+        bool enableGpuCulling = false;
+
+        // Hi-Z occlusion for the GPU-culled statics (needs enableGpuCulling): after the opaque
+        // pass the scene depth is reduced to a max-depth pyramid and the next frame's cull drops
+        // instances behind it. Newly revealed objects can appear one frame late. Shadow casters
+        // are not affected: an object hidden from the camera can still cast a visible shadow.
+        bool enableOcclusionCulling = false;
+
+        // CPU culling of the static region (camera, extra views, cascades, atlas faces) walks a
+        // BVH built with the region instead of testing every static sphere, so its cost follows
+        // what is visible rather than the total. Dynamic renderers are re-snapshotted every frame
+        // and keep the linear SIMD cull.
+        bool enableStaticBvh = true;
+
+        // Mesh LOD (Mesh::lods): each view picks a level from the projected bounding-sphere
+        // size. Biases are in halvings of that size (1 = one size class coarser); shadow views
+        // (cascades, atlas faces) select from their own projection with shadowMeshLodBias.
+        bool enableMeshLod = true;
+        float meshLodBias = 0.0f;
+        float shadowMeshLodBias = 1.0f;
+
+        // Asset streaming (SetAssetRegistry): bytes of pack meshes/textures uploaded per frame.
+        // The first upload of a frame always goes through, so larger assets still arrive.
+        uint32_t streamingBudgetKB = 4096;
+
         // Exposure (used by tonemap). If you also pass exposure as an argument,
         // the argument wins.
         float exposure = 1.0f;
@@ -58,8 +108,32 @@ public:
         float bloomIntensity = 0.65f;
         float bloomThreshold = 1.10f;
 
-        // Point-light shadows (single shadow-casting point light supported for now)
-        uint32_t pointShadowMapSize = 1024;
+        // Dynamic resolution (needs the HDR target and the GPU profiler's timings): the scene
+        // renders into a scaled viewport of its full-size targets, the scale picked from the
+        // smoothed GPU frame time against dynamicResolutionTargetMs (see DynamicResolution),
+        // and the tonemap upscales to the back buffer. Targets keep the back buffer's size, so
+        // scale changes never recreate resources. upscaleSharpness (0 = off) adds a
+        // neighbourhood-clamped sharpen to the upscale while the scale is below 1.
+        bool enableDynamicResolution = false;
+        float dynamicResolutionTargetMs = 16.0f;
+        float dynamicResolutionMinScale = 0.5f;
+        float dynamicResolutionMaxScale = 1.0f;
+        float upscaleSharpness = 0.3f;
+
+        // Point/spot-light shadows (Light::castsShadows). All such lights share one atlas:
+        // six tiles per point light, one per spot light, sized by screen coverage and only
+        // re-rendered when the light or the casters a face sees change.
+        uint32_t pointShadowMapSize = 1024;    // largest tile (texels)
+        uint32_t pointShadowMinTileSize = 128; // smallest tile (texels)
+        uint32_t pointShadowAtlasSize = 4096;
+        uint32_t pointShadowMaxLights = 16;
+        // Per-frame re-render budget: at most this many faces, and beyond the first face no more
+        // than the predicted CPU cost (ms, 0 = count only). Faces over budget keep their old depths.
+        uint32_t pointShadowMaxFaceUpdates = 12;
+        float pointShadowUpdateBudgetMs = 2.0f;
+        // Render up to 16 faces per pass, routing instances to their tile's viewport (VS on
+        // D3D11.3 hardware, GS otherwise). Off = one pass per face.
+        bool pointShadowSinglePass = true;
         float pointShadowBias = 0.05f;       // world units
         float pointShadowStrength = 1.0f;    // 0..1
 
@@ -99,10 +173,33 @@ public:
         // 4 = PCSS (variable penumbra; most expensive)
         uint32_t shadowFilterQuality = 1;
 
+        // Per-cascade overrides, near to far. cascadeFilterQuality uses the ladder above
+        // (kShadowFilterDefault = shadowFilterQuality); cascadeMapSize is the cascade's
+        // resolution in texels (0 = shadowMapSize, never larger). Smaller cascades render into
+        // part of their slice, saving raster and fill time but not memory.
+        static constexpr uint32_t kShadowFilterDefault = 0xFFFFFFFFu;
+        uint32_t cascadeFilterQuality[3] = { kShadowFilterDefault, kShadowFilterDefault, kShadowFilterDefault };
+        uint32_t cascadeMapSize[3] = {};
+        // Adaptive filtering: ahead of a cascade's filter, a 20-compare test over its footprint
+        // (for PCSS the blocker search area) returns fully lit or fully shadowed pixels as they
+        // are, so only penumbra pixels pay for the filter.
+        // Filters and this switch are shader permutations (ShadowsD3D11::FilterDefines); a
+        // change compiles the new geometry programs on first use.
+        bool enableShadowAdaptiveFilter = false;
+
         // Cull tiny casters from the shadow pass based on approximate screen-space radius.
-        // Default 0 (disabled) because it adds CPU work proportional to caster count.
+        // Only applied to casters that survived the cascade cull (one projection each).
         float shadowMinCasterPixels = 0.0f;
 
+        // Cascade caching: cascades from shadowCacheFirstCascade on (>= cascadeCount = none)
+        // keep their map and matrix across frames and are redrawn only when the sun or the
+        // casters inside them change, at most every shadowCacheUpdateInterval frames, or when
+        // the camera has moved out of their coverage. Their bounds grow by shadowCachePadding
+        // (fraction of the cascade extent) to make room for that movement.
+        uint32_t shadowCacheFirstCascade = 2;
+        uint32_t shadowCacheUpdateInterval = 4;
+        float shadowCachePadding = 0.15f;
+
         // Shadow diagnostics (debug)
         // 0=off, 1=show shadow factor (grayscale)
         uint32_t shadowDebugView = 0;
@@ -112,6 +209,71 @@ public:
         // SSAO
         float ssaoRadius = 0.6f;
         float ssaoBias = 0.02f;
+
+        // SSAO quality:
+        // 0 = quarter resolution (cheapest; depth-aware upsample)
+        // 1 = half resolution (good default; depth-aware upsample)
+        // 2 = full resolution
+        // Every level blurs with a separable depth-aware compute pass (ssao_cs.hlsl), or the
+        // plain 5-tap pixel-shader blur when compute shaders are unavailable.
+        uint32_t ssaoQuality = 1;
+
+        // Temporal accumulation: the sample kernel rotates per frame and each frame blends
+        // into last frame's reprojected result (ssaoTemporalBlend = weight of the new frame).
+        // Costs two history targets at AO resolution.
+        bool enableSsaoTemporal = false;
+        float ssaoTemporalBlend = 0.15f;
+    };
+
+    // What one RenderGeometryPass cost. Draws, binds and Map bytes are counted on the CPU as
+    // the frame records, per pass (the profiler scope names; "Other" is everything outside
+    // one). Pipeline statistics are GpuProfilerD3D11 queries read back a few frames late.
+    // GPU memory is what the renderer's resources take at the end of the frame.
+    struct FrameStats
+    {
+        static constexpr uint32_t kMaxPasses = 16;
+
+        struct Pass
+        {
+            const char* name = nullptr;
+            uint32_t draws = 0; // including indirect ones
+            uint32_t indirectDraws = 0;
+            uint32_t instances = 0; // of direct draws
+            uint32_t dispatches = 0;
+            uint32_t stateChanges = 0; // binds left after the state caches' filtering
+            uint32_t stateChangesSkipped = 0;
+            uint64_t mapBytes = 0;
+        };
+
+        struct PipelinePass
+        {
+            const char* name = nullptr;
+            D3D11_QUERY_DATA_PIPELINE_STATISTICS stats{};
+        };
+
+        Pass passes[kMaxPasses];
+        uint32_t passCount = 0;
+        Pass total;
+
+        // Per GPU scope ("Frame" covers them all) of GPU frame pipelineFrame; empty unless
+        // SetPipelineStatsEnabled and GPU perf are on.
+        PipelinePass pipeline[kMaxPasses];
+        uint32_t pipelineCount = 0;
+        uint32_t pipelineFrame = 0;
+
+        GpuMemoryD3D11 shadowMaps;      // cascades, point/spot atlas
+        GpuMemoryD3D11 renderTargets;   // HDR, normals, depth, SSAO history, Hi-Z, frame graph pool
+        GpuMemoryD3D11 instanceBuffers; // instance ring, static instances, GPU cull buffers
+        GpuMemoryD3D11 textures;        // TextureManagerD3D11
+
+        // Global operator new calls (every thread) between the frame's start and end.
+        uint64_t allocations = 0;
+        // The ones made by the render thread itself: 0 once the frame arena and the scratch
+        // members have grown to the scene (see SetAllocationCheck).
+        uint64_t renderThreadAllocations = 0;
+        // Render-thread frame arena: bytes this frame, heap blocks it had to add.
+        uint64_t frameArenaBytes = 0;
+        uint32_t frameArenaOverflows = 0;
     };
 
     RenderSystemD3D11();
@@ -120,21 +282,63 @@ public:
     RenderSystemD3D11(const RenderSystemD3D11&) = delete;
     RenderSystemD3D11& operator=(const RenderSystemD3D11&) = delete;
 
+    // Precompiles every engine shader and material variant on the job system's workers (see
+    // EngineShaderVariants) before creating anything, so no variant compiles mid-frame.
     bool Initialize(RenderDeviceD3D11& device, const std::wstring& shaderPath);
     void Shutdown();
 
+    // Directory for the persistent shader bytecode cache (empty = memory only). Takes effect
+    // at the next Initialize.
+    void SetShaderCacheDir(const std::wstring& dir) { mShaderCacheDir = dir; }
+
     // Call after a device reset/recreate.
     bool OnDeviceReset(RenderDeviceD3D11& device);
 
+    // Hot reload (paths as HotReload::Update returns them): every geometry program compiled
+    // from a changed source (any .hlsli: all of them) is recompiled on a background thread and
+    // swapped in at the start of a later RenderGeometryPass, where the materials using it
+    // rebuild their pipelines. Frames keep drawing with the old programs meanwhile, and one
+    // that fails to compile stays. Engine pass shaders (shadows, SSAO, bloom, GPU culling,
+    // post) are created by Initialize and are not reloaded.
+    void ReloadShaders(const std::vector<std::wstring>& changedPaths);
+    bool ShaderReloadPending() const { return mShaderReload.thread.joinable() || !mShaderReloadQueue.empty(); }
+
     // Optional: feeds FPS into the perf overlay.
     void SetFps(double fps) { mPerf.SetFps(fps); }
+    // Optional: input-to-present / input-to-display latency of an earlier frame in ms (< 0 =
+    // unknown), reported as the CPU timings "InputToPresent" / "InputToDisplay" next frame.
+    void SetInputLatency(double toPresentMs, double toDisplayMs)
+    {
+        mInputToPresentMs = toPresentMs;
+        mInputToDisplayMs = toDisplayMs;
+    }
 
     // Perf output control (useful for automated stress tests).
     void SetPerfEnabled(bool enabled) { mPerf.SetEnabled(enabled); }
     void SetGpuPerfEnabled(bool enabled) { mGpuPerf.SetEnabled(enabled); }
     void SetPerfPrintToStdout(bool enabled) { mPerf.SetPrintToStdout(enabled); }
     void SetPerfPrintEveryNFrames(uint32_t n) { mPerf.SetPrintEveryNFrames(n); }
+    // Debug check: after warmupFrames frames, any frame in which the render thread allocates
+    // from the heap logs a warning and counts as a failure. 0 warm-up frames = off.
+    void SetAllocationCheck(uint32_t warmupFrames)
+    {
+        mAllocCheckWarmup = warmupFrames;
+        mAllocCheckFrames = 0;
+    }
+    uint64_t AllocationCheckFailures() const { return mAllocCheckFailures; }
     const std::vector<king::perf::PerfAnalyzer::Sample>& PerfSamples() const { return mPerf.Samples(); }
+    // Rolling per-scope percentiles live in the samples; hitches are the scopes that spiked.
+    void SetPerfHistogramWindow(uint32_t frames) { mPerf.SetHistogramWindow(frames); }
+    void SetPerfHitchThreshold(double minMs, double factor) { mPerf.SetHitchThreshold(minMs, factor); }
+    std::vector<king::perf::PerfAnalyzer::Hitch> PerfHitches() const { return mPerf.Hitches(); }
+    bool WritePerfHitchCsv(const std::wstring& path) const { return mPerf.WriteHitchCsv(path); }
+    // Counters of the last RenderGeometryPass; SetPipelineStatsEnabled adds pipeline statistics
+    // queries to every GPU scope (GPU perf must be on).
+    const FrameStats& LastFrameStats() const { return mFrameStats; }
+    void SetPipelineStatsEnabled(bool enabled) { mGpuPerf.SetPipelineStatsEnabled(enabled); }
+
+    // Resolution scale the last frame rendered at (1 unless dynamic resolution is on).
+    float RenderScale() const { return mRenderScale; }
 
     void RenderGeometryPass(
         RenderDeviceD3D11& device,
@@ -184,9 +388,81 @@ public:
         float cameraFarZ,
         float exposure = 1.0f);
 
+    // Offscreen color (sampleable, linear HDR) and depth for a render-to-texture view.
+    struct ViewTarget
+    {
+        ID3D11Texture2D* colorTex = nullptr;
+        ID3D11RenderTargetView* rtv = nullptr;
+        ID3D11ShaderResourceView* srv = nullptr;
+        ID3D11Texture2D* depthTex = nullptr;
+        ID3D11DepthStencilView* dsv = nullptr;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+
+    // Released first if `target` holds resources. Owned by the caller (recreate after a
+    // device reset).
+    static bool CreateViewTarget(RenderDeviceD3D11& device, uint32_t width, uint32_t height, ViewTarget& target);
+    static void ReleaseViewTarget(ViewTarget& target);
+
+    // One camera of a multi-view frame. Matrices and planes as for RenderGeometryPass.
+    struct RenderView
+    {
+        Frustum frustum{};
+        Mat4x4 viewProj{};
+        Mat4x4 view{};
+        Mat4x4 proj{};
+        Float3 cameraPos{};
+        float nearZ = 0.1f;
+        float farZ = 1000.0f;
+
+        // Output of views after the first. Null target = the back buffer and device depth
+        // (split-screen, picture-in-picture). Viewport in the target's pixels; width 0 covers
+        // the whole target.
+        const ViewTarget* target = nullptr;
+        D3D11_VIEWPORT viewport{};
+        bool clear = true;
+        float clearColor[4] = { 0.06f, 0.06f, 0.08f, 1.0f };
+    };
+
+    static constexpr uint32_t kMaxRenderViews = 8;
+
+    // Renders up to kMaxRenderViews cameras of one scene in a frame. views[0] is the main view
+    // and takes the whole RenderGeometryPass path (HDR, post, dynamic resolution, GPU culling)
+    // into the back buffer; its target and viewport are ignored. The others share its
+    // snapshot, lights, directional cascades and shadow atlas (fitted to views[0]), are culled
+    // together in one pass over the bounds, and draw forward into their own target without
+    // post-processing (like enableTonemap off), in order, after the main view's post chain.
+    void RenderViews(
+        RenderDeviceD3D11& device,
+        Scene& scene,
+        const RenderView* views,
+        uint32_t viewCount,
+        const RenderSettings& settings,
+        float exposureOverride = -1.0f);
+
+    // Builds this frame's render snapshot ahead of RenderGeometryPass (e.g. as a scheduled
+    // ECS system), chunked across up to `workerThreads` job workers. Reads WorldTransform
+    // (run systems::TransformSystem first; entities without one fall back to their local
+    // Transform) and reorders the Transform/WorldTransform pools, so it must not overlap other
+    // systems touching them. If not called, RenderGeometryPass builds the snapshot itself.
+    void PrepareSnapshot(Scene& scene, uint32_t workerThreads = 0);
+
+    // Frames between snapshot and render for the geometry pass (0 = prepare inline on the
+    // render thread, 1 = default: frame N renders the batches prepared from snapshot N-1 while
+    // the prep job works on snapshot N, 2 = one more frame of overlap). Clamped to 2.
+    // Initial value: KING_PREPARE_LATENCY (default 1).
+    void SetPrepareLatencyFrames(uint32_t frames);
+    uint32_t PrepareLatencyFrames() const { return mPrepareLatency; }
+
     // Releases any per-mesh GPU buffers stored in the scene meshes.
     static void ReleaseSceneMeshBuffers(Scene& scene);
 
+    // Packs that material texture paths are resolved against before the file system. Pack
+    // meshes and textures are paged in by a background thread and uploaded under
+    // RenderSettings::streamingBudgetKB. The registry must outlive the renderer's use of it.
+    void SetAssetRegistry(const AssetRegistry* assets);
+
 private:
     struct CameraCBData
     {
@@ -198,6 +474,7 @@ private:
         float _padPost[3];
     };
 
+    // Matches SsaoCB in pbr_test.hlsl and ssao_cs.hlsl.
     struct SsaoCBData
     {
         Mat4x4 proj;
@@ -206,8 +483,20 @@ private:
         float invTargetSize[2];
         float radius;
         float bias;
+
+        Mat4x4 reproject;
+        uint32_t targetSize[2];
+        uint32_t sourceSize[2];
+        float noiseOffset[2];
+        float temporalBlend;
+        uint32_t downsample;
+
+        float uvScale[2]; // used / allocated size of the AO-resolution targets (dynamic resolution)
+        float _pad[2];
     };
 
+    // Directional lights, in LightCB. Point and spot lights are unbounded and reach the shader
+    // through the light clusters (structured buffers t10..t12, ClusterCB at b5).
     static constexpr uint32_t kMaxLights = 16;
     static constexpr uint32_t kMaxCascades = 3;
 
@@ -216,8 +505,8 @@ private:
         // 16-byte register 0
         uint32_t type;
         uint32_t groupMask;
-        uint32_t _padU0;
-        uint32_t _padU1;
+        uint32_t flags; // kLightFlag_*
+        uint32_t shadowFace; // first ShadowFaceGpu of this light (kLightFlag_Shadowed)
 
         // 16-byte register 1
         float color[3];
@@ -245,7 +534,7 @@ private:
         Mat4x4 lightViewProj[kMaxCascades];
         float cascadeSplitsNdc[4];
         uint32_t cascadeCount;
-        uint32_t _pad1[3];
+        float cascadeUvScale[3]; // used fraction of each slice (ShadowsD3D11::CascadeUvScale)
 
         float shadowTexelSize[2];
         float shadowBias;
@@ -257,142 +546,442 @@ private:
         // x=fadeStartNdc, y=fadeEndNdc, z=shadowSoftness, w=shadowFlags (packed as float)
         float shadowExtras[4];
 
-            // Point-shadow params:
+            // Point/spot-shadow params:
             // x = enabled (0/1)
             // y = bias (world units)
-            // z = invFar (1/range)
+            // z = unused (range is per face, see ShadowFaceGpu)
             // w = strength (0..1)
             float pointShadowParams[4];
-            float pointShadowTexelSize[2];
+            float pointShadowTexelSize[2]; // 1 / atlas size
             float _padPointShadow[2];
+
+        // Camera the cascades were fitted to (cascade selection). The main view's viewProj,
+        // also while secondary views shade with its cascades.
+        Mat4x4 shadowCameraViewProj;
+    };
+
+    // GpuLight::flags: this light has ready tiles in the shadow atlas, starting at shadowFace.
+    static constexpr uint32_t kLightFlag_Shadowed = 1u << 0;
+
+    // One shadow atlas tile as the shader sees it (register t13). Point lights own six in
+    // MakePointShadowViewProj face order (+X, -X, +Y, -Y, +Z, -Z), spot lights one.
+    struct ShadowFaceGpu
+    {
+        Mat4x4 viewProj;
+        float rect[4];    // atlas uv: xy = origin, zw = size
+        float lightPos[3]; // as rendered; cached faces may lag the light
+        float invRange;
+    };
+    static_assert(sizeof(ShadowFaceGpu) % 16 == 0, "ShadowFaceGpu must be 16-byte aligned");
+
+    // Froxel grid for clustered forward lighting.
+    static constexpr uint32_t kClusterTilesX = 16;
+    static constexpr uint32_t kClusterTilesY = 9;
+    static constexpr uint32_t kClusterSlices = 24;
+
+    struct ClusterCBData
+    {
+        // View depth of a world position: dot(float4(wpos, 1), viewZ).
+        float viewZ[4];
+        // SV_Position.xy * tileScale + tileBias = tile coordinate.
+        float tileScale[2];
+        float sliceScale;
+        float sliceBias;
+        uint32_t dims[3];
+        uint32_t localLightCount;
+        float tileBias[2];
+        float _padTile[2];
     };
 
+    // Per-instance vertex data (slot 1), 56 bytes. The world matrix is affine, so only its first
+    // three columns are stored; shaders rebuild the normal matrix (inverse-transpose) from them.
+    // It includes the mesh's dequantization (Mesh::quantOffset/quantScale), so it maps packed
+    // vertex positions straight to world space. The material id is the only material data:
+    // base color, roughness, metallic and emissive come from the material buffer (t14).
     struct InstanceData
     {
-        Mat4x4 world;
-        // Inverse-transpose of world matrix; used for correct normal transforms under non-uniform scale.
-        Mat4x4 normal;
-        float albedo[4];
-        float roughnessMetallic[2];
-        uint32_t lightMask;
+        float worldCols[3][4];           // TEXCOORD4..6: column j of dequantize * world (row-vector)
+        uint32_t lightMask;              // TEXCOORD9
+        uint32_t flags;                  // TEXCOORD10: bits 0..15 flags, 16..31 material id
+    };
+    static_assert(sizeof(InstanceData) == 56, "InstanceData must match the engine input layout");
+    static_assert(offsetof(InstanceData, lightMask) == 48 && offsetof(InstanceData, flags) == 52,
+        "InstanceData offsets must match the TEXCOORD9/10 input elements");
+
+    // Material ids index the material buffer (t14); handles past the id range draw with the
+    // default material's parameters.
+    static constexpr uint32_t kInstMaterialShift = 16;
+    static constexpr uint32_t kMaxMaterialIds = 1u << (32 - kInstMaterialShift);
+
+    // One material buffer entry (StructuredBuffer<MaterialData> in the shaders).
+    struct MaterialData
+    {
+        float baseColor[4];
+        float emissive[3];
+        float roughness;
+        float metallic;
         uint32_t flags;
+        float _pad[2];
     };
+    static_assert(sizeof(MaterialData) % 16 == 0, "MaterialData must be 16-byte aligned");
 
     struct SnapshotItem
     {
         Mesh* mesh = nullptr;
-        Transform transform{};
-        Float4 albedo{ 1, 1, 1, 1 };
-        float roughness = 0.5f;
-        float metallic = 0.0f;
-        PbrMaterial material{};
+        // From WorldTransform (see systems::TransformSystem).
+        Mat4x4 world{};
+        float maxScale = 1.0f;
+        MaterialHandle material = kDefaultMaterial;
         uint32_t lightMask = 0xFFFFFFFFu;
         uint32_t flags = 0;
 
+        // Draw key inputs (see draw_key.h): mesh entity index and material program/blend state.
+        // Items with equal bindGroup (program, blend, textures) batch across materials.
+        uint32_t meshId = 0;
+        uint8_t program = 0;
+        bool alphaBlend = false;
+        uint32_t bindGroup = 0;
+
         Float3 boundsCenter{ 0, 0, 0 };
         float boundsRadius = 0.0f;
     };
 
+    static constexpr uint32_t kNoGpuBucket = 0xFFFFFFFFu;
     struct Batch
     {
         Mesh* mesh = nullptr;
+        uint32_t lod = 0; // index into mesh->lods
+        // Frame material whose pipeline and textures the batch binds. Instances carry their own
+        // material id, so they may use any material of the same bind group.
         uint32_t materialIndex = 0;
         uint32_t startInstance = 0;
         uint32_t instanceCount = 0;
+        // startInstance indexes the persistent static region (mStaticInstanceVB) instead of
+        // this frame's dynamic instances (mInstanceRing, from mMainInstanceFirst).
+        bool staticInstances = false;
+        // GpuCullingD3D11 bucket drawn indirectly from its compacted instances; instanceCount
+        // is then only an upper bound.
+        uint32_t gpuBucket = kNoGpuBucket;
+    };
+
+    // Contiguous run of static instances sharing mesh + bind group.
+    struct StaticBatch
+    {
+        Mesh* mesh = nullptr;
+        MaterialHandle material = kDefaultMaterial; // first instance's; supplies the bindings
+        uint32_t startInstance = 0;
+        uint32_t instanceCount = 0;
+        bool alphaBlend = false;
     };
 
     struct PreparedFrame
     {
         std::vector<InstanceData> instances;
+        // Sorted by draw key: opaque batches first, then alpha-blended ones back-to-front.
         std::vector<Batch> batches;
-        std::vector<PbrMaterial> materials;
-        std::vector<uint64_t> materialKeys;
+        size_t opaqueBatchCount = 0;
+        // Unique materials referenced by this frame; Batch::materialIndex indexes this.
+        std::vector<MaterialHandle> materials;
     };
 
     void UpdateCameraCB(ID3D11DeviceContext* ctx, const Mat4x4& viewProj, const Float3& cameraPos, float exposure, float aoStrength);
     void UpdateLightCB(ID3D11DeviceContext* ctx, const LightCBData& data);
 
     void EnsureHdrTargets(RenderDeviceD3D11& device, bool needSsao);
-    void EnsureSsaoTargets(RenderDeviceD3D11& device);
+    void EnsureSceneDepth(RenderDeviceD3D11& device);
+    // Ping-pong history for temporal SSAO at AO resolution; returns false if unavailable.
+    bool EnsureSsaoHistory(RenderDeviceD3D11& device, uint32_t w, uint32_t h);
+    void ReleaseSsaoHistory();
 
     static bool GetPrimaryDirectionalLightWithTransform(const Scene& scene, Light& outLight, Transform& outXform);
-    static void GatherLights(const Scene& scene, std::vector<GpuLight>& outLights);
-
-    void EnsureMeshBuffers(RenderDeviceD3D11& device, Mesh& mesh);
-    void EnsureInstanceBuffer(RenderDeviceD3D11& device, size_t requiredInstanceCount);
+    struct LocalLightSource
+    {
+        Entity entity = kInvalidEntity;
+        bool castsShadows = false;
+    };
+    // Directional lights (at most kMaxLights) and point/spot lights (all of them, with the
+    // entity each came from).
+    static void GatherLights(const Scene& scene, king::FrameVector<GpuLight>& outDirectional, std::vector<GpuLight>& outLocal,
+        std::vector<LocalLightSource>& outLocalSources);
+    // Picks the shadowed point/spot lights, assigns atlas tiles and schedules face re-renders
+    // (mShadowAtlas); sets kLightFlag_Shadowed/shadowFace on ready lights and fills mShadowFaces.
+    // Runs before UploadLightClusters.
+    void PlanLocalShadows(const Frustum& frustum, const Float3& cameraPos, const Mat4x4& proj, float viewportHeight,
+        const RenderSettings& settings);
+    // Bounds and content hashes of this frame's dynamic shadow casters (mShadowCasterSpheres,
+    // mShadowCasterHashes), shared by the cascade and atlas planning.
+    void BuildShadowCasterBounds();
+    // Picks the cascades to redraw this frame (others keep their cached map; their matrix is
+    // written back into cascadeViewProj) and collects the casters of the redrawn ones into
+    // mShadowCasterPtrs: spheres culled against each cascade extruded toward the sun.
+    // Returns the redraw mask for ShadowsD3D11::Render.
+    uint32_t PlanCascadeShadows(Mat4x4 cascadeViewProj[ShadowsD3D11::kMaxCascades], uint32_t cascadeCount,
+        const float splitsNdc[4], const Mat4x4& viewProj, const Mat4x4& proj, const Float3& sunDir,
+        float viewportHeight, const RenderSettings& settings);
+    // Renders the faces scheduled by PlanLocalShadows into the atlas. False if nothing can be
+    // sampled this frame (no atlas or no ready light).
+    bool RenderLocalShadows(RenderDeviceD3D11& device, ID3D11DeviceContext* ctx, const RenderSettings& settings);
+    // Bins mLocalLights into the froxel grid and uploads lights, cluster ranges and indices.
+    // Tiles cover `viewport`, the one the geometry is drawn with.
+    void UploadLightClusters(RenderDeviceD3D11& device, ID3D11DeviceContext* ctx, const Mat4x4& view, const Mat4x4& proj,
+        bool haveViewProj, float nearZ, float farZ, const D3D11_VIEWPORT& viewport);
+    void BindLightClusters(ID3D11DeviceContext* ctx) const;
+    // Writes changed materials into mMaterialBuffer (grown to the registry size), one
+    // UpdateSubresource per run of consecutive changed handles.
+    void UploadMaterialData(RenderDeviceD3D11& device, ID3D11DeviceContext* ctx, const MaterialRegistry& materials);
+
+    // Uploads the cooked form of a mesh (cooking it first if needed) into IMMUTABLE buffers,
+    // then frees the cooked arrays and, unless mesh.keepCpuData, the source arrays.
+    void EnsureMeshBuffers(RenderDeviceD3D11& device, Mesh& mesh, StreamBudget& budget);
 
     void EnsureDeferredContexts(RenderDeviceD3D11& device);
     void ReleaseDeferredContexts();
+    // Re-reads the live ThreadConfig: prepare worker on/off, shadow recorders and deferred
+    // context counts. Between frames (RenderGeometryPass calls it when the generation moved).
+    void ApplyThreadConfig(RenderDeviceD3D11& device);
 
     void StartWorker();
     void StopWorker();
-
-    static void BuildSnapshot(Scene& scene, std::vector<SnapshotItem>& outItems);
-    void EnqueueBuild(std::vector<SnapshotItem>& items, const Frustum& frustum);
-    bool ConsumeReadyFrame(PreparedFrame& outFrame);
-    static void BuildPreparedFrame(const std::vector<SnapshotItem>& items, const Frustum& frustum, PreparedFrame& outFrame);
+    void PrepareJobMain();
+
+    // workerThreads: extra job workers the build may use (0 = inline). Only dynamic renderers
+    // go to outItems; static ones are hashed and RebuildStaticRegion runs when that changes.
+    void BuildSnapshot(Scene& scene, std::vector<SnapshotItem>& outItems, uint32_t workerThreads);
+    void RebuildStaticRegion();
+    // Static spheres in [begin, end) that intersect `frustum`, ascending (the CullSpheres
+    // result) but found through mStaticBvh.
+    void CullStaticRegion(const Frustum& frustum, size_t begin, size_t end, std::vector<uint32_t>& out) const;
+    void UploadStaticInstances(RenderDeviceD3D11& device, ID3D11DeviceContext* ctx);
+    // Hands the opaque static batches to mGpuCulling (one bucket each) after a rebuild.
+    void UploadGpuCullInstances(RenderDeviceD3D11& device, ID3D11DeviceContext* ctx);
+    // mDrawBatches/mDrawMaterials = frame batches + static runs visible in `frustum` (split
+    // where the LOD changes). With gpuStatic, opaque static batches become GPU-culled bucket
+    // draws instead, one per LOD.
+    // A staticVisible list (ascending static indices) replaces culling against `frustum`.
+    void BuildDrawBatches(const PreparedFrame& frame, const Frustum& frustum, const MeshLodView& lodView, bool gpuStatic,
+        const std::vector<uint32_t>* staticVisible = nullptr);
+    // Binds mesh + instance buffers and issues the batch's draw (indirect for GPU buckets).
+    void DrawBatchInstances(StateCacheD3D11& sc, const Batch& b) const;
+    struct MaterialGpu;
+    // Geometry-pass pipeline for a program (nullptr or no PSMainMRT when mrt: engine default)
+    // with the blend/depth state of the material's blend mode.
+    PipelineStateD3D11 GeometryPipeline(RenderDeviceD3D11& device, const ShaderProgramD3D11* program, bool alphaBlend, bool mrt) const;
+    // Draws mDrawBatches[begin, end) with their material pipelines and textures (t5..t8);
+    // batches without a resolved material use `fallback`.
+    void DrawGeometryBatches(StateCacheD3D11& sc, size_t begin, size_t end, const king::FrameVector<const MaterialGpu*>& frameMaterials,
+        const PipelineStateD3D11& fallback, bool mrt) const;
+    // Reports the frame's issued/skipped binds of every state cache to mPerf and resets them.
+    void ReportStateCacheStats();
+    // What every state cache and Map site has recorded so far this frame.
+    struct PassCounters
+    {
+        StateCacheD3D11::Stats binds;
+        uint64_t mapBytes = 0;
+    };
+    PassCounters CurrentPassCounters() const;
+    // Charges the pass running in mFrameStats with what was recorded since the last mark and
+    // starts `name` (nullptr = "Other"). Only between recordings: deferred caches are read.
+    void MarkFramePass(const char* name);
+    void BeginFrameStats();
+    // Closes the frame's passes and fills pipeline statistics, GPU memory and allocations.
+    void EndFrameStats(ID3D11DeviceContext* ctx);
+    void EnqueueBuild(std::vector<SnapshotItem>& items, const Frustum& frustum, const MeshLodView& lodView);
+    const PreparedFrame& AcquireFrameToRender(const Frustum& frustum, const MeshLodView& lodView);
+    // Scratch (spheres, visible list, sort keys) goes on arena, which must be the calling
+    // thread's: the render thread's own, or mPrepareArena on the prep job. maxParallelism as in
+    // JobSystem::ParallelFor (mPrepareParallelism).
+    static void BuildPreparedFrame(const std::vector<SnapshotItem>& items, const Frustum& frustum, const MeshLodView& lodView,
+        uint32_t maxParallelism, king::FrameArena& arena, PreparedFrame& outFrame);
+    // Sorted batches of the visible items (ascending indices into items and spheres).
+    static void BuildPreparedBatches(const std::vector<SnapshotItem>& items, const SphereSoA& spheres,
+        const uint32_t* visibleIndices, size_t visibleCount, const Frustum& frustum, const MeshLodView& lodView,
+        uint32_t maxParallelism, king::FrameArena& arena, PreparedFrame& outFrame);
+    // Culls this frame's snapshot and the static region for every secondary view in one pass
+    // each, then builds the views' prepared frames and static visible lists.
+    void PrepareSecondaryViews(RenderDeviceD3D11& device, const RenderSettings& settings);
+    static Sphere WorldBoundingSphere(const SnapshotItem& s);
+    static InstanceData MakeInstanceData(const SnapshotItem& s);
 
 private:
     std::wstring mShaderPath;
     std::unique_ptr<king::ShaderCache> mShaderCache;
     std::wstring mShaderDir;
+    std::wstring mShaderCacheDir;
 
     TextureManagerD3D11 mTextures;
+    const AssetRegistry* mAssets = nullptr;
+    AssetStreamer mStreamer;
 
     struct MaterialGpu
     {
         ShaderProgramD3D11* program = nullptr;
-        ID3D11Buffer* materialCB = nullptr;
+        // Borrowed from mTextures; re-resolved when its generation moves (streamed textures).
+        uint32_t textureGeneration = 0;
         ID3D11ShaderResourceView* albedoSRV = nullptr;
         ID3D11ShaderResourceView* normalSRV = nullptr;
         ID3D11ShaderResourceView* mrSRV = nullptr;
         ID3D11ShaderResourceView* emissiveSRV = nullptr;
 
         bool alphaBlend = false;
+        // Built with the entry: [0] forward PS, [1] PSMainMRT (SSAO normals) or the engine
+        // default when the program has none.
+        PipelineStateD3D11 pipelines[2];
     };
 
-    std::unordered_map<std::wstring, std::unique_ptr<ShaderProgramD3D11>> mProgramCache;
+    // Dense program table. A MaterialGpu keeps the program it resolved to when it was created;
+    // the path + defines key of mProgramIds is only built then, never per frame.
+    static constexpr uint32_t kNoProgram = ~0u;
+    std::vector<std::unique_ptr<ShaderProgramD3D11>> mPrograms;
+    std::vector<GeometryProgramDesc> mProgramDescs; // what each program was created from
+    std::unordered_map<std::wstring, uint32_t> mProgramIds;
+    // Engine variant per shading model under mMaterialShadowFilterKey (kNoProgram = not yet).
+    uint32_t mEngineProgramIds[3] = { kNoProgram, kNoProgram, kNoProgram };
     std::unordered_map<uint64_t, MaterialGpu> mMaterialCache;
 
+    // Per-handle resolved GPU bindings. Refreshed only when the registry version changes.
+    struct MaterialSlot
+    {
+        uint32_t version = 0;
+        const MaterialGpu* gpu = nullptr;
+    };
+    std::vector<MaterialSlot> mMaterialSlots;
+    const MaterialRegistry* mMaterialSlotsOwner = nullptr;
+    // Background recompile of hot-reloaded programs. The thread owns `programs` until `done`.
+    struct ShaderReload
+    {
+        std::thread thread;
+        std::atomic<bool> done{ false };
+        std::vector<uint32_t> ids; // into mPrograms
+        std::vector<std::unique_ptr<ShaderProgramD3D11>> programs; // null = failed to compile
+        std::chrono::steady_clock::time_point start;
+    };
+    ShaderReload mShaderReload;
+    std::vector<std::wstring> mShaderReloadQueue; // FileWatcher::NormalizePath form
+    // Frame start: swaps in a finished reload, then starts one for the queued sources.
+    void UpdateShaderReload(RenderDeviceD3D11& device);
+    void WaitShaderReload();
+
+    // Shadow filter permutation (ShadowFilterKey) the cached materials were built with.
+    static constexpr uint32_t kNoShadowFilterKey = ~0u;
+    uint32_t mMaterialShadowFilterKey = kNoShadowFilterKey;
+
+    // Parameters of every registry material, indexed by handle (the instance material id).
+    // Persistent DEFAULT buffer: only entries whose registry version moved are re-uploaded.
+    ID3D11Buffer* mMaterialBuffer = nullptr;
+    ID3D11ShaderResourceView* mMaterialSRV = nullptr;
+    uint32_t mMaterialBufferCapacity = 0; // entries
+    std::vector<MaterialData> mMaterialData; // CPU mirror
+    std::vector<uint32_t> mMaterialDataVersion;
+    const MaterialRegistry* mMaterialDataOwner = nullptr;
+
     std::unique_ptr<ShadowsD3D11> mShadows;
 
     // Dev perf analyzer (CPU + optional GPU query timings).
     king::perf::PerfAnalyzer mPerf;
     king::perf::GpuProfilerD3D11 mGpuPerf;
+    // TraceCapture::CaptureId the GPU clock was last calibrated for.
+    uint32_t mTraceCaptureId = 0;
+
+    // Built during RenderGeometryPass, complete once it returns.
+    FrameStats mFrameStats;
+    PassCounters mPassMark;
+    const char* mPassName = nullptr;
+    uint64_t mFrameAllocStart = 0;
+    uint64_t mFrameThreadAllocStart = 0;
+    uint32_t mAllocCheckWarmup = 0;
+    uint32_t mAllocCheckFrames = 0;
+    uint64_t mAllocCheckFailures = 0;
+    uint64_t mMapBytes = 0; // running total of this class's own Map writes
+    std::vector<std::pair<const char*, D3D11_QUERY_DATA_PIPELINE_STATISTICS>> mPipelineStatsScratch;
+    std::vector<std::pair<const char*, double>> mGpuMsScratch;
+    std::vector<king::perf::GpuProfilerD3D11::Span> mGpuSpansScratch;
+
+    // Redundant-bind filter for the immediate context's geometry, SSAO and post passes.
+    StateCacheD3D11 mImmediateState;
 
     // Scratch buffers reused per-frame (avoid alloc churn for snapshot/shadow building).
     std::vector<SnapshotItem> mSnapshotScratch;
+    bool mSnapshotPrepared = false;
     std::vector<const SnapshotItem*> mShadowCasterPtrs[3];
+    // One cascade's casters with the LOD picked for its projection, sorted for batching.
+    struct ShadowLodCaster
+    {
+        const SnapshotItem* item = nullptr;
+        uint32_t lod = 0;
+    };
+    std::vector<ShadowLodCaster> mShadowLodCasters;
     std::vector<InstanceData> mShadowInstancesScratch;
     std::vector<ShadowsD3D11::DrawBatch> mShadowDrawBatchesPerCascade[3];
-
-        // Point shadow scratch (single cubemap)
-        std::vector<const SnapshotItem*> mPointShadowCasterPtrs;
+    // This frame's dynamic shadow casters (radius -FLT_MAX = not a caster), each with a content
+    // hash (mesh + world). Static casters only change with mStaticSignature.
+    SphereSoA mShadowCasterSpheres;
+    std::vector<uint64_t> mShadowCasterHashes;
+    std::vector<uint32_t> mShadowCascadeVisible;
+    // What each cascade slice of the CSM currently holds.
+    struct CascadeCache
+    {
+        bool valid = false;
+        Mat4x4 viewProj{};
+        uint64_t contentHash = 0; // sun + casters inside viewProj's extruded frustum
+        uint64_t renderedFrame = 0;
+        uint32_t resourceGeneration = 0;
+    };
+    CascadeCache mCascadeCache[ShadowsD3D11::kMaxCascades]{};
+    uint64_t mCascadeFrame = 0;
+
+        // Point/spot shadow casters: the instances/batches of the faces being re-rendered.
+        // Faces go in groups (up to kMaxShadowSlots with single-pass rendering, else one);
+        // batches of group g: [mPointShadowGroupBatchStart[g], [g + 1]).
+        static constexpr uint32_t kMaxShadowSlots = 16;
+        std::vector<uint32_t> mPointShadowVisible;
+        std::vector<uint32_t> mPointShadowStaticVisible;
+        struct PointShadowCaster
+        {
+            const SnapshotItem* item = nullptr;
+            uint32_t slot = 0; // face within its group
+            uint32_t lod = 0;
+        };
+        std::vector<PointShadowCaster> mPointShadowCasters;
         std::vector<InstanceData> mPointShadowInstancesScratch;
         struct PointShadowDrawBatch
         {
             ID3D11Buffer* vb = nullptr;
             ID3D11Buffer* ib = nullptr;
+            uint32_t startIndex = 0;
             uint32_t indexCount = 0;
             uint32_t vertexCount = 0;
             uint32_t startInstance = 0;
             uint32_t instanceCount = 0;
+            bool index32 = false;
             Mesh* mesh = nullptr;
         };
         std::vector<PointShadowDrawBatch> mPointShadowDrawBatches;
+        std::vector<uint32_t> mPointShadowGroupBatchStart;
 
         ID3D11VertexShader* mVSPointShadow = nullptr;
         ID3D11PixelShader* mPSPointShadow = nullptr;
+        // Single-pass faces: VS-written viewport index (null without hardware support) or the
+        // pass-through GS; both feed PSPointShadowLayeredMain, slot data in mPointShadowSlotsCB.
+        ID3D11VertexShader* mVSPointShadowLayered = nullptr;
+        ID3D11VertexShader* mVSPointShadowReplicate = nullptr;
+        ID3D11GeometryShader* mGSPointShadow = nullptr;
+        ID3D11PixelShader* mPSPointShadowLayered = nullptr;
+        ID3D11Buffer* mPointShadowSlotsCB = nullptr;
+        ID3D11PixelShader* mPSShadowTileClear = nullptr;
+        ID3D11DepthStencilState* mDepthAlwaysWrite = nullptr;
         ID3D11Buffer* mPointShadowCB = nullptr;
 
-        ID3D11Texture2D* mPointShadowTex = nullptr; // R32_FLOAT cubemap (stored linear depth normalized)
-        ID3D11ShaderResourceView* mPointShadowSRV = nullptr;
-        ID3D11RenderTargetView* mPointShadowRTV[6] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
-
-        ID3D11Texture2D* mPointShadowDepthTex = nullptr; // D32 cubemap for depth testing
-        ID3D11DepthStencilView* mPointShadowDSV[6] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
-
-        uint32_t mPointShadowSize = 0;
+        // Shadow atlas: R32_FLOAT distance / range (sampled) and D32 for depth testing.
+        ShadowAtlas mShadowAtlas;
+        std::vector<ShadowAtlas::Request> mShadowAtlasRequests;
+        std::vector<uint32_t> mShadowAtlasLights; // request -> index in mLocalLights
+        std::vector<ShadowFaceGpu> mShadowFaces;
+        ID3D11Texture2D* mShadowAtlasTex = nullptr;
+        ID3D11ShaderResourceView* mShadowAtlasSRV = nullptr;
+        ID3D11RenderTargetView* mShadowAtlasRTV = nullptr;
+        ID3D11Texture2D* mShadowAtlasDepthTex = nullptr;
+        ID3D11DepthStencilView* mShadowAtlasDSV = nullptr;
+        uint32_t mShadowAtlasTexSize = 0;
 
     ID3D11VertexShader* mVS = nullptr;
     ID3D11VertexShader* mVSDepth = nullptr;
@@ -406,6 +995,27 @@ private:
     ID3D11Buffer* mLightCB = nullptr;
     ID3D11Buffer* mSsaoCB = nullptr;
 
+    // Clustered lights: per-frame point/spot lights and their froxel lists, in dynamic
+    // structured buffers that grow on demand.
+    struct DynamicStructuredBuffer
+    {
+        ID3D11Buffer* buffer = nullptr;
+        ID3D11ShaderResourceView* srv = nullptr;
+        uint32_t capacity = 0; // elements
+    };
+    bool UploadStructured(ID3D11Device* d, ID3D11DeviceContext* ctx, DynamicStructuredBuffer& sb, const void* data, uint32_t count, uint32_t stride);
+    static void ReleaseStructured(DynamicStructuredBuffer& sb);
+
+    LightClusters mLightClusters;
+    std::vector<GpuLight> mLocalLights;
+    std::vector<LocalLightSource> mLocalLightSources; // parallel to mLocalLights
+    std::vector<Float4> mLocalLightSpheres;
+    ID3D11Buffer* mClusterCB = nullptr;
+    DynamicStructuredBuffer mClusterLights;
+    DynamicStructuredBuffer mClusterRanges;
+    DynamicStructuredBuffer mClusterIndices;
+    DynamicStructuredBuffer mShadowFacesBuffer;
+
     ID3D11SamplerState* mLinearClamp = nullptr;
     ID3D11SamplerState* mPointClamp = nullptr;
 
@@ -421,49 +1031,158 @@ private:
     uint32_t mHdrW = 0;
     uint32_t mHdrH = 0;
 
+    // Dynamic resolution: this frame's scene viewport (top-left of the full-size targets) and
+    // the GPU frame time of the newest profiler results.
+    king::DynamicResolution mDynamicResolution;
+    D3D11_VIEWPORT mSceneViewport{};
+    float mRenderScale = 1.0f;
+    float mLastGpuFrameMs = 0.0f;
+    double mInputToPresentMs = -1.0;
+    double mInputToDisplayMs = -1.0;
+
     // Normal buffer (for SSAO)
     ID3D11Texture2D* mNormalTex = nullptr;
     ID3D11RenderTargetView* mNormalRTV = nullptr;
     ID3D11ShaderResourceView* mNormalSRV = nullptr;
 
-    // Depth buffer with SRV (for SSAO)
+    // Depth buffer with SRV (SSAO, Hi-Z occlusion)
     ID3D11Texture2D* mDepthTex = nullptr;
     ID3D11DepthStencilView* mDepthDSV = nullptr;
     ID3D11ShaderResourceView* mDepthSRV = nullptr;
-
-    // SSAO + blur
-    ID3D11Texture2D* mSsaoTex = nullptr;
-    ID3D11RenderTargetView* mSsaoRTV = nullptr;
-    ID3D11ShaderResourceView* mSsaoSRV = nullptr;
-
-    ID3D11Texture2D* mSsaoBlurTex = nullptr;
-    ID3D11RenderTargetView* mSsaoBlurRTV = nullptr;
-    ID3D11ShaderResourceView* mSsaoBlurSRV = nullptr;
+    uint32_t mDepthW = 0;
+    uint32_t mDepthH = 0;
+
+    // Post-geometry passes (SSAO, bloom, vignette, tonemap) and the pool of their transient
+    // targets; rebuilt every frame by RenderGeometryPass.
+    FrameGraphD3D11 mFrameGraph;
+
+    // SSAO compute blur (ssao_cs.hlsl); null = pixel-shader blur.
+    ID3D11ComputeShader* mSsaoBlurHCS = nullptr;
+    ID3D11ComputeShader* mSsaoBlurVCS = nullptr;
+
+    // Temporal SSAO: [mSsaoHistoryIndex] is written this frame, the other holds last frame's.
+    ID3D11Texture2D* mSsaoHistoryTex[2] = {};
+    ID3D11RenderTargetView* mSsaoHistoryRTV[2] = {};
+    ID3D11ShaderResourceView* mSsaoHistorySRV[2] = {};
+    uint32_t mSsaoHistoryW = 0;
+    uint32_t mSsaoHistoryH = 0;
+    uint32_t mSsaoHistoryIndex = 0;
+    bool mSsaoHistoryValid = false;
+    float mSsaoHistoryScale = 1.0f; // render scale the history was accumulated at
+    Mat4x4 mSsaoPrevViewProj{};
+    uint32_t mSsaoFrame = 0;
 
     // Fallback AO texture (1x1 white) bound when SSAO is disabled.
     ID3D11Texture2D* mAoWhiteTex = nullptr;
     ID3D11ShaderResourceView* mAoWhiteSRV = nullptr;
 
-    ID3D11Buffer* mInstanceVB = nullptr;
-    size_t mInstanceCapacity = 0;
+    // Per-frame instances (point shadows, CSM, main view) appended to one ring;
+    // mMainInstanceFirst is where this frame's main-view range starts.
+    static constexpr uint32_t kInstanceRingInitialCapacity = 16384;
+    DynamicRingBufferD3D11 mInstanceRing;
+    uint32_t mMainInstanceFirst = 0;
+
+    // Views after the first of the RenderViews call in progress (none otherwise), and what
+    // PrepareSecondaryViews built for them.
+    const RenderView* mExtraViews = nullptr;
+    uint32_t mExtraViewCount = 0;
+    SphereSoA mViewSpheres;
+    std::vector<uint32_t> mViewMasks;
+    std::vector<uint32_t> mViewStaticMasks;
+    std::vector<PreparedFrame> mViewFrames;
+    std::vector<MeshLodView> mViewLods;
+    std::vector<std::vector<uint32_t>> mViewVisible;
+    std::vector<std::vector<uint32_t>> mViewStaticVisible;
+
+    // Static region (MeshRenderer::isStatic): items sorted by mesh, material, then Morton order
+    // of their position, so visible instances of a batch tend to form long runs. CPU copies and
+    // bounds live here; the instances are uploaded once per rebuild to a DEFAULT-usage buffer.
+    // Touched by BuildSnapshot and RenderGeometryPass only (never by the prep job).
+    std::vector<SnapshotItem> mStaticItems;
+    std::vector<InstanceData> mStaticInstances;
+    std::vector<StaticBatch> mStaticBatches;
+    SphereSoA mStaticSpheres;
+    // Over mStaticSpheres (user value = static index), rebuilt with the region.
+    Bvh mStaticBvh;
+    // RenderSettings::enableStaticBvh of the frame being rendered.
+    bool mStaticBvhCulling = true;
+    std::vector<uint32_t> mStaticVisible;
+    uint64_t mStaticSignature = 0;
+    size_t mStaticCount = 0;
+    bool mStaticGpuDirty = false;
+    ID3D11Buffer* mStaticInstanceVB = nullptr;
+    size_t mStaticInstanceCapacity = 0;
+
+    // GPU-culled copy of the opaque static instances (RenderSettings::enableGpuCulling); null
+    // when the compute shader is unavailable. Bucket b = mStaticBatches[b].
+    std::unique_ptr<GpuCullingD3D11> mGpuCulling;
+    bool mGpuCullDirty = true;
+
+    // This frame's draw list (dynamic batches + visible static runs) and the materials its
+    // Batch::materialIndex refers to.
+    std::vector<Batch> mDrawBatches;
+    size_t mDrawOpaqueCount = 0; // mDrawBatches[0, mDrawOpaqueCount) are opaque
+    std::vector<MaterialHandle> mDrawMaterials;
+    std::vector<uint32_t> mDrawMaterialIndex; // handle -> index in mDrawMaterials, scratch
+
+    // Per material handle: draw key state, refreshed by BuildSnapshot when the version changes.
+    struct MaterialDrawState
+    {
+        uint32_t version = 0;
+        uint8_t program = 0;
+        bool alphaBlend = false;
+        uint32_t bindGroup = 0;
+    };
+    std::vector<MaterialDrawState> mMaterialDrawState;
+    // HashMaterialBindings -> dense bind group id (ids are never reused).
+    std::unordered_map<uint64_t, uint32_t> mBindGroupIds;
 
     // Deferred contexts for parallel draw recording.
     std::vector<ID3D11DeviceContext*> mDeferredContexts;
-
-    // CPU prep worker (builds batches/instances off-thread).
-    std::thread mWorker;
-    std::mutex mWorkMutex;
-    std::condition_variable mWorkCv;
-    bool mWorkerExit = false;
-    bool mPendingValid = false;
-    bool mReadyValid = false;
-    Frustum mPendingFrustum{};
-    std::vector<SnapshotItem> mPendingItems;
-    PreparedFrame mReadyFrame;
-    PreparedFrame mRenderFrame;
+    std::vector<StateCacheD3D11> mDeferredStateCaches; // one per deferred context
+    std::vector<size_t> mDeferredChunkBounds;
+    uint32_t mDeferredProbeFrame = 0;
+
+    // CPU frame prep pipeline. The main thread hands snapshots to a prep job (pinned to one
+    // job worker) through lock-free SPSC rings of slot indices and gets prepared frames back
+    // the same way. Slots own all buffers and are recycled, so steady state doesn't allocate.
+    // Slot ownership: free list + mRenderSlot are main-thread only; a slot index in a ring
+    // belongs to that ring's consumer.
+    static constexpr uint32_t kPrepareSlots = 3;
+    static constexpr uint32_t kNoPrepareSlot = 0xFFFFFFFFu;
+    struct PrepareSlot
+    {
+        std::vector<SnapshotItem> items;
+        Frustum frustum{};
+        MeshLodView lodView{};
+        PreparedFrame frame;
+    };
+    PrepareSlot mPrepareSlots[kPrepareSlots];
+    SpscRing<uint32_t, kPrepareSlots> mPrepareToWorker;
+    SpscRing<uint32_t, kPrepareSlots> mPrepareToMain;
+    uint32_t mPrepareFree[kPrepareSlots] = {};
+    uint32_t mPrepareFreeCount = 0;
+    uint32_t mPrepareInFlight = 0;
+    uint32_t mRenderSlot = kNoPrepareSlot;
+    uint32_t mPrepareLatency = 1;
+    JobCounter mPrepareJob;
+    std::atomic<bool> mPrepareJobActive{ false };
+    // The prep job's scratch, reset before each frame it builds. Only one prep job runs at a
+    // time (mPrepareJobActive), and it may land on a different worker each time.
+    king::FrameArena mPrepareArena;
+    // Threads that CPU culling, bounds and draw sorting may use (frame prep, secondary views,
+    // shadow casters): ThreadConfig::ecsWorkerThreads workers plus the calling thread, as for
+    // the ECS systems. Written only while no prep job runs.
+    uint32_t mPrepareParallelism = 1;
+
+    // Used when the frame is prepared inline (no worker, latency 0, or pipeline warm-up).
+    PreparedFrame mInlineFrame;
 
     bool mUsePrepareWorker = true;
     bool mAllowDeferredContexts = false;
+    // ThreadConfigGeneration() last applied, and the renderDeferredContexts it created.
+    uint32_t mThreadConfigGeneration = 0;
+    uint32_t mDeferredContextsConfigured = 0;
     bool mAllowPostProcessing = true;
 };
 
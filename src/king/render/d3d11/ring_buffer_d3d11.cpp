@@ -0,0 +1,195 @@
+#include "ring_buffer_d3d11.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace king::render::d3d11
+{
+
+static void SafeRelease(IUnknown*& p)
+{
+    if (p)
+    {
+        p->Release();
+        p = nullptr;
+    }
+}
+
+DynamicRingBufferD3D11::~DynamicRingBufferD3D11()
+{
+    Shutdown();
+}
+
+bool DynamicRingBufferD3D11::Initialize(ID3D11Device* d, UINT bindFlags, uint32_t elementSize, uint32_t capacity)
+{
+    Shutdown();
+    if (!d || elementSize == 0 || capacity == 0)
+        return false;
+
+    mDevice = d;
+    mBindFlags = bindFlags;
+    mElementSize = elementSize;
+
+    for (uint32_t i = 0; i < kMaxFences; ++i)
+    {
+        D3D11_QUERY_DESC qd{};
+        qd.Query = D3D11_QUERY_EVENT;
+        if (FAILED(d->CreateQuery(&qd, &mFences[i].query)))
+        {
+            std::printf("DynamicRingBufferD3D11: CreateQuery(EVENT) failed\n");
+            Shutdown();
+            return false;
+        }
+    }
+
+    if (!Create(capacity))
+    {
+        Shutdown();
+        return false;
+    }
+    return true;
+}
+
+void DynamicRingBufferD3D11::Shutdown()
+{
+    ReleaseBuffer();
+    for (Fence& f : mFences)
+    {
+        SafeRelease((IUnknown*&)f.query);
+        f.end = 0;
+    }
+    mFenceFirst = 0;
+    mFenceCount = 0;
+    mDevice = nullptr;
+    mElementSize = 0;
+}
+
+void DynamicRingBufferD3D11::ReleaseBuffer()
+{
+    SafeRelease((IUnknown*&)mBuffer);
+    mCapacity = 0;
+    mHead = 0;
+    mTail = 0;
+    mFrameStart = 0;
+    mFresh = true;
+}
+
+bool DynamicRingBufferD3D11::Create(uint32_t capacity)
+{
+    // The old buffer stays alive in the driver until the GPU is done with it, so a new one
+    // starts empty with nothing to fence.
+    ReleaseBuffer();
+    mFenceFirst = 0;
+    mFenceCount = 0;
+
+    D3D11_BUFFER_DESC bd{};
+    bd.Usage = D3D11_USAGE_DYNAMIC;
+    bd.ByteWidth = (UINT)((size_t)capacity * mElementSize);
+    bd.BindFlags = mBindFlags;
+    bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    if (!mDevice || FAILED(mDevice->CreateBuffer(&bd, nullptr, &mBuffer)) || !mBuffer)
+    {
+        std::printf("DynamicRingBufferD3D11: CreateBuffer(%u x %u bytes) failed\n", capacity, mElementSize);
+        mBuffer = nullptr;
+        return false;
+    }
+    mCapacity = capacity;
+    return true;
+}
+
+void DynamicRingBufferD3D11::Retire(ID3D11DeviceContext* ctx, bool wait)
+{
+    while (mFenceCount > 0)
+    {
+        Fence& f = mFences[mFenceFirst];
+        BOOL done = FALSE;
+        HRESULT hr = ctx->GetData(f.query, &done, sizeof(done), D3D11_ASYNC_GETDATA_DONOTFLUSH);
+        if (hr != S_OK && wait)
+        {
+            while ((hr = ctx->GetData(f.query, &done, sizeof(done), 0)) == S_FALSE)
+            {
+            }
+        }
+        if (hr != S_OK)
+            break;
+
+        mTail = f.end;
+        mFenceFirst = (mFenceFirst + 1u) % kMaxFences;
+        mFenceCount--;
+        wait = false; // only ever block for the oldest frame
+    }
+    if (mFenceCount == 0)
+        mTail = mFrameStart;
+}
+
+void DynamicRingBufferD3D11::NextFrame(ID3D11DeviceContext* ctx)
+{
+    if (!ctx || !mBuffer)
+        return;
+
+    if (mHead != mFrameStart)
+    {
+        if (mFenceCount == kMaxFences)
+            Retire(ctx, true);
+
+        Fence& f = mFences[(mFenceFirst + mFenceCount) % kMaxFences];
+        ctx->End(f.query);
+        f.end = mHead;
+        mFenceCount++;
+        mFrameStart = mHead;
+    }
+    Retire(ctx, false);
+}
+
+bool DynamicRingBufferD3D11::Append(ID3D11DeviceContext* ctx, const void* data, uint32_t count, uint32_t& outFirst)
+{
+    outFirst = 0;
+    if (!ctx || !data || count == 0 || !mBuffer)
+        return false;
+
+    uint64_t pos = 0;
+    for (int attempt = 0;; ++attempt)
+    {
+        // Allocations never straddle the end of the buffer: skip to the start instead.
+        pos = mHead;
+        const uint32_t offset = (uint32_t)(pos % mCapacity);
+        if (count <= mCapacity && offset + count > mCapacity)
+            pos += mCapacity - offset;
+        if (count <= mCapacity && pos + count - mTail <= mCapacity)
+            break;
+
+        if (attempt == 0)
+        {
+            Retire(ctx, false);
+            continue;
+        }
+
+        // Still in flight: grow instead of waiting for the GPU.
+        uint32_t newCapacity = std::max(mCapacity, 1024u);
+        while ((uint64_t)newCapacity < (uint64_t)(mHead - mFrameStart) + count + count)
+            newCapacity *= 2u;
+        newCapacity *= 2u;
+        std::printf("[Render] Ring buffer grown to %u elements (%u bytes each)\n", newCapacity, mElementSize);
+        if (!Create(newCapacity))
+            return false;
+        pos = 0;
+        break;
+    }
+
+    D3D11_MAPPED_SUBRESOURCE mapped{};
+    const D3D11_MAP mapType = mFresh ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+    if (FAILED(ctx->Map(mBuffer, 0, mapType, 0, &mapped)))
+        return false;
+    const uint32_t first = (uint32_t)(pos % mCapacity);
+    std::memcpy((uint8_t*)mapped.pData + (size_t)first * mElementSize, data, (size_t)count * mElementSize);
+    ctx->Unmap(mBuffer, 0);
+    mMapBytes += (uint64_t)count * mElementSize;
+
+    mFresh = false;
+    mHead = pos + count;
+    outFirst = first;
+    return true;
+}
+
+} // namespace king::render::d3d11
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "gpu_memory_d3d11.h"
+
+#include <d3d11.h>
+
+#include <cstdint>
+
+namespace king::render::d3d11
+{
+
+// Append-only dynamic buffer shared by every pass of a frame (instance data for the shadow
+// passes and the main view). Appends are Map(WRITE_NO_OVERWRITE)-ed into the free part of the
+// ring, so earlier draws keep reading their own range while later passes write theirs; no pass
+// discards the buffer under another.
+//
+// Frames are fenced with event queries: NextFrame() closes the previous frame's allocations and
+// releases those of frames the GPU has finished. When an append does not fit beside the ranges
+// still in flight the ring grows (a new buffer, so nothing in flight is touched); this settles
+// after the first few frames of a scene.
+class DynamicRingBufferD3D11
+{
+public:
+    DynamicRingBufferD3D11() = default;
+    ~DynamicRingBufferD3D11();
+
+    DynamicRingBufferD3D11(const DynamicRingBufferD3D11&) = delete;
+    DynamicRingBufferD3D11& operator=(const DynamicRingBufferD3D11&) = delete;
+
+    bool Initialize(ID3D11Device* d, UINT bindFlags, uint32_t elementSize, uint32_t capacity);
+    void Shutdown();
+
+    // Call once per frame, on the immediate context, before the frame's first Append().
+    void NextFrame(ID3D11DeviceContext* ctx);
+
+    // Copies count elements into the ring and returns the index of the first one (bind the
+    // buffer at offset 0 and add it to StartInstanceLocation, or bind at first * elementSize).
+    bool Append(ID3D11DeviceContext* ctx, const void* data, uint32_t count, uint32_t& outFirst);
+
+    ID3D11Buffer* Buffer() const { return mBuffer; }
+    uint32_t ElementSize() const { return mElementSize; }
+    uint32_t Capacity() const { return mCapacity; }
+
+    // Running total of bytes appended.
+    uint64_t MapBytes() const { return mMapBytes; }
+    GpuMemoryD3D11 GpuMemory() const
+    {
+        GpuMemoryD3D11 m{};
+        m.Add(mBuffer);
+        return m;
+    }
+
+private:
+    static constexpr uint32_t kMaxFences = 8;
+
+    struct Fence
+    {
+        ID3D11Query* query = nullptr;
+        uint64_t end = 0; // ring position after the fenced frame's last append
+    };
+
+    bool Create(uint32_t capacity);
+    void ReleaseBuffer();
+    void Retire(ID3D11DeviceContext* ctx, bool wait);
+
+    ID3D11Device* mDevice = nullptr;
+    ID3D11Buffer* mBuffer = nullptr;
+    UINT mBindFlags = 0;
+    uint32_t mElementSize = 0;
+    uint32_t mCapacity = 0;
+
+    // Monotonic positions in elements (offset in the buffer = position % capacity).
+    uint64_t mHead = 0;       // next free element
+    uint64_t mTail = 0;       // first element the GPU may still read
+    uint64_t mFrameStart = 0; // first element of the current frame
+    bool mFresh = true;       // nothing written since the buffer was created
+    uint64_t mMapBytes = 0;
+
+    Fence mFences[kMaxFences];
+    uint32_t mFenceFirst = 0;
+    uint32_t mFenceCount = 0;
+};
+
+} // namespace king::render::d3d11
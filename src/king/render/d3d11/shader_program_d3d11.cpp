@@ -96,26 +96,18 @@ bool ShaderProgramD3D11::Create(ID3D11Device* device, king::ShaderCache& cache,
         }
     }
 
-    // Fixed engine vertex format (VertexPN + instance data).
+    // Fixed engine vertex format (PackedVertex + instance data).
     D3D11_INPUT_ELEMENT_DESC layout[] = {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "NORMAL",   0, DXGI_FORMAT_R16G16_SNORM,       0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 
-        // Per-instance data (slot 1)
+        // Per-instance data (slot 1): world matrix columns 0..2 (the fourth is 0,0,0,1)
         { "TEXCOORD",  4, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
         { "TEXCOORD",  5, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
         { "TEXCOORD",  6, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD",  7, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        // Normal matrix rows (inverse-transpose of world)
-        { "TEXCOORD", 11, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 64,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD", 12, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 80,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD", 13, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 96,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD", 14, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 112, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-
-        { "COLOR",     0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 128, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD",  8, DXGI_FORMAT_R32G32_FLOAT,       1, 144, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD",  9, DXGI_FORMAT_R32_UINT,           1, 152, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD", 10, DXGI_FORMAT_R32_UINT,           1, 156, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+
+        { "TEXCOORD",  9, DXGI_FORMAT_R32_UINT,           1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "TEXCOORD", 10, DXGI_FORMAT_R32_UINT,           1, 52, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
     };
 
     hr = device->CreateInputLayout(
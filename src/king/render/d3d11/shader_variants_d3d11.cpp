@@ -0,0 +1,77 @@
+#include "shader_variants_d3d11.h"
+
+#include "post_process_d3d11.h"
+#include "shadows.h"
+#include "../../render/material.h"
+
+namespace king::render::d3d11
+{
+
+void AppendGeometryProgramVariants(const std::wstring& hlslPath, const std::vector<king::ShaderDefine>& defines,
+    std::vector<king::ShaderCompileRequest>& out)
+{
+    out.push_back({ hlslPath, "VSMain", "vs_5_0", defines });
+    out.push_back({ hlslPath, "PSMain", "ps_5_0", defines });
+    out.push_back({ hlslPath, "PSMainMRT", "ps_5_0", defines });
+}
+
+std::vector<king::ShaderCompileRequest> EngineShaderVariants(const std::wstring& mainShaderPath)
+{
+    static const char* const kVertex[] = {
+        "VSMain", "VSDepthMain", "VSPointShadowMain", "VSPointShadowLayeredMain", "VSPointShadowReplicateMain",
+        "VSShadowMain", "VSFullscreenMain",
+    };
+    static const char* const kPixel[] = {
+        "PSMain", "PSMainMRT", "PSPointShadowMain", "PSPointShadowLayeredMain", "PSShadowTileClearMain",
+        "PSSsaoMain", "PSBlurMain", "PSSsaoDownsampleMain", "PSSsaoTemporalMain", "PSSsaoUpsampleMain",
+        "PSBloomExtractMain", "PSBloomBlurHMain", "PSBloomBlurVMain",
+    };
+    static const king::MaterialShadingModel kShadingModels[] = {
+        king::MaterialShadingModel::Pbr,
+        king::MaterialShadingModel::Unlit,
+        king::MaterialShadingModel::RimGlow,
+    };
+
+    std::vector<king::ShaderCompileRequest> out;
+    for (const char* e : kVertex)
+        out.push_back({ mainShaderPath, e, "vs_5_0", {} });
+    for (const char* e : kPixel)
+        out.push_back({ mainShaderPath, e, "ps_5_0", {} });
+    out.push_back({ mainShaderPath, "GSPointShadowMain", "gs_5_0", {} });
+
+    // Post composite: one permutation per combination of bloom / AO / vignette / sharpen.
+    for (uint32_t mask = 0; mask < 16u; ++mask)
+    {
+        out.push_back({ mainShaderPath, "PSTonemapMain", "ps_5_0",
+            PostProcessD3D11::CompositeDefines((mask & 1u) != 0, (mask & 2u) != 0, (mask & 4u) != 0, (mask & 8u) != 0) });
+    }
+
+    // The lit model also carries the shadow filter permutation; precompile the default one.
+    const uint32_t defaultFilters[ShadowsD3D11::kMaxCascades] = {
+        ShadowsD3D11::kDefaultFilterQuality, ShadowsD3D11::kDefaultFilterQuality, ShadowsD3D11::kDefaultFilterQuality,
+    };
+    const std::vector<king::ShaderDefine> shadowDefines = ShadowsD3D11::FilterDefines(defaultFilters, false);
+    for (king::MaterialShadingModel sm : kShadingModels)
+    {
+        std::vector<king::ShaderDefine> defines = { { "KING_SHADING_MODEL", std::to_string((int)sm) } };
+        if (sm == king::MaterialShadingModel::Pbr)
+            defines.insert(defines.end(), shadowDefines.begin(), shadowDefines.end());
+        AppendGeometryProgramVariants(mainShaderPath, defines, out);
+    }
+
+    // Same path construction as RenderSystemD3D11::Initialize, so the in-memory keys match.
+    const size_t slash = mainShaderPath.find_last_of(L"/\\");
+    const std::wstring dir = (slash == std::wstring::npos) ? std::wstring() : mainShaderPath.substr(0, slash) + L"\\";
+    const std::wstring cullPath = dir + L"gpu_cull.hlsl";
+    out.push_back({ cullPath, "CSCullInstancesMain", "cs_5_0", {} });
+    out.push_back({ cullPath, "CSHiZDownsampleMain", "cs_5_0", {} });
+    const std::wstring ssaoPath = dir + L"ssao_cs.hlsl";
+    out.push_back({ ssaoPath, "CSSsaoBlurHMain", "cs_5_0", {} });
+    out.push_back({ ssaoPath, "CSSsaoBlurVMain", "cs_5_0", {} });
+    const std::wstring bloomPath = dir + L"bloom_cs.hlsl";
+    out.push_back({ bloomPath, "CSBloomDownsampleMain", "cs_5_0", {} });
+    out.push_back({ bloomPath, "CSBloomUpsampleMain", "cs_5_0", {} });
+    return out;
+}
+
+} // namespace king::render::d3d11
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "../../render/shader.h"
+
+#include <string>
+#include <vector>
+
+namespace king::render::d3d11
+{
+
+// Every shader RenderSystemD3D11 and its passes compile from the main shader (plus
+// gpu_cull.hlsl beside it), including the geometry program of each engine shading model
+// (KING_SHADING_MODEL, the lit one with the default shadow filters). Feeds the startup precompile and the ShaderPrecompile tool; keep it in
+// step with the Compile*FromFile call sites.
+std::vector<king::ShaderCompileRequest> EngineShaderVariants(const std::wstring& mainShaderPath);
+
+// The entries ShaderProgramD3D11::Create compiles for a geometry program (VS, PS, MRT PS).
+void AppendGeometryProgramVariants(const std::wstring& hlslPath, const std::vector<king::ShaderDefine>& defines,
+    std::vector<king::ShaderCompileRequest>& out);
+
+} // namespace king::render::d3d11
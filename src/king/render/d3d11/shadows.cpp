@@ -3,6 +3,8 @@
 #include "../../render/shader.h"
 #include "../../ecs/components.h"
 #include "../../thread_config.h"
+#include "../../jobs/job_system.h"
+#include "../../perf/trace_capture.h"
 
 #include <DirectXMath.h>
 
@@ -13,7 +15,6 @@
 #include <cstdio>
 #include <cstring>
 #include <atomic>
-#include <thread>
 
 namespace
 {
@@ -126,18 +127,25 @@ bool ShadowsD3D11::Initialize(RenderDeviceD3D11& device, ShaderCache& shaderCach
     }
 
     // Create deferred contexts (driven by thread config).
-    {
-        const king::ThreadConfig& tc = king::GetThreadConfig();
-        mShadowRecordThreads = tc.renderShadowRecordThreads;
-        uint32_t desired = 1;
-        if (tc.renderShadowRecordThreads > 1)
-            desired = std::min<uint32_t>(kMaxCascades, tc.renderShadowRecordThreads);
-        EnsureDeferredContexts(device, desired);
-    }
+    ApplyThreadConfig(device);
 
     return true;
 }
 
+void ShadowsD3D11::ApplyThreadConfig(RenderDeviceD3D11& device)
+{
+    const king::ThreadConfig& tc = king::GetThreadConfig();
+    mShadowRecordThreads = tc.renderShadowRecordThreads;
+    uint32_t desired = 1;
+    if (tc.renderShadowRecordThreads > 1)
+        desired = std::min<uint32_t>(kMaxCascades, tc.renderShadowRecordThreads);
+    if (desired == (uint32_t)mDeferredContexts.size())
+        return;
+
+    ReleaseDeferredContexts();
+    EnsureDeferredContexts(device, desired);
+}
+
 void ShadowsD3D11::Shutdown()
 {
     ReleaseDeferredContexts();
@@ -208,6 +216,15 @@ void ShadowsD3D11::ReleaseDeferredContexts()
     mDeferredContexts.clear();
 }
 
+std::vector<king::ShaderDefine> ShadowsD3D11::FilterDefines(const uint32_t cascadeQuality[kMaxCascades], bool adaptive)
+{
+    std::vector<king::ShaderDefine> defs;
+    for (uint32_t c = 0; c < kMaxCascades; ++c)
+        defs.push_back({ "KING_SHADOW_FILTER" + std::to_string(c), std::to_string(std::min(cascadeQuality[c], 4u)) });
+    defs.push_back({ "KING_SHADOW_ADAPTIVE", adaptive ? "1" : "0" });
+    return defs;
+}
+
 void ShadowsD3D11::EnsureResources(RenderDeviceD3D11& device, uint32_t cascadeCount, uint32_t shadowMapSize)
 {
     uint32_t cascades = cascadeCount;
@@ -248,6 +265,7 @@ void ShadowsD3D11::EnsureResources(RenderDeviceD3D11& device, uint32_t cascadeCo
     // Shadow format/size changes invalidate readback.
     SafeRelease((IUnknown*)mShadowReadbackTex);
     mShadowReadbackTex = nullptr;
+    mResourceGeneration++;
 
     // Texture array.
     D3D11_TEXTURE2D_DESC td{};
@@ -285,12 +303,17 @@ void ShadowsD3D11::EnsureResources(RenderDeviceD3D11& device, uint32_t cascadeCo
     if (FAILED(d->CreateShaderResourceView(mShadowTex, &srvd, &mShadowSRV)) || !mShadowSRV)
         return;
 
-    mShadowViewport.TopLeftX = 0.0f;
-    mShadowViewport.TopLeftY = 0.0f;
-    mShadowViewport.Width = (float)size;
-    mShadowViewport.Height = (float)size;
-    mShadowViewport.MinDepth = 0.0f;
-    mShadowViewport.MaxDepth = 1.0f;
+    // Full slices until ComputeCascades applies the per-cascade sizes.
+    for (uint32_t i = 0; i < kMaxCascades; ++i)
+    {
+        mCascadeSize[i] = size;
+        mCascadeViewport[i].TopLeftX = 0.0f;
+        mCascadeViewport[i].TopLeftY = 0.0f;
+        mCascadeViewport[i].Width = (float)size;
+        mCascadeViewport[i].Height = (float)size;
+        mCascadeViewport[i].MinDepth = 0.0f;
+        mCascadeViewport[i].MaxDepth = 1.0f;
+    }
 
     // Rasterizer: front-face cull + bias.
     // Front-face culling is a common trick to reduce self-shadowing (acne)
@@ -298,7 +321,9 @@ void ShadowsD3D11::EnsureResources(RenderDeviceD3D11& device, uint32_t cascadeCo
     D3D11_RASTERIZER_DESC rs{};
     rs.FillMode = D3D11_FILL_SOLID;
     rs.CullMode = D3D11_CULL_FRONT;
-    rs.DepthClipEnable = TRUE;
+    // Depth clamp ("pancaking"): casters between the sun and a cascade's near plane land on
+    // depth 0 instead of being clipped, so the near plane can stay tight around the slice.
+    rs.DepthClipEnable = FALSE;
     rs.DepthBias = 300;
     rs.SlopeScaledDepthBias = 1.25f;
     rs.DepthBiasClamp = 0.0f;
@@ -377,7 +402,21 @@ bool ShadowsD3D11::ComputeCascades(
     if (dY > 0.98f)
         up = XMVectorSet(0, 0, 1, 0);
 
-    const float shadowSize = (mShadowMapSize > 0) ? (float)mShadowMapSize : mShadowViewport.Width;
+    // Per-cascade resolution inside the shared slices. A change invalidates cached cascades:
+    // their depths were drawn over a different region.
+    constexpr uint32_t kMinCascadeSize = 128;
+    for (uint32_t c = 0; c < kMaxCascades; ++c)
+    {
+        const uint32_t requested = (settings.cascadeMapSize[c] > 0) ? settings.cascadeMapSize[c] : mShadowMapSize;
+        const uint32_t size = std::clamp(requested, std::min(kMinCascadeSize, mShadowMapSize), mShadowMapSize);
+        if (size != mCascadeSize[c])
+        {
+            mCascadeSize[c] = size;
+            mCascadeViewport[c].Width = (float)size;
+            mCascadeViewport[c].Height = (float)size;
+            mResourceGeneration++;
+        }
+    }
 
     auto storeMat = [](const DirectX::XMMATRIX& m) -> Mat4x4
     {
@@ -386,7 +425,7 @@ bool ShadowsD3D11::ComputeCascades(
         return out;
     };
 
-    auto computeCascadeVP = [&](float zNearNdc, float zFarNdc) -> Mat4x4
+    auto computeCascadeVP = [&](float zNearNdc, float zFarNdc, float cachePad, float shadowSize) -> Mat4x4
     {
         const XMVECTOR clipCorners[8] = {
             XMVectorSet(-1, -1, zNearNdc, 1), XMVectorSet( 1, -1, zNearNdc, 1), XMVectorSet( 1,  1, zNearNdc, 1), XMVectorSet(-1,  1, zNearNdc, 1),
@@ -428,8 +467,8 @@ bool ShadowsD3D11::ComputeCascades(
         const float baseExtentY = (maxY - minY);
         const float baseExtentZ = (maxZ - minZ);
 
-        const float xyPad = std::max(2.0f, 0.05f * std::max(baseExtentX, baseExtentY));
-        const float zPad = std::max(10.0f, 0.10f * baseExtentZ);
+        const float xyPad = std::max(2.0f, (0.05f + cachePad) * std::max(baseExtentX, baseExtentY));
+        const float zPad = std::max(10.0f, (0.10f + cachePad) * baseExtentZ);
 
         float nearLS = minZ - zPad;
         float farLS = maxZ + zPad;
@@ -456,20 +495,52 @@ bool ShadowsD3D11::ComputeCascades(
         return storeMat(lv * lp);
     };
 
+    const float cachePad = std::clamp(settings.cachedCascadePadding, 0.0f, 1.0f);
     float prevZ = 0.0f;
     for (uint32_t c = 0; c < cascadeCount; ++c)
     {
         const float zFar = (c == 0) ? outCascadeSplitsNdc[0] : (c == 1 ? outCascadeSplitsNdc[1] : 1.0f);
-        outCascadeViewProj[c] = computeCascadeVP(prevZ, zFar);
+        outCascadeViewProj[c] = computeCascadeVP(prevZ, zFar, (c >= settings.firstCachedCascade) ? cachePad : 0.0f,
+            (float)mCascadeSize[c]);
         prevZ = zFar;
     }
 
-    outShadowTexelSize[0] = 1.0f / shadowSize;
-    outShadowTexelSize[1] = 1.0f / shadowSize;
+    // One texel of the array in UV, whichever region of it a cascade uses.
+    outShadowTexelSize[0] = 1.0f / (float)mShadowMapSize;
+    outShadowTexelSize[1] = 1.0f / (float)mShadowMapSize;
 
     return true;
 }
 
+bool ShadowsD3D11::CascadeCoversSlice(const Mat4x4& cascadeViewProj, const Mat4x4& cameraViewProj, float zNearNdc, float zFarNdc)
+{
+    using namespace DirectX;
+
+    const XMMATRIX invVP = XMMatrixInverse(nullptr, XMLoadFloat4x4((const XMFLOAT4X4*)&cameraViewProj));
+    const XMMATRIX cvp = XMLoadFloat4x4((const XMFLOAT4X4*)&cascadeViewProj);
+    for (int i = 0; i < 8; ++i)
+    {
+        const XMVECTOR clip = XMVectorSet((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? zFarNdc : zNearNdc, 1.0f);
+        XMVECTOR w = XMVector4Transform(clip, invVP);
+        w = XMVectorScale(w, 1.0f / XMVectorGetW(w));
+        const XMVECTOR ls = XMVector3TransformCoord(w, cvp);
+        const float x = XMVectorGetX(ls);
+        const float y = XMVectorGetY(ls);
+        const float z = XMVectorGetZ(ls);
+        if (!(std::fabs(x) <= 1.0f && std::fabs(y) <= 1.0f && z >= 0.0f && z <= 1.0f))
+            return false;
+    }
+    return true;
+}
+
+GpuMemoryD3D11 ShadowsD3D11::GpuMemory() const
+{
+    GpuMemoryD3D11 m{};
+    m.Add(mShadowTex);
+    m.Add(mShadowReadbackTex);
+    return m;
+}
+
 void ShadowsD3D11::EnsureReadbackTexture(RenderDeviceD3D11& device)
 {
     ID3D11Device* d = device.Device();
@@ -503,10 +574,11 @@ void ShadowsD3D11::Render(
     uint32_t instanceStride,
     const Mat4x4 cascadeViewProj[kMaxCascades],
     uint32_t cascadeCount,
-    bool debugReadbackOnce)
+    bool debugReadbackOnce,
+    uint32_t renderMask)
 {
     ID3D11DeviceContext* ctx = device.Context();
-    if (!ctx || !mShadowDSV[0] || !mShadowRS || !mVSShadow || !instanceVB || !inputLayout)
+    if (!ctx || !mShadowDSV[0] || !mShadowRS || !mVSShadow || !inputLayout)
         return;
 
     uint32_t cascades = cascadeCount;
@@ -515,16 +587,29 @@ void ShadowsD3D11::Render(
     if (cascades > kMaxCascades)
         cascades = kMaxCascades;
 
+    // Cascades to redraw, in order. Without instances they are only cleared.
+    uint32_t todo[kMaxCascades] = {};
+    uint32_t todoCount = 0;
+    for (uint32_t c = 0; c < cascades; ++c)
+    {
+        if (renderMask & (1u << c))
+            todo[todoCount++] = c;
+    }
+    if (todoCount == 0)
+        return;
+
     // Update per-cascade constant buffers on the immediate context (no contention).
     D3D11_MAPPED_SUBRESOURCE mapped{};
-    for (uint32_t c = 0; c < cascades; ++c)
+    for (uint32_t t = 0; t < todoCount; ++t)
     {
+        const uint32_t c = todo[t];
         ShadowCBData scb{};
         scb.shadowViewProj = cascadeViewProj[c];
         if (SUCCEEDED(ctx->Map(mShadowCB[c], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
         {
             std::memcpy(mapped.pData, &scb, sizeof(scb));
             ctx->Unmap(mShadowCB[c], 0);
+            mMapBytes += sizeof(scb);
         }
     }
 
@@ -539,94 +624,82 @@ void ShadowsD3D11::Render(
     const uint32_t requestedThreads = mShadowRecordThreads;
     const uint32_t ctxCount = (uint32_t)mDeferredContexts.size();
 
-    auto RecordCascade = [&](ID3D11DeviceContext* dc, uint32_t c)
-    {
-        if (!dc)
-            return;
+    PipelineStateD3D11 pipeline{};
+    pipeline.layout = inputLayout;
+    pipeline.vs = mVSShadow;
+    pipeline.rs = mShadowRS;
+    pipeline.topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
-        dc->ClearState();
+    // Bind counts per cascade; summed into mStateStats once recording is done.
+    StateCacheD3D11::Stats cascadeStats[kMaxCascades]{};
+
+    // Draws cascade c through sc (a fresh cache: the context's state is unknown).
+    auto DrawCascade = [&](StateCacheD3D11& sc, uint32_t c)
+    {
+        ID3D11DeviceContext* dc = sc.Context();
 
         // Bind shadow outputs.
         dc->OMSetRenderTargets(0, nullptr, mShadowDSV[c]);
         dc->ClearDepthStencilView(mShadowDSV[c], D3D11_CLEAR_DEPTH, 1.0f, 0);
-        dc->RSSetViewports(1, &mShadowViewport);
-        dc->RSSetState(mShadowRS);
-
-        dc->IASetInputLayout(inputLayout);
-        dc->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        dc->VSSetShader(mVSShadow, nullptr, 0);
-        dc->PSSetShader(nullptr, nullptr, 0);
+        dc->RSSetViewports(1, &mCascadeViewport[c]);
 
+        sc.SetPipeline(pipeline);
         // Shadow VS reads ShadowCB at b2.
-        dc->VSSetConstantBuffers(2, 1, &mShadowCB[c]);
+        sc.SetVSConstantBuffer(2, mShadowCB[c]);
 
         const std::vector<DrawBatch>& batches = batchesPerCascade[c];
         for (const DrawBatch& b : batches)
         {
-            if (!b.vb || b.instanceCount == 0)
+            if (!b.vb || !instanceVB || b.instanceCount == 0)
                 continue;
 
             ID3D11Buffer* vbs[2] = { b.vb, instanceVB };
-            UINT strides[2] = { (UINT)sizeof(king::VertexPN), (UINT)instanceStride };
+            UINT strides[2] = { (UINT)sizeof(king::PackedVertex), (UINT)instanceStride };
             UINT offsets[2] = { 0u, 0u };
-            dc->IASetVertexBuffers(0, 2, vbs, strides, offsets);
+            sc.SetVertexBuffers(0, 2, vbs, strides, offsets);
 
             if (b.ib && b.indexCount > 0)
             {
-                dc->IASetIndexBuffer(b.ib, DXGI_FORMAT_R16_UINT, 0);
-                dc->DrawIndexedInstanced(b.indexCount, b.instanceCount, 0, 0, b.startInstance);
+                sc.SetIndexBuffer(b.ib, b.index32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT, 0);
+                sc.DrawIndexedInstanced(b.indexCount, b.instanceCount, b.startIndex, 0, b.startInstance);
             }
             else if (b.vertexCount > 0)
             {
-                dc->DrawInstanced(b.vertexCount, b.instanceCount, 0, b.startInstance);
+                sc.DrawInstanced(b.vertexCount, b.instanceCount, 0, b.startInstance);
             }
         }
+        cascadeStats[c] = sc.GetStats();
+    };
+
+    auto RecordCascade = [&](ID3D11DeviceContext* dc, uint32_t c)
+    {
+        if (!dc)
+            return;
+
+        king::perf::TraceScope trace("ShadowRecordCascade");
+        dc->ClearState();
+        StateCacheD3D11 sc;
+        sc.Begin(dc);
+        DrawCascade(sc, c);
 
         ID3D11CommandList* cl = nullptr;
         if (SUCCEEDED(dc->FinishCommandList(FALSE, &cl)))
             recorded[c].list = cl;
     };
 
-    // If configured for 0/1 threads, record sequentially (avoid per-frame thread creation).
+    // If configured for 0/1 threads, record sequentially on this thread.
     if (requestedThreads <= 1)
     {
-        for (uint32_t c = 0; c < cascades; ++c)
+        for (uint32_t t = 0; t < todoCount; ++t)
         {
-            ID3D11DeviceContext* dc = (ctxCount > 0) ? mDeferredContexts[c % ctxCount] : nullptr;
+            const uint32_t c = todo[t];
+            ID3D11DeviceContext* dc = (ctxCount > 0) ? mDeferredContexts[t % ctxCount] : nullptr;
             if (!dc)
             {
                 // Fallback: execute directly on the immediate context.
-                ctx->OMSetRenderTargets(0, nullptr, mShadowDSV[c]);
-                ctx->ClearDepthStencilView(mShadowDSV[c], D3D11_CLEAR_DEPTH, 1.0f, 0);
-                ctx->RSSetViewports(1, &mShadowViewport);
-                ctx->RSSetState(mShadowRS);
-                ctx->IASetInputLayout(inputLayout);
-                ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-                ctx->VSSetShader(mVSShadow, nullptr, 0);
-                ctx->PSSetShader(nullptr, nullptr, 0);
-                ctx->VSSetConstantBuffers(2, 1, &mShadowCB[c]);
-
-                const std::vector<DrawBatch>& batches = batchesPerCascade[c];
-                for (const DrawBatch& b : batches)
-                {
-                    if (!b.vb || b.instanceCount == 0)
-                        continue;
-
-                    ID3D11Buffer* vbs[2] = { b.vb, instanceVB };
-                    UINT strides[2] = { (UINT)sizeof(king::VertexPN), (UINT)instanceStride };
-                    UINT offsets[2] = { 0u, 0u };
-                    ctx->IASetVertexBuffers(0, 2, vbs, strides, offsets);
-
-                    if (b.ib && b.indexCount > 0)
-                    {
-                        ctx->IASetIndexBuffer(b.ib, DXGI_FORMAT_R16_UINT, 0);
-                        ctx->DrawIndexedInstanced(b.indexCount, b.instanceCount, 0, 0, b.startInstance);
-                    }
-                    else if (b.vertexCount > 0)
-                    {
-                        ctx->DrawInstanced(b.vertexCount, b.instanceCount, 0, b.startInstance);
-                    }
-                }
+                StateCacheD3D11 sc;
+                sc.Begin(ctx);
+                DrawCascade(sc, c);
             }
             else
             {
@@ -637,31 +710,36 @@ void ShadowsD3D11::Render(
     else
     {
         const uint32_t maxThreads = (ctxCount > 0) ? ctxCount : 1u;
-        const uint32_t workerCount = std::min<uint32_t>(std::min<uint32_t>(requestedThreads, cascades), maxThreads);
+        const uint32_t workerCount = std::min<uint32_t>(std::min<uint32_t>(requestedThreads, todoCount), maxThreads);
 
+        // One recorder per deferred context; each pulls cascades until none are left.
+        // Recorder 0 runs on this thread, the rest on the engine job system.
         std::atomic<uint32_t> next{ 0u };
-        std::vector<std::thread> threads;
-        threads.reserve(workerCount);
+        auto recordLoop = [&](ID3D11DeviceContext* dc)
+        {
+            for (;;)
+            {
+                const uint32_t t = next.fetch_add(1u);
+                if (t >= todoCount)
+                    break;
+                RecordCascade(dc, todo[t]);
+            }
+        };
 
-        for (uint32_t t = 0; t < workerCount; ++t)
+        king::JobSystem& jobs = king::GetJobSystem();
+        king::JobCounter done;
+        for (uint32_t t = 1; t < workerCount; ++t)
         {
             ID3D11DeviceContext* dc = (ctxCount > 0) ? mDeferredContexts[t % ctxCount] : nullptr;
-            threads.emplace_back([&, dc]()
-            {
-                for (;;)
-                {
-                    const uint32_t c = next.fetch_add(1u);
-                    if (c >= cascades)
-                        break;
-                    RecordCascade(dc, c);
-                }
-            });
+            jobs.Submit(done, [&recordLoop, dc]() { recordLoop(dc); });
         }
-
-        for (auto& t : threads)
-            t.join();
+        recordLoop((ctxCount > 0) ? mDeferredContexts[0] : nullptr);
+        jobs.Wait(done);
     }
 
+    for (uint32_t c = 0; c < cascades; ++c)
+        mStateStats += cascadeStats[c];
+
     // Execute command lists.
     for (uint32_t c = 0; c < cascades; ++c)
     {
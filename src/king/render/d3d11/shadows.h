@@ -1,8 +1,11 @@
 #pragma once
 
+#include "gpu_memory_d3d11.h"
 #include "render_device_d3d11.h"
+#include "state_cache_d3d11.h"
 
 #include "../../math/types.h"
+#include "../../render/shader.h"
 
 #include <d3d11.h>
 
@@ -29,8 +32,17 @@ public:
         float strength = 1.0f;
         uint32_t mapSize = 1024;
         uint32_t cascadeCount = 3; // 1..3
+        // Resolution of each cascade (texels), 0 = mapSize; clamped to mapSize. The slices share
+        // one mapSize array, so a smaller cascade renders into the top-left of its slice.
+        uint32_t cascadeMapSize[3] = {};
         float cascadeLambda = 0.55f;
 
+        // Cascades from this index on are sized for reuse across frames (see Render's
+        // renderMask): their light-space bounds grow by cachedCascadePadding (fraction of the
+        // cascade extent) so the camera can move a while before the map stops covering it.
+        uint32_t firstCachedCascade = 3; // >= cascadeCount: none
+        float cachedCascadePadding = 0.0f;
+
         // 0=off, 1=show shadow factor (grayscale)
         uint32_t debugView = 0;
         bool debugReadbackOnce = false;
@@ -41,12 +53,20 @@ public:
         ID3D11Buffer* vb = nullptr;
         ID3D11Buffer* ib = nullptr;
         uint32_t indexCount = 0;
+        uint32_t startIndex = 0; // LOD range within the index buffer
         uint32_t vertexCount = 0;
         uint32_t startInstance = 0;
         uint32_t instanceCount = 0;
+        bool index32 = false;
     };
 
     static constexpr uint32_t kMaxCascades = 3;
+    // Filter quality the shader assumes without defines (RenderSettings::shadowFilterQuality).
+    static constexpr uint32_t kDefaultFilterQuality = 1;
+
+    // Geometry-shader defines selecting each cascade's filter (0..4) and the adaptive early-out
+    // (KING_SHADOW_FILTER0..2, KING_SHADOW_ADAPTIVE in pbr_test.hlsl).
+    static std::vector<king::ShaderDefine> FilterDefines(const uint32_t cascadeQuality[kMaxCascades], bool adaptive);
 
     ShadowsD3D11() = default;
     ~ShadowsD3D11();
@@ -56,6 +76,9 @@ public:
 
     bool Initialize(RenderDeviceD3D11& device, ShaderCache& shaderCache, const std::wstring& shaderPath);
     void Shutdown();
+    // Re-reads renderShadowRecordThreads; re-creates the deferred contexts if their count
+    // changes. Between frames.
+    void ApplyThreadConfig(RenderDeviceD3D11& device);
 
     void EnsureResources(RenderDeviceD3D11& device, uint32_t cascadeCount, uint32_t shadowMapSize);
 
@@ -74,6 +97,14 @@ public:
         float& outShadowBias,
         float& outShadowStrength);
 
+    // True if every point of the camera frustum slice between the NDC depths zNearNdc and
+    // zFarNdc projects inside cascadeViewProj's map (xy and depth).
+    static bool CascadeCoversSlice(const Mat4x4& cascadeViewProj, const Mat4x4& cameraViewProj, float zNearNdc, float zFarNdc);
+
+    // Clears and redraws the cascades whose bit is set in renderMask; the others keep their
+    // depths (the caller keeps sampling them with the matrices they were drawn with).
+    // Casters in front of a cascade's near plane are flattened onto it (depth clamp), so
+    // batches may include everything between the sun and the cascade.
     void Render(
         RenderDeviceD3D11& device,
         const std::vector<DrawBatch> batchesPerCascade[kMaxCascades],
@@ -82,7 +113,29 @@ public:
         uint32_t instanceStride,
         const Mat4x4 cascadeViewProj[kMaxCascades],
         uint32_t cascadeCount,
-        bool debugReadbackOnce);
+        bool debugReadbackOnce,
+        uint32_t renderMask = ~0u);
+
+    // Binds issued/skipped and draws of Render() since the last ResetStateStats().
+    const StateCacheD3D11::Stats& StateStats() const { return mStateStats; }
+    void ResetStateStats() { mStateStats = {}; }
+
+    // Running total of bytes written through Map (cascade constants).
+    uint64_t MapBytes() const { return mMapBytes; }
+    // The cascade shadow map and its debug readback copy.
+    GpuMemoryD3D11 GpuMemory() const;
+
+    // Changes whenever the shadow map is recreated or a cascade's resolution changes (cached
+    // cascade contents are lost).
+    uint32_t ResourceGeneration() const { return mResourceGeneration; }
+
+    // Resolution ComputeCascades picked for cascade c, and the fraction of its slice that
+    // covers (LightCB cascadeUvScale).
+    uint32_t CascadeSize(uint32_t c) const { return (c < kMaxCascades) ? mCascadeSize[c] : 0u; }
+    float CascadeUvScale(uint32_t c) const
+    {
+        return (c < kMaxCascades && mShadowMapSize > 0) ? (float)mCascadeSize[c] / (float)mShadowMapSize : 1.0f;
+    }
 
     ID3D11ShaderResourceView* ShadowSRV() const { return mShadowSRV; }
     // Point comparison sampler: required when doing manual multi-tap PCF in shader.
@@ -100,6 +153,7 @@ private:
 private:
     uint32_t mShadowMapSize = 0;
     uint32_t mShadowCascadeCount = 0;
+    uint32_t mResourceGeneration = 0;
 
     ID3D11VertexShader* mVSShadow = nullptr;
 
@@ -114,7 +168,8 @@ private:
     ID3D11Texture2D* mShadowTex = nullptr;
     ID3D11DepthStencilView* mShadowDSV[kMaxCascades]{};
     ID3D11ShaderResourceView* mShadowSRV = nullptr;
-    D3D11_VIEWPORT mShadowViewport{};
+    uint32_t mCascadeSize[kMaxCascades]{};
+    D3D11_VIEWPORT mCascadeViewport[kMaxCascades]{};
     ID3D11RasterizerState* mShadowRS = nullptr;
 
     // Shadow diagnostics
@@ -123,8 +178,11 @@ private:
     // Deferred contexts for parallel shadow recording (one per cascade).
     std::vector<ID3D11DeviceContext*> mDeferredContexts;
 
-    // Cached init-time setting (avoid per-frame thread_config lookups).
+    // Cached thread_config setting (avoid per-frame lookups), see ApplyThreadConfig.
     uint32_t mShadowRecordThreads = 0;
+
+    StateCacheD3D11::Stats mStateStats{};
+    uint64_t mMapBytes = 0;
 };
 
 } // namespace king::render::d3d11
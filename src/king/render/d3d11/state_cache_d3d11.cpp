@@ -0,0 +1,288 @@
+#include "state_cache_d3d11.h"
+
+namespace king::render::d3d11
+{
+
+void StateCacheD3D11::Begin(ID3D11DeviceContext* ctx)
+{
+    mCtx = ctx;
+    Invalidate();
+}
+
+void StateCacheD3D11::Invalidate()
+{
+    mKnown = 0;
+    mKnownVsCb = 0;
+    mKnownPsCb = 0;
+    mKnownSrv = 0;
+    mKnownSampler = 0;
+    mKnownVb = 0;
+}
+
+void StateCacheD3D11::InvalidateShaderResources()
+{
+    mKnownSrv = 0;
+}
+
+bool StateCacheD3D11::Filter(uint32_t bit, bool same)
+{
+    if ((mKnown & bit) && same)
+    {
+        mStats.skipped++;
+        return false;
+    }
+    mKnown |= bit;
+    mStats.issued++;
+    return true;
+}
+
+void StateCacheD3D11::SetPipeline(const PipelineStateD3D11& p)
+{
+    SetInputLayout(p.layout);
+    SetTopology(p.topology);
+    SetVS(p.vs);
+    SetGS(p.gs);
+    SetPS(p.ps);
+    SetBlendState(p.blend);
+    SetDepthStencilState(p.dss);
+    SetRasterizerState(p.rs);
+}
+
+void StateCacheD3D11::SetInputLayout(ID3D11InputLayout* layout)
+{
+    if (!Filter(kLayout, mLayout == layout))
+        return;
+    mLayout = layout;
+    mCtx->IASetInputLayout(layout);
+}
+
+void StateCacheD3D11::SetTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+    if (!Filter(kTopology, mTopology == topology))
+        return;
+    mTopology = topology;
+    mCtx->IASetPrimitiveTopology(topology);
+}
+
+void StateCacheD3D11::SetVS(ID3D11VertexShader* vs)
+{
+    if (!Filter(kVS, mVS == vs))
+        return;
+    mVS = vs;
+    mCtx->VSSetShader(vs, nullptr, 0);
+}
+
+void StateCacheD3D11::SetGS(ID3D11GeometryShader* gs)
+{
+    if (!Filter(kGS, mGS == gs))
+        return;
+    mGS = gs;
+    mCtx->GSSetShader(gs, nullptr, 0);
+}
+
+void StateCacheD3D11::SetPS(ID3D11PixelShader* ps)
+{
+    if (!Filter(kPS, mPS == ps))
+        return;
+    mPS = ps;
+    mCtx->PSSetShader(ps, nullptr, 0);
+}
+
+void StateCacheD3D11::SetBlendState(ID3D11BlendState* blend)
+{
+    if (!Filter(kBlend, mBlend == blend))
+        return;
+    mBlend = blend;
+    const float blendFactor[4] = { 0, 0, 0, 0 };
+    mCtx->OMSetBlendState(blend, blendFactor, 0xFFFFFFFFu);
+}
+
+void StateCacheD3D11::SetDepthStencilState(ID3D11DepthStencilState* dss)
+{
+    if (!Filter(kDss, mDss == dss))
+        return;
+    mDss = dss;
+    mCtx->OMSetDepthStencilState(dss, 0);
+}
+
+void StateCacheD3D11::SetRasterizerState(ID3D11RasterizerState* rs)
+{
+    if (!Filter(kRs, mRs == rs))
+        return;
+    mRs = rs;
+    mCtx->RSSetState(rs);
+}
+
+void StateCacheD3D11::SetVSConstantBuffer(uint32_t slot, ID3D11Buffer* cb)
+{
+    if (slot < kMaxConstantBuffers)
+    {
+        const uint32_t bit = 1u << slot;
+        if ((mKnownVsCb & bit) && mVsCb[slot] == cb)
+        {
+            mStats.skipped++;
+            return;
+        }
+        mKnownVsCb |= bit;
+        mVsCb[slot] = cb;
+    }
+    mStats.issued++;
+    mCtx->VSSetConstantBuffers(slot, 1, &cb);
+}
+
+void StateCacheD3D11::SetPSConstantBuffer(uint32_t slot, ID3D11Buffer* cb)
+{
+    if (slot < kMaxConstantBuffers)
+    {
+        const uint32_t bit = 1u << slot;
+        if ((mKnownPsCb & bit) && mPsCb[slot] == cb)
+        {
+            mStats.skipped++;
+            return;
+        }
+        mKnownPsCb |= bit;
+        mPsCb[slot] = cb;
+    }
+    mStats.issued++;
+    mCtx->PSSetConstantBuffers(slot, 1, &cb);
+}
+
+void StateCacheD3D11::SetPSShaderResources(uint32_t start, uint32_t count, ID3D11ShaderResourceView* const* srvs)
+{
+    if (count == 0)
+        return;
+    if (start + count > kMaxShaderResources)
+    {
+        mStats.issued++;
+        mCtx->PSSetShaderResources(start, count, srvs);
+        return;
+    }
+
+    // Bind the smallest span covering every slot that changed.
+    uint32_t first = count;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint32_t slot = start + i;
+        if ((mKnownSrv & (1u << slot)) && mSrv[slot] == srvs[i])
+            continue;
+        if (first == count)
+            first = i;
+        last = i;
+        mKnownSrv |= 1u << slot;
+        mSrv[slot] = srvs[i];
+    }
+
+    if (first == count)
+    {
+        mStats.skipped++;
+        return;
+    }
+    mStats.issued++;
+    mCtx->PSSetShaderResources(start + first, last - first + 1u, srvs + first);
+}
+
+void StateCacheD3D11::SetPSSampler(uint32_t slot, ID3D11SamplerState* sampler)
+{
+    if (slot < kMaxSamplers)
+    {
+        const uint32_t bit = 1u << slot;
+        if ((mKnownSampler & bit) && mSampler[slot] == sampler)
+        {
+            mStats.skipped++;
+            return;
+        }
+        mKnownSampler |= bit;
+        mSampler[slot] = sampler;
+    }
+    mStats.issued++;
+    mCtx->PSSetSamplers(slot, 1, &sampler);
+}
+
+void StateCacheD3D11::SetVertexBuffers(uint32_t start, uint32_t count, ID3D11Buffer* const* vbs, const UINT* strides, const UINT* offsets)
+{
+    if (count == 0)
+        return;
+    if (start + count > kMaxVertexBuffers)
+    {
+        mStats.issued++;
+        mCtx->IASetVertexBuffers(start, count, vbs, strides, offsets);
+        return;
+    }
+
+    uint32_t first = count;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint32_t slot = start + i;
+        VertexBinding& vb = mVb[slot];
+        if ((mKnownVb & (1u << slot)) && vb.buffer == vbs[i] && vb.stride == strides[i] && vb.offset == offsets[i])
+            continue;
+        if (first == count)
+            first = i;
+        last = i;
+        mKnownVb |= 1u << slot;
+        vb = { vbs[i], strides[i], offsets[i] };
+    }
+
+    if (first == count)
+    {
+        mStats.skipped++;
+        return;
+    }
+    mStats.issued++;
+    mCtx->IASetVertexBuffers(start + first, last - first + 1u, vbs + first, strides + first, offsets + first);
+}
+
+void StateCacheD3D11::SetIndexBuffer(ID3D11Buffer* ib, DXGI_FORMAT format, UINT offset)
+{
+    if (!Filter(kIndexBuffer, mIb == ib && mIbFormat == format && mIbOffset == offset))
+        return;
+    mIb = ib;
+    mIbFormat = format;
+    mIbOffset = offset;
+    mCtx->IASetIndexBuffer(ib, format, offset);
+}
+
+void StateCacheD3D11::Draw(UINT vertexCount, UINT startVertex)
+{
+    mStats.draws++;
+    mStats.instances++;
+    mCtx->Draw(vertexCount, startVertex);
+}
+
+void StateCacheD3D11::DrawInstanced(UINT vertexCount, UINT instanceCount, UINT startVertex, UINT startInstance)
+{
+    mStats.draws++;
+    mStats.instances += instanceCount;
+    mCtx->DrawInstanced(vertexCount, instanceCount, startVertex, startInstance);
+}
+
+void StateCacheD3D11::DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance)
+{
+    mStats.draws++;
+    mStats.instances += instanceCount;
+    mCtx->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
+
+void StateCacheD3D11::DrawInstancedIndirect(ID3D11Buffer* args, UINT offset)
+{
+    mStats.draws++;
+    mStats.indirectDraws++;
+    mCtx->DrawInstancedIndirect(args, offset);
+}
+
+void StateCacheD3D11::DrawIndexedInstancedIndirect(ID3D11Buffer* args, UINT offset)
+{
+    mStats.draws++;
+    mStats.indirectDraws++;
+    mCtx->DrawIndexedInstancedIndirect(args, offset);
+}
+
+void StateCacheD3D11::Dispatch(UINT x, UINT y, UINT z)
+{
+    mStats.dispatches++;
+    mCtx->Dispatch(x, y, z);
+}
+
+} // namespace king::render::d3d11
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <cstdint>
+
+namespace king::render::d3d11
+{
+
+// Everything a draw needs besides its buffers and resources: built once per material (or per
+// pass) and bound with a single StateCacheD3D11::SetPipeline(). Borrowed pointers; the owners
+// (shader programs, the render device, the passes) outlive every pipeline built from them.
+// Blend factor is always 0 with a full sample mask and the stencil ref is 0, as everywhere else.
+struct PipelineStateD3D11
+{
+    ID3D11InputLayout* layout = nullptr;
+    ID3D11VertexShader* vs = nullptr;
+    ID3D11GeometryShader* gs = nullptr;
+    ID3D11PixelShader* ps = nullptr;
+    ID3D11BlendState* blend = nullptr;
+    ID3D11DepthStencilState* dss = nullptr;
+    ID3D11RasterizerState* rs = nullptr;
+    D3D11_PRIMITIVE_TOPOLOGY topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+};
+
+// Thin filter in front of one device context: remembers what it bound and drops calls that
+// would rebind the same state. Batches sorted by program/material then only pay for what
+// actually changes between them.
+//
+// The cache knows only about binds made through it. Begin() forgets everything, so call it
+// whenever a pass takes over a context (after direct binds, ClearState, ExecuteCommandList or
+// FinishCommandList). Binding a render target unbinds any SRV of the same resource behind the
+// cache's back, so callers that do so should also call InvalidateShaderResources().
+class StateCacheD3D11
+{
+public:
+    struct Stats
+    {
+        uint32_t issued = 0;  // binds forwarded to the context
+        uint32_t skipped = 0; // binds dropped as redundant
+        uint32_t draws = 0;   // including indirect ones
+        uint32_t indirectDraws = 0;
+        uint32_t instances = 0; // of direct draws (indirect counts are up to the GPU)
+        uint32_t dispatches = 0;
+
+        Stats& operator+=(const Stats& o)
+        {
+            issued += o.issued;
+            skipped += o.skipped;
+            draws += o.draws;
+            indirectDraws += o.indirectDraws;
+            instances += o.instances;
+            dispatches += o.dispatches;
+            return *this;
+        }
+    };
+
+    static constexpr uint32_t kMaxConstantBuffers = 8;
+    static constexpr uint32_t kMaxShaderResources = 16;
+    static constexpr uint32_t kMaxSamplers = 8;
+    static constexpr uint32_t kMaxVertexBuffers = 2;
+
+    void Begin(ID3D11DeviceContext* ctx);
+    void Invalidate();
+    void InvalidateShaderResources();
+
+    ID3D11DeviceContext* Context() const { return mCtx; }
+
+    void SetPipeline(const PipelineStateD3D11& p);
+
+    void SetInputLayout(ID3D11InputLayout* layout);
+    void SetTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+    void SetVS(ID3D11VertexShader* vs);
+    void SetGS(ID3D11GeometryShader* gs);
+    void SetPS(ID3D11PixelShader* ps);
+    void SetBlendState(ID3D11BlendState* blend);
+    void SetDepthStencilState(ID3D11DepthStencilState* dss);
+    void SetRasterizerState(ID3D11RasterizerState* rs);
+
+    // Slots past the tracked range are forwarded unfiltered.
+    void SetVSConstantBuffer(uint32_t slot, ID3D11Buffer* cb);
+    void SetPSConstantBuffer(uint32_t slot, ID3D11Buffer* cb);
+    void SetPSShaderResources(uint32_t start, uint32_t count, ID3D11ShaderResourceView* const* srvs);
+    void SetPSSampler(uint32_t slot, ID3D11SamplerState* sampler);
+
+    // Rebinds only the sub-range of slots whose buffer/stride/offset changed.
+    void SetVertexBuffers(uint32_t start, uint32_t count, ID3D11Buffer* const* vbs, const UINT* strides, const UINT* offsets);
+    void SetIndexBuffer(ID3D11Buffer* ib, DXGI_FORMAT format, UINT offset);
+
+    // Forwarded as is; they go through the cache only to be counted in Stats.
+    void Draw(UINT vertexCount, UINT startVertex);
+    void DrawInstanced(UINT vertexCount, UINT instanceCount, UINT startVertex, UINT startInstance);
+    void DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance);
+    void DrawInstancedIndirect(ID3D11Buffer* args, UINT offset);
+    void DrawIndexedInstancedIndirect(ID3D11Buffer* args, UINT offset);
+    void Dispatch(UINT x, UINT y, UINT z);
+
+    const Stats& GetStats() const { return mStats; }
+    void ResetStats() { mStats = {}; }
+
+private:
+    struct VertexBinding
+    {
+        ID3D11Buffer* buffer = nullptr;
+        UINT stride = 0;
+        UINT offset = 0;
+    };
+
+    // Fixed-state slots; bit i of mKnown says whether the cached value is what the context holds.
+    enum KnownBit : uint32_t
+    {
+        kLayout = 1u << 0,
+        kTopology = 1u << 1,
+        kVS = 1u << 2,
+        kGS = 1u << 3,
+        kPS = 1u << 4,
+        kBlend = 1u << 5,
+        kDss = 1u << 6,
+        kRs = 1u << 7,
+        kIndexBuffer = 1u << 8,
+    };
+
+    bool Filter(uint32_t bit, bool same);
+
+    ID3D11DeviceContext* mCtx = nullptr;
+    uint32_t mKnown = 0;
+    uint32_t mKnownVsCb = 0;
+    uint32_t mKnownPsCb = 0;
+    uint32_t mKnownSrv = 0;
+    uint32_t mKnownSampler = 0;
+    uint32_t mKnownVb = 0;
+
+    ID3D11InputLayout* mLayout = nullptr;
+    D3D11_PRIMITIVE_TOPOLOGY mTopology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+    ID3D11VertexShader* mVS = nullptr;
+    ID3D11GeometryShader* mGS = nullptr;
+    ID3D11PixelShader* mPS = nullptr;
+    ID3D11BlendState* mBlend = nullptr;
+    ID3D11DepthStencilState* mDss = nullptr;
+    ID3D11RasterizerState* mRs = nullptr;
+
+    ID3D11Buffer* mVsCb[kMaxConstantBuffers]{};
+    ID3D11Buffer* mPsCb[kMaxConstantBuffers]{};
+    ID3D11ShaderResourceView* mSrv[kMaxShaderResources]{};
+    ID3D11SamplerState* mSampler[kMaxSamplers]{};
+    VertexBinding mVb[kMaxVertexBuffers]{};
+
+    ID3D11Buffer* mIb = nullptr;
+    DXGI_FORMAT mIbFormat = DXGI_FORMAT_UNKNOWN;
+    UINT mIbOffset = 0;
+
+    Stats mStats{};
+};
+
+} // namespace king::render::d3d11
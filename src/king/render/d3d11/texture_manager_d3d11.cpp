@@ -1,6 +1,12 @@
 #include "texture_manager_d3d11.h"
 
+#include "../../render/image_wic.h"
+#include "../../thread_config.h"
+
 #include <wincodec.h>
+#include <cstdio>
+#include <cwctype>
+#include <utility>
 #include <vector>
 
 #pragma comment(lib, "windowscodecs.lib")
@@ -25,12 +31,36 @@ size_t TextureManagerD3D11::KeyHash::operator()(const Key& k) const
     return h;
 }
 
+// Packs and cooked DDS files store the UNORM format; sRGB textures get the matching _SRGB
+// format over the same data.
+static DXGI_FORMAT ToSrgbFormat(DXGI_FORMAT f)
+{
+    switch (f)
+    {
+    case DXGI_FORMAT_R8G8B8A8_UNORM: return DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+    case DXGI_FORMAT_B8G8R8A8_UNORM: return DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+    case DXGI_FORMAT_BC1_UNORM: return DXGI_FORMAT_BC1_UNORM_SRGB;
+    case DXGI_FORMAT_BC2_UNORM: return DXGI_FORMAT_BC2_UNORM_SRGB;
+    case DXGI_FORMAT_BC3_UNORM: return DXGI_FORMAT_BC3_UNORM_SRGB;
+    case DXGI_FORMAT_BC7_UNORM: return DXGI_FORMAT_BC7_UNORM_SRGB;
+    default: return f;
+    }
+}
+
+static bool IsDdsPath(const std::wstring& path)
+{
+    if (path.size() < 4)
+        return false;
+    const wchar_t* ext = path.c_str() + path.size() - 4;
+    return ext[0] == L'.' && std::towlower(ext[1]) == L'd' && std::towlower(ext[2]) == L'd' && std::towlower(ext[3]) == L's';
+}
+
 TextureManagerD3D11::~TextureManagerD3D11()
 {
     Shutdown();
 }
 
-bool TextureManagerD3D11::Initialize(ID3D11Device* device)
+bool TextureManagerD3D11::Initialize(ID3D11Device* device, bool asyncLoads)
 {
     Shutdown();
     mDevice = device;
@@ -43,11 +73,129 @@ bool TextureManagerD3D11::Initialize(ID3D11Device* device)
     if (!CreateSolidColor(0, 0, 0, 255, true, &mBlackSRV))
         return false;
 
+    if (asyncLoads)
+    {
+        mLoaderStop = false;
+        const king::ThreadPlacement placement = king::GetThreadConfig().streaming;
+        mLoader = std::thread([this, placement]()
+        {
+            (void)king::ApplyThreadPlacement(placement);
+            LoaderMain();
+        });
+    }
+    return true;
+}
+
+void TextureManagerD3D11::StopLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mLoadMutex);
+        mLoaderStop = true;
+    }
+    mLoadCv.notify_all();
+    if (mLoader.joinable())
+        mLoader.join();
+    mLoadQueue.clear();
+    mLoadDone.clear();
+    mLoadsInFlight = 0;
+}
+
+void TextureManagerD3D11::LoaderMain()
+{
+    // WIC objects are apartment-bound: this thread gets its own MTA and factory.
+    const HRESULT coHr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    IWICImagingFactory* factory = nullptr;
+    (void)CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+
+    for (;;)
+    {
+        LoadResult r{};
+        {
+            std::unique_lock<std::mutex> lock(mLoadMutex);
+            mLoadCv.wait(lock, [&]() { return mLoaderStop || !mLoadQueue.empty(); });
+            if (mLoaderStop)
+                break;
+            r.key = std::move(mLoadQueue.front());
+            mLoadQueue.pop_front();
+        }
+
+        Decode(factory, r);
+
+        std::lock_guard<std::mutex> lock(mLoadMutex);
+        mLoadDone.push_back(std::move(r));
+    }
+
+    if (factory)
+        factory->Release();
+    if (SUCCEEDED(coHr))
+        CoUninitialize();
+}
+
+void TextureManagerD3D11::Decode(void* wicFactory, LoadResult& r)
+{
+    if (IsDdsPath(r.key.path))
+    {
+        r.ok = DecodeDds(r);
+        return;
+    }
+
+    std::vector<uint8_t> rgba;
+    r.ok = LoadWicRgba8(wicFactory, r.key.path, rgba, r.width, r.height);
+    if (!r.ok)
+        return;
+
+    std::vector<MipLevelDesc> levels;
+    GenerateMipChainRgba8(rgba.data(), r.width, r.height, r.key.srgb, r.data, levels);
+    r.format = r.key.srgb ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM;
+    r.mipLevels = (uint32_t)levels.size();
+    r.arraySize = 1;
+    r.subresources.reserve(levels.size());
+    for (const MipLevelDesc& l : levels)
+        r.subresources.push_back({ l.offset, l.width, l.height, l.width * 4u, l.width * l.height * 4u });
+}
+
+bool TextureManagerD3D11::DecodeDds(LoadResult& r)
+{
+    FILE* f = nullptr;
+    if (_wfopen_s(&f, r.key.path.c_str(), L"rb") != 0 || !f)
+        return false;
+    std::fseek(f, 0, SEEK_END);
+    const long size = std::ftell(f);
+    std::fseek(f, 0, SEEK_SET);
+    if (size > 0)
+    {
+        r.data.resize((size_t)size);
+        if (std::fread(r.data.data(), 1, r.data.size(), f) != r.data.size())
+            r.data.clear();
+    }
+    std::fclose(f);
+
+    DdsImage img{};
+    std::string err;
+    if (!ParseDds(r.data.data(), r.data.size(), img, &err))
+    {
+        std::printf("TextureManagerD3D11: '%ls': %s\n", r.key.path.c_str(), err.c_str());
+        r.data.clear();
+        return false;
+    }
+
+    // Keep the whole file; subresource offsets skip the header.
+    const size_t base = (size_t)(img.data - r.data.data());
+    r.format = r.key.srgb ? ToSrgbFormat(img.format) : img.format;
+    r.width = img.width;
+    r.height = img.height;
+    r.mipLevels = img.mipLevels;
+    r.arraySize = img.arraySize;
+    r.subresources = std::move(img.subresources);
+    for (DdsSubresource& s : r.subresources)
+        s.offset += base;
     return true;
 }
 
 void TextureManagerD3D11::Shutdown()
 {
+    StopLoader();
+
     for (auto& kv : mCache)
     {
         IUnknown* p = (IUnknown*)kv.second;
@@ -55,6 +203,15 @@ void TextureManagerD3D11::Shutdown()
     }
     mCache.clear();
 
+    for (auto& kv : mStreamed)
+    {
+        IUnknown* p = (IUnknown*)kv.second.srv;
+        SafeRelease(p);
+    }
+    mStreamed.clear();
+    mStreamPending.clear();
+    mGpuMemory = {};
+
     IUnknown* tmp = nullptr;
 
     tmp = (IUnknown*)mWhiteSRV;
@@ -115,6 +272,8 @@ ID3D11ShaderResourceView* TextureManagerD3D11::CreateTextureFromRgba8(const uint
 
     ID3D11ShaderResourceView* srv = nullptr;
     hr = mDevice->CreateShaderResourceView(tex, nullptr, &srv);
+    if (SUCCEEDED(hr))
+        mGpuMemory.Add(tex);
     tex->Release();
 
     if (FAILED(hr))
@@ -123,118 +282,221 @@ ID3D11ShaderResourceView* TextureManagerD3D11::CreateTextureFromRgba8(const uint
     return srv;
 }
 
-bool TextureManagerD3D11::LoadWicRgba8(const std::wstring& path, std::vector<uint8_t>& outRgba, uint32_t& outW, uint32_t& outH)
+ID3D11ShaderResourceView* TextureManagerD3D11::CreateTextureFromLoad(const LoadResult& r)
 {
-    outRgba.clear();
-    outW = 0;
-    outH = 0;
+    if (!mDevice || !r.ok || r.subresources.empty())
+        return nullptr;
 
-    if (!mWicFactory)
+    std::vector<D3D11_SUBRESOURCE_DATA> init(r.subresources.size());
+    for (size_t i = 0; i < r.subresources.size(); ++i)
     {
-        IWICImagingFactory* factory = nullptr;
-        HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
-        if (FAILED(hr) || !factory)
-            return false;
-        mWicFactory = factory;
+        init[i].pSysMem = r.data.data() + r.subresources[i].offset;
+        init[i].SysMemPitch = r.subresources[i].rowPitch;
+        init[i].SysMemSlicePitch = r.subresources[i].slicePitch;
     }
 
-    IWICImagingFactory* factory = (IWICImagingFactory*)mWicFactory;
+    D3D11_TEXTURE2D_DESC td{};
+    td.Width = r.width;
+    td.Height = r.height;
+    td.MipLevels = r.mipLevels;
+    td.ArraySize = r.arraySize;
+    td.Format = r.format;
+    td.SampleDesc.Count = 1;
+    td.Usage = D3D11_USAGE_IMMUTABLE;
+    td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 
-    IWICBitmapDecoder* decoder = nullptr;
-    HRESULT hr = factory->CreateDecoderFromFilename(path.c_str(), nullptr, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder);
-    if (FAILED(hr) || !decoder)
-        return false;
+    ID3D11Texture2D* tex = nullptr;
+    if (FAILED(mDevice->CreateTexture2D(&td, init.data(), &tex)))
+    {
+        std::printf("TextureManagerD3D11: CreateTexture2D failed for '%ls' (format %u, %ux%u)\n",
+            r.key.path.c_str(), (unsigned)r.format, r.width, r.height);
+        return nullptr;
+    }
+
+    ID3D11ShaderResourceView* srv = nullptr;
+    const HRESULT hr = mDevice->CreateShaderResourceView(tex, nullptr, &srv);
+    if (SUCCEEDED(hr))
+        mGpuMemory.Add(tex);
+    tex->Release();
+    return SUCCEEDED(hr) ? srv : nullptr;
+}
 
-    IWICBitmapFrameDecode* frame = nullptr;
-    hr = decoder->GetFrame(0, &frame);
-    if (FAILED(hr) || !frame)
+ID3D11ShaderResourceView* TextureManagerD3D11::GetOrLoad2D(const std::wstring& path, bool srgb, ID3D11ShaderResourceView* fallback)
+{
+    if (!fallback)
+        fallback = mWhiteSRV;
+    if (path.empty())
+        return mWhiteSRV;
+
+    Key k{};
+    k.path = path;
+    k.srgb = srgb;
+
+    auto it = mCache.find(k);
+    if (it != mCache.end())
+        return it->second ? it->second : fallback;
+
+    if (mLoader.joinable())
     {
-        decoder->Release();
-        return false;
+        mCache.emplace(k, nullptr);
+        std::lock_guard<std::mutex> lock(mLoadMutex);
+        mLoadQueue.push_back(k);
+        mLoadsInFlight++;
+        mLoadCv.notify_one();
+        return fallback;
     }
 
-    UINT w = 0, h = 0;
-    frame->GetSize(&w, &h);
-    if (w == 0 || h == 0)
+    if (!mWicFactory)
     {
-        frame->Release();
-        decoder->Release();
-        return false;
+        IWICImagingFactory* factory = nullptr;
+        HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+        if (SUCCEEDED(hr))
+            mWicFactory = factory;
     }
 
-    IWICFormatConverter* conv = nullptr;
-    hr = factory->CreateFormatConverter(&conv);
-    if (FAILED(hr) || !conv)
+    LoadResult r{};
+    r.key = k;
+    Decode(mWicFactory, r);
+    ID3D11ShaderResourceView* srv = CreateTextureFromLoad(r);
+    if (!srv)
     {
-        frame->Release();
-        decoder->Release();
-        return false;
+        // Cache negative result as fallback to avoid spamming WIC.
+        srv = mWhiteSRV;
+        if (srv)
+            srv->AddRef();
     }
+    mCache.emplace(k, srv);
+    return srv;
+}
 
-    hr = conv->Initialize(frame, GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom);
-    if (FAILED(hr))
+void TextureManagerD3D11::Update(AssetStreamer* streamer, StreamBudget& budget)
+{
+    // Decoded file textures, oldest first; whatever does not fit waits for the next frame.
+    for (;;)
     {
-        conv->Release();
-        frame->Release();
-        decoder->Release();
-        return false;
+        LoadResult r{};
+        {
+            std::lock_guard<std::mutex> lock(mLoadMutex);
+            if (mLoadDone.empty() || !budget.Take(mLoadDone.front().data.size()))
+                break;
+            r = std::move(mLoadDone.front());
+            mLoadDone.pop_front();
+        }
+        mLoadsInFlight--;
+
+        ID3D11ShaderResourceView* srv = CreateTextureFromLoad(r);
+        if (!srv)
+        {
+            if (!r.ok)
+                std::printf("TextureManagerD3D11: failed to load '%ls'\n", r.key.path.c_str());
+            srv = mWhiteSRV;
+            if (srv)
+                srv->AddRef();
+        }
+        auto it = mCache.find(r.key);
+        if (it != mCache.end() && !it->second)
+            it->second = srv;
+        else if (srv)
+            srv->Release();
+        mGeneration++;
     }
 
-    outRgba.resize((size_t)w * (size_t)h * 4u);
-    hr = conv->CopyPixels(nullptr, w * 4u, (UINT)outRgba.size(), outRgba.data());
+    if (streamer)
+        UpdatePackStreams(*streamer, budget);
+}
 
-    conv->Release();
-    frame->Release();
-    decoder->Release();
+ID3D11ShaderResourceView* TextureManagerD3D11::CreateTextureFromPack(const AssetRef& ref, bool srgb)
+{
+    PackTextureView view{};
+    if (!mDevice || !ref || !ReadPackTexture(*ref.pack, *ref.entry, view))
+        return nullptr;
 
-    if (FAILED(hr))
+    const PackTextureHeader& h = *view.header;
+    const uint32_t subresources = h.mipLevels * h.arraySize;
+    D3D11_SUBRESOURCE_DATA init[16 * 6]{};
+    if (subresources > (uint32_t)(sizeof(init) / sizeof(init[0])))
+        return nullptr;
+    for (uint32_t i = 0; i < subresources; ++i)
     {
-        outRgba.clear();
-        return false;
+        init[i].pSysMem = view.blob + view.mips[i].offset;
+        init[i].SysMemPitch = view.mips[i].rowPitch;
+        init[i].SysMemSlicePitch = view.mips[i].slicePitch;
     }
 
-    outW = (uint32_t)w;
-    outH = (uint32_t)h;
-    return true;
+    D3D11_TEXTURE2D_DESC td{};
+    td.Width = h.width;
+    td.Height = h.height;
+    td.MipLevels = h.mipLevels;
+    td.ArraySize = h.arraySize;
+    td.Format = srgb ? ToSrgbFormat((DXGI_FORMAT)h.format) : (DXGI_FORMAT)h.format;
+    td.SampleDesc.Count = 1;
+    td.Usage = D3D11_USAGE_IMMUTABLE;
+    td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    ID3D11Texture2D* tex = nullptr;
+    if (FAILED(mDevice->CreateTexture2D(&td, init, &tex)))
+    {
+        std::printf("TextureManagerD3D11: CreateTexture2D failed for pack texture '%s' (format %u, %ux%u)\n",
+            ref.pack->Name(*ref.entry), h.format, h.width, h.height);
+        return nullptr;
+    }
+
+    ID3D11ShaderResourceView* srv = nullptr;
+    const HRESULT hr = mDevice->CreateShaderResourceView(tex, nullptr, &srv);
+    if (SUCCEEDED(hr))
+        mGpuMemory.Add(tex);
+    tex->Release();
+    return SUCCEEDED(hr) ? srv : nullptr;
 }
 
-ID3D11ShaderResourceView* TextureManagerD3D11::GetOrLoad2D(const std::wstring& path, bool srgb)
+ID3D11ShaderResourceView* TextureManagerD3D11::GetOrStream2D(const AssetRegistry& assets, const std::string& assetPath, bool srgb,
+    ID3D11ShaderResourceView* fallback)
 {
-    if (path.empty())
-        return srgb ? mWhiteSRV : mWhiteSRV;
+    if (assetPath.empty())
+        return nullptr;
 
-    Key k{};
-    k.path = path;
-    k.srgb = srgb;
+    const uint64_t key = (AssetPathHash(assetPath) << 1) | (srgb ? 1u : 0u);
+    auto it = mStreamed.find(key);
+    if (it != mStreamed.end())
+        return it->second.srv ? it->second.srv : fallback;
 
-    auto it = mCache.find(k);
-    if (it != mCache.end())
-        return it->second;
+    const AssetRef ref = assets.Resolve(assetPath, PackAssetType::Texture);
+    if (!ref)
+        return nullptr;
 
-    std::vector<uint8_t> rgba;
-    uint32_t w = 0, h = 0;
-    if (!LoadWicRgba8(path, rgba, w, h))
-    {
-        // Cache negative result as fallback to avoid spamming WIC.
-        ID3D11ShaderResourceView* fallback = mWhiteSRV;
-        if (fallback)
-            fallback->AddRef();
-        mCache.emplace(k, fallback);
-        return fallback;
-    }
+    Streamed st{};
+    st.ref = ref;
+    st.srgb = srgb;
+    mStreamed.emplace(key, st);
+    mStreamPending.push_back(key);
+    return fallback;
+}
 
-    ID3D11ShaderResourceView* srv = CreateTextureFromRgba8(rgba.data(), w, h, srgb);
-    if (!srv)
+void TextureManagerD3D11::UpdatePackStreams(AssetStreamer& streamer, StreamBudget& budget)
+{
+    // Textures that do not fit keep their place; smaller ones behind them may still go.
+    size_t keep = 0;
+    for (size_t i = 0; i < mStreamPending.size(); ++i)
     {
-        ID3D11ShaderResourceView* fallback = mWhiteSRV;
-        if (fallback)
-            fallback->AddRef();
-        mCache.emplace(k, fallback);
-        return fallback;
+        const uint64_t key = mStreamPending[i];
+        Streamed& st = mStreamed[key];
+        if (!streamer.Prefetch(st.ref) || !budget.Take(st.ref.entry->size))
+        {
+            mStreamPending[keep++] = key;
+            continue;
+        }
+
+        st.srv = CreateTextureFromPack(st.ref, st.srgb);
+        if (!st.srv)
+        {
+            // Broken entry: settle on the fallback for good.
+            st.srv = mWhiteSRV;
+            if (st.srv)
+                st.srv->AddRef();
+        }
+        mGeneration++;
     }
-
-    mCache.emplace(k, srv);
-    return srv;
+    mStreamPending.resize(keep);
 }
 
 } // namespace king::render::d3d11
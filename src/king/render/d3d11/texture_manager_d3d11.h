@@ -1,12 +1,27 @@
 #pragma once
 
+#include "../../assets/asset_streamer.h"
+#include "../../render/dds.h"
+#include "../../render/texture_mips.h"
+#include "gpu_memory_d3d11.h"
+
 #include <d3d11.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 namespace king::render::d3d11
 {
 
+// File textures decode (WIC) and build their mip chain on a loader thread, or, for .dds files
+// (BC1/BC3/BC4/BC5/BC7 from TextureCook), are read with their own mips and format as is. The
+// caller gets its fallback until the finished texture is created in Update, within the frame's
+// StreamBudget.
+// Generation() moves whenever a texture lands, so holders of SRVs know to look them up again.
 class TextureManagerD3D11
 {
 public:
@@ -16,11 +31,29 @@ public:
     TextureManagerD3D11(const TextureManagerD3D11&) = delete;
     TextureManagerD3D11& operator=(const TextureManagerD3D11&) = delete;
 
-    bool Initialize(ID3D11Device* device);
+    // asyncLoads = false decodes on the calling thread inside GetOrLoad2D (tools, captures).
+    bool Initialize(ID3D11Device* device, bool asyncLoads = true);
     void Shutdown();
 
-    // Returns an SRV for the requested texture path. If loading fails, returns a fallback.
-    ID3D11ShaderResourceView* GetOrLoad2D(const std::wstring& path, bool srgb);
+    // Returns an SRV for the requested texture path: `fallback` (White() if null) while it is
+    // loading, and for good if loading fails.
+    ID3D11ShaderResourceView* GetOrLoad2D(const std::wstring& path, bool srgb, ID3D11ShaderResourceView* fallback = nullptr);
+
+    // Pack textures, by asset path (as written in PbrMaterial::textures). Returns nullptr if no
+    // mounted pack has the path, otherwise the texture, or `fallback` until it has streamed in.
+    ID3D11ShaderResourceView* GetOrStream2D(const AssetRegistry& assets, const std::string& assetPath, bool srgb,
+        ID3D11ShaderResourceView* fallback);
+
+    // Once per frame: creates decoded file textures and resident pack textures (streamer may be
+    // null without packs), within the frame's budget.
+    void Update(AssetStreamer* streamer, StreamBudget& budget);
+    size_t PendingLoads() const { return mLoadsInFlight + mStreamPending.size(); }
+
+    // Bumped whenever a loaded texture replaces its fallback.
+    uint32_t Generation() const { return mGeneration; }
+
+    // Every texture created so far (fallbacks included), tallied at creation.
+    const GpuMemoryD3D11& GpuMemory() const { return mGpuMemory; }
 
     // Common fallbacks.
     ID3D11ShaderResourceView* White() const { return mWhiteSRV; }
@@ -40,9 +73,30 @@ private:
         size_t operator()(const Key& k) const;
     };
 
+    // Decoded file texture, waiting for Update: a generated RGBA8 chain, or a DDS file's bytes
+    // with its subresources pointing past the header.
+    struct LoadResult
+    {
+        Key key;
+        bool ok = false;
+        DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t mipLevels = 0;
+        uint32_t arraySize = 0;
+        std::vector<uint8_t> data;
+        std::vector<DdsSubresource> subresources; // offsets into data
+    };
+
     bool CreateSolidColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a, bool srgb, ID3D11ShaderResourceView** outSrv);
-    bool LoadWicRgba8(const std::wstring& path, std::vector<uint8_t>& outRgba, uint32_t& outW, uint32_t& outH);
+    static void Decode(void* wicFactory, LoadResult& r);
+    static bool DecodeDds(LoadResult& r);
     ID3D11ShaderResourceView* CreateTextureFromRgba8(const uint8_t* rgba, uint32_t w, uint32_t h, bool srgb);
+    ID3D11ShaderResourceView* CreateTextureFromLoad(const LoadResult& r);
+    ID3D11ShaderResourceView* CreateTextureFromPack(const AssetRef& ref, bool srgb);
+    void UpdatePackStreams(AssetStreamer& streamer, StreamBudget& budget);
+    void LoaderMain();
+    void StopLoader();
 
 private:
     ID3D11Device* mDevice = nullptr;
@@ -51,9 +105,32 @@ private:
     ID3D11ShaderResourceView* mWhiteSRV = nullptr;
     ID3D11ShaderResourceView* mBlackSRV = nullptr;
 
+    // File textures; null while loading (GetOrLoad2D returns the caller's fallback then).
     std::unordered_map<Key, ID3D11ShaderResourceView*, KeyHash> mCache;
 
-    // WIC factory (created lazily on first decode).
+    // Loader thread: mLoadQueue in, mLoadDone out (both under mLoadMutex).
+    std::thread mLoader;
+    std::mutex mLoadMutex;
+    std::condition_variable mLoadCv;
+    std::deque<Key> mLoadQueue;
+    std::deque<LoadResult> mLoadDone;
+    bool mLoaderStop = false;
+    size_t mLoadsInFlight = 0; // queued + decoding + done, not yet created
+
+    // Pack textures, keyed by (AssetPathHash << 1) | srgb; srv is null while pending.
+    struct Streamed
+    {
+        AssetRef ref;
+        bool srgb = false;
+        ID3D11ShaderResourceView* srv = nullptr;
+    };
+    std::unordered_map<uint64_t, Streamed> mStreamed;
+    std::vector<uint64_t> mStreamPending; // request order
+    uint32_t mGeneration = 0;
+    GpuMemoryD3D11 mGpuMemory{};
+
+    // WIC factory for synchronous loads (created lazily on first decode); the loader thread
+    // has its own.
     void* mWicFactory = nullptr;
 };
 
@@ -0,0 +1,314 @@
+#include "dds.h"
+
+#include <cstring>
+
+namespace king
+{
+
+namespace
+{
+
+constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+{
+    return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+}
+
+constexpr uint32_t kDdsMagic = MakeFourCC('D', 'D', 'S', ' ');
+
+// DDS_HEADER / DDS_PIXELFORMAT / DDS_HEADER_DXT10 as laid out on disk.
+struct DdsPixelFormat
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t rMask;
+    uint32_t gMask;
+    uint32_t bMask;
+    uint32_t aMask;
+};
+
+struct DdsHeader
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    DdsPixelFormat pf;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+};
+static_assert(sizeof(DdsHeader) == 124, "DdsHeader layout");
+
+struct DdsHeaderDx10
+{
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+static_assert(sizeof(DdsHeaderDx10) == 20, "DdsHeaderDx10 layout");
+
+constexpr uint32_t kDdsdCaps = 0x1;
+constexpr uint32_t kDdsdHeight = 0x2;
+constexpr uint32_t kDdsdWidth = 0x4;
+constexpr uint32_t kDdsdPitch = 0x8;
+constexpr uint32_t kDdsdPixelFormat = 0x1000;
+constexpr uint32_t kDdsdMipMapCount = 0x20000;
+constexpr uint32_t kDdsdLinearSize = 0x80000;
+
+constexpr uint32_t kDdpfAlphaPixels = 0x1;
+constexpr uint32_t kDdpfFourCC = 0x4;
+constexpr uint32_t kDdpfRgb = 0x40;
+
+constexpr uint32_t kDdsCapsComplex = 0x8;
+constexpr uint32_t kDdsCapsTexture = 0x1000;
+constexpr uint32_t kDdsCapsMipMap = 0x400000;
+constexpr uint32_t kDdsCaps2Cubemap = 0x200;
+constexpr uint32_t kDdsCaps2Volume = 0x200000;
+
+constexpr uint32_t kDx10DimensionTexture2D = 3;
+constexpr uint32_t kDx10MiscTextureCube = 0x4;
+
+bool Fail(std::string* outError, const char* msg)
+{
+    if (outError)
+        *outError = msg;
+    return false;
+}
+
+DXGI_FORMAT FormatFromLegacy(const DdsPixelFormat& pf)
+{
+    if (pf.flags & kDdpfFourCC)
+    {
+        switch (pf.fourCC)
+        {
+        case MakeFourCC('D', 'X', 'T', '1'): return DXGI_FORMAT_BC1_UNORM;
+        case MakeFourCC('D', 'X', 'T', '2'):
+        case MakeFourCC('D', 'X', 'T', '3'): return DXGI_FORMAT_BC2_UNORM;
+        case MakeFourCC('D', 'X', 'T', '4'):
+        case MakeFourCC('D', 'X', 'T', '5'): return DXGI_FORMAT_BC3_UNORM;
+        case MakeFourCC('A', 'T', 'I', '1'):
+        case MakeFourCC('B', 'C', '4', 'U'): return DXGI_FORMAT_BC4_UNORM;
+        case MakeFourCC('A', 'T', 'I', '2'):
+        case MakeFourCC('B', 'C', '5', 'U'): return DXGI_FORMAT_BC5_UNORM;
+        default: return DXGI_FORMAT_UNKNOWN;
+        }
+    }
+
+    if ((pf.flags & kDdpfRgb) && (pf.flags & kDdpfAlphaPixels) && pf.rgbBitCount == 32 && pf.aMask == 0xff000000u)
+    {
+        if (pf.rMask == 0x000000ffu && pf.gMask == 0x0000ff00u && pf.bMask == 0x00ff0000u)
+            return DXGI_FORMAT_R8G8B8A8_UNORM;
+        if (pf.rMask == 0x00ff0000u && pf.gMask == 0x0000ff00u && pf.bMask == 0x000000ffu)
+            return DXGI_FORMAT_B8G8R8A8_UNORM;
+    }
+    return DXGI_FORMAT_UNKNOWN;
+}
+
+} // namespace
+
+uint32_t BlockCompressedBytes(DXGI_FORMAT format)
+{
+    switch (format)
+    {
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC1_UNORM_SRGB:
+    case DXGI_FORMAT_BC4_UNORM:
+        return 8;
+    case DXGI_FORMAT_BC2_UNORM:
+    case DXGI_FORMAT_BC2_UNORM_SRGB:
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC3_UNORM_SRGB:
+    case DXGI_FORMAT_BC5_UNORM:
+    case DXGI_FORMAT_BC7_UNORM:
+    case DXGI_FORMAT_BC7_UNORM_SRGB:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+uint32_t UncompressedTexelBytes(DXGI_FORMAT format)
+{
+    switch (format)
+    {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+        return 4;
+    case DXGI_FORMAT_R8G8_UNORM:
+        return 2;
+    case DXGI_FORMAT_R8_UNORM:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+bool ComputeSurfacePitch(DXGI_FORMAT format, uint32_t width, uint32_t height, uint32_t& rowPitch, uint32_t& slicePitch)
+{
+    if (const uint32_t block = BlockCompressedBytes(format))
+    {
+        const uint32_t bw = (width + 3u) / 4u;
+        const uint32_t bh = (height + 3u) / 4u;
+        rowPitch = (bw > 0 ? bw : 1u) * block;
+        slicePitch = rowPitch * (bh > 0 ? bh : 1u);
+        return true;
+    }
+    if (const uint32_t texel = UncompressedTexelBytes(format))
+    {
+        rowPitch = width * texel;
+        slicePitch = rowPitch * height;
+        return true;
+    }
+    rowPitch = 0;
+    slicePitch = 0;
+    return false;
+}
+
+bool ParseDds(const uint8_t* file, size_t size, DdsImage& out, std::string* outError)
+{
+    out = DdsImage{};
+    uint32_t magic = 0;
+    if (!file || size < sizeof(magic) + sizeof(DdsHeader))
+        return Fail(outError, "file too small");
+    std::memcpy(&magic, file, sizeof(magic));
+    if (magic != kDdsMagic)
+        return Fail(outError, "bad magic");
+
+    DdsHeader h{};
+    std::memcpy(&h, file + sizeof(magic), sizeof(h));
+    if (h.size != sizeof(DdsHeader) || h.pf.size != sizeof(DdsPixelFormat))
+        return Fail(outError, "bad header size");
+    if (h.caps2 & (kDdsCaps2Cubemap | kDdsCaps2Volume))
+        return Fail(outError, "cube maps and volume textures are not supported");
+
+    size_t at = sizeof(magic) + sizeof(DdsHeader);
+    DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+    uint32_t arraySize = 1;
+    if ((h.pf.flags & kDdpfFourCC) && h.pf.fourCC == MakeFourCC('D', 'X', '1', '0'))
+    {
+        DdsHeaderDx10 dx10{};
+        if (size < at + sizeof(dx10))
+            return Fail(outError, "truncated DX10 header");
+        std::memcpy(&dx10, file + at, sizeof(dx10));
+        at += sizeof(dx10);
+        if (dx10.resourceDimension != kDx10DimensionTexture2D)
+            return Fail(outError, "only 2D textures are supported");
+        if (dx10.miscFlag & kDx10MiscTextureCube)
+            return Fail(outError, "cube maps and volume textures are not supported");
+        format = (DXGI_FORMAT)dx10.dxgiFormat;
+        arraySize = dx10.arraySize;
+    }
+    else
+    {
+        format = FormatFromLegacy(h.pf);
+    }
+
+    if (BlockCompressedBytes(format) == 0 && UncompressedTexelBytes(format) == 0)
+        return Fail(outError, "unsupported pixel format");
+
+    const uint32_t mipLevels = ((h.flags & kDdsdMipMapCount) && h.mipMapCount > 0) ? h.mipMapCount : 1u;
+    if (h.width == 0 || h.height == 0 || mipLevels > 16 || arraySize == 0 || arraySize > 2048)
+        return Fail(outError, "bad dimensions");
+
+    out.format = format;
+    out.width = h.width;
+    out.height = h.height;
+    out.mipLevels = mipLevels;
+    out.arraySize = arraySize;
+    out.data = file + at;
+    out.subresources.reserve((size_t)mipLevels * arraySize);
+
+    size_t offset = 0;
+    for (uint32_t a = 0; a < arraySize; ++a)
+    {
+        uint32_t w = h.width;
+        uint32_t hh = h.height;
+        for (uint32_t m = 0; m < mipLevels; ++m)
+        {
+            DdsSubresource s{};
+            s.offset = offset;
+            s.width = w;
+            s.height = hh;
+            ComputeSurfacePitch(format, w, hh, s.rowPitch, s.slicePitch);
+            offset += s.slicePitch;
+            out.subresources.push_back(s);
+            w = (w > 1) ? w / 2 : 1;
+            hh = (hh > 1) ? hh / 2 : 1;
+        }
+    }
+
+    if (size - at < offset)
+    {
+        out = DdsImage{};
+        return Fail(outError, "truncated pixel data");
+    }
+    return true;
+}
+
+bool WriteDds(std::vector<uint8_t>& out, DXGI_FORMAT format, uint32_t width, uint32_t height,
+    uint32_t mipLevels, uint32_t arraySize, const void* const* data, const uint32_t* slicePitch)
+{
+    out.clear();
+    uint32_t rowPitch0 = 0, slicePitch0 = 0;
+    if (!data || !slicePitch || width == 0 || height == 0 || mipLevels == 0 || arraySize == 0 ||
+        !ComputeSurfacePitch(format, width, height, rowPitch0, slicePitch0))
+        return false;
+
+    const bool compressed = BlockCompressedBytes(format) != 0;
+    DdsHeader h{};
+    h.size = sizeof(DdsHeader);
+    h.flags = kDdsdCaps | kDdsdHeight | kDdsdWidth | kDdsdPixelFormat | kDdsdMipMapCount |
+        (compressed ? kDdsdLinearSize : kDdsdPitch);
+    h.height = height;
+    h.width = width;
+    h.pitchOrLinearSize = compressed ? slicePitch0 : rowPitch0;
+    h.mipMapCount = mipLevels;
+    h.pf.size = sizeof(DdsPixelFormat);
+    h.pf.flags = kDdpfFourCC;
+    h.pf.fourCC = MakeFourCC('D', 'X', '1', '0');
+    h.caps = kDdsCapsTexture | (mipLevels > 1 ? (kDdsCapsComplex | kDdsCapsMipMap) : 0u);
+
+    DdsHeaderDx10 dx10{};
+    dx10.dxgiFormat = (uint32_t)format;
+    dx10.resourceDimension = kDx10DimensionTexture2D;
+    dx10.arraySize = arraySize;
+
+    const uint32_t subresources = mipLevels * arraySize;
+    size_t total = sizeof(kDdsMagic) + sizeof(h) + sizeof(dx10);
+    for (uint32_t i = 0; i < subresources; ++i)
+        total += slicePitch[i];
+
+    out.resize(total);
+    size_t at = 0;
+    std::memcpy(out.data() + at, &kDdsMagic, sizeof(kDdsMagic));
+    at += sizeof(kDdsMagic);
+    std::memcpy(out.data() + at, &h, sizeof(h));
+    at += sizeof(h);
+    std::memcpy(out.data() + at, &dx10, sizeof(dx10));
+    at += sizeof(dx10);
+    for (uint32_t i = 0; i < subresources; ++i)
+    {
+        if (!data[i])
+        {
+            out.clear();
+            return false;
+        }
+        std::memcpy(out.data() + at, data[i], slicePitch[i]);
+        at += slicePitch[i];
+    }
+    return true;
+}
+
+} // namespace king
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <dxgiformat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace king
+{
+
+// One mip of one array slice, relative to DdsImage::data.
+struct DdsSubresource
+{
+    size_t offset = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t rowPitch = 0;   // bytes per row (per row of 4x4 blocks for BC formats)
+    uint32_t slicePitch = 0; // bytes of the whole level
+};
+
+// 2D textures and texture arrays. Cube maps and volumes are rejected: nothing in the engine
+// samples them yet.
+struct DdsImage
+{
+    DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t mipLevels = 0;
+    uint32_t arraySize = 0;
+    const uint8_t* data = nullptr;           // points into the buffer given to ParseDds
+    std::vector<DdsSubresource> subresources; // mipLevels * arraySize, array slice major
+};
+
+// Parses "DDS " + header (+ DX10 extension). Legacy headers are mapped for DXT1/DXT3/DXT5,
+// ATI1/BC4U, ATI2/BC5U and 32bpp RGBA/BGRA masks; anything else needs the DX10 extension.
+bool ParseDds(const uint8_t* file, size_t size, DdsImage& out, std::string* outError);
+
+// Always writes the DX10 extension, so the format round-trips exactly.
+// data[i] / rowPitch / slicePitch follow DdsImage::subresources.
+bool WriteDds(std::vector<uint8_t>& out, DXGI_FORMAT format, uint32_t width, uint32_t height,
+    uint32_t mipLevels, uint32_t arraySize, const void* const* data, const uint32_t* slicePitch);
+
+// 8 or 16 for the BC formats this engine handles, 0 otherwise.
+uint32_t BlockCompressedBytes(DXGI_FORMAT format);
+// Bytes per texel for the uncompressed 8-bit formats, 0 otherwise.
+uint32_t UncompressedTexelBytes(DXGI_FORMAT format);
+// Pitches of a width x height level; false for formats neither helper above knows.
+bool ComputeSurfacePitch(DXGI_FORMAT format, uint32_t width, uint32_t height, uint32_t& rowPitch, uint32_t& slicePitch);
+
+} // namespace king
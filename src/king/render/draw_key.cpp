@@ -0,0 +1,142 @@
+#include "draw_key.h"
+
+#include "../jobs/job_system.h"
+
+#include <algorithm>
+#include <array>
+
+namespace king
+{
+
+// Pairs per job; below two chunks the sort runs inline.
+static constexpr size_t kRadixChunk = 8192;
+static constexpr uint32_t kRadixPasses = 8;
+
+using DigitCounts = std::array<uint32_t, 256>;
+
+void RadixSortDrawPairs(JobSystem& jobs, FrameVector<DrawSortPair>& pairs, FrameVector<DrawSortPair>& scratch,
+    uint32_t maxParallelism)
+{
+    const size_t count = pairs.size();
+    if (count < 2)
+        return;
+    scratch.resize(count);
+
+    const size_t chunks = (count + kRadixChunk - 1) / kRadixChunk;
+
+    // All-pass histogram in one read, only to find the passes that would leave the order alone.
+    thread_local std::vector<std::array<DigitCounts, kRadixPasses>> tAllCounts;
+    std::vector<std::array<DigitCounts, kRadixPasses>>& allCounts = tAllCounts; // filled on other threads
+    allCounts.assign(chunks, {});
+
+    auto countAll = [&](size_t first, size_t last)
+    {
+        for (size_t c = first; c < last; ++c)
+        {
+            auto& h = allCounts[c];
+            const size_t begin = c * kRadixChunk;
+            const size_t end = std::min(begin + kRadixChunk, count);
+            for (size_t i = begin; i < end; ++i)
+            {
+                const DrawKey k = pairs[i].key;
+                for (uint32_t p = 0; p < kRadixPasses; ++p)
+                    h[p][(k >> (p * 8)) & 0xFFu]++;
+            }
+        }
+    };
+    if (chunks > 1)
+        jobs.ParallelFor(chunks, 1, countAll, maxParallelism);
+    else
+        countAll(0, 1);
+
+    bool needed[kRadixPasses]{};
+    for (uint32_t p = 0; p < kRadixPasses; ++p)
+    {
+        for (uint32_t d = 0; d < 256; ++d)
+        {
+            uint32_t total = 0;
+            for (size_t c = 0; c < chunks; ++c)
+                total += allCounts[c][p][d];
+            if (total != 0)
+            {
+                needed[p] = total != count;
+                break;
+            }
+        }
+    }
+
+    thread_local std::vector<DigitCounts> tOffsets;
+    std::vector<DigitCounts>& offsets = tOffsets;
+    offsets.resize(chunks);
+
+    DrawSortPair* src = pairs.data();
+    DrawSortPair* dst = scratch.data();
+    bool first = true;
+    for (uint32_t p = 0; p < kRadixPasses; ++p)
+    {
+        if (!needed[p])
+            continue;
+        const uint32_t shift = p * 8;
+
+        // Chunk contents change after every scatter, so only the first executed pass (or a
+        // single chunk, which always holds everything) can reuse the up-front counts.
+        auto countPass = [&](size_t firstChunk, size_t lastChunk)
+        {
+            for (size_t c = firstChunk; c < lastChunk; ++c)
+            {
+                DigitCounts& h = offsets[c];
+                h.fill(0);
+                const size_t begin = c * kRadixChunk;
+                const size_t end = std::min(begin + kRadixChunk, count);
+                for (size_t i = begin; i < end; ++i)
+                    h[(src[i].key >> shift) & 0xFFu]++;
+            }
+        };
+        if (first || chunks == 1)
+        {
+            for (size_t c = 0; c < chunks; ++c)
+                offsets[c] = allCounts[c][p];
+        }
+        else
+        {
+            jobs.ParallelFor(chunks, 1, countPass, maxParallelism);
+        }
+        first = false;
+
+        // Exclusive prefix over (digit, chunk): each chunk scatters into its own sub-ranges,
+        // in input order, which keeps the sort stable.
+        uint32_t running = 0;
+        for (uint32_t d = 0; d < 256; ++d)
+        {
+            for (size_t c = 0; c < chunks; ++c)
+            {
+                const uint32_t n = offsets[c][d];
+                offsets[c][d] = running;
+                running += n;
+            }
+        }
+
+        auto scatter = [&](size_t firstChunk, size_t lastChunk)
+        {
+            for (size_t c = firstChunk; c < lastChunk; ++c)
+            {
+                DigitCounts& o = offsets[c];
+                const size_t begin = c * kRadixChunk;
+                const size_t end = std::min(begin + kRadixChunk, count);
+                for (size_t i = begin; i < end; ++i)
+                    dst[o[(src[i].key >> shift) & 0xFFu]++] = src[i];
+            }
+        };
+        if (chunks > 1)
+            jobs.ParallelFor(chunks, 1, scatter, maxParallelism);
+        else
+            scatter(0, 1);
+
+        std::swap(src, dst);
+    }
+
+    if (src != pairs.data())
+        pairs.swap(scratch);
+}
+
+} // namespace king
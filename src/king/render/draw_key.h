@@ -0,0 +1,70 @@
+#pragma once
+
+#include "../memory/frame_arena.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace king
+{
+
+class JobSystem;
+
+// Packed 64-bit draw sort key. Sorting ascending gives the submission order:
+//
+//   opaque:  [63] 0 | [62:56] program | [55:40] material | [39:16] mesh | [15:0] depth (near first)
+//   blended: [63] 1 | [62:47] depth (far first) | [46:40] program | [39:24] material | [23:0] mesh
+//
+// Opaque draws group by state and go front-to-back inside a batch (early-Z); alpha-blended
+// draws come last and are ordered back-to-front, state only breaking depth ties. Fields are
+// truncated to their width, so unrelated meshes/materials may share a group; callers still
+// compare the real state when splitting batches.
+using DrawKey = uint64_t;
+
+struct DrawSortPair
+{
+    DrawKey key = 0;
+    uint32_t index = 0; // caller-defined payload (e.g. an item index)
+    uint32_t pad = 0;
+};
+
+// Monotonic 16-bit bucket for a view depth: the top bits of the float, so precision follows
+// the float exponent (finer near the camera). Negative depths clamp to 0.
+inline uint32_t DrawDepthBucket(float viewDepth)
+{
+    if (!(viewDepth > 0.0f))
+        return 0;
+    uint32_t bits = 0;
+    std::memcpy(&bits, &viewDepth, sizeof(bits));
+    return bits >> 16;
+}
+
+inline DrawKey MakeOpaqueDrawKey(uint32_t program, uint32_t material, uint32_t mesh, float viewDepth)
+{
+    return ((DrawKey)(program & 0x7Fu) << 56)
+        | ((DrawKey)(material & 0xFFFFu) << 40)
+        | ((DrawKey)(mesh & 0xFFFFFFu) << 16)
+        | (DrawKey)DrawDepthBucket(viewDepth);
+}
+
+inline DrawKey MakeBlendedDrawKey(uint32_t program, uint32_t material, uint32_t mesh, float viewDepth)
+{
+    return (1ull << 63)
+        | ((DrawKey)(0xFFFFu - DrawDepthBucket(viewDepth)) << 47)
+        | ((DrawKey)(program & 0x7Fu) << 40)
+        | ((DrawKey)(material & 0xFFFFu) << 24)
+        | (DrawKey)(mesh & 0xFFFFFFu);
+}
+
+inline bool IsBlendedDrawKey(DrawKey key) { return (key >> 63) != 0; }
+
+// Stable LSD radix sort of pairs by key, 8 bits per pass. Passes whose digit is the same for
+// every key are skipped, so keys with constant high fields cost fewer passes. Large inputs
+// split histogram and scatter across job workers (maxParallelism as in ParallelFor).
+// scratch is resized as needed and may be swapped with pairs, so both must share an allocator
+// (e.g. the same frame arena).
+void RadixSortDrawPairs(JobSystem& jobs, FrameVector<DrawSortPair>& pairs, FrameVector<DrawSortPair>& scratch,
+    uint32_t maxParallelism = 0);
+
+} // namespace king
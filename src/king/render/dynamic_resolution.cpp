@@ -0,0 +1,57 @@
+#include "dynamic_resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace king
+{
+
+void DynamicResolution::Reset(float scale)
+{
+    mScale = scale;
+    mSmoothedMs = 0.0f;
+    mCooldown = 0;
+}
+
+float DynamicResolution::Update(const Desc& desc, float gpuFrameMs)
+{
+    const float lo = std::clamp(desc.minScale, kScaleStep, 1.0f);
+    const float hi = std::clamp(desc.maxScale, lo, 1.0f);
+    mScale = std::clamp(mScale, lo, hi);
+    if (gpuFrameMs <= 0.0f || desc.targetMs <= 0.0f)
+        return mScale;
+
+    if (mSmoothedMs <= 0.0f)
+        mSmoothedMs = gpuFrameMs;
+    else
+        mSmoothedMs += (gpuFrameMs - mSmoothedMs) * std::clamp(desc.smoothing, 0.01f, 1.0f);
+
+    if (mCooldown > 0)
+    {
+        --mCooldown;
+        return mScale;
+    }
+
+    const bool over = mSmoothedMs > desc.targetMs;
+    const bool under = mSmoothedMs < desc.targetMs * desc.upThreshold;
+    if (!over && !under)
+        return mScale;
+
+    // Aim for the middle of the band so one adjustment does not land right on its edge.
+    const float aimMs = desc.targetMs * (1.0f + desc.upThreshold) * 0.5f;
+    float next = mScale * std::sqrt(aimMs / mSmoothedMs);
+    next = std::clamp(next, mScale - desc.maxStep, mScale + desc.maxStep);
+    next = over ? std::floor(next / kScaleStep) * kScaleStep : std::ceil(next / kScaleStep) * kScaleStep;
+    next = std::clamp(next, lo, hi);
+
+    if (next != mScale)
+    {
+        // Timings so far belong to the old scale; restart the average from the prediction.
+        mSmoothedMs *= (next * next) / (mScale * mScale);
+        mScale = next;
+        mCooldown = desc.latencyFrames;
+    }
+    return mScale;
+}
+
+} // namespace king
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+namespace king
+{
+
+// Picks a render-resolution scale that holds a GPU frame-time budget.
+//
+// Fed with measured GPU frame times (GpuProfilerD3D11's "Frame" scope, a few frames latent),
+// it keeps an exponential moving average and, when that leaves the band around the target,
+// moves the scale toward the value the pixel-count model predicts (GPU time ~ scale^2). Steps
+// are limited and quantized to kScaleStep, and after each change the controller waits
+// `latencyFrames` before reacting again so it never chases timings of an older scale.
+class DynamicResolution
+{
+public:
+    struct Desc
+    {
+        float targetMs = 16.0f;
+        float minScale = 0.5f;
+        float maxScale = 1.0f;
+        // Grow back only below targetMs * upThreshold (hysteresis against oscillation).
+        float upThreshold = 0.85f;
+        float smoothing = 0.1f;       // EMA weight of a new sample
+        float maxStep = 0.1f;         // largest scale change per adjustment
+        uint32_t latencyFrames = 4;   // profiler latency + one frame
+    };
+
+    static constexpr float kScaleStep = 1.0f / 32.0f;
+
+    // Returns the scale to render the next frame at. gpuFrameMs <= 0 (no timing yet) keeps
+    // the current scale.
+    float Update(const Desc& desc, float gpuFrameMs);
+
+    void Reset(float scale = 1.0f);
+
+    float Scale() const { return mScale; }
+    float SmoothedMs() const { return mSmoothedMs; }
+
+private:
+    float mScale = 1.0f;
+    float mSmoothedMs = 0.0f;
+    uint32_t mCooldown = 0;
+};
+
+} // namespace king
@@ -0,0 +1,78 @@
+#include "image_wic.h"
+
+#include <wincodec.h>
+
+#pragma comment(lib, "windowscodecs.lib")
+
+namespace king
+{
+
+bool LoadWicRgba8(void* wicFactory, const std::wstring& path, std::vector<uint8_t>& outRgba, uint32_t& outW, uint32_t& outH)
+{
+    outRgba.clear();
+    outW = 0;
+    outH = 0;
+
+    IWICImagingFactory* factory = (IWICImagingFactory*)wicFactory;
+    if (!factory)
+        return false;
+
+    IWICBitmapDecoder* decoder = nullptr;
+    HRESULT hr = factory->CreateDecoderFromFilename(path.c_str(), nullptr, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder);
+    if (FAILED(hr) || !decoder)
+        return false;
+
+    IWICBitmapFrameDecode* frame = nullptr;
+    hr = decoder->GetFrame(0, &frame);
+    if (FAILED(hr) || !frame)
+    {
+        decoder->Release();
+        return false;
+    }
+
+    UINT w = 0, h = 0;
+    frame->GetSize(&w, &h);
+    if (w == 0 || h == 0)
+    {
+        frame->Release();
+        decoder->Release();
+        return false;
+    }
+
+    IWICFormatConverter* conv = nullptr;
+    hr = factory->CreateFormatConverter(&conv);
+    if (FAILED(hr) || !conv)
+    {
+        frame->Release();
+        decoder->Release();
+        return false;
+    }
+
+    hr = conv->Initialize(frame, GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom);
+    if (FAILED(hr))
+    {
+        conv->Release();
+        frame->Release();
+        decoder->Release();
+        return false;
+    }
+
+    outRgba.resize((size_t)w * (size_t)h * 4u);
+    hr = conv->CopyPixels(nullptr, w * 4u, (UINT)outRgba.size(), outRgba.data());
+
+    conv->Release();
+    frame->Release();
+    decoder->Release();
+
+    if (FAILED(hr))
+    {
+        outRgba.clear();
+        return false;
+    }
+
+    outW = (uint32_t)w;
+    outH = (uint32_t)h;
+    return true;
+}
+
+} // namespace king
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace king
+{
+
+// Decodes any WIC-readable image (PNG, JPEG, BMP, TIFF, ...) to tightly packed RGBA8.
+// wicFactory is an IWICImagingFactory* created on the calling thread's apartment.
+bool LoadWicRgba8(void* wicFactory, const std::wstring& path, std::vector<uint8_t>& outRgba, uint32_t& outW, uint32_t& outH);
+
+} // namespace king
@@ -0,0 +1,172 @@
+#include "light_clusters.h"
+
+#include "../jobs/job_system.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+
+namespace king
+{
+
+void LightClusters::BuildUnclustered(size_t lightCount)
+{
+    mTilesX = 1;
+    mTilesY = 1;
+    mSlices = 1;
+    mSliceScale = 0.0f;
+    mSliceBias = 0.0f;
+    mDropped = 0;
+
+    mRanges.assign(2, 0);
+    mRanges[1] = (uint32_t)lightCount;
+    mIndices.resize(lightCount);
+    for (size_t i = 0; i < lightCount; ++i)
+        mIndices[i] = (uint32_t)i;
+}
+
+void LightClusters::Build(JobSystem& jobs, const Desc& desc, const Mat4x4& view, const Mat4x4& proj, float nearZ, float farZ,
+    const Float4* lightSpheres, size_t lightCount, uint32_t maxParallelism)
+{
+    mTilesX = std::max(1u, desc.tilesX);
+    mTilesY = std::max(1u, desc.tilesY);
+    mSlices = std::max(1u, desc.slices);
+    mDropped = 0;
+
+    nearZ = std::max(nearZ, 1e-3f);
+    farZ = std::max(farZ, nearZ * 1.001f);
+    const float logRange = std::log(farZ / nearZ);
+    mSliceScale = (float)mSlices / logRange;
+    mSliceBias = -(float)mSlices * std::log(nearZ) / logRange;
+
+    auto sliceOf = [&](float z)
+    {
+        const float s = std::floor(std::log(z) * mSliceScale + mSliceBias);
+        return (uint32_t)std::clamp(s, 0.0f, (float)(mSlices - 1));
+    };
+    auto tileOf = [](float t, uint32_t tiles)
+    {
+        return (uint32_t)std::clamp(std::floor(t * (float)tiles), 0.0f, (float)(tiles - 1));
+    };
+
+    const float* v = view.m;
+    const float* p = proj.m;
+
+    // Cluster bounds per light: slices from the view-depth interval, tiles from the projected
+    // corners of the view-space AABB (depth clamped to the near plane, which only widens it).
+    mRects.clear();
+    for (size_t i = 0; i < lightCount; ++i)
+    {
+        const Float4& s = lightSpheres[i];
+        const float r = s.w;
+        if (!(r > 0.0f))
+            continue;
+
+        const float vx = s.x * v[0] + s.y * v[4] + s.z * v[8] + v[12];
+        const float vy = s.x * v[1] + s.y * v[5] + s.z * v[9] + v[13];
+        const float vz = s.x * v[2] + s.y * v[6] + s.z * v[10] + v[14];
+        if (vz + r < nearZ || vz - r > farZ)
+            continue;
+
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        for (int c = 0; c < 8; ++c)
+        {
+            const float x = vx + ((c & 1) ? r : -r);
+            const float y = vy + ((c & 2) ? r : -r);
+            const float z = std::max(vz + ((c & 4) ? r : -r), nearZ);
+            const float cx = x * p[0] + y * p[4] + z * p[8] + p[12];
+            const float cy = x * p[1] + y * p[5] + z * p[9] + p[13];
+            const float cw = x * p[3] + y * p[7] + z * p[11] + p[15];
+            const float invW = 1.0f / std::max(cw, 1e-6f);
+            minX = std::min(minX, cx * invW);
+            maxX = std::max(maxX, cx * invW);
+            minY = std::min(minY, cy * invW);
+            maxY = std::max(maxY, cy * invW);
+        }
+        if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+            continue;
+
+        LightRect rect{};
+        rect.index = (uint32_t)i;
+        rect.x0 = tileOf(minX * 0.5f + 0.5f, mTilesX);
+        rect.x1 = tileOf(maxX * 0.5f + 0.5f, mTilesX);
+        // Tiles count rows from the top of the screen (SV_Position), NDC y points up.
+        rect.y0 = tileOf(0.5f - maxY * 0.5f, mTilesY);
+        rect.y1 = tileOf(0.5f - minY * 0.5f, mTilesY);
+        rect.z0 = sliceOf(std::max(vz - r, nearZ));
+        rect.z1 = sliceOf(std::min(vz + r, farZ));
+        mRects.push_back(rect);
+    }
+
+    const uint32_t tilesPerSlice = mTilesX * mTilesY;
+    mRanges.assign((size_t)ClusterCount() * 2u, 0);
+    mSliceIndices.resize(mSlices);
+
+    // Slices are independent: each job counts, offsets and fills the clusters of its slices.
+    // Offsets are slice-local here and rebased when the slices are concatenated below.
+    std::atomic<size_t> dropped{ 0 };
+    const uint32_t cap = std::max(1u, desc.maxLightsPerCluster);
+    jobs.ParallelFor(mSlices, 1, [&](size_t firstSlice, size_t lastSlice)
+    {
+        size_t localDropped = 0;
+        for (size_t z = firstSlice; z < lastSlice; ++z)
+        {
+            uint32_t* ranges = mRanges.data() + z * tilesPerSlice * 2u;
+            for (const LightRect& lr : mRects)
+            {
+                if (z < lr.z0 || z > lr.z1)
+                    continue;
+                for (uint32_t y = lr.y0; y <= lr.y1; ++y)
+                    for (uint32_t x = lr.x0; x <= lr.x1; ++x)
+                        ranges[(y * mTilesX + x) * 2u + 1u]++;
+            }
+
+            uint32_t total = 0;
+            for (uint32_t c = 0; c < tilesPerSlice; ++c)
+            {
+                uint32_t& count = ranges[c * 2u + 1u];
+                if (count > cap)
+                {
+                    localDropped += count - cap;
+                    count = cap;
+                }
+                ranges[c * 2u] = total;
+                total += count;
+                count = 0; // refilled as the fill cursor
+            }
+
+            std::vector<uint32_t>& out = mSliceIndices[z];
+            out.resize(total);
+            for (const LightRect& lr : mRects)
+            {
+                if (z < lr.z0 || z > lr.z1)
+                    continue;
+                for (uint32_t y = lr.y0; y <= lr.y1; ++y)
+                {
+                    for (uint32_t x = lr.x0; x <= lr.x1; ++x)
+                    {
+                        uint32_t* range = ranges + (y * mTilesX + x) * 2u;
+                        const uint32_t next = (range + 2 < ranges + tilesPerSlice * 2u) ? range[2] : total;
+                        if (range[0] + range[1] < next)
+                            out[range[0] + range[1]++] = lr.index;
+                    }
+                }
+            }
+        }
+        dropped.fetch_add(localDropped, std::memory_order_relaxed);
+    }, maxParallelism);
+    mDropped = dropped.load(std::memory_order_relaxed);
+
+    mIndices.clear();
+    for (uint32_t z = 0; z < mSlices; ++z)
+    {
+        const uint32_t base = (uint32_t)mIndices.size();
+        uint32_t* ranges = mRanges.data() + (size_t)z * tilesPerSlice * 2u;
+        for (uint32_t c = 0; c < tilesPerSlice; ++c)
+            ranges[c * 2u] += base;
+        mIndices.insert(mIndices.end(), mSliceIndices[z].begin(), mSliceIndices[z].end());
+    }
+}
+
+} // namespace king
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "../math/types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace king
+{
+
+class JobSystem;
+
+// CPU light binning for clustered forward shading.
+// The view frustum is split into tilesX x tilesY screen tiles and `slices` depth slices,
+// logarithmic in view depth between nearZ and farZ. Every local light (a world-space sphere:
+// position + range) is added to the index list of each cluster its bounds overlap. Shaders find
+// their cluster from SV_Position and view depth (see SliceScale/SliceBias) and only visit
+// those lights.
+//
+// Layout of the results:
+//   Ranges():  2 uints per cluster (offset into Indices(), count), cluster = (z * tilesY + y) * tilesX + x
+//   Indices(): light indices, in input order within each cluster
+class LightClusters
+{
+public:
+    struct Desc
+    {
+        uint32_t tilesX = 16;
+        uint32_t tilesY = 9;
+        uint32_t slices = 24;
+        // Cap per cluster; extra lights are dropped (and counted in DroppedCount()).
+        uint32_t maxLightsPerCluster = 128;
+    };
+
+    // view/proj use the engine's row-vector convention (clip = pos * view * proj).
+    // A single-cluster grid holding every light is built instead when no real projection is
+    // available (see BuildUnclustered).
+    void Build(JobSystem& jobs, const Desc& desc, const Mat4x4& view, const Mat4x4& proj, float nearZ, float farZ,
+        const Float4* lightSpheres, size_t lightCount, uint32_t maxParallelism = 0);
+
+    // 1x1x1 grid with all lights in the only cluster.
+    void BuildUnclustered(size_t lightCount);
+
+    uint32_t TilesX() const { return mTilesX; }
+    uint32_t TilesY() const { return mTilesY; }
+    uint32_t Slices() const { return mSlices; }
+    uint32_t ClusterCount() const { return mTilesX * mTilesY * mSlices; }
+
+    // slice = floor(log(viewDepth) * SliceScale() + SliceBias()).
+    float SliceScale() const { return mSliceScale; }
+    float SliceBias() const { return mSliceBias; }
+
+    const std::vector<uint32_t>& Ranges() const { return mRanges; }
+    const std::vector<uint32_t>& Indices() const { return mIndices; }
+    size_t DroppedCount() const { return mDropped; }
+
+private:
+    struct LightRect
+    {
+        uint32_t index;
+        uint32_t x0, x1, y0, y1, z0, z1; // inclusive cluster bounds
+    };
+
+    uint32_t mTilesX = 1;
+    uint32_t mTilesY = 1;
+    uint32_t mSlices = 1;
+    float mSliceScale = 0.0f;
+    float mSliceBias = 0.0f;
+
+    std::vector<LightRect> mRects;
+    std::vector<std::vector<uint32_t>> mSliceIndices; // per slice: lists of its clusters, concatenated
+    std::vector<uint32_t> mRanges;
+    std::vector<uint32_t> mIndices;
+    size_t mDropped = 0;
+};
+
+} // namespace king
@@ -50,11 +50,6 @@ static void DeriveIntentFromShaderName(PbrMaterial& m)
         m.shadingModel = MaterialShadingModel::Pbr;
 }
 
-static bool ReadLine(std::ifstream& in, std::string& line)
-{
-    std::getline(in, line);
-    return (bool)in;
-}
 
 static std::string Trim(const std::string& s)
 {
@@ -74,11 +69,25 @@ bool LoadMaterialFile(const char* path, PbrMaterial& outMaterial, std::string* o
         return false;
     }
 
+    std::ostringstream text;
+    text << f.rdbuf();
+    return ParseMaterialText(text.str(), outMaterial, outError);
+}
+
+bool ParseMaterialText(std::string_view text, PbrMaterial& outMaterial, std::string* outError)
+{
     std::string line;
     int lineNo = 0;
 
-    while (ReadLine(f, line))
+    size_t pos = 0;
+    while (pos < text.size())
     {
+        size_t end = text.find('\n', pos);
+        if (end == std::string_view::npos)
+            end = text.size();
+        line.assign(text.substr(pos, end - pos));
+        pos = end + 1;
+
         ++lineNo;
         line = Trim(line);
         if (line.empty()) continue;
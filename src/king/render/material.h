@@ -3,6 +3,7 @@
 #include "../math/types.h"
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 namespace king
@@ -64,4 +65,7 @@ struct PbrMaterial
 //   tex_emissive path
 bool LoadMaterialFile(const char* path, PbrMaterial& outMaterial, std::string* outError);
 
+// Same format from memory (e.g. a material entry in a mounted asset pack).
+bool ParseMaterialText(std::string_view text, PbrMaterial& outMaterial, std::string* outError);
+
 } // namespace king
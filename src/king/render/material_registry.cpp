@@ -0,0 +1,207 @@
+#include "material_registry.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace king
+{
+
+static uint64_t Fnv1a64(const void* data, size_t len, uint64_t seed = 1469598103934665603ull)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t h = seed;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (uint64_t)p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static uint64_t HashU32(uint64_t h, uint32_t v)
+{
+    return Fnv1a64(&v, sizeof(v), h);
+}
+
+static uint64_t HashF32(uint64_t h, float v)
+{
+    uint32_t bits = 0;
+    static_assert(sizeof(bits) == sizeof(v), "float must be 32-bit");
+    std::memcpy(&bits, &v, sizeof(bits));
+    return HashU32(h, bits);
+}
+
+static uint64_t HashString(uint64_t h, const std::string& s)
+{
+    // Prefix with length to avoid boundary ambiguity.
+    h = HashU32(h, (uint32_t)s.size());
+    if (!s.empty())
+        h = Fnv1a64(s.data(), s.size(), h);
+    return h;
+}
+
+uint64_t HashMaterial(const PbrMaterial& m)
+{
+    // Fast, stable key for caching/material batching (avoid per-frame string building).
+    uint64_t h = 1469598103934665603ull;
+
+    // Symbolic names ("unlit", "rim") select engine variants, so the shader always counts.
+    h = HashString(h, m.shader);
+
+    h = HashU32(h, (uint32_t)m.blendMode);
+    h = HashU32(h, (uint32_t)m.shadingModel);
+
+    h = HashF32(h, m.albedo.x);
+    h = HashF32(h, m.albedo.y);
+    h = HashF32(h, m.albedo.z);
+    h = HashF32(h, m.albedo.w);
+    h = HashF32(h, m.roughness);
+    h = HashF32(h, m.metallic);
+    h = HashF32(h, m.emissive.x);
+    h = HashF32(h, m.emissive.y);
+    h = HashF32(h, m.emissive.z);
+
+    h = HashString(h, m.textures.albedo);
+    h = HashString(h, m.textures.normal);
+    h = HashString(h, m.textures.metallicRoughness);
+    h = HashString(h, m.textures.emissive);
+
+    if (!m.scalars.empty())
+    {
+        std::vector<std::pair<std::string, float>> scalars;
+        scalars.reserve(m.scalars.size());
+        for (const auto& kv : m.scalars)
+            scalars.push_back(kv);
+        std::sort(scalars.begin(), scalars.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        for (const auto& kv : scalars)
+        {
+            h = HashString(h, kv.first);
+            h = HashF32(h, kv.second);
+        }
+    }
+
+    return h;
+}
+
+uint64_t HashMaterialBindings(const PbrMaterial& m)
+{
+    // The shader name always counts: symbolic names ("unlit", "rim") select engine variants.
+    uint64_t h = HashString(1469598103934665603ull, m.shader);
+    h = HashU32(h, (uint32_t)m.blendMode);
+    h = HashU32(h, (uint32_t)m.shadingModel);
+
+    h = HashString(h, m.textures.albedo);
+    h = HashString(h, m.textures.normal);
+    h = HashString(h, m.textures.metallicRoughness);
+    h = HashString(h, m.textures.emissive);
+    return h;
+}
+
+static bool SameBits(float a, float b)
+{
+    uint32_t x = 0;
+    uint32_t y = 0;
+    std::memcpy(&x, &a, sizeof(x));
+    std::memcpy(&y, &b, sizeof(y));
+    return x == y;
+}
+
+// Field-wise equality in the terms HashMaterial hashes (floats by bit pattern).
+static bool SameMaterial(const PbrMaterial& a, const PbrMaterial& b)
+{
+    if (a.shader != b.shader || a.blendMode != b.blendMode || a.shadingModel != b.shadingModel)
+        return false;
+    if (!SameBits(a.albedo.x, b.albedo.x) || !SameBits(a.albedo.y, b.albedo.y) || !SameBits(a.albedo.z, b.albedo.z)
+        || !SameBits(a.albedo.w, b.albedo.w) || !SameBits(a.roughness, b.roughness) || !SameBits(a.metallic, b.metallic)
+        || !SameBits(a.emissive.x, b.emissive.x) || !SameBits(a.emissive.y, b.emissive.y) || !SameBits(a.emissive.z, b.emissive.z))
+        return false;
+    if (a.textures.albedo != b.textures.albedo || a.textures.normal != b.textures.normal
+        || a.textures.metallicRoughness != b.textures.metallicRoughness || a.textures.emissive != b.textures.emissive)
+        return false;
+    if (a.scalars.size() != b.scalars.size())
+        return false;
+    for (const auto& kv : a.scalars)
+    {
+        auto it = b.scalars.find(kv.first);
+        if (it == b.scalars.end() || !SameBits(kv.second, it->second))
+            return false;
+    }
+    return true;
+}
+
+MaterialRegistry::MaterialRegistry()
+{
+    // Slot 0: default material, so every handle (including unset ones) resolves to something valid.
+    Entry def{};
+    def.hash = HashMaterial(def.material);
+    def.version = mNextVersion++;
+    def.interned = true;
+    mEntries.push_back(std::move(def));
+    mByHash.emplace(mEntries[0].hash, kDefaultMaterial);
+}
+
+MaterialHandle MaterialRegistry::Intern(const PbrMaterial& m)
+{
+    const uint64_t h = HashMaterial(m);
+    // Equal hashes are only candidates: a 64-bit collision must not merge two materials.
+    auto range = mByHash.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (SameMaterial(mEntries[it->second].material, m))
+            return it->second;
+    }
+
+    const MaterialHandle handle = Add(m);
+    mEntries[handle].interned = true;
+    mByHash.emplace(h, handle);
+    return handle;
+}
+
+MaterialHandle MaterialRegistry::Add(const PbrMaterial& m)
+{
+    Entry e{};
+    e.material = m;
+    e.hash = HashMaterial(m);
+    e.version = mNextVersion++;
+
+    const MaterialHandle handle = (MaterialHandle)mEntries.size();
+    mEntries.push_back(std::move(e));
+    return handle;
+}
+
+bool MaterialRegistry::Set(MaterialHandle h, const PbrMaterial& m)
+{
+    if (!Valid(h))
+        return false;
+
+    Entry& e = mEntries[h];
+    if (SameMaterial(e.material, m))
+        return true;
+    const uint64_t newHash = HashMaterial(m);
+
+    // Keep the interning map pointing at a handle that really holds that content.
+    if (e.interned)
+    {
+        auto range = mByHash.equal_range(e.hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second == h)
+            {
+                mByHash.erase(it);
+                break;
+            }
+        }
+        mByHash.emplace(newHash, h);
+    }
+
+    e.material = m;
+    e.hash = newHash;
+    e.version = mNextVersion++;
+    return true;
+}
+
+} // namespace king
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "material.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace king
+{
+
+// Compact reference to an interned material. Index 0 is the default material and always exists.
+using MaterialHandle = uint32_t;
+constexpr MaterialHandle kDefaultMaterial = 0;
+
+// Stable 64-bit content hash of a material (used for interning + GPU binding caches).
+uint64_t HashMaterial(const PbrMaterial& m);
+
+// Hash of what a material binds (program inputs, blend mode, textures) but not its parameter
+// values, which live in the renderer's material buffer. Materials with equal binding hashes can
+// share a draw.
+uint64_t HashMaterialBindings(const PbrMaterial& m);
+
+// Interned material store.
+// Materials are hashed once when created/changed; per-frame code only passes handles around.
+// Each entry carries a version so consumers (renderer) can cache derived GPU state and
+// refresh it only when the material actually changed.
+class MaterialRegistry
+{
+public:
+    MaterialRegistry();
+
+    // Returns an existing handle if an identical material (same contents, not just the same
+    // hash) was already interned.
+    MaterialHandle Intern(const PbrMaterial& m);
+
+    // Always a new handle, which Intern never hands out: for materials that are edited in
+    // place later (e.g. hot-reloaded files), so Set cannot change anyone else's material.
+    MaterialHandle Add(const PbrMaterial& m);
+
+    // Replaces the contents of an existing material (all users of the handle see the change).
+    // Returns false if the handle is invalid.
+    bool Set(MaterialHandle h, const PbrMaterial& m);
+
+    bool Valid(MaterialHandle h) const { return h < mEntries.size(); }
+
+    // Invalid handles resolve to the default material.
+    const PbrMaterial& Get(MaterialHandle h) const { return mEntries[Valid(h) ? h : kDefaultMaterial].material; }
+    uint64_t Hash(MaterialHandle h) const { return mEntries[Valid(h) ? h : kDefaultMaterial].hash; }
+    uint32_t Version(MaterialHandle h) const { return mEntries[Valid(h) ? h : kDefaultMaterial].version; }
+
+    size_t Size() const { return mEntries.size(); }
+
+private:
+    struct Entry
+    {
+        PbrMaterial material{};
+        uint64_t hash = 0;
+        uint32_t version = 0;
+        bool interned = false; // listed in mByHash
+    };
+
+    std::vector<Entry> mEntries;
+    // Several handles per hash: collisions are resolved by comparing contents.
+    std::unordered_multimap<uint64_t, MaterialHandle> mByHash;
+
+    // Monotonic; never 0 so consumers can use 0 as "not resolved yet".
+    uint32_t mNextVersion = 1;
+};
+
+} // namespace king
@@ -0,0 +1,357 @@
+#include "mesh_cook.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace king
+{
+
+// Simulated cache of the Forsyth optimizer (larger than any real FIFO, as in the paper).
+static constexpr uint32_t kForsythCacheSize = 32;
+static constexpr uint32_t kInvalidIndex = 0xFFFFFFFFu;
+
+static float ForsythVertexScore(int32_t cachePos, uint32_t liveTriangles)
+{
+    if (liveTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePos >= 0)
+    {
+        // The last triangle's vertices get a fixed score so the next one isn't biased
+        // towards reusing a particular edge.
+        if (cachePos < 3)
+            score = 0.75f;
+        else
+            score = std::pow(1.0f - (float)(cachePos - 3) / (float)(kForsythCacheSize - 3), 1.5f);
+    }
+    // Favour vertices with few triangles left, so they are finished and leave the cache.
+    return score + 2.0f / std::sqrt((float)liveTriangles);
+}
+
+void OptimizeVertexCacheOrder(std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+    const size_t triCount = indices.size() / 3;
+    if (triCount < 2 || vertexCount == 0)
+        return;
+    for (size_t i = 0; i < triCount * 3; ++i)
+    {
+        if (indices[i] >= vertexCount)
+            return;
+    }
+
+    // Vertex -> triangles, one range per vertex; its live (unemitted) triangles are kept at
+    // the front of the range.
+    std::vector<uint32_t> adjStart((size_t)vertexCount + 1u, 0);
+    for (size_t i = 0; i < triCount * 3; ++i)
+        adjStart[indices[i] + 1u]++;
+    for (uint32_t v = 0; v < vertexCount; ++v)
+        adjStart[v + 1u] += adjStart[v];
+
+    std::vector<uint32_t> adj(triCount * 3);
+    std::vector<uint32_t> live(vertexCount, 0);
+    for (size_t t = 0; t < triCount; ++t)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            const uint32_t v = indices[t * 3 + k];
+            adj[adjStart[v] + live[v]++] = (uint32_t)t;
+        }
+    }
+
+    std::vector<int32_t> cachePos(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+        vertexScore[v] = ForsythVertexScore(-1, live[v]);
+
+    std::vector<float> triScore(triCount);
+    std::vector<uint8_t> emitted(triCount, 0);
+    uint32_t best = kInvalidIndex;
+    float bestScore = -1.0f;
+    for (size_t t = 0; t < triCount; ++t)
+    {
+        const uint32_t* tri = &indices[t * 3];
+        triScore[t] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+        if (triScore[t] > bestScore)
+        {
+            bestScore = triScore[t];
+            best = (uint32_t)t;
+        }
+    }
+
+    std::vector<uint32_t> out;
+    out.reserve(triCount * 3);
+    uint32_t cache[kForsythCacheSize + 3];
+    uint32_t cacheCount = 0;
+    size_t scanCursor = 0;
+
+    for (size_t n = 0; n < triCount; ++n)
+    {
+        if (best == kInvalidIndex)
+        {
+            // Nothing in the cache touches a live triangle: continue with the next unemitted one.
+            while (emitted[scanCursor])
+                ++scanCursor;
+            best = (uint32_t)scanCursor;
+        }
+
+        const uint32_t t = best;
+        emitted[t] = 1;
+
+        // The triangle's vertices go to the front of the cache, the rest shift back.
+        uint32_t next[kForsythCacheSize + 3];
+        uint32_t nextCount = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            const uint32_t v = indices[(size_t)t * 3 + k];
+            out.push_back(v);
+
+            uint32_t* a = &adj[adjStart[v]];
+            for (uint32_t j = 0; j < live[v]; ++j)
+            {
+                if (a[j] == t)
+                {
+                    a[j] = a[live[v] - 1u];
+                    break;
+                }
+            }
+            live[v]--;
+
+            if (std::find(next, next + nextCount, v) == next + nextCount)
+                next[nextCount++] = v;
+        }
+        const uint32_t frontCount = nextCount;
+        for (uint32_t i = 0; i < cacheCount; ++i)
+        {
+            const uint32_t v = cache[i];
+            if (std::find(next, next + frontCount, v) == next + frontCount)
+                next[nextCount++] = v;
+        }
+
+        // Rescore everything whose cache position changed (including vertices pushed out).
+        for (uint32_t i = 0; i < nextCount; ++i)
+        {
+            const uint32_t v = next[i];
+            cachePos[v] = i < kForsythCacheSize ? (int32_t)i : -1;
+            vertexScore[v] = ForsythVertexScore(cachePos[v], live[v]);
+        }
+
+        best = kInvalidIndex;
+        bestScore = -1.0f;
+        for (uint32_t i = 0; i < nextCount; ++i)
+        {
+            const uint32_t v = next[i];
+            const uint32_t* a = &adj[adjStart[v]];
+            for (uint32_t j = 0; j < live[v]; ++j)
+            {
+                const uint32_t lt = a[j];
+                const uint32_t* tri = &indices[(size_t)lt * 3];
+                triScore[lt] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+                if (triScore[lt] > bestScore)
+                {
+                    bestScore = triScore[lt];
+                    best = lt;
+                }
+            }
+        }
+
+        cacheCount = std::min(nextCount, kForsythCacheSize);
+        std::copy(next, next + cacheCount, cache);
+    }
+
+    indices.swap(out);
+}
+
+float AverageCacheMissRatio(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+    const size_t triCount = indices.size() / 3;
+    if (triCount == 0 || vertexCount == 0 || cacheSize == 0)
+        return 0.0f;
+
+    // FIFO: a vertex hits while fewer than cacheSize vertices were inserted after it.
+    std::vector<uint32_t> insertedAt(vertexCount, 0);
+    uint32_t clock = cacheSize + 1u;
+    uint32_t misses = 0;
+    for (size_t i = 0; i < triCount * 3; ++i)
+    {
+        const uint32_t v = indices[i];
+        if (v >= vertexCount)
+            continue;
+        if (clock - insertedAt[v] > cacheSize)
+        {
+            insertedAt[v] = clock++;
+            misses++;
+        }
+    }
+    return (float)misses / (float)triCount;
+}
+
+static uint16_t QuantizeUnorm16(float v)
+{
+    return (uint16_t)(std::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+static int16_t QuantizeSnorm16(float v)
+{
+    return (int16_t)std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+// Octahedral mapping: project onto |x| + |y| + |z| = 1 and fold the lower hemisphere over
+// the diagonals. The shaders' DecodeOctNormal undoes it.
+static void EncodeOctNormal(float x, float y, float z, int16_t out[2])
+{
+    const float l1 = std::fabs(x) + std::fabs(y) + std::fabs(z);
+    if (!(l1 > 0.0f))
+    {
+        out[0] = 0;
+        out[1] = 0; // decodes to +Z
+        return;
+    }
+    float u = x / l1;
+    float v = y / l1;
+    if (z < 0.0f)
+    {
+        const float fu = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        const float fv = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = fu;
+        v = fv;
+    }
+    out[0] = QuantizeSnorm16(u);
+    out[1] = QuantizeSnorm16(v);
+}
+
+bool CookMesh(Mesh& mesh, const MeshCookOptions& options)
+{
+    const std::vector<VertexPN>& src = mesh.vertices;
+    if (src.empty())
+        return false;
+    const uint32_t srcCount = (uint32_t)src.size();
+
+    // Level 0, then the coarser levels, back to back in one index buffer. Each level is
+    // validated and reordered on its own; triangles referencing missing vertices are dropped.
+    std::vector<uint32_t>& indices = mesh.packedIndices;
+    indices.clear();
+    MeshLod lods[kMaxMeshLods]{};
+    uint32_t lodCount = 0;
+    auto appendLevel = [&](const std::vector<uint32_t>& level, float maxPixels)
+    {
+        const size_t first = indices.size();
+        for (size_t i = 0; i + 2 < level.size(); i += 3)
+        {
+            const uint32_t a = level[i], b = level[i + 1], c = level[i + 2];
+            if (a < srcCount && b < srcCount && c < srcCount)
+            {
+                indices.push_back(a);
+                indices.push_back(b);
+                indices.push_back(c);
+            }
+        }
+        if (indices.size() == first)
+            return;
+
+        if (options.optimizeIndexOrder)
+        {
+            std::vector<uint32_t> range(indices.begin() + (ptrdiff_t)first, indices.end());
+            OptimizeVertexCacheOrder(range, srcCount);
+            std::copy(range.begin(), range.end(), indices.begin() + (ptrdiff_t)first);
+        }
+
+        // Thresholds must shrink level by level for the selection to walk them in order.
+        MeshLod& l = lods[lodCount];
+        l.firstIndex = (uint32_t)first;
+        l.indexCount = (uint32_t)(indices.size() - first);
+        l.maxPixels = (lodCount >= 2) ? std::min(maxPixels, lods[lodCount - 1].maxPixels) : maxPixels;
+        lodCount++;
+    };
+    appendLevel(mesh.indices, 0.0f);
+    if (lodCount == 1)
+    {
+        for (const MeshLodSource& level : mesh.lodSources)
+        {
+            if (lodCount == kMaxMeshLods)
+                break;
+            appendLevel(level.indices, level.maxPixels);
+        }
+    }
+    const bool indexed = !indices.empty();
+
+    // order[new] = old vertex. Optimized meshes store vertices in first-use order (level 0's
+    // first), which also drops vertices no triangle references.
+    std::vector<uint32_t> order;
+    if (indexed && options.optimizeIndexOrder)
+    {
+        OptimizeVertexCacheOrder(indices, srcCount);
+
+        std::vector<uint32_t> remap(srcCount, kInvalidIndex);
+        order.reserve(srcCount);
+        for (uint32_t& idx : indices)
+        {
+            if (remap[idx] == kInvalidIndex)
+            {
+                remap[idx] = (uint32_t)order.size();
+                order.push_back(idx);
+            }
+            idx = remap[idx];
+        }
+    }
+    else
+    {
+        order.resize(srcCount);
+        for (uint32_t v = 0; v < srcCount; ++v)
+            order[v] = v;
+    }
+    const uint32_t vertexCount = (uint32_t)order.size();
+
+    Float3 bmin{ src[order[0]].x, src[order[0]].y, src[order[0]].z };
+    Float3 bmax = bmin;
+    for (uint32_t old : order)
+    {
+        const VertexPN& v = src[old];
+        bmin = { std::min(bmin.x, v.x), std::min(bmin.y, v.y), std::min(bmin.z, v.z) };
+        bmax = { std::max(bmax.x, v.x), std::max(bmax.y, v.y), std::max(bmax.z, v.z) };
+    }
+
+    // Flat axes still need a non-zero scale: it is part of the instance matrix the normals
+    // are rebuilt from.
+    const float maxExtent = std::max({ bmax.x - bmin.x, bmax.y - bmin.y, bmax.z - bmin.z });
+    const float minExtent = std::max(maxExtent * 1e-4f, 1e-6f);
+    const Float3 scale{ std::max(bmax.x - bmin.x, minExtent), std::max(bmax.y - bmin.y, minExtent), std::max(bmax.z - bmin.z, minExtent) };
+
+    const Float3 center{ (bmin.x + bmax.x) * 0.5f, (bmin.y + bmax.y) * 0.5f, (bmin.z + bmax.z) * 0.5f };
+    float radiusSq = 0.0f;
+
+    mesh.packedVertices.resize(vertexCount);
+    for (uint32_t i = 0; i < vertexCount; ++i)
+    {
+        const VertexPN& v = src[order[i]];
+        PackedVertex& p = mesh.packedVertices[i];
+        p.pos[0] = QuantizeUnorm16((v.x - bmin.x) / scale.x);
+        p.pos[1] = QuantizeUnorm16((v.y - bmin.y) / scale.y);
+        p.pos[2] = QuantizeUnorm16((v.z - bmin.z) / scale.z);
+        p.pos[3] = 0;
+        // Pre-scaled by the extent: the shader's cofactor normal divides it back out.
+        EncodeOctNormal(v.nx * scale.x, v.ny * scale.y, v.nz * scale.z, p.nrm);
+
+        const float dx = v.x - center.x, dy = v.y - center.y, dz = v.z - center.z;
+        radiusSq = std::max(radiusSq, dx * dx + dy * dy + dz * dz);
+    }
+
+    // Pad by the worst-case rounding of a packed position (half a step per axis).
+    const float halfStep = 0.5f / 65535.0f;
+    const float quantError = halfStep * std::sqrt(scale.x * scale.x + scale.y * scale.y + scale.z * scale.z);
+
+    mesh.vertexCount = vertexCount;
+    mesh.indexCount = (uint32_t)indices.size();
+    mesh.index32 = indexed && (options.force32BitIndices || vertexCount > 65535u);
+    mesh.lodCount = std::max(lodCount, 1u);
+    for (uint32_t l = 0; l < kMaxMeshLods; ++l)
+        mesh.lods[l] = lods[l];
+    mesh.quantOffset = bmin;
+    mesh.quantScale = scale;
+    mesh.boundsCenter = center;
+    mesh.boundsRadius = std::sqrt(radiusSq) + quantError;
+    mesh.revision++;
+    return true;
+}
+
+} // namespace king
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../ecs/components.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace king
+{
+
+struct MeshCookOptions
+{
+    // Reorder triangles for the post-transform vertex cache, then vertices in first-use order
+    // (fetch locality). Off keeps the authored order.
+    bool optimizeIndexOrder = true;
+    // Always upload 32-bit indices; otherwise only meshes with more than 65535 vertices use them.
+    bool force32BitIndices = false;
+};
+
+// Cooks mesh.vertices/indices (+ lodSources) into mesh.packedVertices/packedIndices and fills
+// the draw fields (counts, LOD ranges, index width, quantization box, tight bounding sphere,
+// revision). Levels share the vertex buffer and follow each other in the index buffer.
+//
+//   position: UNORM16 per axis inside the vertex AABB (degenerate axes get a tiny extent)
+//   normal:   octahedral SNORM16. Stored pre-scaled by the quantization extent so the
+//             cofactor normal of (dequantize * world) is still the correct world normal.
+//
+// Returns false if there is nothing to cook (no vertices, or the CPU data was released).
+bool CookMesh(Mesh& mesh, const MeshCookOptions& options = {});
+
+// Tom Forsyth's linear-speed vertex cache optimization; rewrites the triangle order in place.
+void OptimizeVertexCacheOrder(std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+// Average cache miss ratio (transformed vertices per triangle) of a FIFO cache; 0.5 is the
+// ideal for regular grids, 3 means no reuse at all.
+float AverageCacheMissRatio(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = 16);
+
+} // namespace king
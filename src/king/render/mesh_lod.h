@@ -0,0 +1,58 @@
+#pragma once
+
+#include "../ecs/components.h"
+#include "../math/types.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+
+namespace king
+{
+
+// Screen-size LOD selection for one view. A world-space sphere (c, r) covers about
+// 2 r * pxPerUnit / w pixels vertically, w = dot(float4(c, 1), wRow): the clip-space w column
+// of the view-projection (1 for orthographic views). Same estimate as shadowMinCasterPixels.
+struct MeshLodView
+{
+    float wRow[4] = { 0, 0, 0, 1 };
+    float pxPerUnit = 0.0f; // 0 = always level 0
+};
+
+// viewportHeight in pixels. bias is in halvings of the screen size: 1 picks the levels an
+// object half as large on screen would get.
+inline MeshLodView MakeMeshLodView(const Mat4x4& viewProj, float viewportHeight, float bias)
+{
+    const float* m = viewProj.m;
+    MeshLodView v{};
+    v.wRow[0] = m[3];
+    v.wRow[1] = m[7];
+    v.wRow[2] = m[11];
+    v.wRow[3] = m[15];
+    // Clip y per world unit (at w = 1) is the length of that column, whatever the rotation.
+    const float yScale = std::sqrt(m[1] * m[1] + m[5] * m[5] + m[9] * m[9]);
+    v.pxPerUnit = 0.5f * viewportHeight * yScale * std::exp2(-bias);
+    return v;
+}
+
+inline float ProjectedDiameterPixels(const MeshLodView& v, float x, float y, float z, float radius)
+{
+    const float w = x * v.wRow[0] + y * v.wRow[1] + z * v.wRow[2] + v.wRow[3];
+    if (w <= 1e-4f)
+        return FLT_MAX; // at or behind the eye
+    return 2.0f * radius * v.pxPerUnit / w;
+}
+
+// Coarsest level whose maxPixels is still above the projected size. Mirrored by gpu_cull.hlsl.
+inline uint32_t SelectMeshLod(const Mesh& mesh, const MeshLodView& v, float x, float y, float z, float radius)
+{
+    if (mesh.lodCount <= 1 || !(v.pxPerUnit > 0.0f))
+        return 0;
+    const float px = ProjectedDiameterPixels(v, x, y, z, radius);
+    uint32_t lod = 0;
+    while (lod + 1u < mesh.lodCount && px < mesh.lods[lod + 1u].maxPixels)
+        ++lod;
+    return lod;
+}
+
+} // namespace king
@@ -0,0 +1,172 @@
+#include "primitive_mesh.h"
+
+#include "mesh_cook.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace king
+{
+
+void BuildCubeMesh(Mesh& m, float halfExtents)
+{
+    const float h = halfExtents;
+    const VertexPN v[] = {
+        // +X
+        { h,-h,-h,  1,0,0 }, { h,-h, h,  1,0,0 }, { h, h, h,  1,0,0 }, { h, h,-h,  1,0,0 },
+        // -X
+        {-h,-h, h, -1,0,0 }, {-h,-h,-h, -1,0,0 }, {-h, h,-h, -1,0,0 }, {-h, h, h, -1,0,0 },
+        // +Y
+        {-h, h,-h,  0,1,0 }, { h, h,-h,  0,1,0 }, { h, h, h,  0,1,0 }, {-h, h, h,  0,1,0 },
+        // -Y
+        {-h,-h, h,  0,-1,0}, { h,-h, h,  0,-1,0}, { h,-h,-h,  0,-1,0}, {-h,-h,-h,  0,-1,0},
+        // +Z
+        { h,-h, h,  0,0,1 }, {-h,-h, h,  0,0,1 }, {-h, h, h,  0,0,1 }, { h, h, h,  0,0,1 },
+        // -Z
+        {-h,-h,-h,  0,0,-1}, { h,-h,-h,  0,0,-1}, { h, h,-h,  0,0,-1}, {-h, h,-h,  0,0,-1},
+    };
+    m.vertices.assign(std::begin(v), std::end(v));
+
+    const uint32_t idx[] = {
+        0,1,2, 0,2,3,
+        4,5,6, 4,6,7,
+        8,9,10, 8,10,11,
+        12,13,14, 12,14,15,
+        16,17,18, 16,18,19,
+        20,21,22, 20,22,23
+    };
+    m.indices.assign(std::begin(idx), std::end(idx));
+    m.lodSources.clear();
+
+    CookMesh(m);
+}
+
+void BuildGroundPlaneMesh(Mesh& m, float halfExtents, int segments)
+{
+    const float h = halfExtents;
+    segments = std::max(1, std::min(segments, 1024));
+    const int vertsPerSide = segments + 1;
+
+    m.vertices.clear();
+    m.vertices.reserve((size_t)vertsPerSide * (size_t)vertsPerSide);
+    for (int z = 0; z <= segments; ++z)
+    {
+        const float tz = (float)z / (float)segments;
+        const float pz = (-h) + (2.0f * h) * tz;
+        for (int x = 0; x <= segments; ++x)
+        {
+            const float tx = (float)x / (float)segments;
+            const float px = (-h) + (2.0f * h) * tx;
+            m.vertices.push_back(VertexPN{ px, 0.0f, pz, 0, 1, 0 });
+        }
+    }
+
+    m.indices.clear();
+    m.indices.reserve((size_t)segments * (size_t)segments * 6u);
+    for (int z = 0; z < segments; ++z)
+    {
+        for (int x = 0; x < segments; ++x)
+        {
+            const uint32_t i0 = (uint32_t)(z * vertsPerSide + x);
+            const uint32_t i1 = i0 + 1;
+            const uint32_t i2 = (uint32_t)((z + 1) * vertsPerSide + x + 1);
+            const uint32_t i3 = (uint32_t)((z + 1) * vertsPerSide + x);
+
+            m.indices.push_back(i0);
+            m.indices.push_back(i1);
+            m.indices.push_back(i2);
+            m.indices.push_back(i0);
+            m.indices.push_back(i2);
+            m.indices.push_back(i3);
+        }
+    }
+    m.lodSources.clear();
+
+    CookMesh(m);
+}
+
+void BuildSphereMesh(Mesh& m, float radius, int slices, int stacks)
+{
+    slices = std::max(3, std::min(slices, 128));
+    stacks = std::max(2, std::min(stacks, 128));
+
+    const float pi = 3.14159265358979323846f;
+    const float twoPi = 6.28318530717958647692f;
+
+    // Appends one lat/long grid to m.vertices and its triangles to indices.
+    auto appendGrid = [&](int gridSlices, int gridStacks, std::vector<uint32_t>& indices)
+    {
+        const uint32_t base = (uint32_t)m.vertices.size();
+        for (int y = 0; y <= gridStacks; ++y)
+        {
+            const float v = (float)y / (float)gridStacks;
+            const float phi = v * pi; // 0..pi
+            const float sp = std::sin(phi);
+            const float cp = std::cos(phi);
+
+            for (int x = 0; x <= gridSlices; ++x)
+            {
+                const float u = (float)x / (float)gridSlices;
+                const float theta = u * twoPi; // 0..2pi
+                const float st = std::sin(theta);
+                const float ct = std::cos(theta);
+
+                const float nx = sp * ct;
+                const float ny = cp;
+                const float nz = sp * st;
+
+                VertexPN vtx;
+                vtx.x = nx * radius;
+                vtx.y = ny * radius;
+                vtx.z = nz * radius;
+                vtx.nx = nx;
+                vtx.ny = ny;
+                vtx.nz = nz;
+                m.vertices.push_back(vtx);
+            }
+        }
+
+        indices.reserve(indices.size() + (size_t)gridSlices * (size_t)gridStacks * 6u);
+        for (int y = 0; y < gridStacks; ++y)
+        {
+            for (int x = 0; x < gridSlices; ++x)
+            {
+                const uint32_t i0 = base + (uint32_t)(y * (gridSlices + 1) + x);
+                const uint32_t i1 = base + (uint32_t)(y * (gridSlices + 1) + x + 1);
+                const uint32_t i2 = base + (uint32_t)((y + 1) * (gridSlices + 1) + x);
+                const uint32_t i3 = base + (uint32_t)((y + 1) * (gridSlices + 1) + x + 1);
+
+                // CCW winding when viewed from outside.
+                indices.push_back(i0);
+                indices.push_back(i2);
+                indices.push_back(i1);
+
+                indices.push_back(i1);
+                indices.push_back(i2);
+                indices.push_back(i3);
+            }
+        }
+    };
+
+    m.vertices.clear();
+    m.indices.clear();
+    m.lodSources.clear();
+    m.vertices.reserve((size_t)(slices + 1) * (size_t)(stacks + 1));
+    appendGrid(slices, stacks, m.indices);
+
+    // Coarser grids for distant spheres (halving the tessellation per level).
+    float maxPixels = 96.0f;
+    for (int lodSlices = slices / 2, lodStacks = stacks / 2; lodSlices >= 8 && lodStacks >= 4
+        && m.lodSources.size() + 1u < kMaxMeshLods; lodSlices /= 2, lodStacks /= 2)
+    {
+        MeshLodSource& lod = m.lodSources.emplace_back();
+        lod.maxPixels = maxPixels;
+        appendGrid(lodSlices, lodStacks, lod.indices);
+        maxPixels *= 0.5f;
+    }
+
+    CookMesh(m);
+}
+
+} // namespace king
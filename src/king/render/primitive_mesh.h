@@ -0,0 +1,22 @@
+#pragma once
+
+#include "../ecs/components.h"
+
+namespace king
+{
+
+// Procedural meshes shared by the sandbox and the benchmark. Each builder replaces the
+// mesh's source data and cooks it (CookMesh).
+
+// Indexed cube centered at the origin: 24 vertices (4 per face), 36 indices.
+void BuildCubeMesh(Mesh& mesh, float halfExtents);
+
+// Subdivided plane on Y = 0 facing +Y (top face only). Past 255 segments the cooked
+// mesh uses 32-bit indices. segments is clamped to [1, 1024].
+void BuildGroundPlaneMesh(Mesh& mesh, float halfExtents, int segments);
+
+// UV (lat/long) sphere, plus coarser grids as LOD levels (tessellation halved per level,
+// switching at 96, 48, ... pixels of screen size). slices/stacks are clamped to [3|2, 128].
+void BuildSphereMesh(Mesh& mesh, float radius, int slices, int stacks);
+
+} // namespace king
@@ -1,7 +1,11 @@
 #include "shader.h"
 
+#include "../jobs/job_system.h"
+
 #include <algorithm>
+#include <cstdio>
 #include <cstring>
+#include <cwchar>
 #include <sstream>
 
 #pragma comment(lib, "d3dcompiler.lib")
@@ -39,6 +43,133 @@ CompiledShader& CompiledShader::operator=(CompiledShader&& o) noexcept
 
 ShaderCache::ShaderCache(ID3D11Device* device) : mDevice(device) {}
 
+#if defined(_DEBUG)
+static constexpr UINT kCompileFlags = D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#else
+static constexpr UINT kCompileFlags = D3DCOMPILE_ENABLE_STRICTNESS;
+#endif
+
+// <key>.cso: this header, then the bytecode.
+struct ShaderDiskHeader
+{
+    uint32_t magic;
+    uint32_t size;
+    uint64_t hash;
+};
+static constexpr uint32_t kShaderDiskMagic = 0x3143534Bu; // "KSC1"
+
+static uint64_t Fnv1a64(const void* data, size_t size, uint64_t h = 14695981039346656037ull)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static void SetBlobError(ID3DBlob* errors, const char* fallback, std::string* outError)
+{
+    const char* msg = errors ? (const char*)errors->GetBufferPointer() : nullptr;
+    if (outError) *outError = msg ? msg : fallback;
+    SafeRelease(errors);
+}
+
+static bool ReadWholeFile(const std::wstring& path, std::vector<uint8_t>& out)
+{
+    out.clear();
+    FILE* f = nullptr;
+    if (_wfopen_s(&f, path.c_str(), L"rb") != 0 || !f)
+        return false;
+    std::fseek(f, 0, SEEK_END);
+    const long size = std::ftell(f);
+    std::fseek(f, 0, SEEK_SET);
+    bool ok = size >= 0;
+    if (ok && size > 0)
+    {
+        out.resize((size_t)size);
+        ok = std::fread(out.data(), 1, out.size(), f) == out.size();
+    }
+    std::fclose(f);
+    return ok;
+}
+
+void ShaderCache::SetDiskCacheDir(const std::wstring& dir)
+{
+    mDiskDir = dir;
+    while (!mDiskDir.empty() && (mDiskDir.back() == L'\\' || mDiskDir.back() == L'/'))
+        mDiskDir.pop_back();
+    if (!mDiskDir.empty())
+        CreateDirectoryW(mDiskDir.c_str(), nullptr);
+}
+
+static std::wstring FullPath(const std::wstring& path)
+{
+    wchar_t buf[MAX_PATH];
+    const DWORD n = GetFullPathNameW(path.c_str(), MAX_PATH, buf, nullptr);
+    return (n > 0 && n < MAX_PATH) ? std::wstring(buf, n) : path;
+}
+
+uint32_t ShaderCache::Invalidate(const std::wstring& path)
+{
+    const std::wstring target = path.empty() ? std::wstring() : FullPath(path);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    uint32_t dropped = 0;
+    for (auto it = mBytecodeCache.begin(); it != mBytecodeCache.end();)
+    {
+        if (target.empty() || _wcsicmp(FullPath(it->first.path).c_str(), target.c_str()) == 0)
+        {
+            it = mBytecodeCache.erase(it);
+            ++dropped;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    return dropped;
+}
+
+bool ShaderCache::ReadDiskCache(uint64_t hash, std::vector<uint8_t>& out) const
+{
+    wchar_t name[32];
+    swprintf(name, 32, L"\\%016llx.cso", (unsigned long long)hash);
+    std::vector<uint8_t> file;
+    if (!ReadWholeFile(mDiskDir + name, file) || file.size() < sizeof(ShaderDiskHeader))
+        return false;
+
+    ShaderDiskHeader h{};
+    std::memcpy(&h, file.data(), sizeof(h));
+    if (h.magic != kShaderDiskMagic || h.hash != hash || h.size != file.size() - sizeof(h) || h.size == 0)
+        return false;
+    out.assign(file.begin() + sizeof(h), file.end());
+    return true;
+}
+
+void ShaderCache::WriteDiskCache(uint64_t hash, const std::vector<uint8_t>& bytes) const
+{
+    // Write a temp file and rename it, so concurrent writers (threads or processes) never
+    // leave a torn entry behind.
+    wchar_t name[32];
+    swprintf(name, 32, L"\\%016llx.cso", (unsigned long long)hash);
+    const std::wstring path = mDiskDir + name;
+    const std::wstring tmp = path + L".tmp" + std::to_wstring((unsigned long)GetCurrentThreadId());
+
+    FILE* f = nullptr;
+    if (_wfopen_s(&f, tmp.c_str(), L"wb") != 0 || !f)
+        return;
+    ShaderDiskHeader h{};
+    h.magic = kShaderDiskMagic;
+    h.size = (uint32_t)bytes.size();
+    h.hash = hash;
+    const bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 && std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    std::fclose(f);
+    if (!ok || !MoveFileExW(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+        DeleteFileW(tmp.c_str());
+}
+
 size_t ShaderCache::KeyHash::operator()(const Key& k) const
 {
     std::hash<std::wstring> hw;
@@ -141,89 +272,157 @@ bool ShaderCache::Reflect(ID3DBlob* bytecode, ShaderReflectionInfo& outInfo, std
     return true;
 }
 
-bool ShaderCache::CompileFromFile(const wchar_t* path, const char* entry, const char* target, const std::vector<ShaderDefine>& defines, CompiledShader& out, std::string* outError)
+bool ShaderCache::CompileBytecode(const Key& key, const std::vector<ShaderDefine>& defines, std::vector<uint8_t>& out, std::string* outError)
 {
-    Key key{};
-    key.path = path;
-    key.entry = entry;
-    key.target = target;
-    key.defineHash = MakeDefineHash(defines);
-
-    auto it = mBytecodeCache.find(key);
-    if (it != mBytecodeCache.end())
+    std::vector<uint8_t> source;
+    if (!ReadWholeFile(key.path, source))
     {
-        // Rehydrate blob from cached bytes.
-        ID3DBlob* blob = nullptr;
-        HRESULT hr = D3DCreateBlob(it->second.size(), &blob);
-        if (FAILED(hr))
-        {
-            if (outError) *outError = "D3DCreateBlob failed.";
-            return false;
-        }
-        std::memcpy(blob->GetBufferPointer(), it->second.data(), it->second.size());
-
-        out = CompiledShader{};
-        out.bytecode = blob;
-        if (!Reflect(out.bytecode, out.reflection, outError))
-            return false;
-        return true;
+        if (outError) *outError = "Cannot read shader file.";
+        return false;
     }
 
-    UINT flags = D3DCOMPILE_ENABLE_STRICTNESS;
-#if defined(_DEBUG)
-    flags |= D3DCOMPILE_DEBUG;
-    flags |= D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
-
     std::vector<D3D_SHADER_MACRO> macros;
     FillD3DDefines(defines, macros);
 
-    ID3DBlob* bytecode = nullptr;
+    // The standard include handler resolves includes relative to this name.
+    std::string sourceName;
+    const int n = WideCharToMultiByte(CP_ACP, 0, key.path.c_str(), (int)key.path.size(), nullptr, 0, nullptr, nullptr);
+    if (n > 0)
+    {
+        sourceName.resize((size_t)n);
+        WideCharToMultiByte(CP_ACP, 0, key.path.c_str(), (int)key.path.size(), sourceName.data(), n, nullptr, nullptr);
+    }
+
+    // Preprocessing is cheap next to compiling and its output covers every include and
+    // define, so it is what the disk key hashes (and what gets compiled on a miss).
+    ID3DBlob* preprocessed = nullptr;
     ID3DBlob* errors = nullptr;
+    HRESULT hr = D3DPreprocess(source.data(), source.size(), sourceName.c_str(), macros.data(),
+        D3D_COMPILE_STANDARD_FILE_INCLUDE, &preprocessed, &errors);
+    if (FAILED(hr) || !preprocessed)
+    {
+        SetBlobError(errors, "Shader preprocess failed.", outError);
+        SafeRelease(preprocessed);
+        return false;
+    }
+    SafeRelease(errors);
+    errors = nullptr;
+
+    const UINT flags = kCompileFlags;
+    const uint32_t compilerVersion = D3D_COMPILER_VERSION;
+    uint64_t hash = Fnv1a64(preprocessed->GetBufferPointer(), preprocessed->GetBufferSize());
+    hash = Fnv1a64(key.entry.data(), key.entry.size() + 1, hash);
+    hash = Fnv1a64(key.target.data(), key.target.size() + 1, hash);
+    hash = Fnv1a64(key.defineHash.data(), key.defineHash.size(), hash);
+    hash = Fnv1a64(&flags, sizeof(flags), hash);
+    hash = Fnv1a64(&compilerVersion, sizeof(compilerVersion), hash);
+
+    if (!mDiskDir.empty() && ReadDiskCache(hash, out))
+    {
+        SafeRelease(preprocessed);
+        mDiskHits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
 
-    HRESULT hr = D3DCompileFromFile(
-        path,
-        macros.data(),
-        D3D_COMPILE_STANDARD_FILE_INCLUDE,
-        entry,
-        target,
-        flags,
-        0,
-        &bytecode,
-        &errors
-    );
+    ID3DBlob* bytecode = nullptr;
+    hr = D3DCompile(preprocessed->GetBufferPointer(), preprocessed->GetBufferSize(), sourceName.c_str(), nullptr, nullptr,
+        key.entry.c_str(), key.target.c_str(), flags, 0, &bytecode, &errors);
+    SafeRelease(preprocessed);
+    if (FAILED(hr) || !bytecode)
+    {
+        SetBlobError(errors, "Shader compile failed.", outError);
+        SafeRelease(bytecode);
+        return false;
+    }
+    SafeRelease(errors);
+    mCompiles.fetch_add(1, std::memory_order_relaxed);
 
-    if (FAILED(hr))
+    out.resize(bytecode->GetBufferSize());
+    std::memcpy(out.data(), bytecode->GetBufferPointer(), out.size());
+    bytecode->Release();
+
+    if (!mDiskDir.empty())
+        WriteDiskCache(hash, out);
+    return true;
+}
+
+bool ShaderCache::GetBytecode(const Key& key, const std::vector<ShaderDefine>& defines, std::vector<uint8_t>& out, std::string* outError)
+{
     {
-        if (errors)
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mBytecodeCache.find(key);
+        if (it != mBytecodeCache.end())
         {
-            const char* msg = (const char*)errors->GetBufferPointer();
-            if (outError) *outError = msg ? msg : "Shader compile failed.";
-            errors->Release();
+            out = it->second;
+            return true;
         }
-        else
-        {
-            if (outError) *outError = "Shader compile failed.";
-        }
-        SafeRelease(bytecode);
-        return false;
     }
 
-    if (errors) errors->Release();
+    // Compile unlocked; two threads racing on one key both compile, and the first insert wins.
+    if (!CompileBytecode(key, defines, out, outError))
+        return false;
 
-    // Cache bytes.
-    std::vector<uint8_t> bytes(bytecode->GetBufferSize());
-    std::memcpy(bytes.data(), bytecode->GetBufferPointer(), bytes.size());
-    mBytecodeCache.emplace(key, std::move(bytes));
+    std::lock_guard<std::mutex> lock(mMutex);
+    mBytecodeCache.emplace(key, out);
+    return true;
+}
+
+bool ShaderCache::CompileFromFile(const wchar_t* path, const char* entry, const char* target, const std::vector<ShaderDefine>& defines, CompiledShader& out, std::string* outError)
+{
+    Key key{};
+    key.path = path;
+    key.entry = entry;
+    key.target = target;
+    key.defineHash = MakeDefineHash(defines);
+
+    std::vector<uint8_t> bytes;
+    if (!GetBytecode(key, defines, bytes, outError))
+        return false;
+
+    // Rehydrate blob from cached bytes.
+    ID3DBlob* blob = nullptr;
+    HRESULT hr = D3DCreateBlob(bytes.size(), &blob);
+    if (FAILED(hr))
+    {
+        if (outError) *outError = "D3DCreateBlob failed.";
+        return false;
+    }
+    std::memcpy(blob->GetBufferPointer(), bytes.data(), bytes.size());
 
     out = CompiledShader{};
-    out.bytecode = bytecode;
+    out.bytecode = blob;
     if (!Reflect(out.bytecode, out.reflection, outError))
         return false;
-
     return true;
 }
 
+uint32_t ShaderCache::Precompile(const std::vector<ShaderCompileRequest>& requests, JobSystem& jobs)
+{
+    std::atomic<uint32_t> failed{ 0 };
+    jobs.ParallelFor(requests.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const ShaderCompileRequest& r = requests[i];
+            Key key{};
+            key.path = r.path;
+            key.entry = r.entry;
+            key.target = r.target;
+            key.defineHash = MakeDefineHash(r.defines);
+
+            std::vector<uint8_t> bytes;
+            std::string err;
+            if (!GetBytecode(key, r.defines, bytes, &err))
+            {
+                std::printf("ShaderCache: precompile of '%ls' %s (%s%s) failed: %s\n", r.path.c_str(), r.entry.c_str(),
+                    r.target.c_str(), key.defineHash.empty() ? "" : (", " + key.defineHash).c_str(), err.c_str());
+                failed.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    });
+    return failed.load();
+}
+
 bool ShaderCache::CompileVSFromFile(const wchar_t* path, const char* entry, const std::vector<ShaderDefine>& defines, CompiledShader& out, std::string* outError)
 {
     return CompileFromFile(path, entry, "vs_5_0", defines, out, outError);
@@ -234,4 +433,14 @@ bool ShaderCache::CompilePSFromFile(const wchar_t* path, const char* entry, cons
     return CompileFromFile(path, entry, "ps_5_0", defines, out, outError);
 }
 
+bool ShaderCache::CompileGSFromFile(const wchar_t* path, const char* entry, const std::vector<ShaderDefine>& defines, CompiledShader& out, std::string* outError)
+{
+    return CompileFromFile(path, entry, "gs_5_0", defines, out, outError);
+}
+
+bool ShaderCache::CompileCSFromFile(const wchar_t* path, const char* entry, const std::vector<ShaderDefine>& defines, CompiledShader& out, std::string* outError)
+{
+    return CompileFromFile(path, entry, "cs_5_0", defines, out, outError);
+}
+
 } // namespace king
@@ -3,7 +3,9 @@
 #include <d3d11.h>
 #include <d3dcompiler.h>
 
+#include <atomic>
 #include <cstdint>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -11,6 +13,8 @@
 namespace king
 {
 
+class JobSystem;
+
 struct ShaderDefine
 {
     std::string name;
@@ -52,14 +56,47 @@ struct CompiledShader
     CompiledShader& operator=(CompiledShader&&) noexcept;
 };
 
+// One compile for ShaderCache::Precompile; target is a profile such as "ps_5_0".
+struct ShaderCompileRequest
+{
+    std::wstring path;
+    std::string entry;
+    std::string target;
+    std::vector<ShaderDefine> defines;
+};
+
 // D3D11 HLSL shader compiler + cache.
+//
+// Bytecode is kept in memory by (path, entry, target, defines) and, with a disk cache
+// directory, persisted as <key>.cso where the key hashes the preprocessed source (so every
+// include and define counts), entry, target, compile flags and compiler version: an edited
+// shader or include simply misses. Compile*FromFile may be called from several threads.
 class ShaderCache
 {
 public:
     explicit ShaderCache(ID3D11Device* device);
 
+    // Empty = memory only. The directory is created if missing.
+    void SetDiskCacheDir(const std::wstring& dir);
+    const std::wstring& DiskCacheDir() const { return mDiskDir; }
+
+    // Compiles (or loads from disk) every request on the job system's workers and keeps the
+    // bytecode in memory, so later Compile*FromFile calls for them skip the compiler.
+    // Returns how many failed; errors are printed.
+    uint32_t Precompile(const std::vector<ShaderCompileRequest>& requests, JobSystem& jobs);
+
+    // Drops the in-memory bytecode compiled from `path` (any spelling of the same file; empty =
+    // every entry) so the next Compile*FromFile reads the source again. The disk cache needs no
+    // invalidation: its key hashes the preprocessed source. Returns the entries dropped.
+    uint32_t Invalidate(const std::wstring& path);
+
+    uint32_t DiskHits() const { return mDiskHits.load(std::memory_order_relaxed); }
+    uint32_t Compiles() const { return mCompiles.load(std::memory_order_relaxed); }
+
     bool CompileVSFromFile(const wchar_t* path, const char* entry, const std::vector<ShaderDefine>& defines, CompiledShader& out, std::string* outError);
     bool CompilePSFromFile(const wchar_t* path, const char* entry, const std::vector<ShaderDefine>& defines, CompiledShader& out, std::string* outError);
+    bool CompileGSFromFile(const wchar_t* path, const char* entry, const std::vector<ShaderDefine>& defines, CompiledShader& out, std::string* outError);
+    bool CompileCSFromFile(const wchar_t* path, const char* entry, const std::vector<ShaderDefine>& defines, CompiledShader& out, std::string* outError);
 
 private:
     struct Key
@@ -81,13 +118,22 @@ private:
     };
 
     bool CompileFromFile(const wchar_t* path, const char* entry, const char* target, const std::vector<ShaderDefine>& defines, CompiledShader& out, std::string* outError);
+    // Memory, then disk, then the compiler; fills the memory cache.
+    bool GetBytecode(const Key& key, const std::vector<ShaderDefine>& defines, std::vector<uint8_t>& out, std::string* outError);
+    bool CompileBytecode(const Key& key, const std::vector<ShaderDefine>& defines, std::vector<uint8_t>& out, std::string* outError);
+    bool ReadDiskCache(uint64_t hash, std::vector<uint8_t>& out) const;
+    void WriteDiskCache(uint64_t hash, const std::vector<uint8_t>& bytes) const;
 
     static std::string MakeDefineHash(const std::vector<ShaderDefine>& defines);
     static void FillD3DDefines(const std::vector<ShaderDefine>& defines, std::vector<D3D_SHADER_MACRO>& outMacros);
     static bool Reflect(ID3DBlob* bytecode, ShaderReflectionInfo& outInfo, std::string* outError);
 
     ID3D11Device* mDevice = nullptr;
+    std::mutex mMutex; // guards mBytecodeCache
     std::unordered_map<Key, std::vector<uint8_t>, KeyHash> mBytecodeCache;
+    std::wstring mDiskDir;
+    std::atomic<uint32_t> mDiskHits{ 0 };
+    std::atomic<uint32_t> mCompiles{ 0 };
 };
 
 } // namespace king
@@ -0,0 +1,360 @@
+#include "shadow_atlas.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace king
+{
+
+static uint32_t FloorPow2(uint32_t v)
+{
+    uint32_t p = 1;
+    while (p * 2u <= v && p < 0x80000000u)
+        p *= 2u;
+    return p;
+}
+
+static uint32_t PackTile(uint32_t x, uint32_t y) { return x | (y << 16); }
+
+void ShadowAtlas::Reset()
+{
+    mDesc.atlasSize = std::clamp(FloorPow2(mDesc.atlasSize), 64u, 16384u);
+    mDesc.minTileSize = std::clamp(FloorPow2(mDesc.minTileSize), 16u, mDesc.atlasSize);
+    mDesc.maxTileSize = std::clamp(FloorPow2(mDesc.maxTileSize), mDesc.minTileSize, mDesc.atlasSize);
+
+    mFree.assign((size_t)LevelOf(mDesc.minTileSize) + 1u, {});
+    mFree[0].push_back(PackTile(0, 0));
+    mEntries.clear();
+    mInitialized = true;
+}
+
+uint32_t ShadowAtlas::LevelOf(uint32_t size) const
+{
+    uint32_t level = 0;
+    for (uint32_t s = mDesc.atlasSize; s > size; s /= 2u)
+        ++level;
+    return level;
+}
+
+bool ShadowAtlas::AllocateTile(uint32_t size, Tile& out)
+{
+    const uint32_t level = LevelOf(size);
+    if (level >= mFree.size())
+        return false;
+
+    // Smallest free block that fits, split down to the requested level.
+    uint32_t k = level;
+    while (mFree[k].empty())
+    {
+        if (k == 0)
+            return false;
+        --k;
+    }
+
+    const uint32_t packed = mFree[k].back();
+    mFree[k].pop_back();
+    const uint32_t x = packed & 0xFFFFu;
+    const uint32_t y = packed >> 16;
+    for (; k < level; ++k)
+    {
+        const uint32_t half = mDesc.atlasSize >> (k + 1u);
+        mFree[k + 1u].push_back(PackTile(x + half, y + half));
+        mFree[k + 1u].push_back(PackTile(x, y + half));
+        mFree[k + 1u].push_back(PackTile(x + half, y));
+    }
+
+    out.x = x;
+    out.y = y;
+    out.size = size;
+    return true;
+}
+
+void ShadowAtlas::FreeTile(const Tile& t)
+{
+    if (t.size == 0)
+        return;
+
+    uint32_t level = LevelOf(t.size);
+    uint32_t x = t.x;
+    uint32_t y = t.y;
+    uint32_t size = t.size;
+    while (level > 0)
+    {
+        // Merge with the three buddies if they are all free.
+        const uint32_t px = x & ~(size * 2u - 1u);
+        const uint32_t py = y & ~(size * 2u - 1u);
+        std::vector<uint32_t>& list = mFree[level];
+        size_t found[3];
+        uint32_t foundCount = 0;
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            const uint32_t bx = px + ((c & 1u) ? size : 0u);
+            const uint32_t by = py + ((c & 2u) ? size : 0u);
+            if (bx == x && by == y)
+                continue;
+            const auto it = std::find(list.begin(), list.end(), PackTile(bx, by));
+            if (it == list.end())
+                break;
+            found[foundCount++] = (size_t)(it - list.begin());
+        }
+        if (foundCount != 3)
+            break;
+
+        std::sort(found, found + 3);
+        for (int i = 2; i >= 0; --i)
+        {
+            list[found[i]] = list.back();
+            list.pop_back();
+        }
+        x = px;
+        y = py;
+        size *= 2u;
+        --level;
+    }
+    mFree[level].push_back(PackTile(x, y));
+}
+
+bool ShadowAtlas::AllocateEntry(Entry& e, uint32_t size, uint32_t faceCount)
+{
+    for (uint32_t f = 0; f < faceCount; ++f)
+    {
+        if (!AllocateTile(size, e.tiles[f]))
+        {
+            for (uint32_t g = 0; g < f; ++g)
+                FreeTile(e.tiles[g]);
+            return false;
+        }
+    }
+
+    e.faceCount = faceCount;
+    e.tileSize = size;
+    for (uint32_t f = 0; f < kMaxFaces; ++f)
+    {
+        if (f >= faceCount)
+            e.tiles[f] = {};
+        e.valid[f] = false;
+        e.hash[f] = 0;
+        e.renderedFrame[f] = 0;
+    }
+    return true;
+}
+
+void ShadowAtlas::ReleaseEntry(Entry& e)
+{
+    for (uint32_t f = 0; f < e.faceCount; ++f)
+        FreeTile(e.tiles[f]);
+    e = Entry{};
+}
+
+bool ShadowAtlas::EvictLeastRecentlyUsed()
+{
+    // Only entries not yet claimed this frame; requests are processed highest priority first,
+    // so that also covers lower-priority lights still waiting for their turn.
+    Entry* victim = nullptr;
+    for (Entry& e : mEntries)
+    {
+        if (e.live && e.lastUsedFrame < mFrame && (!victim || e.lastUsedFrame < victim->lastUsedFrame))
+            victim = &e;
+    }
+    if (!victim)
+        return false;
+    ReleaseEntry(*victim);
+    return true;
+}
+
+uint32_t ShadowAtlas::QuantizeTileSize(float desired) const
+{
+    // Nearest power of two (in log space) within [min, max].
+    uint32_t size = mDesc.minTileSize;
+    while (size < mDesc.maxTileSize && (float)size * 1.41421356f < desired)
+        size *= 2u;
+    return size;
+}
+
+void ShadowAtlas::Update(const Desc& desc, const std::vector<Request>& requests)
+{
+    if (!mInitialized || desc.atlasSize != mDesc.atlasSize || desc.minTileSize != mDesc.minTileSize || desc.maxTileSize != mDesc.maxTileSize)
+    {
+        mDesc = desc;
+        Reset();
+    }
+    mDesc.maxFaceUpdates = desc.maxFaceUpdates;
+    mDesc.updateBudgetMs = desc.updateBudgetMs;
+    ++mFrame;
+
+    const uint32_t requestCount = (uint32_t)requests.size();
+    mOrder.resize(requestCount);
+    for (uint32_t i = 0; i < requestCount; ++i)
+        mOrder[i] = i;
+    std::stable_sort(mOrder.begin(), mOrder.end(), [&](uint32_t a, uint32_t b)
+    {
+        return requests[a].priority > requests[b].priority;
+    });
+
+    static constexpr uint32_t kNoEntry = 0xFFFFFFFFu;
+    mEntryOf.assign(requestCount, kNoEntry);
+    mStats = {};
+
+    for (uint32_t i : mOrder)
+    {
+        const Request& r = requests[i];
+        const uint32_t faceCount = std::clamp(r.faceCount, 1u, kMaxFaces);
+
+        uint32_t entry = kNoEntry;
+        for (uint32_t k = 0; k < (uint32_t)mEntries.size(); ++k)
+        {
+            if (mEntries[k].live && mEntries[k].key == r.key)
+            {
+                entry = k;
+                break;
+            }
+        }
+
+        // Keep the tiles unless the light changed kind or its size drifted well away from
+        // them (hysteresis: coverage hovering at a size boundary must not thrash the atlas).
+        if (entry != kNoEntry)
+        {
+            const Entry& e = mEntries[entry];
+            const float desired = std::clamp(r.desiredSize, (float)mDesc.minTileSize, (float)mDesc.maxTileSize);
+            const bool keep = e.faceCount == faceCount
+                && e.tileSize >= mDesc.minTileSize && e.tileSize <= mDesc.maxTileSize
+                && desired >= (float)e.tileSize * 0.6f && desired <= (float)e.tileSize * 1.6f;
+            if (!keep)
+            {
+                ReleaseEntry(mEntries[entry]);
+                entry = kNoEntry;
+            }
+        }
+
+        if (entry == kNoEntry)
+        {
+            for (uint32_t k = 0; k < (uint32_t)mEntries.size(); ++k)
+            {
+                if (!mEntries[k].live)
+                {
+                    entry = k;
+                    break;
+                }
+            }
+            if (entry == kNoEntry)
+            {
+                entry = (uint32_t)mEntries.size();
+                mEntries.emplace_back();
+            }
+
+            // Make room from stale entries first, then settle for smaller tiles.
+            Entry scratch{};
+            uint32_t size = QuantizeTileSize(r.desiredSize);
+            bool allocated = false;
+            for (;;)
+            {
+                if (AllocateEntry(scratch, size, faceCount))
+                {
+                    allocated = true;
+                    break;
+                }
+                if (EvictLeastRecentlyUsed())
+                    continue;
+                if (size <= mDesc.minTileSize)
+                    break;
+                size /= 2u;
+            }
+            if (!allocated)
+                continue;
+
+            scratch.live = true;
+            scratch.key = r.key;
+            mEntries[entry] = scratch;
+        }
+
+        mEntries[entry].lastUsedFrame = mFrame;
+        mEntryOf[i] = entry;
+        mStats.lights++;
+    }
+
+    // Faces whose content is missing or out of date.
+    mCandidates.clear();
+    for (uint32_t i = 0; i < requestCount; ++i)
+    {
+        if (mEntryOf[i] == kNoEntry)
+            continue;
+        const Request& r = requests[i];
+        const Entry& e = mEntries[mEntryOf[i]];
+        for (uint32_t f = 0; f < e.faceCount; ++f)
+        {
+            if (e.valid[f] && e.hash[f] == r.faceHash[f])
+            {
+                mStats.cached++;
+                continue;
+            }
+            Candidate c{};
+            c.request = i;
+            c.face = f;
+            c.missing = !e.valid[f];
+            // Stale faces age into the budget so low-priority lights still catch up.
+            c.score = std::max(r.priority, 1e-6f) * (float)(1u + std::min<uint64_t>(mFrame - e.renderedFrame[f], 1000u));
+            mCandidates.push_back(c);
+        }
+    }
+    std::stable_sort(mCandidates.begin(), mCandidates.end(), [](const Candidate& a, const Candidate& b)
+    {
+        if (a.missing != b.missing)
+            return a.missing;
+        return a.score > b.score;
+    });
+
+    mUpdates.clear();
+    const uint32_t maxUpdates = std::max(1u, mDesc.maxFaceUpdates);
+    for (const Candidate& c : mCandidates)
+    {
+        const size_t taken = mUpdates.size();
+        const bool overCount = taken >= maxUpdates;
+        const bool overTime = taken > 0 && mDesc.updateBudgetMs > 0.0f && (double)(taken + 1u) * mMsPerFace > (double)mDesc.updateBudgetMs;
+        if (overCount || overTime)
+        {
+            mStats.deferred++;
+            continue;
+        }
+
+        const Request& r = requests[c.request];
+        Entry& e = mEntries[mEntryOf[c.request]];
+        e.valid[c.face] = true;
+        e.hash[c.face] = r.faceHash[c.face];
+        e.renderedFrame[c.face] = mFrame;
+        e.views[c.face] = r.views[c.face];
+
+        FaceUpdate u{};
+        u.request = c.request;
+        u.face = c.face;
+        u.tile = e.tiles[c.face];
+        mUpdates.push_back(u);
+    }
+    mStats.updated = (uint32_t)mUpdates.size();
+
+    mAssignments.assign(requestCount, {});
+    for (uint32_t i = 0; i < requestCount; ++i)
+    {
+        if (mEntryOf[i] == kNoEntry)
+            continue;
+        const Entry& e = mEntries[mEntryOf[i]];
+        Assignment& a = mAssignments[i];
+        a.faceCount = e.faceCount;
+        a.ready = true;
+        for (uint32_t f = 0; f < e.faceCount; ++f)
+        {
+            a.ready = a.ready && e.valid[f];
+            a.tiles[f] = e.tiles[f];
+            a.views[f] = e.views[f];
+        }
+    }
+}
+
+void ShadowAtlas::ReportUpdateCost(double ms, uint32_t faces)
+{
+    if (faces == 0 || !(ms >= 0.0))
+        return;
+    const double perFace = ms / (double)faces;
+    mMsPerFace += (perFace - mMsPerFace) * 0.2;
+}
+
+} // namespace king
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "../math/types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace king
+{
+
+// Bookkeeping for the local-light (point/spot) shadow atlas: tile allocation, per-face content
+// caching and the per-frame re-render budget. The renderer owns the texture and draws the faces.
+//
+// Tiles are power-of-two squares from a quadtree (buddy) allocator over the atlas; a point light
+// takes six (cube faces), a spot light one. A light keeps its tiles across frames while its
+// desired size stays near the tile size. A face is re-rendered only when its content hash
+// (light parameters + the casters it sees, computed by the caller) changes or its tile is new.
+// Re-renders go highest-priority first and are capped per frame by count and by a predicted
+// CPU cost (see ReportUpdateCost); a face that misses the cut keeps its old depths and the
+// view they were rendered with, so a busy frame makes shadows lag instead of adding cost.
+class ShadowAtlas
+{
+public:
+    static constexpr uint32_t kMaxFaces = 6;
+
+    struct Desc
+    {
+        uint32_t atlasSize = 4096;   // power of two
+        uint32_t minTileSize = 128;  // power of two
+        uint32_t maxTileSize = 1024; // power of two
+        uint32_t maxFaceUpdates = 12;
+        // Predicted cost limit for re-renders beyond the first (0 = count cap only).
+        float updateBudgetMs = 2.0f;
+    };
+
+    struct Tile
+    {
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t size = 0; // texels; 0 = none
+    };
+
+    // What a face is rendered with. Shading must use the view its stored depths came from.
+    struct FaceView
+    {
+        Mat4x4 viewProj{};
+        Float3 lightPos{ 0, 0, 0 };
+        float invRange = 0.0f;
+    };
+
+    struct Request
+    {
+        uint64_t key = 0;          // stable light identity
+        uint32_t faceCount = 1;    // 6 = point light, 1 = spot light
+        float desiredSize = 0.0f;  // texels, before rounding/clamping
+        float priority = 0.0f;     // higher wins tiles and updates first
+        uint64_t faceHash[kMaxFaces]{};
+        FaceView views[kMaxFaces]{};
+    };
+
+    // Per request, after Update().
+    struct Assignment
+    {
+        bool ready = false; // every face has content; the light may sample its shadow
+        uint32_t faceCount = 0;
+        Tile tiles[kMaxFaces]{};
+        FaceView views[kMaxFaces]{}; // as rendered
+    };
+
+    struct FaceUpdate
+    {
+        uint32_t request = 0;
+        uint32_t face = 0;
+        Tile tile{};
+    };
+
+    struct Stats
+    {
+        uint32_t lights = 0;   // requests holding tiles
+        uint32_t updated = 0;  // faces scheduled this frame
+        uint32_t deferred = 0; // faces that needed an update but were over budget
+        uint32_t cached = 0;   // faces reused as-is
+    };
+
+    // Assigns tiles and schedules re-renders. Every face in Updates() must be rendered this
+    // frame (into its tile, with its request's view); otherwise call Reset().
+    void Update(const Desc& desc, const std::vector<Request>& requests);
+
+    const std::vector<Assignment>& Assignments() const { return mAssignments; }
+    const std::vector<FaceUpdate>& Updates() const { return mUpdates; }
+    const Stats& LastStats() const { return mStats; }
+
+    // Measured CPU time of rendering `faces` scheduled faces; feeds the cost prediction.
+    void ReportUpdateCost(double ms, uint32_t faces);
+
+    // Forgets all tiles and cached contents (e.g. the atlas texture was recreated).
+    void Reset();
+
+    uint32_t AtlasSize() const { return mDesc.atlasSize; }
+
+private:
+    struct Entry
+    {
+        bool live = false;
+        uint64_t key = 0;
+        uint32_t faceCount = 0;
+        uint32_t tileSize = 0;
+        uint64_t lastUsedFrame = 0;
+        Tile tiles[kMaxFaces]{};
+        bool valid[kMaxFaces]{};
+        uint64_t hash[kMaxFaces]{};
+        uint64_t renderedFrame[kMaxFaces]{};
+        FaceView views[kMaxFaces]{};
+    };
+
+    struct Candidate
+    {
+        uint32_t request = 0;
+        uint32_t face = 0;
+        bool missing = false;
+        float score = 0.0f;
+    };
+
+    uint32_t LevelOf(uint32_t size) const;
+    bool AllocateTile(uint32_t size, Tile& out);
+    void FreeTile(const Tile& t);
+    bool AllocateEntry(Entry& e, uint32_t size, uint32_t faceCount);
+    void ReleaseEntry(Entry& e);
+    bool EvictLeastRecentlyUsed();
+    uint32_t QuantizeTileSize(float desired) const;
+
+    Desc mDesc{};
+    bool mInitialized = false;
+    uint64_t mFrame = 0;
+    double mMsPerFace = 0.25; // EMA of ReportUpdateCost
+
+    // Per quadtree level (0 = whole atlas): free blocks, packed x | (y << 16).
+    std::vector<std::vector<uint32_t>> mFree;
+    std::vector<Entry> mEntries;
+
+    std::vector<uint32_t> mOrder;
+    std::vector<uint32_t> mEntryOf;
+    std::vector<Candidate> mCandidates;
+    std::vector<Assignment> mAssignments;
+    std::vector<FaceUpdate> mUpdates;
+    Stats mStats{};
+};
+
+} // namespace king
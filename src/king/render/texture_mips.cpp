@@ -0,0 +1,103 @@
+#include "texture_mips.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace king
+{
+
+namespace
+{
+
+struct SrgbTables
+{
+    float toLinear[256];
+    uint8_t toSrgb[4096]; // linear quantized to 12 bits
+
+    SrgbTables()
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            const float c = (float)i / 255.0f;
+            toLinear[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < 4096; ++i)
+        {
+            const float l = (float)i / 4095.0f;
+            const float c = (l <= 0.0031308f) ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            toSrgb[i] = (uint8_t)std::clamp((int)(c * 255.0f + 0.5f), 0, 255);
+        }
+    }
+};
+
+const SrgbTables& Tables()
+{
+    static const SrgbTables t;
+    return t;
+}
+
+void Downsample(const uint8_t* src, uint32_t sw, uint32_t sh, uint8_t* dst, uint32_t dw, uint32_t dh, bool srgb)
+{
+    const SrgbTables& t = Tables();
+    for (uint32_t y = 0; y < dh; ++y)
+    {
+        const uint32_t y0 = std::min(y * 2u, sh - 1u);
+        const uint32_t y1 = std::min(y * 2u + 1u, sh - 1u);
+        for (uint32_t x = 0; x < dw; ++x)
+        {
+            const uint32_t x0 = std::min(x * 2u, sw - 1u);
+            const uint32_t x1 = std::min(x * 2u + 1u, sw - 1u);
+            const uint8_t* p[4] = {
+                src + ((size_t)y0 * sw + x0) * 4u,
+                src + ((size_t)y0 * sw + x1) * 4u,
+                src + ((size_t)y1 * sw + x0) * 4u,
+                src + ((size_t)y1 * sw + x1) * 4u,
+            };
+            uint8_t* o = dst + ((size_t)y * dw + x) * 4u;
+            for (int c = 0; c < 4; ++c)
+            {
+                if (srgb && c < 3)
+                {
+                    const float l = 0.25f * (t.toLinear[p[0][c]] + t.toLinear[p[1][c]] + t.toLinear[p[2][c]] + t.toLinear[p[3][c]]);
+                    o[c] = t.toSrgb[(int)(l * 4095.0f + 0.5f)];
+                }
+                else
+                {
+                    o[c] = (uint8_t)(((uint32_t)p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2u) / 4u);
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+void GenerateMipChainRgba8(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb,
+    std::vector<uint8_t>& outChain, std::vector<MipLevelDesc>& outLevels)
+{
+    outChain.clear();
+    outLevels.clear();
+    if (!rgba || width == 0 || height == 0)
+        return;
+
+    size_t total = 0;
+    for (uint32_t w = width, h = height;; w = std::max(w / 2u, 1u), h = std::max(h / 2u, 1u))
+    {
+        outLevels.push_back({ total, w, h });
+        total += (size_t)w * h * 4u;
+        if (w == 1 && h == 1)
+            break;
+    }
+
+    outChain.resize(total);
+    std::memcpy(outChain.data(), rgba, (size_t)width * height * 4u);
+    for (size_t i = 1; i < outLevels.size(); ++i)
+    {
+        const MipLevelDesc& s = outLevels[i - 1];
+        const MipLevelDesc& d = outLevels[i];
+        Downsample(outChain.data() + s.offset, s.width, s.height, outChain.data() + d.offset, d.width, d.height, srgb);
+    }
+}
+
+} // namespace king
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace king
+{
+
+struct MipLevelDesc
+{
+    size_t offset = 0; // bytes into the chain buffer
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// Full RGBA8 mip chain (down to 1x1) with a 2x2 box filter; reads clamp at the edges, so a
+// 1-texel-wide level still halves the other axis. sRGB chains are filtered in linear space
+// (alpha always linear), so minified albedo keeps its brightness. Level 0 is copied as is.
+void GenerateMipChainRgba8(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb,
+    std::vector<uint8_t>& outChain, std::vector<MipLevelDesc>& outLevels);
+
+inline uint32_t MipCountForSize(uint32_t width, uint32_t height)
+{
+    uint32_t n = 1;
+    while (width > 1 || height > 1)
+    {
+        width = (width > 1) ? width / 2 : 1;
+        height = (height > 1) ? height / 2 : 1;
+        ++n;
+    }
+    return n;
+}
+
+} // namespace king
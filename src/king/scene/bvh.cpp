@@ -0,0 +1,314 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace king
+{
+
+static AABB Union(const AABB& a, const AABB& b)
+{
+    return { { std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z) },
+        { std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z) } };
+}
+
+// Half the surface area: the insertion cost metric (SAH).
+static float Area(const AABB& b)
+{
+    const float dx = b.max.x - b.min.x;
+    const float dy = b.max.y - b.min.y;
+    const float dz = b.max.z - b.min.z;
+    return dx * dy + dy * dz + dz * dx;
+}
+
+static bool Contains(const AABB& outer, const AABB& inner)
+{
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z
+        && outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+}
+
+void Bvh::Clear()
+{
+    mNodes.clear();
+    mRoot = kNull;
+    mFreeList = kNull;
+    mProxyCount = 0;
+}
+
+AABB Bvh::Fatten(const AABB& box, float margin) const
+{
+    return { { box.min.x - margin, box.min.y - margin, box.min.z - margin }, { box.max.x + margin, box.max.y + margin, box.max.z + margin } };
+}
+
+uint32_t Bvh::AllocateNode()
+{
+    uint32_t id = mFreeList;
+    if (id != kNull)
+    {
+        mFreeList = mNodes[id].parent;
+        mNodes[id] = Node{};
+    }
+    else
+    {
+        id = (uint32_t)mNodes.size();
+        mNodes.emplace_back();
+    }
+    return id;
+}
+
+void Bvh::FreeNode(uint32_t id)
+{
+    mNodes[id].height = -1;
+    mNodes[id].parent = mFreeList;
+    mFreeList = id;
+}
+
+uint32_t Bvh::Insert(const AABB& box, uint32_t userData)
+{
+    const uint32_t id = AllocateNode();
+    mNodes[id].box = Fatten(box, mMargin);
+    mNodes[id].userData = userData;
+    InsertLeaf(id);
+    ++mProxyCount;
+    return id;
+}
+
+void Bvh::Remove(uint32_t proxy)
+{
+    RemoveLeaf(proxy);
+    FreeNode(proxy);
+    --mProxyCount;
+}
+
+bool Bvh::Move(uint32_t proxy, const AABB& box)
+{
+    // Keep the fat box while it still holds the new one and is not much larger than needed
+    // (an object that shrank would otherwise keep a stale, loose leaf).
+    const AABB& fat = mNodes[proxy].box;
+    if (Contains(fat, box) && Contains(Fatten(box, mMargin * 4.0f), fat))
+        return false;
+
+    RemoveLeaf(proxy);
+    mNodes[proxy].box = Fatten(box, mMargin);
+    InsertLeaf(proxy);
+    return true;
+}
+
+void Bvh::InsertLeaf(uint32_t leaf)
+{
+    if (mRoot == kNull)
+    {
+        mRoot = leaf;
+        mNodes[leaf].parent = kNull;
+        return;
+    }
+
+    // Descend toward the sibling with the lowest SAH cost: the area of the new parent plus the
+    // growth it forces on every ancestor.
+    const AABB leafBox = mNodes[leaf].box;
+    uint32_t index = mRoot;
+    while (!mNodes[index].IsLeaf())
+    {
+        const Node& n = mNodes[index];
+        const float area = Area(n.box);
+        const float combined = Area(Union(n.box, leafBox));
+        const float cost = 2.0f * combined;
+        const float inheritance = 2.0f * (combined - area);
+
+        auto childCost = [&](uint32_t child)
+        {
+            const Node& c = mNodes[child];
+            const float grown = Area(Union(leafBox, c.box));
+            return (c.IsLeaf() ? grown : grown - Area(c.box)) + inheritance;
+        };
+        const float cost1 = childCost(n.child1);
+        const float cost2 = childCost(n.child2);
+        if (cost < cost1 && cost < cost2)
+            break;
+        index = (cost1 < cost2) ? n.child1 : n.child2;
+    }
+
+    const uint32_t sibling = index;
+    const uint32_t oldParent = mNodes[sibling].parent;
+    const uint32_t newParent = AllocateNode(); // may grow mNodes: no references held across it
+    Node& p = mNodes[newParent];
+    p.parent = oldParent;
+    p.box = Union(leafBox, mNodes[sibling].box);
+    p.height = mNodes[sibling].height + 1;
+    p.child1 = sibling;
+    p.child2 = leaf;
+    mNodes[sibling].parent = newParent;
+    mNodes[leaf].parent = newParent;
+    if (oldParent == kNull)
+        mRoot = newParent;
+    else if (mNodes[oldParent].child1 == sibling)
+        mNodes[oldParent].child1 = newParent;
+    else
+        mNodes[oldParent].child2 = newParent;
+
+    for (index = mNodes[leaf].parent; index != kNull; index = mNodes[index].parent)
+    {
+        index = Balance(index);
+        Node& n = mNodes[index];
+        n.height = 1 + std::max(mNodes[n.child1].height, mNodes[n.child2].height);
+        n.box = Union(mNodes[n.child1].box, mNodes[n.child2].box);
+    }
+}
+
+void Bvh::RemoveLeaf(uint32_t leaf)
+{
+    if (leaf == mRoot)
+    {
+        mRoot = kNull;
+        return;
+    }
+
+    const uint32_t parent = mNodes[leaf].parent;
+    const uint32_t grandParent = mNodes[parent].parent;
+    const uint32_t sibling = (mNodes[parent].child1 == leaf) ? mNodes[parent].child2 : mNodes[parent].child1;
+    FreeNode(parent);
+
+    if (grandParent == kNull)
+    {
+        mRoot = sibling;
+        mNodes[sibling].parent = kNull;
+        return;
+    }
+
+    if (mNodes[grandParent].child1 == parent)
+        mNodes[grandParent].child1 = sibling;
+    else
+        mNodes[grandParent].child2 = sibling;
+    mNodes[sibling].parent = grandParent;
+
+    for (uint32_t index = grandParent; index != kNull; index = mNodes[index].parent)
+    {
+        index = Balance(index);
+        Node& n = mNodes[index];
+        n.height = 1 + std::max(mNodes[n.child1].height, mNodes[n.child2].height);
+        n.box = Union(mNodes[n.child1].box, mNodes[n.child2].box);
+    }
+}
+
+uint32_t Bvh::Balance(uint32_t iA)
+{
+    Node& A = mNodes[iA];
+    if (A.IsLeaf() || A.height < 2)
+        return iA;
+
+    const uint32_t iB = A.child1;
+    const uint32_t iC = A.child2;
+    Node& B = mNodes[iB];
+    Node& C = mNodes[iC];
+    const int32_t balance = C.height - B.height;
+
+    // Rotates `up` (a child of A) into A's place; A adopts the shorter of up's children.
+    auto rotateUp = [&](uint32_t iUp, Node& up, bool upIsChild2)
+    {
+        const uint32_t iF = up.child1;
+        const uint32_t iG = up.child2;
+        Node& F = mNodes[iF];
+        Node& G = mNodes[iG];
+
+        up.child1 = iA;
+        up.parent = A.parent;
+        A.parent = iUp;
+        if (up.parent == kNull)
+            mRoot = iUp;
+        else if (mNodes[up.parent].child1 == iA)
+            mNodes[up.parent].child1 = iUp;
+        else
+            mNodes[up.parent].child2 = iUp;
+
+        const uint32_t iKeep = (F.height > G.height) ? iF : iG; // stays under `up`
+        const uint32_t iMove = (F.height > G.height) ? iG : iF; // goes to A
+        Node& other = upIsChild2 ? B : C;                       // A's child that is not rotating
+        up.child2 = iKeep;
+        if (upIsChild2)
+            A.child2 = iMove;
+        else
+            A.child1 = iMove;
+        mNodes[iMove].parent = iA;
+        A.box = Union(other.box, mNodes[iMove].box);
+        A.height = 1 + std::max(other.height, mNodes[iMove].height);
+        up.box = Union(A.box, mNodes[iKeep].box);
+        up.height = 1 + std::max(A.height, mNodes[iKeep].height);
+    };
+
+    if (balance > 1)
+    {
+        rotateUp(iC, C, true);
+        return iC;
+    }
+    if (balance < -1)
+    {
+        rotateUp(iB, B, false);
+        return iB;
+    }
+    return iA;
+}
+
+void Bvh::Build(const AABB* boxes, const uint32_t* userData, size_t count, std::vector<uint32_t>* outProxies)
+{
+    Clear();
+    if (outProxies)
+        outProxies->resize(count);
+    if (count == 0)
+        return;
+
+    mNodes.reserve(count * 2 - 1);
+    std::vector<uint32_t> leaves(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint32_t id = AllocateNode();
+        mNodes[id].box = Fatten(boxes[i], mMargin);
+        mNodes[id].userData = userData ? userData[i] : (uint32_t)i;
+        leaves[i] = id;
+        if (outProxies)
+            (*outProxies)[i] = id;
+    }
+    mProxyCount = count;
+    mRoot = BuildRange(leaves, 0, count);
+    mNodes[mRoot].parent = kNull;
+}
+
+uint32_t Bvh::BuildRange(std::vector<uint32_t>& leaves, size_t begin, size_t end)
+{
+    if (end - begin == 1)
+        return leaves[begin];
+
+    AABB centroids{ { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+    for (size_t i = begin; i < end; ++i)
+    {
+        const AABB& b = mNodes[leaves[i]].box;
+        const Float3 c{ b.min.x + b.max.x, b.min.y + b.max.y, b.min.z + b.max.z };
+        centroids = Union(centroids, AABB{ c, c });
+    }
+    const float ex = centroids.max.x - centroids.min.x;
+    const float ey = centroids.max.y - centroids.min.y;
+    const float ez = centroids.max.z - centroids.min.z;
+    const int axis = (ex >= ey && ex >= ez) ? 0 : ((ey >= ez) ? 1 : 2);
+
+    auto key = [&](uint32_t id)
+    {
+        const AABB& b = mNodes[id].box;
+        return (axis == 0) ? b.min.x + b.max.x : ((axis == 1) ? b.min.y + b.max.y : b.min.z + b.max.z);
+    };
+    const size_t mid = begin + (end - begin) / 2;
+    std::nth_element(leaves.begin() + (std::ptrdiff_t)begin, leaves.begin() + (std::ptrdiff_t)mid, leaves.begin() + (std::ptrdiff_t)end,
+        [&](uint32_t a, uint32_t b) { return key(a) < key(b); });
+
+    const uint32_t left = BuildRange(leaves, begin, mid);
+    const uint32_t right = BuildRange(leaves, mid, end);
+    const uint32_t id = AllocateNode(); // within the reserve: no reallocation
+    Node& n = mNodes[id];
+    n.child1 = left;
+    n.child2 = right;
+    n.box = Union(mNodes[left].box, mNodes[right].box);
+    n.height = 1 + std::max(mNodes[left].height, mNodes[right].height);
+    mNodes[left].parent = id;
+    mNodes[right].parent = id;
+    return id;
+}
+
+} // namespace king
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "frustum.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace king
+{
+
+inline AABB SphereBounds(const Sphere& s)
+{
+    const float r = s.radius;
+    return { { s.center.x - r, s.center.y - r, s.center.z - r }, { s.center.x + r, s.center.y + r, s.center.z + r } };
+}
+
+// Bounding volume hierarchy over boxes: leaves are proxies (a box and a user value), inner
+// nodes bound their two children. Proxies are inserted, moved and removed one at a time, with
+// rotations keeping the tree balanced, or built all at once top down (a better tree when the
+// whole set is known, e.g. after a bulk load).
+//
+// A proxy keeps its box grown by the margin, so Move leaves the tree alone until the tight box
+// escapes that fat box. Queries therefore report candidates whose fat box passes the test;
+// callers that need exact answers test their own bounds.
+class Bvh
+{
+public:
+    static constexpr uint32_t kNull = 0xFFFFFFFFu;
+
+    explicit Bvh(float margin = 0.0f) : mMargin(margin) {}
+
+    // Applies to boxes inserted, moved or built afterwards.
+    void SetMargin(float margin) { mMargin = margin; }
+    void Clear();
+
+    // Returns the proxy, valid until it is removed (or the tree cleared or rebuilt).
+    uint32_t Insert(const AABB& box, uint32_t userData);
+    void Remove(uint32_t proxy);
+    // True if the proxy had to be re-inserted: `box` left its fat box, or shrank well inside it.
+    bool Move(uint32_t proxy, const AABB& box);
+
+    // Replaces the tree with one proxy per box (user value userData[i], or i if userData is
+    // nullptr), splitting at the median of the longest centroid axis. outProxies, if given,
+    // receives the proxy of every box.
+    void Build(const AABB* boxes, const uint32_t* userData, size_t count, std::vector<uint32_t>* outProxies = nullptr);
+
+    uint32_t UserData(uint32_t proxy) const { return mNodes[proxy].userData; }
+    const AABB& FatBox(uint32_t proxy) const { return mNodes[proxy].box; }
+    size_t ProxyCount() const { return mProxyCount; }
+    // Longest root-to-leaf path (0: empty or a single proxy).
+    uint32_t Height() const { return (mRoot == kNull) ? 0u : (uint32_t)mNodes[mRoot].height; }
+
+    // fn(userData) for every proxy that may intersect the frustum. A subtree found entirely
+    // inside the remaining planes is reported without testing further.
+    template <typename Fn>
+    void QueryFrustum(const Frustum& frustum, Fn&& fn) const
+    {
+        if (mRoot != kNull)
+            QueryFrustumFrom(mRoot, 0x3Fu, frustum, fn);
+    }
+
+    // fn(userData) for every proxy overlapping the box / sphere.
+    template <typename Fn>
+    void QueryAabb(const AABB& box, Fn&& fn) const
+    {
+        Walk(mRoot, [&](const AABB& b) { return Overlaps(b, box); }, [&](uint32_t u) { fn(u); return true; });
+    }
+    template <typename Fn>
+    void QuerySphere(const Sphere& s, Fn&& fn) const
+    {
+        const float r2 = s.radius * s.radius;
+        Walk(mRoot, [&](const AABB& b) { return DistanceSq(b, s.center) <= r2; }, [&](uint32_t u) { fn(u); return true; });
+    }
+
+    // Segment origin + t * dir for t in [0, maxT]. fn(userData, maxT) returns the new maxT:
+    // the hit's t to clip the ray (so the search converges on the nearest hit), maxT to
+    // continue unchanged, or a negative value to stop.
+    template <typename Fn>
+    void RayCast(const Float3& origin, const Float3& dir, float maxT, Fn&& fn) const
+    {
+        auto inv = [](float d) { return (std::fabs(d) > 1e-20f) ? 1.0f / d : ((d < 0.0f) ? -1e30f : 1e30f); };
+        const Float3 invDir{ inv(dir.x), inv(dir.y), inv(dir.z) };
+        Walk(mRoot,
+            [&](const AABB& b)
+            {
+                float t0 = 0.0f;
+                float t1 = maxT;
+                if (!Slab(origin.x, invDir.x, b.min.x, b.max.x, t0, t1) || !Slab(origin.y, invDir.y, b.min.y, b.max.y, t0, t1)
+                    || !Slab(origin.z, invDir.z, b.min.z, b.max.z, t0, t1))
+                    return false;
+                return true;
+            },
+            [&](uint32_t u)
+            {
+                const float t = fn(u, maxT);
+                if (t < 0.0f)
+                    return false;
+                maxT = t;
+                return true;
+            });
+    }
+
+private:
+    struct Node
+    {
+        AABB box{};
+        uint32_t parent = kNull; // next free node while on the free list
+        uint32_t child1 = kNull;
+        uint32_t child2 = kNull;
+        uint32_t userData = 0;
+        int32_t height = 0; // 0 for leaves, -1 for free nodes
+
+        bool IsLeaf() const { return child1 == kNull; }
+    };
+
+    // Deep enough for any tree the rotations allow; deeper subtrees recurse instead.
+    static constexpr uint32_t kStackSize = 64;
+
+    static bool Overlaps(const AABB& a, const AABB& b)
+    {
+        return a.min.x <= b.max.x && a.max.x >= b.min.x && a.min.y <= b.max.y && a.max.y >= b.min.y
+            && a.min.z <= b.max.z && a.max.z >= b.min.z;
+    }
+    static float DistanceSq(const AABB& b, const Float3& p)
+    {
+        auto axis = [](float v, float lo, float hi) { return (v < lo) ? lo - v : ((v > hi) ? v - hi : 0.0f); };
+        const float dx = axis(p.x, b.min.x, b.max.x);
+        const float dy = axis(p.y, b.min.y, b.max.y);
+        const float dz = axis(p.z, b.min.z, b.max.z);
+        return dx * dx + dy * dy + dz * dz;
+    }
+    static bool Slab(float o, float invD, float lo, float hi, float& t0, float& t1)
+    {
+        float a = (lo - o) * invD;
+        float b = (hi - o) * invD;
+        if (a > b)
+        {
+            const float t = a;
+            a = b;
+            b = t;
+        }
+        t0 = (a > t0) ? a : t0;
+        t1 = (b < t1) ? b : t1;
+        return t0 <= t1;
+    }
+
+    // Depth-first over the subtree at `root`, descending where test(box) holds; emit(userData)
+    // for leaves that pass, stopping when it returns false. Returns false once stopped.
+    template <typename Test, typename Emit>
+    bool Walk(uint32_t root, Test&& test, Emit&& emit) const
+    {
+        if (root == kNull)
+            return true;
+        uint32_t stack[kStackSize];
+        uint32_t top = 0;
+        stack[top++] = root;
+        while (top > 0)
+        {
+            const Node& n = mNodes[stack[--top]];
+            if (!test(n.box))
+                continue;
+            if (n.IsLeaf())
+            {
+                if (!emit(n.userData))
+                    return false;
+                continue;
+            }
+            if (top + 2 > kStackSize)
+            {
+                if (!Walk(n.child1, test, emit) || !Walk(n.child2, test, emit))
+                    return false;
+                continue;
+            }
+            stack[top++] = n.child2;
+            stack[top++] = n.child1;
+        }
+        return true;
+    }
+
+    // `planes`: bit p set while plane p still has to be tested (the box straddled it further up).
+    template <typename Fn>
+    void QueryFrustumFrom(uint32_t root, uint32_t planes, const Frustum& frustum, Fn& fn) const
+    {
+        struct Entry
+        {
+            uint32_t node;
+            uint32_t planes;
+        };
+        Entry stack[kStackSize];
+        uint32_t top = 0;
+        stack[top++] = { root, planes };
+        while (top > 0)
+        {
+            const Entry e = stack[--top];
+            const Node& n = mNodes[e.node];
+
+            // Same test as Frustum::Intersects(const AABB&), in center/extent form so a box
+            // entirely on the inside of a plane can drop it for its children.
+            const Float3 c{ (n.box.min.x + n.box.max.x) * 0.5f, (n.box.min.y + n.box.max.y) * 0.5f, (n.box.min.z + n.box.max.z) * 0.5f };
+            const Float3 h{ (n.box.max.x - n.box.min.x) * 0.5f, (n.box.max.y - n.box.min.y) * 0.5f, (n.box.max.z - n.box.min.z) * 0.5f };
+            uint32_t remaining = e.planes;
+            bool outside = false;
+            for (uint32_t p = 0; p < 6; ++p)
+            {
+                if ((remaining & (1u << p)) == 0)
+                    continue;
+                const Plane& pl = frustum.planes[p];
+                const float d = pl.n.x * c.x + pl.n.y * c.y + pl.n.z * c.z + pl.d;
+                const float r = std::fabs(pl.n.x) * h.x + std::fabs(pl.n.y) * h.y + std::fabs(pl.n.z) * h.z;
+                if (d + r < 0.0f)
+                {
+                    outside = true;
+                    break;
+                }
+                if (d - r >= 0.0f)
+                    remaining &= ~(1u << p);
+            }
+            if (outside)
+                continue;
+
+            if (remaining == 0)
+            {
+                Walk(e.node, [](const AABB&) { return true; }, [&](uint32_t u) { fn(u); return true; });
+                continue;
+            }
+            if (n.IsLeaf())
+            {
+                fn(n.userData);
+                continue;
+            }
+            if (top + 2 > kStackSize)
+            {
+                QueryFrustumFrom(n.child1, remaining, frustum, fn);
+                QueryFrustumFrom(n.child2, remaining, frustum, fn);
+                continue;
+            }
+            stack[top++] = { n.child2, remaining };
+            stack[top++] = { n.child1, remaining };
+        }
+    }
+
+    uint32_t AllocateNode();
+    void FreeNode(uint32_t id);
+    void InsertLeaf(uint32_t leaf);
+    void RemoveLeaf(uint32_t leaf);
+    // Rotates the taller grandchild up if the heights of iA's children differ by more than one;
+    // returns the node now at iA's place.
+    uint32_t Balance(uint32_t iA);
+    // Inner node over leaves[begin, end); leaves are reordered.
+    uint32_t BuildRange(std::vector<uint32_t>& leaves, size_t begin, size_t end);
+    AABB Fatten(const AABB& box, float margin) const;
+
+    std::vector<Node> mNodes;
+    uint32_t mRoot = kNull;
+    uint32_t mFreeList = kNull;
+    size_t mProxyCount = 0;
+    float mMargin = 0.0f;
+};
+
+} // namespace king
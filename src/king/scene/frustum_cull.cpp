@@ -0,0 +1,306 @@
+#include "frustum_cull.h"
+
+#include "../jobs/job_system.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define KING_CULL_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define KING_CULL_SSE 1
+#endif
+
+namespace king
+{
+
+// Spheres per job; a multiple of the widest kernel so only the last chunk has a scalar tail.
+static constexpr size_t kCullChunk = 4096;
+
+static size_t CullScalar(const Frustum& frustum, const SphereSoA& s, size_t begin, size_t end, uint32_t* out, size_t n)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        const float negR = -s.r[i];
+        bool visible = true;
+        for (const Plane& p : frustum.planes)
+        {
+            if (p.n.x * s.x[i] + p.n.y * s.y[i] + p.n.z * s.z[i] + p.d < negR)
+            {
+                visible = false;
+                break;
+            }
+        }
+        out[n] = (uint32_t)i;
+        n += visible ? 1u : 0u;
+    }
+    return n;
+}
+
+size_t CullSpheres(const Frustum& frustum, const SphereSoA& s, size_t begin, size_t end, uint32_t* out)
+{
+    size_t n = 0;
+    size_t i = begin;
+
+    const float* xs = s.x.data();
+    const float* ys = s.y.data();
+    const float* zs = s.z.data();
+    const float* rs = s.r.data();
+
+#if defined(KING_CULL_AVX2)
+    __m256 pnx[6], pny[6], pnz[6], pd[6];
+    for (int p = 0; p < 6; ++p)
+    {
+        pnx[p] = _mm256_set1_ps(frustum.planes[p].n.x);
+        pny[p] = _mm256_set1_ps(frustum.planes[p].n.y);
+        pnz[p] = _mm256_set1_ps(frustum.planes[p].n.z);
+        pd[p] = _mm256_set1_ps(frustum.planes[p].d);
+    }
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+    for (; i + 8 <= end; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(xs + i);
+        const __m256 y = _mm256_loadu_ps(ys + i);
+        const __m256 z = _mm256_loadu_ps(zs + i);
+        const __m256 negR = _mm256_xor_ps(_mm256_loadu_ps(rs + i), signBit);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p)
+        {
+            __m256 d = _mm256_mul_ps(pnx[p], x);
+            d = _mm256_add_ps(d, _mm256_mul_ps(pny[p], y));
+            d = _mm256_add_ps(d, _mm256_mul_ps(pnz[p], z));
+            d = _mm256_add_ps(d, pd[p]);
+            // !(d < -r), matching the scalar test.
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negR, _CMP_NLT_UQ));
+        }
+
+        // Branchless compaction: always write the index, advance only for visible lanes.
+        const unsigned mask = (unsigned)_mm256_movemask_ps(inside);
+        for (unsigned k = 0; k < 8; ++k)
+        {
+            out[n] = (uint32_t)(i + k);
+            n += (mask >> k) & 1u;
+        }
+    }
+#elif defined(KING_CULL_SSE)
+    __m128 pnx[6], pny[6], pnz[6], pd[6];
+    for (int p = 0; p < 6; ++p)
+    {
+        pnx[p] = _mm_set1_ps(frustum.planes[p].n.x);
+        pny[p] = _mm_set1_ps(frustum.planes[p].n.y);
+        pnz[p] = _mm_set1_ps(frustum.planes[p].n.z);
+        pd[p] = _mm_set1_ps(frustum.planes[p].d);
+    }
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+
+    for (; i + 4 <= end; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(xs + i);
+        const __m128 y = _mm_loadu_ps(ys + i);
+        const __m128 z = _mm_loadu_ps(zs + i);
+        const __m128 negR = _mm_xor_ps(_mm_loadu_ps(rs + i), signBit);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p)
+        {
+            __m128 d = _mm_mul_ps(pnx[p], x);
+            d = _mm_add_ps(d, _mm_mul_ps(pny[p], y));
+            d = _mm_add_ps(d, _mm_mul_ps(pnz[p], z));
+            d = _mm_add_ps(d, pd[p]);
+            // !(d < -r), matching the scalar test.
+            inside = _mm_and_ps(inside, _mm_cmpnlt_ps(d, negR));
+        }
+
+        // Branchless compaction: always write the index, advance only for visible lanes.
+        const unsigned mask = (unsigned)_mm_movemask_ps(inside);
+        for (unsigned k = 0; k < 4; ++k)
+        {
+            out[n] = (uint32_t)(i + k);
+            n += (mask >> k) & 1u;
+        }
+    }
+#endif
+
+    (void)xs;
+    (void)ys;
+    (void)zs;
+    (void)rs;
+    return CullScalar(frustum, s, i, end, out, n);
+}
+
+void CullSpheresParallel(JobSystem& jobs, const Frustum& frustum, const SphereSoA& spheres,
+    std::vector<uint32_t>& outVisible, uint32_t maxParallelism)
+{
+    outVisible.resize(spheres.Size());
+    outVisible.resize(CullSpheresParallel(jobs, frustum, spheres, outVisible.data(), maxParallelism));
+}
+
+size_t CullSpheresParallel(JobSystem& jobs, const Frustum& frustum, const SphereSoA& spheres,
+    uint32_t* outVisible, uint32_t maxParallelism)
+{
+    const size_t count = spheres.Size();
+    if (count == 0)
+        return 0;
+
+    // Each chunk writes its visible indices at the start of its own range of outVisible,
+    // then the runs are slid down in order. Destinations never overlap a later run's source.
+    const size_t chunks = (count + kCullChunk - 1) / kCullChunk;
+    thread_local std::vector<uint32_t> tChunkVisible;
+    std::vector<uint32_t>& chunkVisible = tChunkVisible; // the jobs below run on other threads
+    chunkVisible.assign(chunks, 0);
+
+    uint32_t* out = outVisible;
+    jobs.ParallelFor(chunks, 1, [&](size_t first, size_t last)
+    {
+        for (size_t c = first; c < last; ++c)
+        {
+            const size_t begin = c * kCullChunk;
+            const size_t end = std::min(begin + kCullChunk, count);
+            chunkVisible[c] = (uint32_t)CullSpheres(frustum, spheres, begin, end, out + begin);
+        }
+    }, maxParallelism);
+
+    size_t total = chunkVisible[0];
+    for (size_t c = 1; c < chunks; ++c)
+    {
+        const uint32_t* src = out + c * kCullChunk;
+        std::copy(src, src + chunkVisible[c], out + total);
+        total += chunkVisible[c];
+    }
+    return total;
+}
+
+static uint32_t CullMaskScalar(const Frustum* frustums, uint32_t frustumCount, const SphereSoA& s, size_t i)
+{
+    const float negR = -s.r[i];
+    uint32_t mask = 0;
+    for (uint32_t v = 0; v < frustumCount; ++v)
+    {
+        bool visible = true;
+        for (const Plane& p : frustums[v].planes)
+        {
+            if (p.n.x * s.x[i] + p.n.y * s.y[i] + p.n.z * s.z[i] + p.d < negR)
+            {
+                visible = false;
+                break;
+            }
+        }
+        mask |= visible ? (1u << v) : 0u;
+    }
+    return mask;
+}
+
+void CullSpheresMulti(const Frustum* frustums, uint32_t frustumCount, const SphereSoA& s, size_t begin, size_t end,
+    uint32_t* outMasks)
+{
+    frustumCount = std::min(frustumCount, kMaxCullViews);
+    size_t i = begin;
+
+    const float* xs = s.x.data();
+    const float* ys = s.y.data();
+    const float* zs = s.z.data();
+    const float* rs = s.r.data();
+
+    // Planes are broadcast per use rather than kept in registers: with several views they
+    // would not fit, and the loads hit L1.
+#if defined(KING_CULL_AVX2)
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+    for (; i + 8 <= end; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(xs + i);
+        const __m256 y = _mm256_loadu_ps(ys + i);
+        const __m256 z = _mm256_loadu_ps(zs + i);
+        const __m256 negR = _mm256_xor_ps(_mm256_loadu_ps(rs + i), signBit);
+
+        uint32_t masks[8] = {};
+        for (uint32_t v = 0; v < frustumCount; ++v)
+        {
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (const Plane& p : frustums[v].planes)
+            {
+                __m256 d = _mm256_mul_ps(_mm256_set1_ps(p.n.x), x);
+                d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.n.y), y));
+                d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.n.z), z));
+                d = _mm256_add_ps(d, _mm256_set1_ps(p.d));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negR, _CMP_NLT_UQ));
+            }
+            const unsigned lanes = (unsigned)_mm256_movemask_ps(inside);
+            for (unsigned k = 0; k < 8; ++k)
+                masks[k] |= ((lanes >> k) & 1u) << v;
+        }
+        for (unsigned k = 0; k < 8; ++k)
+            outMasks[i + k] = masks[k];
+    }
+#elif defined(KING_CULL_SSE)
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= end; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(xs + i);
+        const __m128 y = _mm_loadu_ps(ys + i);
+        const __m128 z = _mm_loadu_ps(zs + i);
+        const __m128 negR = _mm_xor_ps(_mm_loadu_ps(rs + i), signBit);
+
+        uint32_t masks[4] = {};
+        for (uint32_t v = 0; v < frustumCount; ++v)
+        {
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (const Plane& p : frustums[v].planes)
+            {
+                __m128 d = _mm_mul_ps(_mm_set1_ps(p.n.x), x);
+                d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.n.y), y));
+                d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.n.z), z));
+                d = _mm_add_ps(d, _mm_set1_ps(p.d));
+                inside = _mm_and_ps(inside, _mm_cmpnlt_ps(d, negR));
+            }
+            const unsigned lanes = (unsigned)_mm_movemask_ps(inside);
+            for (unsigned k = 0; k < 4; ++k)
+                masks[k] |= ((lanes >> k) & 1u) << v;
+        }
+        for (unsigned k = 0; k < 4; ++k)
+            outMasks[i + k] = masks[k];
+    }
+#endif
+
+    (void)xs;
+    (void)ys;
+    (void)zs;
+    (void)rs;
+    for (; i < end; ++i)
+        outMasks[i] = CullMaskScalar(frustums, frustumCount, s, i);
+}
+
+void CullSpheresMultiParallel(JobSystem& jobs, const Frustum* frustums, uint32_t frustumCount, const SphereSoA& spheres,
+    std::vector<uint32_t>& outMasks, uint32_t maxParallelism)
+{
+    const size_t count = spheres.Size();
+    outMasks.resize(count);
+    if (count == 0)
+        return;
+
+    uint32_t* out = outMasks.data();
+    const size_t chunks = (count + kCullChunk - 1) / kCullChunk;
+    jobs.ParallelFor(chunks, 1, [&](size_t first, size_t last)
+    {
+        for (size_t c = first; c < last; ++c)
+        {
+            const size_t begin = c * kCullChunk;
+            CullSpheresMulti(frustums, frustumCount, spheres, begin, std::min(begin + kCullChunk, count), out);
+        }
+    }, maxParallelism);
+}
+
+const char* CullKernelName()
+{
+#if defined(KING_CULL_AVX2)
+    return "AVX2";
+#elif defined(KING_CULL_SSE)
+    return "SSE";
+#else
+    return "scalar";
+#endif
+}
+
+} // namespace king
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "frustum.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace king
+{
+
+class JobSystem;
+
+// World-space bounding spheres in structure-of-arrays layout, for the batched culling kernel.
+// A radius of -FLT_MAX marks a slot that is always culled (e.g. an item without a mesh).
+// Heap-backed by default; per-frame scratch can pass a frame arena.
+struct SphereSoA
+{
+    std::pmr::vector<float> x;
+    std::pmr::vector<float> y;
+    std::pmr::vector<float> z;
+    std::pmr::vector<float> r;
+
+    SphereSoA() = default;
+    explicit SphereSoA(std::pmr::memory_resource* mr) : x(mr), y(mr), z(mr), r(mr) {}
+
+    void Resize(size_t count)
+    {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        r.resize(count);
+    }
+
+    size_t Size() const { return x.size(); }
+
+    void Set(size_t i, const Sphere& s)
+    {
+        x[i] = s.center.x;
+        y[i] = s.center.y;
+        z[i] = s.center.z;
+        r[i] = s.radius;
+    }
+};
+
+// Tests spheres [begin, end) against all six planes, 8 (AVX2) or 4 (SSE) per iteration,
+// with the same result as Frustum::Intersects(const Sphere&). Writes the indices of visible
+// spheres, ascending, to out (room for end - begin entries) and returns how many were written.
+size_t CullSpheres(const Frustum& frustum, const SphereSoA& spheres, size_t begin, size_t end, uint32_t* out);
+
+// CullSpheres over the whole array, split across job workers. outVisible is compacted to the
+// visible indices in ascending order. maxParallelism as in JobSystem::ParallelFor.
+void CullSpheresParallel(JobSystem& jobs, const Frustum& frustum, const SphereSoA& spheres,
+    std::vector<uint32_t>& outVisible, uint32_t maxParallelism = 0);
+// Same, into caller storage with room for spheres.Size() entries; returns the visible count.
+size_t CullSpheresParallel(JobSystem& jobs, const Frustum& frustum, const SphereSoA& spheres,
+    uint32_t* outVisible, uint32_t maxParallelism = 0);
+
+// Most frustums one CullSpheresMulti call tests (one mask bit each).
+constexpr uint32_t kMaxCullViews = 32;
+
+// Several views in one pass: each sphere is loaded once and tested against every frustum.
+// Sets bit v of outMasks[i] (i in [begin, end); outMasks indexed like the spheres) when
+// sphere i intersects frustums[v]. frustumCount <= kMaxCullViews.
+void CullSpheresMulti(const Frustum* frustums, uint32_t frustumCount, const SphereSoA& spheres, size_t begin, size_t end,
+    uint32_t* outMasks);
+
+// CullSpheresMulti over the whole array, split across job workers. outMasks is resized to
+// spheres.Size().
+void CullSpheresMultiParallel(JobSystem& jobs, const Frustum* frustums, uint32_t frustumCount, const SphereSoA& spheres,
+    std::vector<uint32_t>& outMasks, uint32_t maxParallelism = 0);
+
+// Kernel selected at compile time: "AVX2", "SSE" or "scalar".
+const char* CullKernelName();
+
+} // namespace king
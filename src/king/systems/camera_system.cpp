@@ -5,17 +5,16 @@ namespace king::systems
 
 bool CameraSystem::UpdatePrimaryCamera(Scene& scene, Frustum& outFrustum, Mat4x4& outViewProj)
 {
-    for (auto e : scene.reg.cameras.Entities())
+    for (auto [e, cc, t] : scene.reg.View<CameraComponent, Transform>())
     {
-        auto* cc = scene.reg.cameras.TryGet(e);
-        auto* t = scene.reg.transforms.TryGet(e);
-        if (!cc || !t || !cc->primary)
+        (void)e;
+        if (!cc.primary)
             continue;
 
         // Keep camera position in sync with transform (minimal sample behavior).
-        cc->camera.SetPosition(t->position);
+        cc.camera.SetPosition(t.position);
 
-        outViewProj = cc->camera.ViewProjectionMatrix();
+        outViewProj = cc.camera.ViewProjectionMatrix();
         outFrustum = Frustum::FromViewProjection(outViewProj);
         return true;
     }
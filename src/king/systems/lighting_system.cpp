@@ -11,7 +11,7 @@ void LightingSystem::EnsureDefaultSun(Scene& scene)
 
     Entity e = scene.reg.CreateEntity();
     scene.reg.transforms.Emplace(e);
-    auto& l = scene.reg.lights.Emplace(e);
+    auto& l = *scene.reg.lights.Emplace(e);
     l.type = LightType::Directional;
     l.color = { 1, 1, 1 };
     l.intensity = 2.0f;
@@ -0,0 +1,214 @@
+#include "spatial_index_system.h"
+
+#include "transform_system.h"
+
+#include <cmath>
+
+namespace king::systems
+{
+
+bool SpatialIndexSystem::Bounds(const Scene& scene, Entity e, Sphere& out)
+{
+    const Registry& reg = scene.reg;
+    const MeshRenderer* r = reg.renderers.TryGet(e);
+    const Transform* t = r ? reg.transforms.TryGet(e) : nullptr;
+    const Mesh* m = t ? reg.meshes.TryGet(r->mesh) : nullptr;
+    if (!m || m->revision == 0)
+        return false;
+
+    WorldTransform local{};
+    const WorldTransform* w = reg.worldTransforms.TryGet(e);
+    if (!w)
+    {
+        TransformSystem::ComputeWorld(*t, nullptr, local);
+        w = &local;
+    }
+
+    // Row-vector convention: center * world (as the renderer's bounds).
+    const float* x = w->world.m;
+    const Float3& c = m->boundsCenter;
+    out.center = {
+        c.x * x[0] + c.y * x[4] + c.z * x[8] + x[12],
+        c.x * x[1] + c.y * x[5] + c.z * x[9] + x[13],
+        c.x * x[2] + c.y * x[6] + c.z * x[10] + x[14]
+    };
+    out.radius = m->boundsRadius * w->maxScale;
+    return true;
+}
+
+void SpatialIndexSystem::Drop(uint32_t entityIndex)
+{
+    if (entityIndex >= mEntries.size())
+        return;
+    Entry& entry = mEntries[entityIndex];
+    if (entry.proxy != kNoProxy)
+        mTree.Remove(entry.proxy);
+    entry.proxy = kNoProxy;
+    entry.entity = kInvalidEntity;
+}
+
+void SpatialIndexSystem::Refresh(const Scene& scene, Entity e)
+{
+    const uint32_t index = EntityIndex(e);
+    if (index >= mEntries.size())
+        mEntries.resize((size_t)index + 1u);
+
+    Sphere s{};
+    if (!Bounds(scene, e, s))
+    {
+        Drop(index);
+        Entry& entry = mEntries[index];
+        if (scene.reg.renderers.Has(e) && !entry.pending)
+        {
+            entry.pending = true;
+            mPending.push_back(e);
+        }
+        return;
+    }
+
+    Entry& entry = mEntries[index];
+    entry.sphere = s;
+    if (entry.proxy != kNoProxy && entry.entity == e)
+    {
+        if (mTree.Move(entry.proxy, SphereBounds(s)))
+            ++mLastReinserts;
+        return;
+    }
+    if (entry.proxy != kNoProxy)
+        mTree.Remove(entry.proxy); // index reused by a newer entity
+    entry.proxy = mTree.Insert(SphereBounds(s), index);
+    entry.entity = e;
+}
+
+void SpatialIndexSystem::Resync(const Scene& scene)
+{
+    const Registry& reg = scene.reg;
+    mEntries.assign(mEntries.size(), Entry{});
+    mPending.clear();
+    mBuildBoxes.clear();
+    mBuildIds.clear();
+
+    for (Entity e : reg.renderers.Entities())
+    {
+        const uint32_t index = EntityIndex(e);
+        if (index >= mEntries.size())
+            mEntries.resize((size_t)index + 1u);
+        Entry& entry = mEntries[index];
+
+        Sphere s{};
+        if (!Bounds(scene, e, s))
+        {
+            entry.pending = true;
+            mPending.push_back(e);
+            continue;
+        }
+        entry.entity = e;
+        entry.sphere = s;
+        mBuildBoxes.push_back(SphereBounds(s));
+        mBuildIds.push_back(index);
+    }
+
+    // The whole set is known: a top-down build beats inserting one by one.
+    mTree.Build(mBuildBoxes.data(), mBuildIds.data(), mBuildBoxes.size(), &mBuildProxies);
+    for (size_t i = 0; i < mBuildIds.size(); ++i)
+        mEntries[mBuildIds[i]].proxy = mBuildProxies[i];
+
+    mRenderersVersion = reg.renderers.Version();
+    mMeshesVersion = reg.meshes.Version();
+}
+
+void SpatialIndexSystem::Update(const Scene& scene, const TransformSystem& transforms)
+{
+    mLastReinserts = 0;
+    if (scene.reg.renderers.Version() != mRenderersVersion || scene.reg.meshes.Version() != mMeshesVersion)
+    {
+        Resync(scene);
+        mDirty.clear();
+        return;
+    }
+
+    for (Entity e : transforms.UpdatedEntities())
+        Refresh(scene, e);
+    for (Entity e : mDirty)
+        Refresh(scene, e);
+    mDirty.clear();
+
+    mPendingScratch.swap(mPending);
+    mPending.clear();
+    for (Entity e : mPendingScratch)
+    {
+        mEntries[EntityIndex(e)].pending = false;
+        Refresh(scene, e);
+    }
+}
+
+bool SpatialIndexSystem::Raycast(const Float3& origin, const Float3& dir, float maxDistance, RayHit& outHit) const
+{
+    const float len = std::sqrt(dir.x * dir.x + dir.y * dir.y + dir.z * dir.z);
+    if (len <= 0.0f || maxDistance < 0.0f)
+        return false;
+    const Float3 d{ dir.x / len, dir.y / len, dir.z / len };
+
+    bool hit = false;
+    mTree.RayCast(origin, d, maxDistance, [&](uint32_t index, float maxT)
+    {
+        const Sphere& s = mEntries[index].sphere;
+        const Float3 m{ origin.x - s.center.x, origin.y - s.center.y, origin.z - s.center.z };
+        const float b = m.x * d.x + m.y * d.y + m.z * d.z;
+        const float c = m.x * m.x + m.y * m.y + m.z * m.z - s.radius * s.radius;
+        if (c > 0.0f && b > 0.0f)
+            return maxT; // outside and pointing away
+        const float disc = b * b - c;
+        if (disc < 0.0f)
+            return maxT;
+        const float t = std::fmax(0.0f, -b - std::sqrt(disc));
+        if (t > maxT)
+            return maxT;
+        outHit.entity = mEntries[index].entity;
+        outHit.distance = t;
+        hit = true;
+        return t;
+    });
+    return hit;
+}
+
+void SpatialIndexSystem::OverlapSphere(const Sphere& sphere, std::vector<Entity>& outEntities) const
+{
+    mTree.QuerySphere(sphere, [&](uint32_t index)
+    {
+        const Entry& e = mEntries[index];
+        const float dx = e.sphere.center.x - sphere.center.x;
+        const float dy = e.sphere.center.y - sphere.center.y;
+        const float dz = e.sphere.center.z - sphere.center.z;
+        const float reach = e.sphere.radius + sphere.radius;
+        if (dx * dx + dy * dy + dz * dz <= reach * reach)
+            outEntities.push_back(e.entity);
+    });
+}
+
+void SpatialIndexSystem::OverlapAabb(const AABB& box, std::vector<Entity>& outEntities) const
+{
+    mTree.QueryAabb(box, [&](uint32_t index)
+    {
+        const Entry& e = mEntries[index];
+        const Float3& c = e.sphere.center;
+        auto axis = [](float v, float lo, float hi) { return (v < lo) ? lo - v : ((v > hi) ? v - hi : 0.0f); };
+        const float dx = axis(c.x, box.min.x, box.max.x);
+        const float dy = axis(c.y, box.min.y, box.max.y);
+        const float dz = axis(c.z, box.min.z, box.max.z);
+        if (dx * dx + dy * dy + dz * dz <= e.sphere.radius * e.sphere.radius)
+            outEntities.push_back(e.entity);
+    });
+}
+
+void SpatialIndexSystem::OverlapFrustum(const Frustum& frustum, std::vector<Entity>& outEntities) const
+{
+    mTree.QueryFrustum(frustum, [&](uint32_t index)
+    {
+        const Entry& e = mEntries[index];
+        if (frustum.Intersects(e.sphere))
+            outEntities.push_back(e.entity);
+    });
+}
+
+} // namespace king::systems
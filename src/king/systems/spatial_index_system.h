@@ -0,0 +1,84 @@
+#pragma once
+
+#include "../ecs/scene.h"
+#include "../scene/bvh.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace king::systems
+{
+
+class TransformSystem;
+
+struct RayHit
+{
+    Entity entity = kInvalidEntity;
+    float distance = 0.0f; // along the (normalized) ray direction
+};
+
+// Scene-wide BVH over the world bounding spheres of every drawable MeshRenderer (mesh cooked),
+// for gameplay raycasts and overlap queries. Run after TransformSystem: only the entities it
+// recomputed are refit (most stay inside their fat box and cost a compare); adding or
+// removing renderers or meshes re-syncs the whole set, and renderers whose mesh is not cooked
+// yet are retried every Update. Changing MeshRenderer::mesh in place, or re-cooking a mesh,
+// needs MarkDirty.
+//
+// Queries test the exact spheres, not the fat boxes; they are const and may run anywhere
+// Update is not running.
+class SpatialIndexSystem
+{
+public:
+    // margin: how far (world units) a proxy may move before it is re-inserted.
+    explicit SpatialIndexSystem(float margin = 0.25f) : mTree(margin) {}
+
+    void Update(const Scene& scene, const TransformSystem& transforms);
+    void MarkDirty(Entity e) { mDirty.push_back(e); }
+
+    size_t ProxyCount() const { return mTree.ProxyCount(); }
+    uint32_t TreeHeight() const { return mTree.Height(); }
+    // Proxies re-inserted by the last Update.
+    uint32_t LastReinsertCount() const { return mLastReinserts; }
+
+    // Nearest sphere hit by origin + t * dir, t in [0, maxDistance]. dir need not be normalized.
+    // An origin inside a sphere hits it at distance 0.
+    bool Raycast(const Float3& origin, const Float3& dir, float maxDistance, RayHit& outHit) const;
+    // Appends the entities whose sphere overlaps the shape.
+    void OverlapSphere(const Sphere& sphere, std::vector<Entity>& outEntities) const;
+    void OverlapAabb(const AABB& box, std::vector<Entity>& outEntities) const;
+    void OverlapFrustum(const Frustum& frustum, std::vector<Entity>& outEntities) const;
+
+private:
+    static constexpr uint32_t kNoProxy = 0xFFFFFFFFu;
+
+    struct Entry
+    {
+        uint32_t proxy = kNoProxy;
+        Entity entity = kInvalidEntity;
+        Sphere sphere{};
+        bool pending = false; // in mPending
+    };
+
+    // World bounding sphere of a drawable renderer; false if e has none.
+    static bool Bounds(const Scene& scene, Entity e, Sphere& out);
+    void Resync(const Scene& scene);
+    void Refresh(const Scene& scene, Entity e);
+    void Drop(uint32_t entityIndex);
+
+    Bvh mTree;
+    // Indexed by EntityIndex; proxies carry the entity index as their user value.
+    std::vector<Entry> mEntries;
+    std::vector<AABB> mBuildBoxes;
+    std::vector<uint32_t> mBuildIds;
+    std::vector<uint32_t> mBuildProxies;
+    std::vector<Entity> mDirty;
+    // Renderers without a drawable mesh yet, and the copy being retried.
+    std::vector<Entity> mPending;
+    std::vector<Entity> mPendingScratch;
+
+    uint64_t mRenderersVersion = ~0ull;
+    uint64_t mMeshesVersion = ~0ull;
+    uint32_t mLastReinserts = 0;
+};
+
+} // namespace king::systems
@@ -0,0 +1,236 @@
+#include "transform_system.h"
+
+#include "../jobs/job_system.h"
+#include "../math/dxmath.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+namespace king::systems
+{
+
+static_assert(sizeof(Transform) == sizeof(float) * 10 + sizeof(Entity), "Transform must stay padding-free for SameLocal");
+
+static bool SameLocal(const Transform& a, const Transform& b)
+{
+    return std::memcmp(&a, &b, sizeof(Transform)) == 0;
+}
+
+void TransformSystem::ComputeWorld(const Transform& local, const WorldTransform* parent, WorldTransform& out)
+{
+    using namespace DirectX;
+    const XMVECTOR q = XMVectorSet(local.rotation.x, local.rotation.y, local.rotation.z, local.rotation.w);
+    const XMMATRIX S = XMMatrixScaling(local.scale.x, local.scale.y, local.scale.z);
+    const XMMATRIX R = XMMatrixRotationQuaternion(q);
+    const XMMATRIX T = XMMatrixTranslation(local.position.x, local.position.y, local.position.z);
+    XMMATRIX W = S * R * T;
+
+    if (parent)
+        W = W * dx::LoadMat4x4(parent->world);
+
+    out.world = dx::StoreMat4x4(W);
+
+    const float lx = XMVectorGetX(XMVector3Length(W.r[0]));
+    const float ly = XMVectorGetX(XMVector3Length(W.r[1]));
+    const float lz = XMVectorGetX(XMVector3Length(W.r[2]));
+    out.maxScale = std::max(lx, std::max(ly, lz));
+}
+
+void TransformSystem::RebuildOrder(Registry& reg)
+{
+    SparseSet<Transform>& transforms = reg.transforms;
+    SparseSet<WorldTransform>& worlds = reg.worldTransforms;
+
+    // Drop caches whose Transform was removed, then create the missing ones.
+    mStale.clear();
+    for (Entity e : worlds.Entities())
+    {
+        if (!transforms.Has(e))
+            mStale.push_back(e);
+    }
+    for (Entity e : mStale)
+        worlds.Remove(e);
+
+    const uint32_t count = (uint32_t)transforms.Size();
+    const std::vector<Entity>& entities = transforms.Entities();
+    const std::vector<Transform>& locals = transforms.Data();
+
+    // mChanged doubles as the per-slot "cache just created" flag until the nodes are built.
+    mChanged.assign(count, 0);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (!worlds.Has(entities[i]))
+        {
+            worlds.Emplace(entities[i]);
+            mChanged[i] = 1;
+        }
+    }
+
+    // Parent slot per transform slot.
+    mParentDense.assign(count, kNoParent);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const Entity p = locals[i].parent;
+        if (p == kInvalidEntity)
+            continue;
+        const Transform* pt = transforms.TryGet(p);
+        if (pt)
+            mParentDense[i] = (uint32_t)(pt - locals.data());
+    }
+
+    // Depth per slot: walk up to the nearest known ancestor, then assign on the way back.
+    constexpr uint32_t kUnknown = 0xFFFFFFFFu;
+    constexpr uint32_t kVisiting = 0xFFFFFFFEu;
+    mDepth.assign(count, kUnknown);
+    uint32_t maxDepth = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (mDepth[i] != kUnknown)
+            continue;
+
+        mStack.clear();
+        uint32_t j = i;
+        while (j != kNoParent && mDepth[j] == kUnknown)
+        {
+            mDepth[j] = kVisiting;
+            mStack.push_back(j);
+            j = mParentDense[j];
+        }
+
+        uint32_t depth = 0;
+        if (j != kNoParent)
+        {
+            if (mDepth[j] == kVisiting)
+            {
+                // Loop back into the current chain: cut it here, making this node a root.
+                std::printf("[ECS] TransformSystem: parent cycle at entity 0x%08X, treating it as a root\n", entities[mStack.back()]);
+                mParentDense[mStack.back()] = kNoParent;
+            }
+            else
+            {
+                depth = mDepth[j] + 1u;
+            }
+        }
+
+        for (size_t k = mStack.size(); k-- > 0;)
+            mDepth[mStack[k]] = depth++;
+        maxDepth = std::max(maxDepth, depth - 1u);
+    }
+
+    // Counting sort by depth: parents always land in an earlier level than their children.
+    mLevelStart.assign((size_t)maxDepth + 2u, 0);
+    for (uint32_t i = 0; i < count; ++i)
+        mLevelStart[(size_t)mDepth[i] + 1u]++;
+    for (size_t l = 1; l < mLevelStart.size(); ++l)
+        mLevelStart[l] += mLevelStart[l - 1];
+
+    mNodeOf.resize(count);
+    mStack.assign(mLevelStart.begin(), mLevelStart.end()); // fill cursor per level
+    for (uint32_t i = 0; i < count; ++i)
+        mNodeOf[i] = mStack[mDepth[i]]++;
+
+    mNodes.resize(count);
+    const WorldTransform* worldBase = worlds.Data().data();
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Node& n = mNodes[mNodeOf[i]];
+        n.transform = i;
+        n.world = (uint32_t)(worlds.TryGet(entities[i]) - worldBase);
+        n.parent = (mParentDense[i] != kNoParent) ? mNodeOf[mParentDense[i]] : kNoParent;
+        n.parentEntity = locals[i].parent;
+        // New caches, and children whose parent lost its Transform (their cached world
+        // still includes the old parent) must be rebuilt even if the local is unchanged.
+        n.force = mChanged[i] != 0 || (n.parentEntity != kInvalidEntity && n.parent == kNoParent);
+    }
+
+    mTransformsVersion = transforms.Version();
+    mWorldsVersion = worlds.Version();
+}
+
+void TransformSystem::Update(Scene& scene, uint32_t workerThreads)
+{
+    Registry& reg = scene.reg;
+    if (reg.transforms.Version() != mTransformsVersion || reg.worldTransforms.Version() != mWorldsVersion)
+        RebuildOrder(reg);
+
+    JobSystem& jobs = GetJobSystem();
+    std::atomic<size_t> updated{ 0 };
+    mUpdatedEntities.clear();
+
+    // A second pass only runs if an entity was reparented since the order was built.
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        const std::vector<Transform>& locals = reg.transforms.Data();
+        std::vector<WorldTransform>& worlds = reg.worldTransforms.Data();
+        std::atomic<bool> reparented{ false };
+        const size_t updatedBefore = updated.load(std::memory_order_relaxed);
+
+        auto updateRange = [&](size_t begin, size_t end)
+        {
+            size_t n = 0;
+            for (size_t k = begin; k < end; ++k)
+            {
+                Node& node = mNodes[k];
+                const Transform& t = locals[node.transform];
+                WorldTransform& w = worlds[node.world];
+
+                if (t.parent != node.parentEntity)
+                {
+                    // Order is stale for this subtree. Leave the cache untouched so the
+                    // mismatch is seen again after the rebuild.
+                    reparented.store(true, std::memory_order_relaxed);
+                    mChanged[k] = 0;
+                    continue;
+                }
+
+                const bool parentChanged = node.parent != kNoParent && mChanged[node.parent] != 0;
+                if (!node.force && !parentChanged && SameLocal(t, w.local))
+                {
+                    mChanged[k] = 0;
+                    continue;
+                }
+
+                ComputeWorld(t, (node.parent != kNoParent) ? &worlds[mNodes[node.parent].world] : nullptr, w);
+                w.local = t;
+                ++w.revision;
+                node.force = false;
+                mChanged[k] = 1;
+                ++n;
+            }
+            updated.fetch_add(n, std::memory_order_relaxed);
+        };
+
+        // Levels run in order; nodes within a level only read the previous levels.
+        constexpr size_t kLevelChunk = 1024;
+        for (size_t l = 0; l + 1 < mLevelStart.size(); ++l)
+        {
+            const size_t begin = mLevelStart[l];
+            const size_t end = mLevelStart[l + 1];
+            if (workerThreads > 0)
+                jobs.ParallelFor(end - begin, kLevelChunk, [&](size_t b, size_t e) { updateRange(begin + b, begin + e); }, workerThreads + 1u);
+            else
+                updateRange(begin, end);
+        }
+
+        // The dirty set, gathered after the levels so the parallel loop stays write-local.
+        if (updated.load(std::memory_order_relaxed) > updatedBefore)
+        {
+            const std::vector<Entity>& worldEntities = reg.worldTransforms.Entities();
+            for (size_t k = 0; k < mNodes.size(); ++k)
+            {
+                if (mChanged[k] != 0)
+                    mUpdatedEntities.push_back(worldEntities[mNodes[k].world]);
+            }
+        }
+
+        if (!reparented.load(std::memory_order_relaxed))
+            break;
+        RebuildOrder(reg);
+    }
+
+    mLastUpdated = updated.load(std::memory_order_relaxed);
+}
+
+} // namespace king::systems
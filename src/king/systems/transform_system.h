@@ -0,0 +1,64 @@
+#pragma once
+
+#include "../ecs/scene.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace king::systems
+{
+
+// Maintains a WorldTransform for every entity with a Transform, honoring Transform::parent.
+// Entities are walked in parent-before-child order (cached, rebuilt on structural changes or
+// reparenting); only entities whose local Transform changed, plus their descendants, are
+// recomputed. A parent without a Transform is treated as absent; parent cycles are broken
+// (with a warning) at the entity that closes the loop.
+class TransformSystem
+{
+public:
+    // workerThreads caps how many job workers share each hierarchy level (0 = inline).
+    void Update(Scene& scene, uint32_t workerThreads = 0);
+
+    // Entities recomputed by the last Update.
+    size_t LastUpdatedCount() const { return mLastUpdated; }
+    // Those entities (parents before children). An entity can appear twice if it was
+    // reparented during the Update.
+    const std::vector<Entity>& UpdatedEntities() const { return mUpdatedEntities; }
+
+    // World matrices for `local` under `parent` (nullptr = root).
+    static void ComputeWorld(const Transform& local, const WorldTransform* parent, WorldTransform& out);
+
+private:
+    static constexpr uint32_t kNoParent = 0xFFFFFFFFu;
+
+    struct Node
+    {
+        uint32_t transform = 0;      // dense index in Registry::transforms
+        uint32_t world = 0;          // dense index in Registry::worldTransforms
+        uint32_t parent = kNoParent; // index in mNodes
+        Entity parentEntity = kInvalidEntity; // Transform::parent the order was built from
+        bool force = false;          // recompute even if the local transform looks unchanged
+    };
+
+    void RebuildOrder(Registry& reg);
+
+    // Nodes sorted by hierarchy depth; level L is [mLevelStart[L], mLevelStart[L + 1]).
+    std::vector<Node> mNodes;
+    std::vector<uint32_t> mLevelStart;
+    // Per node: recomputed during the current Update (children of changed nodes follow).
+    std::vector<uint8_t> mChanged;
+
+    // RebuildOrder scratch, kept to avoid per-rebuild allocation.
+    std::vector<uint32_t> mDepth;
+    std::vector<uint32_t> mParentDense;
+    std::vector<uint32_t> mNodeOf;
+    std::vector<uint32_t> mStack;
+    std::vector<Entity> mStale;
+    std::vector<Entity> mUpdatedEntities;
+
+    uint64_t mTransformsVersion = ~0ull;
+    uint64_t mWorldsVersion = ~0ull;
+    size_t mLastUpdated = 0;
+};
+
+} // namespace king::systems
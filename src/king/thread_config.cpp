@@ -1,7 +1,9 @@
 #include "thread_config.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cstdio>
 #include <cstdlib>
 #include <fstream>
 #include <vector>
@@ -43,12 +45,59 @@ static void ApplyCfgKeyValue(ThreadConfig& cfg, const std::string& keyRaw, const
     const unsigned long v = std::strtoul(val.c_str(), &end, 10);
     (void)end;
     const uint32_t u = (uint32_t)v;
+    // Masks: base prefix allowed (0x...). Priorities are signed.
+    const uint64_t mask = (uint64_t)std::strtoull(val.c_str(), nullptr, 0);
+    long prio = std::strtol(val.c_str(), nullptr, 10);
+    prio = (prio < -2) ? -2 : ((prio > 2) ? 2 : prio);
 
     if (key == "threads_max") cfg.maxThreads = u;
     else if (key == "threads_ecs") cfg.ecsWorkerThreads = u;
     else if (key == "threads_render_prepare") cfg.renderPrepareWorkerThreads = u;
     else if (key == "threads_render_shadows") cfg.renderShadowRecordThreads = u;
     else if (key == "threads_render_deferred_contexts") cfg.renderDeferredContexts = u;
+    else if (key == "threads_autotune") cfg.autoTune = (u != 0);
+    else if (key == "affinity_jobs") cfg.jobWorkers.affinityMask = mask;
+    else if (key == "priority_jobs") cfg.jobWorkers.priority = (int32_t)prio;
+    else if (key == "affinity_render_prepare") cfg.renderPrepare.affinityMask = mask;
+    else if (key == "priority_render_prepare") cfg.renderPrepare.priority = (int32_t)prio;
+    else if (key == "affinity_streaming") cfg.streaming.affinityMask = mask;
+    else if (key == "priority_streaming") cfg.streaming.priority = (int32_t)prio;
+}
+
+// thread_config.cfg next to the executable, or empty if that cannot be resolved.
+static std::string ExeConfigPath()
+{
+#ifdef _WIN32
+    std::vector<wchar_t> buf;
+    buf.resize(32768);
+    DWORD n = GetModuleFileNameW(nullptr, buf.data(), (DWORD)buf.size());
+    if (n == 0 || n >= buf.size())
+        return {};
+
+    // Strip filename
+    size_t end = n;
+    while (end > 0)
+    {
+        wchar_t c = buf[end - 1];
+        if (c == L'\\' || c == L'/')
+            break;
+        --end;
+    }
+
+    std::wstring dir(buf.data(), buf.data() + end);
+    std::wstring cfgPath = dir + L"thread_config.cfg";
+
+    // Convert to UTF-8 for std::ifstream path.
+    int needed = WideCharToMultiByte(CP_UTF8, 0, cfgPath.c_str(), (int)cfgPath.size(), nullptr, 0, nullptr, nullptr);
+    if (needed <= 0)
+        return {};
+    std::string u8;
+    u8.resize((size_t)needed);
+    WideCharToMultiByte(CP_UTF8, 0, cfgPath.c_str(), (int)cfgPath.size(), u8.data(), needed, nullptr, nullptr);
+    return u8;
+#else
+    return {};
+#endif
 }
 
 static void LoadFromConfigFile(ThreadConfig& cfg)
@@ -80,41 +129,11 @@ static void LoadFromConfigFile(ThreadConfig& cfg)
         return true;
     };
 
-#ifdef _WIN32
     // Prefer config next to the executable (more robust than relying on CWD).
     // Example: build\Debug\thread_config.cfg
-    {
-        std::vector<wchar_t> buf;
-        buf.resize(32768);
-        DWORD n = GetModuleFileNameW(nullptr, buf.data(), (DWORD)buf.size());
-        if (n > 0 && n < buf.size())
-        {
-            // Strip filename
-            size_t end = n;
-            while (end > 0)
-            {
-                wchar_t c = buf[end - 1];
-                if (c == L'\\' || c == L'/')
-                    break;
-                --end;
-            }
-
-            std::wstring dir(buf.data(), buf.data() + end);
-            std::wstring cfgPath = dir + L"thread_config.cfg";
-
-            // Convert to UTF-8 for std::ifstream path.
-            int needed = WideCharToMultiByte(CP_UTF8, 0, cfgPath.c_str(), (int)cfgPath.size(), nullptr, 0, nullptr, nullptr);
-            if (needed > 0)
-            {
-                std::string u8;
-                u8.resize((size_t)needed);
-                WideCharToMultiByte(CP_UTF8, 0, cfgPath.c_str(), (int)cfgPath.size(), u8.data(), needed, nullptr, nullptr);
-                if (ParseFile(u8.c_str()))
-                    return;
-            }
-        }
-    }
-#endif
+    const std::string exePath = ExeConfigPath();
+    if (!exePath.empty() && ParseFile(exePath.c_str()))
+        return;
 
     // Fall back to current working directory.
     (void)ParseFile("thread_config.cfg");
@@ -154,6 +173,14 @@ static bool EnvFlagW(const wchar_t*)
 }
 #endif
 
+static void ClampConfig(ThreadConfig& cfg)
+{
+    cfg.ecsWorkerThreads = ClampToMax(cfg.ecsWorkerThreads, cfg.maxThreads);
+    cfg.renderPrepareWorkerThreads = ClampToMax(cfg.renderPrepareWorkerThreads, cfg.maxThreads);
+    cfg.renderShadowRecordThreads = ClampToMax(cfg.renderShadowRecordThreads, cfg.maxThreads);
+    cfg.renderDeferredContexts = ClampToMax(cfg.renderDeferredContexts, cfg.maxThreads);
+}
+
 ThreadConfig LoadThreadConfig()
 {
     ThreadConfig cfg{};
@@ -173,19 +200,94 @@ ThreadConfig LoadThreadConfig()
     cfg.renderPrepareWorkerThreads = EnvUIntW(L"KING_THREADS_RENDER_PREPARE", cfg.renderPrepareWorkerThreads);
     cfg.renderShadowRecordThreads = EnvUIntW(L"KING_THREADS_RENDER_SHADOWS", cfg.renderShadowRecordThreads);
     cfg.renderDeferredContexts = EnvUIntW(L"KING_THREADS_RENDER_DEFERRED_CONTEXTS", cfg.renderDeferredContexts);
+    cfg.autoTune = EnvUIntW(L"KING_THREADS_AUTOTUNE", cfg.autoTune ? 1u : 0u) != 0;
 
-    cfg.ecsWorkerThreads = ClampToMax(cfg.ecsWorkerThreads, cfg.maxThreads);
-    cfg.renderPrepareWorkerThreads = ClampToMax(cfg.renderPrepareWorkerThreads, cfg.maxThreads);
-    cfg.renderShadowRecordThreads = ClampToMax(cfg.renderShadowRecordThreads, cfg.maxThreads);
-    cfg.renderDeferredContexts = ClampToMax(cfg.renderDeferredContexts, cfg.maxThreads);
-
+    ClampConfig(cfg);
     return cfg;
 }
 
-const ThreadConfig& GetThreadConfig()
+bool SaveThreadConfig(const ThreadConfig& cfg)
+{
+    std::ofstream f;
+    const std::string exePath = ExeConfigPath();
+    if (!exePath.empty())
+        f.open(exePath.c_str(), std::ios::trunc);
+    if (!f.is_open())
+        f.open("thread_config.cfg", std::ios::trunc);
+    if (!f.is_open())
+        return false;
+
+    auto writePlacement = [&](const char* name, const ThreadPlacement& p)
+    {
+        char mask[32];
+        std::snprintf(mask, sizeof(mask), "0x%llx", (unsigned long long)p.affinityMask);
+        f << "affinity_" << name << "=" << mask << "\n";
+        f << "priority_" << name << "=" << p.priority << "\n";
+    };
+
+    f << "# King thread config\n";
+    f << "threads_max=" << cfg.maxThreads << "\n";
+    f << "threads_ecs=" << cfg.ecsWorkerThreads << "\n";
+    f << "threads_render_prepare=" << cfg.renderPrepareWorkerThreads << "\n";
+    f << "threads_render_shadows=" << cfg.renderShadowRecordThreads << "\n";
+    f << "threads_render_deferred_contexts=" << cfg.renderDeferredContexts << "\n";
+    f << "threads_autotune=" << (cfg.autoTune ? 1 : 0) << "\n";
+    f << "# Affinity: bit i = logical processor i (0 = any). Priority: -2..2 (0 = normal).\n";
+    writePlacement("jobs", cfg.jobWorkers);
+    writePlacement("render_prepare", cfg.renderPrepare);
+    writePlacement("streaming", cfg.streaming);
+    return (bool)f;
+}
+
+static ThreadConfig& LiveConfig()
 {
     static ThreadConfig cfg = LoadThreadConfig();
     return cfg;
 }
 
+static std::atomic<uint32_t> sGeneration{ 0 };
+
+const ThreadConfig& GetThreadConfig()
+{
+    return LiveConfig();
+}
+
+void SetThreadConfig(const ThreadConfig& cfg)
+{
+    ThreadConfig& live = LiveConfig();
+    live = cfg;
+    ClampConfig(live);
+    sGeneration.fetch_add(1, std::memory_order_release);
+}
+
+uint32_t ThreadConfigGeneration()
+{
+    return sGeneration.load(std::memory_order_acquire);
+}
+
+bool ApplyThreadPlacement(const ThreadPlacement& placement)
+{
+    if (placement.IsDefault())
+        return true;
+
+#ifdef _WIN32
+    bool ok = true;
+    HANDLE self = GetCurrentThread();
+    if (placement.affinityMask != 0)
+        ok = SetThreadAffinityMask(self, (DWORD_PTR)placement.affinityMask) != 0;
+    if (placement.priority != 0)
+    {
+        static const int kPriorities[5] = {
+            THREAD_PRIORITY_LOWEST, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL,
+            THREAD_PRIORITY_ABOVE_NORMAL, THREAD_PRIORITY_HIGHEST
+        };
+        const int32_t p = (placement.priority < -2) ? -2 : ((placement.priority > 2) ? 2 : placement.priority);
+        ok = (SetThreadPriority(self, kPriorities[p + 2]) != 0) && ok;
+    }
+    return ok;
+#else
+    return false;
+#endif
+}
+
 } // namespace king
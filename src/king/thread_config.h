@@ -4,9 +4,25 @@
 
 namespace king
 {
+// Where a thread runs: which cores it may use and at what priority. Applied by the thread
+// itself when it starts (ApplyThreadPlacement).
+struct ThreadPlacement
+{
+    // Bit i = logical processor i. 0 = leave to the OS.
+    uint64_t affinityMask = 0;
+    // -2 (lowest) .. 2 (highest), 0 = normal.
+    int32_t priority = 0;
+
+    bool IsDefault() const { return affinityMask == 0 && priority == 0; }
+    bool operator==(const ThreadPlacement& o) const { return affinityMask == o.affinityMask && priority == o.priority; }
+    bool operator!=(const ThreadPlacement& o) const { return !(*this == o); }
+};
+
 struct ThreadConfig
 {
     // 0 = run single-threaded for that subsystem.
+    // All subsystems share the engine JobSystem; its worker count is the largest of the
+    // budgets below (clamped by maxThreads), see JobWorkerCountFromConfig.
 
     // Render: CPU frame prep worker (BuildPreparedFrame off-thread).
     // Current implementation is either 0 (disabled) or 1 (enabled).
@@ -20,12 +36,23 @@ struct ThreadConfig
     // 0 = create the minimal number needed (1).
     uint32_t renderDeferredContexts = 0;
 
-    // ECS: reserved for ECS parallel iteration / system scheduling.
-    // (ECS is currently single-threaded, but subsystems can consult this.)
+    // ECS: worker threads for the SystemScheduler (concurrent systems + ParallelFor chunks).
+    // 0 = systems run inline on the main thread, in registration order. The renderer's CPU
+    // culling and draw sorting use the same cap.
     uint32_t ecsWorkerThreads = 0;
 
     // Optional global clamp. 0 = no clamp.
     uint32_t maxThreads = 0;
+
+    // Placement per subsystem. Job workers follow jobWorkers, except the last worker, which
+    // hosts the long-running frame prep job and follows renderPrepare. Streaming covers the
+    // asset streamer and the texture loader, and is read when those threads start.
+    ThreadPlacement jobWorkers{};
+    ThreadPlacement renderPrepare{};
+    ThreadPlacement streaming{};
+
+    // Time a few worker counts over the first frames and keep the fastest (ThreadAutoTuner).
+    bool autoTune = false;
 };
 
 // Loads config from thread_config.cfg (prefers next to the executable, then CWD)
@@ -36,9 +63,27 @@ struct ThreadConfig
 // - KING_THREADS_RENDER_PREPARE
 // - KING_THREADS_RENDER_SHADOWS
 // - KING_THREADS_RENDER_DEFERRED_CONTEXTS
+// - KING_THREADS_AUTOTUNE
+// The placement keys (affinity_jobs, priority_jobs, affinity_render_prepare, ...) are
+// file-only; masks may be written in hex (0xF0).
 ThreadConfig LoadThreadConfig();
 
-// Cached singleton (calls LoadThreadConfig() once on first use).
+// Writes every key to thread_config.cfg (next to the executable, else CWD). False if the
+// file cannot be opened.
+bool SaveThreadConfig(const ThreadConfig& cfg);
+
+// The live config (LoadThreadConfig() on first use).
 const ThreadConfig& GetThreadConfig();
 
+// Replaces the live config (budgets clamped by maxThreads) and bumps the generation. Main
+// thread, between frames. Nothing is rebuilt here: the caller runs RebalanceJobSystem and
+// forwards the ECS budget (SystemScheduler / Registry::SetWorkerThreads); the renderer
+// re-reads its own budgets when ThreadConfigGeneration() moves.
+void SetThreadConfig(const ThreadConfig& cfg);
+uint32_t ThreadConfigGeneration();
+
+// Applies the placement to the calling thread; false if the OS rejected it (e.g. a mask
+// with no processor of this machine). A default placement is a no-op.
+bool ApplyThreadPlacement(const ThreadPlacement& placement);
+
 } // namespace king
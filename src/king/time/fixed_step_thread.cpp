@@ -0,0 +1,196 @@
+#include "fixed_step_thread.h"
+
+#include "time.h"
+#include "../perf/trace_capture.h"
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cmath>
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+namespace king
+{
+
+FixedStepThread::~FixedStepThread()
+{
+    Stop();
+}
+
+bool FixedStepThread::Start(double fixedDeltaSeconds, size_t bodyCount, StepFn step)
+{
+    if (Running() || !(fixedDeltaSeconds > 0.0) || !step)
+        return false;
+
+    mStep = std::move(step);
+    mFixedDeltaSeconds = fixedDeltaSeconds;
+    mBodyCount.store(bodyCount, std::memory_order_relaxed);
+    mStop.store(false, std::memory_order_relaxed);
+    mWork.clear();
+    {
+        std::lock_guard<std::mutex> lock(mPublishMutex);
+        mPublished[0].clear();
+        mPublished[1].clear();
+        mNewest = 0;
+        mPublishedSteps = 0;
+    }
+    mStepCount.store(0, std::memory_order_relaxed);
+    mDroppedSteps.store(0, std::memory_order_relaxed);
+
+    mStopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (!mStopEvent)
+        return false;
+
+    mThread = std::thread([this]() { ThreadMain(); });
+    return true;
+}
+
+void FixedStepThread::Stop()
+{
+    mStop.store(true, std::memory_order_relaxed);
+    if (mStopEvent)
+        SetEvent((HANDLE)mStopEvent);
+    if (mThread.joinable())
+        mThread.join();
+    if (mStopEvent)
+    {
+        CloseHandle((HANDLE)mStopEvent);
+        mStopEvent = nullptr;
+    }
+    mStep = nullptr;
+}
+
+void FixedStepThread::ThreadMain()
+{
+    king::perf::TraceCapture::SetThreadName("Simulation");
+
+    // Sleep() and timed waits round up to the system timer period (up to 15.6 ms); the high
+    // resolution timer (Windows 10 1803+) wakes within a fraction of a millisecond.
+    HANDLE timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!timer)
+        timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+
+    Time time;
+    time.SetFixedDeltaSeconds(mFixedDeltaSeconds);
+    // Long stalls (debugger, suspend) are clamped away rather than replayed.
+    time.SetMaxDeltaSeconds(mFixedDeltaSeconds * (double)(kMaxStepsPerTick * 4));
+    time.Reset();
+
+    while (!mStop.load(std::memory_order_relaxed))
+    {
+        time.Tick();
+
+        int steps = 0;
+        while (time.ConsumeFixedStep())
+        {
+            if (steps++ >= kMaxStepsPerTick)
+            {
+                mDroppedSteps.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            mWork.resize(mBodyCount.load(std::memory_order_relaxed));
+            {
+                king::perf::TraceScope trace("SimStep");
+                mStep(time.FixedTimeSeconds(), mFixedDeltaSeconds, mWork);
+            }
+            Publish();
+        }
+
+        // Until the accumulator holds the next step.
+        const double waitSeconds = (1.0 - time.Alpha()) * mFixedDeltaSeconds;
+        if (timer)
+        {
+            LARGE_INTEGER due{};
+            due.QuadPart = -(LONGLONG)(waitSeconds * 1e7); // relative, 100 ns units
+            if (due.QuadPart < 0 && SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE))
+            {
+                HANDLE handles[2] = { (HANDLE)mStopEvent, timer };
+                (void)WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+            }
+        }
+        else
+        {
+            (void)WaitForSingleObject((HANDLE)mStopEvent, (DWORD)(waitSeconds * 1000.0));
+        }
+    }
+
+    if (timer)
+        CloseHandle(timer);
+}
+
+void FixedStepThread::Publish()
+{
+    std::lock_guard<std::mutex> lock(mPublishMutex);
+    const uint32_t slot = mNewest ^ 1u;
+    mPublished[slot] = mWork; // reuses the slot's capacity
+    mNewest = slot;
+    mPublishedSteps = std::min(mPublishedSteps + 1u, 2u);
+    mPublishTime = std::chrono::steady_clock::now();
+    mStepCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool FixedStepThread::Sample(std::vector<Transform>& out, float* outAlpha) const
+{
+    std::lock_guard<std::mutex> lock(mPublishMutex);
+    if (mPublishedSteps == 0)
+        return false;
+
+    const std::vector<Transform>& newest = mPublished[mNewest];
+    const std::vector<Transform>& previous = mPublished[mNewest ^ 1u];
+    out.resize(newest.size());
+
+    float alpha = 1.0f;
+    if (mPublishedSteps > 1)
+    {
+        const double since = std::chrono::duration<double>(std::chrono::steady_clock::now() - mPublishTime).count();
+        alpha = (float)std::clamp(since / mFixedDeltaSeconds, 0.0, 1.0);
+    }
+
+    const size_t blended = (mPublishedSteps > 1) ? std::min(previous.size(), newest.size()) : 0;
+    for (size_t i = 0; i < blended; ++i)
+        Interpolate(previous[i], newest[i], alpha, out[i]);
+    for (size_t i = blended; i < newest.size(); ++i)
+        out[i] = newest[i];
+
+    if (outAlpha)
+        *outAlpha = alpha;
+    return true;
+}
+
+void FixedStepThread::Interpolate(const Transform& a, const Transform& b, float t, Transform& out)
+{
+    out.position = { a.position.x + (b.position.x - a.position.x) * t,
+                     a.position.y + (b.position.y - a.position.y) * t,
+                     a.position.z + (b.position.z - a.position.z) * t };
+    out.scale = { a.scale.x + (b.scale.x - a.scale.x) * t,
+                  a.scale.y + (b.scale.y - a.scale.y) * t,
+                  a.scale.z + (b.scale.z - a.scale.z) * t };
+
+    // q and -q are the same rotation; flip b onto a's hemisphere for the shorter arc.
+    const Float4& qa = a.rotation;
+    Float4 qb = b.rotation;
+    if (qa.x * qb.x + qa.y * qb.y + qa.z * qb.z + qa.w * qb.w < 0.0f)
+        qb = { -qb.x, -qb.y, -qb.z, -qb.w };
+    Float4 q{ qa.x + (qb.x - qa.x) * t,
+              qa.y + (qb.y - qa.y) * t,
+              qa.z + (qb.z - qa.z) * t,
+              qa.w + (qb.w - qa.w) * t };
+    const float len = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+    if (len > 1e-8f)
+    {
+        const float inv = 1.0f / len;
+        q = { q.x * inv, q.y * inv, q.z * inv, q.w * inv };
+    }
+    else
+    {
+        q = b.rotation;
+    }
+    out.rotation = q;
+    out.parent = b.parent;
+}
+
+} // namespace king
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../ecs/components.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace king
+{
+
+// Fixed-step simulation on a thread of its own. Each step advances a private array of
+// transforms (one per simulated body) and publishes it. The last two published steps are
+// double-buffered: the render thread interpolates between them and never waits for a step, and
+// a slow frame does not stretch one.
+//
+// The thread keeps its own Time: it sleeps until the next step is due (Time::Alpha() of its
+// accumulator), runs at most kMaxStepsPerTick steps to catch up, and drops the rest.
+class FixedStepThread
+{
+public:
+    // Advances `state` (index = body) by one step of dtSeconds ending at timeSeconds. Runs on
+    // the simulation thread. Bodies added by SetBodyCount arrive as default Transforms.
+    using StepFn = std::function<void(double timeSeconds, double dtSeconds, std::vector<Transform>& state)>;
+
+    static constexpr int kMaxStepsPerTick = 6;
+
+    FixedStepThread() = default;
+    ~FixedStepThread();
+
+    FixedStepThread(const FixedStepThread&) = delete;
+    FixedStepThread& operator=(const FixedStepThread&) = delete;
+
+    // Returns false if already running or fixedDeltaSeconds <= 0.
+    bool Start(double fixedDeltaSeconds, size_t bodyCount, StepFn step);
+    void Stop();
+    bool Running() const { return mThread.joinable(); }
+
+    // Body count from the next step on (any thread).
+    void SetBodyCount(size_t count) { mBodyCount.store(count, std::memory_order_relaxed); }
+
+    // The published state interpolated to now: between the step before the newest and the
+    // newest one, by the time since the newest was published over the step length (the
+    // simulation clock's Alpha() at the moment of sampling). out takes the newest step's body
+    // count. Returns false until a step has been published.
+    bool Sample(std::vector<Transform>& out, float* outAlpha = nullptr) const;
+
+    uint64_t StepCount() const { return mStepCount.load(std::memory_order_relaxed); }
+    // Steps skipped because the simulation fell more than kMaxStepsPerTick behind.
+    uint64_t DroppedSteps() const { return mDroppedSteps.load(std::memory_order_relaxed); }
+
+    // Lerp of position and scale, normalized lerp of rotation along the shorter arc.
+    static void Interpolate(const Transform& a, const Transform& b, float t, Transform& out);
+
+private:
+    void ThreadMain();
+    void Publish();
+
+private:
+    std::thread mThread;
+    StepFn mStep;
+    double mFixedDeltaSeconds = 1.0 / 60.0;
+    std::atomic<size_t> mBodyCount{ 0 };
+    std::atomic<bool> mStop{ false };
+    // Wakes the thread early on Stop (a manual-reset event; HANDLE kept opaque here).
+    void* mStopEvent = nullptr;
+
+    // Simulation thread only.
+    std::vector<Transform> mWork;
+
+    // Guarded by mPublishMutex. mPublished[mNewest] is the newest step, the other slot the one
+    // before it.
+    mutable std::mutex mPublishMutex;
+    std::vector<Transform> mPublished[2];
+    uint32_t mNewest = 0;
+    uint32_t mPublishedSteps = 0; // saturates at 2
+    std::chrono::steady_clock::time_point mPublishTime;
+
+    std::atomic<uint64_t> mStepCount{ 0 };
+    std::atomic<uint64_t> mDroppedSteps{ 0 };
+};
+
+} // namespace king
@@ -1,14 +1,25 @@
 #include "king_window.h"
+#include "king/assets/asset_registry.h"
+#include "king/assets/file_watcher.h"
+#include "king/assets/hot_reload.h"
 #include "king/ecs/scene.h"
 #include "king/ecs/components.h"
+#include "king/ecs/system_scheduler.h"
+#include "king/jobs/thread_autotune.h"
+#include "king/perf/trace_capture.h"
 #include "king/systems/camera_system.h"
 #include "king/systems/lighting_system.h"
+#include "king/systems/spatial_index_system.h"
+#include "king/systems/transform_system.h"
 #include "king/render/d3d11/render_device_d3d11.h"
 #include "king/render/d3d11/render_system_d3d11.h"
+#include "king/render/primitive_mesh.h"
+#include "king/time/fixed_step_thread.h"
 #include "king/time/time.h"
 
 #include <windows.h>
 
+#include <chrono>
 #include <cstdio>
 #include <cstdint>
 #include <array>
@@ -23,6 +34,7 @@ struct InputState
     bool hasFocus = true;
 
     bool rmbDown = false;
+    bool lmbClicked = false; // this frame
     bool haveMousePos = false;
     int32_t lastMouseX = 0;
     int32_t lastMouseY = 0;
@@ -206,6 +218,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
     EnableDpiAwareness();
     SetupDebugConsole();
     std::printf("King starting...\n");
+    king::perf::TraceCapture::SetThreadName("Main");
 
     king::Window window;
     king::Window::Desc winDesc;
@@ -236,17 +249,56 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
     const king::Float3 bigCenter{ 0.0f, 3.25f, 10.0f };
     const float bigRadius = 4.0f;
 
+    // Asset packs (KING_ASSET_PACKS: ';'-separated .kpak paths, later ones take priority).
+    // Declared before the scene: pack meshes point into the mappings.
+    king::AssetRegistry assets;
+    {
+        const std::wstring packs = EnvWString(L"KING_ASSET_PACKS");
+        size_t start = 0;
+        while (start < packs.size())
+        {
+            size_t end = packs.find(L';', start);
+            if (end == std::wstring::npos)
+                end = packs.size();
+            if (end > start)
+                assets.Mount(packs.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+
     // --- ECS sample scene ---
     king::Scene scene;
 
+    // KING_HOT_RELOAD=1 watches assets/shaders (and the directory of KING_SPHERE_MATERIAL):
+    // edited shaders recompile in the background, edited .mat files reload in place.
+    king::HotReload hotReload;
+    std::vector<std::wstring> changedShaders;
+    if (EnvFlag(L"KING_HOT_RELOAD"))
+        (void)hotReload.Watch(JoinPath(GetExeDirectory(), L"..\\..\\assets\\shaders"));
+    // KING_SPHERE_MATERIAL=<file.mat> draws every demo sphere with that material.
+    king::MaterialHandle sphereFileMaterial = king::kDefaultMaterial;
+    bool useSphereFileMaterial = false;
+    {
+        const std::wstring matPath = EnvWString(L"KING_SPHERE_MATERIAL");
+        if (!matPath.empty())
+        {
+            std::string narrow(WideCharToMultiByte(CP_UTF8, 0, matPath.c_str(), (int)matPath.size(), nullptr, 0, nullptr, nullptr), '\0');
+            WideCharToMultiByte(CP_UTF8, 0, matPath.c_str(), (int)matPath.size(), narrow.data(), (int)narrow.size(), nullptr, nullptr);
+            std::string err;
+            useSphereFileMaterial = hotReload.LoadMaterial(scene.materials, narrow, sphereFileMaterial, &err);
+            if (!useSphereFileMaterial)
+                std::printf("KING_SPHERE_MATERIAL: %s\n", err.c_str());
+        }
+    }
+
     // Camera entity
     king::Entity camEnt = scene.reg.CreateEntity();
     {
-        auto& t = scene.reg.transforms.Emplace(camEnt);
+        auto& t = *scene.reg.transforms.Emplace(camEnt);
         // Pull back a bit so the material grid is visible immediately.
         t.position = { 0.0f, 5.0f, -18.0f };
 
-        auto& cc = scene.reg.cameras.Emplace(camEnt);
+        auto& cc = *scene.reg.cameras.Emplace(camEnt);
         cc.primary = true;
 
         king::PerspectiveParams persp;
@@ -262,212 +314,95 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
     if (!stressTest)
     {
         king::Entity e = scene.reg.CreateEntity();
-        auto& t = scene.reg.transforms.Emplace(e);
+        auto& t = *scene.reg.transforms.Emplace(e);
         t.position = bigCenter;
 
-        auto& l = scene.reg.lights.Emplace(e);
+        auto& l = *scene.reg.lights.Emplace(e);
         l.type = king::LightType::Point;
         l.color = { 1.0f, 0.95f, 0.85f };
         // Night scene: keep range tight so the ground isn't lit too strongly.
         l.intensity = 8.0f;
         l.range = 14.0f;
-        l.castsShadows = false;
+        l.castsShadows = true;
         l.groupMask = 0xFFFFFFFFu;
     }
 
+    // Procedural meshes (king/render/primitive_mesh.h), each on its own entity.
     auto makeCubeMesh = [&](float halfExtents) -> king::Entity
     {
-        const float h = halfExtents;
         king::Entity me = scene.reg.CreateEntity();
-        auto& m = scene.reg.meshes.Emplace(me);
-
-        // Indexed cube: 24 verts (4 per face), 36 indices.
-        const king::VertexPN v[] = {
-            // +X
-            { h,-h,-h,  1,0,0 }, { h,-h, h,  1,0,0 }, { h, h, h,  1,0,0 }, { h, h,-h,  1,0,0 },
-            // -X
-            {-h,-h, h, -1,0,0 }, {-h,-h,-h, -1,0,0 }, {-h, h,-h, -1,0,0 }, {-h, h, h, -1,0,0 },
-            // +Y
-            {-h, h,-h,  0,1,0 }, { h, h,-h,  0,1,0 }, { h, h, h,  0,1,0 }, {-h, h, h,  0,1,0 },
-            // -Y
-            {-h,-h, h,  0,-1,0}, { h,-h, h,  0,-1,0}, { h,-h,-h,  0,-1,0}, {-h,-h,-h,  0,-1,0},
-            // +Z
-            { h,-h, h,  0,0,1 }, {-h,-h, h,  0,0,1 }, {-h, h, h,  0,0,1 }, { h, h, h,  0,0,1 },
-            // -Z
-            {-h,-h,-h,  0,0,-1}, { h,-h,-h,  0,0,-1}, { h, h,-h,  0,0,-1}, {-h, h,-h,  0,0,-1},
-        };
-        m.vertices.assign(std::begin(v), std::end(v));
-
-        const uint16_t idx[] = {
-            0,1,2, 0,2,3,
-            4,5,6, 4,6,7,
-            8,9,10, 8,10,11,
-            12,13,14, 12,14,15,
-            16,17,18, 16,18,19,
-            20,21,22, 20,22,23
-        };
-        m.indices.assign(std::begin(idx), std::end(idx));
-
-        m.boundsCenter = { 0, 0, 0 };
-        m.boundsRadius = halfExtents * 1.8f;
+        king::BuildCubeMesh(*scene.reg.meshes.Emplace(me), halfExtents);
         return me;
     };
 
     auto makeGroundPlaneMesh = [&](float halfExtents, int segments) -> king::Entity
     {
-        const float h = halfExtents;
         king::Entity me = scene.reg.CreateEntity();
-        auto& m = scene.reg.meshes.Emplace(me);
-
-        // Subdivided grid plane (top face only), centered at origin on Y=0.
-        // This makes the sandbox less "low poly" and helps diagnose any per-vertex artifacts.
-        // Note: indices are uint16 in this demo mesh container.
-        // Keep (segments + 1)^2 <= 65535.
-        segments = std::max(1, std::min(segments, 254));
-        const int vertsPerSide = segments + 1;
-        m.vertices.reserve((size_t)vertsPerSide * (size_t)vertsPerSide);
-
-        for (int z = 0; z <= segments; ++z)
-        {
-            const float tz = (float)z / (float)segments;
-            const float pz = (-h) + (2.0f * h) * tz;
-            for (int x = 0; x <= segments; ++x)
-            {
-                const float tx = (float)x / (float)segments;
-                const float px = (-h) + (2.0f * h) * tx;
-                m.vertices.push_back(king::VertexPN{ px, 0.0f, pz, 0, 1, 0 });
-            }
-        }
-
-        m.indices.reserve((size_t)segments * (size_t)segments * 6u);
-        for (int z = 0; z < segments; ++z)
-        {
-            for (int x = 0; x < segments; ++x)
-            {
-                const uint32_t i0 = (uint32_t)(z * vertsPerSide + x);
-                const uint32_t i1 = i0 + 1;
-                const uint32_t i2 = (uint32_t)((z + 1) * vertsPerSide + x + 1);
-                const uint32_t i3 = (uint32_t)((z + 1) * vertsPerSide + x);
-
-                // Indices are uint16 in this demo mesh container.
-                m.indices.push_back((uint16_t)i0);
-                m.indices.push_back((uint16_t)i1);
-                m.indices.push_back((uint16_t)i2);
-                m.indices.push_back((uint16_t)i0);
-                m.indices.push_back((uint16_t)i2);
-                m.indices.push_back((uint16_t)i3);
-            }
-        }
-
-        m.boundsCenter = { 0, 0, 0 };
-        // Sphere radius that covers the plane; scaled by transform later.
-        m.boundsRadius = halfExtents * 1.45f;
+        king::BuildGroundPlaneMesh(*scene.reg.meshes.Emplace(me), halfExtents, segments);
         return me;
     };
 
     auto makeSphereMesh = [&](float radius, int slices, int stacks) -> king::Entity
     {
-        // UV sphere (lat/long). Indices are uint16 in this demo mesh container.
-        slices = std::max(3, std::min(slices, 128));
-        stacks = std::max(2, std::min(stacks, 128));
-
         king::Entity me = scene.reg.CreateEntity();
-        auto& m = scene.reg.meshes.Emplace(me);
-
-        const int vertsPerRing = slices + 1;
-        const int rings = stacks + 1;
-        const int vertCount = vertsPerRing * rings;
-        if (vertCount > 65000)
-        {
-            // Clamp to stay under uint16 indexing.
-            stacks = std::min(stacks, 60);
-            slices = std::min(slices, 60);
-        }
-
-        const float pi = 3.14159265358979323846f;
-        const float twoPi = 6.28318530717958647692f;
-
-        m.vertices.reserve((size_t)(slices + 1) * (size_t)(stacks + 1));
-        for (int y = 0; y <= stacks; ++y)
-        {
-            const float v = (float)y / (float)stacks;
-            const float phi = v * pi; // 0..pi
-            const float sp = std::sinf(phi);
-            const float cp = std::cosf(phi);
+        king::BuildSphereMesh(*scene.reg.meshes.Emplace(me), radius, slices, stacks);
+        return me;
+    };
 
-            for (int x = 0; x <= slices; ++x)
-            {
-                const float u = (float)x / (float)slices;
-                const float theta = u * twoPi; // 0..2pi
-                const float st = std::sinf(theta);
-                const float ct = std::cosf(theta);
-
-                const float nx = sp * ct;
-                const float ny = cp;
-                const float nz = sp * st;
-
-                king::VertexPN vtx;
-                vtx.x = nx * radius;
-                vtx.y = ny * radius;
-                vtx.z = nz * radius;
-                vtx.nx = nx;
-                vtx.ny = ny;
-                vtx.nz = nz;
-                m.vertices.push_back(vtx);
-            }
-        }
+    // Shared sphere mesh for the material grid: from a mounted pack if it has one, otherwise
+    // generated. KING_WRITE_ASSET_PACK=<path> saves the generated (cooked) meshes as a pack.
+    king::Entity sphereMesh = king::kInvalidEntity;
+    if (assets.Resolve("meshes/sphere", king::PackAssetType::Mesh))
+    {
+        sphereMesh = scene.reg.CreateEntity();
+        auto& m = *scene.reg.meshes.Emplace(sphereMesh);
+        if (!assets.LoadMesh("meshes/sphere", m))
+            sphereMesh = king::kInvalidEntity;
+    }
+    if (sphereMesh == king::kInvalidEntity)
+    {
+        sphereMesh = makeSphereMesh(0.5f, 32, 16);
 
-        m.indices.reserve((size_t)slices * (size_t)stacks * 6u);
-        for (int y = 0; y < stacks; ++y)
+        const std::wstring packOut = EnvWString(L"KING_WRITE_ASSET_PACK");
+        if (!packOut.empty())
         {
-            for (int x = 0; x < slices; ++x)
-            {
-                const uint16_t i0 = (uint16_t)(y * (slices + 1) + x);
-                const uint16_t i1 = (uint16_t)(y * (slices + 1) + x + 1);
-                const uint16_t i2 = (uint16_t)((y + 1) * (slices + 1) + x);
-                const uint16_t i3 = (uint16_t)((y + 1) * (slices + 1) + x + 1);
-
-                // CCW winding when viewed from outside.
-                m.indices.push_back(i0);
-                m.indices.push_back(i2);
-                m.indices.push_back(i1);
-
-                m.indices.push_back(i1);
-                m.indices.push_back(i2);
-                m.indices.push_back(i3);
-            }
+            king::AssetPackWriter writer;
+            std::string err;
+            if (writer.AddMesh("meshes/sphere", *scene.reg.meshes.TryGet(sphereMesh)) && writer.Save(packOut, &err))
+                std::printf("Wrote asset pack '%ls' (%zu entries)\n", packOut.c_str(), writer.EntryCount());
+            else
+                std::printf("Failed to write asset pack '%ls': %s\n", packOut.c_str(), err.c_str());
         }
+    }
 
-        m.boundsCenter = { 0, 0, 0 };
-        m.boundsRadius = radius;
-        return me;
-    };
-
-    // Shared sphere mesh for the material grid.
-    king::Entity sphereMesh = makeSphereMesh(0.5f, 32, 16);
+    // Normal-mode sphere motion (disabled in stress test).
+    // Set KING_DISABLE_SPHERE_MOTION=1 to stop.
+    const bool sphereMotion = !stressTest && !EnvFlag(L"KING_DISABLE_SPHERE_MOTION");
 
-    // Sphere cluster helper.
-    auto addSphere = [&](king::Float3 pos, king::Float3 scale, king::Float4 albedo, float roughness, float metallic, king::Float3 emissive) -> king::Entity
+    // Sphere cluster helper (attaches components to an already-created entity).
+    auto initSphere = [&](king::Entity e, king::Float3 pos, king::Float3 scale, king::Float4 albedo, float roughness, float metallic, king::Float3 emissive)
     {
-        king::Entity e = scene.reg.CreateEntity();
-        auto& t = scene.reg.transforms.Emplace(e);
+        auto& t = *scene.reg.transforms.Emplace(e);
         t.position = pos;
         t.scale = scale;
 
-        auto& r = scene.reg.renderers.Emplace(e);
+        king::PbrMaterial mat{};
+        mat.shader = stressTest ? "unlit" : "pbr";
+        mat.shadingModel = stressTest ? king::MaterialShadingModel::Unlit : king::MaterialShadingModel::Pbr;
+        mat.blendMode = king::MaterialBlendMode::Opaque;
+        mat.albedo = albedo;
+        mat.roughness = roughness;
+        mat.metallic = metallic;
+        mat.emissive = emissive;
+
+        auto& r = *scene.reg.renderers.Emplace(e);
         r.mesh = sphereMesh;
-        r.material.shader = stressTest ? "unlit" : "pbr";
-        r.material.shadingModel = stressTest ? king::MaterialShadingModel::Unlit : king::MaterialShadingModel::Pbr;
-        r.material.blendMode = king::MaterialBlendMode::Opaque;
-        r.material.albedo = albedo;
-        r.material.roughness = roughness;
-        r.material.metallic = metallic;
-        r.material.emissive = emissive;
+        r.material = useSphereFileMaterial ? sphereFileMaterial : scene.materials.Intern(mat);
         r.receivesShadows = !stressTest;
         r.castsShadows = !stressTest;
         r.lightMask = 0xFFFFFFFFu;
-
-        return e;
+        // Spheres that never move go into the renderer's static region.
+        r.isStatic = !sphereMotion;
     };
 
     // Keep track of the normal-mode sphere entities so we can animate them.
@@ -491,17 +426,14 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
         desired = std::max(0u, std::min(desired, 2000u));
         if (sphereEntities.size() > desired)
         {
-            while (sphereEntities.size() > desired)
-            {
-                king::Entity e = sphereEntities.back();
-                sphereEntities.pop_back();
-                scene.reg.DestroyEntity(e);
-            }
+            scene.reg.DestroyEntities(sphereEntities.data() + desired, sphereEntities.size() - desired);
+            sphereEntities.resize(desired);
         }
         else if (sphereEntities.size() < desired)
         {
             const uint32_t start = (uint32_t)sphereEntities.size();
-            sphereEntities.reserve(desired);
+            scene.reg.CreateEntities(desired - start, sphereEntities);
+            desired = (uint32_t)sphereEntities.size();
             for (uint32_t i = start; i < desired; ++i)
             {
                 const uint32_t sphereCount = desired;
@@ -528,7 +460,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
                     emissive = { 0.15f, 0.55f, 1.25f };
 
                 const king::Float3 pos{ bigCenter.x + x * bigRadius, bigCenter.y + y * bigRadius, bigCenter.z + z * bigRadius };
-                sphereEntities.push_back(addSphere(pos, { smallScale, smallScale, smallScale }, albedo, roughness, metallic, emissive));
+                initSphere(sphereEntities[i], pos, { smallScale, smallScale, smallScale }, albedo, roughness, metallic, emissive);
             }
         }
     };
@@ -539,6 +471,8 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
     // (No extra lights.)
 
     king::render::d3d11::RenderDeviceD3D11 device;
+    // Flip-model frame queue depth: KING_FRAME_LATENCY=1 for the lowest latency (default 2).
+    device.SetMaxFrameLatency(EnvUInt(L"KING_FRAME_LATENCY", 2u));
     HRESULT initHr = device.Initialize(window.Handle(), width, height);
     if (FAILED(initHr))
     {
@@ -551,12 +485,23 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
     // Render system (D3D11)
     const std::wstring shaderPath = JoinPath(GetExeDirectory(), L"..\\..\\assets\\shaders\\pbr_test.hlsl");
     king::render::d3d11::RenderSystemD3D11 renderSystem;
+    // Compiled shader bytecode persists here between runs (KING_SHADER_CACHE overrides; "off"
+    // keeps it in memory only). ShaderPrecompile can fill it offline.
+    {
+        std::wstring cacheDir = EnvWString(L"KING_SHADER_CACHE");
+        if (cacheDir.empty())
+            cacheDir = JoinPath(GetExeDirectory(), L"shader_cache");
+        else if (cacheDir == L"off")
+            cacheDir.clear();
+        renderSystem.SetShaderCacheDir(cacheDir);
+    }
     if (!renderSystem.Initialize(device, shaderPath))
     {
         std::printf("Failed to initialize render system.\n");
         MessageBoxW(window.Handle(), L"Failed to initialize render system.", L"Error", MB_ICONERROR);
         return 1;
     }
+    renderSystem.SetAssetRegistry(&assets);
 
     device.QueueResize(width, height);
 
@@ -565,12 +510,162 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
     king::Mat4x4 view{};
     king::Mat4x4 proj{};
 
+    // KING_MINIMAP=1: a top-down orthographic second view in the top-right corner, drawn by
+    // RenderViews with the main view's snapshot, culling pass and shadow maps.
+    // KING_MINIMAP_EXTENT sets the world units it covers (default 120).
+    using RenderView = king::render::d3d11::RenderSystemD3D11::RenderView;
+    const bool minimap = EnvFlag(L"KING_MINIMAP");
+    king::Camera minimapCamera;
+    {
+        king::OrthographicParams o{};
+        o.width = (float)EnvUInt(L"KING_MINIMAP_EXTENT", 120u);
+        o.height = o.width;
+        o.nearZ = 1.0f;
+        o.farZ = 1000.0f;
+        minimapCamera.SetOrthographic(o);
+        // +90 degrees about +X: looking down -Y with +Z up.
+        minimapCamera.SetOrientation({ 0.70710678f, 0.0f, 0.0f, 0.70710678f });
+    }
+
     InputState input;
     king::Time time;
     time.SetFixedDeltaSeconds(1.0 / 60.0);
     time.SetMaxDeltaSeconds(0.10);
     time.Reset();
 
+    // ECS systems, scheduled by component access (KING_THREADS_ECS / threads_ecs workers).
+    // Registration order is the logical order; non-conflicting systems may overlap.
+    king::SystemScheduler ecsScheduler(scene.reg.WorkerThreads());
+    king::Float3 primaryCamPos{ 0, 0, 0 };
+
+    // Orbit + bob of sphere i (of `count`) at tsec, around the Fibonacci direction it was placed on.
+    auto SphereMotionPosition = [&](int i, int count, float tsec) -> king::Float3
+    {
+        const float orbitSpeed = 0.25f;
+        const float bobSpeed = 1.35f;
+        const float bobAmp = 0.25f;
+
+        const float tt = (count > 1) ? ((float)i / (float)(count - 1)) : 0.0f;
+        const float y = 1.0f - 2.0f * tt;
+        const float rr = std::sqrtf(std::max(0.0f, 1.0f - y * y));
+        const float theta0 = 2.0f * pi * ((float)i / golden);
+        const float x0 = std::cosf(theta0) * rr;
+        const float z0 = std::sinf(theta0) * rr;
+
+        // Rotate around Y.
+        const float a = tsec * orbitSpeed;
+        const float ca = std::cosf(a);
+        const float sa = std::sinf(a);
+        const float x = x0 * ca - z0 * sa;
+        const float z = x0 * sa + z0 * ca;
+
+        const float bob = bobAmp * std::sinf(tsec * bobSpeed + (float)i * 0.13f);
+        return { bigCenter.x + x * bigRadius,
+                 bigCenter.y + y * bigRadius + bob,
+                 bigCenter.z + z * bigRadius };
+    };
+
+    // KING_SIM_THREAD=1 steps sphere motion at the fixed rate on its own thread; frames apply
+    // its last two steps interpolated. Otherwise it runs per frame, in lockstep with rendering.
+    // Camera movement stays on this thread either way (it reads the window's input state).
+    king::FixedStepThread simThread;
+    std::vector<king::Transform> simSample;
+    if (sphereMotion && EnvFlag(L"KING_SIM_THREAD"))
+    {
+        const bool started = simThread.Start(time.FixedDeltaSeconds(), sphereEntities.size(),
+            [&](double timeSeconds, double dtSeconds, std::vector<king::Transform>& state)
+            {
+                (void)dtSeconds;
+                const int count = (int)state.size();
+                for (int i = 0; i < count; ++i)
+                    state[(size_t)i].position = SphereMotionPosition(i, count, (float)timeSeconds);
+            });
+        std::printf("[Sim] fixed-step thread %s (%.1f Hz)\n", started ? "started" : "failed to start", 1.0 / time.FixedDeltaSeconds());
+    }
+
+    ecsScheduler.Add("SphereMotion", king::SystemAccess{}.Write<king::Transform>(), [&](king::Scene& s)
+    {
+        if (!sphereMotion)
+            return;
+
+        const int sphereCount = (int)sphereEntities.size();
+        if (simThread.Running())
+        {
+            simThread.SetBodyCount((size_t)sphereCount);
+            if (!simThread.Sample(simSample))
+                return;
+
+            // Bodies the thread has not stepped yet (count just grew) keep their spawn position.
+            const int count = std::min(sphereCount, (int)simSample.size());
+            ecsScheduler.ParallelFor((size_t)count, 256, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    auto* tr = s.reg.transforms.TryGet(sphereEntities[i]);
+                    if (tr)
+                        tr->position = simSample[i].position;
+                }
+            });
+            return;
+        }
+
+        const float tsec = (float)time.TotalSeconds();
+
+        // Recompute the base Fibonacci directions and apply a gentle orbit + bob.
+        if (sphereCount <= 0)
+            return;
+
+        ecsScheduler.ParallelFor((size_t)sphereCount, 256, [&](size_t begin, size_t end)
+        {
+            for (int i = (int)begin; i < (int)end; ++i)
+            {
+                king::Entity e = sphereEntities[(size_t)i];
+                auto* tr = s.reg.transforms.TryGet(e);
+                if (tr)
+                    tr->position = SphereMotionPosition(i, sphereCount, tsec);
+            }
+        });
+    });
+
+    // World matrices for moved entities (and their children); skips everything static.
+    king::systems::TransformSystem transformSystem;
+    ecsScheduler.Add("TransformHierarchy", king::SystemAccess{}.Read<king::Transform>().Write<king::WorldTransform>(), [&](king::Scene& s)
+    {
+        transformSystem.Update(s, ecsScheduler.WorkerThreads());
+    });
+
+    // Bounds BVH for gameplay queries (left click picks along the view direction), refit from
+    // the entities TransformHierarchy just recomputed.
+    king::systems::SpatialIndexSystem spatialIndex;
+    ecsScheduler.Add("SpatialIndex", king::SystemAccess{}.Read<king::MeshRenderer, king::Mesh, king::Transform, king::WorldTransform>(), [&](king::Scene& s)
+    {
+        spatialIndex.Update(s, transformSystem);
+    });
+
+    ecsScheduler.Add("Camera", king::SystemAccess{}.Read<king::Transform>().Write<king::CameraComponent>(), [&](king::Scene& s)
+    {
+        primaryCamPos = { 0, 0, 0 };
+        for (auto [e, cc, tr] : s.reg.View<king::CameraComponent, king::Transform>())
+        {
+            (void)e;
+            if (cc.primary)
+            {
+                primaryCamPos = tr.position;
+                view = cc.camera.ViewMatrix();
+                proj = cc.camera.ProjectionMatrix();
+                break;
+            }
+        }
+
+        (void)king::systems::CameraSystem::UpdatePrimaryCamera(s, frustum, viewProj);
+    });
+
+    // Groups the transform pools into renderer order, hence the Transform/WorldTransform writes.
+    ecsScheduler.Add("RenderSnapshot", king::SystemAccess{}.Read<king::MeshRenderer, king::Mesh>().Write<king::Transform, king::WorldTransform>(), [&](king::Scene& s)
+    {
+        renderSystem.PrepareSnapshot(s, ecsScheduler.WorkerThreads());
+    });
+
     // Console FPS (computed from time delta; printed once per ~1s).
     double fpsWindowSeconds = 0.0;
     uint32_t fpsWindowFrames = 0;
@@ -593,6 +688,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
     const uint32_t stressSampleFrames = EnvUInt(L"KING_STRESS_SAMPLE_FRAMES", 240u);
 
     uint32_t stressCurrentTarget = 0;
+    std::vector<king::Entity> stressBatch;
     bool stressPrintedHeader = false;
     uint32_t stressWarmupLeft = stressWarmupFrames;
     uint32_t stressSampleLeft = stressSampleFrames;
@@ -612,6 +708,35 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
         renderSystem.SetPerfPrintToStdout(false);
     }
 
+    // Timeline capture (Chrome trace JSON): KING_TRACE_CAPTURE=N records N frames from startup,
+    // F9 records KING_TRACE_FRAMES (default 16) frames at any time. GPU scopes need GPU timing.
+    const uint32_t traceStartupFrames = EnvUInt(L"KING_TRACE_CAPTURE", 0u);
+    const uint32_t traceFrames = EnvUInt(L"KING_TRACE_FRAMES", 16u);
+    std::wstring tracePath = EnvWString(L"KING_TRACE_PATH");
+    if (tracePath.empty())
+        tracePath = JoinPath(GetExeDirectory(), L"king_trace.json");
+    // Perf histograms: KING_PERF_WINDOW_FRAMES sets the percentile window (0 = since start),
+    // KING_HITCH_MS the hitch floor. F10 writes the hitch log to king_hitches.csv.
+    renderSystem.SetPerfHistogramWindow(EnvUInt(L"KING_PERF_WINDOW_FRAMES", 600u));
+    renderSystem.SetPerfHitchThreshold((double)EnvUInt(L"KING_HITCH_MS", 1u), 3.0);
+    // KING_PIPELINE_STATS=1 adds D3D11 pipeline statistics to every GPU scope (LastFrameStats,
+    // GpuPrimitives in the overlay); they need GPU timing.
+    if (EnvFlag(L"KING_PIPELINE_STATS"))
+    {
+        renderSystem.SetGpuPerfEnabled(true);
+        renderSystem.SetPipelineStatsEnabled(true);
+    }
+    // KING_ALLOC_CHECK=<frames> warns about every frame after that many in which the render
+    // thread still allocates from the heap (1 = a 120-frame warm-up).
+    if (const uint32_t allocCheck = EnvUInt(L"KING_ALLOC_CHECK", 0u))
+        renderSystem.SetAllocationCheck(allocCheck == 1u ? 120u : allocCheck);
+
+    if (traceStartupFrames > 0)
+    {
+        renderSystem.SetGpuPerfEnabled(true);
+        (void)king::perf::GetTraceCapture().Request(traceStartupFrames, tracePath);
+    }
+
     FILE* stressCsv = nullptr;
     std::wstring stressCsvPath;
     if (stressTest)
@@ -628,9 +753,84 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
         }
     }
 
+    // KING_INPUT_LATENCY=1 measures input sampling to Present (and to the vblank it was shown
+    // at, from the swapchain's frame statistics) into the perf overlay/histograms.
+    const bool measureInputLatency = EnvFlag(L"KING_INPUT_LATENCY");
+    if (measureInputLatency)
+        renderSystem.SetPerfEnabled(true);
+    struct PendingPresent
+    {
+        uint32_t presentCount = 0;
+        int64_t inputQpc = 0;
+    };
+    PendingPresent pendingPresents[16]{};
+    uint32_t pendingPresentHead = 0;
+    LARGE_INTEGER qpcFrequency{};
+    QueryPerformanceFrequency(&qpcFrequency);
+    const double qpcToMs = (qpcFrequency.QuadPart > 0) ? (1000.0 / (double)qpcFrequency.QuadPart) : 0.0;
+
+    // Live thread config: edits to thread_config.cfg (e.g. ThreadConfigCLI saves) apply while
+    // running. threads_autotune=1 / KING_THREADS_AUTOTUNE=1 first times a few worker counts
+    // over real frames and keeps the fastest; KING_THREADS_AUTOTUNE_SAVE=1 writes the pick to
+    // thread_config.cfg.
+    king::FileWatcher threadConfigWatcher;
+    std::wstring threadConfigPath;
+    std::vector<std::wstring> threadConfigChanges;
+    if (!EnvFlag(L"KING_DISABLE_THREAD_CONFIG") && threadConfigWatcher.Start(GetExeDirectory(), false))
+        threadConfigPath = king::FileWatcher::NormalizePath(JoinPath(GetExeDirectory(), L"thread_config.cfg"));
+    uint32_t threadConfigGeneration = king::ThreadConfigGeneration();
+    king::ThreadAutoTuner threadTuner;
+    if (king::GetThreadConfig().autoTune)
+        (void)threadTuner.Begin(king::GetThreadConfig());
+    const bool saveTunedThreads = EnvFlag(L"KING_THREADS_AUTOTUNE_SAVE");
+    // CPU time of the last frame: from the end of one frame wait to the start of the next.
+    auto frameCpuStart = std::chrono::steady_clock::now();
+
     king::Window::Event ev{};
-    while (window.PumpMessages())
+    for (;;)
     {
+        const double frameCpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameCpuStart).count();
+
+        // Flip model: hold here until the swapchain can take a frame, so input, simulation and
+        // the render snapshot are as fresh as possible and Present does not stall on a full queue.
+        device.WaitForNextFrame();
+        frameCpuStart = std::chrono::steady_clock::now();
+        if (!window.PumpMessages())
+            break;
+
+        // Thread config changes apply here, between frames: no jobs are queued yet (a frame
+        // prep job still running is finished by the job system restart).
+        if (threadTuner.Running())
+        {
+            (void)threadTuner.Tick(frameCpuMs);
+            if (!threadTuner.Running() && saveTunedThreads && !king::SaveThreadConfig(threadTuner.Best()))
+                std::printf("[ThreadTune] Failed to write thread_config.cfg\n");
+        }
+        if (!threadConfigPath.empty())
+        {
+            threadConfigChanges.clear();
+            threadConfigWatcher.Poll(threadConfigChanges);
+            for (const std::wstring& path : threadConfigChanges)
+            {
+                // While tuning, the tuner owns the config.
+                if (path == threadConfigPath && !threadTuner.Running())
+                {
+                    std::printf("thread_config.cfg changed, applying\n");
+                    king::SetThreadConfig(king::LoadThreadConfig());
+                    break;
+                }
+            }
+        }
+        if (king::ThreadConfigGeneration() != threadConfigGeneration)
+        {
+            threadConfigGeneration = king::ThreadConfigGeneration();
+            (void)king::RebalanceJobSystem();
+            // The renderer re-reads its budgets itself on the next frame.
+            const uint32_t ecsThreads = king::GetThreadConfig().ecsWorkerThreads;
+            scene.reg.SetWorkerThreads(ecsThreads);
+            ecsScheduler.SetWorkerThreads(ecsThreads);
+        }
+
         time.Tick();
         if (time.FpsUpdated())
             renderSystem.SetFps(time.Fps());
@@ -652,49 +852,6 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
             }
         }
 
-        // Normal-mode sphere motion (disabled in stress test).
-        // Set KING_DISABLE_SPHERE_MOTION=1 to stop.
-        if (!stressTest && !EnvFlag(L"KING_DISABLE_SPHERE_MOTION"))
-        {
-            const float tsec = (float)time.TotalSeconds();
-
-            // Recompute the base Fibonacci directions and apply a gentle orbit + bob.
-            const int sphereCount = (int)sphereEntities.size();
-            if (sphereCount > 0)
-            {
-                const float orbitSpeed = 0.25f;
-                const float bobSpeed = 1.35f;
-                const float bobAmp = 0.25f;
-
-                for (int i = 0; i < sphereCount; ++i)
-                {
-                    const float tt = (sphereCount > 1) ? ((float)i / (float)(sphereCount - 1)) : 0.0f;
-                    const float y = 1.0f - 2.0f * tt;
-                    const float rr = std::sqrtf(std::max(0.0f, 1.0f - y * y));
-                    const float theta0 = 2.0f * pi * ((float)i / golden);
-                    const float x0 = std::cosf(theta0) * rr;
-                    const float z0 = std::sinf(theta0) * rr;
-
-                    // Rotate around Y.
-                    const float a = tsec * orbitSpeed;
-                    const float ca = std::cosf(a);
-                    const float sa = std::sinf(a);
-                    const float x = x0 * ca - z0 * sa;
-                    const float z = x0 * sa + z0 * ca;
-
-                    const float bob = bobAmp * std::sinf(tsec * bobSpeed + (float)i * 0.13f);
-                    const king::Float3 pos{ bigCenter.x + x * bigRadius,
-                                            bigCenter.y + y * bigRadius + bob,
-                                            bigCenter.z + z * bigRadius };
-
-                    king::Entity e = sphereEntities[(size_t)i];
-                    auto* tr = scene.reg.transforms.TryGet(e);
-                    if (tr)
-                        tr->position = pos;
-                }
-            }
-        }
-
         if (stressTest)
         {
             // Ensure scene contains exactly `stressCurrentTarget` spheres.
@@ -704,7 +861,9 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
             const uint32_t currentCount = (uint32_t)scene.reg.renderers.Entities().size();
             if (currentCount < stressCurrentTarget)
             {
-                const uint32_t toAdd = stressCurrentTarget - currentCount;
+                stressBatch.clear();
+                scene.reg.CreateEntities(stressCurrentTarget - currentCount, stressBatch);
+                const uint32_t toAdd = (uint32_t)stressBatch.size();
                 for (uint32_t i = 0; i < toAdd; ++i)
                 {
                     const uint32_t idx = currentCount + i;
@@ -719,7 +878,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
                     king::Float3 pos{ -((float)cols * 0.5f) * spacing + (float)x * spacing,
                                      0.75f,
                                      6.0f + (float)z * spacing };
-                    addSphere(pos, { smallScale, smallScale, smallScale }, albedo, 1.0f, 0.0f, { 0, 0, 0 });
+                    initSphere(stressBatch[i], pos, { smallScale, smallScale, smallScale }, albedo, 1.0f, 0.0f, { 0, 0, 0 });
                 }
             }
         }
@@ -768,6 +927,10 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
                     input.haveMousePos = false;
                     SetCapture(window.Handle());
                 }
+                else if (ev.button == king::Window::MouseButton::Left)
+                {
+                    input.lmbClicked = true;
+                }
             }
             else if (ev.type == king::Window::EventType::MouseButtonUp)
             {
@@ -803,6 +966,10 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
             }
         }
 
+        LARGE_INTEGER inputQpc{};
+        if (measureInputLatency)
+            QueryPerformanceCounter(&inputQpc);
+
         // Hotkeys for sphere count (normal mode only):
         // - = decrease by 20
         // + = increase by 20
@@ -847,11 +1014,11 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
 
         // Pass 1: update simulation systems.
         // Mouse look is per-frame (uses latest input), movement/animations are fixed-step.
-        for (auto e : scene.reg.cameras.Entities())
+        for (auto [e, cc, t] : scene.reg.View<king::CameraComponent, king::Transform>())
         {
-            auto* cc = scene.reg.cameras.TryGet(e);
-            auto* t = scene.reg.transforms.TryGet(e);
-            if (!cc || !t || !cc->primary)
+            (void)e;
+            (void)t;
+            if (!cc.primary)
                 continue;
 
             if (input.hasFocus && (input.rmbDown || input.keys[VK_MENU]))
@@ -859,7 +1026,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
                 const float sens = 0.0025f;
                 const float yaw = input.mouseDeltaX * sens;
                 const float pitch = input.mouseDeltaY * sens;
-                cc->camera.RotateYawPitchRoll(yaw, pitch, 0.0f);
+                cc.camera.RotateYawPitchRoll(yaw, pitch, 0.0f);
             }
             break;
         }
@@ -874,11 +1041,10 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
             (void)tNow;
 
             // Fixed-step camera movement (locomotion uses camera forward/right).
-            for (auto e : scene.reg.cameras.Entities())
+            for (auto [e, cc, tr] : scene.reg.View<king::CameraComponent, king::Transform>())
             {
-                auto* cc = scene.reg.cameras.TryGet(e);
-                auto* tr = scene.reg.transforms.TryGet(e);
-                if (!cc || !tr || !cc->primary)
+                (void)e;
+                if (!cc.primary)
                     continue;
 
                 // Keyboard camera rotation (works even without RMB/mouse).
@@ -895,14 +1061,14 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
                     if (yawAxis != 0.0f || pitchAxis != 0.0f)
                     {
                         const float rotSpeed = input.keys[VK_SHIFT] ? 2.0f : 1.2f; // rad/sec
-                        cc->camera.RotateYawPitchRoll(yawAxis * rotSpeed * stepDt, pitchAxis * rotSpeed * stepDt, 0.0f);
+                        cc.camera.RotateYawPitchRoll(yawAxis * rotSpeed * stepDt, pitchAxis * rotSpeed * stepDt, 0.0f);
                     }
                 }
 
                 const float speed = (input.keys[VK_SHIFT] ? 10.0f : 4.0f);
 
-                const king::Float3 f0 = cc->camera.Forward();
-                const king::Float3 r0 = cc->camera.Right();
+                const king::Float3 f0 = cc.camera.Forward();
+                const king::Float3 r0 = cc.camera.Right();
                 king::Float3 f = { f0.x, 0.0f, f0.z };
                 king::Float3 r = { r0.x, 0.0f, r0.z };
                 const float fl = std::sqrt(f.x * f.x + f.z * f.z);
@@ -927,31 +1093,36 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
 
                 if (worldDelta.x != 0.0f || worldDelta.y != 0.0f || worldDelta.z != 0.0f)
                 {
-                    const king::Float3 p = cc->camera.Position();
-                    cc->camera.SetPosition({ p.x + worldDelta.x, p.y + worldDelta.y, p.z + worldDelta.z });
+                    const king::Float3 p = cc.camera.Position();
+                    cc.camera.SetPosition({ p.x + worldDelta.x, p.y + worldDelta.y, p.z + worldDelta.z });
                 }
 
-                tr->position = cc->camera.Position();
+                tr.position = cc.camera.Position();
                 break;
             }
         }
 
-        king::Float3 primaryCamPos{ 0, 0, 0 };
-        for (auto e : scene.reg.cameras.Entities())
+        // Per-frame ECS systems (sphere motion, camera matrices, render snapshot).
+        ecsScheduler.Run(scene);
+
+        if (input.lmbClicked)
         {
-            auto* cc = scene.reg.cameras.TryGet(e);
-            auto* tr = scene.reg.transforms.TryGet(e);
-            if (cc && tr && cc->primary)
+            input.lmbClicked = false;
+            for (auto [e, cc, t] : scene.reg.View<king::CameraComponent, king::Transform>())
             {
-                primaryCamPos = tr->position;
-                view = cc->camera.ViewMatrix();
-                proj = cc->camera.ProjectionMatrix();
+                (void)e;
+                (void)t;
+                if (!cc.primary)
+                    continue;
+                king::systems::RayHit hit{};
+                if (spatialIndex.Raycast(cc.camera.Position(), cc.camera.Forward(), 1000.0f, hit))
+                    std::printf("Pick: entity 0x%08X at %.2f (%zu proxies, height %u)\n", hit.entity, hit.distance, spatialIndex.ProxyCount(), spatialIndex.TreeHeight());
+                else
+                    std::printf("Pick: nothing (%zu proxies)\n", spatialIndex.ProxyCount());
                 break;
             }
         }
 
-        (void)king::systems::CameraSystem::UpdatePrimaryCamera(scene, frustum, viewProj);
-
         // Post hotkeys (tap):
         // - B: toggle bloom
         // - V: toggle vignette
@@ -961,6 +1132,8 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
         // - ; / ': vignette power -/+
         // - , / .: bloom intensity -/+
         // - O / P: bloom threshold -/+
+        // - F9: capture a Chrome trace of the next frames (KING_TRACE_FRAMES)
+        // - F10: write the perf hitch log (needs KING_PERF=1)
         auto KeyPressed = [&](int vk) -> bool
         {
             if (vk < 0 || vk >= 256)
@@ -977,6 +1150,22 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
         const float stepPower = input.keys[VK_SHIFT] ? 0.50f : 0.10f;
         const float stepBloom = input.keys[VK_SHIFT] ? 0.20f : 0.05f;
 
+        if (KeyPressed(VK_F10))
+        {
+            const std::wstring hitchPath = JoinPath(GetExeDirectory(), L"king_hitches.csv");
+            const size_t hitchCount = renderSystem.PerfHitches().size();
+            if (renderSystem.WritePerfHitchCsv(hitchPath))
+                std::printf("[Perf] wrote %zu hitches to '%ls'\n", hitchCount, hitchPath.c_str());
+            else
+                std::printf("[Perf] cannot write '%ls'\n", hitchPath.c_str());
+        }
+        if (KeyPressed(VK_F9))
+        {
+            renderSystem.SetGpuPerfEnabled(true);
+            if (king::perf::GetTraceCapture().Request(traceFrames, tracePath))
+                std::printf("[Trace] capturing %u frames\n", traceFrames);
+        }
+
         bool postChanged = false;
         if (KeyPressed('B')) { postEnableBloom = !postEnableBloom; postChanged = true; }
         if (KeyPressed('V')) { postEnableVignette = !postEnableVignette; postChanged = true; }
@@ -1025,7 +1214,15 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
         renderSettings.enableHdr = !stressTest;
         renderSettings.enableTonemap = (!stressTest) && postEnableTonemap;
         renderSettings.enableShadows = !stressTest;
-        renderSettings.enableSsao = false;
+        // SSAO (off by default): KING_SSAO=1 enables it, KING_SSAO_QUALITY picks the ladder
+        // step (0 = quarter, 1 = half, 2 = full resolution), KING_SSAO_TEMPORAL=1 accumulates.
+        renderSettings.enableSsao = EnvFlag(L"KING_SSAO");
+        renderSettings.ssaoQuality = EnvUInt(L"KING_SSAO_QUALITY", 1u);
+        renderSettings.enableSsaoTemporal = EnvFlag(L"KING_SSAO_TEMPORAL");
+        // Dynamic resolution (off by default): KING_DYNAMIC_RES=1 scales the scene to hold
+        // KING_DYNAMIC_RES_TARGET_MS of GPU time per frame (default 16).
+        renderSettings.enableDynamicResolution = EnvFlag(L"KING_DYNAMIC_RES");
+        renderSettings.dynamicResolutionTargetMs = (float)EnvUInt(L"KING_DYNAMIC_RES_TARGET_MS", 16u);
         renderSettings.shadowMapSize = 2048;
         renderSettings.cascadeCount = 3;
         renderSettings.shadowStrength = 1.0f;
@@ -1040,6 +1237,10 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
         renderSettings.shadowSoftness = 1.35f;
         // 1=PCF 3x3 (default), 2=PCF 5x5, 3=Poisson 9-tap
         renderSettings.shadowFilterQuality = 1;
+        // KING_SHADOW_ADAPTIVE=1: skip the filter where a pixel is fully lit or fully shadowed.
+        renderSettings.enableShadowAdaptiveFilter = EnvFlag(L"KING_SHADOW_ADAPTIVE");
+        // KING_NO_STATIC_BVH=1: cull the static region linearly (for comparison).
+        renderSettings.enableStaticBvh = !EnvFlag(L"KING_NO_STATIC_BVH");
         // Night exposure: darker overall.
         renderSettings.exposure = stressTest ? 0.65f : 0.22f;
         renderSettings.enableShadowPoissonPcf = false;
@@ -1061,11 +1262,80 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
         // - KING_SHADOW_DEBUG=3: castsShadows flag
         renderSettings.debugShadowReadbackOnce = EnvFlag(L"KING_SHADOW_READBACK");
         renderSettings.shadowDebugView = EnvUInt(L"KING_SHADOW_DEBUG", 0u);
-        renderSystem.RenderGeometryPass(device, scene, frustum, viewProj, view, proj, primaryCamPos, cameraNearZ, cameraFarZ, renderSettings);
+
+        // Between frames: changed material files are reloaded in place, changed shaders go to
+        // the renderer's background recompile.
+        if (hotReload.Enabled())
+        {
+            changedShaders.clear();
+            hotReload.Update(changedShaders);
+            if (!changedShaders.empty())
+                renderSystem.ReloadShaders(changedShaders);
+        }
+
+        if (minimap)
+        {
+            RenderView views[2];
+            views[0].frustum = frustum;
+            views[0].viewProj = viewProj;
+            views[0].view = view;
+            views[0].proj = proj;
+            views[0].cameraPos = primaryCamPos;
+            views[0].nearZ = cameraNearZ;
+            views[0].farZ = cameraFarZ;
+
+            minimapCamera.SetPosition({ primaryCamPos.x, primaryCamPos.y + 500.0f, primaryCamPos.z });
+            RenderView& mini = views[1];
+            mini.viewProj = minimapCamera.ViewProjectionMatrix();
+            mini.view = minimapCamera.ViewMatrix();
+            mini.proj = minimapCamera.ProjectionMatrix();
+            mini.frustum = king::Frustum::FromViewProjection(mini.viewProj);
+            mini.cameraPos = minimapCamera.Position();
+            mini.nearZ = 1.0f;
+            mini.farZ = 1000.0f;
+            const D3D11_VIEWPORT out = device.Viewport();
+            const float size = std::floor(std::min(out.Width, out.Height) / 3.0f);
+            mini.viewport.TopLeftX = out.Width - size - 16.0f;
+            mini.viewport.TopLeftY = 16.0f;
+            mini.viewport.Width = size;
+            mini.viewport.Height = size;
+            mini.viewport.MaxDepth = 1.0f;
+            renderSystem.RenderViews(device, scene, views, 2, renderSettings);
+        }
+        else
+        {
+            renderSystem.RenderGeometryPass(device, scene, frustum, viewProj, view, proj, primaryCamPos, cameraNearZ, cameraFarZ, renderSettings);
+        }
 
         // VSync: set KING_VSYNC=1 to enable waiting for v-sync.
         const uint32_t vsync = EnvUInt(L"KING_VSYNC", 0u);
         HRESULT phr = device.Present(vsync ? 1u : 0u);
+        if (measureInputLatency && SUCCEEDED(phr))
+        {
+            LARGE_INTEGER presentQpc{};
+            QueryPerformanceCounter(&presentQpc);
+
+            // Remember which input this present carries; match it once it reaches the screen.
+            pendingPresents[pendingPresentHead % 16u] = { device.LastPresentCount(), inputQpc.QuadPart };
+            ++pendingPresentHead;
+
+            double inputToDisplayMs = -1.0;
+            uint32_t shownCount = 0;
+            int64_t shownQpc = 0;
+            if (device.TryGetDisplayedPresent(&shownCount, &shownQpc))
+            {
+                for (PendingPresent& p : pendingPresents)
+                {
+                    if (p.presentCount != 0 && p.presentCount == shownCount)
+                    {
+                        inputToDisplayMs = (double)(shownQpc - p.inputQpc) * qpcToMs;
+                        p.presentCount = 0;
+                        break;
+                    }
+                }
+            }
+            renderSystem.SetInputLatency((double)(presentQpc.QuadPart - inputQpc.QuadPart) * qpcToMs, inputToDisplayMs);
+        }
         if (FAILED(phr))
         {
             if (device.IsDeviceLost(phr))
@@ -1169,7 +1439,15 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow)
         std::wprintf(L"[StressTest] CSV written: %s\n", stressCsvPath.c_str());
     }
 
+    if (simThread.Running())
+    {
+        simThread.Stop();
+        std::printf("[Sim] %llu steps, %llu dropped\n", (unsigned long long)simThread.StepCount(), (unsigned long long)simThread.DroppedSteps());
+    }
+
     king::render::d3d11::RenderSystemD3D11::ReleaseSceneMeshBuffers(scene);
+    if (renderSystem.AllocationCheckFailures() > 0)
+        std::printf("AllocCheck: %llu frames allocated on the render thread\n", (unsigned long long)renderSystem.AllocationCheckFailures());
     renderSystem.Shutdown();
     device.Shutdown();
     return 0;
@@ -0,0 +1,705 @@
+// Renderer benchmark: scripted scenes with fixed seeds and camera paths, rendered for a fixed
+// number of frames (offscreen by default, no window or swapchain), reporting p50/p95/p99 of
+// the CPU and GPU time of every profiled pass as JSON, so two builds can be diffed.
+// --capture saves each built scene as <dir>\<name>.kscene (SaveScene); --replay loads those
+// instead of running the scene scripts, so a run renders exactly the captured scene.
+//
+//   RenderBench [--scene <name>|all] [--frames N] [--warmup N] [--seed N]
+//               [--width W] [--height H] [--windowed] [--out results.json]
+//               [--capture <dir>] [--replay <dir>] [--no-static-bvh]
+//
+// Scenes:
+//   instances  20k spheres sharing one mesh and four materials (instancing, culling, snapshot)
+//   meshes     1.5k distinct meshes, two instances each (per-mesh binds, uploads, draw count)
+//   lights     2k spheres on a ground plane under 512 unshadowed point lights (light clusters)
+//   shadows    3k casters under a shadowed sun and 8 shadowed point lights (cascades, atlas)
+//   post       a sparse scene with SSAO (full res), bloom, vignette and tonemap
+//   world      60k shadowed statics over 1.5 km, mostly off screen (static BVH culling)
+//
+// Simulation time does not enter: the camera position is a function of the frame index, so a
+// run renders the same frames for the same seed, resolution and build. PerfAnalyzer scopes give
+// the per-pass times; frameWallMs is the wall time of the whole frame including Present.
+// "counters" are RenderSystemD3D11::FrameStats totals per frame (draws, binds, Map bytes,
+// allocations, render-thread allocations, frame arena bytes) and "gpuMemoryBytes" what the renderer's resources took on the last frame.
+
+#include "king_window.h"
+#include "king/assets/scene_file.h"
+#include "king/ecs/components.h"
+#include "king/ecs/scene.h"
+#include "king/render/d3d11/render_device_d3d11.h"
+#include "king/render/d3d11/render_system_d3d11.h"
+#include "king/render/primitive_mesh.h"
+#include "king/systems/camera_system.h"
+#include "king/systems/transform_system.h"
+
+#include <windows.h>
+#include <DirectXMath.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using RenderSettings = king::render::d3d11::RenderSystemD3D11::RenderSettings;
+
+constexpr float kPi = 3.14159265358979323846f;
+
+struct CameraPath
+{
+    king::Float3 center{ 0, 0, 0 }; // orbit center, also the look-at point
+    float radius = 30.0f;
+    float height = 12.0f;
+    float revolutions = 1.0f; // over warmup + measured frames
+};
+
+struct BenchScene
+{
+    const char* name = nullptr;
+    void (*build)(king::Scene& scene, std::mt19937& rng) = nullptr;
+    void (*configure)(RenderSettings& settings) = nullptr;
+    CameraPath path;
+};
+
+std::wstring GetExeDirectory()
+{
+    wchar_t path[MAX_PATH]{};
+    DWORD n = GetModuleFileNameW(nullptr, path, MAX_PATH);
+    if (n == 0 || n >= MAX_PATH)
+        return L".";
+
+    for (DWORD i = n; i > 0; --i)
+    {
+        if (path[i - 1] == L'\\' || path[i - 1] == L'/')
+        {
+            path[i - 1] = 0;
+            break;
+        }
+    }
+    return path;
+}
+
+std::wstring JoinPath(const std::wstring& a, const std::wstring& b)
+{
+    if (a.empty()) return b;
+    if (b.empty()) return a;
+    if (a.back() == L'\\' || a.back() == L'/') return a + b;
+    return a + L"\\" + b;
+}
+
+float Uniform(std::mt19937& rng, float lo, float hi)
+{
+    // Not std::uniform_real_distribution: its output differs between standard libraries.
+    return lo + (hi - lo) * (float)((double)rng() / 4294967296.0);
+}
+
+king::MaterialHandle PbrMaterial(king::Scene& scene, king::Float4 albedo, float roughness, float metallic,
+    king::Float3 emissive = { 0, 0, 0 })
+{
+    king::PbrMaterial mat{};
+    mat.shader = "pbr";
+    mat.shadingModel = king::MaterialShadingModel::Pbr;
+    mat.blendMode = king::MaterialBlendMode::Opaque;
+    mat.albedo = albedo;
+    mat.roughness = roughness;
+    mat.metallic = metallic;
+    mat.emissive = emissive;
+    return scene.materials.Intern(mat);
+}
+
+king::Entity AddRenderer(king::Scene& scene, king::Entity mesh, king::MaterialHandle material, king::Float3 pos,
+    float scale, bool shadows)
+{
+    king::Entity e = scene.reg.CreateEntity();
+    auto& t = *scene.reg.transforms.Emplace(e);
+    t.position = pos;
+    t.scale = { scale, scale, scale };
+
+    auto& r = *scene.reg.renderers.Emplace(e);
+    r.mesh = mesh;
+    r.material = material;
+    r.castsShadows = shadows;
+    r.receivesShadows = shadows;
+    r.isStatic = true;
+    return e;
+}
+
+void AddSun(king::Scene& scene, bool shadows)
+{
+    king::Entity e = scene.reg.CreateEntity();
+    scene.reg.transforms.Emplace(e);
+    auto& l = *scene.reg.lights.Emplace(e);
+    l.type = king::LightType::Directional;
+    l.color = { 1.0f, 0.96f, 0.9f };
+    l.intensity = 2.0f;
+    l.direction = { 0.35f, -1.0f, 0.25f };
+    l.castsShadows = shadows;
+}
+
+void AddPointLight(king::Scene& scene, king::Float3 pos, king::Float3 color, float intensity, float range, bool shadows)
+{
+    king::Entity e = scene.reg.CreateEntity();
+    scene.reg.transforms.Emplace(e)->position = pos;
+    auto& l = *scene.reg.lights.Emplace(e);
+    l.type = king::LightType::Point;
+    l.color = color;
+    l.intensity = intensity;
+    l.range = range;
+    l.castsShadows = shadows;
+}
+
+king::Entity AddGround(king::Scene& scene, float halfExtents, bool shadows)
+{
+    king::Entity mesh = scene.reg.CreateEntity();
+    king::BuildGroundPlaneMesh(*scene.reg.meshes.Emplace(mesh), halfExtents, 64);
+    return AddRenderer(scene, mesh, PbrMaterial(scene, { 0.5f, 0.5f, 0.5f, 1.0f }, 0.9f, 0.0f), { 0, 0, 0 }, 1.0f, shadows);
+}
+
+king::Entity AddSphereMesh(king::Scene& scene, int slices, int stacks)
+{
+    king::Entity mesh = scene.reg.CreateEntity();
+    king::BuildSphereMesh(*scene.reg.meshes.Emplace(mesh), 0.5f, slices, stacks);
+    return mesh;
+}
+
+// Objects on a jittered grid of `columns` columns, `spacing` apart, centered on the origin.
+king::Float3 GridPosition(std::mt19937& rng, uint32_t i, uint32_t count, uint32_t columns, float spacing, float y)
+{
+    const uint32_t rows = (count + columns - 1) / columns;
+    const float x = ((float)(i % columns) - (float)columns * 0.5f) * spacing;
+    const float z = ((float)(i / columns) - (float)rows * 0.5f) * spacing;
+    const float j = spacing * 0.25f;
+    return { x + Uniform(rng, -j, j), y, z + Uniform(rng, -j, j) };
+}
+
+void BuildInstances(king::Scene& scene, std::mt19937& rng)
+{
+    AddSun(scene, false);
+    const king::Entity sphere = AddSphereMesh(scene, 32, 16);
+    king::MaterialHandle materials[4];
+    for (uint32_t m = 0; m < 4; ++m)
+        materials[m] = PbrMaterial(scene, { 0.3f + 0.2f * (float)m, 0.6f, 0.9f - 0.2f * (float)m, 1.0f }, 0.2f + 0.2f * (float)m, (m & 1u) ? 1.0f : 0.0f);
+
+    const uint32_t count = 20000;
+    for (uint32_t i = 0; i < count; ++i)
+        AddRenderer(scene, sphere, materials[rng() & 3u], GridPosition(rng, i, count, 200, 1.25f, Uniform(rng, 0.5f, 3.0f)), 0.55f, false);
+}
+
+void BuildMeshes(king::Scene& scene, std::mt19937& rng)
+{
+    AddSun(scene, false);
+    const king::MaterialHandle material = PbrMaterial(scene, { 0.8f, 0.7f, 0.6f, 1.0f }, 0.5f, 0.0f);
+
+    const uint32_t meshCount = 1500;
+    for (uint32_t i = 0; i < meshCount; ++i)
+    {
+        king::Entity mesh = scene.reg.CreateEntity();
+        if (i & 1u)
+            king::BuildCubeMesh(*scene.reg.meshes.Emplace(mesh), Uniform(rng, 0.3f, 0.5f));
+        else
+            king::BuildSphereMesh(*scene.reg.meshes.Emplace(mesh), 0.5f, 8 + (int)(rng() % 25u), 4 + (int)(rng() % 13u));
+
+        for (uint32_t k = 0; k < 2; ++k)
+            AddRenderer(scene, mesh, material, GridPosition(rng, i * 2 + k, meshCount * 2, 60, 1.5f, 0.75f), 1.0f, false);
+    }
+}
+
+void BuildLights(king::Scene& scene, std::mt19937& rng)
+{
+    AddGround(scene, 60.0f, false);
+    const king::Entity sphere = AddSphereMesh(scene, 24, 12);
+    const king::MaterialHandle material = PbrMaterial(scene, { 0.9f, 0.9f, 0.9f, 1.0f }, 0.4f, 0.0f);
+
+    const uint32_t count = 2000;
+    for (uint32_t i = 0; i < count; ++i)
+        AddRenderer(scene, sphere, material, GridPosition(rng, i, count, 50, 2.0f, 0.5f), 0.8f, false);
+
+    for (uint32_t i = 0; i < 512; ++i)
+    {
+        const king::Float3 pos{ Uniform(rng, -50.0f, 50.0f), Uniform(rng, 0.5f, 3.0f), Uniform(rng, -50.0f, 50.0f) };
+        const king::Float3 color{ Uniform(rng, 0.2f, 1.0f), Uniform(rng, 0.2f, 1.0f), Uniform(rng, 0.2f, 1.0f) };
+        AddPointLight(scene, pos, color, 4.0f, Uniform(rng, 3.0f, 6.0f), false);
+    }
+}
+
+void BuildShadows(king::Scene& scene, std::mt19937& rng)
+{
+    AddSun(scene, true);
+    AddGround(scene, 80.0f, true);
+    const king::Entity sphere = AddSphereMesh(scene, 32, 16);
+    king::Entity cube = scene.reg.CreateEntity();
+    king::BuildCubeMesh(*scene.reg.meshes.Emplace(cube), 0.5f);
+    const king::MaterialHandle material = PbrMaterial(scene, { 0.8f, 0.8f, 0.8f, 1.0f }, 0.6f, 0.0f);
+
+    const uint32_t count = 3000;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const float scale = Uniform(rng, 0.6f, 1.6f);
+        AddRenderer(scene, (rng() & 1u) ? sphere : cube, material, GridPosition(rng, i, count, 60, 2.5f, scale * 0.5f), scale, true);
+    }
+
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        const float a = (float)i * (2.0f * kPi / 8.0f);
+        AddPointLight(scene, { std::cos(a) * 25.0f, 4.0f, std::sin(a) * 25.0f }, { 1.0f, 0.85f, 0.7f }, 8.0f, 14.0f, true);
+    }
+}
+
+void BuildPost(king::Scene& scene, std::mt19937& rng)
+{
+    AddSun(scene, false);
+    AddGround(scene, 40.0f, false);
+    const king::Entity sphere = AddSphereMesh(scene, 48, 24);
+
+    for (uint32_t i = 0; i < 64; ++i)
+    {
+        // A few emissive spheres feed the bloom.
+        const king::Float3 emissive = (i % 8u == 0u) ? king::Float3{ 2.0f, 1.2f, 0.6f } : king::Float3{ 0, 0, 0 };
+        const king::MaterialHandle material = PbrMaterial(scene, { 0.7f, 0.7f, 0.75f, 1.0f }, Uniform(rng, 0.1f, 0.9f), 0.0f, emissive);
+        AddRenderer(scene, sphere, material, GridPosition(rng, i, 64, 8, 4.0f, 1.0f), 2.0f, false);
+    }
+}
+
+void BuildWorld(king::Scene& scene, std::mt19937& rng)
+{
+    AddSun(scene, true);
+    const king::Entity sphere = AddSphereMesh(scene, 16, 8);
+    king::Entity cube = scene.reg.CreateEntity();
+    king::BuildCubeMesh(*scene.reg.meshes.Emplace(cube), 0.5f);
+    const king::MaterialHandle material = PbrMaterial(scene, { 0.7f, 0.75f, 0.7f, 1.0f }, 0.7f, 0.0f);
+    constexpr uint32_t count = 60000;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const float scale = Uniform(rng, 0.5f, 2.0f);
+        AddRenderer(scene, (rng() & 1u) ? sphere : cube, material, GridPosition(rng, i, count, 245, 6.0f, scale * 0.5f), scale, true);
+    }
+}
+
+void ConfigureDefault(RenderSettings& s)
+{
+    s.enableShadows = false;
+    s.enableSsao = false;
+    s.enableBloom = false;
+    s.enableVignette = false;
+}
+
+void ConfigureShadows(RenderSettings& s)
+{
+    ConfigureDefault(s);
+    s.enableShadows = true;
+    s.shadowMapSize = 2048;
+    s.cascadeCount = 3;
+    s.shadowMaxDistance = 120.0f;
+}
+
+void ConfigurePost(RenderSettings& s)
+{
+    ConfigureDefault(s);
+    s.enableSsao = true;
+    s.ssaoQuality = 2;
+    s.enableBloom = true;
+    s.bloomIntensity = 0.7f;
+    s.bloomThreshold = 1.0f;
+    s.enableVignette = true;
+}
+
+const BenchScene kScenes[] = {
+    { "instances", BuildInstances, ConfigureDefault, { { 0, 0, 0 }, 70.0f, 25.0f, 1.0f } },
+    { "meshes", BuildMeshes, ConfigureDefault, { { 0, 0, 0 }, 45.0f, 18.0f, 1.0f } },
+    { "lights", BuildLights, ConfigureDefault, { { 0, 0, 0 }, 40.0f, 12.0f, 1.0f } },
+    { "shadows", BuildShadows, ConfigureShadows, { { 0, 0, 0 }, 50.0f, 20.0f, 1.0f } },
+    { "post", BuildPost, ConfigurePost, { { 0, 1, 0 }, 20.0f, 6.0f, 1.0f } },
+    { "world", BuildWorld, ConfigureShadows, { { 0, 0, 0 }, 60.0f, 8.0f, 1.0f } },
+};
+
+void PlaceCamera(king::Camera& camera, const CameraPath& path, float t)
+{
+    const float a = t * path.revolutions * 2.0f * kPi;
+    const king::Float3 eye{ path.center.x + std::cos(a) * path.radius, path.center.y + path.height,
+                            path.center.z + std::sin(a) * path.radius };
+    const float dx = path.center.x - eye.x;
+    const float dy = path.center.y - eye.y;
+    const float dz = path.center.z - eye.z;
+    const float yaw = std::atan2(dx, dz);
+    const float pitch = std::atan2(-dy, std::sqrt(dx * dx + dz * dz));
+
+    king::Float4 q{};
+    DirectX::XMStoreFloat4((DirectX::XMFLOAT4*)&q, DirectX::XMQuaternionRotationRollPitchYaw(pitch, yaw, 0.0f));
+    camera.SetPosition(eye);
+    camera.SetOrientation(q);
+}
+
+struct Stats
+{
+    double avg = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+// Nearest-rank percentiles.
+Stats ComputeStats(std::vector<double> v)
+{
+    Stats s;
+    if (v.empty())
+        return s;
+    std::sort(v.begin(), v.end());
+    auto rank = [&](double p)
+    {
+        const size_t r = (size_t)std::ceil(p * (double)v.size());
+        return v[std::min(v.size(), std::max<size_t>(r, 1)) - 1];
+    };
+    double sum = 0.0;
+    for (double x : v)
+        sum += x;
+    s.avg = sum / (double)v.size();
+    s.p50 = rank(0.50);
+    s.p95 = rank(0.95);
+    s.p99 = rank(0.99);
+    s.max = v.back();
+    return s;
+}
+
+struct SceneResult
+{
+    std::string name;
+    uint32_t renderers = 0;
+    uint32_t meshes = 0;
+    uint32_t lights = 0;
+    std::vector<double> frameWallMs;
+    std::map<std::string, std::vector<double>> cpuMs;
+    std::map<std::string, std::vector<double>> gpuMs;
+    std::map<std::string, std::vector<double>> counters;
+    king::render::d3d11::RenderSystemD3D11::FrameStats lastStats;
+};
+
+void WriteStats(std::FILE* f, const Stats& s)
+{
+    std::fprintf(f, "{\"avg\":%.4f,\"p50\":%.4f,\"p95\":%.4f,\"p99\":%.4f,\"max\":%.4f}", s.avg, s.p50, s.p95, s.p99, s.max);
+}
+
+void WritePasses(std::FILE* f, const std::map<std::string, std::vector<double>>& passes)
+{
+    std::fputs("{", f);
+    bool first = true;
+    for (const auto& [name, samples] : passes)
+    {
+        if (samples.empty())
+            continue;
+        std::fprintf(f, "%s\n        \"%s\":", first ? "" : ",", name.c_str());
+        WriteStats(f, ComputeStats(samples));
+        first = false;
+    }
+    std::fputs("\n      }", f);
+}
+
+bool WriteResults(const std::wstring& path, const std::vector<SceneResult>& results, uint32_t width, uint32_t height,
+    uint32_t frames, uint32_t warmup, uint32_t seed, bool offscreen)
+{
+    std::FILE* f = nullptr;
+    if (_wfopen_s(&f, path.c_str(), L"wb") != 0 || !f)
+        return false;
+
+    std::fprintf(f, "{\n  \"width\":%u,\"height\":%u,\"frames\":%u,\"warmup\":%u,\"seed\":%u,\"offscreen\":%s,\n  \"scenes\":[",
+        width, height, frames, warmup, seed, offscreen ? "true" : "false");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const SceneResult& r = results[i];
+        std::fprintf(f, "%s\n    {\n      \"name\":\"%s\",\"renderers\":%u,\"meshes\":%u,\"lights\":%u,\n      \"frameWallMs\":",
+            i ? "," : "", r.name.c_str(), r.renderers, r.meshes, r.lights);
+        WriteStats(f, ComputeStats(r.frameWallMs));
+        std::fputs(",\n      \"cpuMs\":", f);
+        WritePasses(f, r.cpuMs);
+        std::fputs(",\n      \"gpuMs\":", f);
+        WritePasses(f, r.gpuMs);
+        std::fputs(",\n      \"counters\":", f);
+        WritePasses(f, r.counters);
+        const auto& s = r.lastStats;
+        std::fprintf(f, ",\n      \"gpuMemoryBytes\":{\"shadowMaps\":%llu,\"renderTargets\":%llu,\"instanceBuffers\":%llu,\"textures\":%llu}",
+            (unsigned long long)s.shadowMaps.bytes, (unsigned long long)s.renderTargets.bytes,
+            (unsigned long long)s.instanceBuffers.bytes, (unsigned long long)s.textures.bytes);
+        std::fputs("\n    }", f);
+    }
+    std::fputs("\n  ]\n}\n", f);
+    const bool ok = std::ferror(f) == 0;
+    std::fclose(f);
+    return ok;
+}
+
+struct Options
+{
+    std::string scene = "all";
+    uint32_t frames = 600;
+    uint32_t warmup = 120;
+    uint32_t seed = 1;
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    bool windowed = false;
+    std::wstring out;
+    std::wstring captureDir;
+    std::wstring replayDir;
+    bool staticBvh = true;
+};
+
+bool RunScene(const BenchScene& bench, const Options& opt, king::render::d3d11::RenderDeviceD3D11& device,
+    king::Window* window, const std::wstring& shaderPath, SceneResult& result)
+{
+    king::Scene scene;
+    // Each scene gets its own stream, so adding a scene does not change the others.
+    std::mt19937 rng(opt.seed * 2654435761u + (uint32_t)std::strlen(bench.name) * 40503u + (uint32_t)bench.name[0]);
+    const std::wstring nameW(bench.name, bench.name + std::strlen(bench.name));
+    if (!opt.replayDir.empty())
+    {
+        const std::wstring path = JoinPath(opt.replayDir, nameW + L".kscene");
+        std::string err;
+        const auto t0 = std::chrono::steady_clock::now();
+        if (!king::LoadScene(scene, path, nullptr, &err))
+        {
+            std::printf("[%s] cannot load '%ls': %s\n", bench.name, path.c_str(), err.c_str());
+            return false;
+        }
+        const double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::printf("[%s] loaded %zu entities in %.3f ms\n", bench.name, scene.reg.Alive().size(), loadMs);
+    }
+    else
+    {
+        bench.build(scene, rng);
+    }
+    if (!opt.captureDir.empty())
+    {
+        const std::wstring path = JoinPath(opt.captureDir, nameW + L".kscene");
+        std::string err;
+        if (!king::SaveScene(scene, path, &err))
+        {
+            std::printf("[%s] cannot save '%ls': %s\n", bench.name, path.c_str(), err.c_str());
+            return false;
+        }
+    }
+
+    king::Entity camEnt = scene.reg.CreateEntity();
+    scene.reg.transforms.Emplace(camEnt);
+    auto& cc = *scene.reg.cameras.Emplace(camEnt);
+    cc.primary = true;
+    king::PerspectiveParams persp;
+    persp.aspect = (float)opt.width / (float)opt.height;
+    cc.camera.SetPerspective(persp);
+
+    king::render::d3d11::RenderSystemD3D11 renderSystem;
+    renderSystem.SetShaderCacheDir(JoinPath(GetExeDirectory(), L"shader_cache"));
+    renderSystem.SetPerfEnabled(true);
+    renderSystem.SetGpuPerfEnabled(true);
+    renderSystem.SetPerfPrintToStdout(false);
+    if (!renderSystem.Initialize(device, shaderPath))
+    {
+        std::printf("[%s] failed to initialize the render system\n", bench.name);
+        return false;
+    }
+
+    RenderSettings settings{};
+    settings.enableHdr = true;
+    settings.enableTonemap = true;
+    settings.exposure = 0.6f;
+    settings.shadowFilterQuality = 1;
+    bench.configure(settings);
+    settings.enableStaticBvh = opt.staticBvh;
+
+    king::systems::TransformSystem transformSystem;
+    const uint32_t workers = scene.reg.WorkerThreads();
+
+    result.name = bench.name;
+    result.renderers = (uint32_t)scene.reg.renderers.Entities().size();
+    result.meshes = (uint32_t)scene.reg.meshes.Entities().size();
+    result.lights = (uint32_t)scene.reg.lights.Entities().size();
+    std::printf("[%s] %u renderers, %u meshes, %u lights\n", bench.name, result.renderers, result.meshes, result.lights);
+
+    const uint32_t total = opt.warmup + opt.frames;
+    bool ok = true;
+    for (uint32_t frame = 0; frame < total && ok; ++frame)
+    {
+        if (window)
+        {
+            king::Window::Event ev{};
+            while (window->PollEvent(ev))
+            {
+            }
+        }
+
+        const auto t0 = std::chrono::steady_clock::now();
+
+        PlaceCamera(cc.camera, bench.path, (float)frame / (float)total);
+
+        king::Frustum frustum{};
+        king::Mat4x4 viewProj{};
+        transformSystem.Update(scene, workers);
+        (void)king::systems::CameraSystem::UpdatePrimaryCamera(scene, frustum, viewProj);
+        const king::Mat4x4 view = cc.camera.ViewMatrix();
+        const king::Mat4x4 proj = cc.camera.ProjectionMatrix();
+        renderSystem.PrepareSnapshot(scene, workers);
+
+        const float clearColor[4] = { 0.06f, 0.06f, 0.08f, 1.0f };
+        device.BeginFrame(clearColor);
+        renderSystem.RenderGeometryPass(device, scene, frustum, viewProj, view, proj, cc.camera.Position(),
+            persp.nearZ, persp.farZ, settings);
+
+        const HRESULT hr = device.Present(0);
+        if (FAILED(hr))
+        {
+            std::printf("[%s] Present failed: hr=0x%08X\n", bench.name, (unsigned)hr);
+            ok = false;
+        }
+
+        const double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        if (frame < opt.warmup)
+            continue;
+
+        result.frameWallMs.push_back(wallMs);
+        for (const auto& s : renderSystem.PerfSamples())
+        {
+            if (!s.name)
+                continue;
+            result.cpuMs[s.name].push_back(s.cpuMs);
+            // GPU results trail by a few frames; a frame without one is left out.
+            if (s.gpuMs >= 0.0)
+                result.gpuMs[s.name].push_back(s.gpuMs);
+        }
+
+        const auto& stats = renderSystem.LastFrameStats();
+        result.counters["draws"].push_back((double)stats.total.draws);
+        result.counters["instances"].push_back((double)stats.total.instances);
+        result.counters["dispatches"].push_back((double)stats.total.dispatches);
+        result.counters["stateChanges"].push_back((double)stats.total.stateChanges);
+        result.counters["mapBytes"].push_back((double)stats.total.mapBytes);
+        result.counters["allocations"].push_back((double)stats.allocations);
+        result.counters["renderThreadAllocations"].push_back((double)stats.renderThreadAllocations);
+        result.counters["frameArenaBytes"].push_back((double)stats.frameArenaBytes);
+        result.lastStats = stats;
+    }
+
+    king::render::d3d11::RenderSystemD3D11::ReleaseSceneMeshBuffers(scene);
+    renderSystem.Shutdown();
+
+    const Stats wall = ComputeStats(result.frameWallMs);
+    std::printf("[%s] frame wall ms: p50 %.3f  p95 %.3f  p99 %.3f\n", bench.name, wall.p50, wall.p95, wall.p99);
+    return ok;
+}
+
+} // namespace
+
+int wmain(int argc, wchar_t** argv)
+{
+    Options opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (!wcscmp(argv[i], L"--scene") && hasValue)
+        {
+            const std::wstring w = argv[++i];
+            opt.scene.assign(w.begin(), w.end());
+        }
+        else if (!wcscmp(argv[i], L"--frames") && hasValue)
+            opt.frames = (uint32_t)std::wcstoul(argv[++i], nullptr, 10);
+        else if (!wcscmp(argv[i], L"--warmup") && hasValue)
+            opt.warmup = (uint32_t)std::wcstoul(argv[++i], nullptr, 10);
+        else if (!wcscmp(argv[i], L"--seed") && hasValue)
+            opt.seed = (uint32_t)std::wcstoul(argv[++i], nullptr, 10);
+        else if (!wcscmp(argv[i], L"--width") && hasValue)
+            opt.width = (uint32_t)std::wcstoul(argv[++i], nullptr, 10);
+        else if (!wcscmp(argv[i], L"--height") && hasValue)
+            opt.height = (uint32_t)std::wcstoul(argv[++i], nullptr, 10);
+        else if (!wcscmp(argv[i], L"--windowed"))
+            opt.windowed = true;
+        else if (!wcscmp(argv[i], L"--out") && hasValue)
+            opt.out = argv[++i];
+        else if (!wcscmp(argv[i], L"--capture") && hasValue)
+            opt.captureDir = argv[++i];
+        else if (!wcscmp(argv[i], L"--replay") && hasValue)
+            opt.replayDir = argv[++i];
+        else if (!wcscmp(argv[i], L"--no-static-bvh"))
+            opt.staticBvh = false;
+        else
+        {
+            std::printf("Usage: RenderBench [--scene <name>|all] [--frames N] [--warmup N] [--seed N]\n"
+                        "                   [--width W] [--height H] [--windowed] [--out results.json]\n"
+                        "                   [--capture <dir>] [--replay <dir>] [--no-static-bvh]\n"
+                        "Scenes:");
+            for (const BenchScene& s : kScenes)
+                std::printf(" %s", s.name);
+            std::printf("\n");
+            return 1;
+        }
+    }
+    if (opt.frames == 0 || opt.width == 0 || opt.height == 0)
+    {
+        std::printf("RenderBench: frames, width and height must be non-zero\n");
+        return 1;
+    }
+    if (opt.out.empty())
+        opt.out = JoinPath(GetExeDirectory(), L"bench_results.json");
+
+    std::vector<const BenchScene*> selected;
+    for (const BenchScene& s : kScenes)
+    {
+        if (opt.scene == "all" || opt.scene == s.name)
+            selected.push_back(&s);
+    }
+    if (selected.empty())
+    {
+        std::printf("RenderBench: unknown scene '%s'\n", opt.scene.c_str());
+        return 1;
+    }
+
+    king::Window window;
+    if (opt.windowed)
+    {
+        king::Window::Desc desc;
+        desc.width = opt.width;
+        desc.height = opt.height;
+        desc.title = L"King - RenderBench";
+        desc.resizable = false;
+        if (!window.Create(GetModuleHandleW(nullptr), desc))
+            return 1;
+        window.Show(SW_SHOW);
+    }
+
+    king::render::d3d11::RenderDeviceD3D11 device;
+    const HRESULT hr = opt.windowed ? device.Initialize(window.Handle(), window.ClientWidth(), window.ClientHeight())
+                                    : device.InitializeOffscreen(opt.width, opt.height);
+    if (FAILED(hr))
+    {
+        std::printf("RenderBench: device creation failed: hr=0x%08X\n", (unsigned)hr);
+        return 1;
+    }
+    (void)device.ApplyQueuedResize(nullptr, nullptr);
+
+    const std::wstring shaderPath = JoinPath(GetExeDirectory(), L"..\\..\\assets\\shaders\\pbr_test.hlsl");
+    std::vector<SceneResult> results;
+    bool ok = true;
+    for (const BenchScene* s : selected)
+    {
+        results.emplace_back();
+        ok = RunScene(*s, opt, device, opt.windowed ? &window : nullptr, shaderPath, results.back()) && ok;
+    }
+
+    const uint32_t width = device.BackBufferWidth();
+    const uint32_t height = device.BackBufferHeight();
+    device.Shutdown();
+
+    if (!WriteResults(opt.out, results, width, height, opt.frames, opt.warmup, opt.seed, !opt.windowed))
+    {
+        std::printf("RenderBench: cannot write '%ls'\n", opt.out.c_str());
+        return 1;
+    }
+    std::printf("RenderBench: wrote '%ls'\n", opt.out.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+// Offline shader precompile: fills a ShaderCache disk directory with every engine shader and
+// material variant (plus any custom material shaders given), so the first run after a build
+// or shader change does not compile at startup.
+//
+//   ShaderPrecompile <main shader .hlsl> <cache dir> [--threads N] [custom material shaders...]
+//
+// The cache key includes the compile flags, so build this tool in the same configuration
+// (Debug/Release) as the game it is filling the cache for.
+
+#include "king/jobs/job_system.h"
+#include "king/render/d3d11/shader_variants_d3d11.h"
+#include "king/render/shader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <string>
+#include <thread>
+#include <vector>
+
+int wmain(int argc, wchar_t** argv)
+{
+    std::vector<std::wstring> positional;
+    uint32_t threads = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!wcscmp(argv[i], L"--threads") && i + 1 < argc)
+            threads = (uint32_t)std::wcstoul(argv[++i], nullptr, 10);
+        else
+            positional.push_back(argv[i]);
+    }
+
+    if (positional.size() < 2)
+    {
+        std::printf("Usage: ShaderPrecompile <main shader .hlsl> <cache dir> [--threads N] [custom material shaders...]\n");
+        return 1;
+    }
+
+    std::vector<king::ShaderCompileRequest> requests = king::render::d3d11::EngineShaderVariants(positional[0]);
+    for (size_t i = 2; i < positional.size(); ++i)
+        king::render::d3d11::AppendGeometryProgramVariants(positional[i], {}, requests);
+
+    if (threads == 0)
+    {
+        const unsigned hc = std::thread::hardware_concurrency();
+        threads = (hc > 1) ? hc - 1 : 0; // plus this thread
+    }
+    king::JobSystem jobs;
+    jobs.Start(threads);
+
+    king::ShaderCache cache(nullptr);
+    cache.SetDiskCacheDir(positional[1]);
+
+    const auto t0 = std::chrono::steady_clock::now();
+    const uint32_t failed = cache.Precompile(requests, jobs);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    jobs.Stop();
+
+    std::printf("%zu shaders in %.1f ms: %u compiled, %u already cached, %u failed\n", requests.size(), ms,
+        cache.Compiles(), cache.DiskHits(), failed);
+    return failed ? 1 : 0;
+}
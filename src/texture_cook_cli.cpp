@@ -0,0 +1,267 @@
+// Offline texture cooker: source images (anything WIC reads) -> block-compressed DDS files
+// with full mip chains, or one .kpak holding every input as a texture entry.
+//
+//   TextureCook [--format bc7|bc1|bc3|bc4|bc5|rgba8] [--srgb|--linear] [--no-mips] [-o out] inputs...
+//
+// Suggested formats: bc7 albedo, bc5 normals (RG only; shaders rebuild z), bc4 single-channel
+// masks, bc1 opaque metallic-roughness / emissive. Files always store the UNORM format; the
+// engine picks the _SRGB view per material slot, so --srgb only selects linear-space mip
+// filtering (the default for bc7/bc1/bc3/rgba8).
+
+#include "king/assets/asset_pack.h"
+#include "king/render/bc_encode.h"
+#include "king/render/dds.h"
+#include "king/render/image_wic.h"
+#include "king/render/texture_mips.h"
+
+#include <windows.h>
+#include <wincodec.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct CookOptions
+{
+    DXGI_FORMAT format = DXGI_FORMAT_BC7_UNORM;
+    int srgb = -1; // -1 = by format
+    bool mips = true;
+    std::wstring output;
+    std::vector<std::wstring> inputs;
+};
+
+struct CookedTexture
+{
+    king::PackTextureHeader header{};
+    std::vector<std::vector<uint8_t>> levels;
+    std::vector<uint32_t> rowPitch;
+    std::vector<uint32_t> slicePitch;
+};
+
+bool ParseFormat(const wchar_t* s, DXGI_FORMAT& out)
+{
+    if (!wcscmp(s, L"bc1")) out = DXGI_FORMAT_BC1_UNORM;
+    else if (!wcscmp(s, L"bc3")) out = DXGI_FORMAT_BC3_UNORM;
+    else if (!wcscmp(s, L"bc4")) out = DXGI_FORMAT_BC4_UNORM;
+    else if (!wcscmp(s, L"bc5")) out = DXGI_FORMAT_BC5_UNORM;
+    else if (!wcscmp(s, L"bc7")) out = DXGI_FORMAT_BC7_UNORM;
+    else if (!wcscmp(s, L"rgba8")) out = DXGI_FORMAT_R8G8B8A8_UNORM;
+    else return false;
+    return true;
+}
+
+bool EndsWith(const std::wstring& s, const wchar_t* suffix)
+{
+    const size_t n = wcslen(suffix);
+    return s.size() >= n && _wcsicmp(s.c_str() + s.size() - n, suffix) == 0;
+}
+
+std::wstring ReplaceExtension(const std::wstring& path, const wchar_t* ext)
+{
+    const size_t slash = path.find_last_of(L"\\/");
+    const size_t dot = path.find_last_of(L'.');
+    if (dot == std::wstring::npos || (slash != std::wstring::npos && dot < slash))
+        return path + ext;
+    return path.substr(0, dot) + ext;
+}
+
+std::string ToUtf8(const std::wstring& w)
+{
+    const int n = WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(), nullptr, 0, nullptr, nullptr);
+    std::string s((size_t)(n > 0 ? n : 0), '\0');
+    if (n > 0)
+        WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(), s.data(), n, nullptr, nullptr);
+    return s;
+}
+
+bool Cook(IWICImagingFactory* factory, const std::wstring& input, const CookOptions& opt, CookedTexture& out)
+{
+    std::vector<uint8_t> rgba;
+    uint32_t w = 0, h = 0;
+    if (!king::LoadWicRgba8(factory, input, rgba, w, h))
+    {
+        std::printf("TextureCook: cannot read '%ls'\n", input.c_str());
+        return false;
+    }
+
+    const bool compressed = king::BlockCompressedBytes(opt.format) != 0;
+    if (compressed && ((w & 3u) || (h & 3u)))
+    {
+        // D3D11 requires the top level of a BC texture to be whole blocks.
+        std::printf("TextureCook: '%ls' is %ux%u; BC formats need multiples of 4\n", input.c_str(), w, h);
+        return false;
+    }
+
+    const bool srgb = (opt.srgb >= 0) ? (opt.srgb != 0)
+        : (opt.format != DXGI_FORMAT_BC4_UNORM && opt.format != DXGI_FORMAT_BC5_UNORM);
+
+    std::vector<uint8_t> chain;
+    std::vector<king::MipLevelDesc> mips;
+    if (opt.mips)
+    {
+        king::GenerateMipChainRgba8(rgba.data(), w, h, srgb, chain, mips);
+    }
+    else
+    {
+        chain = std::move(rgba);
+        mips.push_back({ 0, w, h });
+    }
+
+    out.header = {};
+    out.header.format = (uint32_t)opt.format;
+    out.header.width = w;
+    out.header.height = h;
+    out.header.mipLevels = (uint32_t)mips.size();
+    out.header.arraySize = 1;
+    out.levels.resize(mips.size());
+    out.rowPitch.resize(mips.size());
+    out.slicePitch.resize(mips.size());
+    for (size_t i = 0; i < mips.size(); ++i)
+    {
+        const king::MipLevelDesc& m = mips[i];
+        const uint8_t* src = chain.data() + m.offset;
+        king::ComputeSurfacePitch(opt.format, m.width, m.height, out.rowPitch[i], out.slicePitch[i]);
+        if (compressed)
+            king::CompressRgba8(src, m.width, m.height, opt.format, out.levels[i]);
+        else
+            out.levels[i].assign(src, src + (size_t)m.width * m.height * 4u);
+    }
+    return true;
+}
+
+bool SaveBytes(const std::wstring& path, const std::vector<uint8_t>& bytes)
+{
+    FILE* f = nullptr;
+    if (_wfopen_s(&f, path.c_str(), L"wb") != 0 || !f)
+        return false;
+    const bool ok = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    std::fclose(f);
+    return ok;
+}
+
+void PrintUsage()
+{
+    std::printf("Usage: TextureCook [--format bc7|bc1|bc3|bc4|bc5|rgba8] [--srgb|--linear] [--no-mips] [-o out.dds|out.kpak] inputs...\n");
+    std::printf("  Without -o each input is written next to itself as .dds. A .kpak output packs\n");
+    std::printf("  every input as a texture entry keyed by its path as given.\n");
+}
+
+} // namespace
+
+int wmain(int argc, wchar_t** argv)
+{
+    CookOptions opt{};
+    for (int i = 1; i < argc; ++i)
+    {
+        const wchar_t* a = argv[i];
+        if (!wcscmp(a, L"--format") && i + 1 < argc)
+        {
+            if (!ParseFormat(argv[++i], opt.format))
+            {
+                std::printf("TextureCook: unknown format '%ls'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!wcscmp(a, L"--srgb"))
+            opt.srgb = 1;
+        else if (!wcscmp(a, L"--linear"))
+            opt.srgb = 0;
+        else if (!wcscmp(a, L"--no-mips"))
+            opt.mips = false;
+        else if (!wcscmp(a, L"-o") && i + 1 < argc)
+            opt.output = argv[++i];
+        else if (a[0] == L'-')
+        {
+            PrintUsage();
+            return 1;
+        }
+        else
+            opt.inputs.push_back(a);
+    }
+
+    const bool toPack = EndsWith(opt.output, L".kpak");
+    if (opt.inputs.empty() || (!opt.output.empty() && !toPack && opt.inputs.size() > 1))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    const HRESULT coHr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    IWICImagingFactory* factory = nullptr;
+    if (FAILED(CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory))))
+    {
+        std::printf("TextureCook: WIC is unavailable\n");
+        if (SUCCEEDED(coHr))
+            CoUninitialize();
+        return 1;
+    }
+
+    int failures = 0;
+    king::AssetPackWriter pack;
+    for (const std::wstring& input : opt.inputs)
+    {
+        CookedTexture tex;
+        if (!Cook(factory, input, opt, tex))
+        {
+            failures++;
+            continue;
+        }
+
+        std::vector<const void*> data(tex.levels.size());
+        uint64_t bytes = 0;
+        for (size_t i = 0; i < tex.levels.size(); ++i)
+        {
+            data[i] = tex.levels[i].data();
+            bytes += tex.slicePitch[i];
+        }
+
+        if (toPack)
+        {
+            if (!pack.AddTexture(ToUtf8(input), tex.header, data.data(), tex.rowPitch.data(), tex.slicePitch.data()))
+            {
+                std::printf("TextureCook: cannot add '%ls' to the pack\n", input.c_str());
+                failures++;
+                continue;
+            }
+            std::printf("%ls: %ux%u, %u mips, %llu KB\n", input.c_str(), tex.header.width, tex.header.height,
+                tex.header.mipLevels, (unsigned long long)(bytes / 1024u));
+            continue;
+        }
+
+        std::vector<uint8_t> dds;
+        const std::wstring outPath = opt.output.empty() ? ReplaceExtension(input, L".dds") : opt.output;
+        if (!king::WriteDds(dds, (DXGI_FORMAT)tex.header.format, tex.header.width, tex.header.height, tex.header.mipLevels, 1,
+                data.data(), tex.slicePitch.data()) ||
+            !SaveBytes(outPath, dds))
+        {
+            std::printf("TextureCook: cannot write '%ls'\n", outPath.c_str());
+            failures++;
+            continue;
+        }
+        std::printf("%ls -> %ls: %ux%u, %u mips, %llu KB\n", input.c_str(), outPath.c_str(), tex.header.width,
+            tex.header.height, tex.header.mipLevels, (unsigned long long)(bytes / 1024u));
+    }
+
+    if (toPack && pack.EntryCount() > 0)
+    {
+        std::string err;
+        if (!pack.Save(opt.output, &err))
+        {
+            std::printf("TextureCook: cannot write '%ls': %s\n", opt.output.c_str(), err.c_str());
+            failures++;
+        }
+        else
+        {
+            std::printf("Wrote %ls (%zu textures)\n", opt.output.c_str(), pack.EntryCount());
+        }
+    }
+
+    factory->Release();
+    if (SUCCEEDED(coHr))
+        CoUninitialize();
+    return failures ? 1 : 0;
+}
@@ -3,13 +3,6 @@
 #include <conio.h>
 #include <cstdio>
 #include <cstdlib>
-#include <string>
-#include <fstream>
-
-#ifdef _WIN32
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
-#endif
 
 static void ClearScreen()
 {
@@ -17,60 +10,6 @@ static void ClearScreen()
     std::system("cls");
 }
 
-static void SaveConfig(const king::ThreadConfig& cfg)
-{
-    // Persist next to the executable (engine prefers this location), fall back to CWD.
-    std::string path = "thread_config.cfg";
-
-#ifdef _WIN32
-    {
-        wchar_t exePathW[32768]{};
-        DWORD n = GetModuleFileNameW(nullptr, exePathW, (DWORD)(sizeof(exePathW) / sizeof(exePathW[0])));
-        if (n > 0 && n < (DWORD)(sizeof(exePathW) / sizeof(exePathW[0])))
-        {
-            // Strip filename
-            size_t end = n;
-            while (end > 0)
-            {
-                wchar_t c = exePathW[end - 1];
-                if (c == L'\\' || c == L'/')
-                    break;
-                --end;
-            }
-            std::wstring dir(exePathW, exePathW + end);
-            std::wstring cfgW = dir + L"thread_config.cfg";
-
-            int needed = WideCharToMultiByte(CP_UTF8, 0, cfgW.c_str(), (int)cfgW.size(), nullptr, 0, nullptr, nullptr);
-            if (needed > 0)
-            {
-                std::string u8;
-                u8.resize((size_t)needed);
-                WideCharToMultiByte(CP_UTF8, 0, cfgW.c_str(), (int)cfgW.size(), u8.data(), needed, nullptr, nullptr);
-                path = u8;
-            }
-        }
-    }
-#endif
-
-    std::ofstream f(path.c_str(), std::ios::trunc);
-    if (!f.is_open())
-    {
-        // Fallback to CWD
-        std::ofstream f2("thread_config.cfg", std::ios::trunc);
-        if (!f2.is_open())
-            return;
-        f.swap(f2);
-    }
-
-    f << "# King thread config\n";
-    f << "# Edited by ThreadConfigCLI\n";
-    f << "threads_max=" << cfg.maxThreads << "\n";
-    f << "threads_ecs=" << cfg.ecsWorkerThreads << "\n";
-    f << "threads_render_prepare=" << cfg.renderPrepareWorkerThreads << "\n";
-    f << "threads_render_shadows=" << cfg.renderShadowRecordThreads << "\n";
-    f << "threads_render_deferred_contexts=" << cfg.renderDeferredContexts << "\n";
-}
-
 static uint32_t ClampU32(int v)
 {
     if (v < 0) return 0u;
@@ -81,7 +20,8 @@ static uint32_t ClampU32(int v)
 int main()
 {
     // Start from the currently loaded config (file + env overrides).
-    // NOTE: This CLI persists to file; env vars still override at runtime.
+    // NOTE: This CLI persists to file; env vars still override at runtime. A running King
+    // watches the file and applies a save live.
     king::ThreadConfig cfg = king::LoadThreadConfig();
 
     enum Field
@@ -91,6 +31,7 @@ int main()
         RenderPrepareThreads,
         RenderShadowThreads,
         RenderDeferredContexts,
+        AutoTune,
         FieldCount
     };
 
@@ -114,6 +55,7 @@ int main()
         PrintRow(RenderPrepareThreads, "renderPrepareWorkerThreads", cfg.renderPrepareWorkerThreads);
         PrintRow(RenderShadowThreads, "renderShadowRecordThreads", cfg.renderShadowRecordThreads);
         PrintRow(RenderDeferredContexts, "renderDeferredContexts", cfg.renderDeferredContexts);
+        PrintRow(AutoTune, "autoTune (0/1)", cfg.autoTune ? 1u : 0u);
 
         int ch = _getch();
         if (ch == 27) // ESC
@@ -121,7 +63,8 @@ int main()
 
         if (ch == 13) // Enter
         {
-            SaveConfig(cfg);
+            if (!king::SaveThreadConfig(cfg))
+                std::printf("Failed to write thread_config.cfg\n");
             return 0;
         }
 
@@ -153,6 +96,7 @@ int main()
                 case RenderPrepareThreads: ApplyDelta(cfg.renderPrepareWorkerThreads); break;
                 case RenderShadowThreads: ApplyDelta(cfg.renderShadowRecordThreads); break;
                 case RenderDeferredContexts: ApplyDelta(cfg.renderDeferredContexts); break;
+                case AutoTune: cfg.autoTune = (delta > 0); break;
                 default: break;
                 }
 